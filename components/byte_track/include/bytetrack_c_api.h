@@ -28,7 +28,8 @@ bt_handler_t bt_tracker_create(const bt_config_t* config);
  * @param tracks Output array of tracks
  * @param num_tracks Number of tracks in the output array
  * @return Error code
- * @note The caller is responsible for freeing the memory of the output tracks array
+ * @note If *tracks is NULL the array is allocated and the caller is responsible for freeing it;
+ *       otherwise *tracks must hold *num_tracks entries, and *num_tracks is set to the number written
 */
 bt_error_t bt_tracker_update(
   bt_handler_t tracker, const bt_bbox_t* objects, size_t num_objects, bt_bbox_t** tracks, size_t* num_tracks);
@@ -202,9 +202,9 @@ vector<STrack> BYTETracker::update(const bt_bbox_t* objects, size_t num_objects)
     }
 
     this->lost_stracks = sub_stracks(this->lost_stracks, this->removed_stracks);
-    for (int i = 0; i < removed_stracks.size(); ++i) {
-        this->removed_stracks.push_back(removed_stracks[i]);
-    }
+    // only the last frame's removals are still in lost_stracks; keeping the
+    // whole history grows without bound on a device that never restarts
+    this->removed_stracks = removed_stracks;
 
     remove_duplicate_stracks(resa, resb, this->tracked_stracks, this->lost_stracks);
 
@@ -36,8 +36,8 @@ bt_error_t bt_tracker_update(
         return BT_ERR_OK;
     }
 
-    void* tracks_ptr = nullptr;
-    if (*tracks == nullptr) {
+    void* tracks_ptr = *tracks;
+    if (tracks_ptr == nullptr) {
         tracks_ptr = calloc(tracks_vec.size(), sizeof(bt_bbox_t));
         if (tracks_ptr == nullptr) {
             return BT_ERR_MEM_ALLOC_FAIL;
@@ -59,7 +59,8 @@ bt_error_t bt_tracker_update(
         track_ptr.track_id = track.track_id;
     }
 
-    *tracks = reinterpret_cast<bt_bbox_t*>(tracks_ptr);
+    *tracks     = reinterpret_cast<bt_bbox_t*>(tracks_ptr);
+    *num_tracks = size;
 
     return BT_ERR_OK;
 }
@@ -0,0 +1,43 @@
+# Opus from the one copy of its sources in the repo, the esp-libopus submodule of the
+# openai-realtime example. The firmware component (CMakeLists.txt) and the host tests both build
+# it through opus_sources(): fixed point with the float API, as the firmware runs it.
+if(NOT DEFINED OPUS_SUBMODULE_DIR)
+    get_filename_component(OPUS_SUBMODULE_DIR ${CMAKE_CURRENT_LIST_DIR}/../../examples/openai-realtime/components/esp-libopus ABSOLUTE)
+endif()
+
+# opus_sources(<prefix>) sets <prefix>_FOUND, <prefix>_DIR, <prefix>_SRCS, <prefix>_INCLUDE_DIRS,
+# <prefix>_PRIV_INCLUDE_DIRS, <prefix>_DEFINITIONS and <prefix>_OPTIONS
+macro(opus_sources prefix)
+    # the Opus tree is where src/opus_encoder.c is, at the top of the submodule or below it
+    file(GLOB_RECURSE _opus_hits ${OPUS_SUBMODULE_DIR}/opus_encoder.c)
+    list(FILTER _opus_hits INCLUDE REGEX "/src/opus_encoder\\.c$")
+    set(${prefix}_FOUND FALSE)
+    if(_opus_hits)
+        list(GET _opus_hits 0 _opus_hit)
+        get_filename_component(${prefix}_DIR ${_opus_hit} DIRECTORY)
+        get_filename_component(${prefix}_DIR ${${prefix}_DIR} DIRECTORY)
+        set(${prefix}_FOUND TRUE)
+
+        # no SIMD or DNN subdirectories, no programs with a main()
+        file(GLOB ${prefix}_SRCS
+            ${${prefix}_DIR}/celt/*.c
+            ${${prefix}_DIR}/silk/*.c
+            ${${prefix}_DIR}/silk/fixed/*.c
+            ${${prefix}_DIR}/src/*.c
+        )
+        list(FILTER ${prefix}_SRCS EXCLUDE REGEX "/(opus_custom_demo|opus_demo|opus_compare|repacketizer_demo)\\.c$")
+
+        set(${prefix}_INCLUDE_DIRS ${${prefix}_DIR}/include)
+        set(${prefix}_PRIV_INCLUDE_DIRS ${${prefix}_DIR} ${${prefix}_DIR}/celt ${${prefix}_DIR}/silk ${${prefix}_DIR}/silk/fixed)
+        set(${prefix}_DEFINITIONS OPUS_BUILD FIXED_POINT=1 USE_ALLOCA HAVE_LRINT HAVE_LRINTF)
+
+        # GCC 12 and later raise two false positives in the SILK encoder, kept as warnings here:
+        # -Wstringop-overread where the NSQ callers pass PredCoef_Q12[0] of a [2][MAX_LPC_ORDER]
+        # array for a 2 * MAX_LPC_ORDER parameter, -Wmaybe-uninitialized on the gain search
+        # variables of encode_frame
+        set(${prefix}_OPTIONS)
+        if(CMAKE_C_COMPILER_ID STREQUAL "GNU")
+            set(${prefix}_OPTIONS -Wno-error=stringop-overread -Wno-error=maybe-uninitialized)
+        endif()
+    endif()
+endmacro()
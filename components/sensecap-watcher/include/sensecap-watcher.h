@@ -345,6 +345,30 @@ esp_codec_dev_handle_t bsp_codec_microphone_get(void);
 esp_err_t bsp_get_feed_data(bool is_get_raw_channel, int16_t *buffer, int buffer_len);
 int bsp_get_feed_channel(void);
 
+/**
+ * @brief One read from the microphone, for timestamping audio.
+ *
+ * Reported after every bsp_i2s_read() and bsp_get_feed_data().  The
+ * samples read are the last len / frame_bytes the codec captured
+ * before done_us.  session changes whenever the record device is
+ * reopened or closed, so sample counting restarts.
+ */
+typedef struct
+{
+    size_t len;          /* bytes read */
+    int64_t done_us;     /* esp_timer time the read returned */
+    uint32_t rate;       /* sample rate of the record device */
+    uint8_t frame_bytes; /* bytes per sample frame */
+    uint32_t session;
+} bsp_mic_read_t;
+
+/**
+ * @brief Register the microphone read callback (NULL to clear).
+ *
+ * Called on the reading task, outside the codec lock; keep it short.
+ */
+void bsp_set_mic_read_cb(void (*cb)(const bsp_mic_read_t *read));
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -26,6 +26,10 @@ static sdmmc_card_t *card;
 static esp_codec_dev_handle_t play_dev_handle;
 static esp_codec_dev_handle_t record_dev_handle;
 static  SemaphoreHandle_t codec_mutex = NULL;
+static void (*mic_read_cb)(const bsp_mic_read_t *read) = NULL;
+static uint32_t mic_rate = DRV_AUDIO_SAMPLE_RATE;
+static uint8_t mic_frame_bytes = DRV_AUDIO_SAMPLE_BITS / 8 * DRV_AUDIO_I2S_CHANNEL;
+static uint32_t mic_session = 0;
 
 static i2s_chan_handle_t i2s_tx_chan = NULL;
 static i2s_chan_handle_t i2s_rx_chan = NULL;
@@ -1075,13 +1079,38 @@ esp_codec_dev_handle_t bsp_audio_codec_microphone_init(void)
     return esp_codec_dev_new(&codec_es7243_dev_cfg);
 }
 
+static void bsp_mic_read_done(esp_err_t ret, size_t len, int64_t done_us, uint32_t session)
+{
+    void (*cb)(const bsp_mic_read_t *read) = mic_read_cb;
+    if (cb == NULL || ret != ESP_OK)
+    {
+        return;
+    }
+    bsp_mic_read_t read = {
+        .len = len,
+        .done_us = done_us,
+        .rate = mic_rate,
+        .frame_bytes = mic_frame_bytes,
+        .session = session,
+    };
+    cb(&read);
+}
+
+void bsp_set_mic_read_cb(void (*cb)(const bsp_mic_read_t *read))
+{
+    mic_read_cb = cb;
+}
+
 esp_err_t bsp_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read, uint32_t timeout_ms)
 {
     esp_err_t ret = ESP_OK;
     xSemaphoreTake(codec_mutex, portMAX_DELAY);
     ret = esp_codec_dev_read(record_dev_handle, audio_buffer, len);
+    int64_t done_us = esp_timer_get_time();
+    uint32_t session = mic_session;
     xSemaphoreGive(codec_mutex);
     *bytes_read = len;
+    bsp_mic_read_done(ret, len, done_us, session);
 #if CONFIG_BSP_AUDIO_MIC_VALUE_GAIN > 0
     uint16_t *buffer = (uint16_t *)audio_buffer;
     for (size_t i = 0; i < len / 2; i++)
@@ -1132,6 +1161,9 @@ esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
         fs.channel = 2;
         fs.channel_mask = ESP_CODEC_DEV_MAKE_CHANNEL_MASK(1);
         ret |= esp_codec_dev_open(record_dev_handle, &fs);
+        mic_rate = rate;
+        mic_frame_bytes = bits_cfg / 8;
+        mic_session++;
     }
     xSemaphoreGive(codec_mutex);
     return ret;
@@ -1178,6 +1210,7 @@ esp_err_t bsp_codec_dev_stop(void)
     if (record_dev_handle)
     {
         ret = esp_codec_dev_close(record_dev_handle);
+        mic_session++;
     }
     xSemaphoreGive(codec_mutex); 
     return ret;
@@ -1217,11 +1250,14 @@ esp_err_t bsp_get_feed_data(bool is_get_raw_channel, int16_t *buffer, int buffer
 
     xSemaphoreTake(codec_mutex, portMAX_DELAY);
     ret = esp_codec_dev_read(record_dev_handle, (void *)buffer, buffer_len);
+    int64_t done_us = esp_timer_get_time();
+    uint32_t session = mic_session;
     xSemaphoreGive(codec_mutex); 
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to read data from codec device");
     }
+    bsp_mic_read_done(ret, buffer_len, done_us, session);
     // int audio_chunksize = buffer_len / (sizeof(int16_t) * DRV_AUDIO_I2S_CHANNEL);
     // if (!is_get_raw_channel)
     // {
@@ -1282,6 +1318,7 @@ sscma_client_handle_t bsp_sscma_client_init()
     sscma_client_config.event_queue_size = CONFIG_SSCMA_EVENT_QUEUE_SIZE;
     sscma_client_config.tx_buffer_size = CONFIG_SSCMA_TX_BUFFER_SIZE;
     sscma_client_config.rx_buffer_size = CONFIG_SSCMA_RX_BUFFER_SIZE;
+    sscma_client_config.rx_buffer_max_size = CONFIG_SSCMA_RX_BUFFER_MAX_SIZE;
     sscma_client_config.process_task_stack = CONFIG_SSCMA_PROCESS_TASK_STACK_SIZE;
     sscma_client_config.process_task_affinity = CONFIG_SSCMA_PROCESS_TASK_AFFINITY;
     sscma_client_config.process_task_priority = CONFIG_SSCMA_PROCESS_TASK_PRIORITY;
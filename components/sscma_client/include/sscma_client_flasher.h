@@ -20,6 +20,7 @@ typedef struct
 {
     int reset_gpio_num;                   /* !< GPIO number of reset pin */
     void *user_ctx;                       /*!< User private data */
+    void (*on_progress)(size_t written, void *user_ctx); /*!< Optional, called after each write with the bytes written since start */
     esp_io_expander_handle_t io_expander; /*!< IO expander handle */
     struct
     {
@@ -17,6 +17,7 @@ typedef struct
     int reset_gpio_num;                   /*!< GPIO number of reset pin */
     int tx_buffer_size;                   /*!< Size of TX buffer */
     int rx_buffer_size;                   /*!< Size of RX buffer */
+    int rx_buffer_max_size;               /*!< Max size the RX buffer may grow to (0 is no growth) */
     int process_task_priority;            /* SSCMA process task priority */
     int process_task_stack;               /* SSCMA process task stack size */
     int process_task_affinity;            /* SSCMA process task pinned to core (-1 is no
@@ -38,8 +39,8 @@ typedef struct
 
 #define SSCMA_CLIENT_CONFIG_DEFAULT()                                                                                                                                                                  \
     {                                                                                                                                                                                                  \
-        .reset_gpio_num = -1, .tx_buffer_size = 4096, .rx_buffer_size = 65536, .process_task_priority = 5, .process_task_stack = 4096, .process_task_affinity = -1, .monitor_task_priority = 4,        \
-        .monitor_task_stack = 10240, .monitor_task_affinity = -1, .event_queue_size = 2, .user_ctx = NULL,                                                                                             \
+        .reset_gpio_num = -1, .tx_buffer_size = 4096, .rx_buffer_size = 65536, .rx_buffer_max_size = 0, .process_task_priority = 5, .process_task_stack = 4096, .process_task_affinity = -1,           \
+        .monitor_task_priority = 4, .monitor_task_stack = 10240, .monitor_task_affinity = -1, .event_queue_size = 2, .user_ctx = NULL,                                                                 \
         .flags = {                                                                                                                                                                                     \
             .reset_active_high = false,                                                                                                                                                                \
         },                                                                                                                                                                                             \
@@ -132,6 +133,18 @@ esp_err_t sscma_client_available(sscma_client_handle_t client, size_t *ret_avail
  */
 esp_err_t sscma_client_register_callback(sscma_client_handle_t client, const sscma_client_callback_t *callback, void *user_ctx);
 
+/**
+ * @brief Get the registered callback
+ *
+ * @param[in] client SCCMA client handle
+ * @param[out] callback SCCMA client callback
+ * @param[out] user_ctx User context, may be NULL
+ * @return
+ *          - ESP_OK on success
+ *          - ESP_ERR_INVALID_ARG if client or callback is NULL
+ */
+esp_err_t sscma_client_get_callback(sscma_client_handle_t client, sscma_client_callback_t *callback, void **user_ctx);
+
 /**
  * @brief Clear reply
  *
@@ -278,6 +291,15 @@ esp_err_t sscma_client_get_confidence_threshold(sscma_client_handle_t client, in
  */
 esp_err_t sscma_client_set_model_info(sscma_client_handle_t client, const char *model_info);
 
+/**
+ * @brief Get reply framer statistics
+ * @param[in] client SCCMA client handle
+ * @param[out] stats framer statistics
+ * @return
+ *          - ESP_OK on success
+ */
+esp_err_t sscma_client_get_frame_stats(sscma_client_handle_t client, sscma_client_frame_stats_t *stats);
+
 /**
  * Fetch boxes and classes from sscma client reply
  * @param[in] reply sscma client reply
@@ -403,6 +425,16 @@ esp_err_t sscma_client_ota_start(sscma_client_handle_t client, const sscma_clien
  */
 esp_err_t sscma_client_ota_write(sscma_client_handle_t client, const void *data, size_t len);
 
+/**
+ * Move the ota write position, e.g. to skip blocks that are already up to date
+ * @param[in] client SCCMA client handle
+ * @param[in] offset new offset in file, same base as sscma_client_ota_start()
+ * @return
+ *          - ESP_OK on success
+ *          - ESP_ERR_NOT_SUPPORTED if the flasher can only write sequentially
+ */
+esp_err_t sscma_client_ota_seek(sscma_client_handle_t client, size_t offset);
+
 /**
  * Finish ota
  * @param[in] client SCCMA client handle
@@ -34,6 +34,7 @@ typedef struct
     cJSON *payload;
     char *data;
     size_t len;
+    int64_t ts_us; /* !< esp_timer time of the read that brought the frame start, 0 if unknown */
 } sscma_client_reply_t;
 
 /**
@@ -110,6 +111,26 @@ typedef struct
     sscma_client_point_t points[SSCMA_CLIENT_MODEL_KEYPOINTS_MAX];
 } sscma_client_keypoint_t;
 
+/**
+ * @brief State of the reply framer
+ */
+typedef enum
+{
+    SSCMA_CLIENT_FRAME_HUNT = 0,       /*!< Looking for the next frame boundary */
+    SSCMA_CLIENT_FRAME_BODY,           /*!< Reading a body up to the suffix */
+} sscma_client_frame_state_t;
+
+/**
+ * @brief Statistics of the reply framer
+ */
+typedef struct
+{
+    uint32_t frames;     /*!< Frames delivered */
+    uint32_t resyncs;    /*!< Frames dropped by resync (truncated or corrupted) */
+    uint32_t overflows;  /*!< Frames dropped for exceeding the rx buffer cap */
+    uint32_t dropped;    /*!< Frames dropped for lack of memory */
+} sscma_client_frame_stats_t;
+
 /**
  * @brief Callback function of SCCMA client
  * @param[in] client SCCMA client handle
@@ -169,6 +190,19 @@ struct sscma_client_t
         size_t len;            /* !< Data length */
         size_t pos;            /* !< Data position */
     } rx_buffer, tx_buffer;    /* !< RX and TX buffer */
+    struct
+    {
+        sscma_client_frame_state_t state; /* !< Framer state */
+        size_t scan;                      /* !< Position the suffix scan resumes from */
+        size_t max_len;                   /* !< Hard cap of rx buffer growth */
+        int64_t read_us;                  /* !< esp_timer time of the last read */
+        int64_t start_us;                 /* !< read_us when the frame being assembled started */
+        uint32_t frames;                  /* !< Statistics, see sscma_client_frame_stats_t */
+        uint32_t resyncs;
+        uint32_t overflows;
+        uint32_t dropped;
+    } framer;
+    volatile int break_pending; /* !< Number of pending AT+BREAK requests */
     QueueHandle_t reply_queue; /* !< Queue for reply message */
     List_t *request_list;      /* !< Request list */
 };
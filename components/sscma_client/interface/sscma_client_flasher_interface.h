@@ -30,6 +30,15 @@ struct sscma_client_flasher_t
      */
     esp_err_t (*write)(sscma_client_flasher_t *handle, const void *data, size_t len);
 
+    /**
+     * @brief Move the write position of a started transmitter, optional
+     * @param[in] handle transmitter handle
+     * @param[in] offset new offset, same base as start()
+     * @return
+     * - ESP_OK
+     */
+    esp_err_t (*seek)(sscma_client_flasher_t *handle, size_t offset);
+
     /**
      * @brief Start flasher transmitter
      * @param[in] handle transmitter handle
@@ -74,6 +83,16 @@ esp_err_t sscma_client_flasher_start(sscma_client_flasher_t *handle, size_t offs
  */
 esp_err_t sscma_client_flasher_write(sscma_client_flasher_t *handle, const void *data, size_t len);
 
+/**
+ * Move the write position of a started flasher transmitter
+ * @param[in] handle transmitter handle
+ * @param[in] offset new offset, same base as sscma_client_flasher_start()
+ * @return
+ * - ESP_OK
+ * - ESP_ERR_NOT_SUPPORTED if the transmitter can only write sequentially
+ */
+esp_err_t sscma_client_flasher_seek(sscma_client_flasher_t *handle, size_t offset);
+
 /**
  * Finish flasher transmitter
  * @param[in] handle transmitter handle
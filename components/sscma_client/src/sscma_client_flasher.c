@@ -18,6 +18,13 @@ esp_err_t sscma_client_flasher_write(sscma_client_flasher_handle_t handle, const
     return handle->write(handle, data, len);
 }
 
+esp_err_t sscma_client_flasher_seek(sscma_client_flasher_handle_t handle, size_t offset)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(handle->seek, ESP_ERR_NOT_SUPPORTED, TAG, "not supported");
+    return handle->seek(handle, offset);
+}
+
 esp_err_t sscma_client_flasher_finish(sscma_client_flasher_handle_t handle)
 {
     ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
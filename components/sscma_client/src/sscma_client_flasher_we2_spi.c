@@ -16,6 +16,7 @@
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 #include "sscma_client_commands.h"
 #include "sscma_client_io.h"
@@ -52,6 +53,14 @@ typedef enum {
 
 #define OTA_CHUNKED_SIZE (256)
 
+#ifndef CONFIG_SSCMA_FLASHER_SPI_BURST_PAGES
+#define CONFIG_SSCMA_FLASHER_SPI_BURST_PAGES 1
+#endif
+#define OTA_BURST_PAGES CONFIG_SSCMA_FLASHER_SPI_BURST_PAGES
+#define OTA_BURST_SIZE  (6 + OTA_BURST_PAGES * OTA_CHUNKED_SIZE)
+
+#define OTA_PP_TIMEOUT_US (3000000) // per page program
+
 #define OTA_CMD_WRITE        (0xF2)
 #define OTA_CMD_READ         (0xF3)
 #define OTA_ENABLE_REG       (0xD8)
@@ -63,6 +72,7 @@ typedef enum {
 
 static esp_err_t sscma_client_flasher_we2_start(sscma_client_flasher_handle_t flasher, size_t offset);
 static esp_err_t sscma_client_flasher_we2_write(sscma_client_flasher_handle_t flasher, const void *data, size_t len);
+static esp_err_t sscma_client_flasher_we2_seek(sscma_client_flasher_handle_t flasher, size_t offset);
 static esp_err_t sscma_client_flasher_we2_finish(sscma_client_flasher_handle_t flasher);
 static esp_err_t sscma_client_flasher_we2_abort(sscma_client_flasher_handle_t flasher);
 static esp_err_t sscma_client_flasher_we2_del(sscma_client_flasher_handle_t flasher);
@@ -78,9 +88,78 @@ typedef struct
     uint32_t count;                       /*!< The Page Program Count. */
     void *user_ctx;                       /* !< User context */
     uint8_t data[OTA_CHUNKED_SIZE + 6];   /* !< The data buffer. */
+    uint8_t *burst;                       /* !< DMA capable buffer for page bursts. */
+    size_t written;                       /* !< Bytes written since start. */
+    int64_t start_time;                   /* !< Time the transfer started. */
+    void (*on_progress)(size_t written, void *user_ctx); /* !< Progress callback */
     SemaphoreHandle_t lock;               /*!< The lock. */
 } sscma_client_flasher_we2_spi_t;
 
+/*
+ * Wait until the WE2 has programmed `count` pages in total.
+ * Small register transactions use polling mode, which avoids the
+ * interrupt round trip that dominates transfers of a few bytes.
+ */
+static esp_err_t we2_spi_wait_pp_done(sscma_client_flasher_we2_spi_t *flasher_we2, int64_t timeout_us)
+{
+    esp_err_t ret = ESP_OK;
+    int64_t start = esp_timer_get_time();
+    uint32_t status = 0xFFFFFFFF;
+    spi_transaction_t spi_trans = {};
+
+    do
+    {
+        flasher_we2->data[0] = OTA_CMD_WRITE;
+        flasher_we2->data[1] = 0x00;
+        flasher_we2->data[2] = (OTA_PPDONE_COUNT_ADDR & 0xFF);
+        flasher_we2->data[3] = (OTA_PPDONE_COUNT_ADDR >> 8) & 0xFF;
+        flasher_we2->data[4] = (OTA_PPDONE_COUNT_ADDR >> 16) & 0xFF;
+        flasher_we2->data[5] = (OTA_PPDONE_COUNT_ADDR >> 24) & 0xFF;
+        spi_trans.length = (6) * 8;
+        spi_trans.tx_buffer = flasher_we2->data;
+        spi_trans.rx_buffer = NULL;
+        spi_trans.rxlength = 0;
+        ESP_RETURN_ON_ERROR(spi_device_polling_transmit(flasher_we2->io->handle, &spi_trans), TAG, "spi transmit failed");
+
+        flasher_we2->data[0] = OTA_CMD_WRITE;
+        flasher_we2->data[1] = OTA_STATUS_REG;
+        flasher_we2->data[2] = 0;
+        spi_trans.length = (3) * 8;
+        spi_trans.tx_buffer = flasher_we2->data;
+        spi_trans.rx_buffer = NULL;
+        spi_trans.rxlength = 0;
+        ESP_RETURN_ON_ERROR(spi_device_polling_transmit(flasher_we2->io->handle, &spi_trans), TAG, "spi transmit failed");
+
+        status = 0;
+        memset(&flasher_we2->data[0], 0x00, 7);
+        memset(&flasher_we2->data[7], 0xFF, 7);
+        flasher_we2->data[0] = OTA_CMD_READ;
+        flasher_we2->data[1] = 0x08;
+        flasher_we2->data[2] = 0x00;
+        spi_trans.length = 7 * 8;
+        spi_trans.tx_buffer = &flasher_we2->data[0];
+        spi_trans.rx_buffer = &flasher_we2->data[7];
+        spi_trans.rxlength = 7 * 8;
+        ESP_RETURN_ON_ERROR(spi_device_polling_transmit(flasher_we2->io->handle, &spi_trans), TAG, "spi transmit failed");
+        memcpy(&status, &flasher_we2->data[10], 4);
+        if ((esp_timer_get_time() - start) > timeout_us)
+        {
+            ESP_LOGE(TAG, "Timeout");
+            return ESP_ERR_TIMEOUT;
+        }
+        taskYIELD();
+    }
+    while (!((status >> 28) == 1 || (status & 0xFFFFF) == flasher_we2->count));
+    // CRC Error
+    if (((status >> 28) == 1) || (status >> 28) == 3)
+    {
+        ESP_LOGE(TAG, "CRC Error");
+        ret = ESP_FAIL;
+    }
+
+    return ret;
+}
+
 esp_err_t sscma_client_new_flasher_we2_spi(const sscma_client_io_handle_t io, const sscma_client_flasher_we2_config_t *config, sscma_client_flasher_handle_t *ret_flasher)
 {
     esp_err_t ret = ESP_OK;
@@ -96,9 +175,12 @@ esp_err_t sscma_client_new_flasher_we2_spi(const sscma_client_io_handle_t io, co
     flasher_we2->reset_level = config->flags.reset_high_active ? 1 : 0;
 
     flasher_we2->io = io;
+    flasher_we2->user_ctx = config->user_ctx;
+    flasher_we2->on_progress = config->on_progress;
 
     flasher_we2->base.start = sscma_client_flasher_we2_start;
     flasher_we2->base.write = sscma_client_flasher_we2_write;
+    flasher_we2->base.seek = sscma_client_flasher_we2_seek;
     flasher_we2->base.finish = sscma_client_flasher_we2_finish;
     flasher_we2->base.abort = sscma_client_flasher_we2_abort;
     flasher_we2->base.del = sscma_client_flasher_we2_del;
@@ -118,6 +200,9 @@ esp_err_t sscma_client_new_flasher_we2_spi(const sscma_client_io_handle_t io, co
         ESP_GOTO_ON_ERROR(gpio_config(&io_conf), err, TAG, "configure GPIO for RST line failed");
     }
 
+    flasher_we2->burst = heap_caps_malloc(OTA_BURST_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    ESP_GOTO_ON_FALSE(flasher_we2->burst, ESP_ERR_NO_MEM, err, TAG, "no mem for burst buffer");
+
     flasher_we2->lock = xSemaphoreCreateMutex();
 
     ESP_GOTO_ON_FALSE(flasher_we2->lock, ESP_ERR_NO_MEM, err, TAG, "no mem for flasher lock");
@@ -127,6 +212,10 @@ esp_err_t sscma_client_new_flasher_we2_spi(const sscma_client_io_handle_t io, co
     return ESP_OK;
 
 err:
+    if (flasher_we2->burst != NULL)
+    {
+        heap_caps_free(flasher_we2->burst);
+    }
     if (flasher_we2->lock != NULL)
     {
         vSemaphoreDelete(flasher_we2->lock);
@@ -153,6 +242,10 @@ err:
 esp_err_t sscma_client_flasher_we2_del(sscma_client_flasher_handle_t flasher)
 {
     sscma_client_flasher_we2_spi_t *flasher_we2 = __containerof(flasher, sscma_client_flasher_we2_spi_t, base);
+    if (flasher_we2->burst != NULL)
+    {
+        heap_caps_free(flasher_we2->burst);
+    }
     if (flasher_we2->lock != NULL)
     {
         vSemaphoreDelete(flasher_we2->lock);
@@ -178,10 +271,8 @@ esp_err_t sscma_client_flasher_we2_del(sscma_client_flasher_handle_t flasher)
 static esp_err_t sscma_client_flasher_we2_start(sscma_client_flasher_handle_t flasher, size_t offset)
 {
     esp_err_t ret = ESP_OK;
-    int64_t start = 0;
     uint32_t addr = 0;
     size_t remain = 0;
-    uint32_t status = 0;
     sscma_client_flasher_we2_spi_t *flasher_we2 = __containerof(flasher, sscma_client_flasher_we2_spi_t, base);
     spi_transaction_t spi_trans = {};
 
@@ -190,6 +281,8 @@ static esp_err_t sscma_client_flasher_we2_start(sscma_client_flasher_handle_t fl
 
     flasher_we2->count = 0;
     flasher_we2->offset = offset;
+    flasher_we2->written = 0;
+    flasher_we2->start_time = esp_timer_get_time();
 
     ESP_GOTO_ON_ERROR(spi_device_acquire_bus(flasher_we2->io->handle, portMAX_DELAY), err, TAG, "acquire spi bus failed");
 
@@ -288,72 +381,10 @@ static esp_err_t sscma_client_flasher_we2_start(sscma_client_flasher_handle_t fl
             flasher_we2->count++;
 
             // check status
-            start = esp_timer_get_time();
-            status = 0xFFFFFFFF;
-            do
-            {
-                flasher_we2->data[0] = OTA_CMD_WRITE;
-                flasher_we2->data[1] = 0x00;
-                flasher_we2->data[2] = (OTA_PPDONE_COUNT_ADDR & 0xFF);
-                flasher_we2->data[3] = (OTA_PPDONE_COUNT_ADDR >> 8) & 0xFF;
-                flasher_we2->data[4] = (OTA_PPDONE_COUNT_ADDR >> 16) & 0xFF;
-                flasher_we2->data[5] = (OTA_PPDONE_COUNT_ADDR >> 24) & 0xFF;
-                spi_trans.length = (6) * 8;
-                spi_trans.tx_buffer = &flasher_we2->data;
-                spi_trans.rx_buffer = NULL;
-                spi_trans.rxlength = 0;
-                ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-                if (ret != ESP_OK)
-                {
-                    spi_device_release_bus(flasher_we2->io->handle);
-                    goto err;
-                }
-
-                flasher_we2->data[0] = OTA_CMD_WRITE;
-                flasher_we2->data[1] = OTA_STATUS_REG;
-                flasher_we2->data[2] = 0;
-                spi_trans.length = (3) * 8;
-                spi_trans.tx_buffer = &flasher_we2->data;
-                spi_trans.rx_buffer = NULL;
-                spi_trans.rxlength = 0;
-                ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-                if (ret != ESP_OK)
-                {
-                    spi_device_release_bus(flasher_we2->io->handle);
-                    goto err;
-                }
-                status = 0;
-                memset(&flasher_we2->data[0], 0x00, 7);
-                memset(&flasher_we2->data[7], 0xFF, 7);
-                flasher_we2->data[0] = OTA_CMD_READ;
-                flasher_we2->data[1] = 0x08;
-                flasher_we2->data[2] = 0x00;
-                spi_trans.length = 7 * 8;
-                spi_trans.tx_buffer = &flasher_we2->data[0];
-                spi_trans.rx_buffer = &flasher_we2->data[7];
-                spi_trans.rxlength = 7 * 8;
-                ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-                if (ret != ESP_OK)
-                {
-                    spi_device_release_bus(flasher_we2->io->handle);
-                    goto err;
-                }
-                memcpy(&status, &flasher_we2->data[10], 4);
-                if ((esp_timer_get_time() - start) > 10000000)
-                {
-                    spi_device_release_bus(flasher_we2->io->handle);
-                    ESP_LOGE(TAG, "Timeout");
-                    ret = ESP_ERR_TIMEOUT;
-                    goto err;
-                }
-                taskYIELD();
-            }
-            while (!((status >> 28) == 1 || (status & 0xFFFFF) == flasher_we2->count));
-            // CRC Error
-            if (((status >> 28) == 1) || (status >> 28) == 3)
+            ret = we2_spi_wait_pp_done(flasher_we2, 10000000);
+            if (ret != ESP_OK)
             {
-                ESP_LOGE(TAG, "CRC Error");
-                ret = ESP_FAIL;
+                spi_device_release_bus(flasher_we2->io->handle);
                 goto err;
             }
         }
@@ -396,10 +427,9 @@ err:
 static esp_err_t sscma_client_flasher_we2_write(sscma_client_flasher_handle_t flasher, const void *data, size_t len)
 {
     esp_err_t ret = ESP_OK;
-    int64_t start = 0;
     size_t remain = len;
+    size_t pages = 0;
     uint32_t addr = 0;
-    uint32_t status = 0;
     spi_transaction_t spi_trans = {};
     sscma_client_flasher_we2_spi_t *flasher_we2 = __containerof(flasher, sscma_client_flasher_we2_spi_t, base);
     assert(len % OTA_CHUNKED_SIZE == 0);
@@ -409,17 +439,22 @@ static esp_err_t sscma_client_flasher_we2_write(sscma_client_flasher_handle_t fl
     ESP_GOTO_ON_ERROR(spi_device_acquire_bus(flasher_we2->io->handle, portMAX_DELAY), err, TAG, "acquire spi bus failed");
     do
     {
-        // write chunk
+        // write up to OTA_BURST_PAGES consecutive pages in one DMA transaction
+        pages = remain / OTA_CHUNKED_SIZE;
+        if (pages > OTA_BURST_PAGES)
+        {
+            pages = OTA_BURST_PAGES;
+        }
         addr = OTA_BASE_ADDR + flasher_we2->offset;
-        flasher_we2->data[0] = OTA_CMD_WRITE;
-        flasher_we2->data[1] = 0x00;
-        flasher_we2->data[2] = (addr & 0xFF);
-        flasher_we2->data[3] = (addr >> 8) & 0xFF;
-        flasher_we2->data[4] = (addr >> 16) & 0xFF;
-        flasher_we2->data[5] = (addr >> 24) & 0xFF;
-        memcpy(&flasher_we2->data[6], (uint8_t *)data + (len - remain), OTA_CHUNKED_SIZE);
-        spi_trans.length = (6 + OTA_CHUNKED_SIZE) * 8;
-        spi_trans.tx_buffer = flasher_we2->data;
+        flasher_we2->burst[0] = OTA_CMD_WRITE;
+        flasher_we2->burst[1] = 0x00;
+        flasher_we2->burst[2] = (addr & 0xFF);
+        flasher_we2->burst[3] = (addr >> 8) & 0xFF;
+        flasher_we2->burst[4] = (addr >> 16) & 0xFF;
+        flasher_we2->burst[5] = (addr >> 24) & 0xFF;
+        memcpy(&flasher_we2->burst[6], (uint8_t *)data + (len - remain), pages * OTA_CHUNKED_SIZE);
+        spi_trans.length = (6 + pages * OTA_CHUNKED_SIZE) * 8;
+        spi_trans.tx_buffer = flasher_we2->burst;
         spi_trans.rx_buffer = NULL;
         spi_trans.rxlength = 0;
         ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
@@ -428,88 +463,46 @@ static esp_err_t sscma_client_flasher_we2_write(sscma_client_flasher_handle_t fl
             spi_device_release_bus(flasher_we2->io->handle);
             goto err;
         }
-        remain -= OTA_CHUNKED_SIZE;
-        flasher_we2->offset += OTA_CHUNKED_SIZE;
-        flasher_we2->count++;
+        remain -= pages * OTA_CHUNKED_SIZE;
+        flasher_we2->offset += pages * OTA_CHUNKED_SIZE;
+        flasher_we2->count += pages;
 
         // check status
-        start = esp_timer_get_time();
-        status = 0xFFFFFFFF;
-        do
-        {
-            flasher_we2->data[0] = OTA_CMD_WRITE;
-            flasher_we2->data[1] = 0x00;
-            flasher_we2->data[2] = (OTA_PPDONE_COUNT_ADDR & 0xFF);
-            flasher_we2->data[3] = (OTA_PPDONE_COUNT_ADDR >> 8) & 0xFF;
-            flasher_we2->data[4] = (OTA_PPDONE_COUNT_ADDR >> 16) & 0xFF;
-            flasher_we2->data[5] = (OTA_PPDONE_COUNT_ADDR >> 24) & 0xFF;
-            spi_trans.length = (6) * 8;
-            spi_trans.tx_buffer = &flasher_we2->data;
-            spi_trans.rx_buffer = NULL;
-            spi_trans.rxlength = 0;
-            ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-            if (ret != ESP_OK)
-            {
-                spi_device_release_bus(flasher_we2->io->handle);
-                goto err;
-            }
-
-            flasher_we2->data[0] = OTA_CMD_WRITE;
-            flasher_we2->data[1] = OTA_STATUS_REG;
-            flasher_we2->data[2] = 0;
-            spi_trans.length = (3) * 8;
-            spi_trans.tx_buffer = &flasher_we2->data;
-            spi_trans.rx_buffer = NULL;
-            spi_trans.rxlength = 0;
-            ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-            if (ret != ESP_OK)
-            {
-                spi_device_release_bus(flasher_we2->io->handle);
-                goto err;
-            }
-            status = 0;
-            memset(&flasher_we2->data[0], 0x00, 7);
-            memset(&flasher_we2->data[7], 0xFF, 7);
-            flasher_we2->data[0] = OTA_CMD_READ;
-            flasher_we2->data[1] = 0x08;
-            flasher_we2->data[2] = 0x00;
-            spi_trans.length = 7 * 8;
-            spi_trans.tx_buffer = &flasher_we2->data[0];
-            spi_trans.rx_buffer = &flasher_we2->data[7];
-            spi_trans.rxlength = 7 * 8;
-            ret = spi_device_transmit(flasher_we2->io->handle, &spi_trans);
-            if (ret != ESP_OK)
-            {
-                spi_device_release_bus(flasher_we2->io->handle);
-                goto err;
-            }
-            memcpy(&status, &flasher_we2->data[10], 4);
-            if ((esp_timer_get_time() - start) > 3000000)
-            {
-                spi_device_release_bus(flasher_we2->io->handle);
-                ESP_LOGE(TAG, "Timeout");
-                ret = ESP_ERR_TIMEOUT;
-                goto err;
-            }
-            taskYIELD();
-        }
-        while (!((status >> 28) == 1 || (status & 0xFFFFF) == flasher_we2->count));
-        // CRC Error
-        if (((status >> 28) == 1) || (status >> 28) == 3)
+        ret = we2_spi_wait_pp_done(flasher_we2, OTA_PP_TIMEOUT_US * pages);
+        if (ret != ESP_OK)
         {
-            ESP_LOGE(TAG, "CRC Error");
-            ret = ESP_FAIL;
+            spi_device_release_bus(flasher_we2->io->handle);
             goto err;
         }
     }
     while (remain > 0);
 
     spi_device_release_bus(flasher_we2->io->handle);
+
+    flasher_we2->written += len;
+    if (flasher_we2->on_progress)
+    {
+        flasher_we2->on_progress(flasher_we2->written, flasher_we2->user_ctx);
+    }
 err:
     xSemaphoreGive(flasher_we2->lock);
 
     return ret;
 }
+static esp_err_t sscma_client_flasher_we2_seek(sscma_client_flasher_handle_t flasher, size_t offset)
+{
+    sscma_client_flasher_we2_spi_t *flasher_we2 = __containerof(flasher, sscma_client_flasher_we2_spi_t, base);
+
+    // every page is addressed explicitly, so moving the offset is all a seek takes
+    ESP_RETURN_ON_FALSE(offset % OTA_CHUNKED_SIZE == 0 && offset < OTA_MAX_OFFSET, ESP_ERR_INVALID_ARG, TAG, "invalid offset");
+
+    xSemaphoreTake(flasher_we2->lock, portMAX_DELAY);
+    flasher_we2->offset = offset;
+    xSemaphoreGive(flasher_we2->lock);
+
+    return ESP_OK;
+}
+
 static esp_err_t sscma_client_flasher_we2_finish(sscma_client_flasher_handle_t flasher)
 {
     esp_err_t ret = ESP_OK;
@@ -531,6 +524,10 @@ static esp_err_t sscma_client_flasher_we2_finish(sscma_client_flasher_handle_t f
 
     spi_device_release_bus(flasher_we2->io->handle);
 
+    int64_t elapsed = esp_timer_get_time() - flasher_we2->start_time;
+    ESP_LOGI(TAG, "spi: %u bytes in %lld ms (%u B/s, %d page burst)", (unsigned)flasher_we2->written, (long long)(elapsed / 1000),
+             elapsed > 0 ? (unsigned)(flasher_we2->written * 1000000LL / elapsed) : 0, OTA_BURST_PAGES);
+
 err:
     if (flasher_we2->reset_gpio_num >= 0)
     {
@@ -44,9 +44,20 @@ static const char *TAG = "sscma_client.flasher.we2.uart";
 #define XEOF  0x1A
 
 #define XMODEM_BLOCK_SIZE     128
+#define XMODEM_1K_BLOCK_SIZE  1024
+#define XMODEM_PACKET_SIZE    (3 + XMODEM_1K_BLOCK_SIZE + 2)
 #define XMODEM_RX_BUFFER_SIZE 1024
 
+#ifndef CONFIG_SSCMA_FLASHER_XMODEM_WINDOW
+#define CONFIG_SSCMA_FLASHER_XMODEM_WINDOW 1
+#endif
+#define XMODEM_WINDOW CONFIG_SSCMA_FLASHER_XMODEM_WINDOW
+
+#define XMODEM_DRAIN_IDLE_MS 20   // line quiet time before go-back retransmit
+#define XMODEM_DRAIN_MAX_MS  1000
+
 #define WRITE_BLOCK_MAX_RETRIES      15
+#define WRITE_BLOCK_MAX_TIMEOUTS     2     // ACK timeouts in a row that retire no block
 #define TRANSFER_ACK_TIMEOUT         30000 // 30 seconds
 #define TRANSFER_EOT_TIMEOUT         30000 // 30 seconds
 #define TRANSFER_ETB_TIMEOUT         30000 // 30 seconds
@@ -80,19 +91,6 @@ typedef enum {
     FINAL,
 } xmodem_state_t;
 
-typedef struct xmodem_packet_t
-{
-    uint8_t preamble;
-    uint8_t id;
-    uint8_t id_complement;
-    uint8_t data[XMODEM_BLOCK_SIZE];
-    union
-    {
-        uint8_t data[2];
-        uint16_t value;
-    } crc;
-} __attribute__((packed, aligned(1))) xmodem_packet_t;
-
 typedef struct
 {
     sscma_client_flasher_t base;          /*!< The base class. */
@@ -103,8 +101,8 @@ typedef struct
     void *user_ctx;                       /* !< User context */
     SemaphoreHandle_t lock;               /*!< The lock. */
     xmodem_state_t state;                 /*!< The state of the flasher. */
-    xmodem_packet_t cur_packet;           /*!< The current packet being transmitted. */
-    uint8_t cur_packet_id;                /*!< The ID of the current packet. */
+    uint8_t cur_packet[XMODEM_PACKET_SIZE]; /*!< The packet being transmitted. */
+    uint8_t cur_packet_id;                /*!< The ID of the next packet to be acknowledged. */
     int64_t cur_time;                     /*!< The current time. */
     struct
     {
@@ -114,6 +112,9 @@ typedef struct
     } rx_buffer, tx_buffer; /* !< RX and TX buffer */
     uint32_t xfer_size;
     uint8_t write_block_retries; /*!< The write block retries. */
+    size_t written;              /*!< Bytes acknowledged since start. */
+    int64_t start_time;          /*!< Time the transfer started. */
+    void (*on_progress)(size_t written, void *user_ctx); /*!< Progress callback */
 } sscma_client_flasher_we2_uart_t;
 
 static inline bool xmodem_calculate_crc(const uint8_t *data, const uint32_t size, uint16_t *result)
@@ -152,22 +153,6 @@ static inline bool xmodem_calculate_crc(const uint8_t *data, const uint32_t size
     return status;
 }
 
-static inline bool xmodem_verify_packet(const xmodem_packet_t packet, uint8_t expected_packet_id)
-{
-    bool status = false;
-    uint8_t crc_status = false;
-    uint16_t calculated_crc = 0;
-
-    crc_status = xmodem_calculate_crc(packet.data, XMODEM_BLOCK_SIZE, &calculated_crc);
-
-    if (packet.preamble == XSOH && packet.id == expected_packet_id && packet.id_complement == 0xFF - packet.id && crc_status && calculated_crc == packet.crc.value)
-    {
-        status = true;
-    }
-
-    return status;
-}
-
 static inline bool xmodem_timeout(sscma_client_flasher_we2_uart_t *flasher_we2, int64_t timeout)
 {
     if (esp_timer_get_time() - flasher_we2->cur_time >= (timeout * 1000))
@@ -185,7 +170,6 @@ static xmodem_state_t xmodem_process(sscma_client_flasher_we2_uart_t *flasher)
     uint8_t response = 0;
     uint8_t ctrl = 0;
     size_t rlen = 0;
-    uint16_t crc = 0;
 
     switch (flasher->state)
     {
@@ -210,96 +194,6 @@ static xmodem_state_t xmodem_process(sscma_client_flasher_we2_uart_t *flasher)
             }
             break;
         }
-        case WRITE_BLOCK: {
-            if (flasher->tx_buffer.data == NULL || flasher->tx_buffer.len == 0)
-            {
-                break;
-            }
-            /* setup current packet */
-            if (flasher->cur_packet.id != flasher->cur_packet_id || flasher->cur_packet_id == 1)
-            {
-                flasher->cur_packet.preamble = XSOH;
-                flasher->cur_packet.id = flasher->cur_packet_id;
-                flasher->cur_packet.id_complement = 0xFF - flasher->cur_packet_id;
-                memset(flasher->cur_packet.data, 0xFF, XMODEM_BLOCK_SIZE);
-                flasher->xfer_size = flasher->tx_buffer.len - flasher->tx_buffer.pos > XMODEM_BLOCK_SIZE ? XMODEM_BLOCK_SIZE : flasher->tx_buffer.len - flasher->tx_buffer.pos;
-                memcpy(flasher->cur_packet.data, flasher->tx_buffer.data + flasher->tx_buffer.pos, flasher->xfer_size);
-                xmodem_calculate_crc(flasher->cur_packet.data, XMODEM_BLOCK_SIZE, &crc);
-                flasher->cur_packet.crc.value = crc;
-            }
-            sscma_client_io_write(flasher->io, (uint8_t *)&flasher->cur_packet, sizeof(xmodem_packet_t));
-            flasher->cur_packet_id++;
-            flasher->tx_buffer.pos += flasher->xfer_size;
-            flasher->state = WAIT_FOR_C_ACK;
-            flasher->cur_time = esp_timer_get_time();
-
-            break;
-        }
-        case WAIT_WRITE_BLOCK: {
-            if (flasher->tx_buffer.data != NULL && flasher->tx_buffer.len != 0)
-            {
-                flasher->state = WRITE_BLOCK;
-            }
-            break;
-        }
-        case WAIT_FOR_C_ACK: {
-            if (sscma_client_io_available(flasher->io, &rlen) == ESP_OK && rlen)
-            {
-                sscma_client_io_read(flasher->io, &response, 1);
-                flasher->cur_time = esp_timer_get_time();
-                switch (response)
-                {
-                    case XACK: {
-                        flasher->state = C_ACK_RECEIVED;
-                        break;
-                    }
-                    case XNACK: {
-                        flasher->state = WRITE_BLOCK_FAILED;
-                        break;
-                    }
-                    case XEOF: {
-                        flasher->state = COMPLETE;
-                        break;
-                    }
-                    default:
-                        break;
-                }
-            }
-            else if (xmodem_timeout(flasher, TRANSFER_ACK_TIMEOUT))
-            {
-                flasher->state = WRITE_BLOCK_TIMEOUT;
-            }
-            break;
-        }
-        case WRITE_BLOCK_FAILED: {
-            if (flasher->write_block_retries > WRITE_BLOCK_MAX_RETRIES)
-            {
-                flasher->state = ABORT_TRANSFER;
-            }
-            else
-            {
-                flasher->state = WRITE_BLOCK;
-                flasher->cur_packet_id--;
-                flasher->tx_buffer.pos -= flasher->xfer_size;
-                flasher->write_block_retries++;
-            }
-            break;
-        }
-        case C_ACK_RECEIVED: {
-            if (flasher->tx_buffer.pos >= flasher->tx_buffer.len)
-            {
-                flasher->tx_buffer.len = 0;
-                flasher->tx_buffer.data = NULL;
-                flasher->state = WAIT_WRITE_BLOCK;
-            }
-            else
-            {
-                flasher->write_block_retries = 0;
-                flasher->state = WRITE_BLOCK;
-            }
-
-            break;
-        }
         case WRITE_EOT: {
             ctrl = XEOT;
             sscma_client_io_write(flasher->io, (uint8_t *)&ctrl, sizeof(char));
@@ -344,10 +238,6 @@ static xmodem_state_t xmodem_process(sscma_client_flasher_we2_uart_t *flasher)
             flasher->state = ABORT_TRANSFER;
             break;
         }
-        case WRITE_BLOCK_TIMEOUT: {
-            flasher->state = WRITE_BLOCK_FAILED;
-            break;
-        }
         default: {
             flasher->state = ABORT_TRANSFER;
             break;
@@ -387,37 +277,191 @@ esp_err_t xmodem_start(sscma_client_flasher_we2_uart_t *flasher)
     return ret;
 }
 
+static inline size_t xmodem_block_size(size_t remain)
+{
+#if CONFIG_SSCMA_FLASHER_XMODEM_1K
+    if (remain >= XMODEM_1K_BLOCK_SIZE)
+    {
+        return XMODEM_1K_BLOCK_SIZE;
+    }
+#endif
+    return XMODEM_BLOCK_SIZE;
+}
+
+static void xmodem_send_block(sscma_client_flasher_we2_uart_t *flasher, uint8_t id, const uint8_t *data, size_t remain)
+{
+    size_t size = xmodem_block_size(remain);
+    size_t fill = remain < size ? remain : size;
+    uint16_t crc = 0;
+
+    flasher->cur_packet[0] = size == XMODEM_1K_BLOCK_SIZE ? XSTX : XSOH;
+    flasher->cur_packet[1] = id;
+    flasher->cur_packet[2] = 0xFF - id;
+    memcpy(&flasher->cur_packet[3], data, fill);
+    memset(&flasher->cur_packet[3 + fill], 0xFF, size - fill);
+    xmodem_calculate_crc(&flasher->cur_packet[3], size, &crc);
+    memcpy(&flasher->cur_packet[3 + size], &crc, sizeof(crc));
+
+    sscma_client_io_write(flasher->io, flasher->cur_packet, 3 + size + 2);
+}
+
+/*
+ * Discard late responses to blocks that were in flight before a go-back.
+ * Returns the ACKs that came before any other response: after a timeout
+ * they still belong to the oldest blocks in flight.
+ */
+static int xmodem_drain(sscma_client_flasher_we2_uart_t *flasher)
+{
+    int64_t start = esp_timer_get_time();
+    int64_t quiet = start;
+    size_t rlen = 0;
+    uint8_t c = 0;
+    int acks = 0;
+    bool in_order = true;
+
+    while ((esp_timer_get_time() - quiet) / 1000 < XMODEM_DRAIN_IDLE_MS && (esp_timer_get_time() - start) / 1000 < XMODEM_DRAIN_MAX_MS)
+    {
+        if (sscma_client_io_available(flasher->io, &rlen) == ESP_OK && rlen)
+        {
+            while (rlen--)
+            {
+                sscma_client_io_read(flasher->io, &c, 1);
+                if (c == XACK && in_order)
+                {
+                    acks++;
+                }
+                else
+                {
+                    in_order = false;
+                }
+            }
+            quiet = esp_timer_get_time();
+        }
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+
+    return acks;
+}
+
+/*
+ * Go-back-N over XMODEM: keep up to XMODEM_WINDOW blocks in flight and
+ * match ACKs to blocks in order.  A NACK rewinds to the oldest
+ * unacknowledged block.  ACKs that turn up late after an ACK timeout
+ * still retire blocks, so the resend doesn't repeat blocks the receiver
+ * took and the ACK count stays in step with it.  A timeout that retires
+ * nothing is resent once, for a lost block or ACK; if the resend times
+ * out as well the write ends, so a dead WE2 costs two TRANSFER_ACK_TIMEOUT
+ * rather than one per retry.  An EOF from the receiver ends the transfer
+ * before all of the write was taken, it fails the write.
+ * This relies on the receiver dropping the blocks that follow a corrupted
+ * one and ACKing duplicates; a standard XMODEM receiver cancels on an
+ * out-of-sequence block instead, so windows above 1 are unverified
+ * against the WE2 bootloader.
+ * With a window of 1 this is plain stop-and-wait.
+ */
 esp_err_t xmodem_write(sscma_client_flasher_we2_uart_t *flasher, const void *data, size_t len)
 {
-    esp_err_t ret = ESP_OK;
+    const uint8_t *buf = (const uint8_t *)data;
+    size_t base = 0;
+    size_t next = 0;
+    uint8_t base_id = flasher->cur_packet_id;
+    uint8_t next_id = base_id;
+    int inflight = 0;
+    uint8_t response = 0;
+    size_t rlen = 0;
+    int timeouts = 0;
 
-    flasher->tx_buffer.data = (char *)data;
-    flasher->tx_buffer.pos = 0;
-    flasher->tx_buffer.len = len;
-    flasher->xfer_size = 0;
+    flasher->write_block_retries = 0;
 
-    do
+    while (base < len)
     {
-        xmodem_process(flasher);
-        if (flasher->state == WAIT_WRITE_BLOCK)
+        while (inflight < XMODEM_WINDOW && next < len)
         {
-            ret = ESP_OK;
-            break;
+            xmodem_send_block(flasher, next_id, buf + next, len - next);
+            next += xmodem_block_size(len - next);
+            next_id++;
+            inflight++;
         }
-        if (flasher->state == WRITE_BLOCK_TIMEOUT)
+
+        response = 0;
+        flasher->cur_time = esp_timer_get_time();
+        do
         {
-            ret = ESP_ERR_TIMEOUT;
-            break;
+            if (sscma_client_io_available(flasher->io, &rlen) == ESP_OK && rlen)
+            {
+                sscma_client_io_read(flasher->io, &response, 1);
+                break;
+            }
         }
-        if (flasher->state == FAILED)
+        while (!xmodem_timeout(flasher, TRANSFER_ACK_TIMEOUT));
+
+        switch (response)
         {
-            ret = ESP_FAIL;
-            break;
+            case XACK: {
+                base += xmodem_block_size(len - base);
+                base_id++;
+                inflight--;
+                flasher->write_block_retries = 0;
+                timeouts = 0;
+                break;
+            }
+            case XCAN: {
+                ESP_LOGE(TAG, "transfer cancelled by receiver");
+                flasher->state = FINAL;
+                return ESP_FAIL;
+            }
+            case XEOF: {
+                ESP_LOGE(TAG, "block %u: transfer ended by receiver", base_id);
+                flasher->state = COMPLETE;
+                xmodem_process(flasher);
+                return ESP_FAIL;
+            }
+            case 0:
+            case XNACK: {
+                int late = inflight > 1 || !response ? xmodem_drain(flasher) : 0;
+                timeouts = response || late > 0 ? 0 : timeouts + 1;
+                if (timeouts >= WRITE_BLOCK_MAX_TIMEOUTS)
+                {
+                    ESP_LOGE(TAG, "block %u: no ack in %d ms", base_id, timeouts * TRANSFER_ACK_TIMEOUT);
+                    flasher->state = ABORT_TRANSFER;
+                    xmodem_process(flasher);
+                    return ESP_ERR_TIMEOUT;
+                }
+                else if (!response && late > 0)
+                {
+                    ESP_LOGD(TAG, "block %u: %d late ack(s)", base_id, late);
+                    for (; late > 0 && inflight > 0; late--, inflight--)
+                    {
+                        base += xmodem_block_size(len - base);
+                        base_id++;
+                    }
+                    flasher->write_block_retries = 0;
+                }
+                else if (++flasher->write_block_retries > WRITE_BLOCK_MAX_RETRIES)
+                {
+                    ESP_LOGE(TAG, "block %u: %s, giving up", base_id, response ? "nack" : "timeout");
+                    flasher->state = ABORT_TRANSFER;
+                    xmodem_process(flasher);
+                    return response ? ESP_FAIL : ESP_ERR_TIMEOUT;
+                }
+                else
+                {
+                    ESP_LOGD(TAG, "block %u: %s, resend %d block(s)", base_id, response ? "nack" : "timeout", inflight);
+                }
+                next = base;
+                next_id = base_id;
+                inflight = 0;
+                break;
+            }
+            default:
+                break;
         }
     }
-    while (1);
 
-    return ret;
+    flasher->cur_packet_id = base_id;
+    flasher->state = WAIT_WRITE_BLOCK;
+
+    return ESP_OK;
 }
 
 esp_err_t xmodem_finish(sscma_client_flasher_we2_uart_t *flasher)
@@ -443,7 +487,7 @@ esp_err_t xmodem_finish(sscma_client_flasher_we2_uart_t *flasher)
             ret = ESP_ERR_TIMEOUT;
             break;
         }
-        if (flasher->state == FAILED)
+        if (flasher->state == FAILED || flasher->state == FINAL)
         {
             ret = ESP_FAIL;
             break;
@@ -503,6 +547,8 @@ esp_err_t sscma_client_new_flasher_we2_uart(const sscma_client_io_handle_t io, c
     flasher_we2->reset_level = config->flags.reset_high_active ? 1 : 0;
 
     flasher_we2->io = io;
+    flasher_we2->user_ctx = config->user_ctx;
+    flasher_we2->on_progress = config->on_progress;
 
     flasher_we2->tx_buffer.data = NULL;
     flasher_we2->tx_buffer.len = 0;
@@ -614,6 +660,9 @@ static esp_err_t sscma_client_flasher_we2_start(sscma_client_flasher_handle_t fl
 
     xSemaphoreTake(flasher_we2->lock, portMAX_DELAY);
 
+    flasher_we2->written = 0;
+    flasher_we2->start_time = esp_timer_get_time();
+
     if (flasher_we2->reset_gpio_num >= 0)
     {
         if (flasher_we2->io_expander)
@@ -771,6 +820,14 @@ static esp_err_t sscma_client_flasher_we2_write(sscma_client_flasher_handle_t fl
     xSemaphoreTake(flasher_we2->lock, portMAX_DELAY);
 
     ret = xmodem_write(flasher_we2, data, len);
+    if (ret == ESP_OK)
+    {
+        flasher_we2->written += len;
+        if (flasher_we2->on_progress)
+        {
+            flasher_we2->on_progress(flasher_we2->written, flasher_we2->user_ctx);
+        }
+    }
 
     xSemaphoreGive(flasher_we2->lock);
 
@@ -787,6 +844,10 @@ static esp_err_t sscma_client_flasher_we2_finish(sscma_client_flasher_handle_t f
 
     ret = xmodem_finish(flasher_we2);
 
+    int64_t elapsed = esp_timer_get_time() - flasher_we2->start_time;
+    ESP_LOGI(TAG, "xmodem: %u bytes in %lld ms (%u B/s, window %d)", (unsigned)flasher_we2->written, (long long)(elapsed / 1000),
+             elapsed > 0 ? (unsigned)(flasher_we2->written * 1000000LL / elapsed) : 0, XMODEM_WINDOW);
+
     flasher_we2->tx_buffer.pos = 0;
     start = esp_timer_get_time();
     ret = ESP_ERR_TIMEOUT;
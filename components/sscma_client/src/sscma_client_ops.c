@@ -20,6 +20,7 @@
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 #include "sscma_client_types.h"
 #include "sscma_client_io.h"
@@ -203,232 +204,391 @@ static void sscma_client_monitor(void *arg)
     }
 }
 
-static void sscma_client_process(void *arg)
+static void sscma_client_dispatch(sscma_client_handle_t client, sscma_client_reply_t *reply)
 {
-    size_t rlen = 0;
-    char *suffix = NULL;
-    char *prefix = NULL;
-    sscma_client_handle_t client = (sscma_client_handle_t)arg;
-    sscma_client_reply_t reply;
-    while (true)
+    reply->payload = cJSON_Parse(reply->data);
+    if (reply->payload == NULL)
     {
-        vTaskDelay(10 / portTICK_PERIOD_MS);
-        if (client->inited == false)
+        ESP_LOGW(TAG, "Invalid reply: %s cc", reply->data);
+        sscma_client_reply_clear(reply);
+        return;
+    }
+
+    cJSON *type = cJSON_GetObjectItem(reply->payload, "type");
+    cJSON *name = cJSON_GetObjectItem(reply->payload, "name");
+
+    if (type == NULL || name == NULL)
+    {
+        ESP_LOGW(TAG, "invalid reply: %s", reply->data);
+        sscma_client_reply_clear(reply);
+        return;
+    }
+
+    if (client->on_connect)
+    {
+        if (name != NULL && strnstr(name->valuestring, EVENT_INIT, strlen(name->valuestring)) != NULL)
         {
-            continue;
+            xQueueReset(client->reply_queue); // reset reply queue
+            if (xQueueSend(client->reply_queue, reply, 0) != pdTRUE)
+            {
+                sscma_client_reply_clear(reply);
+            }
+            return;
         }
-        if (sscma_client_available(client, &rlen) == ESP_OK && rlen)
+    }
+
+    if (type->valueint == CMD_TYPE_RESPONSE)
+    {
+        sscma_client_request_t *first_req, *next_req = NULL;
+        bool found = false;
+        if (listCURRENT_LIST_LENGTH(client->request_list) > (UBaseType_t)0)
         {
-            if (rlen + client->rx_buffer.pos > client->rx_buffer.len)
+            listGET_OWNER_OF_NEXT_ENTRY(first_req, client->request_list);
+            do
             {
-                rlen = client->rx_buffer.len - client->rx_buffer.pos;
-                if (rlen <= 0)
+                listGET_OWNER_OF_NEXT_ENTRY(next_req, client->request_list);
+                if (strncmp(next_req->cmd, name->valuestring, sizeof(next_req->cmd)) == 0)
                 {
-                    ESP_LOGW(TAG, "rx buffer is full");
-                    client->rx_buffer.pos = 0;
-                    continue;
+                    if (next_req->reply)
+                    {
+                        found = true;
+                        if (xQueueSend(next_req->reply, reply, 0) != pdTRUE)
+                        {
+                            sscma_client_reply_clear(reply); // discard this reply
+                        }
+                        break;
+                    }
                 }
             }
-
-            sscma_client_read(client, client->rx_buffer.data + client->rx_buffer.pos, rlen);
-            client->rx_buffer.pos += rlen;
-
-            int new_pos = 0;
-            for (int i = 0; i < client->rx_buffer.pos; i++)
+            while (next_req != first_req);
+        }
+        if (!found)
+        {
+            ESP_LOGW(TAG, "request not found: %s", name->valuestring);
+            if (client->on_response == NULL || xQueueSend(client->reply_queue, reply, 0) != pdTRUE)
+            {
+                sscma_client_reply_clear(reply); // discard this reply
+            }
+        }
+    }
+    else if (type->valueint == CMD_TYPE_LOG)
+    {
+        cJSON *code = cJSON_GetObjectItem(reply->payload, "code");
+        if (code == NULL)
+        {
+            ESP_LOGW(TAG, "invalid log: %s", reply->data);
+            sscma_client_reply_clear(reply);
+            return;
+        }
+        if (code->valueint == CMD_EINVAL)
+        { // unkown command
+            cJSON *data = cJSON_GetObjectItem(reply->payload, "data");
+            if (data == NULL)
+            {
+                ESP_LOGW(TAG, "invalid log: %s", reply->data);
+                sscma_client_reply_clear(reply);
+                return;
+            }
+            sscma_client_request_t *first_req, *next_req = NULL;
+            bool found = false;
+            if (listCURRENT_LIST_LENGTH(client->request_list) > (UBaseType_t)0)
             {
-                if (client->rx_buffer.data[i] != '\0')
+                listGET_OWNER_OF_NEXT_ENTRY(first_req, client->request_list);
+                do
                 {
-                    client->rx_buffer.data[new_pos++] = client->rx_buffer.data[i];
+                    listGET_OWNER_OF_NEXT_ENTRY(next_req, client->request_list);
+                    if (strnstr(data->valuestring, next_req->cmd, strlen(data->valuestring)) != NULL)
+                    {
+                        if (next_req->reply)
+                        {
+                            found = true;
+                            if (xQueueSend(next_req->reply, reply, 0) != pdTRUE)
+                            {
+                                sscma_client_reply_clear(reply); // discard this reply
+                            }
+                            break;
+                        }
+                    }
                 }
+                while (next_req != first_req);
             }
-            client->rx_buffer.pos = new_pos;
-
-
-            client->rx_buffer.data[client->rx_buffer.pos] = 0;
-            while ((suffix = strnstr(client->rx_buffer.data, RESPONSE_SUFFIX, client->rx_buffer.pos)) != NULL)
+            if (!found)
             {
-                if ((prefix = strnstr(client->rx_buffer.data, RESPONSE_PREFIX, suffix - client->rx_buffer.data)) != NULL)
+                ESP_LOGW(TAG, "request not found: %s", name->valuestring);
+                if (client->on_log == NULL || xQueueSend(client->reply_queue, reply, 0) != pdTRUE)
                 {
-                    int len = suffix - prefix + RESPONSE_SUFFIX_LEN;
-                    reply.data = (char *)__malloc(len + 1);
-                    if (reply.data != NULL)
-                    {
-                        reply.len = len;
-                        memcpy(reply.data, prefix, len);
+                    sscma_client_reply_clear(reply); // discard this reply
+                }
+            }
+        }
+        else
+        {
+            if (client->on_log == NULL || xQueueSend(client->reply_queue, reply, 0) != pdTRUE)
+            {
+                sscma_client_reply_clear(reply); // discard this reply
+            }
+        }
+    }
+    else if (type->valueint == CMD_TYPE_EVENT)
+    {
+        // discard all the events while AT+BREAK is pending, the counter is maintained by
+        // sscma_client_request() so that there is no need to walk the request list per event
+        if (client->on_event == NULL || client->break_pending > 0 || xQueueSend(client->reply_queue, reply, 0) != pdTRUE)
+        {
+            sscma_client_reply_clear(reply); // discard this reply
+        }
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Invalid reply: %s", reply->data);
+        sscma_client_reply_clear(reply);
+    }
+}
 
-                        // delete this reply from rx buffer
-                        memmove(client->rx_buffer.data, suffix + RESPONSE_SUFFIX_LEN, client->rx_buffer.pos - (suffix - client->rx_buffer.data) - RESPONSE_PREFIX_LEN);
-                        client->rx_buffer.pos -= len;
+/*
+ * Framing
+ *
+ * Replies are framed as "\r{...}\n".
+ *
+ * A raw "\r{" can never appear inside a valid JSON body (control characters are escaped), so
+ * it is used as the resync boundary: whenever a frame turns out to be truncated, oversized or
+ * corrupted, only that frame is dropped and parsing restarts at the next boundary.
+ */
+static void sscma_client_rx_consume(sscma_client_handle_t client, size_t len)
+{
+    if (len >= client->rx_buffer.pos)
+    {
+        client->rx_buffer.pos = 0;
+    }
+    else
+    {
+        memmove(client->rx_buffer.data, client->rx_buffer.data + len, client->rx_buffer.pos - len);
+        client->rx_buffer.pos -= len;
+    }
+    client->rx_buffer.data[client->rx_buffer.pos] = 0;
+    client->framer.scan = 0;
+}
 
-                        reply.data[len] = 0;
-                        reply.payload = cJSON_Parse(reply.data);
-                        if (reply.payload != NULL)
-                        {
-                            cJSON *type = cJSON_GetObjectItem(reply.payload, "type");
-                            cJSON *name = cJSON_GetObjectItem(reply.payload, "name");
+static bool sscma_client_rx_reserve(sscma_client_handle_t client, size_t len)
+{
+    size_t new_len = client->rx_buffer.len;
 
-                            if (type == NULL || name == NULL)
-                            {
-                                ESP_LOGW(TAG, "invalid reply: %s", reply.data);
-                                sscma_client_reply_clear(&reply);
-                                continue;
-                            }
+    if (len <= client->rx_buffer.len)
+    {
+        return true;
+    }
+    if (len > client->framer.max_len)
+    {
+        return false;
+    }
+    while (new_len < len)
+    {
+        new_len *= 2;
+    }
+    if (new_len > client->framer.max_len)
+    {
+        new_len = client->framer.max_len;
+    }
 
-                            if (client->on_connect)
-                            {
-                                if (name != NULL && strnstr(name->valuestring, EVENT_INIT, strlen(name->valuestring)) != NULL)
-                                {
-                                    xQueueReset(client->reply_queue); // reset reply queue
-                                    if (xQueueSend(client->reply_queue, &reply, 0) != pdTRUE)
-                                    {
-                                        sscma_client_reply_clear(&reply);
-                                    }
-                                    continue;
-                                }
-                            }
+    char *data = (char *)heap_caps_realloc(client->rx_buffer.data, new_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (data == NULL)
+    {
+        ESP_LOGW(TAG, "no mem to grow rx buffer to %u", (unsigned)new_len);
+        return false;
+    }
+    ESP_LOGD(TAG, "rx buffer grown %u -> %u", (unsigned)client->rx_buffer.len, (unsigned)new_len);
+    client->rx_buffer.data = data;
+    client->rx_buffer.len = new_len;
 
-                            if (type->valueint == CMD_TYPE_RESPONSE)
-                            {
-                                sscma_client_request_t *first_req, *next_req = NULL;
-                                bool found = false;
-                                if (listCURRENT_LIST_LENGTH(client->request_list) > (UBaseType_t)0)
-                                {
-                                    listGET_OWNER_OF_NEXT_ENTRY(first_req, client->request_list);
-                                    do
-                                    {
-                                        listGET_OWNER_OF_NEXT_ENTRY(next_req, client->request_list);
-                                        if (strncmp(next_req->cmd, name->valuestring, sizeof(next_req->cmd)) == 0)
-                                        {
-                                            if (next_req->reply)
-                                            {
-                                                found = true;
-                                                if (xQueueSend(next_req->reply, &reply, 0) != pdTRUE)
-                                                {
-                                                    sscma_client_reply_clear(&reply); // discard this reply
-                                                }
-                                                break;
-                                            }
-                                        }
-                                    }
-                                    while (next_req != first_req);
-                                }
-                                if (!found)
-                                {
-                                    ESP_LOGW(TAG, "request not found: %s", name->valuestring);
-                                    if (client->on_response == NULL || xQueueSend(client->reply_queue, &reply, 0) != pdTRUE)
-                                    {
-                                        sscma_client_reply_clear(&reply); // discard this reply
-                                    }
-                                }
-                            }
-                            else if (type->valueint == CMD_TYPE_LOG)
-                            {
-                                cJSON *code = cJSON_GetObjectItem(reply.payload, "code");
-                                if (code == NULL)
-                                {
-                                    ESP_LOGW(TAG, "invalid log: %s", reply.data);
-                                    sscma_client_reply_clear(&reply);
-                                    continue;
-                                }
-                                if (code->valueint == CMD_EINVAL)
-                                { // unkown command
-                                    cJSON *data = cJSON_GetObjectItem(reply.payload, "data");
-                                    if (data == NULL)
-                                    {
-                                        ESP_LOGW(TAG, "invalid log: %s", reply.data);
-                                        sscma_client_reply_clear(&reply);
-                                        continue;
-                                    }
-                                    sscma_client_request_t *first_req, *next_req = NULL;
-                                    bool found = false;
-                                    if (listCURRENT_LIST_LENGTH(client->request_list) > (UBaseType_t)0)
-                                    {
-                                        listGET_OWNER_OF_NEXT_ENTRY(first_req, client->request_list);
-                                        do
-                                        {
-                                            listGET_OWNER_OF_NEXT_ENTRY(next_req, client->request_list);
-                                            if (strnstr(data->valuestring, next_req->cmd, strlen(data->valuestring)) != NULL)
-                                            {
-                                                if (next_req->reply)
-                                                {
-                                                    found = true;
-                                                    if (xQueueSend(next_req->reply, &reply, 0) != pdTRUE)
-                                                    {
-                                                        sscma_client_reply_clear(&reply); // discard this reply
-                                                    }
-                                                    break;
-                                                }
-                                            }
-                                        }
-                                        while (next_req != first_req);
-                                    }
-                                    if (!found)
-                                    {
-                                        ESP_LOGW(TAG, "request not found: %s", name->valuestring);
-                                        if (client->on_log == NULL || xQueueSend(client->reply_queue, &reply, 0) != pdTRUE)
-                                        {
-                                            sscma_client_reply_clear(&reply); // discard this reply
-                                        }
-                                    }
-                                }
-                                else
-                                {
-                                    if (client->on_log == NULL || xQueueSend(client->reply_queue, &reply, 0) != pdTRUE)
-                                    {
-                                        sscma_client_reply_clear(&reply); // discard this reply
-                                    }
-                                }
-                            }
-                            else if (type->valueint == CMD_TYPE_EVENT)
-                            {
-                                sscma_client_request_t *first_req, *next_req = NULL;
-                                bool found = false;
-                                // discard all the events while AT+BREAK is found
-                                if (listCURRENT_LIST_LENGTH(client->request_list) > (UBaseType_t)0)
-                                {
-                                    listGET_OWNER_OF_NEXT_ENTRY(first_req, client->request_list);
-                                    do
-                                    {
-                                        listGET_OWNER_OF_NEXT_ENTRY(next_req, client->request_list);
-                                        if (strnstr(next_req->cmd, CMD_AT_BREAK, strlen(next_req->cmd)) != NULL)
-                                        {
-                                            found = true;
-                                            break;
-                                        }
-                                    }
-                                    while (next_req != first_req);
-                                }
-                                if (client->on_event == NULL || found || xQueueSend(client->reply_queue, &reply, 0) != pdTRUE)
-                                {
-                                    sscma_client_reply_clear(&reply); // discard this reply
-                                }
-                            }
-                            else
-                            {
-                                ESP_LOGW(TAG, "Invalid reply: %s", reply.data);
-                                sscma_client_reply_clear(&reply);
-                            }
-                        }
-                        else
-                        {
-                            ESP_LOGW(TAG, "Invalid reply: %s cc", reply.data);
-                            sscma_client_reply_clear(&reply);
-                        }
-                    }else{
-                        printf("reply.data == NULL\r\n");
-                        client->rx_buffer.pos -= len;
-                    }
+    return true;
+}
+
+static void sscma_client_rx_resync(sscma_client_handle_t client)
+{
+    // drop the frame being assembled, keep the byte that may start the next boundary
+    size_t drop = client->rx_buffer.pos;
+    char *next = NULL;
+
+    if (client->rx_buffer.pos > 1)
+    {
+        next = memchr(client->rx_buffer.data + 1, '\r', client->rx_buffer.pos - 1);
+    }
+    if (next != NULL)
+    {
+        drop = next - client->rx_buffer.data;
+    }
+
+    client->framer.resyncs++;
+    client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+    sscma_client_rx_consume(client, drop);
+}
+
+static void sscma_client_rx_emit(sscma_client_handle_t client, size_t len)
+{
+    sscma_client_reply_t reply = { 0 };
+
+    reply.data = (char *)__malloc(len + 1);
+    if (reply.data != NULL)
+    {
+        memcpy(reply.data, client->rx_buffer.data, len);
+        reply.data[len] = 0;
+        reply.len = len;
+        reply.ts_us = client->framer.start_us;
+    }
+
+    client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+    sscma_client_rx_consume(client, len);
+
+    if (reply.data == NULL)
+    {
+        ESP_LOGW(TAG, "no mem for reply of %u bytes", (unsigned)len);
+        client->framer.dropped++;
+        return;
+    }
+
+    client->framer.frames++;
+    sscma_client_dispatch(client, &reply);
+}
+
+static void sscma_client_rx_parse(sscma_client_handle_t client)
+{
+    char *data = NULL;
+    size_t pos = 0;
+
+    while (client->rx_buffer.pos > 0)
+    {
+        data = client->rx_buffer.data;
+        pos = client->rx_buffer.pos;
+
+        switch (client->framer.state)
+        {
+            case SSCMA_CLIENT_FRAME_HUNT: {
+                char *start = memchr(data, '\r', pos);
+                if (start == NULL)
+                {
+                    sscma_client_rx_consume(client, pos);
+                    return;
+                }
+                if (start != data)
+                {
+                    sscma_client_rx_consume(client, start - data);
+                    continue;
+                }
+                if (pos < RESPONSE_PREFIX_LEN)
+                {
+                    return; // need more data to classify the boundary
+                }
+                if (strncmp(data, RESPONSE_PREFIX, RESPONSE_PREFIX_LEN) == 0)
+                {
+                    client->framer.state = SSCMA_CLIENT_FRAME_BODY;
+                    client->framer.scan = RESPONSE_PREFIX_LEN - 1;
+                    client->framer.start_us = client->framer.read_us;
                 }
                 else
                 {
-                    // discard this reply
-                    ESP_LOGW(TAG, "Invalid reply: %d/%d", client->rx_buffer.pos, client->rx_buffer.len);
-                    memmove(client->rx_buffer.data, suffix + RESPONSE_SUFFIX_LEN, client->rx_buffer.pos - (suffix - client->rx_buffer.data) - RESPONSE_PREFIX_LEN);
-                    client->rx_buffer.pos -= suffix - client->rx_buffer.data + RESPONSE_SUFFIX_LEN;
-                    client->rx_buffer.data[client->rx_buffer.pos] = 0;
+                    sscma_client_rx_consume(client, 1);
+                }
+                break;
+            }
+
+            case SSCMA_CLIENT_FRAME_BODY: {
+                // resume the scan where the previous pass stopped, so each byte is looked at once
+                size_t i = client->framer.scan;
+                for (; i + 1 < pos; i++)
+                {
+                    if (data[i] == '}' && data[i + 1] == '\n')
+                    {
+                        break;
+                    }
+                    if (data[i] == '\r' && data[i + 1] == '{')
+                    {
+                        break;
+                    }
+                }
+                if (i + 1 >= pos)
+                {
+                    client->framer.scan = i;
+                    return;
+                }
+                if (data[i] == '\r')
+                {
+                    // a new boundary before the suffix, the current frame lost its tail
+                    ESP_LOGW(TAG, "truncated frame, resync");
+                    client->framer.resyncs++;
+                    client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+                    sscma_client_rx_consume(client, i);
+                    break;
                 }
+                sscma_client_rx_emit(client, i + RESPONSE_SUFFIX_LEN);
+                break;
             }
+
+            default:
+                client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+                break;
+        }
+    }
+}
+
+// read whatever the io has buffered and run the framer over it, one step of the process task
+static void sscma_client_rx_poll(sscma_client_handle_t client)
+{
+    size_t rlen = 0;
+    size_t room = 0;
+
+    if (sscma_client_available(client, &rlen) != ESP_OK || rlen == 0)
+    {
+        return;
+    }
+    // keep one byte for the terminating zero
+    if (!sscma_client_rx_reserve(client, client->rx_buffer.pos + rlen + 1))
+    {
+        room = client->rx_buffer.len - client->rx_buffer.pos - 1;
+        if (room == 0)
+        {
+            // the frame being assembled can never fit, drop it and hunt for the next one
+            ESP_LOGW(TAG, "rx buffer is full, resync");
+            client->framer.overflows++;
+            sscma_client_rx_resync(client);
+            room = client->rx_buffer.len - client->rx_buffer.pos - 1;
+        }
+        rlen = rlen > room ? room : rlen;
+    }
+
+    char *chunk = client->rx_buffer.data + client->rx_buffer.pos;
+    if (sscma_client_read(client, chunk, rlen) != ESP_OK)
+    {
+        return;
+    }
+    // arrival time of whatever frame starts in this chunk
+    client->framer.read_us = esp_timer_get_time();
+
+    // strip the padding zeros of the new chunk only
+    size_t new_len = 0;
+    for (size_t i = 0; i < rlen; i++)
+    {
+        if (chunk[i] != '\0')
+        {
+            chunk[new_len++] = chunk[i];
+        }
+    }
+    client->rx_buffer.pos += new_len;
+    client->rx_buffer.data[client->rx_buffer.pos] = 0;
+
+    sscma_client_rx_parse(client);
+}
+
+static void sscma_client_process(void *arg)
+{
+    sscma_client_handle_t client = (sscma_client_handle_t)arg;
+    while (true)
+    {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+        if (client->inited == false)
+        {
+            continue;
         }
+        sscma_client_rx_poll(client);
     }
 }
 
@@ -471,6 +631,9 @@ esp_err_t sscma_client_new(const sscma_client_io_handle_t io, const sscma_client
     client->rx_buffer.pos = 0;
     client->rx_buffer.len = config->rx_buffer_size;
 
+    client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+    client->framer.max_len = config->rx_buffer_max_size > config->rx_buffer_size ? config->rx_buffer_max_size : config->rx_buffer_size;
+
     client->tx_buffer.data = (char *)malloc(config->tx_buffer_size);
     ESP_GOTO_ON_FALSE(client->tx_buffer.data, ESP_ERR_NO_MEM, err, TAG, "no mem for tx buffer");
     client->tx_buffer.pos = 0;
@@ -751,6 +914,8 @@ esp_err_t sscma_client_reset(sscma_client_handle_t client)
 
     client->rx_buffer.pos = 0;
     client->tx_buffer.pos = 0;
+    client->framer.state = SSCMA_CLIENT_FRAME_HUNT;
+    client->framer.scan = 0;
 
     // perform hardware reset
     if (client->reset_gpio_num >= 0)
@@ -826,6 +991,23 @@ esp_err_t sscma_client_register_callback(sscma_client_handle_t client, const ssc
     return ESP_OK;
 }
 
+esp_err_t sscma_client_get_callback(sscma_client_handle_t client, sscma_client_callback_t *callback, void **user_ctx)
+{
+    ESP_RETURN_ON_FALSE(client && callback, ESP_ERR_INVALID_ARG, TAG, "Invalid argument(s) detected");
+
+    callback->on_connect = client->on_connect;
+    callback->on_disconnect = client->on_disconnect;
+    callback->on_response = client->on_response;
+    callback->on_event = client->on_event;
+    callback->on_log = client->on_log;
+    if (user_ctx)
+    {
+        *user_ctx = client->user_ctx;
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t sscma_client_request(sscma_client_handle_t client, const char *cmd, sscma_client_reply_t *reply, bool wait, TickType_t timeout)
 {
     esp_err_t ret = ESP_OK;
@@ -849,6 +1031,10 @@ esp_err_t sscma_client_request(sscma_client_handle_t client, const char *cmd, ss
         vListInitialiseItem(&(request->item));
         listSET_LIST_ITEM_OWNER(&(request->item), request);
         vListInsertEnd(client->request_list, &(request->item));
+        if (strcmp(request->cmd, CMD_AT_BREAK) == 0)
+        {
+            client->break_pending++;
+        }
     }
 
     ESP_GOTO_ON_ERROR(sscma_client_write(client, cmd, strlen(cmd)), err, TAG, "write command failed");
@@ -868,9 +1054,13 @@ esp_err_t sscma_client_request(sscma_client_handle_t client, const char *cmd, ss
 err:
     if (wait)
     {
-        if (listIS_CONTAINED_WITHIN(client->request_list, &(request->item)))
+        if (request && listIS_CONTAINED_WITHIN(client->request_list, &(request->item)))
         {
             uxListRemove(&(request->item));
+            if (strcmp(request->cmd, CMD_AT_BREAK) == 0)
+            {
+                client->break_pending--;
+            }
         }
         if (request)
         {
@@ -1172,6 +1362,18 @@ esp_err_t sscma_client_break(sscma_client_handle_t client)
     return ret;
 }
 
+esp_err_t sscma_client_get_frame_stats(sscma_client_handle_t client, sscma_client_frame_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(client && stats, ESP_ERR_INVALID_ARG, TAG, "Invalid argument(s) detected");
+
+    stats->frames = client->framer.frames;
+    stats->resyncs = client->framer.resyncs;
+    stats->overflows = client->framer.overflows;
+    stats->dropped = client->framer.dropped;
+
+    return ESP_OK;
+}
+
 esp_err_t sscma_client_set_iou_threshold(sscma_client_handle_t client, int threshold)
 {
     esp_err_t ret = ESP_OK;
@@ -1289,7 +1491,7 @@ esp_err_t sscma_client_set_model_info(sscma_client_handle_t client, const char *
 
     if (mbedtls_base64_encode((unsigned char *)&cmd[strlen(cmd)], sizeof(cmd) - strlen(cmd) - CMD_SUFFIX_LEN, &length, (const unsigned char *)model_info, strlen(model_info)) != 0)
     {
-        ESP_LOGE(TAG, "mbedtls_base64_encode failed %d %d", sizeof(cmd) - strlen(cmd) - CMD_SUFFIX_LEN, length);
+        ESP_LOGE(TAG, "mbedtls_base64_encode failed %d %d", (int)(sizeof(cmd) - strlen(cmd) - CMD_SUFFIX_LEN), (int)length);
         ret = ESP_ERR_NO_MEM;
         goto set_model_info_exit;
     }
@@ -1778,6 +1980,14 @@ err:
     return ret;
 }
 
+esp_err_t sscma_client_ota_seek(sscma_client_handle_t client, size_t offset)
+{
+    ESP_RETURN_ON_FALSE(client && client->flasher, ESP_ERR_INVALID_ARG, TAG, "Invalid argument(s) detected");
+
+    // a failed seek leaves the transfer usable, the caller can fall back to writing sequentially
+    return sscma_client_flasher_seek(client->flasher, offset);
+}
+
 esp_err_t sscma_client_ota_finish(sscma_client_handle_t client)
 {
     esp_err_t ret = ESP_OK;
@@ -1,5 +1,6 @@
 #include "app_audio_recorder.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_log.h"
 #include "esp_err.h"
@@ -8,6 +9,7 @@
 #include "util.h"
 #include "data_defs.h"
 #include "event_loops.h"
+#include "debi_clock.h"
 
 #ifdef CONFIG_ENABLE_VI_SR
 #include "esp_mn_speech_commands.h"
@@ -28,6 +30,8 @@ struct app_audio_recorder *gp_audio_recorder = NULL;
 #define EVENT_RECORD_STREAM_STOP       BIT1
 #define EVENT_RECORD_STREAM_STOP_DONE  BIT2
 
+#define AUDIO_RECORDER_SAMPLE_BYTES    (DRV_AUDIO_SAMPLE_BITS / 8 * DRV_AUDIO_CHANNELS)
+
 static void __data_lock(struct app_audio_recorder  *p_audio_recorder)
 {
     xSemaphoreTake(p_audio_recorder->sem_handle, portMAX_DELAY);
@@ -37,6 +41,106 @@ static void __data_unlock(struct app_audio_recorder *p_audio_recorder)
     xSemaphoreGive(p_audio_recorder->sem_handle);  
 }
 
+static void __stream_reset(struct app_audio_recorder *p_audio_recorder)
+{
+    __data_lock(p_audio_recorder);
+    p_audio_recorder->mark_head = 0;
+    p_audio_recorder->mark_num = 0;
+    p_audio_recorder->in_offset = 0;
+    p_audio_recorder->out_offset = 0;
+    p_audio_recorder->next_ts_us = 0;
+    p_audio_recorder->lost = false;
+    __data_unlock(p_audio_recorder);
+}
+
+// send the block just read from the mic, with a mark of when it was captured
+static void __stream_send(struct app_audio_recorder *p_audio_recorder, const void *p_data, size_t len)
+{
+    uint64_t samples = len / AUDIO_RECORDER_SAMPLE_BYTES;
+    uint64_t sample = debi_clock_audio_samples() - samples;
+    int64_t ts_us = debi_clock_audio_time(sample);
+    debi_clock_audio_t clock;
+    debi_clock_get_audio(&clock);   // the player may have reopened the codec at its own rate
+    uint32_t rate = clock.rate ? clock.rate : DRV_AUDIO_SAMPLE_RATE;
+
+    __data_lock(p_audio_recorder);
+    struct app_audio_recorder_mark mark = {
+        .offset = p_audio_recorder->in_offset,
+        .sample = sample,
+        .ts_us = ts_us,
+        .rate = rate,
+        .gap = p_audio_recorder->lost || p_audio_recorder->in_offset == 0,
+    };
+    // the mic clock restarted under us
+    if (ts_us && p_audio_recorder->next_ts_us && llabs(ts_us - p_audio_recorder->next_ts_us) > DEBI_CLOCK_AUDIO_GAP_US) {
+        mark.gap = true;
+    }
+    if (p_audio_recorder->mark_num > 0 &&
+        p_audio_recorder->marks[(p_audio_recorder->mark_head + p_audio_recorder->mark_num - 1) % AUDIO_RECORDER_MARKS].rate != rate) {
+        mark.gap = true;
+    }
+
+    if (p_audio_recorder->mark_num < AUDIO_RECORDER_MARKS &&
+        xRingbufferSend(p_audio_recorder->rb_handle, p_data, len, 0) == pdTRUE) {
+        int i = (p_audio_recorder->mark_head + p_audio_recorder->mark_num) % AUDIO_RECORDER_MARKS;
+        p_audio_recorder->marks[i] = mark;
+        p_audio_recorder->mark_num++;
+        p_audio_recorder->in_offset += len;
+        p_audio_recorder->next_ts_us = ts_us ? ts_us + (int64_t)(samples * 1000000 / rate) : 0;
+        p_audio_recorder->lost = false;
+    } else {
+        p_audio_recorder->lost = true;
+        ESP_LOGE(TAG, "xRingbufferSend failed");
+    }
+    __data_unlock(p_audio_recorder);
+}
+
+// a read failed: what follows is not continuous with what was sent
+static void __stream_lost(struct app_audio_recorder *p_audio_recorder)
+{
+    __data_lock(p_audio_recorder);
+    p_audio_recorder->lost = true;
+    __data_unlock(p_audio_recorder);
+}
+
+// bytes that can be received before the next gap
+static size_t __stream_limit(struct app_audio_recorder *p_audio_recorder)
+{
+    for (int n = 0; n < p_audio_recorder->mark_num; n++) {
+        const struct app_audio_recorder_mark *p_mark = &p_audio_recorder->marks[(p_audio_recorder->mark_head + n) % AUDIO_RECORDER_MARKS];
+        if (p_mark->gap && p_mark->offset > p_audio_recorder->out_offset) {
+            uint64_t limit = p_mark->offset - p_audio_recorder->out_offset;
+            return limit < AUDIO_RECORDER_RINGBUF_CHUNK_SIZE ? (size_t)limit : AUDIO_RECORDER_RINGBUF_CHUNK_SIZE;
+        }
+    }
+    return AUDIO_RECORDER_RINGBUF_CHUNK_SIZE;
+}
+
+// stamp the chunk starting at out_offset and move past it
+static void __stream_consume(struct app_audio_recorder *p_audio_recorder, size_t len,
+                             struct app_audio_recorder_stamp *p_stamp)
+{
+    __data_lock(p_audio_recorder);
+    while (p_audio_recorder->mark_num > 1 &&
+           p_audio_recorder->marks[(p_audio_recorder->mark_head + 1) % AUDIO_RECORDER_MARKS].offset <= p_audio_recorder->out_offset) {
+        p_audio_recorder->mark_head = (p_audio_recorder->mark_head + 1) % AUDIO_RECORDER_MARKS;
+        p_audio_recorder->mark_num--;
+    }
+    if (p_stamp) {
+        memset(p_stamp, 0, sizeof(*p_stamp));
+        if (p_audio_recorder->mark_num > 0) {
+            const struct app_audio_recorder_mark *p_mark = &p_audio_recorder->marks[p_audio_recorder->mark_head];
+            uint64_t skip = (p_audio_recorder->out_offset - p_mark->offset) / AUDIO_RECORDER_SAMPLE_BYTES;
+            p_stamp->sample = p_mark->sample + skip;
+            p_stamp->rate = p_mark->rate;
+            p_stamp->ts_us = p_mark->ts_us ? p_mark->ts_us + (int64_t)(skip * 1000000 / p_mark->rate) : 0;
+            p_stamp->gap = p_mark->gap && skip == 0;
+        }
+    }
+    p_audio_recorder->out_offset += len;
+    __data_unlock(p_audio_recorder);
+}
+
 
 
 #ifdef CONFIG_ENABLE_VI_SR
@@ -74,13 +178,15 @@ static void app_audio_fead_and_record_task(void *p_arg)
             xEventGroupSetBits(p_audio_recorder->event_group, EVENT_RECORD_STREAM_STOP_DONE);
         }
 
-        bsp_get_feed_data(false, audio_buffer, audio_chunksize * sizeof(int16_t) * feed_channel);
+        if (bsp_get_feed_data(false, audio_buffer, audio_chunksize * sizeof(int16_t) * feed_channel) != ESP_OK) {
+            __stream_lost(p_audio_recorder);
+            vTaskDelay(pdMS_TO_TICKS(20));
+            continue;
+        }
         afe_handle->feed(afe_data, audio_buffer);
 
         if( record_start ) {
-            if(xRingbufferSend(p_audio_recorder->rb_handle, audio_buffer, audio_chunksize * sizeof(int16_t) * feed_channel, 0) != pdTRUE) {
-                ESP_LOGE(TAG, "xRingbufferSend failed");
-            }
+            __stream_send(p_audio_recorder, audio_buffer, audio_chunksize * sizeof(int16_t) * feed_channel);
         }
     }
 }
@@ -166,10 +272,13 @@ static void app_audio_recorder_task(void *p_arg)
                     break;
                 }
 
-                bsp_get_feed_data(false, audio_buffer, AUDIO_RECORDER_RINGBUF_CHUNK_SIZE);
-                if(xRingbufferSend(p_audio_recorder->rb_handle, audio_buffer, AUDIO_RECORDER_RINGBUF_CHUNK_SIZE, 0) != pdTRUE) {
-                    ESP_LOGE(TAG, "xRingbufferSend failed");
+                // the codec can be stopped under us (the player does at the end of a stream)
+                if (bsp_get_feed_data(false, audio_buffer, AUDIO_RECORDER_RINGBUF_CHUNK_SIZE) != ESP_OK) {
+                    __stream_lost(p_audio_recorder);
+                    vTaskDelay(pdMS_TO_TICKS(20));
+                    continue;
                 }
+                __stream_send(p_audio_recorder, audio_buffer, AUDIO_RECORDER_RINGBUF_CHUNK_SIZE);
             }
 
             free(audio_buffer);
@@ -385,6 +494,7 @@ esp_err_t app_audio_recorder_stream_start(void)
     while ((tmp = xRingbufferReceiveUpTo(p_audio_recorder->rb_handle, &len, 0, AUDIO_RECORDER_RINGBUF_SIZE))) {
         vRingbufferReturnItem(p_audio_recorder->rb_handle, tmp);
     }
+    __stream_reset(p_audio_recorder);
 
     ret = bsp_codec_set_fs( DRV_AUDIO_SAMPLE_RATE, 
                             DRV_AUDIO_SAMPLE_BITS, 
@@ -408,12 +518,30 @@ esp_err_t app_audio_recorder_stream_start(void)
 
 uint8_t *app_audio_recorder_stream_recv(size_t *p_recv_len,
                                         TickType_t xTicksToWait)
+{
+    return app_audio_recorder_stream_recv_stamped(p_recv_len, xTicksToWait, NULL);
+}
+
+uint8_t *app_audio_recorder_stream_recv_stamped(size_t *p_recv_len,
+                                                TickType_t xTicksToWait,
+                                                struct app_audio_recorder_stamp *p_stamp)
 {
     struct app_audio_recorder * p_audio_recorder = gp_audio_recorder;
     if( p_audio_recorder == NULL) {
         return NULL;
     }
-    return xRingbufferReceiveUpTo( p_audio_recorder->rb_handle, p_recv_len, xTicksToWait, AUDIO_RECORDER_RINGBUF_CHUNK_SIZE);
+
+    // a gap block is only sent after a failed send, which needs a full
+    // ringbuffer, so none can land before this receive frees space
+    __data_lock(p_audio_recorder);
+    size_t limit = __stream_limit(p_audio_recorder);
+    __data_unlock(p_audio_recorder);
+
+    uint8_t *p_data = xRingbufferReceiveUpTo( p_audio_recorder->rb_handle, p_recv_len, xTicksToWait, limit);
+    if (p_data != NULL) {
+        __stream_consume(p_audio_recorder, *p_recv_len, p_stamp);
+    }
+    return p_data;
 }
 
 esp_err_t app_audio_recorder_stream_free(uint8_t *p_data)
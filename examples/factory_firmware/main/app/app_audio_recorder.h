@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -27,12 +28,32 @@
 #define AUDIO_RECORDER_RINGBUF_SIZE         5*32000  //TODO
 #define AUDIO_RECORDER_RINGBUF_CHUNK_SIZE   16000
 
+// one mark per block sent to the ringbuffer; the smallest block is an AFE
+// feed chunk (512 samples, 1024 bytes), so 5s of them fit
+#define AUDIO_RECORDER_MARKS                256
+
 enum app_audio_recorder_status {
     AUDIO_RECORDER_STATUS_IDLE = 0,
     AUDIO_RECORDER_STATUS_FILE,
     AUDIO_RECORDER_STATUS_STREAM,
 };
 
+// where and when the audio of one block sent to the ringbuffer starts
+struct app_audio_recorder_mark {
+    uint64_t offset;    // stream bytes before the block
+    uint64_t sample;    // debi_clock mic sample index of its first sample
+    int64_t ts_us;      // esp_timer time its first sample was captured
+    uint32_t rate;
+    bool gap;           // audio before the block was lost
+};
+
+struct app_audio_recorder_stamp {
+    int64_t ts_us;      // esp_timer time the first sample was captured, 0 if unknown
+    uint64_t sample;    // its debi_clock mic sample index
+    uint32_t rate;
+    bool gap;           // not continuous with the previous chunk
+};
+
 struct app_audio_recorder {
     SemaphoreHandle_t sem_handle;
     RingbufHandle_t rb_handle;
@@ -40,6 +61,13 @@ struct app_audio_recorder {
     uint8_t * p_rb_storage;
     EventGroupHandle_t event_group;
     enum app_audio_recorder_status status;
+    struct app_audio_recorder_mark marks[AUDIO_RECORDER_MARKS];
+    int mark_head;      // oldest mark
+    int mark_num;
+    uint64_t in_offset;     // stream bytes sent to the ringbuffer
+    uint64_t out_offset;    // stream bytes received from it
+    int64_t next_ts_us;     // expected ts of the next block
+    bool lost;              // a block was dropped since the last mark
 #ifdef CONFIG_ENABLE_VI_SR
     srmodel_list_t *models;
     esp_afe_sr_iface_t *afe_handle;
@@ -69,6 +97,12 @@ esp_err_t app_audio_recorder_stream_start(void);
 uint8_t *app_audio_recorder_stream_recv(size_t *p_recv_len,
                                         TickType_t xTicksToWait);
 
+// as app_audio_recorder_stream_recv, and stamp the chunk; a chunk never
+// spans a gap, so every sample is at stamp->ts_us + i / rate
+uint8_t *app_audio_recorder_stream_recv_stamped(size_t *p_recv_len,
+                                                TickType_t xTicksToWait,
+                                                struct app_audio_recorder_stamp *p_stamp);
+
 esp_err_t app_audio_recorder_stream_free(uint8_t *p_data);
 
 esp_err_t app_audio_recorder_stream_stop(void);
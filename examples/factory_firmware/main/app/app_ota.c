@@ -30,6 +30,7 @@
 #include "app_sensecraft.h"
 #include "app_device_info.h"
 #include "app_ble.h"
+#include "ota_delta.h"
 
 ESP_EVENT_DEFINE_BASE(OTA_EVENT_BASE);
 
@@ -37,9 +38,14 @@ ESP_EVENT_DEFINE_BASE(OTA_EVENT_BASE);
 #define HTTPS_TIMEOUT_MS                30000
 #define HTTPS_DOWNLOAD_RETRY_TIMES      5
 #define HTTP_RX_CHUNK_SIZE              512
-#define SSCMA_FLASH_CHUNK_SIZE_SPI      256   //this value is copied from the `sscma_client_ota` example
-#define SSCMA_FLASH_CHUNK_SIZE_UART     128   //this value is copied from the `sscma_client_ota` example
+#define SSCMA_FLASH_BLOCK_SIZE_SPI      256   //flash page, the SPI flasher's write granularity
+#define SSCMA_FLASH_BLOCK_SIZE_UART     128   //xmodem block, the UART flasher's write granularity
+#define SSCMA_FLASH_CHUNK_SIZE_SPI      4096  //bytes per flasher write, lets the flasher burst pages
+#define SSCMA_FLASH_CHUNK_SIZE_UART     8192  //bytes per flasher write, lets xmodem keep a window in flight
 #define AI_MODEL_RINGBUFF_SIZE          102400
+#define AI_MODEL_COMMIT_BYTES           (256 * 1024)  //how often an ai model OTA records its progress for resuming
+//blocks that may be written before the next commit, the saved block map must not vouch for them
+#define AI_MODEL_DIRTY_BLOCKS           ((AI_MODEL_COMMIT_BYTES + SSCMA_FLASH_CHUNK_SIZE_UART) / OTA_DELTA_BLOCK_SIZE)
 
 //event group events
 #define EVENT_OTA_ESP32_DL_ABORT        BIT0  //due to network too slow
@@ -394,19 +400,69 @@ static sscma_client_flasher_handle_t bsp_sscma_flasher_init_legacy(sscma_client_
     return _sscma_flasher_handle;
 }
 
+/**
+ * write one chunk of the ai model, the chunk starts on a block boundary.
+ * blocks the block map says are on himax flash already are skipped, the flasher
+ * is moved past them before the next block that is written.
+*/
+static esp_err_t __sscma_delta_write(sscma_client_handle_t sscma_client, uint8_t *chunk, int len, int img_offset,
+                                     uint32_t flash_addr, int block_size, ota_delta_map_t *map, bool delta,
+                                     bool *seek_pending, int *skipped)
+{
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+    int n, pos;
+    uint32_t index;
+
+    for (pos = 0; pos < len; pos += OTA_DELTA_BLOCK_SIZE) {
+        n = MIN(OTA_DELTA_BLOCK_SIZE, len - pos);
+        index = (img_offset + pos) / OTA_DELTA_BLOCK_SIZE;
+        ota_delta_hash(chunk + pos, n, hash);
+
+        if (delta && ota_delta_map_match(map, index, hash)) {
+            *seek_pending = true;
+            *skipped += n;
+            continue;
+        }
+        if (*seek_pending) {
+            ESP_RETURN_ON_ERROR(sscma_client_ota_seek(sscma_client, flash_addr + img_offset + pos), TAG, "sscma ota seek failed");
+            *seek_pending = false;
+        }
+        //the chunk is zero padded, round the last block up to the flasher's block size
+        n = (n + block_size - 1) / block_size * block_size;
+        ESP_RETURN_ON_ERROR(sscma_client_ota_write(sscma_client, chunk + pos, n), TAG, "sscma ota write failed");
+        ota_delta_map_set(map, index, hash);
+    }
+    return ESP_OK;
+}
+
+/**
+ * persist how far the ai model got, `committed` bytes are on himax flash.
+*/
+static void __sscma_delta_commit(ota_sscma_writer_userdata_t *userdata, ota_delta_map_t *map, int committed, int content_len)
+{
+    ota_delta_map_save(map, committed / OTA_DELTA_BLOCK_SIZE, AI_MODEL_DIRTY_BLOCKS);
+#if CONFIG_OTA_AI_MODEL_RESUME
+    if (committed > 0 && userdata->url) {
+        ota_delta_resume_save(userdata->url, content_len, committed, userdata->etag);
+    }
+#endif
+}
+
 static void __sscma_writer_task(void *p_arg)
 {
     ota_sscma_writer_userdata_t *userdata = &g_sscma_writer_userdata;
-    int content_len, ota_type;
+    int content_len, ota_type, offset;
     struct view_data_ota_status ota_status;
+    ota_delta_map_t *map = NULL;
 
     while (1) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         content_len = userdata->content_len;
         ota_type = userdata->ota_type;
+        offset = userdata->offset;  //resumed transfers start in the middle of the image
         if (content_len <= 0) continue;
 
-        ESP_LOGI(TAG, "starting sscma writer, content_len=%d ...", content_len);
+        ESP_LOGI(TAG, "starting sscma writer, content_len=%d, offset=%d ...", content_len, offset);
 
         int32_t ota_eventid = ota_type == OTA_TYPE_HIMAX ? CTRL_EVENT_OTA_HIMAX_FW: CTRL_EVENT_OTA_AI_MODEL;
 
@@ -446,6 +502,37 @@ static void __sscma_writer_task(void *p_arg)
         assert(sscma_flasher != NULL);
 
         int sscma_flasher_chunk_size_decided = use_spi_flasher ? SSCMA_FLASH_CHUNK_SIZE_SPI : SSCMA_FLASH_CHUNK_SIZE_UART;
+        int sscma_flasher_block_size = use_spi_flasher ? SSCMA_FLASH_BLOCK_SIZE_SPI : SSCMA_FLASH_BLOCK_SIZE_UART;
+
+        //the block map follows what's in the model slot, it's only trusted with the SPI flasher which
+        //programs every page directly. any other write to the slot makes the map (and resume record) stale.
+        bool track = false;
+        bool delta = false;
+        bool seek_pending = false;
+        int skipped = 0;
+        if (ota_type == OTA_TYPE_AI_MODEL && use_spi_flasher) {
+            if (map == NULL) {
+                map = psram_calloc(1, sizeof(ota_delta_map_t));
+            }
+            if (map && content_len <= OTA_DELTA_MAX_BLOCKS * OTA_DELTA_BLOCK_SIZE) {
+                track = true;
+                if (ota_delta_map_load(map) != ESP_OK) {
+                    ota_delta_map_reset(map, content_len);
+                }
+#if CONFIG_OTA_AI_MODEL_DELTA
+                delta = true;
+#endif
+            }
+        }
+        if (!track) {
+            ota_delta_map_clear();
+            ota_delta_resume_clear();
+            if (offset > 0) {
+                ESP_LOGE(TAG, "sscma writer, can't resume at %d without the SPI flasher", offset);
+                userdata->err = ESP_ERR_OTA_DOWNLOAD_FAIL;
+                goto sscma_writer_end;
+            }
+        }
 
         //sscma_client_init(sscma_client);
 
@@ -458,8 +545,12 @@ static void __sscma_writer_task(void *p_arg)
             flash_addr = 0xA00000;
         }
 
+        if (track) {
+            __sscma_delta_commit(userdata, map, offset, content_len);
+        }
+
         //sscma_client_ota_start
-        if (sscma_client_ota_start(sscma_client, sscma_flasher, flash_addr) != ESP_OK) {
+        if (sscma_client_ota_start(sscma_client, sscma_flasher, flash_addr + offset) != ESP_OK) {
             ESP_LOGE(TAG, "sscma writer, sscma_client_ota_start failed");
             userdata->err = ESP_ERR_OTA_SSCMA_START_FAIL;
             goto sscma_writer_end;
@@ -472,10 +563,12 @@ static void __sscma_writer_task(void *p_arg)
                                             pdMS_TO_TICKS(10000));
 
         // drain the ringbuffer and write to himax
-        int written_len = 0;
+        int written_len = offset;
         int remain_len = content_len - written_len;
         int step_bytes = (int)(content_len / 10);
-        int last_report_bytes = step_bytes;
+        int last_report_bytes = written_len + step_bytes;
+        int last_commit_bytes = written_len;
+        esp_err_t write_err;
         int target_bytes;
         int retry_cnt = 0;
         void *chunk = psram_calloc(1, sscma_flasher_chunk_size_decided);
@@ -530,7 +623,16 @@ static void __sscma_writer_task(void *p_arg)
 
             //write to sscma client
             // ESP_LOGD(TAG, "sscma writer, sscma_client_ota_write");
-            if (sscma_client_ota_write(sscma_client, chunk, sscma_flasher_chunk_size_decided) != ESP_OK)
+            //only pad the last chunk up to the flasher's block size, not the whole chunk
+            int write_len = (int)(rcvlen + rcvlen2);
+            if (track) {
+                write_err = __sscma_delta_write(sscma_client, chunk, write_len, written_len, flash_addr,
+                                                sscma_flasher_block_size, map, delta, &seek_pending, &skipped);
+            } else {
+                write_len = (write_len + sscma_flasher_block_size - 1) / sscma_flasher_block_size * sscma_flasher_block_size;
+                write_err = sscma_client_ota_write(sscma_client, chunk, write_len);
+            }
+            if (write_err != ESP_OK)
             {
                 ESP_LOGW(TAG, "sscma writer, sscma_client_ota_write failed\n");
                 userdata->err = ESP_ERR_OTA_SSCMA_WRITE_FAIL;
@@ -547,6 +649,10 @@ static void __sscma_writer_task(void *p_arg)
                     last_report_bytes += step_bytes;
                     ESP_LOGI(TAG, "%s ota, bytes written: %d, %d%%", ota_type_str(ota_type), written_len, ota_status.percentage);
                 }
+                if (track && written_len - last_commit_bytes >= AI_MODEL_COMMIT_BYTES) {
+                    __sscma_delta_commit(userdata, map, written_len, content_len);
+                    last_commit_bytes = written_len;
+                }
             }
 
             remain_len -= (rcvlen + rcvlen2);
@@ -559,10 +665,20 @@ static void __sscma_writer_task(void *p_arg)
             ESP_LOGD(TAG, "%s sscma writer, write done, take %lld us", ota_type_str(ota_type), esp_timer_get_time() - start);
             sscma_client_ota_finish(sscma_client);
             ESP_LOGI(TAG, "%s sscma writer, finish, take %lld us, speed %d KB/s", ota_type_str(ota_type), esp_timer_get_time() - start,
-                            (int)(1000 * content_len / (esp_timer_get_time() - start)));
+                            (int)(1000 * (content_len - offset) / (esp_timer_get_time() - start)));
+            if (track) {
+                ESP_LOGI(TAG, "%s sscma writer, %d of %d bytes unchanged, not flashed", ota_type_str(ota_type), skipped, content_len - offset);
+                map->image_size = content_len;
+                ota_delta_map_save(map, 0, 0);
+                ota_delta_resume_clear();
+            }
         }
 sscma_writer_end0:
         free(chunk);
+        if (track && (is_abort || userdata->err != ESP_OK)) {
+            //keep what made it to flash, the next try of this url picks up from there
+            __sscma_delta_commit(userdata, map, written_len, content_len);
+        }
 sscma_writer_end:
         if (is_abort || userdata->err != ESP_OK) {
             ESP_LOGW(TAG, "sscma_client_ota_abort !!!");
@@ -600,6 +716,13 @@ static esp_err_t __http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_HEADER:
             ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
+            if (strcasecmp(evt->header_key, "ETag") == 0) {
+                strlcpy(userdata->etag, evt->header_value, sizeof(userdata->etag));
+            } else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+                if (sscanf(evt->header_value, "bytes %d-%*d/%d", &userdata->range_start, &userdata->range_total) != 2) {
+                    userdata->range_start = -1;
+                }
+            }
             break;
         case HTTP_EVENT_ON_DATA:
             ESP_LOGV(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
@@ -607,7 +730,22 @@ static esp_err_t __http_event_handler(esp_http_client_event_t *evt)
             if (content_len == 0) {
                 content_len = esp_http_client_get_content_length(evt->client);
                 ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, content_len=%d", content_len);
+                userdata->offset = 0;
                 userdata->content_len = content_len;
+                if (userdata->resume_offset > 0) {
+                    int status = esp_http_client_get_status_code(evt->client);
+                    if (status == 206 && userdata->range_start == userdata->resume_offset &&
+                        userdata->range_total == userdata->resume_size) {
+                        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, resuming at %d of %d", userdata->range_start, userdata->range_total);
+                        userdata->offset = userdata->range_start;
+                        userdata->content_len = userdata->range_total;
+                    } else if (status != 200) {
+                        //200 means the file changed (If-Range) or the server ignores Range, take the whole file then
+                        ESP_LOGW(TAG, "HTTP_EVENT_ON_DATA, unexpected answer to Range: %d", status);
+                        userdata->range_rejected = true;
+                        break;
+                    }
+                }
                 userdata->err = ESP_OK;
                 xTaskNotifyGive(g_task_sscma_writer);
 
@@ -615,6 +753,9 @@ static esp_err_t __http_event_handler(esp_http_client_event_t *evt)
                 last_report_bytes = step_bytes;
             }
 
+            if (userdata->range_rejected) {
+                break;  //nobody is waiting for this data
+            }
             if (userdata->err != ESP_OK) {
                 ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, userdata->err != ESP_OK (0x%x), error happened in sscma writer", userdata->err);
                 break;  // don't waste time on ringbuffer send
@@ -688,6 +829,29 @@ static void sscma_ota_process(uint32_t ota_type, char *url)
     g_sscma_writer_userdata.ota_type = ota_type;
     g_sscma_writer_userdata.http_client = http_client;
     g_sscma_writer_userdata.err = ESP_OK;
+    g_sscma_writer_userdata.url = url;
+    g_sscma_writer_userdata.resume_offset = 0;
+    g_sscma_writer_userdata.resume_size = 0;
+    g_sscma_writer_userdata.range_rejected = false;
+    g_sscma_writer_userdata.range_start = -1;
+    g_sscma_writer_userdata.range_total = 0;
+    g_sscma_writer_userdata.etag[0] = '\0';
+
+#if CONFIG_OTA_AI_MODEL_RESUME
+    ota_delta_resume_t resume;
+    char range[32];
+    if (ota_type == OTA_TYPE_AI_MODEL && ota_delta_resume_load(url, 0, &resume) == ESP_OK) {
+        ESP_LOGI(TAG, "sscma ota, resume from %" PRIu32 " of %" PRIu32, resume.committed, resume.image_size);
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", resume.committed);
+        esp_http_client_set_header(http_client, "Range", range);
+        if (resume.etag[0]) {
+            //if the file changed since, the server sends all of it with 200
+            esp_http_client_set_header(http_client, "If-Range", resume.etag);
+        }
+        g_sscma_writer_userdata.resume_offset = resume.committed;
+        g_sscma_writer_userdata.resume_size = resume.image_size;
+    }
+#endif
 
     //breakpoint to check if user canceled, this is the last chance to do early abortion
     if (xEventGroupWaitBits(g_eg_globalsync, EVENT_AI_MODEL_DL_EARLY_ABORT, pdTRUE, pdTRUE, 0) & EVENT_AI_MODEL_DL_EARLY_ABORT) {
@@ -698,6 +862,19 @@ static void sscma_ota_process(uint32_t ota_type, char *url)
 
     xEventGroupSetBits(g_eg_globalsync, EVENT_OTA_HIMAX_HTTP_GOING);
     esp_err_t err = esp_http_client_perform(http_client);
+    if (err == ESP_OK && g_sscma_writer_userdata.resume_offset > 0 &&
+        (g_sscma_writer_userdata.range_rejected || esp_http_client_get_status_code(http_client) >= 300)) {
+        //the writer never started, forget the resume record and fetch the whole file
+        ESP_LOGW(TAG, "sscma ota, can't resume, status %d, download all", esp_http_client_get_status_code(http_client));
+        ota_delta_resume_clear();
+        esp_http_client_close(http_client);
+        esp_http_client_delete_header(http_client, "Range");
+        esp_http_client_delete_header(http_client, "If-Range");
+        g_sscma_writer_userdata.resume_offset = 0;
+        g_sscma_writer_userdata.range_rejected = false;
+        g_sscma_writer_userdata.range_start = -1;
+        err = esp_http_client_perform(http_client);
+    }
     xEventGroupClearBits(g_eg_globalsync, EVENT_OTA_HIMAX_HTTP_GOING);
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "sscma ota, HTTP GET Status = %d, content_length = %"PRId64", take %lld us",
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
 #include "esp_https_ota.h"
@@ -13,6 +14,7 @@
 #include "sensecap-watcher.h"
 
 #include "data_defs.h"
+#include "ota_delta.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -60,6 +62,14 @@ typedef struct {
     int content_len;
     esp_err_t err;
     esp_http_client_handle_t http_client;
+    const char *url;            // ai model url, keys the resume record
+    int resume_offset;          // Range asked for, 0 if not resuming
+    int resume_size;            // image size recorded with the resume offset
+    int offset;                 // image offset of the first byte in the response
+    bool range_rejected;        // server answered the Range request with something unusable
+    int range_start;            // from Content-Range
+    int range_total;
+    char etag[OTA_DELTA_ETAG_LEN];
 } ota_sscma_writer_userdata_t;
 
 //worker cmd
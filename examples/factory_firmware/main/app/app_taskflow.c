@@ -18,6 +18,7 @@
 #include "tf_module_sensecraft_alarm.h"
 #include "tf_module_uart_alarm.h"
 #include "tf_module_http_alarm.h"
+#include "tf_module_util.h"
 #include "app_ota.h"
 
 static const char *TAG = "taskflow";
@@ -1015,6 +1016,25 @@ static void __ctrl_event_handler(void* handler_args,
 }
 
 
+/*
+ * Which worker runs each module's input handler. The frame path stays on its
+ * own worker so a sink stuck on uart or network can't hold up the camera;
+ * a full mailbox drops its oldest event, a stale frame or alarm is worth less
+ * than the latest one.
+ */
+static const struct {
+    const char *p_name;
+    tf_dispatch_cfg_t cfg;
+} __g_module_dispatch_cfgs[] = {
+    { TF_MODULE_AI_CAMERA_NAME,         { TF_DISPATCH_WORKER_FRAME,  4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_ALARM_TRIGGER_NAME,     { TF_DISPATCH_WORKER_FRAME,  4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_LOCAL_ALARM_NAME,       { TF_DISPATCH_WORKER_ALARM,  2, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_IMG_ANALYZER_NAME,      { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_SENSECRAFT_ALARM_NAME,  { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_UART_ALARM_NAME,        { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_HTTP_ALARM_NAME,        { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+};
+
 static  void taskflow_engine_module_init( struct app_taskflow * p_taskflow)
 {
     ESP_ERROR_CHECK(tf_engine_init());
@@ -1029,6 +1049,10 @@ static  void taskflow_engine_module_init( struct app_taskflow * p_taskflow)
     ESP_ERROR_CHECK(tf_module_http_alarm_register());
     //add more module
 
+    for (int i = 0; i < sizeof(__g_module_dispatch_cfgs) / sizeof(__g_module_dispatch_cfgs[0]); i++) {
+        ESP_ERROR_CHECK(tf_module_dispatch_set(__g_module_dispatch_cfgs[i].p_name, &__g_module_dispatch_cfgs[i].cfg));
+    }
+
     ESP_ERROR_CHECK(tf_engine_status_cb_register(__task_flow_status_cb, p_taskflow));
     ESP_ERROR_CHECK(tf_module_status_cb_register(__task_flow_module_status_cb, p_taskflow));
 }
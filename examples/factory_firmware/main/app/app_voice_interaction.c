@@ -16,6 +16,7 @@
 #include "uuid.h"
 #include "app_audio_player.h"
 #include "app_audio_recorder.h"
+#include "debi_audio.h"
 #include "app_rgb.h"
 #include "factory_info.h"
 #include "app_device_info.h"
@@ -885,6 +886,10 @@ static void __status_machine_handle(struct app_voice_interaction *p_vi)
     }
 
     if( p_vi->next_status != p_vi->cur_status ) {
+        // DEBI: the hub uplink gives up the mic for the whole interaction
+        if( p_vi->cur_status == VI_STATUS_IDLE || p_vi->next_status == VI_STATUS_IDLE ) {
+            debi_audio_pause(p_vi->next_status != VI_STATUS_IDLE);
+        }
         p_vi->cur_status = p_vi->next_status;
     }
 }
@@ -24,6 +24,7 @@
 #include "data_defs.h"
 #include "event_loops.h"
 #include "tf.h"
+#include "tf_util.h"
 #include "app_time.h"
 #include "app_wifi.h"
 #include "app_ble.h"
@@ -33,6 +34,7 @@
 #include "util.h"
 #include "storage.h"
 #include "app_png.h"
+#include "debi_hub.h"
 
 
 #define AT_CMD_BUFFER_LEN_STEP   (1024 * 100)  // the growing step of the size of at cmd buffer
@@ -359,12 +361,16 @@ void AT_command_reg()
     add_command(&commands, "taskflow?", handle_taskflow_query_command);
     add_command(&commands, "taskflow=", handle_taskflow_command);
     add_command(&commands, "taskflowinfo?", handle_taskflow_info_query_command);
+    add_command(&commands, "taskflowprofile?", handle_taskflow_profile_query_command);
+    add_command(&commands, "taskflowprofile=", handle_taskflow_profile_command);
     add_command(&commands, "cloudservice=", handle_cloud_service_command);
     add_command(&commands, "cloudservice?", handle_cloud_service_query_command);
     add_command(&commands, "emoji=", handle_emoji_command);
     add_command(&commands, "bind=", handle_bind_command);
     add_command(&commands, "localservice?", handle_localservice_query);
     add_command(&commands, "localservice=", handle_localservice_set);
+    add_command(&commands, "debihub?", handle_debihub_query);
+    add_command(&commands, "debihub=", handle_debihub_set);
 }
 
 /**
@@ -1473,6 +1479,140 @@ at_cmd_error_code handle_taskflow_info_query_command(char *params)
     return AT_CMD_SUCCESS;
 }
 
+/**
+ * @brief Report what each module of the running task flow costs: handler time and
+ *        task flow memory held, counted since the flow started or the last reset.
+ */
+at_cmd_error_code handle_taskflow_profile_query_command(char *params)
+{
+    ESP_LOGI(TAG, "Handling handle_taskflow_profile_query_command \n");
+    tf_module_profile_t *profiles = NULL;
+    tf_mem_stats_t other_mem;
+    int64_t window_us = 0;
+    int num_max = 0;
+    int num = 0;
+
+    tf_engine_module_num_get(&num_max);
+    profiles = psram_calloc(num_max > 0 ? num_max : 1, sizeof(tf_module_profile_t));
+    if (profiles == NULL)
+    {
+        return ERROR_CMD_MEM_ALLOC;
+    }
+    tf_engine_profile_get(profiles, num_max, &num, &window_us);
+
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create JSON object\n");
+        free(profiles);
+        return ERROR_CMD_JSON_CREATE;
+    }
+    cJSON *data_rep = cJSON_CreateObject();
+    cJSON *modules = cJSON_CreateArray();
+    if (data_rep == NULL || modules == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create JSON object\n");
+        cJSON_Delete(data_rep);
+        cJSON_Delete(modules);
+        cJSON_Delete(root);
+        free(profiles);
+        return ERROR_CMD_JSON_CREATE;
+    }
+    cJSON_AddStringToObject(root, "name", "taskflowprofile");
+    cJSON_AddNumberToObject(root, "code", 0);
+    cJSON_AddItemToObject(root, "data", data_rep);
+    cJSON_AddNumberToObject(data_rep, "window_ms", (double)(window_us / 1000));
+    cJSON_AddItemToObject(data_rep, "modules", modules);
+
+    for (int i = 0; i < num; i++)
+    {
+        tf_module_profile_t *p = &profiles[i];
+        cJSON *item = cJSON_CreateObject();
+        if (item == NULL)
+        {
+            break;
+        }
+        cJSON_AddNumberToObject(item, "id", p->id);
+        cJSON_AddStringToObject(item, "type", p->name);
+        cJSON_AddNumberToObject(item, "events", p->events);
+        cJSON_AddNumberToObject(item, "dropped", p->dropped);
+        cJSON_AddNumberToObject(item, "wait_max_us", p->wait_max_us);
+        cJSON_AddNumberToObject(item, "run_max_us", p->run_max_us);
+        cJSON_AddNumberToObject(item, "run_ms", (double)(p->run_total_us / 1000));
+        // per mille of one core
+        cJSON_AddNumberToObject(item, "cpu", window_us > 0 ? (double)(p->run_total_us * 1000 / window_us) : 0);
+        cJSON_AddNumberToObject(item, "allocs", p->alloc_num);
+        cJSON_AddNumberToObject(item, "mem", p->mem_cur_bytes);
+        cJSON_AddNumberToObject(item, "mem_peak", p->mem_peak_bytes);
+        cJSON_AddItemToArray(modules, item);
+    }
+    // engine, flow parsing and anything not charged to a module
+    if (tf_mem_stats_get(TF_OWNER_NONE, &other_mem) == ESP_OK)
+    {
+        cJSON_AddNumberToObject(data_rep, "other_mem", other_mem.cur_bytes);
+        cJSON_AddNumberToObject(data_rep, "other_mem_peak", other_mem.peak_bytes);
+    }
+    free(profiles);
+
+    char *json_string = cJSON_PrintUnformatted(root);
+    ESP_LOGD(TAG, "JSON String: %s\n", json_string);
+    esp_err_t send_result = send_at_response(json_string);
+    if (send_result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send AT response\n");
+        cJSON_Delete(root);
+        free(json_string);
+        return ERROR_CMD_RESPONSE;
+    }
+    cJSON_Delete(root);
+    free(json_string);
+    return AT_CMD_SUCCESS;
+}
+
+/**
+ * @brief Start a new task flow profile window, params: {"reset": 1}
+ */
+at_cmd_error_code handle_taskflow_profile_command(char *params)
+{
+    ESP_LOGI(TAG, "Handling taskflow profile command\n");
+    cJSON *json = cJSON_Parse(params);
+    if (json == NULL)
+    {
+        return ERROR_CMD_JSON_PARSE;
+    }
+    cJSON *json_reset = cJSON_GetObjectItem(json, "reset");
+    if (json_reset == NULL || !cJSON_IsNumber(json_reset))
+    {
+        cJSON_Delete(json);
+        return ERROR_CMD_JSON_TYPE;
+    }
+    if (json_reset->valueint)
+    {
+        tf_engine_profile_reset();
+    }
+    cJSON_Delete(json);
+
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create JSON object\n");
+        return ERROR_CMD_JSON_CREATE;
+    }
+    cJSON_AddStringToObject(root, "name", "taskflowprofile");
+    cJSON_AddNumberToObject(root, "code", 0);
+    cJSON_AddItemToObject(root, "data", cJSON_CreateObject());
+    char *json_string = cJSON_PrintUnformatted(root);
+    esp_err_t send_result = send_at_response(json_string);
+    cJSON_Delete(root);
+    free(json_string);
+    if (send_result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send AT response\n");
+        return ERROR_CMD_RESPONSE;
+    }
+    return AT_CMD_SUCCESS;
+}
+
 at_cmd_error_code handle_taskflow_command(char *params)
 {
     esp_err_t code = ESP_OK;
@@ -1678,6 +1818,144 @@ localservice_set_end:
     return ret;
 }
 
+at_cmd_error_code handle_debihub_query(char *params)
+{
+    (void)params; // Prevent unused parameter warning
+    ESP_LOGI(TAG, "%s \n", __func__);
+
+    debi_hub_config_t cfg;
+    debi_hub_status_t st;
+    debi_hub_get_config(&cfg);
+    debi_hub_get_status(&st);
+
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create JSON object\n");
+        return ERROR_CMD_JSON_CREATE;
+    }
+    cJSON_AddStringToObject(root, "name", "debihub");
+    cJSON_AddNumberToObject(root, "code", 0);
+    bool passthrough = false;
+    do {
+        cJSON *data = cJSON_AddObjectToObject(root, "data");
+        if (!data) break;
+        cJSON *uris = cJSON_AddArrayToObject(data, "uris");
+        if (!uris) break;
+        int i;
+        for (i = 0; i < DEBI_HUB_ENDPOINTS; i++) {
+            if (!cfg.uris[i][0]) continue;
+            cJSON *uri = cJSON_CreateString(cfg.uris[i]);
+            if (!uri) break;
+            cJSON_AddItemToArray(uris, uri);
+        }
+        if (i < DEBI_HUB_ENDPOINTS) break;
+        // the password is write-only
+        if (!cJSON_AddStringToObject(data, "user", cfg.user)) break;
+        if (!cJSON_AddStringToObject(data, "hub_id", cfg.hub_id)) break;
+        if (!cJSON_AddBoolToObject(data, "mdns", cfg.mdns)) break;
+        if (!cJSON_AddBoolToObject(data, "connected", st.connected)) break;
+        if (!cJSON_AddStringToObject(data, "current", st.uri)) break;
+        if (!cJSON_AddStringToObject(data, "source", debi_hub_source_name(st.source))) break;
+
+        passthrough = true;
+    } while (0);
+    if (!passthrough) {
+        cJSON_Delete(root);
+        return ERROR_CMD_JSON_CREATE;
+    }
+
+    at_cmd_error_code ret = AT_CMD_SUCCESS;
+    char *json_string = cJSON_Print(root);
+    ESP_LOGD(TAG, "%s: JSON String: %s\n", __func__, json_string);
+    if (send_at_response(json_string) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send AT response\n");
+        ret = ERROR_CMD_RESPONSE;
+    }
+    cJSON_Delete(root);
+    free(json_string);
+
+    return ret;
+}
+
+static void __debihub_copy_str(cJSON *data, const char *key, char *dst, size_t len)
+{
+    cJSON *item = cJSON_GetObjectItem(data, key);
+    if (item && cJSON_IsString(item)) {
+        strlcpy(dst, item->valuestring, len);
+    }
+}
+
+at_cmd_error_code handle_debihub_set(char *params)
+{
+    ESP_LOGI(TAG, "%s \n", __func__);
+
+    cJSON *json = cJSON_Parse(params);
+    if (json == NULL)
+    {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL)
+        {
+            ESP_LOGE(TAG, "Error before: %s\n", error_ptr);
+        }
+        return ERROR_CMD_JSON_PARSE;
+    }
+
+    at_cmd_error_code ret = AT_CMD_SUCCESS;
+    cJSON *data = cJSON_GetObjectItem(json, "data");
+    if (!data) goto debihub_set_end;
+
+    // keys left out keep their saved value
+    debi_hub_config_t cfg;
+    debi_hub_get_config(&cfg);
+    cfg.pass[0] = '\0';
+
+    cJSON *uris = cJSON_GetObjectItem(data, "uris");
+    if (uris) {
+        if (!cJSON_IsArray(uris) || cJSON_GetArraySize(uris) > DEBI_HUB_ENDPOINTS) {
+            ret = ESP_ERR_INVALID_ARG;
+            goto debihub_set_end;
+        }
+        memset(cfg.uris, 0, sizeof(cfg.uris));
+        int i = 0;
+        cJSON *uri;
+        cJSON_ArrayForEach(uri, uris) {
+            if (!cJSON_IsString(uri) || strlen(uri->valuestring) >= DEBI_HUB_URI_MAX) {
+                ret = ESP_ERR_INVALID_ARG;
+                goto debihub_set_end;
+            }
+            strlcpy(cfg.uris[i++], uri->valuestring, DEBI_HUB_URI_MAX);
+        }
+    }
+    __debihub_copy_str(data, "user", cfg.user, sizeof(cfg.user));
+    __debihub_copy_str(data, "pass", cfg.pass, sizeof(cfg.pass));
+    __debihub_copy_str(data, "hub_id", cfg.hub_id, sizeof(cfg.hub_id));
+    cJSON *mdns = cJSON_GetObjectItem(data, "mdns");
+    if (mdns && cJSON_IsGeneralBool(mdns)) {
+        cfg.mdns = cJSON_IsGeneralTrue(mdns);
+    }
+
+    ESP_GOTO_ON_ERROR(debi_hub_set_config(&cfg), debihub_set_end, TAG,
+                      "%s: error when setting hub cfg!!!", __func__);
+
+debihub_set_end:
+    // don't echo the password back
+    cJSON_DeleteItemFromObject(data, "pass");
+    cJSON_AddNumberToObject(json, "code", (int)ret);
+    char *json_string = cJSON_Print(json);
+    ESP_LOGD(TAG, "JSON String: %s", json_string);
+    if (send_at_response(json_string) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send AT response\n");
+        ret = ERROR_CMD_RESPONSE;
+    }
+    cJSON_Delete(json);
+    free(json_string);
+
+    return ret;
+}
+
 
 /**
  * @brief A static task that handles incoming AT commands, parses them, and executes the corresponding actions.
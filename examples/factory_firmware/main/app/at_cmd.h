@@ -102,6 +102,8 @@ at_cmd_error_code handle_wifi_table(char *params);  // WiFi table command
 at_cmd_error_code handle_deviceinfo_cfg_command(char *params);  // Timezone command
 at_cmd_error_code handle_taskflow_command(char *params); // Taskflow command
 at_cmd_error_code handle_taskflow_info_query_command(char *params);    // Taskflow info query command
+at_cmd_error_code handle_taskflow_profile_query_command(char *params); // Taskflow profile query command
+at_cmd_error_code handle_taskflow_profile_command(char *params);       // Taskflow profile reset command
 at_cmd_error_code handle_cloud_service_command(char *params);    // Cloud service command
 at_cmd_error_code handle_cloud_service_query_command(char *params);    // Cloud service query command
 at_cmd_error_code handle_emoji_command(char *params);    // Emoji command
@@ -109,6 +111,8 @@ at_cmd_error_code handle_taskflow_query_command(char *params); // Taskflow query
 at_cmd_error_code handle_bind_command(char *params); // Bind command
 at_cmd_error_code handle_localservice_query(char *params);  // Local service query command
 at_cmd_error_code handle_localservice_set(char *params);  // Local service config command
+at_cmd_error_code handle_debihub_query(char *params);  // Debi hub endpoints query command
+at_cmd_error_code handle_debihub_set(char *params);  // Debi hub endpoints config command
 
 void init_event_loop_and_task();
 void app_at_cmd_init();
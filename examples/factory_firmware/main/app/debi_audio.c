@@ -0,0 +1,605 @@
+/**
+ * @file debi_audio.c
+ * @brief Debi Audio - Opus audio uplink to the hub
+ *
+ * One task holds the app_audio_recorder stream, cuts it into
+ * DEBI_AUDIO_FRAME_MS frames and runs each through an energy VAD.
+ * While the gate is shut the frames wait in a short pre-roll ring;
+ * when it opens the encoder is reset and the pre-roll goes out first,
+ * so the hub hears the onset.  Encoded packets are gathered into
+ * chunks (see debi_audio.h) and published directly at QoS 0, like
+ * camera chunks: audio that missed the hub is of no use later, so
+ * none of it is queued.
+ *
+ * The VAD tracks the noise floor as the quietest second of the last
+ * DEBI_AUDIO_FLOOR_S (minimum statistics), so a fan or heater that
+ * comes on is learnt within that time while a cry, which has pauses
+ * for breath, keeps the gate open.
+ *
+ * The codec is shared: the player reopens it at the sound's rate and,
+ * when a stream ends, stops it.  Audio at another rate is skipped and
+ * a mic that stopped delivering is reopened once the player is idle.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_audio.h"
+#include "debi_os.h"
+#include "app_audio_recorder.h"
+#include "app_audio_player.h"
+
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "mqtt_client.h"
+#include "opus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "debi_audio";
+
+#define AUDIO_TASK_STACK        (32 * 1024)   /* Opus keeps its scratch on the stack */
+#define AUDIO_TASK_PRIO         4             /* below the recorder and MQTT */
+#define AUDIO_TASK_CORE         1
+#define AUDIO_RECV_WAIT_MS      200
+#define AUDIO_PAUSE_WAIT_MS     1000
+
+#define FRAME_SAMPLES           (DEBI_AUDIO_RATE * DEBI_AUDIO_FRAME_MS / 1000)
+#define PREROLL_FRAMES          (DEBI_AUDIO_PREROLL_MS / DEBI_AUDIO_FRAME_MS)
+#define ONSET_FRAMES            (DEBI_AUDIO_VAD_ONSET_MS / DEBI_AUDIO_FRAME_MS)
+#define HANG_FRAMES             (DEBI_AUDIO_HANG_MS / DEBI_AUDIO_FRAME_MS)
+#define FLOOR_BLOCK_FRAMES      (1000 / DEBI_AUDIO_FRAME_MS)
+/* Largest packet at BITRATE_MAX, with room for VBR peaks */
+#define PACKET_MAX              (DEBI_AUDIO_BITRATE_MAX / 8 * DEBI_AUDIO_FRAME_MS / 1000 * 2)
+#define MSG_MAX                 (DEBI_AUDIO_HDR_LEN + DEBI_AUDIO_CHUNK_FRAMES * (2 + PACKET_MAX))
+
+/* ── Internal state ── */
+typedef struct {
+    int16_t   pcm[FRAME_SAMPLES];
+    int64_t   ts_us;               /* capture time of pcm[0], 0 if unknown */
+    bool      gap;                 /* mic samples lost just before it */
+} audio_frame_t;
+
+typedef struct {
+    /* task only */
+    OpusEncoder     *enc;
+    int              bitrate;      /* applied to enc */
+    int              complexity;
+    bool             stream_on;    /* holding the recorder stream */
+    int64_t          audio_us;     /* when audio last arrived */
+
+    /* frames: the pre-roll ring, then the one being filled */
+    audio_frame_t   *frames;       /* PREROLL_FRAMES + 1 */
+    int              pre_head;
+    int              pre_n;
+    int              fill_n;       /* samples in the frame being filled */
+    bool             gap;          /* for the next frame */
+
+    /* VAD */
+    float            min_energy;   /* DEBI_AUDIO_VAD_MIN_DBFS, mean square */
+    float            snr_lin;      /* DEBI_AUDIO_VAD_SNR_DB as a ratio */
+    float            floor;        /* noise floor, mean square */
+    float            block_min;    /* quietest frame of the current second */
+    float            blocks[DEBI_AUDIO_FLOOR_S];
+    int              block_frames;
+    int              blocks_n;
+    int              block_pos;
+    int              voice_run;    /* voiced frames in a row */
+    int              hang;         /* frames the VAD keeps the gate open */
+    bool             open;
+
+    /* chunk being built */
+    uint8_t         *msg;          /* MSG_MAX */
+    size_t           msg_len;
+    int              chunk_frames;
+    uint8_t          chunk_flags;
+    uint8_t          chunk_snr;
+    int64_t          chunk_ts_us;
+    uint32_t         seq;
+    float            enc_avg_us;
+
+    SemaphoreHandle_t lock;        /* stats */
+    SemaphoreHandle_t released;    /* given when the stream is let go */
+    TaskHandle_t      task;
+    debi_audio_stats_t stats;
+} audio_state_t;
+
+static audio_state_t s_audio;
+
+typedef struct {
+    debi_audio_mode_t mode;
+    int64_t           until_us;    /* mode expiry, 0 = none */
+    bool              paused;
+    int               bitrate;
+    int               complexity;
+} audio_ctl_t;
+
+static audio_ctl_t s_ctl = {
+    .mode       = DEBI_AUDIO_MODE_VAD,
+    .bitrate    = DEBI_AUDIO_BITRATE,
+    .complexity = DEBI_AUDIO_COMPLEXITY,
+};
+static portMUX_TYPE s_ctl_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const MODE_NAMES[] = { "vad", "on", "off" };
+
+/* ────────────────────────────────────────────────────
+ *  Wire format helpers
+ * ──────────────────────────────────────────────────── */
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, v & 0xffff);
+    return put_u16(p, v >> 16);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Control
+ * ──────────────────────────────────────────────────── */
+
+static audio_ctl_t ctl_get(int64_t now)
+{
+    portENTER_CRITICAL(&s_ctl_mux);
+    audio_ctl_t c = s_ctl;
+    portEXIT_CRITICAL(&s_ctl_mux);
+
+    if (c.mode != DEBI_AUDIO_MODE_VAD && c.until_us && now >= c.until_us) {
+        c.mode = DEBI_AUDIO_MODE_VAD;
+    }
+    return c;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Chunks
+ * ──────────────────────────────────────────────────── */
+
+static void chunk_reset(void)
+{
+    s_audio.msg_len = DEBI_AUDIO_HDR_LEN;
+    s_audio.chunk_frames = 0;
+    s_audio.chunk_flags = 0;
+    s_audio.chunk_snr = 0;
+    s_audio.chunk_ts_us = 0;
+}
+
+static void chunk_publish(uint8_t flags)
+{
+    if (s_audio.chunk_frames == 0) {
+        return;
+    }
+
+    uint8_t *p = s_audio.msg;
+    *p++ = 'D';
+    *p++ = 'A';
+    *p++ = DEBI_AUDIO_PROTO_VERSION;
+    *p++ = s_audio.chunk_flags | flags;
+    p = put_u32(p, s_audio.seq++);
+    p = put_u32(p, (uint32_t)s_audio.chunk_ts_us);
+    p = put_u32(p, (uint32_t)((uint64_t)s_audio.chunk_ts_us >> 32));
+    p = put_u16(p, DEBI_AUDIO_RATE);
+    p = put_u16(p, FRAME_SAMPLES);
+    *p++ = (uint8_t)s_audio.chunk_frames;
+    *p++ = s_audio.chunk_snr;
+
+    esp_mqtt_client_handle_t mqtt = debi_os_get_mqtt_handle();
+    bool ok = mqtt && debi_os_hub_connected() &&
+              esp_mqtt_client_publish(mqtt, DEBI_TOPIC_AUDIO_CHUNK, (const char *)s_audio.msg,
+                                      (int)s_audio.msg_len, 0, 0) >= 0;
+
+    xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+    if (ok) {
+        s_audio.stats.chunks_sent++;
+        s_audio.stats.bytes_sent += s_audio.msg_len - DEBI_AUDIO_HDR_LEN - 2 * s_audio.chunk_frames;
+    } else {
+        s_audio.stats.chunks_lost++;
+    }
+    xSemaphoreGive(s_audio.lock);
+
+    chunk_reset();
+}
+
+/* ────────────────────────────────────────────────────
+ *  Encoder
+ * ──────────────────────────────────────────────────── */
+
+static void encoder_apply(void)
+{
+    audio_ctl_t c = ctl_get(0);
+    if (c.bitrate != s_audio.bitrate) {
+        opus_encoder_ctl(s_audio.enc, OPUS_SET_BITRATE(c.bitrate));
+        s_audio.bitrate = c.bitrate;
+    }
+    if (c.complexity != s_audio.complexity) {
+        opus_encoder_ctl(s_audio.enc, OPUS_SET_COMPLEXITY(c.complexity));
+        s_audio.complexity = c.complexity;
+    }
+}
+
+static void encode_frame(const audio_frame_t *f, float energy, bool voice)
+{
+    if (s_audio.chunk_frames == DEBI_AUDIO_CHUNK_FRAMES) {
+        chunk_publish(0);
+    }
+    if (f->gap && s_audio.chunk_frames > 0) {
+        chunk_publish(0);   /* a chunk never spans lost samples */
+    }
+    if (f->gap && !(s_audio.chunk_flags & DEBI_AUDIO_FLAG_START)) {
+        s_audio.chunk_flags |= DEBI_AUDIO_FLAG_GAP;
+        xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+        s_audio.stats.gaps++;
+        xSemaphoreGive(s_audio.lock);
+    }
+    if (s_audio.chunk_frames == 0) {
+        s_audio.chunk_ts_us = f->ts_us;
+    }
+
+    encoder_apply();
+    uint8_t *out = s_audio.msg + s_audio.msg_len;
+    int64_t start = esp_timer_get_time();
+    int n = opus_encode(s_audio.enc, f->pcm, FRAME_SAMPLES, out + 2, PACKET_MAX);
+    int32_t took = (int32_t)(esp_timer_get_time() - start);
+    if (n < 0) {
+        ESP_LOGW(TAG, "encode failed: %s", opus_strerror(n));
+        return;
+    }
+    put_u16(out, (uint16_t)n);
+    s_audio.msg_len += 2 + n;
+    s_audio.chunk_frames++;
+
+    float snr = s_audio.floor > 0.0f ? 10.0f * log10f(energy / s_audio.floor) : 255.0f;
+    uint8_t snr_db = snr <= 0.0f ? 0 : snr >= 255.0f ? 255 : (uint8_t)snr;
+    if (snr_db > s_audio.chunk_snr) {
+        s_audio.chunk_snr = snr_db;
+    }
+    if (voice) {
+        s_audio.chunk_flags |= DEBI_AUDIO_FLAG_VOICE;
+    }
+
+    s_audio.enc_avg_us += (took - s_audio.enc_avg_us) / 256.0f;
+    xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+    s_audio.stats.frames_encoded++;
+    if (took > s_audio.stats.encode_us_max) {
+        s_audio.stats.encode_us_max = took;
+    }
+    s_audio.stats.encode_us_avg = (int32_t)s_audio.enc_avg_us;
+    xSemaphoreGive(s_audio.lock);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Gate
+ * ──────────────────────────────────────────────────── */
+
+/* Mean square of a frame around its own mean, so mic DC offset is not
+ * taken for sound */
+static float frame_energy(const int16_t *pcm)
+{
+    int64_t sum = 0, sum2 = 0;
+    for (int i = 0; i < FRAME_SAMPLES; i++) {
+        sum += pcm[i];
+        sum2 += (int32_t)pcm[i] * pcm[i];
+    }
+    return ((float)sum2 - (float)sum * (float)sum / FRAME_SAMPLES) / FRAME_SAMPLES;
+}
+
+/* Update the floor and the VAD gate with one frame; true if it is voice */
+static bool vad_update(float energy)
+{
+    /* Minimum statistics: the floor is the quietest frame of the
+     * quietest second in the last FLOOR_S */
+    if (s_audio.block_frames == 0 || energy < s_audio.block_min) {
+        s_audio.block_min = energy;
+    }
+    if (++s_audio.block_frames == FLOOR_BLOCK_FRAMES) {
+        s_audio.blocks[s_audio.block_pos] = s_audio.block_min;
+        s_audio.block_pos = (s_audio.block_pos + 1) % DEBI_AUDIO_FLOOR_S;
+        if (s_audio.blocks_n < DEBI_AUDIO_FLOOR_S) s_audio.blocks_n++;
+        s_audio.block_frames = 0;
+    }
+    float floor = s_audio.block_frames ? s_audio.block_min : INFINITY;
+    for (int i = 0; i < s_audio.blocks_n; i++) {
+        if (s_audio.blocks[i] < floor) floor = s_audio.blocks[i];
+    }
+    s_audio.floor = floor;
+
+    bool voice = energy > s_audio.min_energy && energy > floor * s_audio.snr_lin;
+
+    /* Only a run re-arms the hang too: the odd loud frame in breathing
+     * or a click would otherwise hold the gate open for good */
+    s_audio.voice_run = voice ? s_audio.voice_run + 1 : 0;
+    if (s_audio.voice_run >= ONSET_FRAMES) {
+        s_audio.hang = HANG_FRAMES;
+    } else if (s_audio.hang > 0) {
+        s_audio.hang--;
+    }
+    return voice;
+}
+
+static void spurt_end(void)
+{
+    if (s_audio.open) {
+        chunk_publish(DEBI_AUDIO_FLAG_END);
+        s_audio.open = false;
+    }
+}
+
+/* A frame is complete: hold it for the pre-roll or send it */
+static void frame_done(void)
+{
+    int slots = PREROLL_FRAMES + 1;
+    audio_frame_t *f = &s_audio.frames[(s_audio.pre_head + s_audio.pre_n) % slots];
+    float energy = frame_energy(f->pcm);
+    bool voice = vad_update(energy);
+
+    audio_ctl_t c = ctl_get(esp_timer_get_time());
+    bool open = debi_os_hub_connected() &&
+                (c.mode == DEBI_AUDIO_MODE_ON ||
+                 (c.mode == DEBI_AUDIO_MODE_VAD && s_audio.hang > 0));
+
+    if (!open) {
+        spurt_end();
+        /* Into the pre-roll; audio before a gap is no use with it */
+        if (f->gap) {
+            s_audio.pre_head = (s_audio.pre_head + s_audio.pre_n) % slots;
+            s_audio.pre_n = 0;
+        }
+        if (s_audio.pre_n == PREROLL_FRAMES) {
+            s_audio.pre_head = (s_audio.pre_head + 1) % slots;
+        } else {
+            s_audio.pre_n++;
+        }
+        return;
+    }
+
+    if (!s_audio.open) {
+        s_audio.open = true;
+        opus_encoder_ctl(s_audio.enc, OPUS_RESET_STATE);
+        chunk_reset();
+        s_audio.chunk_flags = DEBI_AUDIO_FLAG_START;
+        xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+        s_audio.stats.spurts++;
+        xSemaphoreGive(s_audio.lock);
+
+        for (int i = 0; i < s_audio.pre_n; i++) {
+            audio_frame_t *pre = &s_audio.frames[(s_audio.pre_head + i) % slots];
+            pre->gap = false;
+            encode_frame(pre, frame_energy(pre->pcm), false);
+        }
+        s_audio.pre_head = (s_audio.pre_head + s_audio.pre_n) % slots;
+        s_audio.pre_n = 0;
+        f->gap = false;
+    }
+    encode_frame(f, energy, voice);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Audio in
+ * ──────────────────────────────────────────────────── */
+
+/* What was read is not the uplink's: start over after it */
+static void audio_skip(size_t samples)
+{
+    spurt_end();
+    s_audio.fill_n = 0;
+    s_audio.gap = true;
+    xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+    s_audio.stats.frames_skipped += samples / FRAME_SAMPLES;
+    xSemaphoreGive(s_audio.lock);
+}
+
+static void audio_feed(const int16_t *pcm, size_t n, const struct app_audio_recorder_stamp *stamp)
+{
+    if (stamp->gap) {
+        s_audio.fill_n = 0;   /* a partial frame before lost samples is dropped */
+        s_audio.gap = true;
+    }
+
+    size_t i = 0;
+    while (i < n) {
+        audio_frame_t *f = &s_audio.frames[(s_audio.pre_head + s_audio.pre_n) % (PREROLL_FRAMES + 1)];
+        if (s_audio.fill_n == 0) {
+            f->ts_us = stamp->ts_us ? stamp->ts_us + (int64_t)((uint64_t)i * 1000000 / DEBI_AUDIO_RATE) : 0;
+            f->gap = s_audio.gap;
+            s_audio.gap = false;
+        }
+        size_t take = FRAME_SAMPLES - s_audio.fill_n;
+        if (take > n - i) take = n - i;
+        memcpy(f->pcm + s_audio.fill_n, pcm + i, take * sizeof(int16_t));
+        s_audio.fill_n += take;
+        i += take;
+        if (s_audio.fill_n == FRAME_SAMPLES) {
+            s_audio.fill_n = 0;
+            frame_done();
+        }
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Task
+ * ──────────────────────────────────────────────────── */
+
+static bool player_busy(void)
+{
+    return app_audio_player_status_get() != AUDIO_PLAYER_STATUS_IDLE;
+}
+
+static void mic_release(void)
+{
+    spurt_end();
+    if (s_audio.stream_on) {
+        app_audio_recorder_stream_stop();
+        s_audio.stream_on = false;
+    }
+}
+
+static void audio_task(void *arg)
+{
+    struct app_audio_recorder_stamp stamp;
+
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        audio_ctl_t c = ctl_get(now);
+
+        /* OFF waits for the player: stopping the stream stops the codec */
+        if (c.paused || (c.mode == DEBI_AUDIO_MODE_OFF && !player_busy())) {
+            mic_release();
+            xSemaphoreGive(s_audio.released);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        if (!s_audio.stream_on) {
+            if (app_audio_recorder_stream_start() != ESP_OK) {
+                ESP_LOGW(TAG, "mic unavailable");
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+                continue;
+            }
+            s_audio.stream_on = true;
+            s_audio.audio_us = now;
+            s_audio.fill_n = 0;
+            s_audio.gap = true;
+        }
+
+        size_t len = 0;
+        uint8_t *p = app_audio_recorder_stream_recv_stamped(&len, pdMS_TO_TICKS(AUDIO_RECV_WAIT_MS),
+                                                            &stamp);
+        now = esp_timer_get_time();
+        if (!p) {
+            if (now - s_audio.audio_us > DEBI_AUDIO_STALL_MS * 1000LL && !player_busy()) {
+                ESP_LOGW(TAG, "no audio for %d ms, reopening the mic", DEBI_AUDIO_STALL_MS);
+                mic_release();
+            }
+            continue;
+        }
+        s_audio.audio_us = now;
+
+        size_t samples = len / sizeof(int16_t);
+        bool busy = player_busy();
+        if (busy || stamp.rate != DEBI_AUDIO_RATE) {
+            audio_skip(samples);
+        } else {
+            audio_feed((const int16_t *)p, samples, &stamp);
+        }
+        app_audio_recorder_stream_free(p);
+
+        /* The player left the mic at its own rate */
+        if (!busy && stamp.rate != DEBI_AUDIO_RATE) {
+            mic_release();
+        }
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_audio_init(void)
+{
+    if (s_audio.task) return ESP_OK;
+
+    int err = OPUS_OK;
+    s_audio.enc = opus_encoder_create(DEBI_AUDIO_RATE, 1, OPUS_APPLICATION_AUDIO, &err);
+    ESP_RETURN_ON_FALSE(s_audio.enc && err == OPUS_OK, ESP_FAIL, TAG,
+                        "opus encoder: %s", opus_strerror(err));
+    s_audio.min_energy = 32768.0f * 32768.0f * powf(10.0f, DEBI_AUDIO_VAD_MIN_DBFS / 10.0f);
+    s_audio.snr_lin = powf(10.0f, DEBI_AUDIO_VAD_SNR_DB / 10.0f);
+    s_audio.bitrate = s_ctl.bitrate;
+    s_audio.complexity = s_ctl.complexity;
+    opus_encoder_ctl(s_audio.enc, OPUS_SET_BITRATE(s_audio.bitrate));
+    opus_encoder_ctl(s_audio.enc, OPUS_SET_COMPLEXITY(s_audio.complexity));
+
+    s_audio.lock = xSemaphoreCreateMutex();
+    s_audio.released = xSemaphoreCreateBinary();
+    s_audio.frames = heap_caps_calloc(PREROLL_FRAMES + 1, sizeof(audio_frame_t), MALLOC_CAP_SPIRAM);
+    s_audio.msg = heap_caps_malloc(MSG_MAX, MALLOC_CAP_SPIRAM);
+    ESP_RETURN_ON_FALSE(s_audio.lock && s_audio.released && s_audio.frames && s_audio.msg,
+                        ESP_ERR_NO_MEM, TAG, "no mem");
+    chunk_reset();
+
+    /* Too deep for internal RAM, like the recorder's */
+    StackType_t *stack = heap_caps_malloc(AUDIO_TASK_STACK, MALLOC_CAP_SPIRAM);
+    StaticTask_t *tcb = heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(stack && tcb, ESP_ERR_NO_MEM, TAG, "no mem for task");
+    s_audio.task = xTaskCreateStaticPinnedToCore(audio_task, "debi_audio", AUDIO_TASK_STACK, NULL,
+                                                 AUDIO_TASK_PRIO, stack, tcb, AUDIO_TASK_CORE);
+    ESP_RETURN_ON_FALSE(s_audio.task, ESP_FAIL, TAG, "task create failed");
+
+    ESP_LOGI(TAG, "ready  %d bps  complexity %d  %d ms frames  mode %s",
+             s_audio.bitrate, s_audio.complexity, DEBI_AUDIO_FRAME_MS, MODE_NAMES[s_ctl.mode]);
+    return ESP_OK;
+}
+
+void debi_audio_set_mode(debi_audio_mode_t mode, int duration_s)
+{
+    int64_t until = duration_s > 0 ? esp_timer_get_time() + duration_s * 1000000LL : 0;
+
+    portENTER_CRITICAL(&s_ctl_mux);
+    s_ctl.mode = mode;
+    s_ctl.until_us = until;
+    portEXIT_CRITICAL(&s_ctl_mux);
+
+    if (s_audio.task) {
+        xTaskNotifyGive(s_audio.task);
+    }
+    ESP_LOGI(TAG, "mode %s for %ds", MODE_NAMES[mode], duration_s);
+}
+
+void debi_audio_set_encoder(int bitrate, int complexity)
+{
+    if (bitrate > 0 && bitrate < DEBI_AUDIO_BITRATE_MIN) bitrate = DEBI_AUDIO_BITRATE_MIN;
+    if (bitrate > DEBI_AUDIO_BITRATE_MAX) bitrate = DEBI_AUDIO_BITRATE_MAX;
+    if (complexity > 10) complexity = 10;
+
+    portENTER_CRITICAL(&s_ctl_mux);
+    if (bitrate > 0) s_ctl.bitrate = bitrate;
+    if (complexity >= 0) s_ctl.complexity = complexity;
+    bitrate = s_ctl.bitrate;
+    complexity = s_ctl.complexity;
+    portEXIT_CRITICAL(&s_ctl_mux);
+
+    ESP_LOGI(TAG, "encoder %d bps  complexity %d", bitrate, complexity);
+}
+
+void debi_audio_pause(bool pause)
+{
+    if (s_audio.task && pause) {
+        xSemaphoreTake(s_audio.released, 0);   /* only a release from now on counts */
+    }
+
+    portENTER_CRITICAL(&s_ctl_mux);
+    s_ctl.paused = pause;
+    portEXIT_CRITICAL(&s_ctl_mux);
+
+    if (!s_audio.task) return;
+    xTaskNotifyGive(s_audio.task);
+    if (pause && xSemaphoreTake(s_audio.released, pdMS_TO_TICKS(AUDIO_PAUSE_WAIT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "mic not released in %d ms", AUDIO_PAUSE_WAIT_MS);
+    }
+}
+
+debi_audio_mode_t debi_audio_get_mode(void)
+{
+    return ctl_get(esp_timer_get_time()).mode;
+}
+
+void debi_audio_get_stats(debi_audio_stats_t *out)
+{
+    if (!out) return;
+    if (!s_audio.lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_audio.lock, portMAX_DELAY);
+    *out = s_audio.stats;
+    xSemaphoreGive(s_audio.lock);
+}
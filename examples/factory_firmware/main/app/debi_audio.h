@@ -0,0 +1,178 @@
+/**
+ * @file debi_audio.h
+ * @brief Debi Audio — Opus audio uplink to the hub
+ *
+ * Streams the microphone to the hub for cry and breathing analysis.
+ * Audio comes from the app_audio_recorder stream with its debi_clock
+ * stamps, is cut into DEBI_AUDIO_FRAME_MS frames, Opus-encoded and
+ * published in DEBI_AUDIO_CHUNK_FRAMES-frame chunks on
+ * DEBI_TOPIC_AUDIO_CHUNK at QoS 0, about 10 small messages a second
+ * instead of 256 kbps of PCM.
+ *
+ * What is sent depends on the mode:
+ *   VAD  (default) a frame DEBI_AUDIO_VAD_SNR_DB above the noise floor
+ *        opens the gate for at least DEBI_AUDIO_HANG_MS, with the
+ *        DEBI_AUDIO_PREROLL_MS before it, so a cry is sent from its
+ *        start and silence is not sent at all
+ *   ON   everything, for quiet sounds such as breathing; the hub asks
+ *        for it with the "audio" command, usually for a while
+ *   OFF  nothing, and the mic is released
+ * The mic also goes to voice interaction while it records
+ * (debi_audio_pause) and nothing is sent while the hub is away.
+ *
+ * Each run of sent chunks ("spurt") starts from a reset encoder, so
+ * the hub decodes it with a fresh decoder.  All fields little-endian:
+ *
+ *   chunk header (DEBI_AUDIO_HDR_LEN bytes)
+ *     0  u8[2] magic "DA"
+ *     2  u8    version (DEBI_AUDIO_PROTO_VERSION)
+ *     3  u8    flags   DEBI_AUDIO_FLAG_*
+ *     4  u32   seq     +1 per chunk; a jump means chunks were lost
+ *     8  u64   ts_us   esp_timer time the first sample was captured,
+ *                      0 if unknown (see debi_clock.h for the hub
+ *                      mapping)
+ *    16  u16   rate    sample rate (DEBI_AUDIO_RATE)
+ *    18  u16   frame_samples   samples per Opus packet
+ *    20  u8    frames  Opus packets that follow
+ *    21  u8    snr_db  loudest frame, dB above the noise floor
+ *
+ *   then per packet
+ *        u16   len
+ *        u8[]  Opus packet
+ *
+ * tools/debi_audio_receiver.py is the hub-side reference.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ── Wire format ── */
+#define DEBI_TOPIC_AUDIO_CHUNK          "debi/watcher/audio/chunk"
+
+#define DEBI_AUDIO_PROTO_VERSION        1
+#define DEBI_AUDIO_HDR_LEN              22
+
+#define DEBI_AUDIO_FLAG_START           0x01   /* first chunk of a spurt: reset the decoder */
+#define DEBI_AUDIO_FLAG_END             0x02   /* last chunk of a spurt */
+#define DEBI_AUDIO_FLAG_GAP             0x04   /* mic samples lost just before this chunk */
+#define DEBI_AUDIO_FLAG_VOICE           0x08   /* a frame in it passed the VAD */
+
+/* ── Encoder (tunable) ── */
+#define DEBI_AUDIO_RATE                 16000  /* the recorder's rate */
+
+#ifndef DEBI_AUDIO_FRAME_MS
+#define DEBI_AUDIO_FRAME_MS             20     /* Opus frame: 10, 20, 40 or 60 */
+#endif
+
+#ifndef DEBI_AUDIO_CHUNK_FRAMES
+#define DEBI_AUDIO_CHUNK_FRAMES         5      /* frames per message */
+#endif
+
+#ifndef DEBI_AUDIO_BITRATE
+#define DEBI_AUDIO_BITRATE              24000
+#endif
+
+#define DEBI_AUDIO_BITRATE_MIN          6000
+#define DEBI_AUDIO_BITRATE_MAX          64000
+
+#ifndef DEBI_AUDIO_COMPLEXITY
+#define DEBI_AUDIO_COMPLEXITY           3      /* 0 (cheapest) .. 10 */
+#endif
+
+/* ── Gate (tunable) ── */
+#ifndef DEBI_AUDIO_VAD_SNR_DB
+#define DEBI_AUDIO_VAD_SNR_DB           10     /* above the noise floor */
+#endif
+
+#ifndef DEBI_AUDIO_VAD_MIN_DBFS
+#define DEBI_AUDIO_VAD_MIN_DBFS         -55    /* quieter frames are never voice */
+#endif
+
+#ifndef DEBI_AUDIO_VAD_ONSET_MS
+#define DEBI_AUDIO_VAD_ONSET_MS         60     /* voice this long opens the gate */
+#endif
+
+#ifndef DEBI_AUDIO_FLOOR_S
+#define DEBI_AUDIO_FLOOR_S              10     /* noise floor: quietest second of this many */
+#endif
+
+#ifndef DEBI_AUDIO_HANG_MS
+#define DEBI_AUDIO_HANG_MS              2000   /* keep sending after the last voice */
+#endif
+
+#ifndef DEBI_AUDIO_PREROLL_MS
+#define DEBI_AUDIO_PREROLL_MS           300    /* sent from before the onset */
+#endif
+
+#ifndef DEBI_AUDIO_STALL_MS
+#define DEBI_AUDIO_STALL_MS             1500   /* no audio this long: reopen the mic */
+#endif
+
+typedef enum {
+    DEBI_AUDIO_MODE_VAD = 0,       /* send what the VAD lets through */
+    DEBI_AUDIO_MODE_ON,            /* send everything */
+    DEBI_AUDIO_MODE_OFF,           /* send nothing, mic released */
+} debi_audio_mode_t;
+
+typedef struct {
+    uint32_t chunks_sent;
+    uint32_t chunks_lost;          /* encoded but not published */
+    uint32_t spurts;
+    uint32_t frames_encoded;
+    uint32_t frames_skipped;       /* mic busy elsewhere or at another rate */
+    uint32_t gaps;                 /* mic gaps inside a spurt */
+    uint64_t bytes_sent;           /* Opus bytes, without headers */
+    int32_t  encode_us_max;        /* one frame */
+    int32_t  encode_us_avg;        /* over the last 256 frames or so */
+} debi_audio_stats_t;
+
+/**
+ * Create the encoder and start the uplink task.
+ * Call after app_audio_recorder_init().
+ */
+esp_err_t debi_audio_init(void);
+
+/**
+ * Hub choice of what to send.
+ *
+ * @param mode        VAD returns to the default
+ * @param duration_s  back to VAD after this long, 0 = until changed
+ */
+void debi_audio_set_mode(debi_audio_mode_t mode, int duration_s);
+
+/**
+ * Encoder settings, applied from the next frame.
+ *
+ * @param bitrate     bits/s, clamped to DEBI_AUDIO_BITRATE_MIN .. _MAX;
+ *                    0 keeps the current one
+ * @param complexity  0 .. 10, -1 keeps the current one
+ */
+void debi_audio_set_encoder(int bitrate, int complexity);
+
+/**
+ * Give the mic to someone else (true) or take it back (false).
+ * Returns once the uplink has let go of the recorder stream.
+ */
+void debi_audio_pause(bool pause);
+
+/**
+ * Mode in effect now, after any duration ran out.
+ */
+debi_audio_mode_t debi_audio_get_mode(void);
+
+/**
+ * Snapshot uplink statistics.
+ */
+void debi_audio_get_stats(debi_audio_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,58 +2,482 @@
  * @file debi_camera.c
  * @brief Debi Camera - Frame streaming to hub via MQTT
  *
- * Publishes JPEG frames from WiseEye2 to debi/watcher/camera/frame
- * at a controlled rate (max 2 FPS) for hub-side AI processing.
- * Image data from WiseEye2 is base64-encoded JPEG.
+ * Publishes JPEG frames from WiseEye2 to debi/watcher/camera/bin
+ * for hub-side AI processing, at a rate that follows the scene (see
+ * debi_camera.h) or the one the hub asked for.
+ *
+ * Image data from WiseEye2 is base64-encoded JPEG.  It is decoded
+ * once, on the event loop, into one of DEBI_CAMERA_POOL_NUM PSRAM
+ * buffers.  A sender task takes the queued frames oldest first and
+ * publishes a header plus DEBI_CAMERA_CHUNK_SIZE chunks at QoS 0; the
+ * MQTT client lock is only held for one chunk at a time, so heartbeats
+ * and acks get through between chunks.  While the hub link is slower
+ * than the camera, a new frame replaces the oldest one still queued.
  *
  * Copyright (c) 2026 Debi Guardian
  */
 
 #include "debi_camera.h"
 #include "debi_os.h"
+#include "debi_comms.h"
 
 #include <string.h>
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
 #include "mqtt_client.h"
+#include "mbedtls/base64.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "debi_cam";
 
-/* Rate limiting: max 2 frames per second (500ms interval) */
-#define DEBI_CAMERA_MIN_INTERVAL_MS  500
-static int64_t s_last_frame_time_us = 0;
-static uint32_t s_frame_count = 0;
+#define CAMERA_TASK_STACK       3072
+#define CAMERA_TASK_PRIO        3     /* below the MQTT task */
+#define CAMERA_OUTBOX_MAX       (8 * 1024)  /* pending QoS>0 bytes before we hold off */
+#define CAMERA_OUTBOX_WAIT_MS   500
+
+/* ── Internal state ── */
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_FILLING,          /* being decoded into by the event loop */
+    SLOT_READY,            /* queued for the sender */
+    SLOT_SENDING,
+} slot_state_t;
+
+typedef struct {
+    uint8_t      *buf;     /* DEBI_CAMERA_FRAME_MAX bytes, PSRAM */
+    size_t        len;
+    slot_state_t  state;
+    uint32_t      frame_id;
+    int64_t       ts_us;
+    uint32_t      time;
+    uint16_t      width;
+    uint16_t      height;
+} frame_slot_t;
+
+typedef struct {
+    frame_slot_t         slots[DEBI_CAMERA_POOL_NUM];
+    uint8_t             *msg;          /* chunk header + payload, sender only */
+    SemaphoreHandle_t    lock;
+    TaskHandle_t         task;
+    uint32_t             next_id;
+    uint16_t             dropped;      /* since the last header went out */
+    int64_t              drop_us;      /* when a frame was last dropped */
+    int64_t              last_frame_time_us;
+    debi_camera_stats_t  stats;
+} camera_state_t;
+
+static camera_state_t s_cam;
+
+typedef struct {
+    int64_t                    person_us;    /* last inference with a person */
+    int64_t                    motion_us;    /* when motion_pm was seen */
+    int                        motion_pm;    /* last motion above MOTION_MIN */
+    debi_camera_stream_mode_t  mode;         /* hub override */
+    float                      fixed_fps;
+    int64_t                    until_us;     /* override expiry, 0 = none */
+} rate_state_t;
+
+static rate_state_t s_rate = { .mode = DEBI_CAMERA_STREAM_AUTO };
+static portMUX_TYPE s_rate_mux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE s_id_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* ────────────────────────────────────────────────────
+ *  Wire format helpers
+ * ──────────────────────────────────────────────────── */
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, v & 0xffff);
+    return put_u16(p, v >> 16);
+}
+
+static uint8_t *put_prefix(uint8_t *p, uint8_t type, uint32_t frame_id)
+{
+    *p++ = 'D';
+    *p++ = 'F';
+    *p++ = DEBI_CAMERA_PROTO_VERSION;
+    *p++ = type;
+    return put_u32(p, frame_id);
+}
+
+/**
+ * Width and height from the first SOFn marker; 0 x 0 if there is none
+ * before the scan data.
+ */
+static void jpeg_get_size(const uint8_t *p, size_t len, uint16_t *w, uint16_t *h)
+{
+    *w = 0;
+    *h = 0;
+    if (len < 4 || p[0] != 0xFF || p[1] != 0xD8) return;
+
+    size_t i = 2;
+    while (i + 9 <= len) {
+        if (p[i] != 0xFF) return;
+        uint8_t marker = p[i + 1];
+        if (marker == 0xFF) {                    /* fill byte */
+            i++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            i += 2;                              /* no length field */
+            continue;
+        }
+        if (marker == 0xDA) return;              /* start of scan */
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *h = (p[i + 5] << 8) | p[i + 6];
+            *w = (p[i + 7] << 8) | p[i + 8];
+            return;
+        }
+        i += 2 + ((p[i + 2] << 8) | p[i + 3]);
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Frame rate policy
+ * ──────────────────────────────────────────────────── */
+
+static float rate_target(int64_t now)
+{
+    portENTER_CRITICAL(&s_rate_mux);
+    rate_state_t r = s_rate;
+    portEXIT_CRITICAL(&s_rate_mux);
+
+    if (r.mode != DEBI_CAMERA_STREAM_AUTO && r.until_us && now >= r.until_us) {
+        r.mode = DEBI_CAMERA_STREAM_AUTO;
+    }
+    if (r.mode == DEBI_CAMERA_STREAM_OFF) return 0.0f;
+    if (r.mode == DEBI_CAMERA_STREAM_FIXED) return r.fixed_fps;
+
+    int64_t hold_us = DEBI_CAMERA_HOLD_MS * 1000LL;
+    if (!r.person_us || now - r.person_us > hold_us) {
+        return DEBI_CAMERA_FPS_MIN;
+    }
+
+    float fps = DEBI_CAMERA_FPS_PRESENT;
+    if (r.motion_us && now - r.motion_us <= hold_us) {
+        float k = (float)(r.motion_pm - DEBI_CAMERA_MOTION_MIN_PM) /
+                  (DEBI_CAMERA_MOTION_FULL_PM - DEBI_CAMERA_MOTION_MIN_PM);
+        fps += (DEBI_CAMERA_FPS_MAX - DEBI_CAMERA_FPS_PRESENT) * (k < 1.0f ? k : 1.0f);
+    }
+
+    /* A lagging link gets fewer frames, not a longer queue */
+    debi_comms_health_t h = debi_comms_get_health();
+    if (h.rtt_ms > DEBI_CAMERA_RTT_SLOW_MS || h.queued_count > 0 ||
+        (s_cam.drop_us && now - s_cam.drop_us <= hold_us)) {
+        fps = fps < DEBI_CAMERA_FPS_CONGESTED ? fps : DEBI_CAMERA_FPS_CONGESTED;
+    }
+    return fps;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Sender task
+ * ──────────────────────────────────────────────────── */
+
+/**
+ * Give QoS>0 traffic queued in the client (status, acks) a chance to
+ * drain before the next burst of chunks.
+ */
+static void wait_outbox(esp_mqtt_client_handle_t mqtt)
+{
+    int64_t deadline = esp_timer_get_time() + CAMERA_OUTBOX_WAIT_MS * 1000LL;
+    while (esp_mqtt_client_get_outbox_size(mqtt) > CAMERA_OUTBOX_MAX &&
+           esp_timer_get_time() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static bool send_frame(const frame_slot_t *f, uint16_t dropped)
+{
+    esp_mqtt_client_handle_t mqtt = debi_os_get_mqtt_handle();
+    if (!mqtt || !debi_os_hub_connected()) {
+        return false;
+    }
+
+    uint16_t chunk_num = (f->len + DEBI_CAMERA_CHUNK_SIZE - 1) / DEBI_CAMERA_CHUNK_SIZE;
+    uint8_t *p = put_prefix(s_cam.msg, DEBI_CAMERA_MSG_HEADER, f->frame_id);
+    p = put_u32(p, (uint32_t)f->ts_us);
+    p = put_u32(p, (uint32_t)((uint64_t)f->ts_us >> 32));
+    p = put_u32(p, f->time);
+    p = put_u16(p, f->width);
+    p = put_u16(p, f->height);
+    p = put_u32(p, f->len);
+    p = put_u16(p, DEBI_CAMERA_CHUNK_SIZE);
+    p = put_u16(p, chunk_num);
+    p = put_u32(p, esp_rom_crc32_le(0, f->buf, f->len));
+    put_u16(p, dropped);
+
+    int64_t start = esp_timer_get_time();
+    if (esp_mqtt_client_publish(mqtt, DEBI_TOPIC_CAMERA_BIN, (const char *)s_cam.msg,
+                                DEBI_CAMERA_HEADER_LEN, 0, 0) < 0) {
+        return false;
+    }
+
+    for (uint16_t seq = 0; seq < chunk_num; seq++) {
+        if (seq % DEBI_CAMERA_WINDOW == 0) {
+            wait_outbox(mqtt);
+        }
+        if (!debi_os_hub_connected()) {
+            return false;
+        }
+
+        size_t off = (size_t)seq * DEBI_CAMERA_CHUNK_SIZE;
+        size_t n = f->len - off < DEBI_CAMERA_CHUNK_SIZE ? f->len - off : DEBI_CAMERA_CHUNK_SIZE;
+        p = put_prefix(s_cam.msg, DEBI_CAMERA_MSG_CHUNK, f->frame_id);
+        p = put_u16(p, seq);
+        p = put_u16(p, chunk_num);
+        memcpy(p, f->buf + off, n);
+
+        if (esp_mqtt_client_publish(mqtt, DEBI_TOPIC_CAMERA_BIN, (const char *)s_cam.msg,
+                                    DEBI_CAMERA_CHUNK_HDR_LEN + n, 0, 0) < 0) {
+            return false;
+        }
+    }
+
+    int64_t took = esp_timer_get_time() - start;
+    xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+    s_cam.stats.frames_sent++;
+    s_cam.stats.chunks_sent += chunk_num;
+    s_cam.stats.bytes_sent += f->len;
+    if (took > s_cam.stats.send_max_us) {
+        s_cam.stats.send_max_us = took;
+    }
+    xSemaphoreGive(s_cam.lock);
+    return true;
+}
+
+/* Oldest queued frame, or NULL.  Call with the lock held. */
+static frame_slot_t *oldest_ready(void)
+{
+    frame_slot_t *oldest = NULL;
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM; i++) {
+        frame_slot_t *f = &s_cam.slots[i];
+        if (f->state == SLOT_READY &&
+            (!oldest || (int32_t)(f->frame_id - oldest->frame_id) < 0)) {
+            oldest = f;
+        }
+    }
+    return oldest;
+}
 
-void debi_camera_forward_frame(const struct tf_module_ai_camera_preview_info *preview)
+static void camera_task(void *arg)
 {
-    if (!preview || !preview->img.p_buf || preview->img.len == 0) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (1) {
+            xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+            frame_slot_t *f = oldest_ready();
+            uint16_t dropped = s_cam.dropped;
+            if (f) {
+                f->state = SLOT_SENDING;
+                s_cam.dropped = 0;
+            }
+            xSemaphoreGive(s_cam.lock);
+            if (!f) break;
+
+            bool ok = send_frame(f, dropped);
+            size_t len = f->len;
+            uint16_t w = f->width, h = f->height;
+
+            xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+            f->state = SLOT_FREE;
+            if (!ok) {
+                s_cam.stats.frames_aborted++;
+                s_cam.dropped += dropped;   /* the hub never saw that header */
+            }
+            uint32_t sent = s_cam.stats.frames_sent;
+            xSemaphoreGive(s_cam.lock);
+
+            if (ok && sent % 10 == 1) {
+                ESP_LOGI(TAG, "Frame #%lu sent (%u bytes, %ux%u)",
+                         (unsigned long)sent, (unsigned)len, w, h);
+            }
+        }
+    }
+}
+
+static esp_err_t camera_start(void)
+{
+    s_cam.lock = xSemaphoreCreateMutex();
+    s_cam.msg = heap_caps_malloc(DEBI_CAMERA_CHUNK_HDR_LEN + DEBI_CAMERA_CHUNK_SIZE,
+                                 MALLOC_CAP_SPIRAM);
+    bool ok = s_cam.lock && s_cam.msg;
+    for (int i = 0; ok && i < DEBI_CAMERA_POOL_NUM; i++) {
+        s_cam.slots[i].buf = heap_caps_malloc(DEBI_CAMERA_FRAME_MAX, MALLOC_CAP_SPIRAM);
+        ok = s_cam.slots[i].buf != NULL;
+    }
+    if (ok && xTaskCreate(camera_task, "debi_cam", CAMERA_TASK_STACK, NULL,
+                          CAMERA_TASK_PRIO, &s_cam.task) != pdPASS) {
+        ok = false;
+    }
+    if (ok) {
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "no memory for the frame pool");
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM; i++) {
+        free(s_cam.slots[i].buf);
+        s_cam.slots[i].buf = NULL;
+    }
+    free(s_cam.msg);
+    s_cam.msg = NULL;
+    if (s_cam.lock) {
+        vSemaphoreDelete(s_cam.lock);
+        s_cam.lock = NULL;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+void debi_camera_stamp(int64_t ts_us, debi_camera_stamp_t *out)
+{
+    if (ts_us == 0) {
+        ts_us = esp_timer_get_time();
+    }
+
+    portENTER_CRITICAL(&s_id_mux);
+    out->frame_id = ++s_cam.next_id;
+    portEXIT_CRITICAL(&s_id_mux);
+    out->ts_us = ts_us;
+}
+
+void debi_camera_forward_frame(const struct tf_module_ai_camera_preview_info *preview,
+                               const debi_camera_stamp_t *stamp)
+{
+    if (!preview || !stamp || !preview->img.p_buf || preview->img.len == 0) {
         return;
     }
 
-    /* Rate limit */
-    int64_t now = esp_timer_get_time();
-    if ((now - s_last_frame_time_us) < (DEBI_CAMERA_MIN_INTERVAL_MS * 1000)) {
+    /* Rate limit; a rise in activity shortens the interval at once */
+    int64_t now = stamp->ts_us;
+    float fps = rate_target(now);
+    if (fps <= 0.0f || (now - s_cam.last_frame_time_us) < (int64_t)(1000000.0f / fps)) {
         return;
     }
-    s_last_frame_time_us = now;
+    s_cam.last_frame_time_us = now;
 
-    /* Get MQTT handle */
-    esp_mqtt_client_handle_t mqtt = debi_os_get_mqtt_handle();
-    if (!mqtt) {
+    if (!debi_os_get_mqtt_handle() || !debi_os_hub_connected()) {
         return;  /* MQTT not connected yet */
     }
+    if (!s_cam.task && camera_start() != ESP_OK) {
+        return;
+    }
 
-    /* Publish frame - the image data is base64-encoded JPEG from WiseEye2.
-     * We send it as-is; the hub will decode it. */
-    int msg_id = esp_mqtt_client_publish(mqtt,
-                                          "debi/watcher/camera/frame",
-                                          (const char *)preview->img.p_buf,
-                                          preview->img.len,
-                                          0,   /* QoS 0 for speed */
-                                          0);  /* no retain */
+    /* Pick a buffer: a free one, else the oldest frame still queued */
+    xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+    frame_slot_t *f = NULL;
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM && !f; i++) {
+        if (s_cam.slots[i].state == SLOT_FREE) {
+            f = &s_cam.slots[i];
+        }
+    }
+    if (!f) {
+        f = oldest_ready();
+    }
+    if (f) {
+        if (f->state == SLOT_READY) {
+            s_cam.stats.frames_dropped++;
+            s_cam.dropped++;
+            s_cam.drop_us = now;
+        }
+        f->state = SLOT_FILLING;
+    } else {
+        s_cam.stats.frames_dropped++;
+        s_cam.dropped++;
+        s_cam.drop_us = now;
+    }
+    xSemaphoreGive(s_cam.lock);
+    if (!f) {
+        return;
+    }
 
-    s_frame_count++;
-    if (s_frame_count % 10 == 1) {
-        ESP_LOGI(TAG, "Frame #%lu sent (%lu bytes)", s_frame_count, preview->img.len);
+    /* Decode once; the sender and the hub only ever see binary JPEG */
+    size_t len = 0;
+    int ret = mbedtls_base64_decode(f->buf, DEBI_CAMERA_FRAME_MAX, &len,
+                                    preview->img.p_buf, preview->img.len);
+    if (ret != 0 || len == 0) {
+        ESP_LOGW(TAG, "frame rejected (%lu base64 bytes, err %d)",
+                 (unsigned long)preview->img.len, ret);
+        xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+        f->state = SLOT_FREE;
+        s_cam.stats.frames_rejected++;
+        xSemaphoreGive(s_cam.lock);
+        return;
+    }
+
+    f->len = len;
+    f->ts_us = now;
+    f->time = (uint32_t)preview->img.time;
+    jpeg_get_size(f->buf, len, &f->width, &f->height);
+
+    xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+    f->frame_id = stamp->frame_id;
+    f->state = SLOT_READY;
+    xSemaphoreGive(s_cam.lock);
+
+    xTaskNotifyGive(s_cam.task);
+}
+
+void debi_camera_update_activity(bool person, int motion_pm)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_rate_mux);
+    if (person) {
+        s_rate.person_us = now;
+        if (motion_pm > DEBI_CAMERA_MOTION_MIN_PM) {
+            s_rate.motion_pm = motion_pm;
+            s_rate.motion_us = now;
+        }
+    }
+    portEXIT_CRITICAL(&s_rate_mux);
+}
+
+void debi_camera_set_stream(debi_camera_stream_mode_t mode, float fps, int duration_s)
+{
+    if (fps < DEBI_CAMERA_FPS_MIN) fps = DEBI_CAMERA_FPS_MIN;
+    if (fps > DEBI_CAMERA_FPS_MAX) fps = DEBI_CAMERA_FPS_MAX;
+    int64_t until = duration_s > 0 ? esp_timer_get_time() + duration_s * 1000000LL : 0;
+
+    portENTER_CRITICAL(&s_rate_mux);
+    s_rate.mode = mode;
+    s_rate.fixed_fps = fps;
+    s_rate.until_us = until;
+    portEXIT_CRITICAL(&s_rate_mux);
+
+    ESP_LOGI(TAG, "stream %s %.1f fps for %ds",
+             mode == DEBI_CAMERA_STREAM_AUTO ? "auto" :
+             mode == DEBI_CAMERA_STREAM_FIXED ? "fixed" : "off", fps, duration_s);
+}
+
+float debi_camera_get_fps(void)
+{
+    return rate_target(esp_timer_get_time());
+}
+
+void debi_camera_get_stats(debi_camera_stats_t *out)
+{
+    if (!out) return;
+    if (!s_cam.lock) {
+        memset(out, 0, sizeof(*out));
+        return;
     }
+    xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+    *out = s_cam.stats;
+    xSemaphoreGive(s_cam.lock);
 }
@@ -5,10 +5,54 @@
  * Forwards JPEG frames from WiseEye2 AI camera to the Pi hub
  * for Coral TPU pose estimation and fall detection.
  *
+ * Frames go out as binary JPEG, not as the base64 text the WE2
+ * delivers.  Each frame is one header message followed by fixed-size
+ * chunks, all on DEBI_TOPIC_CAMERA_BIN, so no single publish holds
+ * the MQTT client long enough to delay heartbeats.  All fields are
+ * little-endian:
+ *
+ *   common prefix (8 bytes)
+ *     0  u8[2] magic "DF"
+ *     2  u8    version (DEBI_CAMERA_PROTO_VERSION)
+ *     3  u8    type    (DEBI_CAMERA_MSG_HEADER / DEBI_CAMERA_MSG_CHUNK)
+ *     4  u32   frame_id   every camera frame gets one, streamed or not,
+ *                         so ids skip the frames the rate policy held
+ *                         back; debi_tracks messages carry the same id
+ *
+ *   header (DEBI_CAMERA_HEADER_LEN bytes)
+ *     8  u64   ts_us      esp_timer time the frame arrived from the
+ *                         WE2 (see debi_clock.h for the hub mapping)
+ *    16  u32   time       wall clock of the capture (0 if unset)
+ *    20  u16   width      from the JPEG SOF, 0 if not found
+ *    22  u16   height
+ *    24  u32   size       JPEG bytes
+ *    28  u16   chunk_size payload bytes per chunk (last one shorter)
+ *    30  u16   chunk_num
+ *    32  u32   crc32      of the JPEG (zlib crc32)
+ *    36  u16   dropped    frames dropped since the previous header
+ *
+ *   chunk (DEBI_CAMERA_CHUNK_HDR_LEN bytes + payload)
+ *     8  u16   seq        0 .. chunk_num - 1
+ *    10  u16   chunk_num
+ *    12  ...   JPEG bytes [seq * chunk_size, ...)
+ *
+ * tools/debi_frame_reassembler.py is the hub-side reference.
+ *
+ * Frame rate follows the scene: DEBI_CAMERA_FPS_MIN with nobody in
+ * view, DEBI_CAMERA_FPS_PRESENT while a person is seen, rising to
+ * DEBI_CAMERA_FPS_MAX with the person's box motion above
+ * DEBI_CAMERA_MOTION_MIN_PM.  Presence and
+ * motion come from debi_face_bridge; a slow hub link (RTT, queued
+ * messages, frames dropped here) caps the rate at
+ * DEBI_CAMERA_FPS_CONGESTED.  The hub can pin the rate with the
+ * "stream" command.
+ *
  * Copyright (c) 2026 Debi Guardian
  */
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "tf_module_ai_camera.h"
 
@@ -16,13 +60,137 @@
 extern "C" {
 #endif
 
+/* ── Wire format ── */
+#define DEBI_TOPIC_CAMERA_BIN           "debi/watcher/camera/bin"
+
+#define DEBI_CAMERA_PROTO_VERSION       1
+#define DEBI_CAMERA_MSG_HEADER          1
+#define DEBI_CAMERA_MSG_CHUNK           2
+#define DEBI_CAMERA_HEADER_LEN          38
+#define DEBI_CAMERA_CHUNK_HDR_LEN       12
+
+/* ── Frame rate policy (tunable) ── */
+#ifndef DEBI_CAMERA_FPS_MIN
+#define DEBI_CAMERA_FPS_MIN             0.2f   /* nobody in view */
+#endif
+
+#ifndef DEBI_CAMERA_FPS_PRESENT
+#define DEBI_CAMERA_FPS_PRESENT         1.0f   /* person in view, still */
+#endif
+
+#ifndef DEBI_CAMERA_FPS_MAX
+#define DEBI_CAMERA_FPS_MAX             10.0f  /* person moving fast */
+#endif
+
+#ifndef DEBI_CAMERA_FPS_CONGESTED
+#define DEBI_CAMERA_FPS_CONGESTED       0.5f   /* cap while the hub link lags */
+#endif
+
+#ifndef DEBI_CAMERA_MOTION_MIN_PM
+#define DEBI_CAMERA_MOTION_MIN_PM       40     /* below this is detector jitter */
+#endif
+
+#ifndef DEBI_CAMERA_MOTION_FULL_PM
+#define DEBI_CAMERA_MOTION_FULL_PM      250    /* box motion (per mille) for FPS_MAX */
+#endif
+
+#ifndef DEBI_CAMERA_HOLD_MS
+#define DEBI_CAMERA_HOLD_MS             5000   /* keep the rate this long after activity */
+#endif
+
+#ifndef DEBI_CAMERA_RTT_SLOW_MS
+#define DEBI_CAMERA_RTT_SLOW_MS         500
+#endif
+
+/* ── Transport (tunable) ── */
+#ifndef DEBI_CAMERA_CHUNK_SIZE
+#define DEBI_CAMERA_CHUNK_SIZE          4096   /* JPEG bytes per chunk */
+#endif
+
+#ifndef DEBI_CAMERA_FRAME_MAX
+#define DEBI_CAMERA_FRAME_MAX           (64 * 1024)  /* largest decoded JPEG */
+#endif
+
+#ifndef DEBI_CAMERA_POOL_NUM
+#define DEBI_CAMERA_POOL_NUM            3      /* frames in flight, >= 2 */
+#endif
+
+#ifndef DEBI_CAMERA_WINDOW
+#define DEBI_CAMERA_WINDOW              4      /* chunks per burst before yielding */
+#endif
+
+typedef enum {
+    DEBI_CAMERA_STREAM_AUTO = 0,   /* rate follows the scene */
+    DEBI_CAMERA_STREAM_FIXED,      /* hub-chosen rate */
+    DEBI_CAMERA_STREAM_OFF,
+} debi_camera_stream_mode_t;
+
+/* Identity of one camera frame, shared by its JPEG and its detections */
+typedef struct {
+    uint32_t frame_id;
+    int64_t  ts_us;                /* esp_timer time the frame arrived from the WE2 */
+} debi_camera_stamp_t;
+
+typedef struct {
+    uint32_t frames_sent;
+    uint32_t frames_dropped;       /* replaced by a newer frame before sending */
+    uint32_t frames_aborted;       /* hub link lost mid-frame */
+    uint32_t frames_rejected;      /* bad base64 or larger than FRAME_MAX */
+    uint32_t chunks_sent;
+    uint64_t bytes_sent;           /* JPEG bytes, without headers */
+    int64_t  send_max_us;          /* longest header-to-last-chunk time */
+} debi_camera_stats_t;
+
+/**
+ * Give a new camera frame its id and timestamp.
+ * Call once per preview, before anything is sent about it.
+ *
+ * @param ts_us  esp_timer time the frame arrived from the WE2 (the
+ *               sscma_client reply ts_us), 0 = now
+ */
+void debi_camera_stamp(int64_t ts_us, debi_camera_stamp_t *out);
+
 /**
  * Forward a camera preview frame to the hub via MQTT.
  * Called from debi_face_bridge when a preview event arrives.
  *
+ * The image is decoded into a pooled buffer and queued; a sender task
+ * publishes it.  When every buffer is taken the oldest queued frame
+ * gives way.
+ *
  * @param preview  The AI camera preview info (image + inference)
+ * @param stamp    from debi_camera_stamp() for this preview
+ */
+void debi_camera_forward_frame(const struct tf_module_ai_camera_preview_info *preview,
+                               const debi_camera_stamp_t *stamp);
+
+/**
+ * Report what the camera sees, once per inference.
+ *
+ * @param person     a person is in view
+ * @param motion_pm  movement of the person's box since the previous
+ *                   inference, per mille of the box size
+ */
+void debi_camera_update_activity(bool person, int motion_pm);
+
+/**
+ * Hub override of the frame rate.
+ *
+ * @param mode        AUTO returns to the policy, FIXED sends at `fps`
+ * @param fps         clamped to DEBI_CAMERA_FPS_MIN .. DEBI_CAMERA_FPS_MAX
+ * @param duration_s  back to AUTO after this long, 0 = until changed
+ */
+void debi_camera_set_stream(debi_camera_stream_mode_t mode, float fps, int duration_s);
+
+/**
+ * Frame rate the camera is currently aiming for (0 when off).
+ */
+float debi_camera_get_fps(void);
+
+/**
+ * Snapshot transport statistics.
  */
-void debi_camera_forward_frame(const struct tf_module_ai_camera_preview_info *preview);
+void debi_camera_get_stats(debi_camera_stats_t *out);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,444 @@
+/**
+ * @file debi_clock.c
+ * @brief Debi Clock — One media clock for camera frames and audio
+ *
+ * Mic reads arrive on whichever task reads the codec (the AFE feed
+ * task, the recorder task, the factory mic test), pongs on the MQTT
+ * task; one mutex covers both mappings.  The fits are a handful of
+ * points, done when a window closes or a pong arrives.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_clock.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sensecap-watcher.h"
+
+static const char *TAG = "debi_clock";
+
+/* A hub offset further than this (plus the sample's RTT) from the
+ * mapping means the hub clock was stepped or the hub restarted */
+#define CLOCK_SYNC_STEP_US      100000
+
+/* Queueing delay that halves a sample's say in the hub fit, roughly,
+ * or this fraction of the median sample's on a busy link */
+#define CLOCK_SYNC_JITTER_US    2000.0
+#define CLOCK_SYNC_JITTER_DIV   16
+
+/* Envelope points before the rate is fitted rather than assumed */
+#define CLOCK_AUDIO_FIT_MIN     4
+
+/* Reads in a row behind the line by DEBI_CLOCK_AUDIO_GAP_US before
+ * they count as lost samples rather than a busy task catching up */
+#define CLOCK_AUDIO_LATE_READS  8
+
+/* ── Internal state ── */
+typedef struct {
+    int64_t dk;                    /* samples after k0 */
+    int64_t r_us;                  /* earliest read of the window, off the nominal line */
+} env_point_t;
+
+typedef struct {
+    int64_t mid_us;                /* esp_timer half way through the exchange */
+    int64_t offset_us;             /* hub - mid */
+    int32_t rtt_us;
+} sync_sample_t;
+
+typedef struct {
+    SemaphoreHandle_t  lock;
+
+    /* audio: t(k) = t0 + nominal(k - k0) + a + b * (k - k0) */
+    bool               seg_open;   /* a segment has its first read */
+    uint32_t           session;
+    uint64_t           seg_start;  /* first sample of the segment */
+    uint64_t           k0;         /* sample count after the first read */
+    int64_t            t0_us;      /* that read's done time */
+    int64_t            last_done_us;
+    int                late_reads;
+    double             a_us;
+    double             b;          /* us per sample */
+    int64_t            win_start_us;
+    int64_t            win_min_us;
+    int64_t            win_dk;
+    bool               win_open;
+    env_point_t        env[DEBI_CLOCK_AUDIO_WINDOWS];
+    int                env_n;
+    int                env_head;   /* next slot to write */
+    debi_clock_audio_t audio;
+
+    /* hub */
+    sync_sample_t      sync[DEBI_CLOCK_SYNC_SAMPLES];
+    int                sync_n;
+    int                sync_head;
+    bool               hub_valid;
+    debi_clock_hub_t   hub;
+} clock_state_t;
+
+static clock_state_t s_clock;
+
+/* ────────────────────────────────────────────────────
+ *  Audio
+ * ──────────────────────────────────────────────────── */
+
+static int64_t nominal_us(int64_t dk)
+{
+    return dk * 1000000 / (int64_t)s_clock.audio.rate;
+}
+
+/* Fitted offset from the nominal line at dk; the open window stands
+ * in until the first one closes */
+static double audio_line(int64_t dk)
+{
+    if (s_clock.env_n == 0) {
+        return s_clock.win_open ? (double)s_clock.win_min_us : 0.0;
+    }
+    return s_clock.a_us + s_clock.b * (double)dk;
+}
+
+static void audio_fit(void)
+{
+    int n = s_clock.env_n;
+    int last = (s_clock.env_head + DEBI_CLOCK_AUDIO_WINDOWS - 1) % DEBI_CLOCK_AUDIO_WINDOWS;
+
+    if (n < CLOCK_AUDIO_FIT_MIN) {
+        /* Too short a span for a rate; the latest point is the best offset */
+        s_clock.a_us = (double)s_clock.env[last].r_us;
+        s_clock.b = 0.0;
+        return;
+    }
+
+    double mx = 0.0, my = 0.0;
+    for (int i = 0; i < n; i++) {
+        mx += (double)s_clock.env[i].dk;
+        my += (double)s_clock.env[i].r_us;
+    }
+    mx /= n;
+    my /= n;
+
+    double sxx = 0.0, sxy = 0.0;
+    for (int i = 0; i < n; i++) {
+        double dx = (double)s_clock.env[i].dk - mx;
+        sxx += dx * dx;
+        sxy += dx * ((double)s_clock.env[i].r_us - my);
+    }
+    double b = sxx > 0.0 ? sxy / sxx : 0.0;
+
+    /* b is us per sample, so b * rate is us per second: ppm, and a
+     * codec running fast brings its samples early */
+    double ppm = -b * s_clock.audio.rate;
+    if (ppm > DEBI_CLOCK_AUDIO_PPM_MAX || ppm < -DEBI_CLOCK_AUDIO_PPM_MAX) {
+        b = 0.0;
+        ppm = 0.0;
+        mx = (double)s_clock.env[last].dk;
+        my = (double)s_clock.env[last].r_us;
+    }
+    s_clock.b = b;
+    s_clock.a_us = my - b * mx;
+    s_clock.audio.rate_ppm = (float)ppm;
+}
+
+static void audio_new_segment(bool gap)
+{
+    s_clock.seg_open = false;
+    s_clock.win_open = false;
+    s_clock.env_n = 0;
+    s_clock.env_head = 0;
+    s_clock.a_us = 0.0;
+    s_clock.b = 0.0;
+    s_clock.audio.rate_ppm = 0.0f;
+    s_clock.late_reads = 0;
+    s_clock.audio.segments++;
+    if (gap) {
+        s_clock.audio.gaps++;
+    }
+}
+
+/* Close the window; false if it jumped off the line */
+static bool audio_close_window(void)
+{
+    s_clock.win_open = false;
+
+    if (s_clock.env_n > 0) {
+        double off = (double)s_clock.win_min_us - audio_line(s_clock.win_dk);
+        if (off > DEBI_CLOCK_AUDIO_GAP_US || off < -DEBI_CLOCK_AUDIO_GAP_US) {
+            ESP_LOGW(TAG, "audio off the clock line by %d us, new segment", (int)off);
+            return false;
+        }
+    }
+
+    s_clock.env[s_clock.env_head].dk = s_clock.win_dk;
+    s_clock.env[s_clock.env_head].r_us = s_clock.win_min_us;
+    s_clock.env_head = (s_clock.env_head + 1) % DEBI_CLOCK_AUDIO_WINDOWS;
+    if (s_clock.env_n < DEBI_CLOCK_AUDIO_WINDOWS) {
+        s_clock.env_n++;
+    }
+    audio_fit();
+    return true;
+}
+
+/* Anchor a segment at this read, the latest `n` samples */
+static void audio_open_segment(const bsp_mic_read_t *read, uint64_t n)
+{
+    s_clock.seg_open   = true;
+    s_clock.session    = read->session;
+    s_clock.audio.rate = read->rate;
+    s_clock.seg_start  = s_clock.audio.samples - n;
+    s_clock.k0         = s_clock.audio.samples;
+    s_clock.t0_us      = read->done_us;
+}
+
+static void on_mic_read(const bsp_mic_read_t *read)
+{
+    if (read->frame_bytes == 0 || read->rate == 0) return;
+
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+
+    int64_t since_us = read->done_us - s_clock.last_done_us;
+    bool paused = s_clock.last_done_us > 0 && since_us > DEBI_CLOCK_AUDIO_PAUSE_MS * 1000LL;
+    if (s_clock.seg_open &&
+        (read->session != s_clock.session || read->rate != s_clock.audio.rate || paused)) {
+        audio_new_segment(paused && read->session == s_clock.session);
+    }
+
+    uint64_t n = read->len / read->frame_bytes;
+    s_clock.audio.samples += n;
+    s_clock.last_done_us = read->done_us;
+
+    if (!s_clock.seg_open) {
+        audio_open_segment(read, n);
+    }
+
+    int64_t dk = (int64_t)(s_clock.audio.samples - s_clock.k0);
+    int64_t r = read->done_us - s_clock.t0_us - nominal_us(dk);
+
+    if (s_clock.env_n > 0) {
+        /* A read can lag by at most the DMA buffering; reads that all
+         * stay behind the line by more than that follow lost samples.
+         * Reads that come back to back are draining the DMA buffers
+         * after a stalled task, they catch up with the line */
+        int64_t late = r - (int64_t)audio_line(dk);
+        bool draining = since_us < nominal_us((int64_t)n) / 2;
+        s_clock.audio.jitter_us = (int32_t)late;
+        s_clock.late_reads = late > DEBI_CLOCK_AUDIO_GAP_US && !draining ? s_clock.late_reads + 1 : 0;
+        if (s_clock.late_reads >= CLOCK_AUDIO_LATE_READS) {
+            ESP_LOGW(TAG, "audio %d us behind the clock line, new segment", (int)late);
+            audio_new_segment(true);
+            audio_open_segment(read, n);
+            dk = 0;
+            r = 0;
+        }
+    }
+
+    if (!s_clock.win_open) {
+        s_clock.win_open     = true;
+        s_clock.win_start_us = read->done_us;
+        s_clock.win_min_us   = r;
+        s_clock.win_dk       = dk;
+    } else if (r < s_clock.win_min_us) {
+        s_clock.win_min_us = r;
+        s_clock.win_dk     = dk;
+    }
+
+    if (read->done_us - s_clock.win_start_us >= DEBI_CLOCK_AUDIO_WINDOW_MS * 1000LL &&
+        !audio_close_window()) {
+        /* The whole window was off, so this read is past the jump */
+        audio_new_segment(true);
+        audio_open_segment(read, n);
+    }
+
+    xSemaphoreGive(s_clock.lock);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Hub
+ * ──────────────────────────────────────────────────── */
+
+static int64_t hub_offset_at(int64_t t_us)
+{
+    return s_clock.hub.offset_us +
+           (int64_t)((double)s_clock.hub.skew_ppm * (double)(t_us - s_clock.hub.ts_us) / 1e6);
+}
+
+/* Line through the samples, each weighted by how close its RTT is to
+ * the best one: queueing delay is what makes an offset wrong.  Once
+ * the samples span DEBI_CLOCK_SKEW_SPAN_S the line gives offset and
+ * skew; before that the best sample is the offset and the skew stays. */
+static void hub_fit(void)
+{
+    const sync_sample_t *best = &s_clock.sync[0];
+    int64_t first = INT64_MAX, last = INT64_MIN;
+    for (int i = 0; i < s_clock.sync_n; i++) {
+        const sync_sample_t *s = &s_clock.sync[i];
+        if (s->rtt_us < best->rtt_us) best = s;
+        if (s->mid_us < first) first = s->mid_us;
+        if (s->mid_us > last) last = s->mid_us;
+    }
+    s_clock.hub.ts_us     = best->mid_us;
+    s_clock.hub.offset_us = best->offset_us;
+    s_clock.hub.err_us    = best->rtt_us / 2;
+
+    if (s_clock.sync_n < 3 || last - first < DEBI_CLOCK_SKEW_SPAN_S * 1000000LL) return;
+
+    /* On a busy link every pong queues; weighed against the best one
+     * alone, two or three samples would decide the skew */
+    int32_t rtts[DEBI_CLOCK_SYNC_SAMPLES];
+    for (int i = 0; i < s_clock.sync_n; i++) {
+        int j = i;
+        for (; j > 0 && rtts[j - 1] > s_clock.sync[i].rtt_us; j--) {
+            rtts[j] = rtts[j - 1];
+        }
+        rtts[j] = s_clock.sync[i].rtt_us;
+    }
+    double jitter = (double)(rtts[s_clock.sync_n / 2] - best->rtt_us) / CLOCK_SYNC_JITTER_DIV;
+    if (jitter < CLOCK_SYNC_JITTER_US) {
+        jitter = CLOCK_SYNC_JITTER_US;
+    }
+
+    /* Times relative to the best sample keep the sums well inside a double */
+    double sw = 0.0, mx = 0.0, my = 0.0;
+    for (int i = 0; i < s_clock.sync_n; i++) {
+        const sync_sample_t *s = &s_clock.sync[i];
+        double q = (double)(s->rtt_us - best->rtt_us) + jitter;
+        double w = 1.0 / (q * q);
+        sw += w;
+        mx += w * (double)(s->mid_us - best->mid_us);
+        my += w * (double)(s->offset_us - best->offset_us);
+    }
+    mx /= sw;
+    my /= sw;
+
+    double sxx = 0.0, sxy = 0.0;
+    for (int i = 0; i < s_clock.sync_n; i++) {
+        const sync_sample_t *s = &s_clock.sync[i];
+        double q = (double)(s->rtt_us - best->rtt_us) + jitter;
+        double w = 1.0 / (q * q);
+        double dx = (double)(s->mid_us - best->mid_us) - mx;
+        sxx += w * dx * dx;
+        sxy += w * dx * ((double)(s->offset_us - best->offset_us) - my);
+    }
+    if (sxx <= 0.0) return;
+
+    double skew = sxy / sxx * 1e6;
+    if (skew > DEBI_CLOCK_SKEW_PPM_MAX || skew < -DEBI_CLOCK_SKEW_PPM_MAX) return;
+    s_clock.hub.skew_ppm  = (float)skew;
+    s_clock.hub.ts_us     = best->mid_us + (int64_t)mx;
+    s_clock.hub.offset_us = best->offset_us + (int64_t)my;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_clock_init(void)
+{
+    if (s_clock.lock) return ESP_OK;
+
+    s_clock.lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(s_clock.lock, ESP_ERR_NO_MEM, TAG, "no mem for lock");
+    bsp_set_mic_read_cb(on_mic_read);
+    return ESP_OK;
+}
+
+uint64_t debi_clock_audio_samples(void)
+{
+    if (!s_clock.lock) return 0;
+
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+    uint64_t n = s_clock.audio.samples;
+    xSemaphoreGive(s_clock.lock);
+    return n;
+}
+
+int64_t debi_clock_audio_time(uint64_t sample)
+{
+    if (!s_clock.lock) return 0;
+
+    int64_t t = 0;
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+    if (s_clock.seg_open && sample >= s_clock.seg_start) {
+        /* Sample k is in once the count passes it */
+        int64_t dk = (int64_t)(sample + 1 - s_clock.k0);
+        t = s_clock.t0_us + nominal_us(dk) + (int64_t)audio_line(dk);
+    }
+    xSemaphoreGive(s_clock.lock);
+    return t;
+}
+
+bool debi_clock_hub_sample(int64_t t0_us, int64_t rx_us, int64_t hub_us)
+{
+    int64_t rtt = rx_us - t0_us;
+    if (!s_clock.lock || rtt < 0 || rtt > DEBI_CLOCK_SYNC_RTT_MAX_MS * 1000LL) return false;
+
+    sync_sample_t sample = {
+        .mid_us    = t0_us + rtt / 2,
+        .offset_us = hub_us - (t0_us + rtt / 2),
+        .rtt_us    = (int32_t)rtt,
+    };
+
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+
+    if (s_clock.hub_valid) {
+        int64_t off = sample.offset_us - hub_offset_at(sample.mid_us);
+        if (off > rtt + CLOCK_SYNC_STEP_US || off < -(rtt + CLOCK_SYNC_STEP_US)) {
+            ESP_LOGW(TAG, "hub clock stepped by %lld us, resync", (long long)off);
+            s_clock.sync_n = 0;
+            s_clock.sync_head = 0;
+            s_clock.hub.skew_ppm = 0.0f;
+        }
+    }
+
+    s_clock.sync[s_clock.sync_head] = sample;
+    s_clock.sync_head = (s_clock.sync_head + 1) % DEBI_CLOCK_SYNC_SAMPLES;
+    if (s_clock.sync_n < DEBI_CLOCK_SYNC_SAMPLES) {
+        s_clock.sync_n++;
+    }
+
+    hub_fit();
+    s_clock.hub.rtt_us    = sample.rtt_us;
+    s_clock.hub.samples++;
+    s_clock.hub_valid     = true;
+
+    xSemaphoreGive(s_clock.lock);
+    return true;
+}
+
+bool debi_clock_get_hub(debi_clock_hub_t *out)
+{
+    if (!s_clock.lock) return false;
+
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+    bool valid = s_clock.hub_valid;
+    *out = s_clock.hub;
+    xSemaphoreGive(s_clock.lock);
+    return valid;
+}
+
+int64_t debi_clock_to_hub(int64_t t_us)
+{
+    if (!s_clock.lock) return 0;
+
+    int64_t hub = 0;
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+    if (s_clock.hub_valid) {
+        hub = t_us + hub_offset_at(t_us);
+    }
+    xSemaphoreGive(s_clock.lock);
+    return hub;
+}
+
+void debi_clock_get_audio(debi_clock_audio_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_clock.lock) return;
+
+    xSemaphoreTake(s_clock.lock, portMAX_DELAY);
+    *out = s_clock.audio;
+    xSemaphoreGive(s_clock.lock);
+}
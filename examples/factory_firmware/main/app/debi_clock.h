@@ -0,0 +1,159 @@
+/**
+ * @file debi_clock.h
+ * @brief Debi Clock — One media clock for camera frames and audio
+ *
+ * Everything the Watcher stamps for the hub is in esp_timer
+ * microseconds: camera frames and their boxes by the time the WE2
+ * frame reached the ESP32 (sscma_client reply ts_us), audio by the
+ * time its samples were captured.  This module supplies the two
+ * mappings the hub needs to line them up with each other and with
+ * its own clock.
+ *
+ * Audio: the codec runs on its own sample clock and a read only says
+ * when the last of its samples had arrived.  Every mic read from the
+ * BSP (bsp_set_mic_read_cb) advances a sample count; the capture
+ * time of sample k is fitted as
+ *
+ *   t(k) = t0 + (k - k0) * period + a + b * (k - k0)
+ *
+ * where a, b are a least-squares line through the earliest read of
+ * each DEBI_CLOCK_AUDIO_WINDOW_MS window (reads only ever come late),
+ * over the last DEBI_CLOCK_AUDIO_WINDOWS windows.  b absorbs the
+ * codec clock's rate error.  A reopened codec, a pause in reading or
+ * a window that jumps off the line by DEBI_CLOCK_AUDIO_GAP_US (lost
+ * DMA buffers) starts a new segment from the next read.
+ *
+ * Hub: the periodic ping carries "t0"; a hub that answers with
+ * {"pong":true,"t0":<echo>,"hub_us":<its clock>} gives one sample of
+ * offset = hub_us - (t0 + t_rx) / 2, good to +-RTT/2.  Until the last
+ * DEBI_CLOCK_SYNC_SAMPLES span DEBI_CLOCK_SKEW_SPAN_S the offset is the
+ * lowest-RTT sample's; after that offset and skew come from a line
+ * through all of them, each weighted down by how much slower its RTT
+ * was than the best one.  Each update goes to the hub on
+ * DEBI_TOPIC_CLOCK:
+ *
+ *   {"ts":<esp_timer us>,"offset_us":...,"skew_ppm":...,"err_us":...,
+ *    "rtt_us":...,"samples":...}
+ *
+ * so any Watcher timestamp t is hub time
+ *
+ *   t + offset_us + skew_ppm * (t - ts) / 1e6
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEBI_TOPIC_CLOCK                "debi/watcher/clock"
+
+/* ── Audio (tunable) ── */
+#ifndef DEBI_CLOCK_AUDIO_WINDOW_MS
+#define DEBI_CLOCK_AUDIO_WINDOW_MS      2000   /* one envelope point per window */
+#endif
+
+#ifndef DEBI_CLOCK_AUDIO_WINDOWS
+#define DEBI_CLOCK_AUDIO_WINDOWS        16     /* points in the rate fit */
+#endif
+
+#ifndef DEBI_CLOCK_AUDIO_GAP_US
+#define DEBI_CLOCK_AUDIO_GAP_US         10000  /* envelope jump that means lost samples */
+#endif
+
+#ifndef DEBI_CLOCK_AUDIO_PAUSE_MS
+#define DEBI_CLOCK_AUDIO_PAUSE_MS       500    /* no read this long -> DMA overran */
+#endif
+
+#ifndef DEBI_CLOCK_AUDIO_PPM_MAX
+#define DEBI_CLOCK_AUDIO_PPM_MAX        1000   /* larger fitted rate errors are noise */
+#endif
+
+/* ── Hub sync (tunable) ── */
+#ifndef DEBI_CLOCK_SYNC_SAMPLES
+#define DEBI_CLOCK_SYNC_SAMPLES         16     /* pongs kept */
+#endif
+
+#ifndef DEBI_CLOCK_SYNC_RTT_MAX_MS
+#define DEBI_CLOCK_SYNC_RTT_MAX_MS      2000   /* slower pongs are not used */
+#endif
+
+#ifndef DEBI_CLOCK_SKEW_SPAN_S
+#define DEBI_CLOCK_SKEW_SPAN_S          300    /* samples this far apart before fitting skew */
+#endif
+
+#ifndef DEBI_CLOCK_SKEW_PPM_MAX
+#define DEBI_CLOCK_SKEW_PPM_MAX         200
+#endif
+
+typedef struct {
+    int64_t  ts_us;                /* esp_timer time the mapping is anchored at */
+    int64_t  offset_us;            /* hub clock - esp_timer at ts_us */
+    float    skew_ppm;             /* hub clock rate relative to esp_timer */
+    int32_t  err_us;               /* bound on offset_us: RTT / 2 of the best sample */
+    int32_t  rtt_us;               /* of the latest sample */
+    uint32_t samples;              /* pongs used since boot */
+} debi_clock_hub_t;
+
+typedef struct {
+    uint32_t rate;                 /* nominal sample rate, 0 before the first read */
+    float    rate_ppm;             /* fitted codec rate error, > 0 = fast */
+    uint64_t samples;              /* mic samples read since boot */
+    uint32_t segments;             /* restarts of the sample -> time mapping */
+    uint32_t gaps;                 /* of those, lost samples or a read pause */
+    int32_t  jitter_us;            /* latest read, behind the fitted line */
+} debi_clock_audio_t;
+
+/**
+ * Register with the BSP for mic reads.  Call before audio starts.
+ */
+esp_err_t debi_clock_init(void);
+
+/**
+ * Mic samples read since boot, up to the end of the latest read.
+ */
+uint64_t debi_clock_audio_samples(void);
+
+/**
+ * esp_timer time sample `sample` was captured.
+ *
+ * @return 0 for samples from before the current segment, or before
+ *         any read
+ */
+int64_t debi_clock_audio_time(uint64_t sample);
+
+/**
+ * Add one ping/pong exchange.
+ *
+ * @param t0_us   esp_timer time the ping went out (echoed by the hub)
+ * @param rx_us   esp_timer time the pong arrived
+ * @param hub_us  hub clock when it answered
+ * @return true if the hub mapping changed
+ */
+bool debi_clock_hub_sample(int64_t t0_us, int64_t rx_us, int64_t hub_us);
+
+/**
+ * Current hub mapping.
+ *
+ * @return false before the first usable pong
+ */
+bool debi_clock_get_hub(debi_clock_hub_t *out);
+
+/**
+ * Hub clock at esp_timer time `t_us`, 0 before the first usable pong.
+ */
+int64_t debi_clock_to_hub(int64_t t_us);
+
+/**
+ * Snapshot of the audio mapping.
+ */
+void debi_clock_get_audio(debi_clock_audio_t *out);
+
+#ifdef __cplusplus
+}
+#endif
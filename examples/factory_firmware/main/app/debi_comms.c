@@ -4,7 +4,11 @@
  *
  * Sits between debi_os (which owns the MQTT client) and the rest
  * of the Debi firmware.  Provides:
- *   - Ring-buffer outbound queue for offline resilience
+ *   - Byte-budgeted PSRAM rings, one per priority, for offline
+ *     resilience, drained at a paced rate on reconnect by the comms
+ *     task; the timers only wake it
+ *   - Detection and sensor history spooled to flash (debi_spool)
+ *     while the hub is away, replayed at the hub's round-trip pace
  *   - Expanded command handling (voice, reboot, OTA, config)
  *   - Command acknowledgement with cmd_id
  *   - Connection health tracking
@@ -17,35 +21,85 @@
 #include "debi_os.h"
 #include "debi_voice.h"
 #include "debi_face_bridge.h"
+#include "debi_camera.h"
+#include "debi_spool.h"
+#include "debi_hub.h"
+#include "debi_clock.h"
+#include "debi_json.h"
+#include "debi_audio.h"
 
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "storage.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 static const char *TAG = "debi_comms";
 
+#define COMMS_TASK_STACK        4096
+#define COMMS_TASK_PRIO         4     /* beside the hub task, below MQTT */
+
+/* Why the comms task woke, notification bits */
+#define COMMS_EV_FLUSH          (1 << 0)
+#define COMMS_EV_PING           (1 << 1)
+#define COMMS_EV_STOP           (1 << 2)
+
 /* ------------------------------------------------------------------ */
 /*  Outbound message queue                                             */
 /* ------------------------------------------------------------------ */
 
+/*
+ * A ring holds variable-length records back to back, wrapping at the
+ * end of the buffer:  rec_hdr_t | topic (no NUL) | payload
+ */
 typedef struct {
-    char    topic[64];
-    char    payload[DEBI_COMMS_MSG_MAX_LEN];
-    int     qos;
-    bool    retain;
-} queued_msg_t;
+    uint16_t topic_len;
+    uint8_t  qos;
+    uint8_t  retain;
+    uint32_t payload_len;
+} rec_hdr_t;
 
 typedef struct {
-    queued_msg_t  msgs[DEBI_COMMS_QUEUE_SIZE];
-    int           head;          /* next write position */
-    int           count;         /* number of queued messages */
-} msg_queue_t;
+    uint8_t  *buf;
+    size_t    size;
+    size_t    head;          /* offset of the oldest record */
+    size_t    used;          /* bytes in use */
+    int       count;         /* records in use */
+    uint32_t  head_seq;      /* bumps whenever the oldest record leaves */
+} msg_ring_t;
+
+static const size_t RING_BYTES[DEBI_COMMS_PRIO_COUNT] = {
+    [DEBI_COMMS_PRIO_HIGH]   = DEBI_COMMS_QUEUE_BYTES_HIGH,
+    [DEBI_COMMS_PRIO_NORMAL] = DEBI_COMMS_QUEUE_BYTES_NORMAL,
+    [DEBI_COMMS_PRIO_LOW]    = DEBI_COMMS_QUEUE_BYTES_LOW,
+};
+
+/* Topic suffix -> priority; anything else is NORMAL */
+static const struct {
+    const char        *suffix;
+    debi_comms_prio_t  prio;
+} TOPIC_PRIO[] = {
+    { "/alert",     DEBI_COMMS_PRIO_HIGH   },
+    { "/status",    DEBI_COMMS_PRIO_HIGH   },
+    { "/heartbeat", DEBI_COMMS_PRIO_HIGH   },
+    { "/sensor",    DEBI_COMMS_PRIO_LOW    },
+};
+
+/* History worth keeping through a long outage: spooled to flash while
+ * disconnected, replayed under DEBI_TOPIC_REPLAY */
+static const char *const SPOOL_TOPICS[] = {
+    DEBI_TOPIC_DETECTION,
+    DEBI_TOPIC_SENSOR,
+};
 
 /* ------------------------------------------------------------------ */
 /*  Module state                                                       */
@@ -59,7 +113,15 @@ typedef struct {
     int64_t                   last_rx_us;
     int64_t                   ping_sent_us;  /* for RTT measurement */
     int                       rtt_ms;
-    msg_queue_t               queue;
+    msg_ring_t                rings[DEBI_COMMS_PRIO_COUNT];
+    int                       dropped_count;
+    int                       cmd_dup_count;     /* retried cmd_ids not run again */
+    int                       cmd_limited_count; /* commands over their rate limit */
+    uint8_t                  *flush_buf;     /* comms task only */
+    esp_timer_handle_t        flush_timer;   /* wakes the comms task */
+    esp_timer_handle_t        ping_timer;    /* wakes the comms task */
+    TaskHandle_t              task;          /* publishes for the timers */
+    SemaphoreHandle_t         task_done;
     debi_comms_config_t       config;
     SemaphoreHandle_t         lock;
 } debi_comms_ctx_t;
@@ -72,7 +134,6 @@ static debi_comms_ctx_t s_comms = {
     .last_rx_us      = 0,
     .ping_sent_us    = 0,
     .rtt_ms          = -1,
-    .queue           = { .head = 0, .count = 0 },
     .config          = {
         .idle_timeout_s      = 120,
         .concerned_timeout_s = 1800,
@@ -89,13 +150,24 @@ static debi_comms_ctx_t s_comms = {
 /*  Forward declarations                                               */
 /* ------------------------------------------------------------------ */
 
-static void queue_push(const char *topic, const char *payload,
-                        int qos, bool retain);
+static bool queue_push(debi_comms_prio_t prio, const char *topic,
+                       const void *payload, size_t len, int qos, bool retain);
+static void queue_kick(void);
 static void queue_flush(void);
+static int  queued_count(void);
+static void ping_send(void);
+static void timer_cb(void *arg);
+static void comms_task(void *arg);
+static void publish_clock(void);
+static bool spool_push(const char *topic, const void *payload, size_t len,
+                       int qos, bool retain);
+static int  spool_send(const char *topic, const void *data, size_t len,
+                       int qos, bool retain);
+static void cmd_table_init(void);
 static void dispatch_command(const cJSON *root);
 static void dispatch_config(const cJSON *root);
 static void send_ack(const char *cmd_id, const char *status,
-                      const char *detail);
+                      const char *detail, bool dup);
 static void apply_config(void);
 
 /* ------------------------------------------------------------------ */
@@ -112,15 +184,87 @@ void debi_comms_init(void)
         return;
     }
 
+    /* All rings in one PSRAM block, plus one message worth for flushing */
+    size_t total = 0, largest = 0;
+    for (int i = 0; i < DEBI_COMMS_PRIO_COUNT; i++) {
+        total += RING_BYTES[i];
+        if (RING_BYTES[i] > largest) largest = RING_BYTES[i];
+    }
+    uint8_t *mem = heap_caps_malloc(total + largest + 1, MALLOC_CAP_SPIRAM);
+    const esp_timer_create_args_t timer_args = {
+        .callback = timer_cb,
+        .arg      = (void *)COMMS_EV_FLUSH,
+        .name     = "debi_comms_flush",
+    };
+    const esp_timer_create_args_t ping_args = {
+        .callback = timer_cb,
+        .arg      = (void *)COMMS_EV_PING,
+        .name     = "debi_comms_ping",
+    };
+    s_comms.task_done = xSemaphoreCreateBinary();
+    if (!mem || !s_comms.task_done ||
+        esp_timer_create(&timer_args, &s_comms.flush_timer) != ESP_OK ||
+        esp_timer_create(&ping_args, &s_comms.ping_timer) != ESP_OK ||
+        xTaskCreate(comms_task, "debi_comms", COMMS_TASK_STACK, NULL,
+                    COMMS_TASK_PRIO, &s_comms.task) != pdPASS) {
+        ESP_LOGE(TAG, "queue alloc failed");
+        if (s_comms.flush_timer) {
+            esp_timer_delete(s_comms.flush_timer);
+            s_comms.flush_timer = NULL;
+        }
+        if (s_comms.ping_timer) {
+            esp_timer_delete(s_comms.ping_timer);
+            s_comms.ping_timer = NULL;
+        }
+        if (s_comms.task_done) {
+            vSemaphoreDelete(s_comms.task_done);
+            s_comms.task_done = NULL;
+        }
+        s_comms.task = NULL;
+        free(mem);
+        vSemaphoreDelete(s_comms.lock);
+        s_comms.lock = NULL;
+        return;
+    }
+    for (int i = 0; i < DEBI_COMMS_PRIO_COUNT; i++) {
+        s_comms.rings[i] = (msg_ring_t){ .buf = mem, .size = RING_BYTES[i] };
+        mem += RING_BYTES[i];
+    }
+    s_comms.flush_buf = mem;
+
+    if (debi_spool_init(spool_send) != ESP_OK) {
+        ESP_LOGW(TAG, "no spool, outages keep only the RAM queue");
+    }
+    cmd_table_init();
+
     s_comms.initialised = true;
-    ESP_LOGI(TAG, "comms layer ready  queue_size=%d",
-             DEBI_COMMS_QUEUE_SIZE);
+    ESP_LOGI(TAG, "comms layer ready  queue=%u/%u/%u bytes",
+             (unsigned)RING_BYTES[0], (unsigned)RING_BYTES[1],
+             (unsigned)RING_BYTES[2]);
 }
 
 void debi_comms_deinit(void)
 {
     if (!s_comms.initialised) return;
 
+    esp_timer_stop(s_comms.flush_timer);
+    esp_timer_delete(s_comms.flush_timer);
+    s_comms.flush_timer = NULL;
+    esp_timer_stop(s_comms.ping_timer);
+    esp_timer_delete(s_comms.ping_timer);
+    s_comms.ping_timer = NULL;
+
+    /* The task finishes what it is publishing, then exits */
+    xTaskNotify(s_comms.task, COMMS_EV_STOP, eSetBits);
+    xSemaphoreTake(s_comms.task_done, portMAX_DELAY);
+    vSemaphoreDelete(s_comms.task_done);
+    s_comms.task_done = NULL;
+    s_comms.task = NULL;
+
+    free(s_comms.rings[0].buf);   /* start of the whole block */
+    memset(s_comms.rings, 0, sizeof(s_comms.rings));
+    s_comms.flush_buf = NULL;
+
     if (s_comms.lock) {
         vSemaphoreDelete(s_comms.lock);
         s_comms.lock = NULL;
@@ -141,14 +285,24 @@ void debi_comms_on_connected(esp_mqtt_client_handle_t client)
 
     if (s_comms.reconnect_count > 0) {
         ESP_LOGI(TAG, "reconnected (count=%d), flushing queue (%d msgs)",
-                 s_comms.reconnect_count, s_comms.queue.count);
+                 s_comms.reconnect_count, queued_count());
     }
     s_comms.reconnect_count++;
 
-    /* Flush any queued messages */
-    queue_flush();
+    /* Drain queued messages on the flush timer's pace, not in one burst */
+    queue_kick();
+
+    int rtt_ms = s_comms.rtt_ms;
 
     xSemaphoreGive(s_comms.lock);
+
+    /* Measure the round trip now and every PING_INTERVAL; the pong
+     * re-paces the spool replay */
+    ping_send();
+    esp_timer_stop(s_comms.ping_timer);
+    esp_timer_start_periodic(s_comms.ping_timer,
+                             (uint64_t)DEBI_COMMS_PING_INTERVAL_S * 1000000);
+    debi_spool_replay(rtt_ms);
 }
 
 void debi_comms_on_disconnected(void)
@@ -157,6 +311,8 @@ void debi_comms_on_disconnected(void)
     s_comms.connected   = false;
     s_comms.mqtt_client = NULL;
     xSemaphoreGive(s_comms.lock);
+    esp_timer_stop(s_comms.ping_timer);
+    debi_spool_pause();
 
     ESP_LOGW(TAG, "disconnected — messages will be queued");
 }
@@ -175,14 +331,22 @@ void debi_comms_handle_message(const char *topic,
         return;
     }
 
-    /* Check for pong response (RTT measurement) */
+    /* Check for pong response (RTT measurement, hub clock sync) */
     cJSON *pong = cJSON_GetObjectItem(root, "pong");
     if (pong && cJSON_IsTrue(pong)) {
+        int64_t now = s_comms.last_rx_us;
+        cJSON *t0 = cJSON_GetObjectItem(root, "t0");
+        cJSON *hub_us = cJSON_GetObjectItem(root, "hub_us");
+        if (cJSON_IsNumber(t0) && cJSON_IsNumber(hub_us) &&
+            debi_clock_hub_sample((int64_t)t0->valuedouble, now,
+                                  (int64_t)hub_us->valuedouble)) {
+            publish_clock();
+        }
         if (s_comms.ping_sent_us > 0) {
-            int64_t now = esp_timer_get_time();
             s_comms.rtt_ms = (int)((now - s_comms.ping_sent_us) / 1000);
             s_comms.ping_sent_us = 0;
             ESP_LOGI(TAG, "pong received, RTT=%d ms", s_comms.rtt_ms);
+            debi_spool_replay(s_comms.rtt_ms);
         }
         cJSON_Delete(root);
         return;
@@ -201,29 +365,66 @@ void debi_comms_handle_message(const char *topic,
 int debi_comms_publish(const char *topic, const char *payload,
                         int qos, bool retain)
 {
-    if (!s_comms.initialised || !topic || !payload) return -1;
+    if (!payload) return -1;
+    return debi_comms_publish_bin(topic, payload, strlen(payload), qos, retain);
+}
+
+int debi_comms_publish_bin(const char *topic, const void *data, size_t len,
+                           int qos, bool retain)
+{
+    if (!s_comms.initialised || !topic || !data) return -1;
+
+    debi_comms_prio_t prio = debi_comms_topic_prio(topic);
 
     xSemaphoreTake(s_comms.lock, portMAX_DELAY);
 
-    if (s_comms.connected && s_comms.mqtt_client) {
-        /* Publish directly */
-        esp_mqtt_client_publish(s_comms.mqtt_client,
-                                topic, payload, 0,
-                                qos, retain ? 1 : 0);
-        xSemaphoreGive(s_comms.lock);
+    /* Nothing as urgent waiting: publish directly, outside the lock */
+    bool backlog = false;
+    for (int i = 0; i <= prio; i++) {
+        backlog |= s_comms.rings[i].count > 0;
+    }
+    bool connected = s_comms.connected;
+    esp_mqtt_client_handle_t client = connected && !backlog
+                                      ? s_comms.mqtt_client : NULL;
+    xSemaphoreGive(s_comms.lock);
+
+    if (client && esp_mqtt_client_publish(client, topic, data, (int)len,
+                                          qos, retain ? 1 : 0) >= 0) {
         return 0;
     }
 
-    /* Queue for later */
-    queue_push(topic, payload, qos, retain);
-    int count = s_comms.queue.count;
+    /* Hub away: history goes to flash, the RAM queue if that fails */
+    if (!connected && spool_push(topic, data, len, qos, retain)) {
+        return 0;
+    }
 
+    /* Queue for later */
+    xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+    bool ok = queue_push(prio, topic, data, len, qos, retain);
+    int count = queued_count();
+    queue_kick();
     xSemaphoreGive(s_comms.lock);
 
+    if (!ok) {
+        ESP_LOGW(TAG, "msg for %s too large to queue", topic);
+        return -1;
+    }
     ESP_LOGD(TAG, "queued msg for %s (%d in queue)", topic, count);
     return 0;
 }
 
+debi_comms_prio_t debi_comms_topic_prio(const char *topic)
+{
+    size_t len = topic ? strlen(topic) : 0;
+    for (size_t i = 0; i < sizeof(TOPIC_PRIO) / sizeof(TOPIC_PRIO[0]); i++) {
+        size_t n = strlen(TOPIC_PRIO[i].suffix);
+        if (len >= n && strcmp(topic + len - n, TOPIC_PRIO[i].suffix) == 0) {
+            return TOPIC_PRIO[i].prio;
+        }
+    }
+    return DEBI_COMMS_PRIO_NORMAL;
+}
+
 debi_comms_health_t debi_comms_get_health(void)
 {
     debi_comms_health_t h = {
@@ -231,8 +432,23 @@ debi_comms_health_t debi_comms_get_health(void)
         .reconnect_count = s_comms.reconnect_count,
         .last_msg_time_us = s_comms.last_rx_us,
         .rtt_ms          = s_comms.rtt_ms,
-        .queued_count    = s_comms.queue.count,
     };
+    if (s_comms.initialised) {
+        xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+        h.queued_count  = queued_count();
+        for (int i = 0; i < DEBI_COMMS_PRIO_COUNT; i++) {
+            h.queued_bytes += s_comms.rings[i].used;
+        }
+        h.dropped_count = s_comms.dropped_count;
+        xSemaphoreGive(s_comms.lock);
+
+        h.cmd_dup_count     = s_comms.cmd_dup_count;
+        h.cmd_limited_count = s_comms.cmd_limited_count;
+
+        debi_spool_stats_t spool;
+        debi_spool_get_stats(&spool);
+        h.spooled_count = spool.pending;
+    }
     return h;
 }
 
@@ -251,57 +467,717 @@ bool debi_comms_hub_healthy(void)
     return (elapsed_us < timeout_us);
 }
 
+/* ------------------------------------------------------------------ */
+/*  Hub ping                                                           */
+/* ------------------------------------------------------------------ */
+
+/* The pong gives the RTT and, on a quiet link, is what keeps last_rx
+ * inside STALE_TIMEOUT: a hub that stops answering goes unhealthy
+ * even while the broker still holds the connection.  A hub that
+ * echoes t0 with its own clock also syncs debi_clock. */
+static void ping_send(void)
+{
+    int64_t now = 0;
+    xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+    esp_mqtt_client_handle_t client = s_comms.connected ? s_comms.mqtt_client : NULL;
+    if (client) {
+        now = esp_timer_get_time();
+        s_comms.ping_sent_us = now;
+    }
+    xSemaphoreGive(s_comms.lock);
+
+    if (client) {
+        /* {"ping":true,"t0":...} */
+        char buf[48];
+        debi_json_t w;
+        debi_json_init(&w, buf, sizeof(buf));
+        DEBI_JSON_LIT(&w, "{\"ping\":true,\"t0\":");
+        debi_json_int(&w, now);
+        DEBI_JSON_LIT(&w, "}");
+        const char *json = debi_json_finish(&w, NULL);
+        if (json) {
+            esp_mqtt_client_publish(client, DEBI_TOPIC_STATUS, json, 0, 0, 0);
+        }
+    }
+}
+
+/* The Watcher -> hub clock mapping, for the hub to place ts_us stamps */
+static void publish_clock(void)
+{
+    debi_clock_hub_t hub;
+    if (!debi_clock_get_hub(&hub)) return;
+
+    /* {"ts":...,"offset_us":...,"skew_ppm":1.25,"err_us":...,"rtt_us":...,"samples":...} */
+    char buf[160];
+    debi_json_t w;
+    debi_json_init(&w, buf, sizeof(buf));
+    DEBI_JSON_LIT(&w, "{\"ts\":");
+    debi_json_int(&w, hub.ts_us);
+    DEBI_JSON_LIT(&w, ",\"offset_us\":");
+    debi_json_int(&w, hub.offset_us);
+    DEBI_JSON_LIT(&w, ",\"skew_ppm\":");
+    debi_json_centi(&w, (int64_t)lroundf(hub.skew_ppm * 100.0f));
+    DEBI_JSON_LIT(&w, ",\"err_us\":");
+    debi_json_int(&w, hub.err_us);
+    DEBI_JSON_LIT(&w, ",\"rtt_us\":");
+    debi_json_int(&w, hub.rtt_us);
+    DEBI_JSON_LIT(&w, ",\"samples\":");
+    debi_json_int(&w, hub.samples);
+    DEBI_JSON_LIT(&w, "}");
+
+    const char *json = debi_json_finish(&w, NULL);
+    if (json) {
+        debi_comms_publish(DEBI_TOPIC_CLOCK, json, 0, false);
+    }
+}
+
 /* ------------------------------------------------------------------ */
 /*  Queue internals                                                    */
 /* ------------------------------------------------------------------ */
 
-static void queue_push(const char *topic, const char *payload,
-                        int qos, bool retain)
+/* Copy in / out of a ring at `off`, wrapping at the end of the buffer */
+static void ring_write(msg_ring_t *r, size_t off, const void *src, size_t len)
+{
+    off %= r->size;
+    size_t n = len < r->size - off ? len : r->size - off;
+    memcpy(r->buf + off, src, n);
+    memcpy(r->buf, (const uint8_t *)src + n, len - n);
+}
+
+static void ring_read(const msg_ring_t *r, size_t off, void *dst, size_t len)
 {
-    if (s_comms.queue.count >= DEBI_COMMS_QUEUE_SIZE) {
-        ESP_LOGW(TAG, "queue full — dropping oldest message");
-        /* Overwrite oldest (head wraps around) */
-        s_comms.queue.count = DEBI_COMMS_QUEUE_SIZE - 1;
+    off %= r->size;
+    size_t n = len < r->size - off ? len : r->size - off;
+    memcpy(dst, r->buf + off, n);
+    memcpy((uint8_t *)dst + n, r->buf, len - n);
+}
+
+static size_t ring_head_len(const msg_ring_t *r)
+{
+    rec_hdr_t hdr;
+    ring_read(r, r->head, &hdr, sizeof(hdr));
+    return sizeof(hdr) + hdr.topic_len + hdr.payload_len;
+}
+
+static void ring_pop(msg_ring_t *r)
+{
+    size_t len = ring_head_len(r);
+    r->head = (r->head + len) % r->size;
+    r->used -= len;
+    r->count--;
+    r->head_seq++;
+}
+
+static int queued_count(void)
+{
+    int count = 0;
+    for (int i = 0; i < DEBI_COMMS_PRIO_COUNT; i++) {
+        count += s_comms.rings[i].count;
     }
+    return count;
+}
 
-    int idx = (s_comms.queue.head + s_comms.queue.count)
-              % DEBI_COMMS_QUEUE_SIZE;
+/* Call with the lock held. */
+static bool queue_push(debi_comms_prio_t prio, const char *topic,
+                       const void *payload, size_t len, int qos, bool retain)
+{
+    msg_ring_t *r = &s_comms.rings[prio];
+    rec_hdr_t hdr = {
+        .topic_len   = strlen(topic),
+        .qos         = qos,
+        .retain      = retain,
+        .payload_len = len,
+    };
+    size_t rec_len = sizeof(hdr) + hdr.topic_len + hdr.payload_len;
+    if (!r->buf || rec_len > r->size) return false;
 
-    strncpy(s_comms.queue.msgs[idx].topic, topic,
-            sizeof(s_comms.queue.msgs[idx].topic) - 1);
-    s_comms.queue.msgs[idx].topic[sizeof(s_comms.queue.msgs[idx].topic) - 1] = '\0';
+    int dropped = 0;
+    while (r->size - r->used < rec_len) {
+        ring_pop(r);
+        dropped++;
+    }
+    if (dropped) {
+        s_comms.dropped_count += dropped;
+        ESP_LOGW(TAG, "queue %d full — dropped %d oldest", prio, dropped);
+    }
 
-    strncpy(s_comms.queue.msgs[idx].payload, payload,
-            sizeof(s_comms.queue.msgs[idx].payload) - 1);
-    s_comms.queue.msgs[idx].payload[sizeof(s_comms.queue.msgs[idx].payload) - 1] = '\0';
+    size_t tail = r->head + r->used;
+    ring_write(r, tail, &hdr, sizeof(hdr));
+    ring_write(r, tail + sizeof(hdr), topic, hdr.topic_len);
+    ring_write(r, tail + sizeof(hdr) + hdr.topic_len, payload, hdr.payload_len);
+    r->used += rec_len;
+    r->count++;
+    return true;
+}
 
-    s_comms.queue.msgs[idx].qos    = qos;
-    s_comms.queue.msgs[idx].retain = retain;
-    s_comms.queue.count++;
+/* Start the flush timer if there is something to send.  Lock held. */
+static void queue_kick(void)
+{
+    if (s_comms.connected && queued_count() > 0 &&
+        !esp_timer_is_active(s_comms.flush_timer)) {
+        esp_timer_start_periodic(s_comms.flush_timer,
+                                 DEBI_COMMS_FLUSH_INTERVAL_MS * 1000ULL);
+    }
 }
 
+/*
+ * One flush tick on the comms task: send up to DEBI_COMMS_FLUSH_BYTES
+ * (at least one message), highest priority first.  Publishing happens
+ * outside the lock; a message leaves its ring only once the client
+ * took it.
+ */
 static void queue_flush(void)
 {
-    if (!s_comms.mqtt_client || s_comms.queue.count == 0) return;
+    size_t budget = DEBI_COMMS_FLUSH_BYTES;
+    bool sent_any = false;
+
+    while (1) {
+        xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+        msg_ring_t *r = NULL;
+        for (int i = 0; i < DEBI_COMMS_PRIO_COUNT && !r; i++) {
+            if (s_comms.rings[i].count > 0) r = &s_comms.rings[i];
+        }
+        if (!r || !s_comms.connected || !s_comms.mqtt_client) {
+            esp_timer_stop(s_comms.flush_timer);
+            xSemaphoreGive(s_comms.lock);
+            return;
+        }
+        size_t len = ring_head_len(r);
+        if (sent_any && len > budget) {
+            xSemaphoreGive(s_comms.lock);
+            return;
+        }
 
-    ESP_LOGI(TAG, "flushing %d queued messages", s_comms.queue.count);
+        /* flush_buf: topic \0 payload */
+        rec_hdr_t hdr;
+        ring_read(r, r->head, &hdr, sizeof(hdr));
+        char *topic = (char *)s_comms.flush_buf;
+        char *payload = topic + hdr.topic_len + 1;
+        ring_read(r, r->head + sizeof(hdr), topic, hdr.topic_len);
+        topic[hdr.topic_len] = '\0';
+        ring_read(r, r->head + sizeof(hdr) + hdr.topic_len, payload, hdr.payload_len);
+        uint32_t seq = r->head_seq;
+        esp_mqtt_client_handle_t client = s_comms.mqtt_client;
+        xSemaphoreGive(s_comms.lock);
 
-    while (s_comms.queue.count > 0) {
-        queued_msg_t *msg = &s_comms.queue.msgs[s_comms.queue.head];
+        if (esp_mqtt_client_publish(client, topic, payload, hdr.payload_len,
+                                    hdr.qos, hdr.retain) < 0) {
+            return;   /* retried on the next tick */
+        }
 
-        esp_mqtt_client_publish(s_comms.mqtt_client,
-                                msg->topic, msg->payload, 0,
-                                msg->qos, msg->retain ? 1 : 0);
+        xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+        if (r->head_seq == seq) {   /* not pushed out meanwhile */
+            ring_pop(r);
+        }
+        xSemaphoreGive(s_comms.lock);
 
-        s_comms.queue.head = (s_comms.queue.head + 1) % DEBI_COMMS_QUEUE_SIZE;
-        s_comms.queue.count--;
+        sent_any = true;
+        budget = len < budget ? budget - len : 0;
+        if (budget == 0) return;
     }
 }
 
+/*
+ * The timers run on the esp_timer task, which every timer of the
+ * firmware shares: they only wake the comms task, where the publish
+ * may block on the MQTT client and copy a large message.
+ */
+static void timer_cb(void *arg)
+{
+    xTaskNotify(s_comms.task, (uint32_t)(uintptr_t)arg, eSetBits);
+}
+
+static void comms_task(void *arg)
+{
+    uint32_t events = 0;
+
+    while (1) {
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        if (events & COMMS_EV_STOP) break;
+        if (events & COMMS_EV_PING) ping_send();
+        if (events & COMMS_EV_FLUSH) queue_flush();
+    }
+    xSemaphoreGive(s_comms.task_done);
+    vTaskDelete(NULL);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Flash spool                                                        */
+/* ------------------------------------------------------------------ */
+
+/* Spool a history message under its replay topic, e.g.
+ * debi/watcher/sensor -> debi/watcher/replay/sensor */
+static bool spool_push(const char *topic, const void *payload, size_t len,
+                       int qos, bool retain)
+{
+    for (size_t i = 0; i < sizeof(SPOOL_TOPICS) / sizeof(SPOOL_TOPICS[0]); i++) {
+        if (strcmp(topic, SPOOL_TOPICS[i]) == 0) {
+            char replay_topic[64];
+            snprintf(replay_topic, sizeof(replay_topic), "%s%s", DEBI_TOPIC_REPLAY,
+                     topic + strlen(DEBI_TOPIC_PREFIX));
+            return debi_spool_put(replay_topic, payload, len, qos, retain);
+        }
+    }
+    return false;
+}
+
+/* Spool task: replayed history waits until the RAM queue is empty */
+static int spool_send(const char *topic, const void *data, size_t len,
+                      int qos, bool retain)
+{
+    xSemaphoreTake(s_comms.lock, portMAX_DELAY);
+    esp_mqtt_client_handle_t client = s_comms.connected && queued_count() == 0
+                                      ? s_comms.mqtt_client : NULL;
+    xSemaphoreGive(s_comms.lock);
+
+    if (client && esp_mqtt_client_publish(client, topic, data, (int)len,
+                                          qos, retain ? 1 : 0) >= 0) {
+        return 0;
+    }
+    return -1;
+}
+
 /* ------------------------------------------------------------------ */
 /*  Command dispatch                                                   */
 /* ------------------------------------------------------------------ */
 
+/*
+ * Commands are looked up by name in CMD_TABLE (sorted, binary search).
+ * Each entry lists its arguments; they are picked out of the message
+ * in one walk and type-checked before the handler runs, so a handler
+ * only reads c->arg[i] in the order of its schema.
+ *
+ * A cmd_id that already ran is not run again: the hub retries when an
+ * ack is slow, and a retried alarm or mode change must not happen
+ * twice.  The last DEBI_COMMS_CMD_IDS ids are kept with their ack,
+ * which is sent again instead.  Read-only commands skip this and
+ * simply answer again.  The ids are kept in RAM, so a command that
+ * reboots saves its id to NVS too, and it is remembered after boot:
+ * the hub's retry of a reboot that lost its ack must not reboot again.
+ *
+ * Each command also has a token bucket: burst commands at once, then
+ * one per refill_ms.  A command over its limit is refused with an
+ * error ack and is not remembered, so a later retry runs.
+ *
+ * Only the MQTT event task dispatches, so none of this is locked.
+ */
+
+#define CMD_ARGS_MAX        4
+#define CMD_DETAIL_MAX      32
+#define CMD_DURATION_MAX_S  (7 * 24 * 3600)
+
+typedef enum {
+    ARG_NUM = 0,
+    ARG_STR,
+    ARG_BOOL,
+    ARG_ENUM,                      /* string, one of names[] */
+} cmd_arg_type_t;
+
+typedef struct {
+    const char         *name;
+    cmd_arg_type_t      type;
+    bool                required;
+    const char *const  *names;     /* ARG_ENUM, NULL-terminated */
+    double              min, max;  /* ARG_NUM */
+} cmd_arg_t;
+
+typedef struct {
+    const char  *cmd_id;           /* NULL if the hub wants no ack */
+    const cJSON *arg[CMD_ARGS_MAX];
+    int          choice[CMD_ARGS_MAX];  /* ARG_ENUM index */
+    int          seen;             /* slot in s_cmd_seen, -1 if none */
+    bool         save;             /* CMD_SAVE_ID */
+} cmd_call_t;
+
+#define CMD_READ_ONLY       0x01   /* safe to run again for a retried cmd_id */
+#define CMD_SAVE_ID         0x02   /* id saved by its reply, which comes before it acts */
+
+typedef struct {
+    const char  *name;
+    void       (*fn)(cmd_call_t *c);
+    cmd_arg_t    args[CMD_ARGS_MAX];
+    uint8_t      flags;
+    uint8_t      burst;            /* 0 = no rate limit */
+    uint32_t     refill_ms;        /* one more token every refill_ms */
+} cmd_def_t;
+
+typedef struct {
+    uint64_t  id_hash;             /* FNV-1a of cmd_id */
+    int64_t   used_us;             /* 0 = free */
+    bool      replied;
+    bool      ok;
+    char      detail[CMD_DETAIL_MAX];
+} cmd_seen_t;
+
+/* The cmd_id of the last CMD_SAVE_ID command, in NVS */
+#define CMD_SAVED_VERSION   1
+
+typedef struct {
+    uint32_t  version;
+    uint64_t  id_hash;
+    bool      ok;
+    char      detail[CMD_DETAIL_MAX];
+} cmd_saved_t;
+
+typedef struct {
+    int       tokens;
+    int64_t   refill_us;           /* when the last token was added */
+} cmd_bucket_t;
+
+static const char *const MODE_NAMES[]        = { "active", "night", "alert", "setup", NULL };
+static const debi_mode_t MODE_VALUES[]       = { DEBI_MODE_ACTIVE, DEBI_MODE_NIGHT,
+                                                 DEBI_MODE_ALERT, DEBI_MODE_SETUP };
+static const char *const STREAM_NAMES[]      = { "auto", "fixed", "off", NULL };
+static const debi_camera_stream_mode_t STREAM_VALUES[] = {
+    DEBI_CAMERA_STREAM_AUTO, DEBI_CAMERA_STREAM_FIXED, DEBI_CAMERA_STREAM_OFF,
+};
+static const char *const AUDIO_NAMES[]       = { "vad", "on", "off", NULL };
+static const debi_audio_mode_t AUDIO_VALUES[] = {
+    DEBI_AUDIO_MODE_VAD, DEBI_AUDIO_MODE_ON, DEBI_AUDIO_MODE_OFF,
+};
+
+static cmd_seen_t s_cmd_seen[DEBI_COMMS_CMD_IDS];
+
+static void cmd_seen_save(const cmd_seen_t *s)
+{
+    cmd_saved_t saved = { .version = CMD_SAVED_VERSION, .id_hash = s->id_hash, .ok = s->ok };
+    memcpy(saved.detail, s->detail, sizeof(saved.detail));
+    esp_err_t err = storage_write(DEBI_COMMS_CMD_STORAGE, &saved, sizeof(saved));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "cmd_id not saved: %s", esp_err_to_name(err));
+    }
+}
+
+/* The id saved before the reboot, as if it had just run */
+static void cmd_seen_load(int64_t now)
+{
+    cmd_saved_t saved;
+    size_t len = sizeof(saved);
+    if (storage_read(DEBI_COMMS_CMD_STORAGE, &saved, &len) != ESP_OK ||
+        len != sizeof(saved) || saved.version != CMD_SAVED_VERSION) {
+        return;
+    }
+    uint8_t ok;
+    memcpy(&ok, &saved.ok, 1);
+    s_cmd_seen[0] = (cmd_seen_t){
+        .id_hash = saved.id_hash, .used_us = now > 0 ? now : 1, .replied = true, .ok = ok != 0,
+    };
+    memcpy(s_cmd_seen[0].detail, saved.detail, sizeof(saved.detail));
+    s_cmd_seen[0].detail[CMD_DETAIL_MAX - 1] = '\0';
+}
+
+static void cmd_reply(cmd_call_t *c, const char *status, const char *detail)
+{
+    if (c->seen >= 0) {
+        cmd_seen_t *s = &s_cmd_seen[c->seen];
+        s->replied = true;
+        s->ok = strcmp(status, "ok") == 0;
+        snprintf(s->detail, sizeof(s->detail), "%s", detail ? detail : "");
+        if (c->save) cmd_seen_save(s);
+    }
+    if (c->cmd_id) send_ack(c->cmd_id, status, detail, false);
+}
+
+static double arg_num(const cmd_call_t *c, int i, double def)
+{
+    return c->arg[i] ? c->arg[i]->valuedouble : def;
+}
+
+static bool arg_bool(const cmd_call_t *c, int i, bool def)
+{
+    return c->arg[i] ? cJSON_IsTrue(c->arg[i]) : def;
+}
+
+/* ---- handlers, in table order ---- */
+
+static void cmd_audio(cmd_call_t *c)
+{
+    /* {"cmd":"audio","mode":"vad"|"on"|"off","duration_s":60,
+     *  "bitrate":24000,"complexity":3}, every field optional */
+    if (c->arg[2] || c->arg[3]) {
+        debi_audio_set_encoder((int)arg_num(c, 2, 0), (int)arg_num(c, 3, -1));
+    }
+    if (c->arg[0]) {
+        debi_audio_set_mode(AUDIO_VALUES[c->choice[0]], (int)arg_num(c, 1, 0));
+    }
+    cmd_reply(c, "ok", c->arg[0] ? c->arg[0]->valuestring : "encoder set");
+}
+
+static void cmd_get_health(cmd_call_t *c)
+{
+    debi_comms_health_t h = debi_comms_get_health();
+    debi_hub_status_t hub;
+    debi_hub_get_status(&hub);
+    debi_clock_audio_t audio;
+    debi_clock_get_audio(&audio);
+    debi_audio_stats_t uplink;
+    debi_audio_get_stats(&uplink);
+    cJSON *resp = cJSON_CreateObject();
+    if (resp) {
+        cJSON_AddBoolToObject(resp, "connected", h.connected);
+        cJSON_AddStringToObject(resp, "broker", hub.uri);
+        cJSON_AddStringToObject(resp, "broker_src", debi_hub_source_name(hub.source));
+        cJSON_AddNumberToObject(resp, "reconnects", h.reconnect_count);
+        cJSON_AddNumberToObject(resp, "rtt_ms", h.rtt_ms);
+        cJSON_AddNumberToObject(resp, "queued", h.queued_count);
+        cJSON_AddNumberToObject(resp, "spooled", h.spooled_count);
+        cJSON_AddNumberToObject(resp, "cmd_dups", h.cmd_dup_count);
+        cJSON_AddNumberToObject(resp, "cmd_limited", h.cmd_limited_count);
+        cJSON_AddNumberToObject(resp, "cam_fps", debi_camera_get_fps());
+        cJSON_AddNumberToObject(resp, "mic_ppm", audio.rate_ppm);
+        cJSON_AddNumberToObject(resp, "mic_gaps", audio.gaps);
+        cJSON_AddNumberToObject(resp, "audio_chunks", uplink.chunks_sent);
+        cJSON_AddNumberToObject(resp, "audio_enc_us", uplink.encode_us_avg);
+        cJSON_AddNumberToObject(resp, "heap",
+                                 (double)esp_get_free_heap_size());
+        if (c->cmd_id) cJSON_AddStringToObject(resp, "cmd_id", c->cmd_id);
+        char *json = cJSON_PrintUnformatted(resp);
+        if (json) {
+            debi_comms_publish(DEBI_TOPIC_STATUS, json, 0, false);
+            free(json);
+        }
+        cJSON_Delete(resp);
+    }
+}
+
+static void cmd_mute(cmd_call_t *c)
+{
+    bool mute_on = arg_bool(c, 0, true);
+    debi_voice_set_mute(mute_on);
+    s_comms.config.mute = mute_on;
+    cmd_reply(c, "ok", mute_on ? "muted" : "unmuted");
+}
+
+static void cmd_ping(cmd_call_t *c)
+{
+    /* Send pong with timestamp for hub-side RTT */
+    cJSON *pong = cJSON_CreateObject();
+    if (pong) {
+        cJSON_AddTrueToObject(pong, "pong");
+        cJSON_AddNumberToObject(pong, "ts",
+                                 (double)esp_timer_get_time());
+        if (c->cmd_id) cJSON_AddStringToObject(pong, "cmd_id", c->cmd_id);
+        char *json = cJSON_PrintUnformatted(pong);
+        if (json) {
+            debi_comms_publish(DEBI_TOPIC_STATUS, json, 0, false);
+            free(json);
+        }
+        cJSON_Delete(pong);
+    }
+}
+
+static void cmd_play_sound(cmd_call_t *c)
+{
+    debi_voice_play_file(c->arg[0]->valuestring);
+    cmd_reply(c, "ok", "playing");
+}
+
+static void cmd_reboot(cmd_call_t *c)
+{
+    cmd_reply(c, "ok", "rebooting");
+    ESP_LOGW(TAG, "reboot requested by hub");
+    vTaskDelay(pdMS_TO_TICKS(500));  /* Let ack send */
+    esp_restart();
+}
+
+static void cmd_report_sensors(cmd_call_t *c)
+{
+    debi_os_report_sensors();
+    cmd_reply(c, "ok", "reported");
+}
+
+static void cmd_set_mode(cmd_call_t *c)
+{
+    debi_os_set_mode(MODE_VALUES[c->choice[0]]);
+    cmd_reply(c, "ok", c->arg[0]->valuestring);
+}
+
+static void cmd_set_volume(cmd_call_t *c)
+{
+    int vol = (int)arg_num(c, 0, 0);
+    debi_voice_set_volume(vol);
+    s_comms.config.volume = vol;
+    cmd_reply(c, "ok", "volume set");
+}
+
+static void cmd_stop_sound(cmd_call_t *c)
+{
+    debi_voice_stop();
+    cmd_reply(c, "ok", "stopped");
+}
+
+static void cmd_stream(cmd_call_t *c)
+{
+    /* {"cmd":"stream","mode":"auto"|"fixed"|"off","fps":5,"duration_s":60} */
+    debi_camera_stream_mode_t mode = c->arg[0] ? STREAM_VALUES[c->choice[0]]
+                                               : DEBI_CAMERA_STREAM_FIXED;
+    if (mode == DEBI_CAMERA_STREAM_FIXED && !c->arg[1]) {
+        cmd_reply(c, "error", "missing fps");
+        return;
+    }
+    debi_camera_set_stream(mode, (float)arg_num(c, 1, 0.0), (int)arg_num(c, 2, 0));
+    cmd_reply(c, "ok", c->arg[0] ? c->arg[0]->valuestring : "fixed");
+}
+
+/* Sorted by name (strcmp order): looked up by binary search */
+static const cmd_def_t CMD_TABLE[] = {
+    { "audio",          cmd_audio,
+      { { "mode", ARG_ENUM, false, AUDIO_NAMES },
+        { "duration_s", ARG_NUM, .min = 0, .max = CMD_DURATION_MAX_S },
+        { "bitrate", ARG_NUM, .min = 0, .max = 1000000 },
+        { "complexity", ARG_NUM, .min = 0, .max = 10 } },
+      .burst = 5, .refill_ms = 1000 },
+    { "get_health",     cmd_get_health,     { { 0 } },
+      .flags = CMD_READ_ONLY, .burst = 5, .refill_ms = 1000 },
+    { "mute",           cmd_mute,           { { "value", ARG_BOOL } },
+      .burst = 10, .refill_ms = 200 },
+    { "ping",           cmd_ping,           { { 0 } },
+      .flags = CMD_READ_ONLY, .burst = 10, .refill_ms = 500 },
+    { "play_sound",     cmd_play_sound,     { { "file", ARG_STR, true } },
+      .burst = 5, .refill_ms = 1000 },
+    { "reboot",         cmd_reboot,         { { 0 } },
+      .flags = CMD_SAVE_ID, .burst = 1, .refill_ms = 60000 },
+    { "report_sensors", cmd_report_sensors, { { 0 } },
+      .flags = CMD_READ_ONLY, .burst = 5, .refill_ms = 1000 },
+    { "set_mode",       cmd_set_mode,       { { "mode", ARG_ENUM, true, MODE_NAMES } },
+      .burst = 5, .refill_ms = 500 },
+    { "set_volume",     cmd_set_volume,     { { "value", ARG_NUM, true, .min = 0, .max = 100 } },
+      .burst = 10, .refill_ms = 200 },
+    { "stop_sound",     cmd_stop_sound,     { { 0 } },
+      .burst = 10, .refill_ms = 200 },
+    { "stream",         cmd_stream,
+      { { "mode", ARG_ENUM, false, STREAM_NAMES },
+        { "fps", ARG_NUM, .min = 0, .max = 1000 },
+        { "duration_s", ARG_NUM, .min = 0, .max = CMD_DURATION_MAX_S } },
+      .burst = 5, .refill_ms = 1000 },
+};
+
+#define CMD_COUNT   (sizeof(CMD_TABLE) / sizeof(CMD_TABLE[0]))
+
+static cmd_bucket_t s_cmd_bucket[CMD_COUNT];
+
+/* Every bucket starts full; cmd_find() only works on a sorted table */
+static void cmd_table_init(void)
+{
+    int64_t now = esp_timer_get_time();
+    for (size_t i = 0; i < CMD_COUNT; i++) {
+        s_cmd_bucket[i] = (cmd_bucket_t){ .tokens = CMD_TABLE[i].burst, .refill_us = now };
+        if (i > 0 && strcmp(CMD_TABLE[i - 1].name, CMD_TABLE[i].name) >= 0) {
+            ESP_LOGE(TAG, "CMD_TABLE not sorted at %s", CMD_TABLE[i].name);
+        }
+    }
+    cmd_seen_load(now);
+}
+
+static const cmd_def_t *cmd_find(const char *name)
+{
+    size_t lo = 0, hi = CMD_COUNT;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int d = strcmp(name, CMD_TABLE[mid].name);
+        if (d == 0) return &CMD_TABLE[mid];
+        if (d < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+/* Pick the schema's arguments out of the message; NULL if they fit,
+ * else the ack detail */
+static const char *cmd_parse_args(const cmd_def_t *def, const cJSON *root,
+                                  cmd_call_t *c, char *detail, size_t detail_len)
+{
+    for (const cJSON *item = root->child; item; item = item->next) {
+        if (!item->string) continue;
+        for (int i = 0; i < CMD_ARGS_MAX && def->args[i].name; i++) {
+            if (c->arg[i] || strcmp(item->string, def->args[i].name) != 0) continue;
+            c->arg[i] = item;
+            break;
+        }
+    }
+
+    for (int i = 0; i < CMD_ARGS_MAX && def->args[i].name; i++) {
+        const cmd_arg_t *a = &def->args[i];
+        const cJSON *v = c->arg[i];
+        if (!v) {
+            if (!a->required) continue;
+            snprintf(detail, detail_len, "missing %s", a->name);
+            return detail;
+        }
+        bool ok = a->type == ARG_NUM  ? cJSON_IsNumber(v) && v->valuedouble >= a->min &&
+                                        v->valuedouble <= a->max :
+                  a->type == ARG_BOOL ? cJSON_IsBool(v) :
+                                        cJSON_IsString(v) && v->valuestring;
+        if (ok && a->type == ARG_ENUM) {
+            ok = false;
+            for (int k = 0; a->names[k]; k++) {
+                if (strcmp(v->valuestring, a->names[k]) == 0) {
+                    c->choice[i] = k;
+                    ok = true;
+                    break;
+                }
+            }
+            if (!ok) {
+                snprintf(detail, detail_len, "unknown %s", a->name);
+                return detail;
+            }
+        }
+        if (!ok) {
+            snprintf(detail, detail_len, "bad %s", a->name);
+            return detail;
+        }
+    }
+    return NULL;
+}
+
+static bool cmd_take_token(const cmd_def_t *def, int64_t now)
+{
+    if (def->burst == 0) return true;
+
+    cmd_bucket_t *b = &s_cmd_bucket[def - CMD_TABLE];
+    int64_t step = (int64_t)def->refill_ms * 1000;
+    int64_t add = (now - b->refill_us) / step;
+    if (add > 0) {
+        b->tokens = add >= def->burst - b->tokens ? def->burst : b->tokens + (int)add;
+        b->refill_us += add * step;
+    }
+    if (b->tokens == def->burst) {
+        b->refill_us = now;   /* a full bucket does not save up */
+    }
+    if (b->tokens == 0) return false;
+    b->tokens--;
+    return true;
+}
+
+static uint64_t cmd_id_hash(const char *id)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *id; id++) {
+        h = (h ^ (uint8_t)*id) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* The slot of an id already run, or -1 */
+static int cmd_seen_find(uint64_t hash)
+{
+    for (int i = 0; i < DEBI_COMMS_CMD_IDS; i++) {
+        if (s_cmd_seen[i].used_us && s_cmd_seen[i].id_hash == hash) return i;
+    }
+    return -1;
+}
+
+/* Remember an id, pushing out the least recently used one */
+static int cmd_seen_add(uint64_t hash, int64_t now)
+{
+    int lru = 0;
+    for (int i = 1; i < DEBI_COMMS_CMD_IDS; i++) {
+        if (s_cmd_seen[i].used_us < s_cmd_seen[lru].used_us) lru = i;
+    }
+    s_cmd_seen[lru] = (cmd_seen_t){ .id_hash = hash, .used_us = now };
+    return lru;
+}
+
 static void dispatch_command(const cJSON *root)
 {
     /* Extract optional cmd_id for acknowledgement */
@@ -311,7 +1187,7 @@ static void dispatch_command(const cJSON *root)
 
     const cJSON *cmd_item = cJSON_GetObjectItem(root, "cmd");
     if (!cmd_item || !cJSON_IsString(cmd_item)) {
-        if (cmd_id) send_ack(cmd_id, "error", "missing cmd field");
+        if (cmd_id) send_ack(cmd_id, "error", "missing cmd field", false);
         return;
     }
 
@@ -320,111 +1196,52 @@ static void dispatch_command(const cJSON *root)
     ESP_LOGI(TAG, "cmd: %s (id=%s)", cmd,
              cmd_id ? cmd_id : "none");
 
-    /* ---- set_mode ---- */
-    if (strcmp(cmd, "set_mode") == 0) {
-        const cJSON *mode_item = cJSON_GetObjectItem(root, "mode");
-        if (mode_item && cJSON_IsString(mode_item)) {
-            const char *m = mode_item->valuestring;
-            if (strcmp(m, "active") == 0)
-                debi_os_set_mode(DEBI_MODE_ACTIVE);
-            else if (strcmp(m, "night") == 0)
-                debi_os_set_mode(DEBI_MODE_NIGHT);
-            else if (strcmp(m, "alert") == 0)
-                debi_os_set_mode(DEBI_MODE_ALERT);
-            else if (strcmp(m, "setup") == 0)
-                debi_os_set_mode(DEBI_MODE_SETUP);
-            else {
-                if (cmd_id) send_ack(cmd_id, "error", "unknown mode");
-                return;
-            }
-            if (cmd_id) send_ack(cmd_id, "ok", m);
-        }
-    }
-    /* ---- mute ---- */
-    else if (strcmp(cmd, "mute") == 0) {
-        const cJSON *val = cJSON_GetObjectItem(root, "value");
-        bool mute_on = val ? cJSON_IsTrue(val) : true;
-        debi_voice_set_mute(mute_on);
-        s_comms.config.mute = mute_on;
-        if (cmd_id) send_ack(cmd_id, "ok", mute_on ? "muted" : "unmuted");
-    }
-    /* ---- set_volume ---- */
-    else if (strcmp(cmd, "set_volume") == 0) {
-        const cJSON *val = cJSON_GetObjectItem(root, "value");
-        if (val && cJSON_IsNumber(val)) {
-            int vol = (int)val->valuedouble;
-            debi_voice_set_volume(vol);
-            s_comms.config.volume = vol;
-            if (cmd_id) send_ack(cmd_id, "ok", "volume set");
-        }
-    }
-    /* ---- play_sound ---- */
-    else if (strcmp(cmd, "play_sound") == 0) {
-        const cJSON *path = cJSON_GetObjectItem(root, "file");
-        if (path && cJSON_IsString(path)) {
-            debi_voice_play_file(path->valuestring);
-            if (cmd_id) send_ack(cmd_id, "ok", "playing");
-        }
+    const cmd_def_t *def = cmd_find(cmd);
+    if (!def) {
+        ESP_LOGW(TAG, "unknown cmd: %s", cmd);
+        if (cmd_id) send_ack(cmd_id, "error", "unknown command", false);
+        return;
     }
-    /* ---- stop_sound ---- */
-    else if (strcmp(cmd, "stop_sound") == 0) {
-        debi_voice_stop();
-        if (cmd_id) send_ack(cmd_id, "ok", "stopped");
-    }
-    /* ---- report_sensors ---- */
-    else if (strcmp(cmd, "report_sensors") == 0) {
-        debi_os_report_sensors();
-        if (cmd_id) send_ack(cmd_id, "ok", "reported");
-    }
-    /* ---- ping ---- */
-    else if (strcmp(cmd, "ping") == 0) {
-        /* Send pong with timestamp for hub-side RTT */
-        cJSON *pong = cJSON_CreateObject();
-        if (pong) {
-            cJSON_AddTrueToObject(pong, "pong");
-            cJSON_AddNumberToObject(pong, "ts",
-                                     (double)esp_timer_get_time());
-            if (cmd_id) cJSON_AddStringToObject(pong, "cmd_id", cmd_id);
-            char *json = cJSON_PrintUnformatted(pong);
-            if (json) {
-                debi_comms_publish(DEBI_TOPIC_STATUS, json, 0, false);
-                free(json);
+
+    /* A retry of something that already ran gets the same ack again */
+    int64_t now = esp_timer_get_time();
+    uint64_t id_hash = cmd_id ? cmd_id_hash(cmd_id) : 0;
+    bool once = cmd_id && !(def->flags & CMD_READ_ONLY);
+    if (once) {
+        int i = cmd_seen_find(id_hash);
+        if (i >= 0) {
+            cmd_seen_t *s = &s_cmd_seen[i];
+            s->used_us = now;
+            s_comms.cmd_dup_count++;
+            ESP_LOGW(TAG, "cmd %s (id=%s) already done", cmd, cmd_id);
+            if (s->replied) {
+                send_ack(cmd_id, s->ok ? "ok" : "error", s->detail, true);
             }
-            cJSON_Delete(pong);
+            return;
         }
     }
-    /* ---- get_health ---- */
-    else if (strcmp(cmd, "get_health") == 0) {
-        debi_comms_health_t h = debi_comms_get_health();
-        cJSON *resp = cJSON_CreateObject();
-        if (resp) {
-            cJSON_AddBoolToObject(resp, "connected", h.connected);
-            cJSON_AddNumberToObject(resp, "reconnects", h.reconnect_count);
-            cJSON_AddNumberToObject(resp, "rtt_ms", h.rtt_ms);
-            cJSON_AddNumberToObject(resp, "queued", h.queued_count);
-            cJSON_AddNumberToObject(resp, "heap",
-                                     (double)esp_get_free_heap_size());
-            if (cmd_id) cJSON_AddStringToObject(resp, "cmd_id", cmd_id);
-            char *json = cJSON_PrintUnformatted(resp);
-            if (json) {
-                debi_comms_publish(DEBI_TOPIC_STATUS, json, 0, false);
-                free(json);
-            }
-            cJSON_Delete(resp);
-        }
+
+    cmd_call_t c = { .cmd_id = cmd_id, .seen = -1 };
+    char detail[CMD_DETAIL_MAX];
+    const char *err = cmd_parse_args(def, root, &c, detail, sizeof(detail));
+    if (err) {
+        ESP_LOGW(TAG, "cmd %s: %s", cmd, err);
+        if (cmd_id) send_ack(cmd_id, "error", err, false);
+        return;
     }
-    /* ---- reboot ---- */
-    else if (strcmp(cmd, "reboot") == 0) {
-        if (cmd_id) send_ack(cmd_id, "ok", "rebooting");
-        ESP_LOGW(TAG, "reboot requested by hub");
-        vTaskDelay(pdMS_TO_TICKS(500));  /* Let ack send */
-        esp_restart();
+
+    if (!cmd_take_token(def, now)) {
+        s_comms.cmd_limited_count++;
+        ESP_LOGW(TAG, "cmd %s over its rate limit", cmd);
+        if (cmd_id) send_ack(cmd_id, "error", "rate limited", false);
+        return;
     }
-    /* ---- unknown ---- */
-    else {
-        ESP_LOGW(TAG, "unknown cmd: %s", cmd);
-        if (cmd_id) send_ack(cmd_id, "error", "unknown command");
+
+    if (once) {
+        c.seen = cmd_seen_add(id_hash, now);
+        c.save = def->flags & CMD_SAVE_ID;
     }
+    def->fn(&c);
 }
 
 /* ------------------------------------------------------------------ */
@@ -487,7 +1304,7 @@ static void dispatch_config(const cJSON *root)
         /* Ack the config update */
         const cJSON *id_item = cJSON_GetObjectItem(root, "cmd_id");
         if (id_item && cJSON_IsString(id_item)) {
-            send_ack(id_item->valuestring, "ok", "config applied");
+            send_ack(id_item->valuestring, "ok", "config applied", false);
         }
     }
 }
@@ -516,7 +1333,7 @@ static void apply_config(void)
 /* ------------------------------------------------------------------ */
 
 static void send_ack(const char *cmd_id, const char *status,
-                      const char *detail)
+                      const char *detail, bool dup)
 {
     cJSON *root = cJSON_CreateObject();
     if (!root) return;
@@ -526,6 +1343,9 @@ static void send_ack(const char *cmd_id, const char *status,
     if (detail) {
         cJSON_AddStringToObject(root, "detail", detail);
     }
+    if (dup) {
+        cJSON_AddTrueToObject(root, "dup");   /* a retry: not run again */
+    }
     cJSON_AddNumberToObject(root, "ts", (double)esp_timer_get_time());
 
     char *json = cJSON_PrintUnformatted(root);
@@ -3,9 +3,13 @@
  * @brief Debi Guardian — Communications layer
  *
  * Extends the basic MQTT in debi_os with:
- *   - Outbound message queue (survives brief disconnects)
- *   - Expanded hub command handling (mute, volume, play, reboot, OTA)
- *   - Command acknowledgement protocol (cmd_id echo)
+ *   - Outbound message queue (survives brief disconnects), one byte
+ *     budget per priority so telemetry never pushes out alerts
+ *   - Detection and sensor history kept on flash through long outages
+ *     (debi_spool) and replayed on DEBI_TOPIC_REPLAY/...
+ *   - Expanded hub command handling (mute, volume, play, stream, reboot, OTA)
+ *   - Command acknowledgement protocol (cmd_id echo); a retried cmd_id
+ *     is acked again but not run twice, and each command is rate limited
  *   - Connection health metrics (latency, reconnect count)
  *   - Configuration sync from hub (timeouts, schedules, sensitivity)
  *
@@ -27,6 +31,7 @@
 #ifndef DEBI_COMMS_H
 #define DEBI_COMMS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "mqtt_client.h"
@@ -36,23 +41,55 @@ extern "C" {
 #endif
 
 /* —— Queue config —— */
-#ifndef DEBI_COMMS_QUEUE_SIZE
-#define DEBI_COMMS_QUEUE_SIZE       16     /* Max queued outbound messages */
+/*
+ * Messages published while the hub is away wait in PSRAM, in one ring
+ * per priority.  A full ring drops its oldest message.  On reconnect
+ * the rings drain highest priority first, at most
+ * DEBI_COMMS_FLUSH_BYTES every DEBI_COMMS_FLUSH_INTERVAL_MS.
+ */
+typedef enum {
+    DEBI_COMMS_PRIO_HIGH = 0,      /* status, heartbeat, alerts   */
+    DEBI_COMMS_PRIO_NORMAL,        /* detections, face state      */
+    DEBI_COMMS_PRIO_LOW,           /* sensor telemetry            */
+    DEBI_COMMS_PRIO_COUNT,
+} debi_comms_prio_t;
+
+#ifndef DEBI_COMMS_QUEUE_BYTES_HIGH
+#define DEBI_COMMS_QUEUE_BYTES_HIGH     4096
+#endif
+
+#ifndef DEBI_COMMS_QUEUE_BYTES_NORMAL
+#define DEBI_COMMS_QUEUE_BYTES_NORMAL   16384
+#endif
+
+#ifndef DEBI_COMMS_QUEUE_BYTES_LOW
+#define DEBI_COMMS_QUEUE_BYTES_LOW      8192
 #endif
 
-#ifndef DEBI_COMMS_MSG_MAX_LEN
-#define DEBI_COMMS_MSG_MAX_LEN      512    /* Max payload bytes per message */
+#ifndef DEBI_COMMS_FLUSH_INTERVAL_MS
+#define DEBI_COMMS_FLUSH_INTERVAL_MS    50
+#endif
+
+#ifndef DEBI_COMMS_FLUSH_BYTES
+#define DEBI_COMMS_FLUSH_BYTES          2048   /* per interval, at least one message */
 #endif
 
 /* —— Health thresholds —— */
 #ifndef DEBI_COMMS_PING_INTERVAL_S
-#define DEBI_COMMS_PING_INTERVAL_S  60     /* Ping hub every 60s for latency */
+#define DEBI_COMMS_PING_INTERVAL_S  60     /* Ping hub every 60s for latency and liveness */
 #endif
 
 #ifndef DEBI_COMMS_STALE_TIMEOUT_S
 #define DEBI_COMMS_STALE_TIMEOUT_S  180    /* Hub considered stale after 3 min */
 #endif
 
+/* —— Commands —— */
+#ifndef DEBI_COMMS_CMD_IDS
+#define DEBI_COMMS_CMD_IDS          32     /* cmd_ids remembered for at-most-once commands */
+#endif
+
+#define DEBI_COMMS_CMD_STORAGE      "debi_cmd"   /* NVS key, cmd_id of the last reboot */
+
 /* —— Connection health snapshot —— */
 typedef struct {
     bool     connected;
@@ -60,6 +97,11 @@ typedef struct {
     int64_t  last_msg_time_us;     /* esp_timer_get_time of last rx */
     int      rtt_ms;               /* last measured round-trip (ping/pong) */
     int      queued_count;         /* messages waiting in outbound queue */
+    int      queued_bytes;
+    int      dropped_count;        /* queued messages pushed out by newer ones */
+    int      spooled_count;        /* history on flash waiting for replay */
+    int      cmd_dup_count;        /* retried cmd_ids answered, not run again */
+    int      cmd_limited_count;    /* commands refused by their rate limit */
 } debi_comms_health_t;
 
 /* —— Configuration pushed from hub */ 
@@ -89,7 +131,8 @@ void debi_comms_deinit(void);
 /**
  * @brief Called by debi_os when the MQTT client connects.
  *
- * Flushes the outbound queue and resets health counters.
+ * Starts draining the outbound queue, pings the hub for its round
+ * trip and starts the spool replay.
  *
  * @param client  The esp_mqtt_client handle from debi_os
  */
@@ -116,18 +159,38 @@ void debi_comms_handle_message(const char *topic,
 /**
  * @brief Publish a message to the hub, with queuing.
  *
- * If connected, publishes immediately.
- * If disconnected, queues the message for delivery on reconnect.
+ * If connected and nothing of the same or higher priority is waiting,
+ * publishes immediately.  Otherwise queues the message; the priority
+ * comes from the topic (see debi_comms_topic_prio()).  While
+ * disconnected, detections and sensor readings go to the flash spool
+ * instead, and come back on DEBI_TOPIC_REPLAY/<suffix>.
+ *
+ * Safe to call from any task or esp_timer callback.
  *
  * @param topic    MQTT topic
  * @param payload  JSON payload string
  * @param qos      0, 1, or 2
  * @param retain   true for retained messages
- * @return         0 on success, -1 if queue full
+ * @return         0 on success, -1 if the message is larger than its
+ *                 priority's whole queue
  */
 int debi_comms_publish(const char *topic, const char *payload,
                         int qos, bool retain);
 
+/**
+ * @brief debi_comms_publish() for binary payloads.
+ *
+ * @param data  payload bytes
+ * @param len   payload length, > 0
+ */
+int debi_comms_publish_bin(const char *topic, const void *data, size_t len,
+                           int qos, bool retain);
+
+/**
+ * @brief Queue priority of a topic.
+ */
+debi_comms_prio_t debi_comms_topic_prio(const char *topic);
+
 /**
  * @brief Get current connection health snapshot.
  */
@@ -141,7 +204,8 @@ debi_comms_config_t debi_comms_get_config(void);
 /**
  * @brief Check if the hub connection is considered healthy.
  *
- * Healthy = connected AND last message within STALE_TIMEOUT.
+ * Healthy = connected AND last message within STALE_TIMEOUT.  The
+ * periodic ping's pong counts, so a live but quiet hub stays healthy.
  */
 bool debi_comms_hub_healthy(void);
 
@@ -16,9 +16,12 @@
 
 #include "debi_face_bridge.h"
 #include "debi_camera.h"
+#include "debi_failover.h"
+#include "debi_tracks.h"
 #include "debi_voice.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "esp_log.h"
@@ -31,6 +34,7 @@
 #include "view/ui_face_states.h"
 #include "task_flow_module/tf_module_ai_camera.h"
 #include "task_flow_module/common/tf_module_data_type.h"
+#include "task_flow_module/common/tf_module_util.h"
 
 static const char *TAG = "debi_face_bridge";
 
@@ -38,20 +42,25 @@ static const char *TAG = "debi_face_bridge";
 typedef struct {
     bool             active;              /* bridge is running              */
     bool             overridden;          /* external override in effect    */
+    bool             held;                /* override kept until released   */
     face_state_t     current_state;       /* last state we set              */
     time_t           last_detection_time; /* any object seen                */
     time_t           person_first_seen;   /* start of current person streak */
     bool             person_present;      /* person in view right now       */
+    bool             person_box_valid;
+    sscma_client_box_t person_box;        /* largest person box last time   */
     esp_timer_handle_t timer_handle;      /* periodic check timer           */
 } bridge_state_t;
 
 static bridge_state_t s_bridge = {
     .active            = false,
     .overridden        = false,
+    .held              = false,
     .current_state     = FACE_STATE_IDLE,
     .last_detection_time = 0,
     .person_first_seen = 0,
     .person_present    = false,
+    .person_box_valid  = false,
     .timer_handle      = NULL,
 };
 
@@ -62,6 +71,7 @@ static void on_ai_camera_preview(void *handler_arg, esp_event_base_t base,
 static void on_local_detection(void *handler_arg, esp_event_base_t base,
                                 int32_t id, void *event_data);
 static void timeout_check_cb(void *arg);
+static void process_inference(const struct tf_data_inference_info *info);
 
 /* ────────────────────────────────────────────────────
  *  Public API
@@ -83,6 +93,7 @@ void debi_face_bridge_init(void)
     s_bridge.person_first_seen  = 0;
     s_bridge.person_present     = false;
     s_bridge.overridden         = false;
+    s_bridge.held               = false;
     s_bridge.current_state      = FACE_STATE_IDLE;
 
     /* Register for AI camera preview events (inference results) */
@@ -140,16 +151,41 @@ void debi_face_bridge_deinit(void)
 void debi_face_bridge_override(int state)
 {
     if (state < 0 || state >= FACE_STATE_COUNT) return;
+    if (s_bridge.held) return;
     s_bridge.overridden = true;
     bridge_set_face((face_state_t)state);
     ESP_LOGI(TAG, "override -> %s", ui_face_state_name((face_state_t)state));
 }
 
+void debi_face_bridge_hold(int state)
+{
+    if (state < 0 || state >= FACE_STATE_COUNT) return;
+    s_bridge.held = true;
+    s_bridge.overridden = true;
+    bridge_set_face((face_state_t)state);
+    ESP_LOGW(TAG, "hold -> %s", ui_face_state_name((face_state_t)state));
+}
+
+void debi_face_bridge_release(void)
+{
+    if (!s_bridge.held) return;
+    s_bridge.held = false;
+    s_bridge.overridden = false;
+    bridge_set_face(s_bridge.person_present ? FACE_STATE_PRESENCE : FACE_STATE_IDLE);
+    ESP_LOGI(TAG, "hold released");
+}
+
 bool debi_face_bridge_is_active(void)
 {
     return s_bridge.active && !s_bridge.overridden;
 }
 
+void debi_face_bridge_feed_inference(const struct tf_data_inference_info *info)
+{
+    if (!s_bridge.active) return;
+    process_inference(info);
+}
+
 /* ────────────────────────────────────────────────────
  *  Internal helpers
  * ──────────────────────────────────────────────────── */
@@ -171,6 +207,18 @@ static void bridge_set_face(face_state_t state)
     debi_voice_on_face_change(prev, state);
 }
 
+/**
+ * Movement between two boxes of the same person, per mille of the
+ * box size.  A fall shows up as a large change of y and h.
+ */
+static int box_motion_pm(const sscma_client_box_t *prev, const sscma_client_box_t *cur)
+{
+    int d = abs(cur->x - prev->x) + abs(cur->y - prev->y) +
+            abs(cur->w - prev->w) + abs(cur->h - prev->h);
+    int size = prev->w + prev->h;
+    return size > 0 ? d * 1000 / size : 0;
+}
+
 /**
  * Process inference boxes from AI camera preview.
  *
@@ -195,6 +243,7 @@ static void process_inference(const struct tf_data_inference_info *info)
     bool saw_person = false;
     bool saw_pet    = false;
     time_t now      = time(NULL);
+    const sscma_client_box_t *person_box = NULL;
 
     for (uint32_t i = 0; i < count; i++) {
         if (boxes[i].score < DEBI_BRIDGE_MIN_SCORE) continue;
@@ -212,13 +261,14 @@ static void process_inference(const struct tf_data_inference_info *info)
          * We check class names if available, else use target id.
          */
         uint8_t tid = boxes[i].target;
+        bool is_person = false;
 
         /* Check class name string if available */
         if (tid < CONFIG_MODEL_CLASSES_MAX_NUM &&
             info->classes[tid] != NULL) {
             const char *cls = info->classes[tid];
             if (strcmp(cls, "person") == 0 || strcmp(cls, "human") == 0) {
-                saw_person = true;
+                is_person = true;
             } else if (strcmp(cls, "cat") == 0 || strcmp(cls, "dog") == 0 ||
                        strcmp(cls, "bird") == 0 || strcmp(cls, "pet") == 0) {
                 saw_pet = true;
@@ -226,13 +276,35 @@ static void process_inference(const struct tf_data_inference_info *info)
         } else {
             /* Fallback: target 0 is person on default model */
             if (tid == 0) {
-                saw_person = true;
+                is_person = true;
             } else {
                 saw_pet = true;
             }
         }
+
+        /* The largest person box drives the camera frame rate */
+        if (is_person) {
+            saw_person = true;
+            if (!person_box ||
+                boxes[i].w * boxes[i].h > person_box->w * person_box->h) {
+                person_box = &boxes[i];
+            }
+        }
     }
 
+    int motion_pm = 0;
+    if (person_box) {
+        if (s_bridge.person_box_valid) {
+            motion_pm = box_motion_pm(&s_bridge.person_box, person_box);
+        }
+        s_bridge.person_box = *person_box;
+    }
+    s_bridge.person_box_valid = person_box != NULL;
+    debi_camera_update_activity(saw_person, motion_pm);
+
+    /* A held face stays until debi_face_bridge_release() */
+    if (s_bridge.held) return;
+
     /* Clear override on new inference */
     s_bridge.overridden = false;
 
@@ -256,22 +328,32 @@ static void process_inference(const struct tf_data_inference_info *info)
  * ──────────────────────────────────────────────────── */
 
 /**
- * AI camera preview event — carries inference results from the
- * Himax camera running an object detection model.
+ * AI camera preview event — image and inference results from the
+ * Himax camera running an object detection model.  Drives the face,
+ * tracks the boxes (debi_tracks) and forwards the frame (debi_camera)
+ * under one frame id, on the app event loop task.  The event owns its
+ * share of the image and its inference; the only listener frees them.
  */
 static void on_ai_camera_preview(void *handler_arg, esp_event_base_t base,
                                   int32_t id, void *event_data)
 {
-    if (!s_bridge.active) return;
+    struct tf_module_ai_camera_preview_info *preview = event_data;
 
-    const struct tf_module_ai_camera_preview_info *preview =
-        (const struct tf_module_ai_camera_preview_info *)event_data;
-    if (!preview) return;
+    if (s_bridge.active) {
+        debi_camera_stamp_t stamp;
+        debi_camera_stamp(preview->ts_us, &stamp);
+
+        uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+        process_inference(&preview->inference);
+        debi_tracks_report(&preview->inference, &stamp, ids);
+        debi_failover_observe(&preview->inference, ids, stamp.ts_us);
 
-    process_inference(&preview->inference);
+        /* Forward frame to hub for Coral TPU analysis */
+        debi_camera_forward_frame(preview, &stamp);
+    }
 
-    /* Forward frame to hub for Coral TPU analysis */
-    debi_camera_forward_frame(preview);
+    tf_data_image_free(&preview->img);
+    tf_data_inference_free(&preview->inference);
 }
 
 /**
@@ -288,6 +370,7 @@ static void on_local_detection(void *handler_arg, esp_event_base_t base,
     time_t now = time(NULL);
 
     s_bridge.last_detection_time = now;
+    if (s_bridge.held) return;
     s_bridge.overridden = false;
 
     ESP_LOGI(TAG, "local detection: %lu (%s)",
@@ -327,11 +410,11 @@ static void on_local_detection(void *handler_arg, esp_event_base_t base,
 /**
  * Periodic timer callback — checks for idle and concerned states.
  *
- * Runs every 5 seconds.  If overridden, does nothing.
+ * Runs every 5 seconds.  If overridden or held, does nothing.
  */
 static void timeout_check_cb(void *arg)
 {
-    if (!s_bridge.active || s_bridge.overridden) return;
+    if (!s_bridge.active || s_bridge.overridden || s_bridge.held) return;
 
     time_t now  = time(NULL);
     double idle_elapsed = difftime(now, s_bridge.last_detection_time);
@@ -40,7 +40,8 @@ extern "C" {
  * @brief Initialise the face bridge.
  *
  * Registers event handlers on `app_event_loop_handle` for:
- *   - VIEW_EVENT_AI_CAMERA_PREVIEW  (inference results)
+ *   - VIEW_EVENT_AI_CAMERA_PREVIEW  (image + inference, tracks and
+ *     frame stream to the hub, on the app event loop task)
  *   - VIEW_EVENT_TASK_FLOW_START_BY_LOCAL (local detections)
  * Creates a periodic timer for idle / concerned timeout checks.
  *
@@ -58,15 +59,39 @@ void debi_face_bridge_deinit(void);
  *
  * Useful when other subsystems (voice, alerts) need to override
  * the sensor-driven state temporarily.  The bridge resumes
- * automatic control after the next inference event.
+ * automatic control after the next inference event.  Ignored while
+ * a debi_face_bridge_hold() is in effect.
  */
 void debi_face_bridge_override(int state);
 
+/**
+ * @brief Force a face state that inferences do not clear.
+ *
+ * For alerts raised on the Watcher itself (debi_failover): the face,
+ * and the alarm debi_voice plays for it, stay until
+ * debi_face_bridge_release().
+ */
+void debi_face_bridge_hold(int state);
+
+/**
+ * @brief End a debi_face_bridge_hold() and resume automatic control.
+ * Does nothing if no hold is in effect.
+ */
+void debi_face_bridge_release(void);
+
 /**
  * @brief Check whether the bridge is currently driving the face.
  */
 bool debi_face_bridge_is_active(void);
 
+struct tf_data_inference_info;
+
+/**
+ * @brief Feed an inference result that did not come through the
+ * AI camera preview event (e.g. from the multi-model scheduler).
+ */
+void debi_face_bridge_feed_inference(const struct tf_data_inference_info *info);
+
 #ifdef __cplusplus
 }
 #endif
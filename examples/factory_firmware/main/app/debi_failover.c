@@ -0,0 +1,376 @@
+/**
+ * @file debi_failover.c
+ * @brief Debi Failover — Local-only safety mode while the hub is away
+ *
+ * The hub watch runs in its own task because switching the WE2 models
+ * blocks until the current slice ends.  The fall check runs in the
+ * task that delivers inferences and owns the track slots; the two
+ * only share the local_only flag.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_failover.h"
+#include "debi_comms.h"
+#include "debi_face_bridge.h"
+#include "debi_os.h"
+#include "debi_taskflow.h"
+#include "debi_tracks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "view/ui_face_states.h"
+
+static const char *TAG = "debi_failover";
+
+#define FAILOVER_TASK_STACK     3072
+#define FAILOVER_TASK_PRIO      3
+#define FAILOVER_TICK_MS        1000
+
+/* ── Internal state ── */
+typedef enum {
+    FALL_NONE = 0,
+    FALL_SUSPECT,                  /* went down, waiting for stillness */
+    FALL_ALERT,                    /* stayed down, alert raised */
+} fall_phase_t;
+
+typedef struct {
+    uint16_t     id;               /* ByteTrack id, 0 = free slot */
+    fall_phase_t phase;
+    int64_t      seen_us;
+    int64_t      upright_us;       /* last frame standing, 0 = not yet */
+    int          upright_y;
+    int          upright_h;
+    int64_t      still_us;         /* lying at still_x/y since */
+    int          still_x;
+    int          still_y;
+    int          still_w;
+    int          still_h;
+    int64_t      recover_us;       /* upright since, while alerted */
+    uint8_t      score;
+} fall_track_t;
+
+typedef struct {
+    volatile bool          local_only;
+    TaskHandle_t           task;
+    fall_track_t           tracks[DEBI_FAILOVER_TRACKS];
+    bool                   alarm;          /* our alarm is sounding */
+    debi_mode_t            alarm_prev_mode;
+    debi_failover_stats_t  stats;
+} failover_state_t;
+
+static failover_state_t s_failover;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define STAT_INC(field)                          \
+    do {                                         \
+        portENTER_CRITICAL(&s_stats_mux);        \
+        s_failover.stats.field++;                \
+        portEXIT_CRITICAL(&s_stats_mux);         \
+    } while (0)
+
+/* ────────────────────────────────────────────────────
+ *  Hub watch
+ * ──────────────────────────────────────────────────── */
+
+static void set_local_only(bool on)
+{
+    if (on) {
+        ESP_LOGW(TAG, "hub unhealthy for %d s, local only", DEBI_FAILOVER_ENTER_S);
+    } else {
+        ESP_LOGI(TAG, "hub healthy for %d s, leaving local only", DEBI_FAILOVER_EXIT_S);
+    }
+
+    esp_err_t err = debi_taskflow_set_local_only(on);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "model switch failed: %s", esp_err_to_name(err));
+    }
+
+    s_failover.local_only = on;
+    portENTER_CRITICAL(&s_stats_mux);
+    s_failover.stats.local_only = on;
+    s_failover.stats.failovers += on;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+static void failover_task(void *arg)
+{
+    int unhealthy_s = 0, healthy_s = 0;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(FAILOVER_TICK_MS));
+
+        if (debi_comms_hub_healthy()) {
+            healthy_s++;
+            unhealthy_s = 0;
+        } else {
+            unhealthy_s++;
+            healthy_s = 0;
+        }
+
+        if (!s_failover.local_only && unhealthy_s >= DEBI_FAILOVER_ENTER_S) {
+            set_local_only(true);
+        } else if (s_failover.local_only && healthy_s >= DEBI_FAILOVER_EXIT_S) {
+            set_local_only(false);
+        }
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Fall check
+ * ──────────────────────────────────────────────────── */
+
+static bool box_upright(const sscma_client_box_t *b)
+{
+    return b->h * 100 >= b->w * DEBI_FAILOVER_UPRIGHT_PCT;
+}
+
+static bool box_lying(const sscma_client_box_t *b)
+{
+    return b->h * 100 <= b->w * DEBI_FAILOVER_LYING_PCT;
+}
+
+static fall_track_t *track_slot(uint16_t id, int64_t now_us)
+{
+    fall_track_t *free_slot = NULL, *oldest = NULL;
+
+    for (int i = 0; i < DEBI_FAILOVER_TRACKS; i++) {
+        fall_track_t *t = &s_failover.tracks[i];
+        if (t->id == id) return t;
+        if (t->id == 0) {
+            if (!free_slot) free_slot = t;
+        } else if (t->phase == FALL_NONE &&
+                   (!oldest || t->seen_us < oldest->seen_us)) {
+            oldest = t;
+        }
+    }
+
+    fall_track_t *t = free_slot ? free_slot : oldest;
+    if (!t) {
+        STAT_INC(no_slot);
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    t->seen_us = now_us;
+    return t;
+}
+
+static void start_still(fall_track_t *t, const sscma_client_box_t *b, int64_t now_us)
+{
+    t->still_us = now_us;
+    t->still_x  = b->x;
+    t->still_y  = b->y;
+    t->still_w  = b->w;
+    t->still_h  = b->h;
+}
+
+static void raise_alert(fall_track_t *t)
+{
+    t->phase = FALL_ALERT;
+    t->recover_us = 0;
+    STAT_INC(alerts);
+
+    bool local = s_failover.local_only;
+    ESP_LOGW(TAG, "fall suspected  track=%u  %s", t->id,
+             local ? "sounding alarm" : "reported to hub");
+    debi_os_report_detection("fall_suspect", t->score);
+
+    if (local && !s_failover.alarm) {
+        debi_mode_t mode = debi_os_get_mode();
+        s_failover.alarm = true;
+        s_failover.alarm_prev_mode = mode == DEBI_MODE_ALERT ? DEBI_MODE_ACTIVE : mode;
+        debi_os_set_mode(DEBI_MODE_ALERT);
+        debi_face_bridge_hold(FACE_STATE_ALERT_FALL);
+        STAT_INC(local_alarms);
+    }
+}
+
+static void clear_alert(fall_track_t *t)
+{
+    ESP_LOGI(TAG, "track %u is up again", t->id);
+    t->phase = FALL_NONE;
+    STAT_INC(recovered);
+
+    for (int i = 0; i < DEBI_FAILOVER_TRACKS; i++) {
+        if (s_failover.tracks[i].id && s_failover.tracks[i].phase == FALL_ALERT) return;
+    }
+    if (s_failover.alarm) {
+        s_failover.alarm = false;
+        if (debi_os_get_mode() == DEBI_MODE_ALERT) {
+            debi_os_set_mode(s_failover.alarm_prev_mode);   /* releases the hold */
+        } else {
+            debi_face_bridge_release();
+        }
+    }
+}
+
+/* Upright again: clears the alert once it lasts RECOVER_MS */
+static void note_upright(fall_track_t *t, int64_t now_us)
+{
+    if (!t->recover_us) {
+        t->recover_us = now_us;
+    } else if (now_us - t->recover_us >= DEBI_FAILOVER_RECOVER_MS * 1000LL) {
+        clear_alert(t);
+    }
+}
+
+/* One tracked person box */
+static void observe_box(fall_track_t *t, const sscma_client_box_t *b, int64_t now_us)
+{
+    t->seen_us = now_us;
+
+    switch (t->phase) {
+    case FALL_NONE:
+        if (box_upright(b)) {
+            t->upright_us = now_us;
+            t->upright_y  = b->y;
+            t->upright_h  = b->h;
+        } else if (box_lying(b) && t->upright_us &&
+                   now_us - t->upright_us <= DEBI_FAILOVER_FALL_WINDOW_MS * 1000LL &&
+                   (b->y - t->upright_y) * 100 >= t->upright_h * DEBI_FAILOVER_DROP_PCT) {
+            ESP_LOGI(TAG, "track %u went down", t->id);
+            t->phase = FALL_SUSPECT;
+            t->score = b->score;
+            start_still(t, b, now_us);
+            STAT_INC(suspects);
+        }
+        break;
+
+    case FALL_SUSPECT:
+        if (box_upright(b)) {
+            ESP_LOGI(TAG, "track %u got up", t->id);
+            t->phase = FALL_NONE;
+            t->upright_us = now_us;
+            t->upright_y  = b->y;
+            t->upright_h  = b->h;
+            STAT_INC(cancelled);
+        } else if (abs(b->x - t->still_x) * 100 > t->still_w * DEBI_FAILOVER_STILL_PCT ||
+                   abs(b->y - t->still_y) * 100 > t->still_h * DEBI_FAILOVER_STILL_PCT) {
+            start_still(t, b, now_us);
+        }
+        break;
+
+    case FALL_ALERT:
+        if (box_upright(b)) {
+            note_upright(t, now_us);
+        } else {
+            t->recover_us = 0;
+        }
+        break;
+    }
+}
+
+/* Someone upright where a track went down: the tracker may have given
+ * the person a new id, or another person is with them */
+static void observe_upright_near(const sscma_client_box_t *b, uint16_t id, int64_t now_us)
+{
+    for (int i = 0; i < DEBI_FAILOVER_TRACKS; i++) {
+        fall_track_t *t = &s_failover.tracks[i];
+        if (!t->id || t->id == id || t->phase == FALL_NONE) continue;
+        if (abs(b->x - t->still_x) > t->still_w) continue;
+
+        if (t->phase == FALL_SUSPECT) {
+            ESP_LOGI(TAG, "track %u: someone up at the spot", t->id);
+            t->phase = FALL_NONE;
+            STAT_INC(cancelled);
+        } else {
+            note_upright(t, now_us);
+        }
+    }
+}
+
+/* Timers of every slot, seen this frame or not */
+static void sweep(int64_t now_us)
+{
+    for (int i = 0; i < DEBI_FAILOVER_TRACKS; i++) {
+        fall_track_t *t = &s_failover.tracks[i];
+        if (!t->id) continue;
+
+        switch (t->phase) {
+        case FALL_NONE:
+            if (now_us - t->seen_us > DEBI_FAILOVER_FORGET_MS * 1000LL) {
+                t->id = 0;
+            }
+            break;
+        case FALL_SUSPECT:
+            if (now_us - t->still_us >= DEBI_FAILOVER_STILL_MS * 1000LL) {
+                raise_alert(t);
+            }
+            break;
+        case FALL_ALERT:
+            break;              /* until upright again, seen or not */
+        }
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_failover_init(void)
+{
+    if (s_failover.task) return ESP_OK;
+
+    ESP_RETURN_ON_FALSE(xTaskCreate(failover_task, "debi_failover", FAILOVER_TASK_STACK,
+                                    NULL, FAILOVER_TASK_PRIO, &s_failover.task) == pdPASS,
+                        ESP_ERR_NO_MEM, TAG, "task create failed");
+
+    ESP_LOGI(TAG, "hub watch  enter=%ds exit=%ds  fall h/w %d%%->%d%% in %dms, still %dms",
+             DEBI_FAILOVER_ENTER_S, DEBI_FAILOVER_EXIT_S,
+             DEBI_FAILOVER_UPRIGHT_PCT, DEBI_FAILOVER_LYING_PCT,
+             DEBI_FAILOVER_FALL_WINDOW_MS, DEBI_FAILOVER_STILL_MS);
+    return ESP_OK;
+}
+
+void debi_failover_observe(const struct tf_data_inference_info *info,
+                           const uint16_t *ids, int64_t ts_us)
+{
+    const sscma_client_box_t *boxes = NULL;
+    size_t n = 0;
+    if (info && info->is_valid && info->type == INFERENCE_TYPE_BOX && info->p_data && ids) {
+        boxes = (const sscma_client_box_t *)info->p_data;
+        n = info->cnt < DEBI_TRACKS_MAX_BOXES ? info->cnt : DEBI_TRACKS_MAX_BOXES;
+    }
+
+    /* The hub moved debi_os out of ALERT: our alarm is over */
+    if (s_failover.alarm && debi_os_get_mode() != DEBI_MODE_ALERT) {
+        s_failover.alarm = false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const sscma_client_box_t *b = &boxes[i];
+        /* The person model has one class */
+        if (!ids[i] || b->target != 0 || b->score < DEBI_BRIDGE_MIN_SCORE ||
+            b->w == 0 || b->h == 0) {
+            continue;
+        }
+
+        fall_track_t *t = track_slot(ids[i], ts_us);
+        if (t) {
+            observe_box(t, b, ts_us);
+        }
+        if (box_upright(b)) {
+            observe_upright_near(b, ids[i], ts_us);
+        }
+    }
+
+    sweep(ts_us);
+}
+
+bool debi_failover_local_only(void)
+{
+    return s_failover.local_only;
+}
+
+void debi_failover_get_stats(debi_failover_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_mux);
+    *out = s_failover.stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
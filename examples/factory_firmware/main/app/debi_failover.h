@@ -0,0 +1,132 @@
+/**
+ * @file debi_failover.h
+ * @brief Debi Failover — Local-only safety mode while the hub is away
+ *
+ * Fall and breathing alerts normally come from the hub.  When
+ * debi_comms_hub_healthy() has been false for DEBI_FAILOVER_ENTER_S the
+ * Watcher goes local-only: the WE2 runs the person model alone
+ * (debi_taskflow_set_local_only) and a fall suspected on the tracked
+ * person boxes raises the alarm on the Watcher itself.  The hub being
+ * healthy again for DEBI_FAILOVER_EXIT_S ends it.
+ *
+ * The fall check works on the ByteTrack boxes of debi_tracks, per
+ * track id.  Box height / width is the body's posture:
+ *
+ *   1. suspect  the box goes from upright (h/w >= UPRIGHT_PCT) to lying
+ *               (h/w <= LYING_PCT) within FALL_WINDOW_MS, and its
+ *               centre drops by DROP_PCT of the upright height
+ *   2. alert    its centre then stays within STILL_PCT of the box
+ *               size for STILL_MS; frames without the person count
+ *               as still, larger movement starts the wait again
+ *   3. clear    the person (or anyone standing where they fell) is
+ *               upright again for RECOVER_MS
+ *
+ * Standing up before the alert cancels the suspect.  A slow lie-down,
+ * sitting and bending do not get through step 1.
+ *
+ * Alerts go to the hub as a "fall_suspect" detection in any case
+ * (spooled while it is away).  In local-only mode they also put
+ * debi_os in DEBI_MODE_ALERT and hold the fall face, whose alarm
+ * debi_voice repeats, until the person recovers or the hub sets
+ * another mode.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "task_flow_module/common/tf_module_data_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ── Hub watch (tunable) ── */
+#ifndef DEBI_FAILOVER_ENTER_S
+#define DEBI_FAILOVER_ENTER_S           30     /* hub unhealthy this long -> local only */
+#endif
+
+#ifndef DEBI_FAILOVER_EXIT_S
+#define DEBI_FAILOVER_EXIT_S            10     /* hub healthy this long -> back to normal */
+#endif
+
+/* ── Fall check (tunable) ── */
+#ifndef DEBI_FAILOVER_TRACKS
+#define DEBI_FAILOVER_TRACKS            8      /* people followed at once */
+#endif
+
+#ifndef DEBI_FAILOVER_UPRIGHT_PCT
+#define DEBI_FAILOVER_UPRIGHT_PCT       160    /* box h/w of a standing person */
+#endif
+
+#ifndef DEBI_FAILOVER_LYING_PCT
+#define DEBI_FAILOVER_LYING_PCT         90     /* box h/w of a person on the floor */
+#endif
+
+#ifndef DEBI_FAILOVER_FALL_WINDOW_MS
+#define DEBI_FAILOVER_FALL_WINDOW_MS    800    /* last upright frame -> first lying frame */
+#endif
+
+#ifndef DEBI_FAILOVER_DROP_PCT
+#define DEBI_FAILOVER_DROP_PCT          15     /* centre drop, of the upright height */
+#endif
+
+#ifndef DEBI_FAILOVER_STILL_MS
+#define DEBI_FAILOVER_STILL_MS          5000
+#endif
+
+#ifndef DEBI_FAILOVER_STILL_PCT
+#define DEBI_FAILOVER_STILL_PCT         25     /* centre movement, of the lying box size */
+#endif
+
+#ifndef DEBI_FAILOVER_RECOVER_MS
+#define DEBI_FAILOVER_RECOVER_MS        3000
+#endif
+
+#ifndef DEBI_FAILOVER_FORGET_MS
+#define DEBI_FAILOVER_FORGET_MS         10000  /* unseen track dropped, unless fallen */
+#endif
+
+typedef struct {
+    bool     local_only;
+    uint32_t failovers;            /* times local-only mode was entered */
+    uint32_t suspects;             /* falls waiting for the stillness check */
+    uint32_t cancelled;            /* suspects that got up again */
+    uint32_t alerts;               /* suspects that stayed down */
+    uint32_t local_alarms;         /* alerts sounded on the Watcher */
+    uint32_t recovered;            /* alerted people upright again */
+    uint32_t no_slot;              /* tracks not followed, all slots busy */
+} debi_failover_stats_t;
+
+/**
+ * Start the hub watch task.  Call after debi_comms_init().
+ */
+esp_err_t debi_failover_init(void);
+
+/**
+ * Run the fall check over the boxes of one frame.  Called for every
+ * person-model inference, empty ones included, from one task.
+ *
+ * @param info   inference of the frame; non-box ones count as empty
+ * @param ids    track id of each box from debi_tracks_report(), NULL
+ *               if none (untracked boxes are skipped)
+ * @param ts_us  esp_timer time of the frame
+ */
+void debi_failover_observe(const struct tf_data_inference_info *info,
+                           const uint16_t *ids, int64_t ts_us);
+
+/**
+ * Whether the Watcher is running without its hub.
+ */
+bool debi_failover_local_only(void);
+
+/**
+ * Snapshot failover statistics.
+ */
+void debi_failover_get_stats(debi_failover_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
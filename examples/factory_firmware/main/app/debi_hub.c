@@ -0,0 +1,504 @@
+/**
+ * @file debi_hub.c
+ * @brief Debi Hub — Finding the hub's MQTT broker
+ *
+ * One task runs the connection rounds.  Events from WiFi, MQTT and
+ * provisioning only set notification bits; hub_step() does the work,
+ * including the blocking mDNS lookup and the debi_os restarts.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_hub.h"
+#include "debi_os.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mdns.h"
+#include "storage.h"
+
+static const char *TAG = "debi_hub";
+
+#define HUB_TASK_STACK          4096
+#define HUB_TASK_PRIO           4
+#define HUB_SAVED_VERSION       1
+#define HUB_HOSTNAME            "debi-watcher"
+
+#define HUB_CANDIDATES          (DEBI_HUB_MDNS_RESULTS + 1 + DEBI_HUB_ENDPOINTS + 1)
+
+/* Task notification bits */
+#define EV_NET                  (1u << 0)
+#define EV_CONNECTED            (1u << 1)
+#define EV_DISCONNECTED         (1u << 2)
+#define EV_CONFIG               (1u << 3)
+
+/* ── Internal state ── */
+
+/* NVS record */
+typedef struct {
+    uint8_t           version;
+    debi_hub_config_t cfg;
+    char              last_good[DEBI_HUB_URI_MAX];
+} hub_saved_t;
+
+typedef struct {
+    char              uri[DEBI_HUB_URI_MAX];
+    debi_hub_source_t source;
+} hub_cand_t;
+
+typedef enum {
+    HUB_IDLE = 0,                  /* no network */
+    HUB_TRYING,                    /* waiting for one candidate */
+    HUB_CONNECTED,
+    HUB_WAITING,                   /* backing off before the next round */
+} hub_phase_t;
+
+typedef struct {
+    SemaphoreHandle_t   lock;      /* saved, current, status */
+    TaskHandle_t        task;
+    volatile bool       net_up;
+    bool                mdns_ok;
+    hub_saved_t         saved;
+    debi_hub_endpoint_t current;
+    debi_hub_status_t   status;
+
+    /* debi_hub task only */
+    hub_phase_t         phase;
+    hub_cand_t          cands[HUB_CANDIDATES];
+    int                 n_cands;
+    int                 next;      /* next candidate of the round */
+    int64_t             deadline_us;
+    uint32_t            backoff_ms;
+} hub_state_t;
+
+static hub_state_t s_hub;
+
+/* ────────────────────────────────────────────────────
+ *  Helpers
+ * ──────────────────────────────────────────────────── */
+
+static bool uri_valid(const char *uri)
+{
+    if (strncmp(uri, "mqtt://", 7) != 0 && strncmp(uri, "mqtts://", 8) != 0) {
+        return false;
+    }
+    return strchr(uri, ' ') == NULL && strlen(uri) > 8;
+}
+
+static void saved_defaults(hub_saved_t *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->version  = HUB_SAVED_VERSION;
+    s->cfg.mdns = true;
+    strlcpy(s->cfg.user, DEBI_HUB_MQTT_USER, sizeof(s->cfg.user));
+    strlcpy(s->cfg.pass, DEBI_HUB_MQTT_PASS, sizeof(s->cfg.pass));
+}
+
+static void saved_load(void)
+{
+    size_t len = sizeof(s_hub.saved);
+    if (storage_read(DEBI_HUB_STORAGE, &s_hub.saved, &len) != ESP_OK ||
+        len != sizeof(s_hub.saved) || s_hub.saved.version != HUB_SAVED_VERSION) {
+        saved_defaults(&s_hub.saved);
+        return;
+    }
+
+    /* Strings and the flag come from flash: make sure they are sane */
+    debi_hub_config_t *c = &s_hub.saved.cfg;
+    uint8_t mdns;
+    memcpy(&mdns, &c->mdns, 1);
+    c->mdns = mdns != 0;
+    for (int i = 0; i < DEBI_HUB_ENDPOINTS; i++) {
+        c->uris[i][DEBI_HUB_URI_MAX - 1] = '\0';
+        if (!uri_valid(c->uris[i])) c->uris[i][0] = '\0';
+    }
+    c->user[DEBI_HUB_CRED_MAX - 1] = '\0';
+    c->pass[DEBI_HUB_CRED_MAX - 1] = '\0';
+    c->hub_id[DEBI_HUB_ID_MAX - 1] = '\0';
+    s_hub.saved.last_good[DEBI_HUB_URI_MAX - 1] = '\0';
+    if (!uri_valid(s_hub.saved.last_good)) s_hub.saved.last_good[0] = '\0';
+}
+
+/* Caller holds the lock */
+static esp_err_t saved_store(void)
+{
+    esp_err_t err = storage_write(DEBI_HUB_STORAGE, &s_hub.saved, sizeof(s_hub.saved));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "save failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void add_cand(const char *uri, debi_hub_source_t src)
+{
+    if (!uri[0] || s_hub.n_cands >= HUB_CANDIDATES) return;
+    for (int i = 0; i < s_hub.n_cands; i++) {
+        if (strcmp(s_hub.cands[i].uri, uri) == 0) return;
+    }
+    strlcpy(s_hub.cands[s_hub.n_cands].uri, uri, DEBI_HUB_URI_MAX);
+    s_hub.cands[s_hub.n_cands].source = src;
+    s_hub.n_cands++;
+}
+
+static const char *txt_value(const mdns_result_t *r, const char *key)
+{
+    for (size_t i = 0; i < r->txt_count; i++) {
+        if (r->txt[i].key && strcmp(r->txt[i].key, key) == 0) {
+            return r->txt[i].value ? r->txt[i].value : "";
+        }
+    }
+    return NULL;
+}
+
+/* Hubs answering for _debi-hub._tcp, as mqtt[s]://a.b.c.d:port */
+static int mdns_lookup(const char *hub_id)
+{
+    mdns_result_t *results = NULL;
+    esp_err_t err = mdns_query_ptr(DEBI_HUB_MDNS_SERVICE, DEBI_HUB_MDNS_PROTO,
+                                   DEBI_HUB_MDNS_TIMEOUT_MS, DEBI_HUB_MDNS_RESULTS,
+                                   &results);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "mDNS lookup failed: %s", esp_err_to_name(err));
+        return 0;
+    }
+
+    int found = 0;
+    for (const mdns_result_t *r = results; r; r = r->next) {
+        const char *id = txt_value(r, "id");
+        if (hub_id[0] && (!id || strcmp(id, hub_id) != 0)) {
+            ESP_LOGI(TAG, "mDNS: skipping hub '%s'", id ? id : "?");
+            continue;
+        }
+
+        esp_ip4_addr_t ip = { 0 };
+        for (const mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+            if (a->addr.type == ESP_IPADDR_TYPE_V4) {
+                ip = a->addr.u_addr.ip4;
+                break;
+            }
+        }
+        if (!ip.addr && r->hostname) {
+            mdns_query_a(r->hostname, DEBI_HUB_MDNS_TIMEOUT_MS / 2, &ip);
+        }
+        if (!ip.addr || !r->port) continue;
+
+        const char *scheme = txt_value(r, "scheme");
+        char uri[DEBI_HUB_URI_MAX];
+        snprintf(uri, sizeof(uri), "%s://" IPSTR ":%u",
+                 scheme && strcmp(scheme, "mqtts") == 0 ? "mqtts" : "mqtt",
+                 IP2STR(&ip), r->port);
+        add_cand(uri, DEBI_HUB_SRC_MDNS);
+        found++;
+    }
+    mdns_query_results_free(results);
+
+    ESP_LOGI(TAG, "mDNS: %d hub(s)", found);
+    return found;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Connection rounds
+ * ──────────────────────────────────────────────────── */
+
+static void try_next(int64_t now_us);
+
+/* Returns the time after the mDNS lookup, which blocks for a while */
+static int64_t begin_round(void)
+{
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    debi_hub_config_t cfg = s_hub.saved.cfg;
+    char last_good[DEBI_HUB_URI_MAX];
+    strlcpy(last_good, s_hub.saved.last_good, sizeof(last_good));
+    xSemaphoreGive(s_hub.lock);
+
+    s_hub.n_cands = 0;
+    s_hub.next = 0;
+    int found = 0;
+    if (cfg.mdns && s_hub.mdns_ok) {
+        found = mdns_lookup(cfg.hub_id);
+    }
+    add_cand(last_good, DEBI_HUB_SRC_LAST);
+    for (int i = 0; i < DEBI_HUB_ENDPOINTS; i++) {
+        add_cand(cfg.uris[i], DEBI_HUB_SRC_SAVED);
+    }
+    add_cand(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    s_hub.status.mdns_found = found;
+    xSemaphoreGive(s_hub.lock);
+
+    int64_t now_us = esp_timer_get_time();
+    try_next(now_us);
+    return now_us;
+}
+
+static void try_next(int64_t now_us)
+{
+    if (s_hub.next >= s_hub.n_cands) {
+        /* Round over: close the last try and back off */
+        debi_os_mqtt_stop();
+        s_hub.backoff_ms = s_hub.backoff_ms ? s_hub.backoff_ms * 2 : DEBI_HUB_BACKOFF_MIN_MS;
+        if (s_hub.backoff_ms > DEBI_HUB_BACKOFF_MAX_MS) {
+            s_hub.backoff_ms = DEBI_HUB_BACKOFF_MAX_MS;
+        }
+        s_hub.phase = HUB_WAITING;
+        s_hub.deadline_us = now_us + s_hub.backoff_ms * 1000LL;
+
+        xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+        s_hub.status.rounds_failed++;
+        s_hub.status.backoff_ms = s_hub.backoff_ms;
+        xSemaphoreGive(s_hub.lock);
+        ESP_LOGW(TAG, "no hub reachable, next round in %lu ms", (unsigned long)s_hub.backoff_ms);
+        return;
+    }
+
+    const hub_cand_t *c = &s_hub.cands[s_hub.next++];
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    strlcpy(s_hub.current.uri, c->uri, sizeof(s_hub.current.uri));
+    strlcpy(s_hub.current.user, s_hub.saved.cfg.user, sizeof(s_hub.current.user));
+    strlcpy(s_hub.current.pass, s_hub.saved.cfg.pass, sizeof(s_hub.current.pass));
+    s_hub.current.source = c->source;
+    strlcpy(s_hub.status.uri, c->uri, sizeof(s_hub.status.uri));
+    s_hub.status.source = c->source;
+    s_hub.status.attempts++;
+    xSemaphoreGive(s_hub.lock);
+
+    ESP_LOGI(TAG, "trying %s (%s)", c->uri, debi_hub_source_name(c->source));
+    s_hub.phase = HUB_TRYING;
+    s_hub.deadline_us = now_us + DEBI_HUB_CONNECT_TIMEOUT_MS * 1000LL;
+    debi_os_mqtt_restart();
+}
+
+static void on_connected(void)
+{
+    s_hub.phase = HUB_CONNECTED;
+    s_hub.backoff_ms = 0;
+
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    /* Remember it for the next boot; flash only when it changed */
+    if (strcmp(s_hub.saved.last_good, s_hub.current.uri) != 0) {
+        strlcpy(s_hub.saved.last_good, s_hub.current.uri, sizeof(s_hub.saved.last_good));
+        saved_store();
+    }
+    xSemaphoreGive(s_hub.lock);
+
+    ESP_LOGI(TAG, "connected to %s (%s)", s_hub.current.uri,
+             debi_hub_source_name(s_hub.current.source));
+}
+
+/*
+ * Apply events and timeouts.  Returns how long to sleep before the
+ * next call without events, portMAX_DELAY for no timeout.
+ *
+ * Notifications are merged, so the order of bits is lost: the network
+ * state is read from s_hub.net_up, and debi_os ignores events from a
+ * client it already closed, so both MQTT bits while trying mean the
+ * candidate connected and then dropped.
+ */
+static TickType_t hub_step(uint32_t ev, int64_t now_us)
+{
+    bool lost = false;
+
+    if (!s_hub.net_up) {
+        if (s_hub.phase != HUB_IDLE) {
+            debi_os_mqtt_stop();
+            s_hub.phase = HUB_IDLE;
+        }
+    } else if (s_hub.phase == HUB_IDLE || (ev & EV_CONFIG)) {
+        /* New network or new settings: start over, from the top */
+        s_hub.backoff_ms = 0;
+        now_us = begin_round();
+        ev &= ~(EV_CONNECTED | EV_DISCONNECTED);    /* about the old client */
+    }
+
+    if (s_hub.phase == HUB_TRYING && (ev & EV_CONNECTED)) {
+        on_connected();
+        lost = ev & EV_DISCONNECTED;
+    } else if (s_hub.phase == HUB_TRYING && (ev & EV_DISCONNECTED)) {
+        try_next(now_us);             /* refused: no need to sit out the timeout */
+    } else if (s_hub.phase == HUB_CONNECTED && (ev & EV_DISCONNECTED)) {
+        lost = true;
+    }
+
+    if (lost) {
+        ESP_LOGW(TAG, "lost %s", s_hub.current.uri);
+        s_hub.phase = HUB_WAITING;
+        s_hub.backoff_ms = DEBI_HUB_BACKOFF_MIN_MS;
+        s_hub.deadline_us = now_us + s_hub.backoff_ms * 1000LL;
+    }
+
+    /* Timeouts */
+    if (s_hub.phase == HUB_TRYING && now_us >= s_hub.deadline_us) {
+        ESP_LOGW(TAG, "%s: no answer", s_hub.current.uri);
+        try_next(now_us);
+    } else if (s_hub.phase == HUB_WAITING && now_us >= s_hub.deadline_us) {
+        now_us = begin_round();
+    }
+
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    s_hub.status.connected = s_hub.phase == HUB_CONNECTED;
+    if (s_hub.phase != HUB_WAITING) {
+        s_hub.status.backoff_ms = 0;
+    }
+    xSemaphoreGive(s_hub.lock);
+
+    if (s_hub.phase != HUB_TRYING && s_hub.phase != HUB_WAITING) {
+        return portMAX_DELAY;
+    }
+    int64_t wait_ms = (s_hub.deadline_us - now_us + 999) / 1000;
+    return pdMS_TO_TICKS(wait_ms > 0 ? wait_ms : 0);
+}
+
+static void hub_task(void *arg)
+{
+    TickType_t wait = 0;           /* WiFi may already be up */
+    for (;;) {
+        uint32_t ev = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &ev, wait);
+        wait = hub_step(ev, esp_timer_get_time());
+    }
+}
+
+static void notify(uint32_t ev)
+{
+    if (s_hub.task) {
+        xTaskNotify(s_hub.task, ev, eSetBits);
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_hub_init(void)
+{
+    if (s_hub.task) return ESP_OK;
+
+    s_hub.lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(s_hub.lock, ESP_ERR_NO_MEM, TAG, "no mem");
+    saved_load();
+
+    /* Until the first round picks one */
+    strlcpy(s_hub.current.uri, DEBI_HUB_MQTT_URI, sizeof(s_hub.current.uri));
+    strlcpy(s_hub.current.user, s_hub.saved.cfg.user, sizeof(s_hub.current.user));
+    strlcpy(s_hub.current.pass, s_hub.saved.cfg.pass, sizeof(s_hub.current.pass));
+    s_hub.current.source = DEBI_HUB_SRC_DEFAULT;
+
+    s_hub.mdns_ok = mdns_init() == ESP_OK && mdns_hostname_set(HUB_HOSTNAME) == ESP_OK;
+    if (!s_hub.mdns_ok) {
+        ESP_LOGW(TAG, "mDNS unavailable, saved endpoints only");
+    }
+
+    ESP_RETURN_ON_FALSE(xTaskCreate(hub_task, "debi_hub", HUB_TASK_STACK, NULL,
+                                    HUB_TASK_PRIO, &s_hub.task) == pdPASS,
+                        ESP_ERR_NO_MEM, TAG, "task create failed");
+
+    ESP_LOGI(TAG, "ready  mdns=%d  saved=%s%s  last=%s",
+             s_hub.saved.cfg.mdns && s_hub.mdns_ok,
+             s_hub.saved.cfg.uris[0][0] ? s_hub.saved.cfg.uris[0] : "-",
+             s_hub.saved.cfg.uris[1][0] ? " ..." : "",
+             s_hub.saved.last_good[0] ? s_hub.saved.last_good : "-");
+    return ESP_OK;
+}
+
+void debi_hub_network(bool up)
+{
+    s_hub.net_up = up;
+    notify(EV_NET);
+}
+
+void debi_hub_on_connected(void)
+{
+    notify(EV_CONNECTED);
+}
+
+void debi_hub_on_disconnected(void)
+{
+    notify(EV_DISCONNECTED);
+}
+
+void debi_hub_current(debi_hub_endpoint_t *out)
+{
+    if (!s_hub.lock) {
+        memset(out, 0, sizeof(*out));
+        strlcpy(out->uri, DEBI_HUB_MQTT_URI, sizeof(out->uri));
+        strlcpy(out->user, DEBI_HUB_MQTT_USER, sizeof(out->user));
+        strlcpy(out->pass, DEBI_HUB_MQTT_PASS, sizeof(out->pass));
+        out->source = DEBI_HUB_SRC_DEFAULT;
+        return;
+    }
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    *out = s_hub.current;
+    xSemaphoreGive(s_hub.lock);
+}
+
+esp_err_t debi_hub_set_config(const debi_hub_config_t *cfg)
+{
+    ESP_RETURN_ON_FALSE(cfg && s_hub.lock, ESP_ERR_INVALID_STATE, TAG, "not ready");
+
+    debi_hub_config_t c = *cfg;
+    for (int i = 0; i < DEBI_HUB_ENDPOINTS; i++) {
+        c.uris[i][DEBI_HUB_URI_MAX - 1] = '\0';
+        ESP_RETURN_ON_FALSE(!c.uris[i][0] || uri_valid(c.uris[i]), ESP_ERR_INVALID_ARG,
+                            TAG, "bad uri: %s", c.uris[i]);
+    }
+    c.user[DEBI_HUB_CRED_MAX - 1] = '\0';
+    c.pass[DEBI_HUB_CRED_MAX - 1] = '\0';
+    c.hub_id[DEBI_HUB_ID_MAX - 1] = '\0';
+
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    if (!c.pass[0]) {
+        strlcpy(c.pass, s_hub.saved.cfg.pass, sizeof(c.pass));
+    }
+    s_hub.saved.cfg = c;
+    s_hub.saved.last_good[0] = '\0';   /* may be a hub we were just told to leave */
+    esp_err_t err = saved_store();
+    xSemaphoreGive(s_hub.lock);
+
+    ESP_LOGI(TAG, "new config  mdns=%d id='%s' first=%s", c.mdns, c.hub_id,
+             c.uris[0][0] ? c.uris[0] : "-");
+    notify(EV_CONFIG);
+    return err;
+}
+
+void debi_hub_get_config(debi_hub_config_t *out)
+{
+    if (!s_hub.lock) {
+        hub_saved_t d;
+        saved_defaults(&d);
+        *out = d.cfg;
+        return;
+    }
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    *out = s_hub.saved.cfg;
+    xSemaphoreGive(s_hub.lock);
+}
+
+void debi_hub_get_status(debi_hub_status_t *out)
+{
+    if (!s_hub.lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_hub.lock, portMAX_DELAY);
+    *out = s_hub.status;
+    xSemaphoreGive(s_hub.lock);
+}
+
+const char *debi_hub_source_name(debi_hub_source_t src)
+{
+    switch (src) {
+        case DEBI_HUB_SRC_MDNS:    return "mdns";
+        case DEBI_HUB_SRC_LAST:    return "last";
+        case DEBI_HUB_SRC_SAVED:   return "saved";
+        case DEBI_HUB_SRC_DEFAULT: return "default";
+        default:                   return "none";
+    }
+}
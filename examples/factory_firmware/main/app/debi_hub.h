@@ -0,0 +1,156 @@
+/**
+ * @file debi_hub.h
+ * @brief Debi Hub — Finding the hub's MQTT broker
+ *
+ * Picks the broker debi_os connects to, so a new deployment or a DHCP
+ * change needs no reflash.  Every connection round tries, in order:
+ *
+ *   1. hubs answering mDNS for _debi-hub._tcp (SRV port, A record);
+ *      with a hub id configured, only the one whose TXT "id" matches
+ *   2. the endpoint that last connected
+ *   3. the endpoints saved by provisioning, in their order
+ *   4. DEBI_HUB_MQTT_URI, the build-time default
+ *
+ * Each candidate gets DEBI_HUB_CONNECT_TIMEOUT_MS.  When a whole round
+ * fails the next one waits DEBI_HUB_BACKOFF_MIN_MS, doubling up to
+ * DEBI_HUB_BACKOFF_MAX_MS; a lost connection starts over from 1.
+ *
+ * Endpoints, credentials and the hub id are kept in NVS through
+ * util/storage and set over the AT/BLE path ("debihub=" / "debihub?",
+ * see at_cmd.c).  A hub advertises itself with an avahi service file
+ * such as tools/debi-hub.service.
+ *
+ * debi_os reports WiFi and MQTT state here and opens the broker from
+ * debi_hub_current(); the debi_hub task calls debi_os_mqtt_restart()
+ * and debi_os_mqtt_stop() and is the only caller of either.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEBI_HUB_STORAGE                "debi_hub"   /* NVS key */
+#define DEBI_HUB_MDNS_SERVICE           "_debi-hub"
+#define DEBI_HUB_MDNS_PROTO             "_tcp"
+
+/* ── Sizes ── */
+#ifndef DEBI_HUB_ENDPOINTS
+#define DEBI_HUB_ENDPOINTS              4      /* saved fallback endpoints */
+#endif
+
+#ifndef DEBI_HUB_MDNS_RESULTS
+#define DEBI_HUB_MDNS_RESULTS           4      /* hubs taken from one lookup */
+#endif
+
+#define DEBI_HUB_URI_MAX                96
+#define DEBI_HUB_CRED_MAX               64
+#define DEBI_HUB_ID_MAX                 32
+
+/* ── Timing (tunable) ── */
+#ifndef DEBI_HUB_MDNS_TIMEOUT_MS
+#define DEBI_HUB_MDNS_TIMEOUT_MS        2000   /* one lookup per round */
+#endif
+
+#ifndef DEBI_HUB_CONNECT_TIMEOUT_MS
+#define DEBI_HUB_CONNECT_TIMEOUT_MS     10000  /* per candidate */
+#endif
+
+#ifndef DEBI_HUB_BACKOFF_MIN_MS
+#define DEBI_HUB_BACKOFF_MIN_MS         1000
+#endif
+
+#ifndef DEBI_HUB_BACKOFF_MAX_MS
+#define DEBI_HUB_BACKOFF_MAX_MS         60000
+#endif
+
+typedef enum {
+    DEBI_HUB_SRC_NONE = 0,
+    DEBI_HUB_SRC_MDNS,
+    DEBI_HUB_SRC_LAST,             /* last endpoint that connected */
+    DEBI_HUB_SRC_SAVED,
+    DEBI_HUB_SRC_DEFAULT,
+} debi_hub_source_t;
+
+/* What provisioning sets; empty strings are unused entries */
+typedef struct {
+    char uris[DEBI_HUB_ENDPOINTS][DEBI_HUB_URI_MAX];   /* "mqtt://host:port" */
+    char user[DEBI_HUB_CRED_MAX];
+    char pass[DEBI_HUB_CRED_MAX];
+    char hub_id[DEBI_HUB_ID_MAX];  /* only this hub from mDNS, "" = any */
+    bool mdns;                     /* look the hub up with mDNS */
+} debi_hub_config_t;
+
+typedef struct {
+    char              uri[DEBI_HUB_URI_MAX];
+    char              user[DEBI_HUB_CRED_MAX];
+    char              pass[DEBI_HUB_CRED_MAX];
+    debi_hub_source_t source;
+} debi_hub_endpoint_t;
+
+typedef struct {
+    bool              connected;
+    char              uri[DEBI_HUB_URI_MAX];   /* current or last tried */
+    debi_hub_source_t source;
+    uint32_t          attempts;                /* connects tried since boot */
+    uint32_t          rounds_failed;
+    uint32_t          mdns_found;              /* hubs from the last lookup */
+    uint32_t          backoff_ms;              /* before the next round, 0 = none */
+} debi_hub_status_t;
+
+/**
+ * Load the saved configuration and start the discovery task.
+ * Call after storage_init() and app_wifi_init() (mDNS needs the netif).
+ */
+esp_err_t debi_hub_init(void);
+
+/**
+ * WiFi has an IP (true) or lost it (false).
+ */
+void debi_hub_network(bool up);
+
+/**
+ * MQTT state of the broker debi_os opened; called from the MQTT event
+ * handler.
+ */
+void debi_hub_on_connected(void);
+void debi_hub_on_disconnected(void);
+
+/**
+ * Endpoint to open now.  Falls back to the build-time default before
+ * the task has picked one.
+ */
+void debi_hub_current(debi_hub_endpoint_t *out);
+
+/**
+ * Save a new configuration and reconnect with it.  An empty pass
+ * keeps the saved password.
+ *
+ * @return ESP_ERR_INVALID_ARG for a URI that is not mqtt:// or mqtts://
+ */
+esp_err_t debi_hub_set_config(const debi_hub_config_t *cfg);
+
+/**
+ * Saved configuration, password included.
+ */
+void debi_hub_get_config(debi_hub_config_t *out);
+
+/**
+ * Snapshot of the connection state.
+ */
+void debi_hub_get_status(debi_hub_status_t *out);
+
+/**
+ * Name of an endpoint source, for logs and status messages.
+ */
+const char *debi_hub_source_name(debi_hub_source_t src);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file debi_json.c
+ * @brief Debi JSON — allocation-free writer for hot telemetry
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_json.h"
+
+#include <string.h>
+
+/* ---- Helpers ---- */
+
+static void put(debi_json_t *w, char c)
+{
+    if (w->full) return;
+    if (w->len + 1 >= w->cap) {         /* keep room for the NUL */
+        w->full = true;
+        return;
+    }
+    w->buf[w->len++] = c;
+}
+
+/* Decimal digits of `u`, at least `min_digits` of them. */
+static void put_digits(debi_json_t *w, uint64_t u, int min_digits)
+{
+    char tmp[20];
+    int  n = 0;
+
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u || n < min_digits);
+
+    while (n) put(w, tmp[--n]);
+}
+
+/* ---- Public API ---- */
+
+void debi_json_init(debi_json_t *w, char *buf, size_t cap)
+{
+    w->buf  = buf;
+    w->cap  = cap;
+    w->len  = 0;
+    w->full = (buf == NULL || cap == 0);
+}
+
+void debi_json_raw(debi_json_t *w, const char *s, size_t n)
+{
+    if (w->full) return;
+    if (w->len + n >= w->cap) {
+        w->full = true;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+void debi_json_str(debi_json_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    put(w, '"');
+    for (const unsigned char *p = (const unsigned char *)(s ? s : ""); *p; p++) {
+        switch (*p) {
+        case '"':  DEBI_JSON_LIT(w, "\\\""); break;
+        case '\\': DEBI_JSON_LIT(w, "\\\\"); break;
+        case '\b': DEBI_JSON_LIT(w, "\\b");  break;
+        case '\f': DEBI_JSON_LIT(w, "\\f");  break;
+        case '\n': DEBI_JSON_LIT(w, "\\n");  break;
+        case '\r': DEBI_JSON_LIT(w, "\\r");  break;
+        case '\t': DEBI_JSON_LIT(w, "\\t");  break;
+        default:
+            if (*p < 32) {              /* cJSON: \u00XX, lower-case hex */
+                DEBI_JSON_LIT(w, "\\u00");
+                put(w, hex[*p >> 4]);
+                put(w, hex[*p & 0x0f]);
+            } else {
+                put(w, (char)*p);       /* UTF-8 passes through */
+            }
+            break;
+        }
+    }
+    put(w, '"');
+}
+
+void debi_json_int(debi_json_t *w, int64_t v)
+{
+    uint64_t u = (uint64_t)v;
+
+    if (v < 0) {
+        put(w, '-');
+        u = 0 - u;
+    }
+    put_digits(w, u, 1);
+}
+
+void debi_json_centi(debi_json_t *w, int64_t v)
+{
+    uint64_t u = (uint64_t)v;
+
+    if (v < 0) {
+        put(w, '-');
+        u = 0 - u;
+    }
+    put_digits(w, u / 100, 1);
+
+    /* %1.15g drops trailing zeros, and the point with them */
+    unsigned frac = (unsigned)(u % 100);
+    if (frac == 0) return;
+    put(w, '.');
+    if (frac % 10 == 0) {
+        put(w, (char)('0' + frac / 10));
+    } else {
+        put_digits(w, frac, 2);
+    }
+}
+
+const char *debi_json_finish(debi_json_t *w, size_t *len)
+{
+    if (w->full) return NULL;
+    w->buf[w->len] = '\0';
+    if (len) *len = w->len;
+    return w->buf;
+}
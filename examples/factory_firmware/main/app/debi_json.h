@@ -0,0 +1,65 @@
+/**
+ * @file debi_json.h
+ * @brief Debi JSON — allocation-free writer for hot telemetry
+ *
+ * Appends JSON text into a caller-owned buffer, so periodic messages
+ * (heartbeat, status, sensors, detections) go out without building a
+ * cJSON tree.  Output is byte-for-byte what cJSON_PrintUnformatted
+ * gives for the same fields:
+ *   - strings escape the same characters cJSON does
+ *   - integers print as cJSON prints an integral number (exact while
+ *     |v| < 1e15)
+ *   - debi_json_centi() prints v / 100.0 the way cJSON prints it
+ *
+ * Keys and punctuation are written as string literals with
+ * DEBI_JSON_LIT, so a message template is a fixed sequence of appends.
+ * Once the buffer is full the writer stops and debi_json_finish()
+ * returns NULL.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char   *buf;
+    size_t  cap;
+    size_t  len;
+    bool    full;
+} debi_json_t;
+
+/** Append a string literal (length known at compile time). */
+#define DEBI_JSON_LIT(w, lit)   debi_json_raw((w), (lit), sizeof(lit) - 1)
+
+void debi_json_init(debi_json_t *w, char *buf, size_t cap);
+
+/** Append `n` bytes verbatim. */
+void debi_json_raw(debi_json_t *w, const char *s, size_t n);
+
+/** Append a quoted, escaped string ("" for NULL). */
+void debi_json_str(debi_json_t *w, const char *s);
+
+/** Append an integer. */
+void debi_json_int(debi_json_t *w, int64_t v);
+
+/** Append v / 100 as a decimal, e.g. 2345 -> 23.45, 2340 -> 23.4. */
+void debi_json_centi(debi_json_t *w, int64_t v);
+
+/**
+ * NUL-terminate the output.
+ *
+ * @param len  output length without the NUL (may be NULL)
+ * @return the buffer, or NULL if the message did not fit
+ */
+const char *debi_json_finish(debi_json_t *w, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,395 @@
+/**
+ * @file debi_models.c
+ * @brief Debi Models — Multi-model scheduling on the WiseEye2
+ *
+ * One scheduler task owns the WE2 while running.  Each round it walks
+ * the model table, switches the WE2 to the next model only when it is
+ * not already loaded, runs that model's share of inferences with a
+ * single AT+INVOKE=<n> and waits for the n events, then paces the
+ * round out to its nominal length so the requested rates hold.
+ *
+ * Results arrive on the SSCMA monitor task; they are copied into a
+ * per-model cache and handed to the result callback there.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_models.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "sensecap-watcher.h"
+#include "sscma_client_ops.h"
+#include "sscma_client_commands.h"
+
+static const char *TAG = "debi_models";
+
+#define MODELS_TASK_STACK   4096
+#define MODELS_TASK_PRIO    5
+#define MODEL_NONE          (-1)
+
+/* ── Internal state ── */
+typedef struct {
+    debi_model_cfg_t    cfg;
+    char               *classes[SSCMA_CLIENT_MODEL_MAX_CLASSES];
+    bool                classes_loaded;
+    debi_model_result_t result;          /* latest result, guarded by lock */
+} model_slot_t;
+
+typedef struct {
+    model_slot_t          slots[DEBI_MODELS_MAX];
+    int                   count;
+    sscma_client_handle_t client;
+    TaskHandle_t          task;
+    SemaphoreHandle_t     lock;
+    SemaphoreHandle_t     done;
+    volatile bool         running;
+    volatile bool         stop_req;
+    volatile int          active_slot;   /* slot whose results are expected */
+    volatile int          loaded_model;  /* model id currently on the WE2   */
+    debi_models_stats_t   stats;
+    debi_models_result_cb_t cb;
+    void                 *cb_ctx;
+    sscma_client_callback_t prev_callback; /* handed back on stop */
+    void                 *prev_ctx;
+} models_state_t;
+
+static models_state_t s_models = {
+    .active_slot  = MODEL_NONE,
+    .loaded_model = MODEL_NONE,
+};
+
+/* ────────────────────────────────────────────────────
+ *  SSCMA callbacks (monitor task context)
+ * ──────────────────────────────────────────────────── */
+
+static void models_on_connect(sscma_client_handle_t client,
+                              const sscma_client_reply_t *reply, void *user_ctx)
+{
+    /* WE2 rebooted: whatever model we loaded is gone */
+    ESP_LOGW(TAG, "WE2 (re)connected");
+    s_models.loaded_model = MODEL_NONE;
+}
+
+static void models_on_event(sscma_client_handle_t client,
+                            const sscma_client_reply_t *reply, void *user_ctx)
+{
+    int slot = s_models.active_slot;
+    if (slot < 0 || slot >= s_models.count) return;
+
+    cJSON *name = cJSON_GetObjectItem(reply->payload, "name");
+    if (!cJSON_IsString(name) || strcmp(name->valuestring, CMD_AT_INVOKE) != 0) {
+        return;
+    }
+
+    debi_model_result_t result = { 0 };
+    if (sscma_utils_copy_boxes_from_reply(reply, result.boxes, DEBI_MODELS_MAX_BOXES,
+                                          &result.box_count) != ESP_OK) {
+        result.box_count = 0;
+    }
+    result.ts_us = reply->ts_us ? reply->ts_us : esp_timer_get_time();
+
+    model_slot_t *s = &s_models.slots[slot];
+
+    xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    result.seq = s->result.seq + 1;
+    s->result = result;
+    s_models.stats.inferences[slot]++;
+    debi_models_result_cb_t cb = s_models.cb;
+    void *cb_ctx = s_models.cb_ctx;
+    xSemaphoreGive(s_models.lock);
+
+    if (cb) {
+        cb(slot, &s->cfg, &result, s->classes, cb_ctx);
+    }
+
+    if (s_models.task) {
+        xTaskNotifyGive(s_models.task);
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Scheduling
+ * ──────────────────────────────────────────────────── */
+
+static void models_classes_free(model_slot_t *s)
+{
+    for (int i = 0; i < SSCMA_CLIENT_MODEL_MAX_CLASSES; i++) {
+        free(s->classes[i]);
+        s->classes[i] = NULL;
+    }
+    s->classes_loaded = false;
+}
+
+static void models_classes_load(model_slot_t *s)
+{
+    sscma_client_model_t *model = NULL;
+
+    if (sscma_client_get_model(s_models.client, &model, false) != ESP_OK || !model) {
+        ESP_LOGW(TAG, "%s: no model info, falling back to target ids", s->cfg.name);
+        s->classes_loaded = true;   /* don't ask again every round */
+        return;
+    }
+    for (int i = 0; i < SSCMA_CLIENT_MODEL_MAX_CLASSES; i++) {
+        if (model->classes[i]) {
+            s->classes[i] = strdup(model->classes[i]);
+        }
+    }
+    s->classes_loaded = true;
+}
+
+/**
+ * Load the slot's model on the WE2 unless it is already there.
+ * Only the AT+MODEL round trip counts towards the switch cost.
+ */
+static esp_err_t models_switch(int slot)
+{
+    model_slot_t *s = &s_models.slots[slot];
+
+    if (s_models.loaded_model == s->cfg.model_id) {
+        if (!s->classes_loaded) models_classes_load(s);
+        return ESP_OK;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t ret = sscma_client_set_model(s_models.client, s->cfg.model_id);
+    int64_t cost = esp_timer_get_time() - t0;
+    ESP_RETURN_ON_ERROR(ret, TAG, "%s: set model %d failed", s->cfg.name, s->cfg.model_id);
+
+    s_models.loaded_model = s->cfg.model_id;
+
+    xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    debi_models_stats_t *st = &s_models.stats;
+    /* EWMA, alpha = 1/4; seed with the first sample */
+    st->switch_cost_us = st->switches ? st->switch_cost_us + (cost - st->switch_cost_us) / 4 : cost;
+    if (cost > st->switch_cost_max_us) st->switch_cost_max_us = cost;
+    st->switches++;
+    xSemaphoreGive(s_models.lock);
+
+    ESP_LOGD(TAG, "switched to %s in %lld us", s->cfg.name, (long long)cost);
+
+    if (!s->classes_loaded) models_classes_load(s);
+    return ESP_OK;
+}
+
+/**
+ * Round length such that count switches fit in the switch budget.
+ */
+static uint32_t models_round_ms(void)
+{
+    if (s_models.count <= 1) return DEBI_MODELS_ROUND_MIN_MS;
+
+    xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    int64_t cost_us = s_models.stats.switch_cost_us;
+    xSemaphoreGive(s_models.lock);
+
+    int64_t ms = cost_us * s_models.count * 100 / DEBI_MODELS_SWITCH_BUDGET_PCT / 1000;
+    if (ms < DEBI_MODELS_ROUND_MIN_MS) ms = DEBI_MODELS_ROUND_MIN_MS;
+    if (ms > DEBI_MODELS_ROUND_MAX_MS) ms = DEBI_MODELS_ROUND_MAX_MS;
+    return (uint32_t)ms;
+}
+
+/**
+ * Run `times` inferences of one slot and wait for all of them.
+ */
+static void models_run_slice(int slot, int times)
+{
+    ulTaskNotifyTake(pdTRUE, 0);    /* drop stale notifications */
+    s_models.active_slot = slot;
+
+    if (sscma_client_invoke(s_models.client, times, false, false) != ESP_OK) {
+        ESP_LOGW(TAG, "%s: invoke failed", s_models.slots[slot].cfg.name);
+        s_models.active_slot = MODEL_NONE;
+        return;
+    }
+
+    int got = 0;
+    for (; got < times && !s_models.stop_req; got++) {
+        if (ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(DEBI_MODELS_RESULT_TIMEOUT_MS)) == 0) {
+            xSemaphoreTake(s_models.lock, portMAX_DELAY);
+            s_models.stats.timeouts[slot]++;
+            xSemaphoreGive(s_models.lock);
+            ESP_LOGW(TAG, "%s: result %d/%d timed out", s_models.slots[slot].cfg.name, got + 1, times);
+            break;
+        }
+    }
+
+    s_models.active_slot = MODEL_NONE;
+
+    /* Cut the invoke short if we stopped waiting early */
+    if (got < times) {
+        sscma_client_break(s_models.client);
+    }
+}
+
+static void models_task(void *arg)
+{
+    ESP_LOGI(TAG, "scheduler started with %d model(s)", s_models.count);
+
+    while (!s_models.stop_req) {
+        uint32_t round_ms = models_round_ms();
+        int64_t  round_start = esp_timer_get_time();
+
+        xSemaphoreTake(s_models.lock, portMAX_DELAY);
+        s_models.stats.round_ms = round_ms;
+        xSemaphoreGive(s_models.lock);
+
+        for (int slot = 0; slot < s_models.count && !s_models.stop_req; slot++) {
+            model_slot_t *s = &s_models.slots[slot];
+
+            if (models_switch(slot) != ESP_OK) {
+                s_models.loaded_model = MODEL_NONE;
+                continue;
+            }
+
+            int times = (int)ceilf(s->cfg.rate_hz * round_ms / 1000.0f);
+            if (times < 1) times = 1;
+            models_run_slice(slot, times);
+        }
+
+        /* Pace the round so fast models don't overshoot their rate */
+        int64_t elapsed_ms = (esp_timer_get_time() - round_start) / 1000;
+        if (elapsed_ms > round_ms + round_ms / 2) {
+            ESP_LOGW(TAG, "round overran: %lld ms of %u ms, rates not met",
+                     (long long)elapsed_ms, (unsigned)round_ms);
+        }
+        while (!s_models.stop_req && elapsed_ms < round_ms) {
+            /* late events may wake us early; keep waiting out the round */
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(round_ms - elapsed_ms));
+            elapsed_ms = (esp_timer_get_time() - round_start) / 1000;
+        }
+    }
+
+    ESP_LOGI(TAG, "scheduler stopped");
+    xSemaphoreGive(s_models.done);
+    vTaskDelete(NULL);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_models_start(const debi_model_cfg_t *cfgs, int count)
+{
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_FALSE(cfgs && count > 0 && count <= DEBI_MODELS_MAX,
+                        ESP_ERR_INVALID_ARG, TAG, "bad model table");
+    ESP_RETURN_ON_FALSE(!s_models.running, ESP_ERR_INVALID_STATE, TAG, "already running");
+
+    for (int i = 0; i < count; i++) {
+        ESP_RETURN_ON_FALSE(cfgs[i].rate_hz > 0, ESP_ERR_INVALID_ARG, TAG,
+                            "model %d: rate must be > 0", i);
+    }
+
+    if (!s_models.lock) {
+        s_models.lock = xSemaphoreCreateMutex();
+        s_models.done = xSemaphoreCreateBinary();
+        ESP_RETURN_ON_FALSE(s_models.lock && s_models.done, ESP_ERR_NO_MEM, TAG, "no mem");
+    }
+
+    s_models.client = bsp_sscma_client_init();
+    ESP_RETURN_ON_FALSE(s_models.client, ESP_FAIL, TAG, "sscma client init failed");
+
+    memset(&s_models.stats, 0, sizeof(s_models.stats));
+    for (int i = 0; i < count; i++) {
+        model_slot_t *s = &s_models.slots[i];
+        s->cfg = cfgs[i];
+        memset(&s->result, 0, sizeof(s->result));
+    }
+    s_models.count        = count;
+    s_models.active_slot  = MODEL_NONE;
+    s_models.loaded_model = MODEL_NONE;
+    s_models.stop_req     = false;
+
+    const sscma_client_callback_t callback = {
+        .on_event   = models_on_event,
+        .on_connect = models_on_connect,
+        .on_log     = NULL,
+    };
+    /* Whoever had the events before (the ai camera) gets them back on stop */
+    if (sscma_client_get_callback(s_models.client, &s_models.prev_callback,
+                                  &s_models.prev_ctx) != ESP_OK) {
+        memset(&s_models.prev_callback, 0, sizeof(s_models.prev_callback));
+        s_models.prev_ctx = NULL;
+    }
+    ESP_RETURN_ON_ERROR(sscma_client_register_callback(s_models.client, &callback, NULL),
+                        TAG, "register callback failed");
+    sscma_client_init(s_models.client);
+    sscma_client_break(s_models.client);
+
+    s_models.running = true;
+    if (xTaskCreate(models_task, "debi_models", MODELS_TASK_STACK, NULL,
+                    MODELS_TASK_PRIO, &s_models.task) != pdPASS) {
+        ESP_LOGE(TAG, "task create failed");
+        s_models.running = false;
+        s_models.task = NULL;
+        ret = ESP_ERR_NO_MEM;
+    }
+    return ret;
+}
+
+void debi_models_stop(void)
+{
+    if (!s_models.running) return;
+
+    s_models.stop_req = true;
+    xTaskNotifyGive(s_models.task);
+    xSemaphoreTake(s_models.done, portMAX_DELAY);
+    s_models.task = NULL;
+
+    /* Leave the WE2 idle and route its events back to their previous owner */
+    sscma_client_register_callback(s_models.client, &s_models.prev_callback, s_models.prev_ctx);
+    sscma_client_break(s_models.client);
+
+    for (int i = 0; i < s_models.count; i++) {
+        models_classes_free(&s_models.slots[i]);
+    }
+    s_models.running = false;
+}
+
+bool debi_models_is_running(void)
+{
+    return s_models.running;
+}
+
+void debi_models_set_result_cb(debi_models_result_cb_t cb, void *ctx)
+{
+    if (s_models.lock) xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    s_models.cb     = cb;
+    s_models.cb_ctx = ctx;
+    if (s_models.lock) xSemaphoreGive(s_models.lock);
+}
+
+esp_err_t debi_models_get_result(int slot, debi_model_result_t *out)
+{
+    ESP_RETURN_ON_FALSE(out && slot >= 0 && slot < s_models.count,
+                        ESP_ERR_INVALID_ARG, TAG, "bad slot");
+
+    xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    *out = s_models.slots[slot].result;
+    xSemaphoreGive(s_models.lock);
+
+    return out->seq ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void debi_models_get_stats(debi_models_stats_t *out)
+{
+    if (!out) return;
+    if (!s_models.lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_models.lock, portMAX_DELAY);
+    *out = s_models.stats;
+    xSemaphoreGive(s_models.lock);
+}
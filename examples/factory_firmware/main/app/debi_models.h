@@ -0,0 +1,122 @@
+/**
+ * @file debi_models.h
+ * @brief Debi Models — Multi-model scheduling on the WiseEye2
+ *
+ * Time-slices several WE2 models (e.g. person at 5 Hz, gesture at
+ * 1 Hz) on top of sscma_client_set_model / sscma_client_invoke
+ * instead of reconfiguring a whole task flow per model.
+ *
+ * Work is organised in rounds.  In each round every model gets one
+ * slice in which it runs rate_hz * round length inferences back to
+ * back, so a model switch is paid once per model per round.  The
+ * switch cost is measured on every switch and the round is stretched
+ * until switching stays within DEBI_MODELS_SWITCH_BUDGET_PCT of the
+ * round.
+ *
+ * The scheduler takes over the SSCMA client callbacks while running and
+ * hands them back to their previous owner on stop; stop the ai camera
+ * task flow before starting it.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sscma_client_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ── Limits ── */
+#define DEBI_MODELS_MAX             4
+#define DEBI_MODELS_MAX_BOXES       16
+
+/* ── Scheduling (tunable) ── */
+#ifndef DEBI_MODELS_SWITCH_BUDGET_PCT
+#define DEBI_MODELS_SWITCH_BUDGET_PCT   20     /* max share of a round spent switching */
+#endif
+
+#ifndef DEBI_MODELS_ROUND_MIN_MS
+#define DEBI_MODELS_ROUND_MIN_MS        1000
+#endif
+
+#ifndef DEBI_MODELS_ROUND_MAX_MS
+#define DEBI_MODELS_ROUND_MAX_MS        10000  /* bounds blind time of the other models */
+#endif
+
+#ifndef DEBI_MODELS_RESULT_TIMEOUT_MS
+#define DEBI_MODELS_RESULT_TIMEOUT_MS   2000
+#endif
+
+/* ── Types ── */
+typedef struct {
+    const char *name;       /* "person", "gesture", ...               */
+    int         model_id;   /* WE2 model slot for sscma_client_set_model */
+    float       rate_hz;    /* requested average inference rate        */
+} debi_model_cfg_t;
+
+typedef struct {
+    uint32_t           seq;         /* bumps on every new result        */
+    int64_t            ts_us;       /* esp_timer time it reached the ESP32 */
+    int                box_count;
+    sscma_client_box_t boxes[DEBI_MODELS_MAX_BOXES];
+} debi_model_result_t;
+
+typedef struct {
+    int64_t  switch_cost_us;        /* smoothed model switch cost       */
+    int64_t  switch_cost_max_us;
+    uint32_t switches;
+    uint32_t round_ms;              /* current round length             */
+    uint32_t inferences[DEBI_MODELS_MAX];
+    uint32_t timeouts[DEBI_MODELS_MAX];
+} debi_models_stats_t;
+
+/**
+ * Called from the SSCMA monitor task for every new result.
+ * `classes` is the class name table of that model (may contain NULLs).
+ */
+typedef void (*debi_models_result_cb_t)(int slot, const debi_model_cfg_t *cfg,
+                                        const debi_model_result_t *result,
+                                        char *const *classes, void *ctx);
+
+/* ── Public API ── */
+
+/**
+ * Start scheduling the given models.  The table is copied.
+ */
+esp_err_t debi_models_start(const debi_model_cfg_t *cfgs, int count);
+
+/**
+ * Stop scheduling and release the WE2, its callbacks back to whoever had
+ * them before debi_models_start().  Blocks until the current slice ends.
+ */
+void debi_models_stop(void);
+
+/**
+ * Whether the scheduler is running.
+ */
+bool debi_models_is_running(void);
+
+/**
+ * Register the result callback (NULL to clear).
+ */
+void debi_models_set_result_cb(debi_models_result_cb_t cb, void *ctx);
+
+/**
+ * Copy the latest cached result of a model slot.
+ *
+ * @return ESP_ERR_NOT_FOUND if the slot has produced no result yet.
+ */
+esp_err_t debi_models_get_result(int slot, debi_model_result_t *out);
+
+/**
+ * Snapshot scheduling statistics.
+ */
+void debi_models_get_stats(debi_models_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
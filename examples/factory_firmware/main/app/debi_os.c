@@ -19,7 +19,6 @@
 #include "esp_timer.h"
 #include "esp_wifi.h"
 #include "mqtt_client.h"
-#include "cJSON.h"
 
 #include "event_loops.h"
 #include "data_defs.h"
@@ -27,6 +26,8 @@
 #include "debi_face_bridge.h"
 #include "view/ui_face_states.h"
 #include "debi_comms.h"
+#include "debi_json.h"
+#include "debi_hub.h"
 
 static const char *TAG = "debi_os";
 
@@ -80,6 +81,9 @@ static void sensor_report_cb(void *arg);
 static void mqtt_connect(void);
 static void mqtt_disconnect(void);
 static void publish_status(void);
+static void publish_json(const char *topic, debi_json_t *w,
+                         int qos, int retain);
+static void queue_json(const char *topic, debi_json_t *w);
 
 /* ============================================================
  *  Public API
@@ -89,7 +93,7 @@ void debi_os_init(void)
 {
     ESP_LOGI(TAG, "===================================");
     ESP_LOGI(TAG, "  Debi Guardian OS initialising");
-    ESP_LOGI(TAG, "  Hub: %s", DEBI_HUB_MQTT_URI);
+    ESP_LOGI(TAG, "  Hub: mDNS / saved, default %s", DEBI_HUB_MQTT_URI);
     ESP_LOGI(TAG, "  Client: %s", DEBI_HUB_MQTT_CLIENT_ID);
     ESP_LOGI(TAG, "===================================");
 
@@ -133,7 +137,7 @@ void debi_os_init(void)
     };
     ESP_ERROR_CHECK(esp_timer_create(&sr_args, &s_os.sensor_timer));
 
-    /* WiFi will trigger mqtt_connect via on_wifi_connected */
+    /* WiFi tells debi_hub, which opens the broker */
     s_os.mode = DEBI_MODE_CONNECTING;
     ui_face_set_state(FACE_STATE_BOOT);
 
@@ -172,6 +176,11 @@ void debi_os_set_mode(debi_mode_t mode)
 
     ESP_LOGI(TAG, "mode: %s -> %s", MODE_NAMES[old], MODE_NAMES[mode]);
 
+    /* Leaving ALERT (hub or debi_failover) ends a locally held alarm */
+    if (old == DEBI_MODE_ALERT) {
+        debi_face_bridge_release();
+    }
+
     /* Update face to match mode */
     switch (mode) {
         case DEBI_MODE_ACTIVE:
@@ -213,26 +222,26 @@ bool debi_os_hub_connected(void)
 
 void debi_os_report_detection(const char *type, int score)
 {
-    if (!s_os.hub_connected || !s_os.mqtt_handle) return;
-
     s_os.detection_count++;
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return;
-
-    cJSON_AddStringToObject(root, "type", type ? type : "unknown");
-    cJSON_AddNumberToObject(root, "score", score);
-    cJSON_AddNumberToObject(root, "seq", s_os.detection_count);
-    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
-    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
-
-    char *json = cJSON_PrintUnformatted(root);
-    if (json) {
-        esp_mqtt_client_publish(s_os.mqtt_handle,
-                                 DEBI_TOPIC_DETECTION, json, 0, 0, 0);
-        free(json);
-    }
-    cJSON_Delete(root);
+    /* {"type":"person","score":100,"seq":7,"mode":"Active","ts":...} */
+    char buf[DEBI_OS_MSG_MAX_LEN];
+    debi_json_t w;
+    debi_json_init(&w, buf, sizeof(buf));
+
+    DEBI_JSON_LIT(&w, "{\"type\":");
+    debi_json_str(&w, type ? type : "unknown");
+    DEBI_JSON_LIT(&w, ",\"score\":");
+    debi_json_int(&w, score);
+    DEBI_JSON_LIT(&w, ",\"seq\":");
+    debi_json_int(&w, s_os.detection_count);
+    DEBI_JSON_LIT(&w, ",\"mode\":");
+    debi_json_str(&w, MODE_NAMES[s_os.mode]);
+    DEBI_JSON_LIT(&w, ",\"ts\":");
+    debi_json_int(&w, time(NULL));
+    DEBI_JSON_LIT(&w, "}");
+
+    queue_json(DEBI_TOPIC_DETECTION, &w);
 }
 
 
@@ -243,40 +252,36 @@ void *debi_os_get_mqtt_handle(void)
 
 void debi_os_report_sensors(void)
 {
-    if (!s_os.hub_connected || !s_os.mqtt_handle) return;
-
     app_sensor_data_t sensor_data[APP_SENSOR_SUPPORT_MAX];
     uint8_t count = app_sensor_read_measurement(sensor_data,
                                                   APP_SENSOR_SUPPORT_MAX);
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return;
+    /* {"ts":...,"temp_c":23.45,"humidity":41.2[,"co2":612]} per sensor */
+    char buf[DEBI_OS_MSG_MAX_LEN];
+    debi_json_t w;
+    debi_json_init(&w, buf, sizeof(buf));
 
-    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    DEBI_JSON_LIT(&w, "{\"ts\":");
+    debi_json_int(&w, time(NULL));
 
     for (uint8_t i = 0; i < count; i++) {
         if (sensor_data[i].type == SENSOR_SHT4x) {
-            cJSON_AddNumberToObject(root, "temp_c",
-                sensor_data[i].context.sht4x.temperature / 100.0);
-            cJSON_AddNumberToObject(root, "humidity",
-                sensor_data[i].context.sht4x.humidity / 100.0);
+            DEBI_JSON_LIT(&w, ",\"temp_c\":");
+            debi_json_centi(&w, sensor_data[i].context.sht4x.temperature);
+            DEBI_JSON_LIT(&w, ",\"humidity\":");
+            debi_json_centi(&w, sensor_data[i].context.sht4x.humidity);
         } else if (sensor_data[i].type == SENSOR_SCD4x) {
-            cJSON_AddNumberToObject(root, "temp_c",
-                sensor_data[i].context.scd4x.temperature / 100.0);
-            cJSON_AddNumberToObject(root, "humidity",
-                sensor_data[i].context.scd4x.humidity / 100.0);
-            cJSON_AddNumberToObject(root, "co2",
-                sensor_data[i].context.scd4x.co2);
+            DEBI_JSON_LIT(&w, ",\"temp_c\":");
+            debi_json_centi(&w, sensor_data[i].context.scd4x.temperature);
+            DEBI_JSON_LIT(&w, ",\"humidity\":");
+            debi_json_centi(&w, sensor_data[i].context.scd4x.humidity);
+            DEBI_JSON_LIT(&w, ",\"co2\":");
+            debi_json_int(&w, sensor_data[i].context.scd4x.co2);
         }
     }
+    DEBI_JSON_LIT(&w, "}");
 
-    char *json = cJSON_PrintUnformatted(root);
-    if (json) {
-        esp_mqtt_client_publish(s_os.mqtt_handle,
-                                 DEBI_TOPIC_SENSOR, json, 0, 0, 0);
-        free(json);
-    }
-    cJSON_Delete(root);
+    queue_json(DEBI_TOPIC_SENSOR, &w);
 }
 
 /* ============================================================
@@ -287,14 +292,17 @@ static void mqtt_connect(void)
 {
     if (s_os.mqtt_handle) return; /* already connected or connecting */
 
+    /* debi_hub picks the endpoint and retries; the client does not */
+    debi_hub_endpoint_t ep;
+    debi_hub_current(&ep);
+
     esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri         = DEBI_HUB_MQTT_URI,
+        .broker.address.uri         = ep.uri,
         .credentials.client_id    = DEBI_HUB_MQTT_CLIENT_ID,
-        .credentials.username      = DEBI_HUB_MQTT_USER,
-        .credentials.authentication.password = DEBI_HUB_MQTT_PASS,
+        .credentials.username      = ep.user,
+        .credentials.authentication.password = ep.pass,
         .session.disable_clean_session = false,
-        .network.disable_auto_reconnect = false,
-        .network.reconnect_timeout_ms   = 10000,
+        .network.disable_auto_reconnect = true,
     };
 
     s_os.mqtt_handle = esp_mqtt_client_init(&mqtt_cfg);
@@ -308,7 +316,7 @@ static void mqtt_connect(void)
                                     ESP_EVENT_ANY_ID,
                                     mqtt_event_handler, NULL);
     esp_mqtt_client_start(s_os.mqtt_handle);
-    ESP_LOGI(TAG, "MQTT connecting to %s", DEBI_HUB_MQTT_URI);
+    ESP_LOGI(TAG, "MQTT connecting to %s (%s)", ep.uri, debi_hub_source_name(ep.source));
 }
 
 static void mqtt_disconnect(void)
@@ -317,25 +325,25 @@ static void mqtt_disconnect(void)
 
     /* Publish offline status before disconnecting */
     if (s_os.hub_connected) {
-        cJSON *root = cJSON_CreateObject();
-        if (root) {
-            cJSON_AddStringToObject(root, "status", "offline");
-            cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
-            char *json = cJSON_PrintUnformatted(root);
-            if (json) {
-                esp_mqtt_client_publish(s_os.mqtt_handle,
-                    DEBI_TOPIC_STATUS, json, 0, 1, 1);
-                free(json);
-            }
-            cJSON_Delete(root);
-        }
+        char buf[DEBI_OS_MSG_MAX_LEN];
+        debi_json_t w;
+        debi_json_init(&w, buf, sizeof(buf));
+
+        DEBI_JSON_LIT(&w, "{\"status\":\"offline\",\"ts\":");
+        debi_json_int(&w, time(NULL));
+        DEBI_JSON_LIT(&w, "}");
+
+        publish_json(DEBI_TOPIC_STATUS, &w, 1, 1);
     }
 
-    esp_mqtt_client_stop(s_os.mqtt_handle);
-    esp_mqtt_client_destroy(s_os.mqtt_handle);
-    s_os.mqtt_handle = NULL;
+    /* Let go of the handle before it goes; events still queued for this
+     * client are ignored from here on */
+    esp_mqtt_client_handle_t client = s_os.mqtt_handle;
     s_os.hub_connected = false;
-        debi_comms_on_disconnected();
+    debi_comms_on_disconnected();
+    s_os.mqtt_handle = NULL;
+    esp_mqtt_client_stop(client);
+    esp_mqtt_client_destroy(client);
 }
 
 /* ============================================================
@@ -346,6 +354,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
                                 int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
+    if (event->client != s_os.mqtt_handle) return;  /* closed by mqtt_disconnect */
 
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
@@ -361,12 +370,15 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             /* Publish online status (retained) */
             publish_status();
         debi_comms_on_connected(s_os.mqtt_handle);
+            debi_hub_on_connected();
 
             /* Start timers */
             esp_timer_start_periodic(s_os.heartbeat_timer,
                 (uint64_t)DEBI_HEARTBEAT_INTERVAL_S * 1000000);
-            esp_timer_start_periodic(s_os.sensor_timer,
-                (uint64_t)DEBI_SENSOR_REPORT_INTERVAL_S * 1000000);
+            if (!esp_timer_is_active(s_os.sensor_timer)) {
+                esp_timer_start_periodic(s_os.sensor_timer,
+                    (uint64_t)DEBI_SENSOR_REPORT_INTERVAL_S * 1000000);
+            }
 
             /* Transition to active mode */
             if (s_os.mode == DEBI_MODE_CONNECTING ||
@@ -379,14 +391,14 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             ESP_LOGW(TAG, "Hub MQTT disconnected");
             s_os.hub_connected = false;
         debi_comms_on_disconnected();
+            debi_hub_on_disconnected();
 
-            /* Stop periodic timers */
+            /* Sensor readings keep going into the spool */
             esp_timer_stop(s_os.heartbeat_timer);
-            esp_timer_stop(s_os.sensor_timer);
 
             if (s_os.mode == DEBI_MODE_ACTIVE) {
                 s_os.mode = DEBI_MODE_CONNECTING;
-                ESP_LOGW(TAG, "mode -> Connecting (will auto-reconnect)");
+                ESP_LOGW(TAG, "mode -> Connecting (debi_hub retries)");
             }
             break;
 
@@ -432,11 +444,11 @@ static void on_wifi_state_changed(void *handler_arg, esp_event_base_t base,
     if (!event_data) return;
     struct view_data_wifi_st *p_st = (struct view_data_wifi_st *)event_data;
     if (p_st->is_connected && !s_os.hub_connected) {
-        ESP_LOGI(TAG, "WiFi connected - triggering MQTT connect");
-        mqtt_connect();
+        ESP_LOGI(TAG, "WiFi connected - looking for the hub");
+        debi_hub_network(true);
     } else if (!p_st->is_connected) {
         ESP_LOGW(TAG, "WiFi disconnected");
-        mqtt_disconnect();
+        debi_hub_network(false);
     }
 }
 
@@ -444,7 +456,7 @@ static void on_wifi_connected(void *handler_arg, esp_event_base_t base,
                                int32_t id, void *event_data)
 {
     ESP_LOGI(TAG, "WiFi connected — starting hub MQTT");
-    mqtt_connect();
+    debi_hub_network(true);
 }
 
 static void on_wifi_disconnected(void *handler_arg, esp_event_base_t base,
@@ -483,26 +495,30 @@ static void heartbeat_cb(void *arg)
 
     s_os.heartbeat_seq++;
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return;
-
-    cJSON_AddNumberToObject(root, "seq", s_os.heartbeat_seq);
-    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
-    cJSON_AddStringToObject(root, "face",
-        ui_face_state_name(ui_face_get_state()));
-    cJSON_AddNumberToObject(root, "uptime",
-        difftime(time(NULL), s_os.boot_time));
-    cJSON_AddNumberToObject(root, "detections", s_os.detection_count);
-    cJSON_AddNumberToObject(root, "heap",
-        (double)esp_get_free_heap_size());
-    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
-
-    char *json = cJSON_PrintUnformatted(root);
-    if (json) {
-        esp_mqtt_client_publish(s_os.mqtt_handle,
-                                 DEBI_TOPIC_HEARTBEAT, json, 0, 0, 0);
-        free(json);
-    }
+    /* {"seq":..,"mode":"..","face":"..","uptime":..,"detections":..,
+     *  "heap":..,"ts":..} */
+    char buf[DEBI_OS_MSG_MAX_LEN];
+    debi_json_t w;
+    debi_json_init(&w, buf, sizeof(buf));
+    time_t now = time(NULL);
+
+    DEBI_JSON_LIT(&w, "{\"seq\":");
+    debi_json_int(&w, s_os.heartbeat_seq);
+    DEBI_JSON_LIT(&w, ",\"mode\":");
+    debi_json_str(&w, MODE_NAMES[s_os.mode]);
+    DEBI_JSON_LIT(&w, ",\"face\":");
+    debi_json_str(&w, ui_face_state_name(ui_face_get_state()));
+    DEBI_JSON_LIT(&w, ",\"uptime\":");
+    debi_json_int(&w, (int64_t)now - s_os.boot_time);
+    DEBI_JSON_LIT(&w, ",\"detections\":");
+    debi_json_int(&w, s_os.detection_count);
+    DEBI_JSON_LIT(&w, ",\"heap\":");
+    debi_json_int(&w, esp_get_free_heap_size());
+    DEBI_JSON_LIT(&w, ",\"ts\":");
+    debi_json_int(&w, now);
+    DEBI_JSON_LIT(&w, "}");
+
+    publish_json(DEBI_TOPIC_HEARTBEAT, &w, 0, 0);
 
     /* Night mode auto-switch */
     debi_comms_config_t cfg = debi_comms_get_config();
@@ -527,7 +543,6 @@ static void heartbeat_cb(void *arg)
             debi_os_set_mode(DEBI_MODE_ACTIVE);
         }
     }
-    cJSON_Delete(root);
 }
 
 static void sensor_report_cb(void *arg)
@@ -543,31 +558,69 @@ static void publish_status(void)
 {
     if (!s_os.hub_connected || !s_os.mqtt_handle) return;
 
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return;
-
-    cJSON_AddStringToObject(root, "status", "online");
-    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
-    cJSON_AddStringToObject(root, "client_id", DEBI_HUB_MQTT_CLIENT_ID);
-    cJSON_AddStringToObject(root, "face",
-        ui_face_state_name(ui_face_get_state()));
-    cJSON_AddNumberToObject(root, "uptime",
-        difftime(time(NULL), s_os.boot_time));
-    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
-
-    char *json = cJSON_PrintUnformatted(root);
-    if (json) {
-        /* Retained so hub sees it on reconnect */
-        esp_mqtt_client_publish(s_os.mqtt_handle,
-                                 DEBI_TOPIC_STATUS, json, 0, 1, 1);
-        free(json);
+    char buf[DEBI_OS_MSG_MAX_LEN];
+    debi_json_t w;
+    debi_json_init(&w, buf, sizeof(buf));
+    time_t now = time(NULL);
+
+    DEBI_JSON_LIT(&w, "{\"status\":\"online\",\"mode\":");
+    debi_json_str(&w, MODE_NAMES[s_os.mode]);
+    DEBI_JSON_LIT(&w, ",\"client_id\":");
+    debi_json_str(&w, DEBI_HUB_MQTT_CLIENT_ID);
+    DEBI_JSON_LIT(&w, ",\"face\":");
+    debi_json_str(&w, ui_face_state_name(ui_face_get_state()));
+    DEBI_JSON_LIT(&w, ",\"uptime\":");
+    debi_json_int(&w, (int64_t)now - s_os.boot_time);
+    DEBI_JSON_LIT(&w, ",\"ts\":");
+    debi_json_int(&w, now);
+    DEBI_JSON_LIT(&w, "}");
+
+    /* Retained so hub sees it on reconnect */
+    publish_json(DEBI_TOPIC_STATUS, &w, 1, 1);
+}
+
+static void publish_json(const char *topic, debi_json_t *w,
+                         int qos, int retain)
+{
+    size_t len;
+    const char *json = debi_json_finish(w, &len);
+    if (!json) {
+        ESP_LOGW(TAG, "%s: message over %d bytes, dropped",
+                 topic, DEBI_OS_MSG_MAX_LEN);
+        return;
     }
-    cJSON_Delete(root);
+    esp_mqtt_client_publish(s_os.mqtt_handle, topic, json, (int)len,
+                            qos, retain);
 }
 
-/* Public wrapper for mqtt_connect - called by debi_wifi after WiFi is up */
+/* History goes through debi_comms, which spools it while the hub is away */
+static void queue_json(const char *topic, debi_json_t *w)
+{
+    size_t len;
+    const char *json = debi_json_finish(w, &len);
+    if (!json) {
+        ESP_LOGW(TAG, "%s: message over %d bytes, dropped",
+                 topic, DEBI_OS_MSG_MAX_LEN);
+        return;
+    }
+    debi_comms_publish_bin(topic, json, len, 0, false);
+}
+
+/* Called by debi_wifi after WiFi is up */
 void debi_os_mqtt_start(void)
 {
     ESP_LOGI("debi-os", "debi_os_mqtt_start() called from WiFi module");
+    debi_hub_network(true);
+}
+
+/* Called by the debi_hub task only */
+void debi_os_mqtt_restart(void)
+{
+    mqtt_disconnect();
     mqtt_connect();
 }
+
+void debi_os_mqtt_stop(void)
+{
+    mqtt_disconnect();
+}
@@ -35,6 +35,7 @@ typedef enum {
 } debi_mode_t;
 
 /* ── Hub connection config ── */
+/* Build-time defaults; debi_hub finds the broker and may override these */
 #ifndef DEBI_HUB_MQTT_URI
 #define DEBI_HUB_MQTT_URI       "mqtt://192.168.0.182:1883"
 #endif
@@ -60,6 +61,7 @@ typedef enum {
 #define DEBI_TOPIC_HEARTBEAT    DEBI_TOPIC_PREFIX "/heartbeat"
 #define DEBI_TOPIC_CMD          DEBI_TOPIC_PREFIX "/cmd"
 #define DEBI_TOPIC_CONFIG       DEBI_TOPIC_PREFIX "/config"
+#define DEBI_TOPIC_REPLAY       DEBI_TOPIC_PREFIX "/replay"   /* + original suffix */
 
 /* Timing */
 #ifndef DEBI_HEARTBEAT_INTERVAL_S
@@ -70,6 +72,11 @@ typedef enum {
 #define DEBI_SENSOR_REPORT_INTERVAL_S 60
 #endif
 
+/* Longest heartbeat/status/sensor/detection JSON, built on the stack */
+#ifndef DEBI_OS_MSG_MAX_LEN
+#define DEBI_OS_MSG_MAX_LEN         256
+#endif
+
 /* ── Public API ── */
 
 /**
@@ -111,13 +118,17 @@ bool debi_os_hub_connected(void);
 /**
  * @brief Publish a detection event to the hub.
  *
+ * Goes through debi_comms, so events seen while the hub is away are
+ * spooled and replayed later.
+ *
  * @param type   Detection type string ("person", "pet", "gesture")
  * @param score  Confidence score (0-100)
  */
 void debi_os_report_detection(const char *type, int score);
 
 /**
- * @brief Publish current sensor readings to the hub.
+ * @brief Publish current sensor readings to the hub (spooled like
+ *        detections while the hub is away).
  */
 void debi_os_report_sensors(void);
 
@@ -125,6 +136,13 @@ void debi_os_report_sensors(void);
 /** Get the MQTT client handle for publishing (returns esp_mqtt_client_handle_t) */
 void *debi_os_get_mqtt_handle(void);
 
+/**
+ * @brief (Re)open the hub broker at debi_hub_current(), or close it.
+ *        Called by the debi_hub task only.
+ */
+void debi_os_mqtt_restart(void);
+void debi_os_mqtt_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,535 @@
+/**
+ * @file debi_spool.c
+ * @brief Debi Spool — On-flash history kept while the hub is away
+ *
+ * All file access happens in the spool task; callers only copy into
+ * a RAM batch.  Two batches take turns: one fills while the other is
+ * written out.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_spool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sensecap-watcher.h"
+
+static const char *TAG = "debi_spool";
+
+#if DEBI_SPOOL_BATCH_BYTES > 65535
+#error "DEBI_SPOOL_BATCH_BYTES must fit the u16 record lengths"
+#endif
+
+#define SPOOL_TASK_STACK        4096
+#define SPOOL_TASK_PRIO         2     /* below the camera task */
+
+#define SPOOL_HDR_LEN           12
+#define SPOOL_PREFIX            "dspl"
+#define SPOOL_SUFFIX            ".log"
+#define SPOOL_PATH_MAX          48
+
+/* ── Internal state ── */
+typedef struct {
+    size_t   len;                  /* whole record */
+    uint16_t topic_len;
+    uint16_t payload_len;
+    uint8_t  qos;
+    uint8_t  retain;
+} rec_info_t;
+
+typedef struct {
+    debi_spool_send_t   send;
+    char                dir[16];
+    TaskHandle_t        task;
+    SemaphoreHandle_t   lock;
+
+    /* RAM batches (lock held).  batch[fill] takes new records; the
+     * other one waits for the writer while its length is non-zero. */
+    uint8_t            *batch[2];
+    size_t              batch_len[2];
+    uint32_t            batch_recs[2];
+    int                 fill;
+    bool                replaying;
+    int                 pace_ms;
+    debi_spool_stats_t  stats;
+
+    /* Log on flash (spool task only) */
+    uint32_t            seg_first;     /* oldest segment, replay reads it */
+    uint32_t            seg_write;     /* segment appended to */
+    size_t              seg_len;       /* bytes in seg_write; SEGMENT_BYTES = closed */
+    size_t              read_off;      /* replay position in seg_first */
+    uint32_t            seg_recs[DEBI_SPOOL_SEGMENTS];  /* unread, by segment % SEGMENTS */
+    uint8_t            *rec;           /* record read back: topic \0 payload */
+} spool_state_t;
+
+static spool_state_t s_spool;
+
+/* ────────────────────────────────────────────────────
+ *  Helpers
+ * ──────────────────────────────────────────────────── */
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v);
+    put_u16(p + 2, v >> 16);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | (uint32_t)get_u16(p + 2) << 16;
+}
+
+static uint32_t rec_crc(const uint8_t *hdr, const void *topic, size_t topic_len,
+                        const void *payload, size_t payload_len)
+{
+    uint32_t crc = esp_rom_crc32_le(0, hdr, 8);
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)topic, topic_len);
+    return esp_rom_crc32_le(crc, (const uint8_t *)payload, payload_len);
+}
+
+static void path_get(uint32_t seg, char *path)
+{
+    snprintf(path, SPOOL_PATH_MAX, "%s/" SPOOL_PREFIX "%08" PRIx32 SPOOL_SUFFIX,
+             s_spool.dir, seg);
+}
+
+/* Lock held. */
+static void update_segments(void)
+{
+    s_spool.stats.segments = s_spool.seg_write - s_spool.seg_first +
+                             (s_spool.seg_len > 0 ? 1 : 0);
+}
+
+/* Read the record at the file position into s_spool.rec.  False at
+ * the end of the segment or at anything that is not a whole record. */
+static bool read_rec(FILE *fp, rec_info_t *ri)
+{
+    uint8_t hdr[SPOOL_HDR_LEN];
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1) return false;
+
+    ri->qos         = hdr[2];
+    ri->retain      = hdr[3];
+    ri->topic_len   = get_u16(hdr + 4);
+    ri->payload_len = get_u16(hdr + 6);
+    ri->len         = SPOOL_HDR_LEN + ri->topic_len + ri->payload_len;
+    if (get_u16(hdr) != DEBI_SPOOL_MAGIC || ri->topic_len == 0 ||
+        ri->len > DEBI_SPOOL_BATCH_BYTES) {
+        return false;
+    }
+
+    uint8_t *topic = s_spool.rec;
+    uint8_t *payload = topic + ri->topic_len + 1;
+    if (fread(topic, ri->topic_len, 1, fp) != 1 ||
+        (ri->payload_len > 0 && fread(payload, ri->payload_len, 1, fp) != 1)) {
+        return false;
+    }
+    if (rec_crc(hdr, topic, ri->topic_len, payload, ri->payload_len) != get_u32(hdr + 8)) {
+        return false;
+    }
+    topic[ri->topic_len] = '\0';
+    return true;
+}
+
+/* Delete the oldest segment; records not replayed from it are lost. */
+static void drop_first(void)
+{
+    char path[SPOOL_PATH_MAX];
+    path_get(s_spool.seg_first, path);
+    remove(path);
+
+    uint32_t *recs = &s_spool.seg_recs[s_spool.seg_first % DEBI_SPOOL_SEGMENTS];
+    if (*recs) {
+        ESP_LOGW(TAG, "segment %08" PRIx32 " dropped, %" PRIu32 " records lost",
+                 s_spool.seg_first, *recs);
+    }
+
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    s_spool.stats.pending -= *recs < s_spool.stats.pending ? *recs : s_spool.stats.pending;
+    s_spool.stats.dropped += *recs;
+    *recs = 0;
+    if (s_spool.seg_first == s_spool.seg_write) {   /* empty: start afresh */
+        s_spool.seg_write++;
+        s_spool.seg_len = 0;
+    }
+    s_spool.seg_first++;
+    s_spool.read_off = 0;
+    update_segments();
+    xSemaphoreGive(s_spool.lock);
+}
+
+/* ────────────────────────────────────────────────────
+ *  Log on flash (spool task)
+ * ──────────────────────────────────────────────────── */
+
+/* Pick up the segments of the last run.  A torn last segment is
+ * closed, so new records never follow a partial one. */
+static void spool_load(void)
+{
+    const size_t prefix_len = strlen(SPOOL_PREFIX);
+    uint32_t first = UINT32_MAX, last = 0;
+    struct dirent *entry;
+    DIR *dir = opendir(s_spool.dir);
+
+    while (dir && (entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        char *end = NULL;
+        if (strncmp(name, SPOOL_PREFIX, prefix_len) != 0 ||
+            strlen(name) != prefix_len + 8 + strlen(SPOOL_SUFFIX)) {
+            continue;
+        }
+        uint32_t seg = strtoul(name + prefix_len, &end, 16);
+        if (end != name + prefix_len + 8 || strcmp(end, SPOOL_SUFFIX) != 0) {
+            continue;
+        }
+        if (seg < first) first = seg;
+        if (seg > last)  last = seg;
+    }
+    if (dir) closedir(dir);
+    if (first == UINT32_MAX) {
+        ESP_LOGI(TAG, "%s: empty", s_spool.dir);
+        return;
+    }
+
+    char path[SPOOL_PATH_MAX];
+    while (last - first >= DEBI_SPOOL_SEGMENTS) {
+        path_get(first++, path);
+        remove(path);
+    }
+    s_spool.seg_first = first;
+    s_spool.seg_write = last;
+
+    uint32_t total = 0;
+    for (uint32_t seg = first; ; seg++) {
+        rec_info_t ri;
+        size_t off = 0;
+        uint32_t n = 0;
+        bool clean = false;
+
+        path_get(seg, path);
+        FILE *fp = fopen(path, "rb");
+        if (fp) {
+            while (read_rec(fp, &ri)) {
+                off += ri.len;
+                n++;
+            }
+            clean = fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == (long)off;
+            fclose(fp);
+        }
+        if (fp && !clean) {
+            ESP_LOGW(TAG, "segment %08" PRIx32 ": torn after %u bytes", seg, (unsigned)off);
+        }
+        s_spool.seg_recs[seg % DEBI_SPOOL_SEGMENTS] = n;
+        total += n;
+        if (seg == last) {
+            s_spool.seg_len = clean ? off : DEBI_SPOOL_SEGMENT_BYTES;
+            break;
+        }
+    }
+
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    s_spool.stats.pending += total;
+    update_segments();
+    xSemaphoreGive(s_spool.lock);
+    ESP_LOGI(TAG, "%s: %" PRIu32 " records in %" PRIu32 " segments",
+             s_spool.dir, total, last - first + 1);
+}
+
+/* Hand the filling batch to the writer if it has records.  Lock held. */
+static void swap_batch(void)
+{
+    int fill = s_spool.fill;
+    if (s_spool.batch_len[fill] > 0 && s_spool.batch_len[!fill] == 0) {
+        s_spool.fill = !fill;
+    }
+}
+
+/* Append the waiting batch in one write. */
+static void write_batch(void)
+{
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    int idx = !s_spool.fill;
+    size_t len = s_spool.batch_len[idx];
+    uint32_t recs = s_spool.batch_recs[idx];
+    xSemaphoreGive(s_spool.lock);
+    if (len == 0) return;
+
+    if (s_spool.seg_len > 0 && s_spool.seg_len + len > DEBI_SPOOL_SEGMENT_BYTES) {
+        s_spool.seg_write++;
+        s_spool.seg_len = 0;
+        while (s_spool.seg_write - s_spool.seg_first >= DEBI_SPOOL_SEGMENTS) {
+            drop_first();
+        }
+    }
+
+    char path[SPOOL_PATH_MAX];
+    path_get(s_spool.seg_write, path);
+    FILE *fp = fopen(path, "ab");
+    bool ok = fp && fwrite(s_spool.batch[idx], len, 1, fp) == 1 &&
+              fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fp && fclose(fp) != 0) ok = false;
+
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    if (ok) {
+        s_spool.seg_len += len;
+        s_spool.seg_recs[s_spool.seg_write % DEBI_SPOOL_SEGMENTS] += recs;
+    } else {
+        /* Part of it may be on flash: never append behind it */
+        s_spool.seg_len = DEBI_SPOOL_SEGMENT_BYTES;
+        s_spool.stats.pending -= recs;
+        s_spool.stats.dropped += recs;
+        s_spool.stats.write_errors++;
+    }
+    s_spool.batch_len[idx] = 0;
+    s_spool.batch_recs[idx] = 0;
+    update_segments();
+    xSemaphoreGive(s_spool.lock);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "write to %s failed, %" PRIu32 " records lost", path, recs);
+    }
+}
+
+/*
+ * Send up to DEBI_SPOOL_REPLAY_BYTES (at least one record), oldest
+ * first.  A record counts as replayed once send() took it.
+ *
+ * @return true when everything on flash has been sent
+ */
+static bool replay_some(void)
+{
+    size_t budget = DEBI_SPOOL_REPLAY_BYTES;
+    bool sent_any = false;
+    FILE *fp = NULL;
+    char path[SPOOL_PATH_MAX];
+    rec_info_t ri;
+
+    while (1) {
+        if (s_spool.seg_first == s_spool.seg_write &&
+            s_spool.read_off >= s_spool.seg_len) {
+            if (s_spool.seg_len > 0) {
+                drop_first();            /* all sent */
+            }
+            return true;
+        }
+        if (!fp) {
+            path_get(s_spool.seg_first, path);
+            fp = fopen(path, "rb");
+            if (fp && fseek(fp, s_spool.read_off, SEEK_SET) != 0) {
+                fclose(fp);
+                fp = NULL;
+            }
+            if (!fp) {
+                drop_first();
+                continue;
+            }
+        }
+        if (!read_rec(fp, &ri)) {        /* end of segment, or a torn tail */
+            fclose(fp);
+            fp = NULL;
+            drop_first();
+            continue;
+        }
+        if (sent_any && ri.len > budget) break;
+
+        const char *topic = (const char *)s_spool.rec;
+        if (s_spool.send(topic, topic + ri.topic_len + 1, ri.payload_len,
+                         ri.qos, ri.retain) != 0) {
+            break;                       /* same record next round */
+        }
+
+        uint32_t *recs = &s_spool.seg_recs[s_spool.seg_first % DEBI_SPOOL_SEGMENTS];
+        if (*recs) (*recs)--;
+        s_spool.read_off += ri.len;
+
+        xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+        if (s_spool.stats.pending) s_spool.stats.pending--;
+        s_spool.stats.replayed++;
+        xSemaphoreGive(s_spool.lock);
+
+        sent_any = true;
+        budget = ri.len < budget ? budget - ri.len : 0;
+        if (budget == 0) break;
+    }
+    if (fp) fclose(fp);
+    return false;
+}
+
+/*
+ * Wakes for a full batch, a replay request, every replay round, and
+ * otherwise every DEBI_SPOOL_FLUSH_MS to write a partial batch.
+ */
+static void spool_task(void *arg)
+{
+    spool_load();
+
+    while (1) {
+        xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+        int wait_ms = s_spool.replaying ? s_spool.pace_ms : DEBI_SPOOL_FLUSH_MS;
+        xSemaphoreGive(s_spool.lock);
+
+        bool timeout = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) == 0;
+
+        write_batch();
+        xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+        bool replaying = s_spool.replaying;
+        if (timeout || replaying) {
+            swap_batch();                /* replay reads from flash only */
+        }
+        xSemaphoreGive(s_spool.lock);
+        write_batch();
+
+        if (replaying && replay_some()) {
+            xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+            bool done = s_spool.batch_len[0] == 0 && s_spool.batch_len[1] == 0;
+            if (done) s_spool.replaying = false;
+            uint32_t replayed = s_spool.stats.replayed;
+            xSemaphoreGive(s_spool.lock);
+            if (done) {
+                ESP_LOGI(TAG, "replay done, %" PRIu32 " records since boot", replayed);
+            }
+        }
+    }
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_spool_init(debi_spool_send_t send)
+{
+    ESP_RETURN_ON_FALSE(send, ESP_ERR_INVALID_ARG, TAG, "no send callback");
+    if (s_spool.task) return ESP_OK;
+
+    /* board_init mounts the sd card only when one is inserted */
+    DIR *sd = opendir(DRV_BASE_PATH_SD);
+    if (sd) closedir(sd);
+    snprintf(s_spool.dir, sizeof(s_spool.dir), "%s",
+             sd ? DRV_BASE_PATH_SD : DRV_BASE_PATH_FLASH);
+
+    s_spool.send    = send;
+    s_spool.pace_ms = DEBI_SPOOL_REPLAY_MAX_MS;
+    s_spool.lock    = xSemaphoreCreateMutex();
+
+    /* Two batches and one record to read back, in PSRAM */
+    uint8_t *mem = heap_caps_malloc(3 * DEBI_SPOOL_BATCH_BYTES + 1, MALLOC_CAP_SPIRAM);
+    if (mem) {
+        s_spool.batch[0] = mem;
+        s_spool.batch[1] = mem + DEBI_SPOOL_BATCH_BYTES;
+        s_spool.rec      = mem + 2 * DEBI_SPOOL_BATCH_BYTES;
+    }
+    if (!s_spool.lock || !mem ||
+        xTaskCreate(spool_task, "debi_spool", SPOOL_TASK_STACK, NULL,
+                    SPOOL_TASK_PRIO, &s_spool.task) != pdPASS) {
+        ESP_LOGE(TAG, "spool start failed");
+        free(mem);
+        if (s_spool.lock) vSemaphoreDelete(s_spool.lock);
+        memset(&s_spool, 0, sizeof(s_spool));
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "spool on %s  %d x %d bytes  batch=%d",
+             s_spool.dir, DEBI_SPOOL_SEGMENTS, DEBI_SPOOL_SEGMENT_BYTES,
+             DEBI_SPOOL_BATCH_BYTES);
+    return ESP_OK;
+}
+
+bool debi_spool_put(const char *topic, const void *data, size_t len,
+                    int qos, bool retain)
+{
+    if (!s_spool.task || !topic || !data) return false;
+
+    size_t topic_len = strlen(topic);
+    size_t rec_len = SPOOL_HDR_LEN + topic_len + len;
+    if (topic_len == 0 || rec_len > DEBI_SPOOL_BATCH_BYTES) return false;
+
+    uint8_t hdr[SPOOL_HDR_LEN];
+    put_u16(hdr, DEBI_SPOOL_MAGIC);
+    hdr[2] = qos;
+    hdr[3] = retain;
+    put_u16(hdr + 4, topic_len);
+    put_u16(hdr + 6, len);
+    put_u32(hdr + 8, rec_crc(hdr, topic, topic_len, data, len));
+
+    bool notify = false;
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    int fill = s_spool.fill;
+    if (s_spool.batch_len[fill] + rec_len > DEBI_SPOOL_BATCH_BYTES) {
+        if (s_spool.batch_len[!fill] > 0) {      /* writer a batch behind */
+            xSemaphoreGive(s_spool.lock);
+            return false;
+        }
+        s_spool.fill = fill = !fill;
+        notify = true;
+    }
+    uint8_t *p = s_spool.batch[fill] + s_spool.batch_len[fill];
+    memcpy(p, hdr, SPOOL_HDR_LEN);
+    memcpy(p + SPOOL_HDR_LEN, topic, topic_len);
+    memcpy(p + SPOOL_HDR_LEN + topic_len, data, len);
+    s_spool.batch_len[fill] += rec_len;
+    s_spool.batch_recs[fill]++;
+    s_spool.stats.spooled++;
+    s_spool.stats.pending++;
+    xSemaphoreGive(s_spool.lock);
+
+    if (notify) xTaskNotifyGive(s_spool.task);
+    return true;
+}
+
+void debi_spool_replay(int rtt_ms)
+{
+    if (!s_spool.task) return;
+
+    int pace_ms = rtt_ms < 0 ? DEBI_SPOOL_REPLAY_MAX_MS : rtt_ms;
+    if (pace_ms < DEBI_SPOOL_REPLAY_MIN_MS) pace_ms = DEBI_SPOOL_REPLAY_MIN_MS;
+    if (pace_ms > DEBI_SPOOL_REPLAY_MAX_MS) pace_ms = DEBI_SPOOL_REPLAY_MAX_MS;
+
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    s_spool.replaying = true;
+    s_spool.pace_ms   = pace_ms;
+    xSemaphoreGive(s_spool.lock);
+    xTaskNotifyGive(s_spool.task);
+}
+
+void debi_spool_pause(void)
+{
+    if (!s_spool.task) return;
+
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    s_spool.replaying = false;
+    xSemaphoreGive(s_spool.lock);
+}
+
+void debi_spool_get_stats(debi_spool_stats_t *out)
+{
+    if (!s_spool.task) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_spool.lock, portMAX_DELAY);
+    *out = s_spool.stats;
+    xSemaphoreGive(s_spool.lock);
+}
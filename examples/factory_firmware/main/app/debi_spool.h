@@ -0,0 +1,135 @@
+/**
+ * @file debi_spool.h
+ * @brief Debi Spool — On-flash history kept while the hub is away
+ *
+ * debi_comms hands detections and sensor readings here while the hub
+ * is unreachable, and replays them once it is back.  The log lives on
+ * the SD card when one is mounted, on SPIFFS otherwise:
+ *
+ *   dsplXXXXXXXX.log   segment files, XXXXXXXX = segment number (hex)
+ *
+ * Segments are append-only sequences of records:
+ *
+ *   record header (12 bytes, little-endian)
+ *     0  u16   magic  DEBI_SPOOL_MAGIC
+ *     2  u8    qos
+ *     3  u8    retain
+ *     4  u16   topic_len
+ *     6  u16   payload_len
+ *     8  u32   crc32 of bytes 0..7, topic and payload
+ *   topic (no NUL) | payload
+ *
+ * Records collect in RAM and go to flash DEBI_SPOOL_BATCH_BYTES at a
+ * time (or after DEBI_SPOOL_FLUSH_MS), each batch a single append and
+ * fsync.  A segment that took a torn write is never appended to
+ * again, so after a power cut the log reads back up to the last whole
+ * record and nothing past it; only the unwritten RAM batch is lost.
+ * The oldest segment is deleted when DEBI_SPOOL_SEGMENTS are in use.
+ *
+ * Replay is at least once: the read position is not stored, so a
+ * reboot mid-replay sends the current segment again.  Messages keep
+ * their own timestamps.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEBI_SPOOL_MAGIC                0x5344   /* "DS" */
+
+/* ── Log size (tunable) ── */
+#ifndef DEBI_SPOOL_SEGMENT_BYTES
+#define DEBI_SPOOL_SEGMENT_BYTES        32768  /* one file */
+#endif
+
+#ifndef DEBI_SPOOL_SEGMENTS
+#define DEBI_SPOOL_SEGMENTS             16     /* files kept, oldest goes first */
+#endif
+
+#ifndef DEBI_SPOOL_BATCH_BYTES
+#define DEBI_SPOOL_BATCH_BYTES          4096   /* one flash write, largest record */
+#endif
+
+#ifndef DEBI_SPOOL_FLUSH_MS
+#define DEBI_SPOOL_FLUSH_MS             5000   /* a partial batch waits this long */
+#endif
+
+/* ── Replay pacing (tunable) ── */
+#ifndef DEBI_SPOOL_REPLAY_BYTES
+#define DEBI_SPOOL_REPLAY_BYTES         2048   /* per hub round trip, at least one record */
+#endif
+
+#ifndef DEBI_SPOOL_REPLAY_MIN_MS
+#define DEBI_SPOOL_REPLAY_MIN_MS        50
+#endif
+
+#ifndef DEBI_SPOOL_REPLAY_MAX_MS
+#define DEBI_SPOOL_REPLAY_MAX_MS        1000   /* also used while the RTT is unknown */
+#endif
+
+/**
+ * Sends one replayed record.
+ *
+ * @return 0 once the message is handed to MQTT, anything else to
+ *         retry the same record on the next round
+ */
+typedef int (*debi_spool_send_t)(const char *topic, const void *data,
+                                 size_t len, int qos, bool retain);
+
+typedef struct {
+    uint32_t pending;              /* records not replayed yet, RAM + flash */
+    uint32_t segments;             /* segment files in use */
+    uint32_t spooled;              /* records taken since boot */
+    uint32_t replayed;
+    uint32_t dropped;              /* lost to full segments or bad writes */
+    uint32_t write_errors;
+} debi_spool_stats_t;
+
+/**
+ * Pick the storage, start the spool task and pick up the log left by
+ * the last run.
+ *
+ * @param send  called from the spool task for every replayed record
+ */
+esp_err_t debi_spool_init(debi_spool_send_t send);
+
+/**
+ * Append one message.  Copies into RAM and returns; the flash write
+ * happens in the spool task.  Safe to call from any task or esp_timer
+ * callback.
+ *
+ * @return false if the spool is not running, the record is larger
+ *         than a batch, or the writer is a full batch behind
+ */
+bool debi_spool_put(const char *topic, const void *data, size_t len,
+                    int qos, bool retain);
+
+/**
+ * Start (or re-pace) replay: about DEBI_SPOOL_REPLAY_BYTES per round
+ * trip, clamped to DEBI_SPOOL_REPLAY_MIN_MS..MAX_MS.
+ *
+ * @param rtt_ms  hub round trip, < 0 if not measured yet
+ */
+void debi_spool_replay(int rtt_ms);
+
+/**
+ * Stop replaying; records stay on flash.
+ */
+void debi_spool_pause(void);
+
+/**
+ * Snapshot spool statistics.
+ */
+void debi_spool_get_stats(debi_spool_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -10,20 +10,113 @@
 
 #include "debi_taskflow.h"
 #include <string.h>
+#include "sdkconfig.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "event_loops.h"
 #include "data_defs.h"
+#include "debi_models.h"
+#include "debi_face_bridge.h"
+#include "debi_camera.h"
+#include "debi_tracks.h"
+#include "debi_failover.h"
+#include "tf.h"
+#include "task_flow_module/common/tf_module_data_type.h"
 
 static const char *TAG = "debi_tf";
 
+#if CONFIG_DEBI_TASKFLOW_MULTI_MODEL
+/* How long a running or restored task flow gets to stop */
+#ifndef DEBI_TASKFLOW_STOP_WAIT_MS
+#define DEBI_TASKFLOW_STOP_WAIT_MS  10000
+#endif
+
+/* Model ids match the local task flows in app_taskflow.c */
+static const debi_model_cfg_t s_models[] = {
+    { .name = "person",  .model_id = 1, .rate_hz = 5.0f },
+    { .name = "gesture", .model_id = 3, .rate_hz = 1.0f },
+    { .name = "pet",     .model_id = 2, .rate_hz = 1.0f },
+};
+
+static const debi_model_cfg_t s_local_models[] = {
+    { .name = "person",  .model_id = 1, .rate_hz = DEBI_TASKFLOW_LOCAL_PERSON_HZ },
+};
+
+/* The scheduler owns the WE2: set once boot stopped the task flow */
+static volatile bool s_scheduler_on;
+
+static void on_model_result(int slot, const debi_model_cfg_t *cfg,
+                            const debi_model_result_t *result,
+                            char *const *classes, void *ctx)
+{
+    struct tf_data_inference_info info = {
+        .is_valid = true,
+        .type     = INFERENCE_TYPE_BOX,
+        .p_data   = (void *)result->boxes,
+        .cnt      = result->box_count,
+    };
+    for (int i = 0; i < CONFIG_MODEL_CLASSES_MAX_NUM && i < SSCMA_CLIENT_MODEL_MAX_CLASSES; i++) {
+        info.classes[i] = classes[i];
+    }
+    debi_face_bridge_feed_inference(&info);
+
+    /* Person boxes are tracked as the preview path does, for the hub
+     * and for the local fall check */
+    if (strcmp(cfg->name, "person") == 0) {
+        debi_camera_stamp_t stamp;
+        uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+        debi_camera_stamp(result->ts_us, &stamp);
+        debi_tracks_report(&info, &stamp, ids);
+        debi_failover_observe(&info, ids, stamp.ts_us);
+    }
+}
+
+/* The scheduler takes over the SSCMA client callbacks, so a task flow
+ * restored at boot must release the camera first */
+static esp_err_t stop_task_flow(void)
+{
+    int status = TF_STATUS_IDLE;
+
+    esp_err_t err = esp_event_post_to(app_event_loop_handle,
+                                      VIEW_EVENT_BASE,
+                                      VIEW_EVENT_TASK_FLOW_STOP,
+                                      NULL, 0,
+                                      pdMS_TO_TICKS(1000));
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (int waited = 0; waited < DEBI_TASKFLOW_STOP_WAIT_MS; waited += 100) {
+        tf_engine_status_get(&status);
+        if (status != TF_STATUS_RUNNING && status != TF_STATUS_STARTING &&
+            status != TF_STATUS_STOPING && status != TF_STATUS_PAUSE) {
+            return ESP_OK;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    ESP_LOGE(TAG, "task flow still running (status %d)", status);
+    return ESP_ERR_TIMEOUT;
+}
+#endif
+
 static void debi_taskflow_start_task(void *arg)
 {
     /* Wait for task flow engine to fully initialise */
     vTaskDelay(pdMS_TO_TICKS(3000));
 
+#if CONFIG_DEBI_TASKFLOW_MULTI_MODEL
+    ESP_LOGI(TAG, "Starting multi-model scheduler");
+    esp_err_t err = stop_task_flow();
+    if (err == ESP_OK) {
+        debi_models_set_result_cb(on_model_result, NULL);
+        err = debi_models_start(s_models, sizeof(s_models) / sizeof(s_models[0]));
+    }
+    s_scheduler_on = err == ESP_OK;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start multi-model scheduler: %s", esp_err_to_name(err));
+    }
+#else
     ESP_LOGI(TAG, "Starting person detection task flow");
 
     uint32_t tf_num = 2;  /* 0=gesture, 1=pet, 2=person */
@@ -37,6 +130,7 @@ static void debi_taskflow_start_task(void *arg)
     } else {
         ESP_LOGI(TAG, "Person detection started successfully");
     }
+#endif
 
     vTaskDelete(NULL);
 }
@@ -54,9 +148,34 @@ esp_err_t debi_taskflow_init(void)
 void debi_taskflow_deinit(void)
 {
     ESP_LOGI(TAG, "Debi task flow deinit");
+#if CONFIG_DEBI_TASKFLOW_MULTI_MODEL
+    s_scheduler_on = false;
+    debi_models_stop();
+#endif
     esp_event_post_to(app_event_loop_handle,
                       VIEW_EVENT_BASE,
                       VIEW_EVENT_TASK_FLOW_STOP,
                       NULL, 0,
                       pdMS_TO_TICKS(1000));
 }
+
+esp_err_t debi_taskflow_set_local_only(bool on)
+{
+#if CONFIG_DEBI_TASKFLOW_MULTI_MODEL
+    /* Before boot took the WE2 over a task flow may still hold it */
+    if (!s_scheduler_on) {
+        ESP_LOGW(TAG, "scheduler not started, models left as they are");
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_LOGI(TAG, "%s", on ? "local only: person model" : "all models");
+    debi_models_stop();
+    if (on) {
+        return debi_models_start(s_local_models,
+                                 sizeof(s_local_models) / sizeof(s_local_models[0]));
+    }
+    return debi_models_start(s_models, sizeof(s_models) / sizeof(s_models[0]));
+#else
+    (void)on;   /* the person task flow is the local model already */
+    return ESP_OK;
+#endif
+}
@@ -9,12 +9,24 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * CONFIG_DEBI_TASKFLOW_MULTI_MODEL (on by default): time-slice
+ * person/gesture/pet on the WE2 with debi_models instead of running
+ * the single-model person task flow.
+ */
+
+/* Person model rate while the Watcher runs without its hub */
+#ifndef DEBI_TASKFLOW_LOCAL_PERSON_HZ
+#define DEBI_TASKFLOW_LOCAL_PERSON_HZ   10.0f
+#endif
+
 /**
  * Initialise the Debi task flow.
  * Starts the WiseEye2 person detection model immediately.
@@ -26,6 +38,19 @@ esp_err_t debi_taskflow_init(void);
  */
 void debi_taskflow_deinit(void);
 
+/**
+ * Switch the WE2 to (or back from) person detection only, for
+ * debi_failover while the hub is unreachable.  With the multi-model
+ * scheduler this drops gesture and pet and runs the person model at
+ * DEBI_TASKFLOW_LOCAL_PERSON_HZ; the single task flow already runs the
+ * person model and is left alone.  Blocks until the current model
+ * slice ends.
+ *
+ * @return ESP_ERR_INVALID_STATE: the scheduler has not taken over the
+ *         WE2 yet, nothing was switched.
+ */
+esp_err_t debi_taskflow_set_local_only(bool on);
+
 #ifdef __cplusplus
 }
 #endif
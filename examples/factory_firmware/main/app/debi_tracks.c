@@ -0,0 +1,226 @@
+/**
+ * @file debi_tracks.c
+ * @brief Debi Tracks — Per-frame detection boxes with track ids
+ *
+ * ByteTrack keeps its own Kalman-smoothed boxes; the hub gets the
+ * camera's boxes unchanged, each tagged with the id of the track it
+ * overlaps most.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+
+#include "debi_tracks.h"
+#include "debi_comms.h"
+#include "debi_os.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "bytetrack_c_api.h"
+
+static const char *TAG = "debi_tracks";
+
+#define TRACKS_MSG_MAX  (DEBI_TRACKS_HEADER_LEN + DEBI_TRACKS_MAX_BOXES * DEBI_TRACKS_BOX_LEN)
+
+/* ── Internal state ── */
+typedef struct {
+    bt_handler_t         tracker;
+    bt_bbox_t            dets[DEBI_TRACKS_MAX_BOXES];
+    bt_bbox_t            tracks[DEBI_TRACKS_MAX_BOXES];
+    uint16_t             ids[DEBI_TRACKS_MAX_BOXES];
+    uint8_t              msg[TRACKS_MSG_MAX];
+    bool                 last_empty;   /* the last message sent was empty */
+    debi_tracks_stats_t  stats;
+} tracks_state_t;
+
+static tracks_state_t s_tracks = { .last_empty = true };
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* ────────────────────────────────────────────────────
+ *  Helpers
+ * ──────────────────────────────────────────────────── */
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, v);
+    return put_u16(p, v >> 16);
+}
+
+static float box_iou(const bt_bbox_t *a, const bt_bbox_t *b)
+{
+    float x0 = a->tlwh[0] > b->tlwh[0] ? a->tlwh[0] : b->tlwh[0];
+    float y0 = a->tlwh[1] > b->tlwh[1] ? a->tlwh[1] : b->tlwh[1];
+    float x1 = a->tlwh[0] + a->tlwh[2] < b->tlwh[0] + b->tlwh[2] ?
+               a->tlwh[0] + a->tlwh[2] : b->tlwh[0] + b->tlwh[2];
+    float y1 = a->tlwh[1] + a->tlwh[3] < b->tlwh[1] + b->tlwh[3] ?
+               a->tlwh[1] + a->tlwh[3] : b->tlwh[1] + b->tlwh[3];
+    if (x1 <= x0 || y1 <= y0) return 0.0f;
+
+    float inter = (x1 - x0) * (y1 - y0);
+    float uni = a->tlwh[2] * a->tlwh[3] + b->tlwh[2] * b->tlwh[3] - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+/* Give each detection the id of the free track it overlaps most */
+static void match_ids(size_t n_dets, size_t n_tracks)
+{
+    bool taken[DEBI_TRACKS_MAX_BOXES] = { 0 };
+
+    for (size_t i = 0; i < n_dets; i++) {
+        float best_iou = DEBI_TRACKS_MATCH_IOU_PCT / 100.0f;
+        int best = -1;
+        for (size_t j = 0; j < n_tracks; j++) {
+            if (taken[j]) continue;
+            float iou = box_iou(&s_tracks.dets[i], &s_tracks.tracks[j]);
+            if (iou >= best_iou) {
+                best_iou = iou;
+                best = (int)j;
+            }
+        }
+        s_tracks.ids[i] = 0;
+        if (best >= 0 && s_tracks.tracks[best].track_id > 0) {
+            taken[best] = true;
+            s_tracks.ids[i] = (uint16_t)((s_tracks.tracks[best].track_id - 1) % 65535 + 1);
+        }
+    }
+}
+
+static size_t encode(const sscma_client_box_t *boxes, size_t n,
+                     const debi_camera_stamp_t *stamp)
+{
+    uint8_t *p = s_tracks.msg;
+    *p++ = 'D';
+    *p++ = 'T';
+    *p++ = DEBI_TRACKS_PROTO_VERSION;
+    *p++ = (uint8_t)n;
+    p = put_u32(p, stamp->frame_id);
+    p = put_u32(p, (uint32_t)stamp->ts_us);
+    p = put_u32(p, (uint32_t)((uint64_t)stamp->ts_us >> 32));
+
+    for (size_t i = 0; i < n; i++) {
+        p = put_u16(p, boxes[i].x);
+        p = put_u16(p, boxes[i].y);
+        p = put_u16(p, boxes[i].w);
+        p = put_u16(p, boxes[i].h);
+        *p++ = boxes[i].score;
+        *p++ = boxes[i].target;
+        p = put_u16(p, s_tracks.ids[i]);
+    }
+    return p - s_tracks.msg;
+}
+
+/* ────────────────────────────────────────────────────
+ *  Public API
+ * ──────────────────────────────────────────────────── */
+
+esp_err_t debi_tracks_init(void)
+{
+    if (s_tracks.tracker) return ESP_OK;
+
+    /* A lost track is kept frame_rate / 30 * track_buffer frames */
+    bt_config_t cfg = BT_CONFIG_DEFAULT();
+    cfg.frame_rate   = 30;
+    cfg.track_buffer = DEBI_TRACKS_LOST_FRAMES;
+
+    s_tracks.tracker = bt_tracker_create(&cfg);
+    ESP_RETURN_ON_FALSE(s_tracks.tracker, ESP_ERR_NO_MEM, TAG, "tracker create failed");
+
+    ESP_LOGI(TAG, "tracker ready  lost=%d frames  iou=%d%%",
+             DEBI_TRACKS_LOST_FRAMES, DEBI_TRACKS_MATCH_IOU_PCT);
+    return ESP_OK;
+}
+
+void debi_tracks_report(const struct tf_data_inference_info *info,
+                        const debi_camera_stamp_t *stamp, uint16_t *ids)
+{
+    if (ids) {
+        memset(ids, 0, DEBI_TRACKS_MAX_BOXES * sizeof(ids[0]));
+    }
+    if (!info || !stamp || !info->is_valid || info->type != INFERENCE_TYPE_BOX) {
+        return;
+    }
+    if (!s_tracks.tracker && debi_tracks_init() != ESP_OK) {
+        return;
+    }
+
+    const sscma_client_box_t *boxes = (const sscma_client_box_t *)info->p_data;
+    size_t n = boxes ? info->cnt : 0;
+    if (n > DEBI_TRACKS_MAX_BOXES) {
+        n = DEBI_TRACKS_MAX_BOXES;
+    }
+
+    /* sscma boxes are centre based, ByteTrack wants top-left */
+    for (size_t i = 0; i < n; i++) {
+        bt_bbox_t *d = &s_tracks.dets[i];
+        d->tlwh[0]  = boxes[i].x - boxes[i].w / 2.0f;
+        d->tlwh[1]  = boxes[i].y - boxes[i].h / 2.0f;
+        d->tlwh[2]  = boxes[i].w;
+        d->tlwh[3]  = boxes[i].h;
+        d->prob     = boxes[i].score / 100.0f;
+        d->label    = boxes[i].target;
+        d->track_id = 0;
+    }
+
+    /* Empty frames too: that is how lost tracks age out */
+    bt_bbox_t *tracks = s_tracks.tracks;
+    size_t n_tracks = DEBI_TRACKS_MAX_BOXES;
+    if (bt_tracker_update(s_tracks.tracker, s_tracks.dets, n,
+                          &tracks, &n_tracks) != BT_ERR_OK) {
+        ESP_LOGW(TAG, "tracker update failed");
+        n_tracks = 0;
+    }
+    match_ids(n, n_tracks);
+    if (ids) {
+        memcpy(ids, s_tracks.ids, n * sizeof(ids[0]));
+    }
+
+    uint32_t tracked = 0, max_id = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (s_tracks.ids[i]) tracked++;
+    }
+    for (size_t j = 0; j < n_tracks; j++) {
+        if ((uint32_t)s_tracks.tracks[j].track_id > max_id) {
+            max_id = s_tracks.tracks[j].track_id;
+        }
+    }
+
+    /* One empty message closes the hub's tracks; repeats say nothing.
+     * last_empty is what the hub last got, so a scene that emptied
+     * while the hub was away is closed once it is back */
+    bool send = n > 0 || !s_tracks.last_empty;
+    if (send && debi_os_hub_connected()) {
+        size_t len = encode(boxes, n, stamp);
+        send = debi_comms_publish_bin(DEBI_TOPIC_TRACKS, s_tracks.msg, len, 0, false) == 0;
+    } else {
+        send = false;
+    }
+    if (send) {
+        s_tracks.last_empty = n == 0;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_tracks.stats.frames++;
+    s_tracks.stats.sent += send;
+    s_tracks.stats.tracked_boxes += tracked;
+    s_tracks.stats.untracked_boxes += n - tracked;
+    if (max_id > s_tracks.stats.max_track_id) {
+        s_tracks.stats.max_track_id = max_id;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+void debi_tracks_get_stats(debi_tracks_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_mux);
+    *out = s_tracks.stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file debi_tracks.h
+ * @brief Debi Tracks — Per-frame detection boxes with track ids
+ *
+ * Runs ByteTrack (components/byte_track) over the AI camera boxes and
+ * sends every box of a frame to the hub in one small binary message,
+ * so the hub's fall pipeline can follow each person's trajectory.
+ * The frame id and timestamp are the ones debi_camera gives the JPEG
+ * of the same frame.  All fields are little-endian:
+ *
+ *   header (DEBI_TRACKS_HEADER_LEN bytes)
+ *     0  u8[2] magic "DT"
+ *     2  u8    version (DEBI_TRACKS_PROTO_VERSION)
+ *     3  u8    count      boxes that follow
+ *     4  u32   frame_id   as in the camera frame header
+ *     8  u64   ts_us      as in the camera frame header
+ *
+ *   box (DEBI_TRACKS_BOX_LEN bytes), sscma_client_box_t packed + id
+ *     0  u16   x          box centre, model input pixels
+ *     2  u16   y
+ *     4  u16   w
+ *     6  u16   h
+ *     8  u8    score      0-100
+ *     9  u8    target     class id
+ *    10  u16   track_id   1..65535 (wraps), 0 = not tracked
+ *
+ * A message goes out for every frame with boxes, plus one empty
+ * message when the scene empties so the hub can close its tracks.
+ * Nothing goes out while the hub is away; a scene that emptied in
+ * the meantime gets its empty message once the hub is back.
+ * tools/debi_tracks_decoder.py is the hub-side reference.
+ *
+ * Copyright (c) 2026 Debi Guardian
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "debi_camera.h"
+#include "task_flow_module/common/tf_module_data_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ── Wire format ── */
+#define DEBI_TOPIC_TRACKS               "debi/watcher/detection/bin"
+
+#define DEBI_TRACKS_PROTO_VERSION       1
+#define DEBI_TRACKS_HEADER_LEN          16
+#define DEBI_TRACKS_BOX_LEN             12
+
+/* ── Tracking (tunable) ── */
+#ifndef DEBI_TRACKS_MAX_BOXES
+#define DEBI_TRACKS_MAX_BOXES           16     /* boxes per frame, rest ignored */
+#endif
+
+#ifndef DEBI_TRACKS_LOST_FRAMES
+#define DEBI_TRACKS_LOST_FRAMES         15     /* frames a lost track may come back */
+#endif
+
+#ifndef DEBI_TRACKS_MATCH_IOU_PCT
+#define DEBI_TRACKS_MATCH_IOU_PCT       30     /* box <-> track overlap to share an id */
+#endif
+
+typedef struct {
+    uint32_t frames;               /* inferences run through the tracker */
+    uint32_t sent;
+    uint32_t tracked_boxes;        /* boxes that got a track id */
+    uint32_t untracked_boxes;
+    uint32_t max_track_id;
+} debi_tracks_stats_t;
+
+/**
+ * Create the tracker.  Called lazily by debi_tracks_report() too.
+ */
+esp_err_t debi_tracks_init(void);
+
+/**
+ * Track the boxes of one camera frame and send them to the hub.
+ * Non-box inferences are ignored.  Not reentrant: call from one task.
+ *
+ * @param info   inference of the frame
+ * @param stamp  the frame's id and time from debi_camera_stamp()
+ * @param ids    optional, DEBI_TRACKS_MAX_BOXES entries: the track id
+ *               of each box, 0 = not tracked, all 0 for a non-box
+ *               inference
+ */
+void debi_tracks_report(const struct tf_data_inference_info *info,
+                        const debi_camera_stamp_t *stamp, uint16_t *ids);
+
+/**
+ * Snapshot tracker statistics.
+ */
+void debi_tracks_get_stats(debi_tracks_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -255,7 +255,7 @@ enum {
     VIEW_EVENT_OTA_STATUS,  //struct view_data_ota_status, this is the merged status reporting, e.g. both himax and esp32 ota
 
     VIEW_EVENT_AI_CAMERA_READY,
-    VIEW_EVENT_AI_CAMERA_PREVIEW, // struct tf_module_ai_camera_preview_info (tf_module_ai_camera.h), There can only be one listener
+    VIEW_EVENT_AI_CAMERA_PREVIEW, // struct tf_module_ai_camera_preview_info (tf_module_ai_camera.h), There can only be one listener, it frees img and inference
     VIEW_EVENT_AI_CAMERA_SAMPLE,  // NULL
 
     VIEW_EVENT_SENSOR,       // display update for sensor data
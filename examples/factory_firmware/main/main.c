@@ -40,6 +40,10 @@
 #include "debi_taskflow.h"
 #include "debi_voice.h"
 #include "debi_comms.h"
+#include "debi_failover.h"
+#include "debi_hub.h"
+#include "debi_clock.h"
+#include "debi_audio.h"
 #include "app_wifi.h"
 #include "debi_wifi.h"
 
@@ -174,6 +178,7 @@ void app_init(void)
 {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    debi_clock_init();      /* DEBI: media clock, before the mic is read */
     app_audio_player_init();
     app_audio_recorder_init();
     app_rgb_init();
@@ -193,8 +198,11 @@ void app_init(void)
     debi_taskflow_init();   /* DEBI: person detection auto-start */
     debi_comms_init();      /* DEBI: mutex & queue */
     debi_voice_init();      /* DEBI: audio module */
+    debi_audio_init();      /* DEBI: Opus uplink, after the recorder */
     debi_face_bridge_init();/* DEBI: face bridge */
+    debi_hub_init();        /* DEBI: hub discovery */
     debi_os_init();         /* DEBI: MQTT */
+    debi_failover_init();   /* DEBI: local-only mode without the hub */
 }
 
 void task_app_init(void *p_arg)
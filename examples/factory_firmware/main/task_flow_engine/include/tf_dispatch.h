@@ -0,0 +1,117 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Task flow event dispatcher.
+ *
+ * Every subscribed event id gets its own bounded mailbox, every mailbox is
+ * served by one worker task. Modules of one type always share a worker, so
+ * handlers of the same type never run concurrently, while a slow sink on
+ * one worker no longer holds up the frame path on another.
+ */
+
+// workers, see tf_dispatch.c for their stack, priority and core
+#define TF_DISPATCH_WORKER_FRAME     0   // frame path: camera, triggers, timers
+#define TF_DISPATCH_WORKER_ALARM     1   // local feedback: screen, sound, rgb
+#define TF_DISPATCH_WORKER_UPLINK    2   // sinks that may block on uart or network
+#define TF_DISPATCH_WORKER_NUM       3
+
+#define TF_DISPATCH_MAILBOX_MAX      16
+
+#ifndef TF_DISPATCH_EVENT_SIZE_MAX
+#define TF_DISPATCH_EVENT_SIZE_MAX   192  // largest tf_data_* posted between modules
+#endif
+
+#define TF_DISPATCH_DEPTH_DEFAULT    8
+
+typedef enum {
+    TF_DISPATCH_POLICY_BLOCK = 0,      // wait up to ticks_to_wait for room, like the old event loop
+    TF_DISPATCH_POLICY_DROP_NEWEST,    // full mailbox rejects the new event, the poster frees it
+    TF_DISPATCH_POLICY_DROP_OLDEST,    // full mailbox evicts the oldest event through drop_cb
+} tf_dispatch_policy_t;
+
+typedef void (*tf_dispatch_drop_cb_t)(void *p_event_data);
+
+typedef struct {
+    int worker;                        // TF_DISPATCH_WORKER_*
+    int depth;                         // mailbox depth, 0: TF_DISPATCH_DEPTH_DEFAULT
+    tf_dispatch_policy_t policy;
+    tf_dispatch_drop_cb_t drop_cb;     // frees a dropped event, required by DROP_OLDEST
+} tf_dispatch_cfg_t;
+
+#define TF_DISPATCH_CFG_DEFAULT() {                 \
+    .worker = TF_DISPATCH_WORKER_FRAME,             \
+    .depth = TF_DISPATCH_DEPTH_DEFAULT,             \
+    .policy = TF_DISPATCH_POLICY_BLOCK,             \
+    .drop_cb = NULL,                                \
+}
+
+typedef struct {
+    uint32_t posted;
+    uint32_t dropped;
+    uint32_t high_water;               // most events waiting at once
+    uint32_t handled;
+    uint32_t wait_max_us;              // longest an event waited in the mailbox for its handler
+    uint64_t wait_total_us;            // over handled events, / handled for the mean
+    uint32_t run_max_us;               // longest the handler took for one event
+    uint64_t run_total_us;             // time spent in the handler
+} tf_dispatch_stats_t;
+
+/**
+ * Create the worker tasks. Called once by tf_engine_init.
+ */
+esp_err_t tf_dispatch_init(void);
+
+/**
+ * Check a dispatch config, fills in the default depth.
+ *
+ * @return ESP_ERR_INVALID_ARG on an unknown worker or policy, or DROP_OLDEST without drop_cb.
+ */
+esp_err_t tf_dispatch_cfg_check(tf_dispatch_cfg_t *p_cfg);
+
+/**
+ * Open the mailbox of an event id and attach its handler.
+ * The handler is called on the worker of p_cfg with TF_EVENT_BASE as base.
+ *
+ * @return ESP_ERR_INVALID_STATE if the event id already has a handler,
+ *         ESP_ERR_NO_MEM if all mailboxes are in use.
+ */
+esp_err_t tf_dispatch_open(int32_t event_id, const tf_dispatch_cfg_t *p_cfg,
+                           esp_event_handler_t handler, void *handler_arg);
+
+/**
+ * Detach the handler and close the mailbox. Waits for a running handler to
+ * return, events still queued are passed to drop_cb.
+ */
+esp_err_t tf_dispatch_close(int32_t event_id, esp_event_handler_t handler);
+
+/**
+ * Copy an event into the mailbox of event_id, following its policy when full.
+ *
+ * @return ESP_OK: queued, the mailbox owns the event now.
+ *         ESP_ERR_TIMEOUT: not queued, the caller still owns the event.
+ *         ESP_ERR_NOT_FOUND: nobody subscribed to event_id.
+ *         ESP_ERR_INVALID_SIZE: event larger than TF_DISPATCH_EVENT_SIZE_MAX.
+ */
+esp_err_t tf_dispatch_post(int32_t event_id, const void *event_data,
+                           size_t event_data_size, TickType_t ticks_to_wait);
+
+esp_err_t tf_dispatch_stats_get(int32_t event_id, tf_dispatch_stats_t *p_stats);
+
+/**
+ * Clear the stats of every open mailbox.
+ */
+void tf_dispatch_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
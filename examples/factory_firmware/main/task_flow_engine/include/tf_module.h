@@ -1,60 +1,95 @@
-
-#pragma once
-#include <stdint.h>
-#include "cJSON.h"
-
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-
-struct tf_module_ops
-{
-    int (*start)(void *p_module);
-    int (*stop)(void *p_module);
-    int (*cfg)(void *p_module, cJSON *p_json);
-    int (*msgs_sub_set)(void *p_module, int evt_id);
-    int (*msgs_pub_set)(void *p_module, int output_index, int *p_evt_id, int num);
-};
-
-typedef struct 
-{
-    const struct tf_module_ops *ops;
-    void *p_module;
-} tf_module_t;
-
-
-typedef struct tf_module_mgmt {
-    tf_module_t *(*tf_module_instance)(void);
-    void (*tf_module_destroy)(tf_module_t *p_module);
-}tf_module_mgmt_t;
-
-
-static inline int tf_module_start(tf_module_t *handle)
-{
-    return handle->ops->start(handle->p_module);
-}
-
-static inline int tf_module_stop(tf_module_t *handle)
-{
-    return handle->ops->stop(handle->p_module);
-}
-
-static inline int tf_module_cfg(tf_module_t *handle, cJSON *p_json)
-{
-    return handle->ops->cfg(handle->p_module, p_json);
-}
-
-static inline int tf_module_msgs_sub_set(tf_module_t *handle, int evt_id)
-{
-    return handle->ops->msgs_sub_set(handle->p_module, evt_id);
-}
-
-static inline int tf_module_msgs_pub_set(tf_module_t *handle, int output_index, int *p_evt_id, int num)
-{
-    return handle->ops->msgs_pub_set(handle->p_module, output_index, p_evt_id, num);
-}
-
-#ifdef __cplusplus
-}
+
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct tf_module_ops
+{
+    int (*start)(void *p_module);
+    int (*stop)(void *p_module);
+    int (*cfg)(void *p_module, cJSON *p_json);
+    int (*msgs_sub_set)(void *p_module, int evt_id);
+    /*
+     * Called again on a started module when a flow updated in place rewires
+     * it: the new targets replace the old ones of the port, num 0 clears it.
+     * The module's own event handler or task may be publishing meanwhile.
+     */
+    int (*msgs_pub_set)(void *p_module, int output_index, int *p_evt_id, int num);
+
+    /*
+     * Optional. Apply new params to a started module without stopping it,
+     * used when a flow is updated in place. Return ESP_ERR_NOT_SUPPORTED if
+     * the change needs a restart, the engine then rebuilds the module.
+     */
+    int (*cfg_update)(void *p_module, cJSON *p_json);
+};
+
+typedef struct 
+{
+    const struct tf_module_ops *ops;
+    void *p_module;
+} tf_module_t;
+
+
+typedef struct tf_module_mgmt {
+    tf_module_t *(*tf_module_instance)(void);
+    void (*tf_module_destroy)(tf_module_t *p_module);
+}tf_module_mgmt_t;
+
+#define TF_DATA_TYPE_MASK(type)     (1UL << (type))
+#define TF_DATA_TYPE_MASK_ANY       0xffffffffUL
+#define TF_MODULE_OUTPUT_PORT_MAX   4
+
+/*
+ * Data types a module type takes and publishes, used to check the wires of
+ * a flow before any module is instanced. Types are TF_DATA_TYPE_* values.
+ */
+typedef struct tf_module_io {
+    uint32_t input_types;                              // mask of accepted types, 0: takes no input
+    int output_port_num;
+    uint32_t output_types[TF_MODULE_OUTPUT_PORT_MAX];  // mask of types each port may publish
+} tf_module_io_t;
+
+
+static inline int tf_module_start(tf_module_t *handle)
+{
+    return handle->ops->start(handle->p_module);
+}
+
+static inline int tf_module_stop(tf_module_t *handle)
+{
+    return handle->ops->stop(handle->p_module);
+}
+
+static inline int tf_module_cfg(tf_module_t *handle, cJSON *p_json)
+{
+    return handle->ops->cfg(handle->p_module, p_json);
+}
+
+static inline int tf_module_cfg_update(tf_module_t *handle, cJSON *p_json)
+{
+    if (handle->ops->cfg_update == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return handle->ops->cfg_update(handle->p_module, p_json);
+}
+
+static inline int tf_module_msgs_sub_set(tf_module_t *handle, int evt_id)
+{
+    return handle->ops->msgs_sub_set(handle->p_module, evt_id);
+}
+
+static inline int tf_module_msgs_pub_set(tf_module_t *handle, int output_index, int *p_evt_id, int num)
+{
+    return handle->ops->msgs_pub_set(handle->p_module, output_index, p_evt_id, num);
+}
+
+#ifdef __cplusplus
+}
 #endif
\ No newline at end of file
@@ -1,54 +1,76 @@
-
-#pragma once
-#include "tf_module.h"
-
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-
-struct tf_module_wires
-{
-    int *p_evt_id;
-    int num;
-};
-typedef struct tf_module_item
-{
-    int id;
-    int index;
-    const char *p_name;
-    cJSON *p_params;
-    struct tf_module_wires *p_wires;
-    int output_port_num;
-    tf_module_t *handle;
-    tf_module_mgmt_t *mgmt_handle;
-    uint32_t flag;
-} tf_module_item_t;
-
-typedef struct tf_info
-{
-    int type;
-    intmax_t tid;
-    intmax_t ctd;
-    const char* p_tf_name; //memory from json parser
-}tf_info_t;
-
-int tf_parse_json_with_length(const char *p_str, size_t len,
-                              cJSON **pp_json_root,
-                              tf_module_item_t **pp_head,
-                              tf_info_t *p_info);
-                              
-int tf_parse_json(const char *p_str,
-                  cJSON **pp_json_root,
-                  tf_module_item_t **pp_head,
-                  tf_info_t *p_info);
-
-void tf_parse_free(cJSON *p_json_root, tf_module_item_t *p_head, int num);
-
-
-// can delete audio data in taskflow
-char* tf_parse_util_simplify_json(const char *p_str);
-
-#ifdef __cplusplus
-}
-#endif
+
+#pragma once
+#include "tf_module.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+struct tf_module_wires
+{
+    int *p_evt_id;
+    int *p_dst_index;  // index of each target in the module array, filled by tf_parse_flow_compile
+    int num;
+};
+typedef struct tf_module_item
+{
+    int id;
+    int index;
+    const char *p_name;
+    cJSON *p_params;
+    struct tf_module_wires *p_wires;
+    int output_port_num;
+    tf_module_t *handle;
+    tf_module_mgmt_t *mgmt_handle;
+    const tf_module_io_t *p_io;  // NULL: the module type didn't declare its data types
+    uint32_t flag;
+} tf_module_item_t;
+
+typedef struct tf_info
+{
+    int type;
+    intmax_t tid;
+    intmax_t ctd;
+    const char* p_tf_name; //memory from json parser
+}tf_info_t;
+
+int tf_parse_json_with_length(const char *p_str, size_t len,
+                              cJSON **pp_json_root,
+                              tf_module_item_t **pp_head,
+                              tf_info_t *p_info);
+                              
+int tf_parse_json(const char *p_str,
+                  cJSON **pp_json_root,
+                  tf_module_item_t **pp_head,
+                  tf_info_t *p_info);
+
+void tf_parse_free(cJSON *p_json_root, tf_module_item_t *p_head, int num);
+
+/**
+ * Compiles the parsed modules into a runnable flow, in O(modules + wires).
+ *
+ * Resolves every wire to the index of its target and rejects duplicate ids,
+ * wires to missing modules or to the module itself, cycles, and wires whose
+ * output types the target doesn't take (when both ends declared p_io).
+ * Then reorders p_head so that every module comes before the modules feeding
+ * it: sinks first, sources last, the order modules are started in. The wires
+ * decide the order; the flow's "index" only orders the modules of one level
+ * (the same longest path from a source), higher index first as before.
+ *
+ * @param p_head the parsed modules, reordered in place
+ * @param num number of modules
+ * @param pp_err_module set to the name of the offending module on error
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG (ids, ports, types), ESP_ERR_NOT_FOUND (missing target),
+ *         ESP_ERR_INVALID_STATE (cycle), ESP_ERR_NO_MEM.
+ */
+int tf_parse_flow_compile(tf_module_item_t *p_head, int num, const char **pp_err_module);
+
+
+// can delete audio data in taskflow
+char* tf_parse_util_simplify_json(const char *p_str);
+
+#ifdef __cplusplus
+}
+#endif
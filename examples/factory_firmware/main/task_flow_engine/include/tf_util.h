@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
+#include "esp_err.h"
 #include "cJSON.h"
 #include "cJSON_Utils.h"
 
@@ -31,6 +32,48 @@ extern "C"
 #define CONTAINER_OF(ptr, type, member) \
     ((type *)((char *)(ptr)-offsetof(type, member)))
 
+#define TF_OWNER_NONE        -1   // allocations outside any module
+#define TF_OWNER_MAX         32   // owners tracked at once, the rest count as TF_OWNER_NONE
+#define TF_OWNER_TASK_MAX    16   // tasks bound to an owner at once
+
+/*
+ * Memory accounting. A block from tf_malloc() is charged to the owner the
+ * calling task is bound to, an owner is the id of a module in the flow. The
+ * block is credited back to that owner when tf_free() releases it, whichever
+ * task does so. Blocks released with free() are forgotten once their address
+ * is reused.
+ */
+typedef struct {
+    uint32_t alloc_num;      // blocks allocated
+    size_t cur_bytes;        // bytes held now, as requested from tf_malloc()
+    size_t peak_bytes;       // most bytes held at once
+} tf_mem_stats_t;
+
+/**
+ * Start accounting, blocks allocated before aren't tracked. Called once by tf_engine_init.
+ */
+esp_err_t tf_mem_acct_init(void);
+
+/**
+ * Bind the calling task to an owner, TF_OWNER_NONE unbinds it.
+ * A task of a module that exits on its own should unbind before it does.
+ *
+ * @return the owner the task was bound to.
+ */
+int tf_owner_set(int owner);
+
+/**
+ * @return ESP_ERR_NOT_FOUND if the owner didn't allocate since the last reset,
+ *         ESP_ERR_NOT_SUPPORTED if accounting is off.
+ */
+esp_err_t tf_mem_stats_get(int owner, tf_mem_stats_t *p_stats);
+
+/**
+ * Start a new measurement: peaks drop to what is held now, counts to 0,
+ * owners holding nothing are forgotten.
+ */
+void tf_mem_stats_reset(void);
+
 void *tf_malloc(size_t sz);
 void tf_free(void *ptr);
 
@@ -5,6 +5,7 @@
 #include "tf_util.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 
 ESP_EVENT_DEFINE_BASE(TF_EVENT_BASE);
 
@@ -26,6 +27,7 @@ static tf_engine_t *gp_engine = NULL;
 #define MODULE_FLAG_SUB_SET_DONE   BIT3
 #define MODULE_FLAG_PUB_SET_DONE   BIT4
 #define MODULE_FLAG_START_DONE     BIT5
+#define MODULE_FLAG_KEEP           BIT6   // instance carried over to the updated flow
 
 static void __data_lock( tf_engine_t *p_engine)
 {
@@ -53,6 +55,18 @@ static void __status_cb( tf_engine_t *p_engine, int status, const char *p_err_mo
         status_cb(p_status_cb_arg, tid, status, p_err_module);
     }
 }
+// caller holds the data lock, a dozen module types make a list walk cheap enough
+static tf_module_node_t *__module_node_find(tf_engine_t *p_engine, const char *p_name)
+{
+    tf_module_node_t *it = NULL;
+    SLIST_FOREACH(it, &(p_engine->module_nodes), next) {
+        if (strcmp(it->p_name, p_name) == 0) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
 void __modules_item_print(tf_module_item_t *p_head, int num)
 {
     ESP_LOGI(TAG, "modules:");
@@ -61,35 +75,20 @@ void __modules_item_print(tf_module_item_t *p_head, int num)
     }
 }
 
-int __modules_index_compare(const void *a, const void *b)
-{
-    return ((tf_module_item_t *)b)->index - ((tf_module_item_t *)a)->index;
-}
 static int __modules_init(tf_engine_t *p_engine, tf_module_item_t *p_head, int num, const char **pp_err_module)
 {
     *pp_err_module = NULL;   
     if( p_head == NULL || num <= 0 ) {
         return ESP_FAIL;
     }
-    qsort(p_head, num, sizeof(tf_module_item_t), __modules_index_compare);
-    
-    ESP_LOGI(TAG, "==== after sort ===");
-    __modules_item_print(p_head, num);
 
     for(int i = 0; i < num; i++) {
         __data_lock(p_engine);
         p_head[i].flag = 0;
-        if (!SLIST_EMPTY(&(p_engine->module_nodes)))
-        {
-            tf_module_node_t *it = NULL;
-            SLIST_FOREACH(it, &(p_engine->module_nodes), next)
-            {
-                if (strcmp(it->p_name, p_head[i].p_name) == 0)
-                {
-                    p_head[i].mgmt_handle = it->mgmt_handle;
-                    break;
-                }
-            }
+        tf_module_node_t *p_node = __module_node_find(p_engine, p_head[i].p_name);
+        if (p_node) {
+            p_head[i].mgmt_handle = p_node->mgmt_handle;
+            p_head[i].p_io = p_node->has_io ? &p_node->io : NULL;
         }
         __data_unlock(p_engine);
         if( p_head[i].mgmt_handle == NULL ) {
@@ -101,6 +100,16 @@ static int __modules_init(tf_engine_t *p_engine, tf_module_item_t *p_head, int n
     }
     return ESP_OK;
 }
+static int __modules_compile(tf_module_item_t *p_head, int num, const char **pp_err_module)
+{
+    int ret = tf_parse_flow_compile(p_head, num, pp_err_module);
+    if( ret != ESP_OK ) {
+        return ret;
+    }
+    ESP_LOGI(TAG, "==== after compile ===");
+    __modules_item_print(p_head, num);
+    return ESP_OK;
+}
 static int __modules_instance(tf_module_item_t *p_head, int num, const char **pp_err_module)
 {
     *pp_err_module = NULL;
@@ -108,7 +117,12 @@ static int __modules_instance(tf_module_item_t *p_head, int num, const char **pp
         return ESP_FAIL;
     }
     for(int i = 0; i < num; i++) {
+        if( p_head[i].flag & MODULE_FLAG_INSTANCE_DONE ) {
+            continue;  // kept running by __update
+        }
+        int owner = tf_owner_set(p_head[i].id);
         p_head[i].handle = p_head[i].mgmt_handle->tf_module_instance();
+        tf_owner_set(owner);
         if(p_head[i].handle == NULL) {
             ESP_LOGE(TAG, "module %s instance failed", p_head[i].p_name);
             *pp_err_module = p_head[i].p_name;
@@ -126,7 +140,9 @@ static int __modules_destroy(tf_module_item_t *p_head, int num)
     for(int i = 0; i < num; i++) {
         if(p_head[i].handle != NULL && p_head[i].mgmt_handle != NULL &&
             (p_head[i].flag & MODULE_FLAG_INSTANCE_DONE) && (p_head[i].flag & MODULE_FLAG_INIT_DONE)) {
+            int owner = tf_owner_set(p_head[i].id);
             p_head[i].mgmt_handle->tf_module_destroy(p_head[i].handle);
+            tf_owner_set(owner);
         }
     }
    return ESP_OK;
@@ -139,7 +155,12 @@ static int __modules_start(tf_module_item_t *p_head, int num, const char **pp_er
         return ESP_FAIL;
     }
     for(int i = 0; i < num; i++) {
+        if( p_head[i].flag & MODULE_FLAG_START_DONE ) {
+            continue;
+        }
+        int owner = tf_owner_set(p_head[i].id);
         ret = tf_module_start(p_head[i].handle);
+        tf_owner_set(owner);
         if(ret != ESP_OK) {
             ESP_LOGE(TAG, "Module %s start failed", p_head[i].p_name);
             *pp_err_module = p_head[i].p_name;
@@ -163,7 +184,9 @@ static int __modules_stop(tf_module_item_t *p_head, int num)
             p_head[i].flag & MODULE_FLAG_PUB_SET_DONE ||
             p_head[i].flag & MODULE_FLAG_SUB_SET_DONE)) {
 
+            int owner = tf_owner_set(p_head[i].id);
             ret = tf_module_stop(p_head[i].handle);
+            tf_owner_set(owner);
             if(ret != ESP_OK) {
                 ESP_LOGE(TAG, "Module %s stop failed", p_head[i].p_name);
             }
@@ -182,7 +205,12 @@ static int __modules_cfg(tf_module_item_t *p_head, int num, const char **pp_err_
     }
 
     for(int i = 0; i < num; i++) {
+        if( p_head[i].flag & MODULE_FLAG_CFG_DONE ) {
+            continue;
+        }
+        int owner = tf_owner_set(p_head[i].id);
         ret = tf_module_cfg(p_head[i].handle, p_head[i].p_params);
+        tf_owner_set(owner);
         if(ret != ESP_OK) {
             ESP_LOGE(TAG, "Module %s cfg failed", p_head[i].p_name);
             *pp_err_module = p_head[i].p_name;
@@ -193,7 +221,7 @@ static int __modules_cfg(tf_module_item_t *p_head, int num, const char **pp_err_
    return ESP_OK;
 }
 
-static int __modules_msgs_sub_set(tf_module_item_t *p_head, int num, const char **pp_err_module)
+static int __modules_msgs_sub_set(tf_engine_t *p_engine, tf_module_item_t *p_head, int num, const char **pp_err_module)
 {
     int ret = ESP_OK;
     *pp_err_module = NULL;
@@ -201,7 +229,12 @@ static int __modules_msgs_sub_set(tf_module_item_t *p_head, int num, const char
         return ESP_FAIL;
     }
     for(int i = 0; i < num; i++) {
+        if( p_head[i].flag & MODULE_FLAG_SUB_SET_DONE ) {
+            continue;
+        }
+        int owner = tf_owner_set(p_head[i].id);
         ret = tf_module_msgs_sub_set(p_head[i].handle, p_head[i].id);
+        tf_owner_set(owner);
         if(ret != ESP_OK) {
             ESP_LOGE(TAG, "Module %s msgs sub set failed", p_head[i].p_name);
             *pp_err_module = p_head[i].p_name;
@@ -211,24 +244,6 @@ static int __modules_msgs_sub_set(tf_module_item_t *p_head, int num, const char
     }
    return ESP_OK;
 }
-static int __modules_wires_check(tf_module_item_t *p_head, int num, struct tf_module_wires *p_wires)
-{
-    int i = 0;
-    int j = 0;
-    for( i = 0; i < p_wires->num; i++) {
-        for( j = 0; j < num; j++ ) {
-            if(p_head[j].id == p_wires->p_evt_id[i]) {
-                break;
-            }
-        }
-        if( j >= num ) {
-            ESP_LOGE(TAG, "Not find wire: %d", p_wires->p_evt_id[i]);
-            return ESP_FAIL;
-        }
-    }
-   return ESP_OK;
-}
-
 static int __modules_msgs_pub_set(tf_module_item_t *p_head, int num, const char **pp_err_module)
 {
     int ret = ESP_OK;
@@ -237,15 +252,15 @@ static int __modules_msgs_pub_set(tf_module_item_t *p_head, int num, const char
         return ESP_FAIL;
     }
     for(int i = 0; i < num; i++) {
+        if( p_head[i].flag & MODULE_FLAG_PUB_SET_DONE ) {
+            continue;
+        }
+        // wires were checked by __modules_compile
         for(int j = 0; j < p_head[i].output_port_num; j++) {
-
-            ret = __modules_wires_check(p_head, num, p_head[i].p_wires);
-            if(ret != ESP_OK) {
-                *pp_err_module = p_head[i].p_name;
-                return ret;
-            }
+            int owner = tf_owner_set(p_head[i].id);
             ret = tf_module_msgs_pub_set(p_head[i].handle, j,  \
-                                         p_head[i].p_wires->p_evt_id, p_head[i].p_wires->num);
+                                         p_head[i].p_wires[j].p_evt_id, p_head[i].p_wires[j].num);
+            tf_owner_set(owner);
             if(ret != ESP_OK) {
                 ESP_LOGE(TAG, "Module %s msgs pub set failed", p_head[i].p_name);
                 *pp_err_module = p_head[i].p_name;
@@ -273,25 +288,12 @@ static int __clear(tf_engine_t *p_engine)
     __data_unlock(p_engine);
     return ESP_OK;
 }
-static int __run(tf_engine_t *p_engine)
+// instance, cfg, wire and start every module that isn't yet, sinks first, the caller reports RUNNING
+static int __build(tf_engine_t *p_engine)
 {
     int ret =  0;
     const char *p_err_module = NULL;
 
-    ESP_LOGI(TAG, "======= START ======");
-    ESP_LOGI(TAG, "tlid: %jd", p_engine->tf_info.tid);
-    ESP_LOGI(TAG, "name: %s", p_engine->tf_info.p_tf_name);
-    ESP_LOGI(TAG, "type: %ld", p_engine->tf_info.type);
-    ESP_LOGI(TAG, "num:  %d", p_engine->module_item_num);
-    __modules_item_print(p_engine->p_module_head, p_engine->module_item_num);
-    ESP_LOGI(TAG, "====================");
-    
-    ret = __modules_init(p_engine, p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
-    if( ret != ESP_OK ) {
-        __status_cb(p_engine, TF_STATUS_ERR_MODULE_NOT_FOUND, p_err_module);
-        return ESP_FAIL;
-    }
-
     ret =  __modules_instance(p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
     if( ret != ESP_OK ) {
         __status_cb(p_engine, TF_STATUS_ERR_MODULES_INSTANCE, p_err_module);
@@ -304,7 +306,7 @@ static int __run(tf_engine_t *p_engine)
         return ESP_FAIL;
     }
 
-    ret =  __modules_msgs_sub_set(p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
+    ret =  __modules_msgs_sub_set(p_engine, p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
     if( ret != ESP_OK ) {
         __status_cb(p_engine, TF_STATUS_ERR_MODULES_WIRES, p_err_module);
         return ESP_FAIL;
@@ -321,11 +323,184 @@ static int __run(tf_engine_t *p_engine)
         __status_cb(p_engine, TF_STATUS_ERR_MODULES_START, p_err_module);
         return ESP_FAIL;
     }
-    __status_cb(p_engine, TF_STATUS_RUNNING, NULL);
-    
     return ESP_OK;
 }
 
+static int __run(tf_engine_t *p_engine)
+{
+    int ret =  0;
+    const char *p_err_module = NULL;
+
+    tf_engine_profile_reset();
+
+    ESP_LOGI(TAG, "======= START ======");
+    ESP_LOGI(TAG, "tlid: %jd", p_engine->tf_info.tid);
+    ESP_LOGI(TAG, "name: %s", p_engine->tf_info.p_tf_name);
+    ESP_LOGI(TAG, "type: %d", p_engine->tf_info.type);
+    ESP_LOGI(TAG, "num:  %d", p_engine->module_item_num);
+    __modules_item_print(p_engine->p_module_head, p_engine->module_item_num);
+    ESP_LOGI(TAG, "====================");
+    
+    ret = __modules_init(p_engine, p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
+    if( ret != ESP_OK ) {
+        __status_cb(p_engine, TF_STATUS_ERR_MODULE_NOT_FOUND, p_err_module);
+        return ESP_FAIL;
+    }
+
+    ret = __modules_compile(p_engine->p_module_head, p_engine->module_item_num, &p_err_module);
+    if( ret != ESP_OK ) {
+        __status_cb(p_engine, TF_STATUS_ERR_MODULES_WIRES, p_err_module);
+        return ESP_FAIL;
+    }
+
+    ret = __build(p_engine);
+    if( ret == ESP_OK ) {
+        __status_cb(p_engine, TF_STATUS_RUNNING, NULL);
+    }
+    return ret;
+}
+
+static bool __module_wires_same(const tf_module_item_t *p_a, const tf_module_item_t *p_b)
+{
+    if( p_a->output_port_num != p_b->output_port_num ) {
+        return false;
+    }
+    for(int j = 0; j < p_a->output_port_num; j++) {
+        int num = p_a->p_wires[j].num;
+        if( num != p_b->p_wires[j].num ) {
+            return false;
+        }
+        if( num > 0 && memcmp(p_a->p_wires[j].p_evt_id, p_b->p_wires[j].p_evt_id, sizeof(int) * num) != 0 ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int __module_rewire(tf_module_item_t *p_item, const tf_module_item_t *p_old)
+{
+    int ret = ESP_OK;
+    int owner = tf_owner_set(p_item->id);
+    for(int j = 0; j < p_item->output_port_num && ret == ESP_OK; j++) {
+        ret = tf_module_msgs_pub_set(p_item->handle, j, p_item->p_wires[j].p_evt_id, p_item->p_wires[j].num);
+    }
+    // ports the new flow no longer wires
+    for(int j = p_item->output_port_num; j < p_old->output_port_num && ret == ESP_OK; j++) {
+        ret = tf_module_msgs_pub_set(p_item->handle, j, NULL, 0);
+    }
+    tf_owner_set(owner);
+    return ret;
+}
+
+/*
+ * Move the running modules of p_old over to the flow now in p_engine, which
+ * is parsed but not yet initialized. A module of the same id and type keeps
+ * its instance if its params are unchanged, or if it takes the new ones
+ * through cfg_update; new wires are handed to it with msgs_pub_set once their
+ * targets run. Every other old module is stopped and destroyed,
+ * __build then brings up what is missing. The caller frees p_old.
+ *
+ * Returns ESP_ERR_NOT_SUPPORTED with p_old untouched if the new flow doesn't
+ * check out, the caller then restarts from scratch and __run reports why.
+ */
+static int __update(tf_engine_t *p_engine, tf_module_item_t *p_old, int old_num)
+{
+    int ret = ESP_OK;
+    const char *p_err_module = NULL;
+    tf_module_item_t *p_head = p_engine->p_module_head;
+    int num = p_engine->module_item_num;
+    int *p_rewire = NULL;
+    int rewire_num = 0;
+
+    ESP_LOGI(TAG, "======= UPDATE =====");
+    ESP_LOGI(TAG, "tlid: %jd", p_engine->tf_info.tid);
+    ESP_LOGI(TAG, "name: %s", p_engine->tf_info.p_tf_name);
+
+    if( __modules_init(p_engine, p_head, num, &p_err_module) != ESP_OK ||
+        __modules_compile(p_head, num, &p_err_module) != ESP_OK ) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    p_rewire = (int *)tf_malloc(sizeof(int) * num * 2);  // pairs of new, old index
+    if( p_rewire == NULL ) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    for(int i = 0; i < old_num; i++) {
+        p_old[i].flag &= ~MODULE_FLAG_KEEP;
+    }
+
+    // flows are a handful of modules, a linear match is fine
+    for(int i = 0; i < num; i++) {
+        tf_module_item_t *p_item = &p_head[i];
+        int k = 0;
+        for(k = 0; k < old_num; k++) {
+            if( p_old[k].id == p_item->id && !(p_old[k].flag & MODULE_FLAG_KEEP) ) {
+                break;
+            }
+        }
+        if( k == old_num ) {
+            ESP_LOGI(TAG, "    %s-%d: new", p_item->p_name, p_item->id);
+            continue;
+        }
+        if( strcmp(p_old[k].p_name, p_item->p_name) != 0 || !(p_old[k].flag & MODULE_FLAG_START_DONE) ) {
+            ESP_LOGI(TAG, "    %s-%d: rebuild", p_item->p_name, p_item->id);
+            continue;
+        }
+
+        bool params_same = cJSON_Compare(p_old[k].p_params, p_item->p_params, true);
+        bool wires_same = __module_wires_same(&p_old[k], p_item);
+
+        if( !params_same ) {
+            int owner = tf_owner_set(p_item->id);
+            ret = tf_module_cfg_update(p_old[k].handle, p_item->p_params);
+            tf_owner_set(owner);
+            if( ret != ESP_OK ) {
+                ESP_LOGI(TAG, "    %s-%d: rebuild%s", p_item->p_name, p_item->id,
+                         ret == ESP_ERR_NOT_SUPPORTED ? "" : ", update failed");
+                continue;
+            }
+        }
+        if( !wires_same ) {
+            p_rewire[rewire_num * 2] = i;
+            p_rewire[rewire_num * 2 + 1] = k;
+            rewire_num++;
+        }
+        ESP_LOGI(TAG, "    %s-%d: %s", p_item->p_name, p_item->id,
+                 params_same && wires_same ? "keep" : (params_same ? "rewire" : "update"));
+
+        p_old[k].flag |= MODULE_FLAG_KEEP;
+        p_item->handle = p_old[k].handle;
+        p_item->flag = p_old[k].flag & ~MODULE_FLAG_KEEP;
+    }
+
+    // what isn't carried over goes, sources first like __modules_stop
+    for(int k = old_num - 1; k >= 0; k--) {
+        if( !(p_old[k].flag & MODULE_FLAG_KEEP) ) {
+            __modules_stop(&p_old[k], 1);
+            __modules_destroy(&p_old[k], 1);
+        }
+    }
+
+    ret = __build(p_engine);
+
+    // kept modules now feed targets that are all started
+    for(int n = 0; n < rewire_num && ret == ESP_OK; n++) {
+        tf_module_item_t *p_item = &p_head[p_rewire[n * 2]];
+        ret = __module_rewire(p_item, &p_old[p_rewire[n * 2 + 1]]);
+        if( ret != ESP_OK ) {
+            ESP_LOGE(TAG, "Module %s msgs pub set failed", p_item->p_name);
+            __status_cb(p_engine, TF_STATUS_ERR_MODULES_WIRES, p_item->p_name);
+            ret = ESP_FAIL;
+        }
+    }
+    tf_free(p_rewire);
+    if( ret == ESP_OK ) {
+        __status_cb(p_engine, TF_STATUS_RUNNING, NULL);
+    }
+    return ret;
+}
+
 
 static void __tf_engine_task(void *p_arg)
 {
@@ -404,6 +579,44 @@ static void __tf_engine_task(void *p_arg)
         if( xQueueReceive(p_engine->queue_handle, &flow, ( TickType_t ) 10 ) == pdPASS ) {
 
             ESP_LOGI(TAG, "RECV NEW TASK");
+            cJSON *p_root = NULL;
+            tf_module_item_t *p_head = NULL;
+            tf_info_t info = p_engine->tf_info;
+
+            ret = tf_parse_json_with_length( flow.p_data, flow.len, &p_root, &p_head, &info);
+            tf_free(flow.p_data);
+
+            if( run_flag && ret > 0 ) {
+                ESP_LOGI(TAG, "UPDATE LAST TASK");
+                cJSON *p_old_root = p_engine->cur_flow_root;
+                tf_module_item_t *p_old = p_engine->p_module_head;
+                int old_num = p_engine->module_item_num;
+
+                __data_lock(p_engine);
+                p_engine->cur_flow_root = p_root;
+                p_engine->p_module_head = p_head;
+                p_engine->module_item_num = ret;
+                p_engine->tf_info = info;
+                __data_unlock(p_engine);
+
+                __status_cb(p_engine, TF_STATUS_STARTING, NULL);
+
+                ret = __update(p_engine, p_old, old_num);
+                if( ret == ESP_ERR_NOT_SUPPORTED ) {
+                    __modules_stop(p_old, old_num);
+                    __modules_destroy(p_old, old_num);
+                    ret = __run(p_engine);
+                }
+                tf_parse_free(p_old_root, p_old, old_num);
+
+                if(  ret != ESP_OK ) {
+                    __stop(p_engine);
+                    __clear(p_engine);
+                    run_flag = false;
+                }
+                continue;
+            }
+
             if(run_flag) {
                 ESP_LOGI(TAG, "STOP LAST TASK");
                 __stop(p_engine);
@@ -416,12 +629,12 @@ static void __tf_engine_task(void *p_arg)
             }
 
             __data_lock(p_engine);
-            ret = tf_parse_json_with_length( flow.p_data, flow.len, &p_engine->cur_flow_root, &p_engine->p_module_head, &p_engine->tf_info);
+            p_engine->cur_flow_root = p_root;
+            p_engine->p_module_head = p_head;
             p_engine->module_item_num = ret;
+            p_engine->tf_info = info;
             __data_unlock(p_engine);
 
-            tf_free(flow.p_data);
-
             __status_cb(p_engine, TF_STATUS_STARTING, NULL);
 
             if( ret  <= 0) {
@@ -445,23 +658,23 @@ esp_err_t tf_engine_init(void)
 {
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
     esp_err_t ret = ESP_OK;
+
+    ret = tf_mem_acct_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "mem accounting off");  // only the profiles miss it
+    }
+
     gp_engine = (tf_engine_t *)tf_malloc(sizeof(tf_engine_t));
     ESP_GOTO_ON_FALSE(gp_engine, ESP_ERR_NO_MEM, err, TAG, "no mem for tf engine");
     memset(gp_engine, 0, sizeof(tf_engine_t));
 
-    esp_event_loop_args_t event_task_args = {
-        .queue_size = 32,
-        .task_name = "tf_event_task",
-        .task_priority = 14,
-        .task_stack_size = 1024 * 3,
-        .task_core_id = 1
-    };
-    ret = esp_event_loop_create(&event_task_args, &gp_engine->event_handle);
-    ESP_GOTO_ON_ERROR(ret, err, TAG, "event_loop_create failed");
+    ret = tf_dispatch_init();
+    ESP_GOTO_ON_ERROR(ret, err, TAG, "dispatch init failed");
 
     SLIST_INIT(&(gp_engine->module_nodes));
 
     gp_engine->status = TF_STATUS_IDLE;
+    gp_engine->profile_start_us = esp_timer_get_time();
 
     gp_engine->sem_handle = xSemaphoreCreateMutex();
     ESP_GOTO_ON_FALSE(NULL != gp_engine->sem_handle, ESP_ERR_NO_MEM, err, TAG, "Failed to create semaphore");
@@ -675,6 +888,70 @@ esp_err_t tf_engine_status_get(int *p_status)
     return ESP_OK;
 }
 
+esp_err_t tf_engine_module_num_get(int *p_num)
+{
+    assert(gp_engine);
+    if( p_num == NULL ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    __data_lock(gp_engine);
+    *p_num = gp_engine->module_item_num;
+    __data_unlock(gp_engine);
+    return ESP_OK;
+}
+
+esp_err_t tf_engine_profile_get(tf_module_profile_t *p_profiles, int num_max, int *p_num, int64_t *p_window_us)
+{
+    assert(gp_engine);
+    tf_dispatch_stats_t stats;
+    tf_mem_stats_t mem_stats;
+    int num = 0;
+
+    if( p_profiles == NULL || p_num == NULL ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    __data_lock(gp_engine);
+    for(int i = 0; i < gp_engine->module_item_num && num < num_max; i++) {
+        tf_module_item_t *p_item = &gp_engine->p_module_head[i];
+        tf_module_profile_t *p_profile = &p_profiles[num++];
+
+        memset(p_profile, 0, sizeof(tf_module_profile_t));
+        p_profile->id = p_item->id;
+        strncpy(p_profile->name, p_item->p_name, sizeof(p_profile->name) - 1);
+        if( tf_dispatch_stats_get(p_item->id, &stats) == ESP_OK ) {
+            p_profile->events = stats.handled;
+            p_profile->dropped = stats.dropped;
+            p_profile->wait_max_us = stats.wait_max_us;
+            p_profile->run_max_us = stats.run_max_us;
+            p_profile->run_total_us = stats.run_total_us;
+        }
+        if( tf_mem_stats_get(p_item->id, &mem_stats) == ESP_OK ) {
+            p_profile->alloc_num = mem_stats.alloc_num;
+            p_profile->mem_cur_bytes = mem_stats.cur_bytes;
+            p_profile->mem_peak_bytes = mem_stats.peak_bytes;
+        }
+    }
+    if( p_window_us ) {
+        *p_window_us = esp_timer_get_time() - gp_engine->profile_start_us;
+    }
+    __data_unlock(gp_engine);
+
+    *p_num = num;
+    return ESP_OK;
+}
+
+esp_err_t tf_engine_profile_reset(void)
+{
+    assert(gp_engine);
+    __data_lock(gp_engine);
+    tf_dispatch_stats_reset();
+    tf_mem_stats_reset();
+    gp_engine->profile_start_us = esp_timer_get_time();
+    __data_unlock(gp_engine);
+    return ESP_OK;
+}
+
 esp_err_t tf_engine_status_cb_register(tf_engine_status_cb_t engine_status_cb, void *p_arg)
 {
     assert(gp_engine);
@@ -726,18 +1003,11 @@ esp_err_t tf_module_register(const char *p_name,
         return ESP_ERR_INVALID_ARG;
     }
     __data_lock(gp_engine);
-    if (!SLIST_EMPTY(&(gp_engine->module_nodes)))
+    if (__module_node_find(gp_engine, p_name) != NULL)
     {
-        tf_module_node_t *it = NULL;
-        SLIST_FOREACH(it, &(gp_engine->module_nodes), next)
-        {
-            if (strcmp(it->p_name, p_name) == 0)
-            {
-                __data_unlock(gp_engine);
-                ESP_LOGW(TAG, "module %s already exist", p_name);
-                return ESP_ERR_INVALID_STATE;
-            }
-        }
+        __data_unlock(gp_engine);
+        ESP_LOGW(TAG, "module %s already exist", p_name);
+        return ESP_ERR_INVALID_STATE;
     }
 
     tf_module_node_t *p_node = (tf_module_node_t *)tf_malloc(sizeof(tf_module_node_t));
@@ -747,10 +1017,12 @@ esp_err_t tf_module_register(const char *p_name,
         return ESP_ERR_NO_MEM;
     }
 
+    memset(p_node, 0, sizeof(tf_module_node_t));
     p_node->p_name = p_name;
     p_node->p_desc = p_desc;
     p_node->p_version = p_version;
     p_node->mgmt_handle = mgmt_handle;
+    p_node->dispatch_cfg = (tf_dispatch_cfg_t)TF_DISPATCH_CFG_DEFAULT();
     SLIST_INSERT_HEAD(&(gp_engine->module_nodes), p_node, next);
     __data_unlock(gp_engine);
 
@@ -758,6 +1030,62 @@ esp_err_t tf_module_register(const char *p_name,
     return ESP_OK;
 }
 
+esp_err_t tf_module_dispatch_set(const char *p_name, const tf_dispatch_cfg_t *p_cfg)
+{
+    assert(gp_engine);
+    tf_dispatch_cfg_t cfg;
+    tf_module_node_t *p_node = NULL;
+
+    if (p_name == NULL || p_cfg == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cfg = *p_cfg;
+    ESP_RETURN_ON_ERROR(tf_dispatch_cfg_check(&cfg), TAG, "module %s invalid dispatch cfg", p_name);
+
+    __data_lock(gp_engine);
+    p_node = __module_node_find(gp_engine, p_name);
+    if (p_node)
+    {
+        p_node->dispatch_cfg = cfg;
+    }
+    __data_unlock(gp_engine);
+
+    if (p_node == NULL)
+    {
+        ESP_LOGW(TAG, "module %s not registered", p_name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t tf_module_io_set(const char *p_name, const tf_module_io_t *p_io)
+{
+    assert(gp_engine);
+    tf_module_node_t *p_node = NULL;
+
+    if (p_name == NULL || p_io == NULL || p_io->output_port_num < 0 || p_io->output_port_num > TF_MODULE_OUTPUT_PORT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    __data_lock(gp_engine);
+    p_node = __module_node_find(gp_engine, p_name);
+    if (p_node)
+    {
+        p_node->io = *p_io;
+        p_node->has_io = true;
+    }
+    __data_unlock(gp_engine);
+
+    if (p_node == NULL)
+    {
+        ESP_LOGW(TAG, "module %s not registered", p_name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t tf_modules_report(void)
 {
     return ESP_OK;
@@ -769,7 +1097,35 @@ esp_err_t tf_event_post(int32_t event_id,
                         TickType_t ticks_to_wait)
 {
     assert(gp_engine);
-    return esp_event_post_to(gp_engine->event_handle, TF_EVENT_BASE, event_id, event_data, event_data_size, ticks_to_wait);
+    return tf_dispatch_post(event_id, event_data, event_data_size, ticks_to_wait);
+}
+
+// event ids are module ids, the type of the flow's module with that id decides how its events are
+// dispatched, whenever the handler is registered
+static void __dispatch_cfg_get(tf_engine_t *p_engine, int32_t event_id, tf_dispatch_cfg_t *p_cfg)
+{
+    tf_dispatch_cfg_t def = TF_DISPATCH_CFG_DEFAULT();
+    tf_module_node_t *p_node = NULL;
+    const char *p_name = NULL;
+
+    *p_cfg = def;
+    __data_lock(p_engine);
+    for(int i = 0; i < p_engine->module_item_num; i++) {
+        if( p_engine->p_module_head[i].id == event_id ) {
+            p_name = p_engine->p_module_head[i].p_name;
+            break;
+        }
+    }
+    if( p_name ) {
+        p_node = __module_node_find(p_engine, p_name);
+        if( p_node ) {
+            *p_cfg = p_node->dispatch_cfg;
+        }
+    }
+    __data_unlock(p_engine);
+    if( p_name == NULL ) {
+        ESP_LOGW(TAG, "event %ld is not a module of the flow, default dispatch", (long)event_id);
+    }
 }
 
 esp_err_t tf_event_handler_register(int32_t event_id,
@@ -777,12 +1133,14 @@ esp_err_t tf_event_handler_register(int32_t event_id,
                                     void *event_handler_arg)
 {
     assert(gp_engine);
-    return esp_event_handler_register_with(gp_engine->event_handle, TF_EVENT_BASE, event_id, event_handler, event_handler_arg);
+    tf_dispatch_cfg_t cfg;
+    __dispatch_cfg_get(gp_engine, event_id, &cfg);
+    return tf_dispatch_open(event_id, &cfg, event_handler, event_handler_arg);
 }
 
 esp_err_t tf_event_handler_unregister(int32_t event_id,
                                       esp_event_handler_t event_handler)
 {
     assert(gp_engine);
-    return esp_event_handler_unregister_with(gp_engine->event_handle, TF_EVENT_BASE, event_id, event_handler);
+    return tf_dispatch_close(event_id, event_handler);
 }
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include "tf_dispatch.h"
+#include "tf_util.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+ESP_EVENT_DECLARE_BASE(TF_EVENT_BASE);
+
+static const char *TAG = "tf.dispatch";
+
+struct tf_dispatch_worker_cfg
+{
+    const char *p_name;
+    uint32_t stack_size;
+    UBaseType_t prio;
+    BaseType_t core_id;
+};
+
+// indexed by TF_DISPATCH_WORKER_*
+static const struct tf_dispatch_worker_cfg __g_worker_cfgs[TF_DISPATCH_WORKER_NUM] = {
+    { "tf_frame",  1024 * 4, 14, 1 },  // where the single event loop used to run
+    { "tf_alarm",  1024 * 4, 12, 1 },
+    { "tf_uplink", 1024 * 4, 6,  0 },
+};
+
+struct tf_dispatch_item
+{
+    int64_t post_us;
+    size_t size;
+    uint64_t data[(TF_DISPATCH_EVENT_SIZE_MAX + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+};
+
+struct tf_mailbox
+{
+    bool used;
+    bool closing;   // no new events, close is draining
+    int refs;       // posters between lookup and send
+    int32_t event_id;
+    int worker;
+    tf_dispatch_policy_t policy;
+    tf_dispatch_drop_cb_t drop_cb;
+    esp_event_handler_t handler;
+    void *handler_arg;
+    QueueHandle_t queue;
+    tf_dispatch_stats_t stats;
+};
+
+struct tf_worker
+{
+    TaskHandle_t task_handle;
+    SemaphoreHandle_t run_lock;  // held while a handler runs, recursive so a handler may close its own mailbox
+    int next;                    // round robin start
+    struct tf_dispatch_item drain_item;  // used by close under run_lock
+};
+
+typedef struct tf_dispatcher
+{
+    SemaphoreHandle_t sem_handle;
+    struct tf_worker workers[TF_DISPATCH_WORKER_NUM];
+    struct tf_mailbox mailboxes[TF_DISPATCH_MAILBOX_MAX];
+} tf_dispatcher_t;
+
+static tf_dispatcher_t *gp_dispatcher = NULL;
+
+static void __data_lock(tf_dispatcher_t *p_dispatcher)
+{
+    xSemaphoreTake(p_dispatcher->sem_handle, portMAX_DELAY);
+}
+static void __data_unlock(tf_dispatcher_t *p_dispatcher)
+{
+    xSemaphoreGive(p_dispatcher->sem_handle);
+}
+
+static struct tf_mailbox *__mailbox_find(tf_dispatcher_t *p_dispatcher, int32_t event_id)
+{
+    for (int i = 0; i < TF_DISPATCH_MAILBOX_MAX; i++) {
+        struct tf_mailbox *p_mailbox = &p_dispatcher->mailboxes[i];
+        if (p_mailbox->used && p_mailbox->event_id == event_id) {
+            return p_mailbox;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Run one event of the worker, taking mailboxes in turn so a busy event id
+ * can't starve the others. Returns false when all its mailboxes are empty.
+ */
+static bool __worker_run_once(tf_dispatcher_t *p_dispatcher, int worker, struct tf_dispatch_item *p_item)
+{
+    struct tf_worker *p_worker = &p_dispatcher->workers[worker];
+    struct tf_mailbox *p_mailbox = NULL;
+    esp_event_handler_t handler = NULL;
+    void *handler_arg = NULL;
+    int32_t event_id = 0;
+    int64_t start_us = 0;
+    uint32_t run_us = 0;
+    int owner = TF_OWNER_NONE;
+
+    xSemaphoreTakeRecursive(p_worker->run_lock, portMAX_DELAY);
+
+    __data_lock(p_dispatcher);
+    for (int n = 0; n < TF_DISPATCH_MAILBOX_MAX; n++) {
+        int i = (p_worker->next + n) % TF_DISPATCH_MAILBOX_MAX;
+        p_mailbox = &p_dispatcher->mailboxes[i];
+
+        if (!p_mailbox->used || p_mailbox->closing || p_mailbox->worker != worker) {
+            continue;
+        }
+        if (xQueueReceive(p_mailbox->queue, p_item, 0) == pdTRUE) {
+            uint32_t wait_us = (uint32_t)(esp_timer_get_time() - p_item->post_us);
+            p_mailbox->stats.handled++;
+            p_mailbox->stats.wait_total_us += wait_us;
+            if (wait_us > p_mailbox->stats.wait_max_us) {
+                p_mailbox->stats.wait_max_us = wait_us;
+            }
+            handler = p_mailbox->handler;
+            handler_arg = p_mailbox->handler_arg;
+            event_id = p_mailbox->event_id;
+            p_worker->next = (i + 1) % TF_DISPATCH_MAILBOX_MAX;
+            break;
+        }
+    }
+    __data_unlock(p_dispatcher);
+
+    if (handler) {
+        // the handler allocates for the module it belongs to
+        owner = tf_owner_set(event_id);
+        start_us = esp_timer_get_time();
+        handler(handler_arg, TF_EVENT_BASE, event_id, p_item->data);
+        run_us = (uint32_t)(esp_timer_get_time() - start_us);
+        tf_owner_set(owner);
+
+        // the handler may have closed its own mailbox
+        __data_lock(p_dispatcher);
+        p_mailbox = __mailbox_find(p_dispatcher, event_id);
+        if (p_mailbox && p_mailbox->handler == handler) {
+            p_mailbox->stats.run_total_us += run_us;
+            if (run_us > p_mailbox->stats.run_max_us) {
+                p_mailbox->stats.run_max_us = run_us;
+            }
+        }
+        __data_unlock(p_dispatcher);
+    }
+
+    xSemaphoreGiveRecursive(p_worker->run_lock);
+
+    return handler != NULL;
+}
+
+static void __worker_task(void *p_arg)
+{
+    int worker = (int)(intptr_t)p_arg;
+    struct tf_dispatch_item item;
+
+    ESP_LOGI(TAG, "worker %s start", __g_worker_cfgs[worker].p_name);
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (__worker_run_once(gp_dispatcher, worker, &item)) {
+        }
+    }
+}
+
+esp_err_t tf_dispatch_init(void)
+{
+    esp_err_t ret = ESP_OK;
+    tf_dispatcher_t *p_dispatcher = NULL;
+
+    ESP_RETURN_ON_FALSE(gp_dispatcher == NULL, ESP_ERR_INVALID_STATE, TAG, "already init");
+
+    // looked up on every post, keep it in internal ram
+    p_dispatcher = heap_caps_calloc(1, sizeof(tf_dispatcher_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(p_dispatcher, ESP_ERR_NO_MEM, TAG, "no mem for dispatcher");
+
+    p_dispatcher->sem_handle = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(p_dispatcher->sem_handle, ESP_ERR_NO_MEM, err, TAG, "Failed to create semaphore");
+
+    for (int i = 0; i < TF_DISPATCH_WORKER_NUM; i++) {
+        p_dispatcher->workers[i].run_lock = xSemaphoreCreateRecursiveMutex();
+        ESP_GOTO_ON_FALSE(p_dispatcher->workers[i].run_lock, ESP_ERR_NO_MEM, err, TAG, "Failed to create run lock");
+    }
+
+    // workers dereference it as soon as they run
+    gp_dispatcher = p_dispatcher;
+
+    for (int i = 0; i < TF_DISPATCH_WORKER_NUM; i++) {
+        const struct tf_dispatch_worker_cfg *p_cfg = &__g_worker_cfgs[i];
+        BaseType_t res = xTaskCreatePinnedToCore(__worker_task, p_cfg->p_name, p_cfg->stack_size, (void *)(intptr_t)i,
+                                                 p_cfg->prio, &p_dispatcher->workers[i].task_handle, p_cfg->core_id);
+        ESP_GOTO_ON_FALSE(res == pdPASS, ESP_FAIL, err, TAG, "create worker %s failed", p_cfg->p_name);
+    }
+    return ESP_OK;
+
+err:
+    gp_dispatcher = NULL;
+    for (int i = 0; i < TF_DISPATCH_WORKER_NUM; i++) {
+        if (p_dispatcher->workers[i].task_handle) {
+            vTaskDelete(p_dispatcher->workers[i].task_handle);
+        }
+        if (p_dispatcher->workers[i].run_lock) {
+            vSemaphoreDelete(p_dispatcher->workers[i].run_lock);
+        }
+    }
+    if (p_dispatcher->sem_handle) {
+        vSemaphoreDelete(p_dispatcher->sem_handle);
+    }
+    free(p_dispatcher);
+    return ret;
+}
+
+esp_err_t tf_dispatch_cfg_check(tf_dispatch_cfg_t *p_cfg)
+{
+    ESP_RETURN_ON_FALSE(p_cfg, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(p_cfg->worker >= 0 && p_cfg->worker < TF_DISPATCH_WORKER_NUM, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid worker %d", p_cfg->worker);
+    ESP_RETURN_ON_FALSE(p_cfg->depth >= 0, ESP_ERR_INVALID_ARG, TAG, "invalid depth %d", p_cfg->depth);
+
+    switch (p_cfg->policy) {
+        case TF_DISPATCH_POLICY_BLOCK:
+        case TF_DISPATCH_POLICY_DROP_NEWEST:
+            break;
+        case TF_DISPATCH_POLICY_DROP_OLDEST:
+            // the evicted event holds buffers only its owner knows how to free
+            ESP_RETURN_ON_FALSE(p_cfg->drop_cb, ESP_ERR_INVALID_ARG, TAG, "drop oldest needs drop_cb");
+            break;
+        default:
+            ESP_LOGE(TAG, "invalid policy %d", p_cfg->policy);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    if (p_cfg->depth == 0) {
+        p_cfg->depth = TF_DISPATCH_DEPTH_DEFAULT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t tf_dispatch_open(int32_t event_id, const tf_dispatch_cfg_t *p_cfg,
+                           esp_event_handler_t handler, void *handler_arg)
+{
+    tf_dispatcher_t *p_dispatcher = gp_dispatcher;
+    struct tf_mailbox *p_mailbox = NULL;
+    tf_dispatch_cfg_t cfg;
+
+    assert(p_dispatcher);
+    ESP_RETURN_ON_FALSE(p_cfg && handler, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    cfg = *p_cfg;
+    ESP_RETURN_ON_ERROR(tf_dispatch_cfg_check(&cfg), TAG, "invalid cfg for %ld", (long)event_id);
+
+    __data_lock(p_dispatcher);
+    if (__mailbox_find(p_dispatcher, event_id) != NULL) {
+        __data_unlock(p_dispatcher);
+        ESP_LOGE(TAG, "event %ld already has a handler", (long)event_id);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < TF_DISPATCH_MAILBOX_MAX; i++) {
+        if (!p_dispatcher->mailboxes[i].used) {
+            p_mailbox = &p_dispatcher->mailboxes[i];
+            break;
+        }
+    }
+    if (p_mailbox == NULL) {
+        __data_unlock(p_dispatcher);
+        ESP_LOGE(TAG, "no free mailbox for %ld", (long)event_id);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(p_mailbox, 0, sizeof(struct tf_mailbox));
+    p_mailbox->queue = xQueueCreate(cfg.depth, sizeof(struct tf_dispatch_item));
+    if (p_mailbox->queue == NULL) {
+        __data_unlock(p_dispatcher);
+        ESP_LOGE(TAG, "no mem for mailbox %ld", (long)event_id);
+        return ESP_ERR_NO_MEM;
+    }
+    p_mailbox->event_id = event_id;
+    p_mailbox->worker = cfg.worker;
+    p_mailbox->policy = cfg.policy;
+    p_mailbox->drop_cb = cfg.drop_cb;
+    p_mailbox->handler = handler;
+    p_mailbox->handler_arg = handler_arg;
+    p_mailbox->used = true;
+    __data_unlock(p_dispatcher);
+
+    ESP_LOGI(TAG, "mailbox %ld: worker %s, depth %d, policy %d", (long)event_id,
+             __g_worker_cfgs[cfg.worker].p_name, cfg.depth, cfg.policy);
+    return ESP_OK;
+}
+
+static void __item_fill(struct tf_dispatch_item *p_item, const void *event_data, size_t event_data_size)
+{
+    p_item->post_us = esp_timer_get_time();
+    p_item->size = event_data_size;
+    if (event_data && event_data_size) {
+        memcpy(p_item->data, event_data, event_data_size);
+    }
+}
+
+static void __mailbox_drain(struct tf_mailbox *p_mailbox, struct tf_dispatch_item *p_item)
+{
+    while (xQueueReceive(p_mailbox->queue, p_item, 0) == pdTRUE) {
+        if (p_mailbox->drop_cb) {
+            p_mailbox->drop_cb(p_item->data);
+        }
+    }
+}
+
+esp_err_t tf_dispatch_close(int32_t event_id, esp_event_handler_t handler)
+{
+    tf_dispatcher_t *p_dispatcher = gp_dispatcher;
+    struct tf_mailbox *p_mailbox = NULL;
+    struct tf_worker *p_worker = NULL;
+    int refs = 0;
+
+    assert(p_dispatcher);
+
+    __data_lock(p_dispatcher);
+    p_mailbox = __mailbox_find(p_dispatcher, event_id);
+    if (p_mailbox == NULL || p_mailbox->closing || p_mailbox->handler != handler) {
+        __data_unlock(p_dispatcher);
+        return ESP_ERR_NOT_FOUND;
+    }
+    p_mailbox->closing = true;
+    p_worker = &p_dispatcher->workers[p_mailbox->worker];
+    __data_unlock(p_dispatcher);
+
+    // wait for a running handler to return
+    xSemaphoreTakeRecursive(p_worker->run_lock, portMAX_DELAY);
+
+    // a blocked poster may still get its event in, keep draining until it left
+    do {
+        __mailbox_drain(p_mailbox, &p_worker->drain_item);
+        __data_lock(p_dispatcher);
+        refs = p_mailbox->refs;
+        __data_unlock(p_dispatcher);
+        if (refs > 0) {
+            vTaskDelay(1);
+        }
+    } while (refs > 0);
+    __mailbox_drain(p_mailbox, &p_worker->drain_item);
+
+    __data_lock(p_dispatcher);
+    ESP_LOGI(TAG, "mailbox %ld closed: posted %lu, dropped %lu, high water %lu, wait max %lu us, run max %lu us",
+             (long)event_id, (unsigned long)p_mailbox->stats.posted, (unsigned long)p_mailbox->stats.dropped,
+             (unsigned long)p_mailbox->stats.high_water, (unsigned long)p_mailbox->stats.wait_max_us,
+             (unsigned long)p_mailbox->stats.run_max_us);
+    vQueueDelete(p_mailbox->queue);
+    memset(p_mailbox, 0, sizeof(struct tf_mailbox));
+    __data_unlock(p_dispatcher);
+
+    xSemaphoreGiveRecursive(p_worker->run_lock);
+    return ESP_OK;
+}
+
+esp_err_t tf_dispatch_post(int32_t event_id, const void *event_data,
+                           size_t event_data_size, TickType_t ticks_to_wait)
+{
+    tf_dispatcher_t *p_dispatcher = gp_dispatcher;
+    struct tf_mailbox *p_mailbox = NULL;
+    struct tf_dispatch_item item;
+    bool queued = false;
+    uint32_t dropped = 0;
+    uint32_t waiting = 0;
+
+    assert(p_dispatcher);
+    ESP_RETURN_ON_FALSE(event_data_size <= TF_DISPATCH_EVENT_SIZE_MAX, ESP_ERR_INVALID_SIZE, TAG,
+                        "event %ld too large: %u", (long)event_id, (unsigned)event_data_size);
+
+    __data_lock(p_dispatcher);
+    p_mailbox = __mailbox_find(p_dispatcher, event_id);
+    if (p_mailbox == NULL || p_mailbox->closing) {
+        __data_unlock(p_dispatcher);
+        return ESP_ERR_NOT_FOUND;
+    }
+    p_mailbox->refs++;
+    __data_unlock(p_dispatcher);
+
+    switch (p_mailbox->policy) {
+        case TF_DISPATCH_POLICY_BLOCK:
+        case TF_DISPATCH_POLICY_DROP_NEWEST:
+            __item_fill(&item, event_data, event_data_size);
+            queued = (xQueueSend(p_mailbox->queue, &item,
+                                 p_mailbox->policy == TF_DISPATCH_POLICY_BLOCK ? ticks_to_wait : 0) == pdTRUE);
+            break;
+        case TF_DISPATCH_POLICY_DROP_OLDEST:
+            // twice at most, another poster may take the room we made.
+            // the evicted event goes through item, one item is enough on the poster stack
+            for (int i = 0; i < 2 && !queued; i++) {
+                if (uxQueueSpacesAvailable(p_mailbox->queue) == 0 &&
+                    xQueueReceive(p_mailbox->queue, &item, 0) == pdTRUE) {
+                    p_mailbox->drop_cb(item.data);
+                    dropped++;
+                }
+                __item_fill(&item, event_data, event_data_size);
+                queued = (xQueueSend(p_mailbox->queue, &item, 0) == pdTRUE);
+            }
+            break;
+        default:
+            break;
+    }
+    waiting = uxQueueMessagesWaiting(p_mailbox->queue);
+
+    __data_lock(p_dispatcher);
+    p_mailbox->refs--;
+    if (queued) {
+        p_mailbox->stats.posted++;
+    } else {
+        dropped++;
+    }
+    p_mailbox->stats.dropped += dropped;
+    if (waiting > p_mailbox->stats.high_water) {
+        p_mailbox->stats.high_water = waiting;
+    }
+    if (queued) {
+        xTaskNotifyGive(p_dispatcher->workers[p_mailbox->worker].task_handle);
+    }
+    __data_unlock(p_dispatcher);
+
+    if (dropped) {
+        ESP_LOGD(TAG, "mailbox %ld full, %lu dropped", (long)event_id, (unsigned long)dropped);
+    }
+    return queued ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t tf_dispatch_stats_get(int32_t event_id, tf_dispatch_stats_t *p_stats)
+{
+    tf_dispatcher_t *p_dispatcher = gp_dispatcher;
+    struct tf_mailbox *p_mailbox = NULL;
+
+    assert(p_dispatcher);
+    ESP_RETURN_ON_FALSE(p_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    __data_lock(p_dispatcher);
+    p_mailbox = __mailbox_find(p_dispatcher, event_id);
+    if (p_mailbox) {
+        *p_stats = p_mailbox->stats;
+    }
+    __data_unlock(p_dispatcher);
+
+    return p_mailbox ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void tf_dispatch_stats_reset(void)
+{
+    tf_dispatcher_t *p_dispatcher = gp_dispatcher;
+
+    assert(p_dispatcher);
+
+    __data_lock(p_dispatcher);
+    for (int i = 0; i < TF_DISPATCH_MAILBOX_MAX; i++) {
+        memset(&p_dispatcher->mailboxes[i].stats, 0, sizeof(tf_dispatch_stats_t));
+    }
+    __data_unlock(p_dispatcher);
+}
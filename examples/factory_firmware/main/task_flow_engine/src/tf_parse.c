@@ -1,4 +1,5 @@
 #include "tf_parse.h"
+#include <stdlib.h>
 #include <string.h>
 #include "tf_util.h"
 #include "esp_err.h"
@@ -38,6 +39,10 @@ static void __module_item_free(tf_module_item_t *p_item, int num)
             {
                 tf_free(p_item[i].p_wires[j].p_evt_id);
             }
+            if (p_item[i].p_wires[j].p_dst_index != NULL)
+            {
+                tf_free(p_item[i].p_wires[j].p_dst_index);
+            }
         }
         if (p_item[i].p_wires != NULL)
         {
@@ -123,7 +128,9 @@ int tf_parse_json_with_length(const char *p_str, size_t len,
 
     memset((void *)p_list_head, 0, sizeof(tf_module_item_t) * module_item_num);
 
-    for (int i = 0; i < module_item_num; i++)
+    // cJSON arrays are lists, walk them instead of indexing
+    cJSON *p_item = p_tasklist->child;
+    for (int i = 0; i < module_item_num; i++, p_item = p_item->next)
     {
         cJSON *p_id = NULL;
         cJSON *p_type = NULL;
@@ -132,7 +139,6 @@ int tf_parse_json_with_length(const char *p_str, size_t len,
         cJSON *p_wires = NULL;
         int output_port_num = 0;
 
-        cJSON *p_item = cJSON_GetArrayItem(p_tasklist, i);
         if (p_item == NULL || !cJSON_IsObject(p_item))
         {
             ESP_LOGE(TAG, "tasklist[%d] is not object", i);
@@ -188,10 +194,11 @@ int tf_parse_json_with_length(const char *p_str, size_t len,
             memset((void *)p_list_head[i].p_wires, 0, sizeof(struct tf_module_wires) * output_port_num);
             p_list_head[i].output_port_num = output_port_num;
 
-            for (int m = 0; m < output_port_num; m++)
+            cJSON *p_wires_item_tmp = p_wires->child;
+            for (int m = 0; m < output_port_num; m++, p_wires_item_tmp = p_wires_item_tmp->next)
             {
                 int evt_id_num = 0;
-                cJSON *p_wires_item_tmp = cJSON_GetArrayItem(p_wires, m);
+                cJSON *p_evt_id = NULL;
                 if (p_wires_item_tmp == NULL || !cJSON_IsArray(p_wires_item_tmp))
                 {
                     ESP_LOGE(TAG, "tasklist[%d] wires[%d] is not array", i, m);
@@ -206,9 +213,18 @@ int tf_parse_json_with_length(const char *p_str, size_t len,
                 p_list_head[i].p_wires[m].p_evt_id = (int *)tf_malloc(sizeof(int) * evt_id_num);
                 ESP_GOTO_ON_FALSE(p_list_head[i].p_wires[m].p_evt_id, ESP_ERR_NO_MEM, err, TAG, "malloc failed");
                 memset((void *)p_list_head[i].p_wires[m].p_evt_id, 0, sizeof(int) * evt_id_num);
-                for (int n = 0; n < evt_id_num; n++)
+                p_list_head[i].p_wires[m].p_dst_index = (int *)tf_malloc(sizeof(int) * evt_id_num);
+                ESP_GOTO_ON_FALSE(p_list_head[i].p_wires[m].p_dst_index, ESP_ERR_NO_MEM, err, TAG, "malloc failed");
+                p_evt_id = p_wires_item_tmp->child;
+                for (int n = 0; n < evt_id_num; n++, p_evt_id = p_evt_id->next)
                 {
-                    p_list_head[i].p_wires[m].p_evt_id[n] = cJSON_GetArrayItem(p_wires_item_tmp, n)->valueint;
+                    if (!cJSON_IsNumber(p_evt_id))
+                    {
+                        ESP_LOGE(TAG, "tasklist[%d] wires[%d][%d] is not number", i, m, n);
+                        goto err;
+                    }
+                    p_list_head[i].p_wires[m].p_evt_id[n] = p_evt_id->valueint;
+                    p_list_head[i].p_wires[m].p_dst_index[n] = -1;
                 }
                 p_list_head[i].p_wires[m].num = evt_id_num;
             }
@@ -252,6 +268,216 @@ void tf_parse_free(cJSON *p_json_root, tf_module_item_t *p_head, int num)
     }
 }
 
+static uint32_t __id_hash(int id)
+{
+    return (uint32_t)id * 2654435761u;
+}
+
+// open addressing map from module id to array index, -1 is an empty slot
+static int __id_map_find(const tf_module_item_t *p_head, const int *p_slot, uint32_t mask, int id)
+{
+    for (uint32_t h = __id_hash(id) & mask; p_slot[h] >= 0; h = (h + 1) & mask) {
+        if (p_head[p_slot[h]].id == id) {
+            return p_slot[h];
+        }
+    }
+    return -1;
+}
+
+struct __order_item {
+    int index;  // the flow's "index" of the module
+    int i;      // its position in the parsed array
+};
+
+static int __order_item_cmp(const void *a, const void *b)
+{
+    const struct __order_item *p_a = (const struct __order_item *)a;
+    const struct __order_item *p_b = (const struct __order_item *)b;
+
+    if (p_a->index != p_b->index) {
+        return p_a->index < p_b->index ? -1 : 1;
+    }
+    return p_a->i - p_b->i;
+}
+
+static esp_err_t __wire_types_check(const tf_module_item_t *p_src, int port, const tf_module_item_t *p_dst)
+{
+    uint32_t output_types = 0;
+
+    if (p_dst->p_io == NULL) {
+        return ESP_OK;
+    }
+    if (p_dst->p_io->input_types == 0) {
+        ESP_LOGE(TAG, "%s-%d -> %s-%d: %s takes no input", p_src->p_name, p_src->id, p_dst->p_name, p_dst->id, p_dst->p_name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (p_src->p_io == NULL) {
+        return ESP_OK;
+    }
+    output_types = p_src->p_io->output_types[port];
+    if (output_types & ~p_dst->p_io->input_types) {
+        ESP_LOGE(TAG, "%s-%d -> %s-%d: port %d publishes types 0x%lx, %s takes 0x%lx",
+                 p_src->p_name, p_src->id, p_dst->p_name, p_dst->id, port,
+                 (unsigned long)output_types, p_dst->p_name, (unsigned long)p_dst->p_io->input_types);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+int tf_parse_flow_compile(tf_module_item_t *p_head, int num, const char **pp_err_module)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t size = 1;
+    uint32_t mask = 0;
+    int *p_slot = NULL;       // id map
+    int *p_indegree = NULL;
+    struct __order_item *p_order = NULL; // topological order, sources first
+    int *p_new = NULL;        // duplicate wire stamps, then old index -> new index
+    tf_module_item_t *p_tmp = NULL;
+    int head = 0;
+    int tail = 0;
+    int stamp = 0;
+    int wire_num = 0;
+
+    *pp_err_module = NULL;
+    if (p_head == NULL || num <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (size < 2 * (uint32_t)num) {
+        size <<= 1;
+    }
+    mask = size - 1;
+
+    p_slot = (int *)tf_malloc(sizeof(int) * size);
+    p_indegree = (int *)tf_malloc(sizeof(int) * num);
+    p_order = (struct __order_item *)tf_malloc(sizeof(struct __order_item) * num);
+    p_new = (int *)tf_malloc(sizeof(int) * num);
+    p_tmp = (tf_module_item_t *)tf_malloc(sizeof(tf_module_item_t) * num);
+    ESP_GOTO_ON_FALSE(p_slot && p_indegree && p_order && p_new && p_tmp, ESP_ERR_NO_MEM, end, TAG, "malloc failed");
+
+    memset(p_slot, 0xff, sizeof(int) * size);
+    memset(p_indegree, 0, sizeof(int) * num);
+    memset(p_new, 0xff, sizeof(int) * num);
+
+    for (int i = 0; i < num; i++) {
+        uint32_t h = __id_hash(p_head[i].id) & mask;
+        for (; p_slot[h] >= 0; h = (h + 1) & mask) {
+            if (p_head[p_slot[h]].id == p_head[i].id) {
+                ESP_LOGE(TAG, "%s-%d: duplicate module id", p_head[i].p_name, p_head[i].id);
+                *pp_err_module = p_head[i].p_name;
+                ret = ESP_ERR_INVALID_ARG;
+                goto end;
+            }
+        }
+        p_slot[h] = i;
+    }
+
+    // resolve wires, count inputs
+    for (int i = 0; i < num; i++) {
+        tf_module_item_t *p_src = &p_head[i];
+
+        if (p_src->p_io && p_src->output_port_num > p_src->p_io->output_port_num) {
+            ESP_LOGE(TAG, "%s-%d: wires %d output ports, the module has %d",
+                     p_src->p_name, p_src->id, p_src->output_port_num, p_src->p_io->output_port_num);
+            *pp_err_module = p_src->p_name;
+            ret = ESP_ERR_INVALID_ARG;
+            goto end;
+        }
+        for (int m = 0; m < p_src->output_port_num; m++) {
+            struct tf_module_wires *p_wires = &p_src->p_wires[m];
+            stamp++;
+            for (int n = 0; n < p_wires->num; n++) {
+                int dst = __id_map_find(p_head, p_slot, mask, p_wires->p_evt_id[n]);
+                if (dst < 0) {
+                    ESP_LOGE(TAG, "%s-%d -> %d: no such module", p_src->p_name, p_src->id, p_wires->p_evt_id[n]);
+                    ret = ESP_ERR_NOT_FOUND;
+                } else if (dst == i) {
+                    ESP_LOGE(TAG, "%s-%d: wired to itself", p_src->p_name, p_src->id);
+                    ret = ESP_ERR_INVALID_STATE;
+                } else if (p_new[dst] == stamp) {
+                    ESP_LOGE(TAG, "%s-%d -> %s-%d: wired twice on port %d",
+                             p_src->p_name, p_src->id, p_head[dst].p_name, p_head[dst].id, m);
+                    ret = ESP_ERR_INVALID_ARG;
+                } else {
+                    ret = __wire_types_check(p_src, m, &p_head[dst]);
+                }
+                if (ret != ESP_OK) {
+                    *pp_err_module = p_src->p_name;
+                    goto end;
+                }
+                p_new[dst] = stamp;
+                p_wires->p_dst_index[n] = dst;
+                p_indegree[dst]++;
+                wire_num++;
+            }
+        }
+    }
+
+    // Kahn's algorithm one level at a time, p_order doubles as the queue. Inside a level the
+    // modules go by "index", which was the whole start order before wires decided it.
+    for (int i = 0; i < num; i++) {
+        if (p_indegree[i] == 0) {
+            p_order[tail].index = p_head[i].index;
+            p_order[tail++].i = i;
+        }
+    }
+    while (head < tail) {
+        int level_end = tail;
+        qsort(&p_order[head], level_end - head, sizeof(struct __order_item), __order_item_cmp);
+        while (head < level_end) {
+            tf_module_item_t *p_src = &p_head[p_order[head++].i];
+            for (int m = 0; m < p_src->output_port_num; m++) {
+                for (int n = 0; n < p_src->p_wires[m].num; n++) {
+                    int dst = p_src->p_wires[m].p_dst_index[n];
+                    if (--p_indegree[dst] == 0) {
+                        p_order[tail].index = p_head[dst].index;
+                        p_order[tail++].i = dst;
+                    }
+                }
+            }
+        }
+    }
+    if (tail < num) {
+        for (int i = 0; i < num; i++) {
+            if (p_indegree[i] > 0) {
+                ESP_LOGE(TAG, "%s-%d: wires form a cycle", p_head[i].p_name, p_head[i].id);
+                *pp_err_module = p_head[i].p_name;
+                break;
+            }
+        }
+        ret = ESP_ERR_INVALID_STATE;
+        goto end;
+    }
+
+    // reverse topological order, higher "index" first inside a level as the old sort had it,
+    // then point the wires at the new positions
+    for (int k = 0; k < num; k++) {
+        p_new[p_order[k].i] = num - 1 - k;
+    }
+    for (int i = 0; i < num; i++) {
+        p_tmp[p_new[i]] = p_head[i];
+    }
+    for (int i = 0; i < num; i++) {
+        for (int m = 0; m < p_tmp[i].output_port_num; m++) {
+            for (int n = 0; n < p_tmp[i].p_wires[m].num; n++) {
+                p_tmp[i].p_wires[m].p_dst_index[n] = p_new[p_tmp[i].p_wires[m].p_dst_index[n]];
+            }
+        }
+    }
+    memcpy(p_head, p_tmp, sizeof(tf_module_item_t) * num);
+
+    ESP_LOGI(TAG, "flow compiled: %d modules, %d wires", num, wire_num);
+
+end:
+    tf_free(p_slot);
+    tf_free(p_indegree);
+    tf_free(p_order);
+    tf_free(p_new);
+    tf_free(p_tmp);
+    return ret;
+}
+
 char* tf_parse_util_simplify_json(const char *p_str)
 {
     esp_err_t ret = ESP_OK;
@@ -1,14 +1,317 @@
 #include "tf_util.h"
 #include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 
+#ifndef CONFIG_TF_MEM_TRACK
+#undef CONFIG_TF_MEM_TRACK_NUM
+#define CONFIG_TF_MEM_TRACK_NUM   0
+#elif !defined(CONFIG_TF_MEM_TRACK_NUM)
+#define CONFIG_TF_MEM_TRACK_NUM   512
+#endif
+
+static const char *TAG = "tf.util";
+
+struct tf_mem_block
+{
+    void *ptr;        // NULL: free entry
+    uint32_t size;
+    int8_t slot;      // index in owner slots
+};
+
+struct tf_owner_slot
+{
+    bool used;
+    int owner;
+    tf_mem_stats_t stats;
+};
+
+struct tf_owner_task
+{
+    TaskHandle_t task;   // NULL: free entry
+    int owner;
+};
+
+typedef struct tf_mem_acct
+{
+    SemaphoreHandle_t sem_handle;
+    struct tf_mem_block *p_blocks;     // open addressing, at most half full
+    uint32_t block_mask;
+    uint32_t block_num;
+    uint32_t untracked;                // blocks allocated while the table was full
+    struct tf_owner_slot slots[TF_OWNER_MAX + 1];  // 0: TF_OWNER_NONE and owners that didn't fit
+    struct tf_owner_task tasks[TF_OWNER_TASK_MAX];
+} tf_mem_acct_t;
+
+static tf_mem_acct_t *gp_acct = NULL;
+
+static void __data_lock(tf_mem_acct_t *p_acct)
+{
+    xSemaphoreTake(p_acct->sem_handle, portMAX_DELAY);
+}
+static void __data_unlock(tf_mem_acct_t *p_acct)
+{
+    xSemaphoreGive(p_acct->sem_handle);
+}
+
+static uint32_t __ptr_hash(const void *ptr)
+{
+    uint32_t h = (uint32_t)((uintptr_t)ptr >> 3);  // heap blocks are 8 byte aligned
+    h = (h ^ (h >> 16)) * 0x45d9f3bu;
+    return h ^ (h >> 16);
+}
+
+// index of ptr, or of the free entry where it goes
+static uint32_t __block_probe(tf_mem_acct_t *p_acct, const void *ptr)
+{
+    uint32_t i = __ptr_hash(ptr) & p_acct->block_mask;
+    while (p_acct->p_blocks[i].ptr && p_acct->p_blocks[i].ptr != ptr) {
+        i = (i + 1) & p_acct->block_mask;
+    }
+    return i;
+}
+
+// shift the entries after i back so no probe runs into the hole
+static void __block_remove(tf_mem_acct_t *p_acct, uint32_t i)
+{
+    const uint32_t mask = p_acct->block_mask;
+    uint32_t hole = i;
+
+    for (uint32_t j = (hole + 1) & mask; p_acct->p_blocks[j].ptr; j = (j + 1) & mask) {
+        uint32_t home = __ptr_hash(p_acct->p_blocks[j].ptr) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            p_acct->p_blocks[hole] = p_acct->p_blocks[j];
+            hole = j;
+        }
+    }
+    p_acct->p_blocks[hole].ptr = NULL;
+    p_acct->block_num--;
+}
+
+static int __task_owner_get(tf_mem_acct_t *p_acct)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < TF_OWNER_TASK_MAX; i++) {
+        if (p_acct->tasks[i].task == task) {
+            return p_acct->tasks[i].owner;
+        }
+    }
+    return TF_OWNER_NONE;
+}
+
+static int __slot_get(tf_mem_acct_t *p_acct, int owner)
+{
+    int free_slot = 0;
+
+    if (owner == TF_OWNER_NONE) {
+        return 0;
+    }
+    for (int i = 1; i <= TF_OWNER_MAX; i++) {
+        if (p_acct->slots[i].used && p_acct->slots[i].owner == owner) {
+            return i;
+        }
+        if (!p_acct->slots[i].used && free_slot == 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot) {
+        memset(&p_acct->slots[free_slot], 0, sizeof(struct tf_owner_slot));
+        p_acct->slots[free_slot].used = true;
+        p_acct->slots[free_slot].owner = owner;
+    }
+    return free_slot;
+}
+
+static void __stats_sub(tf_mem_stats_t *p_stats, size_t size)
+{
+    p_stats->cur_bytes = p_stats->cur_bytes > size ? p_stats->cur_bytes - size : 0;
+}
+
+static void __acct_alloc(tf_mem_acct_t *p_acct, void *ptr, size_t size)
+{
+    tf_mem_stats_t *p_stats = NULL;
+    struct tf_mem_block *p_block = NULL;
+    uint32_t untracked = 0;
+
+    __data_lock(p_acct);
+    p_block = &p_acct->p_blocks[__block_probe(p_acct, ptr)];
+    if (p_block->ptr) {
+        // released with free(), the address is handed out again
+        __stats_sub(&p_acct->slots[p_block->slot].stats, p_block->size);
+    } else if (p_acct->block_num < CONFIG_TF_MEM_TRACK_NUM) {
+        p_acct->block_num++;
+    } else {
+        p_block = NULL;
+        untracked = ++p_acct->untracked;
+    }
+    if (p_block) {
+        p_block->ptr = ptr;
+        p_block->size = size;
+        p_block->slot = __slot_get(p_acct, __task_owner_get(p_acct));
+        p_stats = &p_acct->slots[p_block->slot].stats;
+        p_stats->alloc_num++;
+        p_stats->cur_bytes += size;
+        if (p_stats->cur_bytes > p_stats->peak_bytes) {
+            p_stats->peak_bytes = p_stats->cur_bytes;
+        }
+    }
+    __data_unlock(p_acct);
+
+    if (untracked == 1) {
+        ESP_LOGW(TAG, "more than %d blocks, the rest isn't tracked", CONFIG_TF_MEM_TRACK_NUM);
+    }
+}
+
+static void __acct_free(tf_mem_acct_t *p_acct, void *ptr)
+{
+    uint32_t i = 0;
+
+    __data_lock(p_acct);
+    i = __block_probe(p_acct, ptr);
+    if (p_acct->p_blocks[i].ptr) {
+        __stats_sub(&p_acct->slots[p_acct->p_blocks[i].slot].stats, p_acct->p_blocks[i].size);
+        __block_remove(p_acct, i);
+    }
+    __data_unlock(p_acct);
+}
+
+esp_err_t tf_mem_acct_init(void)
+{
+    esp_err_t ret = ESP_OK;
+    tf_mem_acct_t *p_acct = NULL;
+    uint32_t size = 1;
+
+    ESP_RETURN_ON_FALSE(gp_acct == NULL, ESP_ERR_INVALID_STATE, TAG, "already init");
+    if (CONFIG_TF_MEM_TRACK_NUM <= 0) {
+        return ESP_OK;
+    }
+    while (size < CONFIG_TF_MEM_TRACK_NUM * 2) {
+        size <<= 1;
+    }
+
+    // taken on every tf_malloc, keep it in internal ram
+    p_acct = heap_caps_calloc(1, sizeof(tf_mem_acct_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(p_acct, ESP_ERR_NO_MEM, TAG, "no mem for mem acct");
+
+    p_acct->p_blocks = heap_caps_calloc(size, sizeof(struct tf_mem_block), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_GOTO_ON_FALSE(p_acct->p_blocks, ESP_ERR_NO_MEM, err, TAG, "no mem for block table");
+
+    p_acct->sem_handle = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(p_acct->sem_handle, ESP_ERR_NO_MEM, err, TAG, "Failed to create semaphore");
+
+    p_acct->block_mask = size - 1;
+    p_acct->slots[0].used = true;
+    p_acct->slots[0].owner = TF_OWNER_NONE;
+    gp_acct = p_acct;
+    return ESP_OK;
+
+err:
+    free(p_acct->p_blocks);
+    free(p_acct);
+    return ret;
+}
+
+int tf_owner_set(int owner)
+{
+    tf_mem_acct_t *p_acct = gp_acct;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int prev = TF_OWNER_NONE;
+    int free_i = -1;
+    bool found = false;
+
+    if (p_acct == NULL) {
+        return TF_OWNER_NONE;
+    }
+
+    __data_lock(p_acct);
+    for (int i = 0; i < TF_OWNER_TASK_MAX; i++) {
+        if (p_acct->tasks[i].task == task) {
+            prev = p_acct->tasks[i].owner;
+            if (owner == TF_OWNER_NONE) {
+                p_acct->tasks[i].task = NULL;
+            } else {
+                p_acct->tasks[i].owner = owner;
+            }
+            found = true;
+            break;
+        }
+        if (p_acct->tasks[i].task == NULL && free_i < 0) {
+            free_i = i;
+        }
+    }
+    if (!found && owner != TF_OWNER_NONE && free_i >= 0) {
+        p_acct->tasks[free_i].task = task;
+        p_acct->tasks[free_i].owner = owner;
+    }
+    __data_unlock(p_acct);
+
+    if (!found && owner != TF_OWNER_NONE && free_i < 0) {
+        ESP_LOGW(TAG, "can't bind %s to %d, raise TF_OWNER_TASK_MAX", pcTaskGetName(NULL), owner);
+    }
+    return prev;
+}
+
+esp_err_t tf_mem_stats_get(int owner, tf_mem_stats_t *p_stats)
+{
+    tf_mem_acct_t *p_acct = gp_acct;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    ESP_RETURN_ON_FALSE(p_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (p_acct == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    __data_lock(p_acct);
+    for (int i = 0; i <= TF_OWNER_MAX; i++) {
+        if (p_acct->slots[i].used && p_acct->slots[i].owner == owner) {
+            *p_stats = p_acct->slots[i].stats;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    __data_unlock(p_acct);
+    return ret;
+}
+
+void tf_mem_stats_reset(void)
+{
+    tf_mem_acct_t *p_acct = gp_acct;
+
+    if (p_acct == NULL) {
+        return;
+    }
+
+    __data_lock(p_acct);
+    for (int i = 0; i <= TF_OWNER_MAX; i++) {
+        struct tf_owner_slot *p_slot = &p_acct->slots[i];
+        p_slot->stats.alloc_num = 0;
+        p_slot->stats.peak_bytes = p_slot->stats.cur_bytes;
+        if (i > 0 && p_slot->stats.cur_bytes == 0) {
+            p_slot->used = false;
+        }
+    }
+    __data_unlock(p_acct);
+}
+
 void *tf_malloc(size_t sz)
 {
-    return heap_caps_malloc(sz, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void *ptr = heap_caps_malloc(sz, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ptr && gp_acct) {
+        __acct_alloc(gp_acct, ptr, sz);
+    }
+    return ptr;
 }
 
 void tf_free(void *ptr)
 {
+    // forget the block before the heap may hand its address out again
+    if (ptr && gp_acct) {
+        __acct_free(gp_acct, ptr);
+    }
     free(ptr);
 }
 
@@ -27,7 +330,7 @@ bool tf_cJSON_IsGeneralTrue(const cJSON * const item)
 char *tf_strdup(const char *s)
 {
     size_t len = strlen(s) + 1;
-    void *new = heap_caps_calloc(1, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void *new = tf_malloc(len);
     if (new == NULL)
         return NULL;
     return (char *)memcpy(new, s, len);
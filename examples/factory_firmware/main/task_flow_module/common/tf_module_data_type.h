@@ -32,11 +32,20 @@ struct tf_data_buf
     uint32_t len;
 };
 
+// shared owner of an image buffer, see tf_data_image_share()
+struct tf_data_image_ref
+{
+    uint32_t refcnt;   //atomic, number of images pointing at the buffer
+    void (*release)(uint8_t *p_buf, void *p_ctx); //called by the last owner, NULL: tf_free
+    void *p_ctx;
+};
+
 struct tf_data_image
 {
     uint8_t *p_buf;  //base64 data
     uint32_t len;
     time_t   time;
+    struct tf_data_image_ref *p_ref;  //NULL: p_buf belongs to this image only
 };
 
 enum tf_data_inference_type {
@@ -50,6 +59,9 @@ enum tf_data_inference_type {
 // classes max num
 #define CONFIG_MODEL_CLASSES_MAX_NUM       20
 
+// roi zones max num
+#define CONFIG_MODEL_ZONES_MAX_NUM         4
+
 struct tf_data_inference_info
 {
     bool is_valid;
@@ -57,6 +69,8 @@ struct tf_data_inference_info
     void  *p_data;
     uint32_t cnt;
     char *classes[CONFIG_MODEL_CLASSES_MAX_NUM];
+    uint8_t zone_num;  // 0: no zones, boxes were not filtered
+    uint8_t zone_cnt[CONFIG_MODEL_ZONES_MAX_NUM];  // boxes with their centre in each zone
 };
 
 
@@ -0,0 +1,436 @@
+#include "tf_module_expr.h"
+#include <string.h>
+#include "tf_util.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "sscma_client_types.h"
+
+static const char *TAG = "tfm.expr";
+
+struct expr_compiler
+{
+    tf_expr_t *p_expr;
+    uint8_t score_default;
+    const struct tf_expr_zone_def *p_zone_defs;
+    int zone_def_num;
+};
+
+static esp_err_t __emit(struct expr_compiler *p_cc, uint8_t op, uint8_t arg)
+{
+    tf_expr_t *p_expr = p_cc->p_expr;
+
+    ESP_RETURN_ON_FALSE(p_expr->code_num < TF_EXPR_CODE_MAX, ESP_ERR_INVALID_ARG, TAG, "more than %d nodes", TF_EXPR_CODE_MAX);
+    p_expr->code[p_expr->code_num].op = op;
+    p_expr->code[p_expr->code_num].arg = arg;
+    p_expr->code_num++;
+    return ESP_OK;
+}
+
+static esp_err_t __cmp_parse(const cJSON *p_json, uint8_t *p_cmp)
+{
+    static const char *cmp_str[] = {
+        [TF_EXPR_CMP_LT] = "<",
+        [TF_EXPR_CMP_LE] = "<=",
+        [TF_EXPR_CMP_EQ] = "==",
+        [TF_EXPR_CMP_NE] = "!=",
+        [TF_EXPR_CMP_GE] = ">=",
+        [TF_EXPR_CMP_GT] = ">",
+    };
+
+    if( p_json == NULL ) {
+        *p_cmp = TF_EXPR_CMP_GT;
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_FALSE(cJSON_IsString(p_json), ESP_ERR_INVALID_ARG, TAG, "op is not a string");
+    for (int i = 0; i < sizeof(cmp_str) / sizeof(cmp_str[0]); i++) {
+        if( strcmp(p_json->valuestring, cmp_str[i]) == 0 ) {
+            *p_cmp = i;
+            return ESP_OK;
+        }
+    }
+    ESP_LOGE(TAG, "unknown op: %s", p_json->valuestring);
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t tf_expr_zone_parse(const cJSON *p_json, struct tf_expr_zone *p_zone)
+{
+    int num = cJSON_GetArraySize(p_json);
+    int32_t x[TF_EXPR_ZONE_POINT_MAX];
+    int32_t y[TF_EXPR_ZONE_POINT_MAX];
+
+    ESP_RETURN_ON_FALSE(cJSON_IsArray(p_json), ESP_ERR_INVALID_ARG, TAG, "zone is not an array");
+    memset(p_zone, 0, sizeof(struct tf_expr_zone));
+
+    // [x, y, w, h]
+    if( num == 4 && cJSON_IsNumber(cJSON_GetArrayItem(p_json, 0)) ) {
+        int v[4];
+        for (int i = 0; i < 4; i++) {
+            cJSON *p_item = cJSON_GetArrayItem(p_json, i);
+            ESP_RETURN_ON_FALSE(cJSON_IsNumber(p_item), ESP_ERR_INVALID_ARG, TAG, "zone rect needs numbers");
+            v[i] = p_item->valueint;
+        }
+        ESP_RETURN_ON_FALSE(v[2] > 0 && v[3] > 0, ESP_ERR_INVALID_ARG, TAG, "zone rect is empty");
+        p_zone->type = TF_EXPR_ZONE_RECT;
+        p_zone->min_x = v[0];
+        p_zone->min_y = v[1];
+        p_zone->max_x = v[0] + v[2];
+        p_zone->max_y = v[1] + v[3];
+        return ESP_OK;
+    }
+
+    // [[x, y], ...]
+    ESP_RETURN_ON_FALSE(num >= 3 && num <= TF_EXPR_ZONE_POINT_MAX, ESP_ERR_INVALID_ARG, TAG,
+                        "zone polygon needs 3~%d points", TF_EXPR_ZONE_POINT_MAX);
+    for (int i = 0; i < num; i++) {
+        cJSON *p_point = cJSON_GetArrayItem(p_json, i);
+        ESP_RETURN_ON_FALSE(cJSON_IsArray(p_point) && cJSON_GetArraySize(p_point) == 2 &&
+                            cJSON_IsNumber(cJSON_GetArrayItem(p_point, 0)) &&
+                            cJSON_IsNumber(cJSON_GetArrayItem(p_point, 1)),
+                            ESP_ERR_INVALID_ARG, TAG, "zone point is not [x, y]");
+        x[i] = cJSON_GetArrayItem(p_point, 0)->valueint;
+        y[i] = cJSON_GetArrayItem(p_point, 1)->valueint;
+    }
+
+    p_zone->type = TF_EXPR_ZONE_POLYGON;
+    p_zone->edge_num = 0;
+    p_zone->min_x = p_zone->max_x = x[0];
+    p_zone->min_y = p_zone->max_y = y[0];
+    for (int i = 0; i < num; i++) {
+        int j = (i + 1) % num;
+        if( x[i] < p_zone->min_x ) p_zone->min_x = x[i];
+        if( x[i] > p_zone->max_x ) p_zone->max_x = x[i];
+        if( y[i] < p_zone->min_y ) p_zone->min_y = y[i];
+        if( y[i] > p_zone->max_y ) p_zone->max_y = y[i];
+        if( y[i] == y[j] ) {
+            continue;  // never crossed by a horizontal ray
+        }
+        struct tf_expr_edge *p_edge = &p_zone->edges[p_zone->edge_num++];
+        int a = y[i] < y[j] ? i : j;
+        int b = y[i] < y[j] ? j : i;
+        p_edge->x0 = x[a];
+        p_edge->y0 = y[a];
+        p_edge->y1 = y[b];
+        p_edge->dx = x[b] - x[a];
+        p_edge->dy = y[b] - y[a];
+    }
+    p_zone->max_x++;
+    p_zone->max_y++;
+    return ESP_OK;
+}
+
+static esp_err_t __term_parse(struct expr_compiler *p_cc, const cJSON *p_json)
+{
+    static const char *keys[] = { "class", "score", "zone", "area", "op", "num", "dwell" };
+    tf_expr_t *p_expr = p_cc->p_expr;
+    struct tf_expr_term *p_term = NULL;
+    cJSON *p_item = NULL;
+
+    // a misspelt key would otherwise drop its filter and match every box
+    cJSON_ArrayForEach(p_item, p_json) {
+        int i = 0;
+        for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if( strcmp(p_item->string, keys[i]) == 0 ) {
+                break;
+            }
+        }
+        ESP_RETURN_ON_FALSE(i < sizeof(keys) / sizeof(keys[0]), ESP_ERR_INVALID_ARG, TAG, "unknown key: %s", p_item->string);
+    }
+
+    ESP_RETURN_ON_FALSE(p_expr->term_num < TF_EXPR_TERM_MAX, ESP_ERR_INVALID_ARG, TAG, "more than %d terms", TF_EXPR_TERM_MAX);
+    p_term = &p_expr->terms[p_expr->term_num];
+    memset(p_term, 0, sizeof(struct tf_expr_term));
+    p_term->class_id = TF_EXPR_CLASS_ANY;
+    p_term->score = p_cc->score_default;
+    p_term->since_us = -1;
+
+    p_item = cJSON_GetObjectItem(p_json, "class");
+    if( p_item ) {
+        ESP_RETURN_ON_FALSE(cJSON_IsString(p_item) && strlen(p_item->valuestring) < TF_EXPR_CLASS_NAME_MAX,
+                            ESP_ERR_INVALID_ARG, TAG, "class is not a name");
+        strcpy(p_term->class_name, p_item->valuestring);
+        p_term->class_id = TF_EXPR_CLASS_NONE;
+    }
+
+    p_item = cJSON_GetObjectItem(p_json, "score");
+    if( p_item ) {
+        ESP_RETURN_ON_FALSE(cJSON_IsNumber(p_item) && p_item->valueint >= 0 && p_item->valueint <= 100,
+                            ESP_ERR_INVALID_ARG, TAG, "score is not 0~100");
+        p_term->score = p_item->valueint;
+    }
+
+    p_item = cJSON_GetObjectItem(p_json, "zone");
+    if( p_item && cJSON_IsString(p_item) ) {
+        int i = 0;
+        for (i = 0; i < p_cc->zone_def_num; i++) {
+            if( strcmp(p_cc->p_zone_defs[i].name, p_item->valuestring) == 0 ) {
+                p_term->zone = p_cc->p_zone_defs[i].zone;
+                break;
+            }
+        }
+        ESP_RETURN_ON_FALSE(i < p_cc->zone_def_num, ESP_ERR_INVALID_ARG, TAG, "unknown zone: %s", p_item->valuestring);
+    } else if( p_item ) {
+        ESP_RETURN_ON_ERROR(tf_expr_zone_parse(p_item, &p_term->zone), TAG, "bad zone");
+    }
+
+    p_item = cJSON_GetObjectItem(p_json, "area");
+    if( p_item ) {
+        ESP_RETURN_ON_FALSE(cJSON_IsArray(p_item) && cJSON_GetArraySize(p_item) == 2 &&
+                            cJSON_IsNumber(cJSON_GetArrayItem(p_item, 0)) &&
+                            cJSON_IsNumber(cJSON_GetArrayItem(p_item, 1)),
+                            ESP_ERR_INVALID_ARG, TAG, "area is not [min, max]");
+        p_term->area_min = cJSON_GetArrayItem(p_item, 0)->valueint;
+        p_term->area_max = cJSON_GetArrayItem(p_item, 1)->valueint;
+    }
+
+    ESP_RETURN_ON_ERROR(__cmp_parse(cJSON_GetObjectItem(p_json, "op"), &p_term->cmp), TAG, "bad op");
+
+    p_item = cJSON_GetObjectItem(p_json, "num");
+    if( p_item ) {
+        ESP_RETURN_ON_FALSE(cJSON_IsNumber(p_item), ESP_ERR_INVALID_ARG, TAG, "num is not a number");
+        p_term->num = p_item->valueint;
+    }
+
+    p_item = cJSON_GetObjectItem(p_json, "dwell");
+    if( p_item ) {
+        ESP_RETURN_ON_FALSE(cJSON_IsNumber(p_item) && p_item->valuedouble >= 0, ESP_ERR_INVALID_ARG, TAG, "dwell is not seconds");
+        p_term->dwell_ms = (uint32_t)(p_item->valuedouble * 1000);
+    }
+
+    return __emit(p_cc, TF_EXPR_OP_TERM, p_expr->term_num++);
+}
+
+static esp_err_t __node_compile(struct expr_compiler *p_cc, const cJSON *p_json, int nest)
+{
+    cJSON *p_and = NULL;
+    cJSON *p_or = NULL;
+    cJSON *p_not = NULL;
+
+    ESP_RETURN_ON_FALSE(cJSON_IsObject(p_json), ESP_ERR_INVALID_ARG, TAG, "node is not an object");
+    ESP_RETURN_ON_FALSE(nest < TF_EXPR_NEST_MAX, ESP_ERR_INVALID_ARG, TAG, "nested deeper than %d", TF_EXPR_NEST_MAX);
+
+    p_and = cJSON_GetObjectItem(p_json, "and");
+    p_or = cJSON_GetObjectItem(p_json, "or");
+    p_not = cJSON_GetObjectItem(p_json, "not");
+    ESP_RETURN_ON_FALSE(!!p_and + !!p_or + !!p_not <= 1, ESP_ERR_INVALID_ARG, TAG, "node mixes and, or, not");
+    ESP_RETURN_ON_FALSE(!(p_and || p_or || p_not) || cJSON_GetArraySize(p_json) == 1, ESP_ERR_INVALID_ARG, TAG,
+                        "and, or, not node has term keys");
+
+    if( p_not ) {
+        ESP_RETURN_ON_ERROR(__node_compile(p_cc, p_not, nest + 1), TAG, "bad not");
+        return __emit(p_cc, TF_EXPR_OP_NOT, 0);
+    }
+
+    if( p_and || p_or ) {
+        cJSON *p_list = p_and ? p_and : p_or;
+        int num = cJSON_GetArraySize(p_list);
+
+        ESP_RETURN_ON_FALSE(cJSON_IsArray(p_list) && num > 0, ESP_ERR_INVALID_ARG, TAG, "and/or needs a list of nodes");
+        for (int i = 0; i < num; i++) {
+            ESP_RETURN_ON_ERROR(__node_compile(p_cc, cJSON_GetArrayItem(p_list, i), nest + 1), TAG, "bad and/or");
+        }
+        return __emit(p_cc, p_and ? TF_EXPR_OP_AND : TF_EXPR_OP_OR, num);
+    }
+
+    return __term_parse(p_cc, p_json);
+}
+
+esp_err_t tf_expr_compile(const cJSON *p_json, uint8_t score_default,
+                          const struct tf_expr_zone_def *p_zone_defs, int zone_def_num,
+                          tf_expr_t **pp_expr)
+{
+    esp_err_t ret = ESP_OK;
+    struct expr_compiler cc;
+
+    *pp_expr = NULL;
+    memset(&cc, 0, sizeof(cc));
+    cc.score_default = score_default;
+    cc.p_zone_defs = p_zone_defs;
+    cc.zone_def_num = zone_def_num;
+    cc.p_expr = (tf_expr_t *)tf_malloc(sizeof(tf_expr_t));
+    ESP_RETURN_ON_FALSE(cc.p_expr, ESP_ERR_NO_MEM, TAG, "no mem for expr");
+    memset(cc.p_expr, 0, sizeof(tf_expr_t));
+
+    ESP_GOTO_ON_ERROR(__node_compile(&cc, p_json, 0), err, TAG, "compile failed");
+
+    ESP_LOGI(TAG, "compiled %d terms into %d insns", cc.p_expr->term_num, cc.p_expr->code_num);
+    *pp_expr = cc.p_expr;
+    return ESP_OK;
+
+err:
+    tf_free(cc.p_expr);
+    return ret;
+}
+
+void tf_expr_bind(tf_expr_t *p_expr, char *classes[])
+{
+    for (int i = 0; i < p_expr->term_num; i++) {
+        struct tf_expr_term *p_term = &p_expr->terms[i];
+
+        if( p_term->class_name[0] == '\0' ) {
+            continue;
+        }
+        p_term->class_id = TF_EXPR_CLASS_NONE;
+        for (int j = 0; j < CONFIG_MODEL_CLASSES_MAX_NUM && classes[j] != NULL; j++) {
+            if( strcmp(classes[j], p_term->class_name) == 0 ) {
+                p_term->class_id = j;
+                break;
+            }
+        }
+        if( p_term->class_id == TF_EXPR_CLASS_NONE ) {
+            ESP_LOGW(TAG, "class %s not in model", p_term->class_name);
+        }
+    }
+}
+
+void tf_expr_reset(tf_expr_t *p_expr)
+{
+    for (int i = 0; i < p_expr->term_num; i++) {
+        p_expr->terms[i].since_us = -1;
+    }
+}
+
+bool tf_expr_zone_contains(const struct tf_expr_zone *p_zone, int32_t x, int32_t y)
+{
+    bool inside = false;
+
+    if( x < p_zone->min_x || x >= p_zone->max_x || y < p_zone->min_y || y >= p_zone->max_y ) {
+        return false;
+    }
+    if( p_zone->type != TF_EXPR_ZONE_POLYGON ) {
+        return true;
+    }
+
+    // crossing number of a ray towards +x, on integers only
+    for (int i = 0; i < p_zone->edge_num; i++) {
+        const struct tf_expr_edge *p_edge = &p_zone->edges[i];
+        if( y >= p_edge->y0 && y < p_edge->y1 &&
+            (int64_t)(x - p_edge->x0) * p_edge->dy < (int64_t)p_edge->dx * (y - p_edge->y0) ) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+static bool __term_box_match(const struct tf_expr_term *p_term, const sscma_client_box_t *p_box)
+{
+    uint32_t area = 0;
+
+    if( p_box->score < p_term->score ) {
+        return false;
+    }
+    if( p_term->class_id != TF_EXPR_CLASS_ANY && p_term->class_id != p_box->target ) {
+        return false;
+    }
+    if( p_term->area_min || p_term->area_max ) {
+        area = (uint32_t)p_box->w * p_box->h;
+        if( area < p_term->area_min || (p_term->area_max && area > p_term->area_max) ) {
+            return false;
+        }
+    }
+    if( p_term->zone.type != TF_EXPR_ZONE_NONE && !tf_expr_zone_contains(&p_term->zone, p_box->x, p_box->y) ) {
+        return false;  // x, y is the box centre
+    }
+    return true;
+}
+
+static bool __term_class_match(const struct tf_expr_term *p_term, const sscma_client_class_t *p_class)
+{
+    // classification has no boxes, nothing is inside a zone or has an area
+    if( p_term->zone.type != TF_EXPR_ZONE_NONE || p_term->area_min || p_term->area_max ) {
+        return false;
+    }
+    return p_class->score >= p_term->score &&
+           (p_term->class_id == TF_EXPR_CLASS_ANY || p_term->class_id == p_class->target);
+}
+
+static bool __cmp(uint8_t cmp, int a, int b)
+{
+    switch (cmp)
+    {
+    case TF_EXPR_CMP_LT: return a < b;
+    case TF_EXPR_CMP_LE: return a <= b;
+    case TF_EXPR_CMP_EQ: return a == b;
+    case TF_EXPR_CMP_NE: return a != b;
+    case TF_EXPR_CMP_GE: return a >= b;
+    case TF_EXPR_CMP_GT: return a > b;
+    default:
+        break;
+    }
+    return false;
+}
+
+bool tf_expr_eval(tf_expr_t *p_expr, const struct tf_data_inference_info *p_inference, int64_t now_us)
+{
+    int cnt[TF_EXPR_TERM_MAX] = { 0 };
+    bool result[TF_EXPR_TERM_MAX];
+    bool stack[TF_EXPR_CODE_MAX];  // never deeper than the code is long
+    int sp = 0;
+
+    // one pass over the boxes counts every term
+    if( p_inference->is_valid && p_inference->p_data ) {
+        if( p_inference->type == INFERENCE_TYPE_BOX ) {
+            const sscma_client_box_t *p_box = (const sscma_client_box_t *)p_inference->p_data;
+            for (int i = 0; i < p_inference->cnt; i++) {
+                for (int j = 0; j < p_expr->term_num; j++) {
+                    cnt[j] += __term_box_match(&p_expr->terms[j], &p_box[i]);
+                }
+            }
+        } else if( p_inference->type == INFERENCE_TYPE_CLASS ) {
+            const sscma_client_class_t *p_class = (const sscma_client_class_t *)p_inference->p_data;
+            for (int i = 0; i < p_inference->cnt; i++) {
+                for (int j = 0; j < p_expr->term_num; j++) {
+                    cnt[j] += __term_class_match(&p_expr->terms[j], &p_class[i]);
+                }
+            }
+        }
+    }
+
+    // all terms every frame, dwell must not miss a frame to short circuit
+    for (int j = 0; j < p_expr->term_num; j++) {
+        struct tf_expr_term *p_term = &p_expr->terms[j];
+        if( p_term->class_id == TF_EXPR_CLASS_NONE ) {
+            cnt[j] = 0;
+        }
+        if( !__cmp(p_term->cmp, cnt[j], p_term->num) ) {
+            p_term->since_us = -1;
+            result[j] = false;
+            continue;
+        }
+        if( p_term->since_us < 0 ) {
+            p_term->since_us = now_us;
+        }
+        result[j] = (now_us - p_term->since_us) >= (int64_t)p_term->dwell_ms * 1000;
+        ESP_LOGD(TAG, "term %d: %d %s", j, cnt[j], result[j] ? "true" : "dwelling");
+    }
+
+    for (int i = 0; i < p_expr->code_num; i++) {
+        const struct tf_expr_insn *p_insn = &p_expr->code[i];
+        switch (p_insn->op)
+        {
+        case TF_EXPR_OP_TERM:
+            stack[sp++] = result[p_insn->arg];
+            break;
+        case TF_EXPR_OP_AND:
+        case TF_EXPR_OP_OR: {
+            bool v = (p_insn->op == TF_EXPR_OP_AND);
+            for (int k = 0; k < p_insn->arg; k++) {
+                bool top = stack[--sp];
+                v = (p_insn->op == TF_EXPR_OP_AND) ? (v && top) : (v || top);
+            }
+            stack[sp++] = v;
+            break;
+        }
+        case TF_EXPR_OP_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+        default:
+            break;
+        }
+    }
+    return sp == 1 && stack[0];
+}
+
+void tf_expr_free(tf_expr_t *p_expr)
+{
+    tf_free(p_expr);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "cJSON.h"
+#include "tf_module_data_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Trigger expressions for the ai camera.
+ *
+ * An expression is a JSON tree of and / or / not nodes over terms, a term
+ * counts the boxes that pass its filters and compares the count:
+ *
+ *   {"and": [
+ *       {"class": "person", "zone": [[60,200],[380,200],[380,400],[60,400]], "op": ">", "num": 0, "dwell": 10},
+ *       {"not": {"class": "dog", "area": [2000, 0]}}
+ *   ]}
+ *
+ * term keys, all optional:
+ *   class: class name, absent matches every class
+ *   score: lowest score of a box, 0~100
+ *   zone:  box centre inside [x, y, w, h], inside the polygon [[x, y], ...]
+ *          or inside the named zone of zone_defs
+ *   area:  [min, max] of box w*h in pixels, max 0: no limit
+ *   op:    "<", "<=", "==", "!=", ">=" or ">", default ">"
+ *   num:   value the count is compared with, default 0
+ *   dwell: seconds the comparison must hold before the term is true
+ * any other key, or a term key next to and / or / not, is an error.
+ *
+ * The tree is compiled once into postfix code, every frame then walks the
+ * boxes once to count all terms and runs the code on the results.
+ */
+
+#define TF_EXPR_TERM_MAX         16
+#define TF_EXPR_CODE_MAX         32
+#define TF_EXPR_NEST_MAX         8
+#define TF_EXPR_ZONE_POINT_MAX   8
+#define TF_EXPR_CLASS_NAME_MAX   32
+#define TF_EXPR_ZONE_NAME_MAX    32
+
+#define TF_EXPR_CLASS_ANY        -1  // term has no class
+#define TF_EXPR_CLASS_NONE       -2  // class not in the model, counts stay 0
+
+enum tf_expr_cmp {
+    TF_EXPR_CMP_LT = 0,
+    TF_EXPR_CMP_LE,
+    TF_EXPR_CMP_EQ,
+    TF_EXPR_CMP_NE,
+    TF_EXPR_CMP_GE,
+    TF_EXPR_CMP_GT,
+};
+
+enum tf_expr_op {
+    TF_EXPR_OP_TERM = 0,   // push the result of term arg
+    TF_EXPR_OP_AND,        // pop arg results, push true if all are true
+    TF_EXPR_OP_OR,         // pop arg results, push true if any is true
+    TF_EXPR_OP_NOT,
+};
+
+enum tf_expr_zone_type {
+    TF_EXPR_ZONE_NONE = 0,
+    TF_EXPR_ZONE_RECT,
+    TF_EXPR_ZONE_POLYGON,
+};
+
+// polygon edge with y0 < y1, horizontal edges are dropped when compiled
+struct tf_expr_edge
+{
+    int32_t x0;
+    int32_t y0;
+    int32_t y1;
+    int32_t dx;
+    int32_t dy;
+};
+
+struct tf_expr_zone
+{
+    uint8_t type;         // enum tf_expr_zone_type
+    uint8_t edge_num;
+    int32_t min_x;        // bounding box, [min, max)
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+    struct tf_expr_edge edges[TF_EXPR_ZONE_POINT_MAX];
+};
+
+// a zone configured once and referred to by name
+struct tf_expr_zone_def
+{
+    char name[TF_EXPR_ZONE_NAME_MAX];
+    struct tf_expr_zone zone;
+};
+
+struct tf_expr_term
+{
+    char class_name[TF_EXPR_CLASS_NAME_MAX];
+    int16_t class_id;     // TF_EXPR_CLASS_* or index in the model classes, see tf_expr_bind()
+    uint8_t score;
+    uint8_t cmp;          // enum tf_expr_cmp
+    int num;
+    uint32_t area_min;
+    uint32_t area_max;
+    uint32_t dwell_ms;
+    struct tf_expr_zone zone;
+    int64_t since_us;     // when the comparison became true, -1: it is false
+};
+
+struct tf_expr_insn
+{
+    uint8_t op;           // enum tf_expr_op
+    uint8_t arg;
+};
+
+typedef struct tf_expr
+{
+    struct tf_expr_term terms[TF_EXPR_TERM_MAX];
+    int term_num;
+    struct tf_expr_insn code[TF_EXPR_CODE_MAX];
+    int code_num;
+} tf_expr_t;
+
+/**
+ * Compile an expression, terms without score get score_default. Zone names are
+ * looked up in p_zone_defs, which may be NULL when zone_def_num is 0.
+ * Classes stay unresolved until tf_expr_bind().
+ *
+ * @return ESP_ERR_INVALID_ARG on a malformed tree, an unknown key or zone name, or a
+ *         tree over the TF_EXPR_*_MAX limits.
+ */
+esp_err_t tf_expr_compile(const cJSON *p_json, uint8_t score_default,
+                          const struct tf_expr_zone_def *p_zone_defs, int zone_def_num,
+                          tf_expr_t **pp_expr);
+
+/**
+ * Resolve class names against the classes of the loaded model, a NULL terminated list.
+ */
+void tf_expr_bind(tf_expr_t *p_expr, char *classes[]);
+
+/**
+ * Forget dwell times, the next frame starts counting afresh.
+ */
+void tf_expr_reset(tf_expr_t *p_expr);
+
+/**
+ * Evaluate one frame, now_us is a monotonic time used for dwell.
+ */
+bool tf_expr_eval(tf_expr_t *p_expr, const struct tf_data_inference_info *p_inference, int64_t now_us);
+
+void tf_expr_free(tf_expr_t *p_expr);
+
+/**
+ * Parse a zone, the rectangle [x, y, w, h] or the polygon [[x, y], ...].
+ */
+esp_err_t tf_expr_zone_parse(const cJSON *p_json, struct tf_expr_zone *p_zone);
+
+/**
+ * Whether the point is inside the zone, integer math only.
+ */
+bool tf_expr_zone_contains(const struct tf_expr_zone *p_zone, int32_t x, int32_t y);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,433 @@
+#include "tf_module_outbox.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/queue.h>
+#include "tf_util.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "sensecap-watcher.h"
+
+static const char *TAG = "tfm.outbox";
+
+#define OUTBOX_MAGIC        0x324f4654  // "TFO2", files without a destination are dropped
+#define OUTBOX_SUFFIX       ".ob"
+#define OUTBOX_SUFFIX_TMP   ".tp"
+#define OUTBOX_PATH_MAX     64
+
+struct outbox_hdr
+{
+    uint32_t magic;
+    uint32_t key;
+    uint32_t dest;
+    uint32_t len;
+    uint32_t crc;     // of the message
+};
+
+struct outbox_item
+{
+    uint32_t seq;
+    uint32_t key;
+    uint32_t dest;
+};
+
+struct tf_outbox
+{
+    tf_outbox_cfg_t cfg;
+    char name[TF_OUTBOX_NAME_LEN_MAX + 1];
+    char dir[16];
+    struct outbox_item items[TF_OUTBOX_NUM_MAX];  // oldest first
+    int num;
+    uint32_t seq_next;
+    int attempts;                                  // failed sends of items[0]
+    int64_t next_try_us;
+    uint32_t sent_key;                             // of the last message sent, not sent twice
+    volatile uint32_t dest;                        // set by the owner's config, read by its task
+    SLIST_ENTRY(tf_outbox) next;
+};
+
+// open outboxes, a name is open once
+static SLIST_HEAD(, tf_outbox) __g_outboxes = SLIST_HEAD_INITIALIZER(__g_outboxes);
+static portMUX_TYPE __g_outboxes_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool __claim(tf_outbox_t *p_outbox)
+{
+    tf_outbox_t *it = NULL;
+    bool claimed = true;
+
+    taskENTER_CRITICAL(&__g_outboxes_mux);
+    SLIST_FOREACH(it, &__g_outboxes, next) {
+        if( strcmp(it->name, p_outbox->name) == 0 ) {
+            claimed = false;
+            break;
+        }
+    }
+    if( claimed ) {
+        SLIST_INSERT_HEAD(&__g_outboxes, p_outbox, next);
+    }
+    taskEXIT_CRITICAL(&__g_outboxes_mux);
+    return claimed;
+}
+
+static void __path_get(tf_outbox_t *p_outbox, uint32_t seq, const char *p_suffix, char *p_path)
+{
+    snprintf(p_path, OUTBOX_PATH_MAX, "%s/%s%08" PRIx32 "%s", p_outbox->dir, p_outbox->name, seq, p_suffix);
+}
+
+static void __item_remove(tf_outbox_t *p_outbox, int idx)
+{
+    char path[OUTBOX_PATH_MAX];
+
+    __path_get(p_outbox, p_outbox->items[idx].seq, OUTBOX_SUFFIX, path);
+    remove(path);
+    memmove(&p_outbox->items[idx], &p_outbox->items[idx + 1], (p_outbox->num - idx - 1) * sizeof(struct outbox_item));
+    p_outbox->num--;
+    if( idx == 0 ) {
+        p_outbox->attempts = 0;
+        p_outbox->next_try_us = 0;
+    }
+}
+
+static int __item_cmp(const void *p_a, const void *p_b)
+{
+    uint32_t a = ((const struct outbox_item *)p_a)->seq;
+    uint32_t b = ((const struct outbox_item *)p_b)->seq;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// pick up the messages of the last run, clear half written ones
+static void __load(tf_outbox_t *p_outbox)
+{
+    size_t name_len = strlen(p_outbox->name);
+    char path[OUTBOX_PATH_MAX];
+    struct dirent *p_entry = NULL;
+    DIR *p_dir = opendir(p_outbox->dir);
+
+    if( p_dir == NULL ) {
+        return;
+    }
+    while( (p_entry = readdir(p_dir)) != NULL ) {
+        const char *p_name = p_entry->d_name;
+        char *p_end = NULL;
+        uint32_t seq = 0;
+        struct outbox_hdr hdr;
+        FILE *fp = NULL;
+
+        if( strncmp(p_name, p_outbox->name, name_len) != 0 || strlen(p_name) != name_len + 8 + strlen(OUTBOX_SUFFIX) ) {
+            continue;
+        }
+        seq = strtoul(p_name + name_len, &p_end, 16);
+        if( p_end != p_name + name_len + 8 ) {
+            continue;
+        }
+        if( strcmp(p_end, OUTBOX_SUFFIX_TMP) == 0 ) {
+            __path_get(p_outbox, seq, OUTBOX_SUFFIX_TMP, path);
+            remove(path);
+            continue;
+        }
+        if( strcmp(p_end, OUTBOX_SUFFIX) != 0 ) {
+            continue;
+        }
+
+        __path_get(p_outbox, seq, OUTBOX_SUFFIX, path);
+        fp = fopen(path, "rb");
+        if( fp == NULL ) {
+            continue;
+        }
+        if( fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != OUTBOX_MAGIC ) {
+            fclose(fp);
+            remove(path);
+            continue;
+        }
+        fclose(fp);
+
+        if( p_outbox->num == TF_OUTBOX_NUM_MAX ) {
+            ESP_LOGW(TAG, "%s: more than %d messages, skip %s", p_outbox->name, TF_OUTBOX_NUM_MAX, p_name);
+            continue;
+        }
+        p_outbox->items[p_outbox->num].seq = seq;
+        p_outbox->items[p_outbox->num].key = hdr.key;
+        p_outbox->items[p_outbox->num].dest = hdr.dest;
+        p_outbox->num++;
+        if( seq >= p_outbox->seq_next ) {
+            p_outbox->seq_next = seq + 1;
+        }
+    }
+    closedir(p_dir);
+
+    qsort(p_outbox->items, p_outbox->num, sizeof(struct outbox_item), __item_cmp);
+    while( p_outbox->num > p_outbox->cfg.num ) {
+        __item_remove(p_outbox, 0);
+    }
+}
+
+esp_err_t tf_outbox_open(const tf_outbox_cfg_t *p_cfg, tf_outbox_t **pp_outbox)
+{
+    tf_outbox_t *p_outbox = NULL;
+    DIR *p_dir = NULL;
+
+    ESP_RETURN_ON_FALSE(p_cfg && p_cfg->name && p_cfg->send, ESP_ERR_INVALID_ARG, TAG, "no name or send");
+    ESP_RETURN_ON_FALSE(strlen(p_cfg->name) > 0 && strlen(p_cfg->name) <= TF_OUTBOX_NAME_LEN_MAX,
+                        ESP_ERR_INVALID_ARG, TAG, "name is 1~%d chars", TF_OUTBOX_NAME_LEN_MAX);
+    ESP_RETURN_ON_FALSE(p_cfg->num > 0 && p_cfg->num <= TF_OUTBOX_NUM_MAX, ESP_ERR_INVALID_ARG, TAG,
+                        "num is 1~%d", TF_OUTBOX_NUM_MAX);
+
+    p_outbox = (tf_outbox_t *)tf_malloc(sizeof(tf_outbox_t));
+    ESP_RETURN_ON_FALSE(p_outbox, ESP_ERR_NO_MEM, TAG, "no mem for outbox");
+    memset(p_outbox, 0, sizeof(tf_outbox_t));
+    p_outbox->cfg = *p_cfg;
+    strcpy(p_outbox->name, p_cfg->name);
+    if( !__claim(p_outbox) ) {
+        ESP_LOGE(TAG, "%s: already open", p_outbox->name);
+        tf_free(p_outbox);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if( p_cfg->dir ) {
+        snprintf(p_outbox->dir, sizeof(p_outbox->dir), "%s", p_cfg->dir);
+    } else {
+        // board_init mounts the sd card only when one is inserted
+        p_dir = opendir(DRV_BASE_PATH_SD);
+        if( p_dir ) {
+            closedir(p_dir);
+        }
+        snprintf(p_outbox->dir, sizeof(p_outbox->dir), "%s", p_dir ? DRV_BASE_PATH_SD : DRV_BASE_PATH_FLASH);
+    }
+
+    __load(p_outbox);
+    ESP_LOGI(TAG, "%s: %s, %d unsent", p_outbox->name, p_outbox->dir, p_outbox->num);
+
+    *pp_outbox = p_outbox;
+    return ESP_OK;
+}
+
+void tf_outbox_dest_set(tf_outbox_t *p_outbox, uint32_t dest)
+{
+    if( dest != p_outbox->dest ) {
+        ESP_LOGI(TAG, "%s: destination %08" PRIx32, p_outbox->name, dest);
+        p_outbox->sent_key = 0;
+    }
+    p_outbox->dest = dest;
+}
+
+static esp_err_t __check(tf_outbox_t *p_outbox, uint32_t dest, uint32_t key, size_t len)
+{
+    ESP_RETURN_ON_FALSE(dest != 0, ESP_ERR_INVALID_ARG, TAG, "%s: no destination", p_outbox->name);
+    ESP_RETURN_ON_FALSE(len <= p_outbox->cfg.size_max, ESP_ERR_INVALID_SIZE, TAG, "%s: message of %u bytes too large",
+                        p_outbox->name, (unsigned)len);
+    if( key != 0 && key == p_outbox->sent_key ) {
+        ESP_LOGW(TAG, "%s: %08" PRIx32 " already sent, skip", p_outbox->name, key);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; key != 0 && i < p_outbox->num; i++) {
+        if( p_outbox->items[i].key == key ) {
+            ESP_LOGW(TAG, "%s: duplicate %08" PRIx32 ", skip", p_outbox->name, key);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t __store(tf_outbox_t *p_outbox, uint32_t dest, uint32_t key, const void *p_data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+    char path_tmp[OUTBOX_PATH_MAX];
+    char path[OUTBOX_PATH_MAX];
+    struct outbox_hdr hdr;
+    uint32_t seq = p_outbox->seq_next;
+    FILE *fp = NULL;
+
+    hdr.magic = OUTBOX_MAGIC;
+    hdr.key = key;
+    hdr.dest = dest;
+    hdr.len = len;
+    hdr.crc = esp_rom_crc32_le(0, (const uint8_t *)p_data, len);
+
+    __path_get(p_outbox, seq, OUTBOX_SUFFIX_TMP, path_tmp);
+    __path_get(p_outbox, seq, OUTBOX_SUFFIX, path);
+
+    fp = fopen(path_tmp, "wb");
+    ESP_RETURN_ON_FALSE(fp, ESP_FAIL, TAG, "%s: failed to create %s", p_outbox->name, path_tmp);
+    ESP_GOTO_ON_FALSE(fwrite(&hdr, sizeof(hdr), 1, fp) == 1 && (len == 0 || fwrite(p_data, len, 1, fp) == 1) &&
+                      fflush(fp) == 0 && fsync(fileno(fp)) == 0,
+                      ESP_FAIL, err, TAG, "%s: failed to write %s", p_outbox->name, path_tmp);
+    fclose(fp);
+    fp = NULL;
+
+    // full: the oldest gives way, newer alarms matter more
+    if( p_outbox->num == p_outbox->cfg.num ) {
+        ESP_LOGW(TAG, "%s: full, drop %08" PRIx32, p_outbox->name, p_outbox->items[0].seq);
+        __item_remove(p_outbox, 0);
+    }
+
+    ESP_GOTO_ON_FALSE(rename(path_tmp, path) == 0, ESP_FAIL, err, TAG, "%s: failed to rename %s", p_outbox->name, path_tmp);
+
+    p_outbox->items[p_outbox->num].seq = seq;
+    p_outbox->items[p_outbox->num].key = key;
+    p_outbox->items[p_outbox->num].dest = dest;
+    p_outbox->num++;
+    p_outbox->seq_next++;
+    ESP_LOGI(TAG, "%s: put %08" PRIx32 ", %u bytes, %d unsent", p_outbox->name, seq, (unsigned)len, p_outbox->num);
+    return ESP_OK;
+
+err:
+    if( fp ) {
+        fclose(fp);
+    }
+    remove(path_tmp);
+    return ret;
+}
+
+esp_err_t tf_outbox_put(tf_outbox_t *p_outbox, uint32_t key, const void *p_data, size_t len)
+{
+    uint32_t dest = p_outbox->dest;
+    esp_err_t ret = __check(p_outbox, dest, key, len);
+
+    if( ret != ESP_OK ) {
+        return ret;
+    }
+    return __store(p_outbox, dest, key, p_data, len);
+}
+
+esp_err_t tf_outbox_send(tf_outbox_t *p_outbox, uint32_t key, const void *p_data, size_t len)
+{
+    uint32_t dest = p_outbox->dest;
+    esp_err_t ret = __check(p_outbox, dest, key, len);
+    int send_ret = 0;
+    uint32_t wait_ms = 0;
+
+    if( ret != ESP_OK ) {
+        return ret;
+    }
+    // older messages go first, the new one waits behind them
+    if( p_outbox->num > 0 ) {
+        return __store(p_outbox, dest, key, p_data, len);
+    }
+
+    send_ret = p_outbox->cfg.send(p_outbox->cfg.p_ctx, dest, (const uint8_t *)p_data, len);
+    if( send_ret != TF_OUTBOX_SEND_RETRY ) {
+        if( send_ret != TF_OUTBOX_SEND_OK ) {
+            ESP_LOGW(TAG, "%s: rejected, drop", p_outbox->name);
+        }
+        p_outbox->sent_key = key;
+        return ESP_OK;
+    }
+
+    ret = __store(p_outbox, dest, key, p_data, len);
+    if( ret == ESP_OK ) {
+        // the try just made counts, the stored one waits out its backoff
+        p_outbox->attempts = 1;
+        wait_ms = tf_outbox_backoff_ms(p_outbox->cfg.backoff_min_ms, p_outbox->cfg.backoff_max_ms, 1);
+        p_outbox->next_try_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+        ESP_LOGW(TAG, "%s: send failed, kept, retry in %" PRIu32 " ms", p_outbox->name, wait_ms);
+    }
+    return ret;
+}
+
+esp_err_t tf_outbox_poll(tf_outbox_t *p_outbox)
+{
+    esp_err_t ret = ESP_OK;
+    char path[OUTBOX_PATH_MAX];
+    struct outbox_hdr hdr;
+    uint8_t *p_data = NULL;
+    FILE *fp = NULL;
+    int send_ret = 0;
+    uint32_t dest = p_outbox->dest;
+
+    if( p_outbox->num == 0 || dest == 0 || esp_timer_get_time() < p_outbox->next_try_us ) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // put for a server or account the owner no longer uses
+    if( p_outbox->items[0].dest != dest ) {
+        ESP_LOGW(TAG, "%s: %08" PRIx32 " was for destination %08" PRIx32 ", drop", p_outbox->name,
+                 p_outbox->items[0].seq, p_outbox->items[0].dest);
+        __item_remove(p_outbox, 0);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    __path_get(p_outbox, p_outbox->items[0].seq, OUTBOX_SUFFIX, path);
+    fp = fopen(path, "rb");
+    ESP_GOTO_ON_FALSE(fp, ESP_ERR_INVALID_CRC, drop, TAG, "%s: %s is gone", p_outbox->name, path);
+    ESP_GOTO_ON_FALSE(fread(&hdr, sizeof(hdr), 1, fp) == 1 && hdr.magic == OUTBOX_MAGIC && hdr.len <= p_outbox->cfg.size_max,
+                      ESP_ERR_INVALID_CRC, drop, TAG, "%s: bad header in %s", p_outbox->name, path);
+
+    p_data = (uint8_t *)tf_malloc(hdr.len + 1);
+    if( p_data == NULL ) {
+        fclose(fp);
+        ESP_LOGE(TAG, "%s: no mem for %" PRIu32 " bytes", p_outbox->name, hdr.len);
+        return ESP_ERR_NO_MEM;  // keep it, memory may come back
+    }
+    ESP_GOTO_ON_FALSE((hdr.len == 0 || fread(p_data, hdr.len, 1, fp) == 1) &&
+                      esp_rom_crc32_le(0, p_data, hdr.len) == hdr.crc,
+                      ESP_ERR_INVALID_CRC, drop, TAG, "%s: bad crc in %s", p_outbox->name, path);
+    fclose(fp);
+    fp = NULL;
+    p_data[hdr.len] = '\0';  // text messages can be used as strings
+
+    send_ret = p_outbox->cfg.send(p_outbox->cfg.p_ctx, dest, p_data, hdr.len);
+    tf_free(p_data);
+
+    if( send_ret == TF_OUTBOX_SEND_RETRY ) {
+        uint32_t wait_ms = 0;
+        p_outbox->attempts++;
+        wait_ms = tf_outbox_backoff_ms(p_outbox->cfg.backoff_min_ms, p_outbox->cfg.backoff_max_ms, p_outbox->attempts);
+        p_outbox->next_try_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+        ESP_LOGW(TAG, "%s: send failed %d times, retry in %" PRIu32 " ms", p_outbox->name, p_outbox->attempts, wait_ms);
+        return ESP_FAIL;
+    }
+    if( send_ret != TF_OUTBOX_SEND_OK ) {
+        ESP_LOGW(TAG, "%s: %08" PRIx32 " rejected, drop", p_outbox->name, p_outbox->items[0].seq);
+    }
+    p_outbox->sent_key = p_outbox->items[0].key;
+    __item_remove(p_outbox, 0);
+    return ESP_OK;
+
+drop:
+    if( fp ) {
+        fclose(fp);
+    }
+    if( p_data ) {
+        tf_free(p_data);
+    }
+    __item_remove(p_outbox, 0);
+    return ret;
+}
+
+int tf_outbox_num_get(tf_outbox_t *p_outbox)
+{
+    return p_outbox->num;
+}
+
+void tf_outbox_close(tf_outbox_t *p_outbox)
+{
+    if( p_outbox ) {
+        taskENTER_CRITICAL(&__g_outboxes_mux);
+        SLIST_REMOVE(&__g_outboxes, p_outbox, tf_outbox, next);
+        taskEXIT_CRITICAL(&__g_outboxes_mux);
+        tf_free(p_outbox);
+    }
+}
+
+uint32_t tf_outbox_backoff_ms(uint32_t min_ms, uint32_t max_ms, int attempt)
+{
+    uint32_t wait_ms = min_ms;
+
+    for (int i = 1; i < attempt && wait_ms < max_ms; i++) {
+        wait_ms *= 2;
+    }
+    if( wait_ms > max_ms ) {
+        wait_ms = max_ms;
+    }
+    if( wait_ms >= 4 ) {
+        wait_ms -= esp_random() % (wait_ms / 4);
+    }
+    return wait_ms;
+}
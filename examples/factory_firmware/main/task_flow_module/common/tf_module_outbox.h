@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Outbox of a sink module.
+ *
+ * Messages that could not be sent are kept as files on the sd card or on
+ * spiffs, so an alarm survives a flaky uplink and a reboot. A message is
+ * written to a temporary file and renamed, a half written one is never sent.
+ *
+ * An outbox belongs to one task: tf_outbox_send() sends a message from memory
+ * and only writes it to a file when the send fails, tf_outbox_put() stores it
+ * right away. The task calls tf_outbox_poll() in its loop, which sends the
+ * oldest stored message once it is due. After a failed send the next try
+ * waits twice as long as the one before, from backoff_min_ms up to
+ * backoff_max_ms.
+ *
+ * A message is only sent to the destination it was put for. The owner names
+ * its destination with tf_outbox_dest_set(), a hash of whatever decides where
+ * a message goes and as whom. Nothing is sent before that, and a message for
+ * another destination is dropped when it comes up. The name of an outbox can
+ * be open only once, two owners never share the files.
+ */
+
+#define TF_OUTBOX_NUM_MAX          32
+#define TF_OUTBOX_NAME_LEN_MAX     4   // spiffs file names are short
+
+// returned by tf_outbox_send_t
+#define TF_OUTBOX_SEND_OK          0   // sent, the message is removed
+#define TF_OUTBOX_SEND_RETRY       1   // try again after backoff
+#define TF_OUTBOX_SEND_DROP        2   // will never succeed, the message is removed
+
+// dest: the destination the message was put for, the one send must go to
+typedef int (*tf_outbox_send_t)(void *p_ctx, uint32_t dest, const uint8_t *p_data, size_t len);
+
+typedef struct {
+    const char *name;             // file prefix of the messages, unique per outbox
+    const char *dir;              // NULL: the sd card if mounted, else spiffs
+    int num;                      // messages kept at most, the oldest gives way to a new one
+    size_t size_max;              // largest message
+    uint32_t backoff_min_ms;
+    uint32_t backoff_max_ms;
+    tf_outbox_send_t send;
+    void *p_ctx;                  // passed to send
+} tf_outbox_cfg_t;
+
+typedef struct tf_outbox tf_outbox_t;
+
+/**
+ * Open an outbox, messages left by the last run are sent first.
+ *
+ * @return ESP_ERR_INVALID_STATE: an outbox of the same name is open.
+ */
+esp_err_t tf_outbox_open(const tf_outbox_cfg_t *p_cfg, tf_outbox_t **pp_outbox);
+
+/**
+ * Set the destination of the messages put from now on, 0 holds back sending.
+ */
+void tf_outbox_dest_set(tf_outbox_t *p_outbox, uint32_t dest);
+
+/**
+ * Store a message for the current destination. A key other than 0 identifies
+ * it, a message whose key is still in the outbox is not stored twice.
+ *
+ * @return ESP_ERR_INVALID_STATE: duplicate key, ESP_ERR_INVALID_SIZE: larger than size_max,
+ *         ESP_ERR_INVALID_ARG: no destination set, ESP_FAIL: could not write the file.
+ */
+esp_err_t tf_outbox_put(tf_outbox_t *p_outbox, uint32_t key, const void *p_data, size_t len);
+
+/**
+ * Send a message for the current destination now, the flash is only written
+ * when the send fails. With older messages still waiting it is stored behind
+ * them instead, the order is kept. The key is checked as by tf_outbox_put(),
+ * and against the last message sent.
+ *
+ * @return ESP_OK: sent, rejected by send, or stored for a retry; otherwise as tf_outbox_put().
+ */
+esp_err_t tf_outbox_send(tf_outbox_t *p_outbox, uint32_t key, const void *p_data, size_t len);
+
+/**
+ * Send the oldest message if it is due.
+ *
+ * @return ESP_OK: one message sent or rejected by send, ESP_ERR_NOT_FOUND: nothing due,
+ *         ESP_FAIL: send failed, retried later, ESP_ERR_INVALID_CRC: a damaged message was dropped,
+ *         ESP_ERR_INVALID_STATE: a message for another destination was dropped.
+ */
+esp_err_t tf_outbox_poll(tf_outbox_t *p_outbox);
+
+int tf_outbox_num_get(tf_outbox_t *p_outbox);
+
+/**
+ * Free the outbox, unsent messages stay on the file system for the next open.
+ */
+void tf_outbox_close(tf_outbox_t *p_outbox);
+
+/**
+ * Wait before retry number attempt (from 1): min_ms doubled per attempt up to max_ms,
+ * with up to a quarter of random jitter so that devices do not retry in step.
+ */
+uint32_t tf_outbox_backoff_ms(uint32_t min_ms, uint32_t max_ms, int attempt);
+
+#ifdef __cplusplus
+}
+#endif
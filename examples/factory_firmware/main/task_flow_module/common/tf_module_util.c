@@ -1,6 +1,10 @@
 #include "tf_module_util.h"
 #include "tf_module_data_type.h"
 #include "tf_util.h"
+#include "tf_dispatch.h"
+
+// events are copied into fixed size mailbox slots
+_Static_assert(sizeof(tf_data_dualimage_with_audio_text_t) <= TF_DISPATCH_EVENT_SIZE_MAX, "tf data larger than a mailbox slot");
 
 const char * tf_data_type_to_str(uint32_t type)
 {
@@ -74,6 +78,7 @@ void tf_data_image_copy(struct tf_data_image *p_dst, struct tf_data_image *p_src
 {
     p_dst->len  = p_src->len;
     p_dst->time = p_src->time;
+    p_dst->p_ref = NULL;
     if( p_src->p_buf != NULL &&  p_src->len > 0) {
         p_dst->p_buf = tf_malloc(p_src->len + 1);
         memcpy(p_dst->p_buf, p_src->p_buf, p_src->len);
@@ -86,12 +91,62 @@ void tf_data_image_copy(struct tf_data_image *p_dst, struct tf_data_image *p_src
 
 void tf_data_image_free(struct tf_data_image *p_data)
 {
+    struct tf_data_image_ref *p_ref = p_data->p_ref;
+
     p_data->len  = 0;
     p_data->time  = 0;
-    if( p_data->p_buf != NULL) {
+    if( p_ref != NULL ) {
+        if( __atomic_sub_fetch(&p_ref->refcnt, 1, __ATOMIC_ACQ_REL) == 0 ) {
+            if( p_ref->release ) {
+                p_ref->release(p_data->p_buf, p_ref->p_ctx);
+            } else if( p_data->p_buf != NULL ) {
+                tf_free(p_data->p_buf);
+            }
+            tf_free(p_ref);
+        }
+    } else if( p_data->p_buf != NULL) {
         tf_free(p_data->p_buf);
     }
     p_data->p_buf = NULL;
+    p_data->p_ref = NULL;
+}
+
+int tf_data_image_wrap(struct tf_data_image *p_dst, uint8_t *p_buf, uint32_t len, time_t time,
+                       void (*release)(uint8_t *p_buf, void *p_ctx), void *p_ctx)
+{
+    struct tf_data_image_ref *p_ref = tf_malloc(sizeof(struct tf_data_image_ref));
+    if( p_ref == NULL ) {
+        return -1;
+    }
+    p_ref->refcnt  = 1;
+    p_ref->release = release;
+    p_ref->p_ctx   = p_ctx;
+
+    p_dst->p_buf = p_buf;
+    p_dst->len   = len;
+    p_dst->time  = time;
+    p_dst->p_ref = p_ref;
+    return 0;
+}
+
+void tf_data_image_share(struct tf_data_image *p_dst, struct tf_data_image *p_src)
+{
+    if( p_src->p_buf == NULL || p_src->len == 0 ) {
+        p_dst->p_buf = NULL;
+        p_dst->len   = 0;
+        p_dst->time  = p_src->time;
+        p_dst->p_ref = NULL;
+        return;
+    }
+    if( p_src->p_ref == NULL ) {
+        // first share, p_src hands its buffer over to the refcount
+        if( tf_data_image_wrap(p_src, p_src->p_buf, p_src->len, p_src->time, NULL, NULL) != 0 ) {
+            tf_data_image_copy(p_dst, p_src);
+            return;
+        }
+    }
+    __atomic_add_fetch(&p_src->p_ref->refcnt, 1, __ATOMIC_RELAXED);
+    *p_dst = *p_src;
 }
 
 void tf_data_inference_copy(struct tf_data_inference_info *p_dst, struct tf_data_inference_info *p_src)
@@ -99,6 +154,8 @@ void tf_data_inference_copy(struct tf_data_inference_info *p_dst, struct tf_data
     p_dst->is_valid = p_src->is_valid;
     p_dst->type     = p_src->type;
     p_dst->cnt      = p_src->cnt;
+    p_dst->zone_num = p_src->zone_num;
+    memcpy(p_dst->zone_cnt, p_src->zone_cnt, sizeof(p_dst->zone_cnt));
     if( p_src->p_data != NULL && p_src->cnt > 0) {
         int size = 0;
         switch (p_src->type)
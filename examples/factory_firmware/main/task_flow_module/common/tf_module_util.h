@@ -19,6 +19,21 @@ void tf_data_buf_free(struct tf_data_buf *p_data);
 void tf_data_image_copy(struct tf_data_image *p_dst, struct tf_data_image *p_src);
 void tf_data_image_free(struct tf_data_image *p_data);
 
+/**
+ * Make p_dst another owner of p_src's buffer instead of copying it, images are read only
+ * once they are shared. p_src becomes a shared image on first use. Every owner frees its
+ * image with tf_data_image_free(), the last one frees the buffer.
+ * Falls back to tf_data_image_copy() if no memory for the refcount.
+ */
+void tf_data_image_share(struct tf_data_image *p_dst, struct tf_data_image *p_src);
+
+/**
+ * Wrap a buffer into a shared image with one owner. release is called with p_buf and p_ctx
+ * when the last owner is gone, NULL means tf_free(p_buf).
+ */
+int tf_data_image_wrap(struct tf_data_image *p_dst, uint8_t *p_buf, uint32_t len, time_t time,
+                       void (*release)(uint8_t *p_buf, void *p_ctx), void *p_ctx);
+
 void tf_data_inference_copy(struct tf_data_inference_info *p_dst, struct tf_data_inference_info *p_src);
 void tf_data_inference_free(struct tf_data_inference_info *p_inference);
 
@@ -211,6 +211,42 @@ static int __class_num_get(struct tf_data_inference_info *p_inference, const cha
     }
     return cnt;
 }
+// drop boxes with their centre outside every zone, count the rest per zone
+static void __zones_filter(struct tf_module_ai_camera_params *p_params, struct tf_data_inference_info *p_inference)
+{
+    sscma_client_box_t *p_box = (sscma_client_box_t *)p_inference->p_data;
+    int keep = 0;
+
+    p_inference->zone_num = p_params->zone_num;
+    memset(p_inference->zone_cnt, 0, sizeof(p_inference->zone_cnt));
+
+    if( p_params->zone_num == 0 || p_inference->type != INFERENCE_TYPE_BOX || p_box == NULL ) {
+        return;
+    }
+
+    for (int i = 0; i < p_inference->cnt; i++)
+    {
+        bool inside = false;
+        for (int j = 0; j < p_params->zone_num; j++)
+        {
+            if( tf_expr_zone_contains(&p_params->zones[j].zone, p_box[i].x, p_box[i].y) ) {
+                inside = true;
+                if( p_inference->zone_cnt[j] < UINT8_MAX ) {
+                    p_inference->zone_cnt[j]++;
+                }
+            }
+        }
+        if( inside ) {
+            p_box[keep++] = p_box[i];
+        }
+    }
+
+    if( keep != p_inference->cnt ) {
+        ESP_LOGD(TAG, "Zones keep %d of %d boxes", keep, (int)p_inference->cnt);
+    }
+    p_inference->cnt = keep;
+}
+
 static bool __condition_check(tf_module_ai_camera_t                     *p_module_ins,  
                               struct tf_data_inference_info *p_inference)
 {
@@ -220,6 +256,10 @@ static bool __condition_check(tf_module_ai_camera_t                     *p_modul
         return true;
     }
 
+    if( p_params->p_expr ) {
+        return tf_expr_eval(p_params->p_expr, p_inference, esp_timer_get_time());
+    }
+
     // none conditions
     if( p_params->conditions== NULL || p_params->condition_num == 0) {
         return true;
@@ -539,6 +579,9 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
     int resolution = __get_camera_sensor_resolution(reply->payload);
     int mode = __get_camera_mode_get(reply->payload);
 
+    // frames are copied on the sscma client task
+    tf_owner_set(p_module_ins->input_evt_id);
+
     switch (resolution)
     {
         case TF_MODULE_AI_CAMERA_SENSOR_RESOLUTION_416_416: {
@@ -560,10 +603,13 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
 
             info.img.p_buf = NULL;
             info.img.len = 0;
+            info.img.p_ref = NULL;
+            info.ts_us = reply->ts_us ? reply->ts_us : esp_timer_get_time();
 
             info.inference.cnt = 0;
             info.inference.is_valid = false;
             info.inference.p_data = NULL;
+            info.inference.zone_num = 0;
 
             __data_lock(p_module_ins);
             __classes_name_copy(info.inference.classes, p_module_ins->classes);
@@ -620,6 +666,21 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
                 } else if (algorithm_type == TF_MODULE_AI_CAMERA_ALGORITHM_TYPE_YOLO_POSE) {
                     ESP_LOGD(TAG, "yolo_pose algorithm is not supported yet!");
                 }
+
+                // before anything else looks at the boxes
+                __data_lock(p_module_ins);
+                __zones_filter(&p_module_ins->params, &info.inference);
+                __data_unlock(p_module_ins);
+            }
+
+            // to the listener of the preview, on its own task; it frees its share of the image and its inference
+            struct tf_module_ai_camera_preview_info preview = { .ts_us = info.ts_us };
+            tf_data_image_share(&preview.img, &info.img);
+            tf_data_inference_copy(&preview.inference, &info.inference);
+            if( esp_event_post_to(app_event_loop_handle, VIEW_EVENT_BASE, VIEW_EVENT_AI_CAMERA_PREVIEW,
+                                  &preview, sizeof(preview), 0) != ESP_OK ) {
+                tf_data_image_free(&preview.img);
+                tf_data_inference_free(&preview.inference);
             }
             
             // Reduce event bus usage
@@ -648,7 +709,7 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
                     tf_data_image_free(&p_module_ins->preview_info_cache.img);
                     tf_data_inference_free(&p_module_ins->preview_info_cache.inference);
 
-                    tf_data_image_copy(&p_module_ins->preview_info_cache.img, &info.img);
+                    tf_data_image_share(&p_module_ins->preview_info_cache.img, &info.img);
                     tf_data_inference_copy(&p_module_ins->preview_info_cache.inference, &info.inference);
 
                 } else {
@@ -657,9 +718,10 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
                     p_module_ins->output_data.img_large.p_buf = NULL;
                     p_module_ins->output_data.img_large.len = 0;
                     p_module_ins->output_data.img_large.time = 0;
+                    p_module_ins->output_data.img_large.p_ref = NULL;
                     for (int i = 0; i < p_module_ins->output_evt_num; i++)
                     {
-                        tf_data_image_copy(&p_module_ins->output_data.img_small, &info.img);
+                        tf_data_image_share(&p_module_ins->output_data.img_small, &info.img);
                         tf_data_inference_copy(&p_module_ins->output_data.inference, &info.inference);
 
                         ret = tf_event_post(p_module_ins->p_output_evt_id[i], &p_module_ins->output_data, sizeof(p_module_ins->output_data), pdMS_TO_TICKS(1));
@@ -686,7 +748,7 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
         case TF_MODULE_AI_CAMERA_SENSOR_RESOLUTION_640_480:{
             char *img = NULL;
             int img_size = 0;
-            struct tf_data_image img_large;
+            struct tf_data_image img_large = { 0 };
             // printf("sscma:%s\r\n",reply->data);
 
             if (esp_timer_is_active( p_module_ins->timer_handle ) == true)
@@ -733,8 +795,8 @@ static void sscma_on_event(sscma_client_handle_t client, const sscma_client_repl
             p_module_ins->output_data.type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE;
             for (int i = 0; i < p_module_ins->output_evt_num; i++)
             {
-                tf_data_image_copy(&p_module_ins->output_data.img_large, &img_large);
-                tf_data_image_copy(&p_module_ins->output_data.img_small, &p_module_ins->preview_info_cache.img);
+                tf_data_image_share(&p_module_ins->output_data.img_large, &img_large);
+                tf_data_image_share(&p_module_ins->output_data.img_small, &p_module_ins->preview_info_cache.img);
                 tf_data_inference_copy(&p_module_ins->output_data.inference, &p_module_ins->preview_info_cache.inference);
                 ret = tf_event_post(p_module_ins->p_output_evt_id[i], &p_module_ins->output_data, sizeof(p_module_ins->output_data), pdMS_TO_TICKS(1));
                 if( ret != ESP_OK) {
@@ -783,10 +845,18 @@ static void __parmas_printf(struct tf_module_ai_camera_params *p_params)
     ESP_LOGD(TAG, "iou: %d", p_params->model.iou);
     ESP_LOGD(TAG, "confidence: %d", p_params->model.confidence);
     
+    for (int i = 0; i < p_params->zone_num; i++) {
+        ESP_LOGD(TAG, "Zone %d %s: [%d,%d~%d,%d]", i, p_params->zones[i].name,
+                 (int)p_params->zones[i].zone.min_x, (int)p_params->zones[i].zone.min_y,
+                 (int)p_params->zones[i].zone.max_x, (int)p_params->zones[i].zone.max_y);
+    }
+    if( p_params->p_expr ) {
+        ESP_LOGD(TAG, "Expr: %d terms, %d insns", p_params->p_expr->term_num, p_params->p_expr->code_num);
+    }
     ESP_LOGD(TAG, "Conditions combo: %d", p_params->conditions_combo);
     for (size_t i = 0; i < p_params->condition_num; i++)
     {
-        ESP_LOGD(TAG, "  condition %d", i);
+        ESP_LOGD(TAG, "  condition %d", (int)i);
         if( p_params->conditions[i].mode == TF_MODULE_AI_CAMERA_CONDITION_MODE_PRESENCE_DETECTION) {
             ESP_LOGD(TAG, "    %s: 0~N, N~0", p_params->conditions[i].class_name);
         } else if( p_params->conditions[i].mode == TF_MODULE_AI_CAMERA_CONDITION_MODE_NUM_CHANGE ) {
@@ -841,6 +911,8 @@ static void __parmas_default(struct tf_module_ai_camera_params *p_params)
     p_params->condition_num = 0;
     p_params->conditions = NULL;
     p_params->conditions_combo = TF_MODULE_AI_CAMERA_CONDITIONS_COMBO_AND;
+    p_params->p_expr = NULL;
+    p_params->zone_num = 0;
     p_params->silent_period.time_is_valid = false;
     p_params->silent_period.silence_duration =  CONFIG_TF_MODULE_AI_CAMERA_SILENCE_DURATION_DEFAULT;
     p_params->output_type = TF_MODULE_AI_CAMERA_OUTPUT_TYPE_SMALL_IMG_AND_LARGE_IMG;
@@ -971,6 +1043,41 @@ static int __params_parse(struct tf_module_ai_camera_params *p_params, cJSON *p_
         p_params->conditions_combo = conditions_combo_json->valueint;
     } 
 
+    cJSON *zones_json = cJSON_GetObjectItem(p_json, "zones");
+    if (zones_json != NULL && cJSON_IsArray(zones_json))
+    {
+        for (int i = 0; i < cJSON_GetArraySize(zones_json); i++)
+        {
+            cJSON *zone_json = cJSON_GetArrayItem(zones_json, i);
+            cJSON *name_json = cJSON_GetObjectItem(zone_json, "name");
+            struct tf_expr_zone_def *p_zone_def = &p_params->zones[p_params->zone_num];
+
+            if( p_params->zone_num >= CONFIG_MODEL_ZONES_MAX_NUM ) {
+                ESP_LOGE(TAG, "Zones more than %d, ignore the rest", CONFIG_MODEL_ZONES_MAX_NUM);
+                break;
+            }
+            if( tf_expr_zone_parse(cJSON_GetObjectItem(zone_json, "zone"), &p_zone_def->zone) != ESP_OK ) {
+                ESP_LOGE(TAG, "Invalid zone %d, ignore it", i);
+                continue;
+            }
+            p_zone_def->name[0] = '\0';
+            if (name_json && cJSON_IsString(name_json)) {
+                strncpy(p_zone_def->name, name_json->valuestring, sizeof(p_zone_def->name) - 1);
+                p_zone_def->name[sizeof(p_zone_def->name) - 1] = '\0';
+            }
+            p_params->zone_num++;
+        }
+    }
+
+    cJSON *expr_json = cJSON_GetObjectItem(p_json, "expr");
+    if (expr_json != NULL)
+    {
+        if( tf_expr_compile(expr_json, CONFIG_TF_MODULE_AI_CAMERA_CLASS_OBJECT_SCORE_THRESHOLD,
+                            p_params->zones, p_params->zone_num, &p_params->p_expr) != ESP_OK ) {
+            ESP_LOGE(TAG, "Invalid expr, use conditions");
+        }
+    }
+
     cJSON *silent_period_json = cJSON_GetObjectItem(p_json, "silent_period");
     if (silent_period_json != NULL)
     {
@@ -1147,6 +1254,7 @@ static void ai_camera_task(void *p_arg)
             bool is_need_update = false;
 
             ESP_LOGI(TAG, "EVENT_START");
+            tf_owner_set(p_module_ins->input_evt_id);
             run_flag = false;
             p_module_ins->sscma_starting_flag = true;
             
@@ -1163,6 +1271,10 @@ static void ai_camera_task(void *p_arg)
             memset(p_module_ins->classes_num, 0, sizeof(p_module_ins->classes_num));
             p_module_ins->target_id_cache = 0;
             memset(p_module_ins->classes, NULL, sizeof(p_module_ins->classes));
+            if( p_params->p_expr ) {
+                tf_expr_bind(p_params->p_expr, p_module_ins->classes);
+                tf_expr_reset(p_params->p_expr);
+            }
             __data_unlock(p_module_ins);
 
             if( p_params->mode == TF_MODULE_AI_CAMERA_MODES_INFERENCE ) {
@@ -1304,6 +1416,9 @@ static void ai_camera_task(void *p_arg)
                         //update classes
                         __data_lock(p_module_ins);
                         memcpy(p_module_ins->classes, model_info->classes, i * sizeof(char*));
+                        if( p_params->p_expr ) {
+                            tf_expr_bind(p_params->p_expr, p_module_ins->classes);
+                        }
                         __data_unlock(p_module_ins);
                     } else {
                         ESP_LOGI(TAG, "  N/A");
@@ -1445,6 +1560,9 @@ static int __stop(void *p_module)
     if( p_module_ins->params.conditions ) {
         tf_free(p_module_ins->params.conditions);
     }
+    if( p_module_ins->params.p_expr ) {
+        tf_expr_free(p_module_ins->params.p_expr);
+    }
     if( p_module_ins->params.model.p_info_all ) {
         free(p_module_ins->params.model.p_info_all);
     }
@@ -1453,6 +1571,7 @@ static int __stop(void *p_module)
     p_module_ins->output_evt_num = 0;
     p_module_ins->params.conditions  = NULL;
     p_module_ins->params.condition_num = 0;
+    p_module_ins->params.p_expr = NULL;
     __data_unlock(p_module_ins);
 
     esp_err_t ret = tf_event_handler_unregister(p_module_ins->input_evt_id, __event_handler);
@@ -1470,6 +1589,87 @@ static int __cfg(void *p_module, cJSON *p_json)
     __data_unlock(p_module_ins);
     return 0;
 }
+// what EVENT_START loads onto himax, a change here needs a restart
+static bool __params_model_same(struct tf_module_ai_camera_params *p_a, struct tf_module_ai_camera_params *p_b)
+{
+    if( p_a->mode != p_b->mode || p_a->model.model_type != p_b->model.model_type ) {
+        return false;
+    }
+    if( p_a->mode != TF_MODULE_AI_CAMERA_MODES_INFERENCE || p_a->model.model_type != TF_MODULE_AI_CAMERA_MODEL_TYPE_CLOUD ) {
+        return true;
+    }
+    return strcmp(p_a->model.model_id, p_b->model.model_id) == 0 &&
+           strcmp(p_a->model.version, p_b->model.version) == 0 &&
+           strcmp(p_a->model.checksum, p_b->model.checksum) == 0 &&
+           strcmp(p_a->model.url, p_b->model.url) == 0 &&
+           p_a->model.size == p_b->model.size;
+}
+
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    tf_module_ai_camera_t *p_module_ins = (tf_module_ai_camera_t *)p_module;
+    struct tf_module_ai_camera_params *p_params = NULL;
+    bool threshold_changed = false;
+
+    p_params = (struct tf_module_ai_camera_params *)tf_malloc(sizeof(struct tf_module_ai_camera_params));
+    if( p_params == NULL ) {
+        return ESP_ERR_NO_MEM;
+    }
+    __parmas_default(p_params);
+    __params_parse(p_params, p_json);
+
+    __data_lock(p_module_ins);
+    if( !p_module_ins->start_flag || p_module_ins->sscma_starting_flag ||
+        !__params_model_same(&p_module_ins->params, p_params) ) {
+        __data_unlock(p_module_ins);
+        if( p_params->conditions ) {
+            tf_free(p_params->conditions);
+        }
+        if( p_params->p_expr ) {
+            tf_expr_free(p_params->p_expr);
+        }
+        if( p_params->model.p_info_all ) {
+            free(p_params->model.p_info_all);
+        }
+        tf_free(p_params);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    threshold_changed = p_module_ins->params.model.iou != p_params->model.iou ||
+                        p_module_ins->params.model.confidence != p_params->model.confidence;
+
+    if( p_module_ins->params.conditions ) {
+        tf_free(p_module_ins->params.conditions);
+    }
+    if( p_module_ins->params.p_expr ) {
+        tf_expr_free(p_module_ins->params.p_expr);
+    }
+    if( p_module_ins->params.model.p_info_all ) {
+        free(p_module_ins->params.model.p_info_all);
+    }
+    p_params->algorithm = p_module_ins->params.algorithm;  // reported by himax on invoke
+    p_module_ins->params = *p_params;
+    if( p_params->p_expr ) {
+        tf_expr_bind(p_params->p_expr, p_module_ins->classes);
+    }
+
+    // conditions may differ now, start counting afresh
+    p_module_ins->condition_trigger_buf_idx = 0;
+    memset(p_module_ins->condition_trigger_buf, false, sizeof(p_module_ins->condition_trigger_buf));
+    if( p_params->shutter == TF_MODULE_AI_CAMERA_SHUTTER_TRIGGER_ONCE ) {
+        p_module_ins->shutter_trigger_flag = 0x01 << TF_MODULE_AI_CAMERA_SHUTTER_TRIGGER_ONCE;
+    }
+    __parmas_printf(&p_module_ins->params);
+    __data_unlock(p_module_ins);
+    tf_free(p_params);
+
+    if( threshold_changed ) {
+        // invoke again with the new thresholds, the model stays loaded
+        xEventGroupSetBits(p_module_ins->event_group, EVENT_PRVIEW_416_416);
+    }
+    ESP_LOGI(TAG, "cfg updated without restart");
+    return ESP_OK;
+}
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_ai_camera_t *p_module_ins = (tf_module_ai_camera_t *)p_module;
@@ -1483,6 +1683,15 @@ static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int n
 {
     tf_module_ai_camera_t *p_module_ins = (tf_module_ai_camera_t *)p_module;
     __data_lock(p_module_ins);
+    if (output_index == 0)
+    {
+        // may be set again while started, see __cfg_update
+        if( p_module_ins->p_output_evt_id ) {
+            tf_free(p_module_ins->p_output_evt_id);
+            p_module_ins->p_output_evt_id = NULL;
+        }
+        p_module_ins->output_evt_num = 0;
+    }
     if (output_index == 0 && num > 0)
     {
         p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
@@ -1531,7 +1740,8 @@ const static struct tf_module_ops __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 const static struct tf_module_mgmt __g_module_mgmt = {  
@@ -1597,6 +1807,7 @@ tf_module_t *tf_module_ai_camera_init(tf_module_ai_camera_t *p_module_ins)
     p_module_ins->sscma_client_handle = bsp_sscma_client_init();
     ESP_GOTO_ON_FALSE(p_module_ins->sscma_client_handle, ESP_FAIL, err, TAG, "Failed to bsp sscma");
 
+    // registered once: the model scheduler hands the callbacks back when it stops
     const sscma_client_callback_t callback = {
         .on_event = sscma_on_event,
         .on_connect = sscma_on_connect,
@@ -1619,7 +1830,7 @@ tf_module_t *tf_module_ai_camera_init(tf_module_ai_camera_t *p_module_ins)
         if ( ret == ESP_OK) {
             break;
         }
-        ESP_LOGE(TAG, "Failed to get info, retry %d", i);
+        ESP_LOGE(TAG, "Failed to get info, retry %d", (int)i);
         vTaskDelay(20 / portTICK_PERIOD_MS);
     }
     if ( ret != ESP_OK) {
@@ -1679,6 +1890,12 @@ err:
     return NULL;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK_ANY,  // any input triggers the shutter
+    .output_port_num = 1,
+    .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE) },
+};
+
 esp_err_t tf_module_ai_camera_register(void)
 {
     g_handle = __module_instance(); // Must be instantiated
@@ -1686,10 +1903,14 @@ esp_err_t tf_module_ai_camera_register(void)
     {
         return ESP_FAIL;
     }
-    return tf_module_register(TF_MODULE_AI_CAMERA_NAME,
-                              TF_MODULE_AI_CAMERA_DESC,
-                              TF_MODULE_AI_CAMERA_VERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_AI_CAMERA_NAME,
+                                       TF_MODULE_AI_CAMERA_DESC,
+                                       TF_MODULE_AI_CAMERA_VERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_AI_CAMERA_NAME, &__g_module_io);
 }
 
 char *tf_module_ai_camera_himax_version_get(void)
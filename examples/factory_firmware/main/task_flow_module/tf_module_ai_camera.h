@@ -1,6 +1,7 @@
 #pragma once
 #include "tf_module.h"
 #include "tf_module_data_type.h"
+#include "tf_module_expr.h"
 #include "esp_err.h"
 #include "sensecap-watcher.h"
 #include "sscma_client_types.h"
@@ -135,6 +136,9 @@ struct tf_module_ai_camera_params
     struct tf_module_ai_camera_condition *conditions;
     int condition_num;
     int conditions_combo;
+    tf_expr_t *p_expr;  // replaces conditions when set
+    struct tf_expr_zone_def zones[CONFIG_MODEL_ZONES_MAX_NUM];  // boxes outside every zone are dropped
+    int zone_num;
     struct tf_module_ai_camera_silent_period silent_period;
     int shutter;
     int output_type;
@@ -172,6 +176,7 @@ struct tf_module_ai_camera_preview_info
 {
     struct tf_data_image                      img;
     struct tf_data_inference_info inference;
+    int64_t                                   ts_us; // esp_timer time the frame arrived from the WE2
 };
 
 typedef struct tf_module_ai_camera
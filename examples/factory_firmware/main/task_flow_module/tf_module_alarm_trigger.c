@@ -46,7 +46,7 @@ static int __params_parse(struct tf_module_alarm_trigger_params *p_params, cJSON
                 }
             }
         } else {
-            ESP_LOGE(TAG, "Base64 decode failed, ret: %d, len:%d", decode_ret, output_len);
+            ESP_LOGE(TAG, "Base64 decode failed, ret: %d, len:%zu", decode_ret, output_len);
         } 
     }
 
@@ -81,8 +81,8 @@ static void __event_handler(void *handler_args, esp_event_base_t base, int32_t i
     output_data.type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT;
     __data_lock(p_module_ins);
     for (int i = 0; i < p_module_ins->output_evt_num; i++) {
-        tf_data_image_copy(&output_data.img_small, &p_data->img_small);
-        tf_data_image_copy(&output_data.img_large, &p_data->img_large);
+        tf_data_image_share(&output_data.img_small, &p_data->img_small);
+        tf_data_image_share(&output_data.img_large, &p_data->img_large);
         tf_data_inference_copy(&output_data.inference, &p_data->inference);
         tf_data_buf_copy(&output_data.audio, &p_params->audio);
         tf_data_buf_copy(&output_data.text, &p_params->text);
@@ -132,6 +132,22 @@ static int __cfg(void *p_module, cJSON *p_json)
     __data_unlock(p_module_ins);
     return 0;
 }
+// the handler copies audio and text under the lock, so they are swapped under it
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    tf_module_alarm_trigger_t *p_module_ins = (tf_module_alarm_trigger_t *)p_module;
+    struct tf_module_alarm_trigger_params params;
+
+    __parmas_default(&params);
+    __params_parse(&params, p_json);
+
+    __data_lock(p_module_ins);
+    tf_data_buf_free(&p_module_ins->params.audio);
+    tf_data_buf_free(&p_module_ins->params.text);
+    p_module_ins->params = params;
+    __data_unlock(p_module_ins);
+    return 0;
+}
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_alarm_trigger_t *p_module_ins = (tf_module_alarm_trigger_t *)p_module;
@@ -145,6 +161,15 @@ static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int n
 {
     tf_module_alarm_trigger_t *p_module_ins = (tf_module_alarm_trigger_t *)p_module;
     __data_lock(p_module_ins);
+    if (output_index == 0)
+    {
+        // may be set again while started, when the flow is rewired
+        if( p_module_ins->p_output_evt_id ) {
+            tf_free(p_module_ins->p_output_evt_id);
+            p_module_ins->p_output_evt_id = NULL;
+        }
+        p_module_ins->output_evt_num = 0;
+    }
     if (output_index == 0 && num > 0)
     {
         p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
@@ -193,7 +218,8 @@ const static struct tf_module_ops  __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 const static struct tf_module_mgmt __g_module_mgmt = {
@@ -236,10 +262,20 @@ err:
     return NULL;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE),
+    .output_port_num = 1,
+    .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) },
+};
+
 esp_err_t tf_module_alarm_trigger_register(void)
 {
-    return tf_module_register(TF_MODULE_ALARM_TRIGGER_NAME,
-                              TF_MODULE_ALARM_TRIGGER_DESC,
-                              TF_MODULE_ALARM_TRIGGER_RVERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_ALARM_TRIGGER_NAME,
+                                       TF_MODULE_ALARM_TRIGGER_DESC,
+                                       TF_MODULE_ALARM_TRIGGER_RVERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_ALARM_TRIGGER_NAME, &__g_module_io);
 }
\ No newline at end of file
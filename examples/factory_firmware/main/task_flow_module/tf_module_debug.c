@@ -119,10 +119,19 @@ tf_module_t * tf_module_debug_init(tf_module_debug_t *p_module_ins)
     return &p_module_ins->module_base;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK_ANY,
+    .output_port_num = 0,
+};
+
 esp_err_t tf_module_debug_register(void)
 {
-    return tf_module_register(TF_MODULE_DEBUG_NAME,
-                              TF_MODULE_DEBUG_DESC,
-                              TF_MODULE_DEBUG_VERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_DEBUG_NAME,
+                                       TF_MODULE_DEBUG_DESC,
+                                       TF_MODULE_DEBUG_VERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_DEBUG_NAME, &__g_module_io);
 }
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include "app_sensor.h"
 #include "factory_info.h"
 #include <mbedtls/base64.h>
+#include "esp_rom_crc.h"
 
 static const char *TAG = "tfm.http_alarm";
 
@@ -158,16 +159,14 @@ err:
     return result != NULL ? result : NULL;
 }
 
-static int __http_report_warn_event(tf_module_http_alarm_t *p_module_ins,
-                                    tf_data_dualimage_with_audio_text_t *p_data)
+static char *__alarm_json_build(tf_module_http_alarm_t *p_module_ins,
+                                tf_data_dualimage_with_audio_text_t *p_data)
 {
-    int ret = 0;
     struct tf_module_http_alarm_params *p_params = &p_module_ins->params;
 
     char *p_str = NULL;
     cJSON *json = NULL;
     char *json_str = NULL;
-    char *p_resp = NULL;
 
     struct app_sensecraft *p_sensecraft = gp_sensecraft;
 
@@ -265,6 +264,14 @@ static int __http_report_warn_event(tf_module_http_alarm_t *p_module_ins,
         {
             cJSON_AddItemToArray(classes, cJSON_CreateString(p_data->inference.classes[i]));
         }
+        if (p_data->inference.zone_num > 0) {
+            cJSON *zones = cJSON_CreateArray();
+            cJSON_AddItemToObject(inference, "zones_cnt", zones);
+            for (size_t i = 0; i < p_data->inference.zone_num; i++)
+            {
+                cJSON_AddItemToArray(zones, cJSON_CreateNumber(p_data->inference.zone_cnt[i]));
+            }
+        }
     }
 
     if (p_params->sensor_en) {
@@ -309,43 +316,79 @@ static int __http_report_warn_event(tf_module_http_alarm_t *p_module_ins,
 
     __data_unlock(p_module_ins);
 
-    free(tf_info.p_tf_name);
+    tf_free((void *)tf_info.p_tf_name);
 
     json_str = cJSON_PrintUnformatted(json);
     cJSON_Delete(json);
+    return json_str;
+}
+
+// caller holds the data lock
+static uint32_t __dest_hash(tf_module_http_alarm_t *p_module_ins)
+{
+    uint32_t crc = 0;
+
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)p_module_ins->url, strlen(p_module_ins->url) + 1);
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)p_module_ins->token, strlen(p_module_ins->token) + 1);
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)p_module_ins->head, strlen(p_module_ins->head) + 1);
+    return crc != 0 ? crc : 1;  // 0 is no destination
+}
 
-    ESP_LOGI(TAG, "Post %s", p_module_ins->url);
+// tf_outbox_send_t, the body keeps its requestId across retries so the server can tell repeats
+static int __alarm_send(void *p_ctx, uint32_t dest, const uint8_t *p_data, size_t len)
+{
+    tf_module_http_alarm_t *p_module_ins = (tf_module_http_alarm_t *)p_ctx;
+    int ret = TF_OUTBOX_SEND_DROP;
+    cJSON *json = NULL;
+    char *p_resp = NULL;
+    char url[sizeof(p_module_ins->url)];
+    char token[sizeof(p_module_ins->token)];
+    char head[sizeof(p_module_ins->head)];
 
-    p_resp = __request(p_module_ins->url, 
+    // a new config may have moved the module to another server while the alarm waited
+    __data_lock(p_module_ins);
+    if (dest != p_module_ins->dest) {
+        __data_unlock(p_module_ins);
+        ESP_LOGW(TAG, "Alarm for another destination, drop");
+        return TF_OUTBOX_SEND_DROP;
+    }
+    memcpy(url, p_module_ins->url, sizeof(url));
+    memcpy(token, p_module_ins->token, sizeof(token));
+    memcpy(head, p_module_ins->head, sizeof(head));
+    __data_unlock(p_module_ins);
+
+    ESP_LOGI(TAG, "Post %s", url);
+
+    p_resp = __request(url, 
                     HTTP_METHOD_POST, 
-                    p_module_ins->token,
+                    token,
                     "application/json",
-                    p_module_ins->head, 
-                    (uint8_t *)json_str, strlen(json_str));
-    free(json_str);
+                    head, 
+                    (uint8_t *)p_data, len);
 
     if (p_resp == NULL) {
         ESP_LOGE(TAG, "request failed");
-        return -1;
+        return TF_OUTBOX_SEND_RETRY;
     }
 
     ESP_LOGI(TAG, "Response: %s", p_resp);
 
     json = cJSON_Parse(p_resp);
     if (json == NULL) {
-        ESP_LOGE(TAG, "Json parse failed");
+        ESP_LOGE(TAG, "Json parse failed");  // likely a gateway error page
         tf_free(p_resp);
-        return -1;
+        return TF_OUTBOX_SEND_RETRY;
     }
 
-    ret = -1;
     cJSON *code = cJSON_GetObjectItem(json, "code");
     if (code != NULL && cJSON_IsNumber(code) && code->valueint == 200) {
-        // TODO
-        ret = 0; //success
+        ret = TF_OUTBOX_SEND_OK;
     } else {
         if( code != NULL ) {
             ESP_LOGE(TAG, "code: %d", code->valueint);
+            if (cJSON_IsNumber(code) && (code->valueint >= 500 || code->valueint == 429)) {
+                ret = TF_OUTBOX_SEND_RETRY;
+            }
         }
     }
 
@@ -354,6 +397,40 @@ static int __http_report_warn_event(tf_module_http_alarm_t *p_module_ins,
     return ret;
 }
 
+static void __alarm_put(tf_module_http_alarm_t *p_module_ins,
+                        tf_data_dualimage_with_audio_text_t *p_data)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t key = 0;
+    char *json_str = __alarm_json_build(p_module_ins, p_data);
+
+    if (json_str == NULL) {
+        ESP_LOGE(TAG, "Failed to build http alarm");
+        return;
+    }
+
+    if (p_module_ins->p_outbox) {
+        // the same picture is one alarm, however often it arrives
+        if (p_data->img_small.p_buf != NULL && p_data->img_small.len > 0) {
+            key = esp_rom_crc32_le(0, p_data->img_small.p_buf, p_data->img_small.len);
+        }
+        // sent from memory, the flash is only written when the uplink fails
+        ret = tf_outbox_send(p_module_ins->p_outbox, key, json_str, strlen(json_str));
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+            ESP_LOGE(TAG, "Faild to report http alarm: %s", esp_err_to_name(ret));
+        }
+        free(json_str);
+        return;
+    }
+
+    if (__alarm_send(p_module_ins, p_module_ins->dest, (uint8_t *)json_str, strlen(json_str)) == TF_OUTBOX_SEND_OK) {
+        ESP_LOGI(TAG, "Success to report http alarm");
+    } else {
+        ESP_LOGE(TAG, "Faild to report http alarm");
+    }
+    free(json_str);
+}
+
 static void __event_handler(void *handler_args, esp_event_base_t base, int32_t id, void *p_event_data)
 {
     esp_err_t ret = ESP_OK;
@@ -390,7 +467,7 @@ static void __event_handler(void *handler_args, esp_event_base_t base, int32_t i
 
 static void http_alarm_task(void *p_arg)
 {
-    int ret = 0;
+    esp_err_t ret = ESP_OK;
     tf_module_http_alarm_t *p_module_ins = (tf_module_http_alarm_t *)p_arg;
     struct tf_module_http_alarm_params *p_params = &p_module_ins->params;
     tf_data_dualimage_with_audio_text_t data;
@@ -405,6 +482,7 @@ static void http_alarm_task(void *p_arg)
             while (xQueueReceive(p_module_ins->queue_handle, &data,0) == pdPASS ) {
                 tf_data_free((void *)&data); //clear queue
             }
+            tf_owner_set(TF_OWNER_NONE);
             xEventGroupSetBits(p_module_ins->event_group, EVENT_TASK_DELETED);
             vTaskDelete(NULL);
         }
@@ -419,16 +497,18 @@ static void http_alarm_task(void *p_arg)
 
         if (xQueueReceive(p_module_ins->queue_handle, &data, (TickType_t)10) == pdPASS) {
             ESP_LOGI(TAG, "Start send http alarm");
+            tf_owner_set(p_module_ins->input_evt_id);
+            __alarm_put(p_module_ins, &data);
+            tf_data_free((void *)&data);
+        }
 
-            ret = __http_report_warn_event(p_module_ins, &data);
-            if (ret == 0) {
-                ESP_LOGI(TAG, "Success to report http alarm");
-            }
-            else {
-                ESP_LOGE(TAG, "Faild to report http alarm");
+        // retries, and the files left by the last boot or by a flow destroyed before they went out:
+        // the outbox is closed with the module, what it holds is sent once a flow opens it again
+        if (p_module_ins->p_outbox) {
+            ret = tf_outbox_poll(p_module_ins->p_outbox);
+            if (ret == ESP_OK) {
+                ESP_LOGI(TAG, "Http alarm sent, %d unsent", tf_outbox_num_get(p_module_ins->p_outbox));
             }
-
-            tf_data_free((void *)&data);
         }
     }
 }
@@ -458,6 +538,10 @@ static void http_alarm_task_destroy(tf_module_http_alarm_t *p_module_ins)
         vQueueDelete(p_module_ins->queue_handle);
         p_module_ins->queue_handle = NULL;
     }
+    if ( p_module_ins->p_outbox ) {
+        tf_outbox_close(p_module_ins->p_outbox);
+        p_module_ins->p_outbox = NULL;
+    }
 }
 
 /*************************************************************************
@@ -502,12 +586,16 @@ static int __cfg(void *p_module, cJSON *p_json)
         // return -1;
     }
 
-    // host
     if (p_host == NULL) p_host = CONFIG_TF_MODULE_HTTP_ALARM_SERV_HOST;
+    if (p_token == NULL) p_token = __token_gen();
+
+    // the task may be sending, it copies these under the lock
+    __data_lock(p_module_ins);
+
+    // host
     snprintf(p_module_ins->url, sizeof(p_module_ins->url), "%s%s", p_host, CONFIG_TF_MODULE_HTTP_ALARM_SERV_REQ_PATH);
 
     // token
-    if (p_token == NULL) p_token = __token_gen();
     if (p_token) {
         if (local_svc_cfg.enable) {
             snprintf(p_module_ins->token, sizeof(p_module_ins->token), "%s", p_token);
@@ -518,6 +606,14 @@ static int __cfg(void *p_module, cJSON *p_json)
         p_module_ins->token[0] = '\0';
     }
 
+    p_module_ins->head[0] = '\0';
+    p_module_ins->dest = __dest_hash(p_module_ins);
+
+    tf_data_buf_free(&p_module_ins->params.text);  // set before by __cfg_update
+    __parmas_default(&p_module_ins->params);
+    __params_parse(&p_module_ins->params, p_json);
+    __data_unlock(p_module_ins);
+
     if (local_svc_cfg.url != NULL) {
         free(local_svc_cfg.url);
     }
@@ -525,16 +621,20 @@ static int __cfg(void *p_module, cJSON *p_json)
         free(local_svc_cfg.token);
     }
 
-    p_module_ins->head[0] = '\0';
-
-    __data_lock(p_module_ins);
-    __parmas_default(&p_module_ins->params);
-    __params_parse(&p_module_ins->params, p_json);
-    __data_unlock(p_module_ins);
+    // alarms left for another server or account are dropped, not sent here
+    if (p_module_ins->p_outbox) {
+        tf_outbox_dest_set(p_module_ins->p_outbox, p_module_ins->dest);
+    }
 
     return 0;
 }
 
+// everything __cfg sets is read under the lock, by the handler and the task alike
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    return __cfg(p_module, p_json);
+}
+
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_http_alarm_t *p_module_ins = (tf_module_http_alarm_t *)p_module;
@@ -577,7 +677,8 @@ const static struct tf_module_ops __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 const static struct tf_module_mgmt __g_module_mgmt = {
@@ -616,6 +717,24 @@ tf_module_t * tf_module_http_alarm_init(tf_module_http_alarm_t *p_module_ins)
     p_module_ins->queue_handle = xQueueCreate(TF_MODULE_HTTP_ALARM_QUEUE_SIZE, sizeof(tf_data_dualimage_with_audio_text_t));
     ESP_GOTO_ON_FALSE(NULL != p_module_ins->queue_handle, ESP_FAIL, err, TAG, "Failed to create queue");
 
+#if CONFIG_TF_MODULE_HTTP_ALARM_OUTBOX_NUM > 0
+    tf_outbox_cfg_t outbox_cfg = {
+        .name = TF_MODULE_HTTP_ALARM_OUTBOX_NAME,
+        .dir = NULL,
+        .num = CONFIG_TF_MODULE_HTTP_ALARM_OUTBOX_NUM,
+        .size_max = TF_MODULE_HTTP_ALARM_OUTBOX_SIZE_MAX,
+        .backoff_min_ms = TF_MODULE_HTTP_ALARM_RETRY_MIN_MS,
+        .backoff_max_ms = TF_MODULE_HTTP_ALARM_RETRY_MAX_MS,
+        .send = __alarm_send,
+        .p_ctx = p_module_ins,
+    };
+    // a second http alarm in the flow finds the outbox taken
+    if (tf_outbox_open(&outbox_cfg, &p_module_ins->p_outbox) != ESP_OK) {
+        ESP_LOGW(TAG, "No outbox, alarms are sent once");  // not fatal
+        p_module_ins->p_outbox = NULL;
+    }
+#endif
+
     p_module_ins->p_task_stack_buf = (StackType_t *)tf_malloc(TF_MODULE_HTTP_ALARM_TASK_STACK_SIZE);
     ESP_GOTO_ON_FALSE(NULL != p_module_ins->p_task_stack_buf, ESP_ERR_NO_MEM, err, TAG, "Failed to malloc task stack");
 
@@ -658,13 +777,26 @@ err:
         vQueueDelete(p_module_ins->queue_handle);
         p_module_ins->queue_handle = NULL;
     }
+    if( p_module_ins->p_outbox ) {
+        tf_outbox_close(p_module_ins->p_outbox);
+        p_module_ins->p_outbox = NULL;
+    }
     return NULL;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT),
+    .output_port_num = 0,
+};
+
 esp_err_t tf_module_http_alarm_register(void)
 {
-    return tf_module_register(TF_MODULE_HTTP_ALARM_NAME,
-                              TF_MODULE_HTTP_ALARM_DESC,
-                              TF_MODULE_HTTP_ALARM_RVERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_HTTP_ALARM_NAME,
+                                       TF_MODULE_HTTP_ALARM_DESC,
+                                       TF_MODULE_HTTP_ALARM_RVERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_HTTP_ALARM_NAME, &__g_module_io);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #pragma once
 #include "tf_module.h"
 #include "tf_module_data_type.h"
+#include "tf_module_outbox.h"
 #include "esp_err.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
@@ -30,6 +31,15 @@ extern "C"
 
 #define TF_MODULE_HTTP_ALARM_DEFAULT_SILENCE_DURATION  30
 
+// alarms whose send failed kept on flash, 0: alarms are sent once
+#ifndef CONFIG_TF_MODULE_HTTP_ALARM_OUTBOX_NUM
+#define CONFIG_TF_MODULE_HTTP_ALARM_OUTBOX_NUM    8
+#endif
+#define TF_MODULE_HTTP_ALARM_OUTBOX_NAME          "ha"
+#define TF_MODULE_HTTP_ALARM_OUTBOX_SIZE_MAX      (256 * 1024)
+#define TF_MODULE_HTTP_ALARM_RETRY_MIN_MS         5000
+#define TF_MODULE_HTTP_ALARM_RETRY_MAX_MS         (10 * 60 * 1000)
+
 struct tf_module_http_alarm_params
 {
     bool time_en;
@@ -49,12 +59,14 @@ typedef struct tf_module_http_alarm
     SemaphoreHandle_t sem_handle;
     EventGroupHandle_t event_group;
     QueueHandle_t queue_handle;
+    tf_outbox_t *p_outbox;
     TaskHandle_t task_handle;
     StaticTask_t *p_task_buf;
     StackType_t *p_task_stack_buf;
     char url[256];
     char token[128];
     char head[128];
+    uint32_t dest;    // hash of url, token and head, an alarm is only sent where it was put for
 } tf_module_http_alarm_t;
 
 tf_module_t * tf_module_http_alarm_init(tf_module_http_alarm_t *p_module_ins);
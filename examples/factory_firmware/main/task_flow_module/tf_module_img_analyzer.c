@@ -1,5 +1,6 @@
 #include "tf_module_img_analyzer.h"
 #include "tf_module_util.h"
+#include "tf_module_outbox.h"
 #include <string.h>
 #include "tf.h"
 #include "tf_util.h"
@@ -21,6 +22,8 @@ static const char *TAG = "tfm.img_analyzer";
 #define EVENT_NEED_DELETE   BIT2
 #define EVENT_TASK_DELETED  BIT3 
 
+#define UPLOAD_ERR_NO_RESPONSE  -2
+
 // #define IMG_ANALYZER_NET_CHECK_ENABLE 
 
 #ifdef IMG_ANALYZER_NET_CHECK_ENABLE
@@ -287,7 +290,7 @@ static int __https_upload_image(tf_module_img_analyzer_t             *p_module_i
 
     if (p_resp == NULL) {
         ESP_LOGE(TAG, "request failed");
-        return -1;
+        return UPLOAD_ERR_NO_RESPONSE;
     }
 
     // ESP_LOGD(TAG, "Response: %s", p_resp); 
@@ -349,11 +352,12 @@ static int __https_upload_image(tf_module_img_analyzer_t             *p_module_i
 
             p_result->img.p_buf = NULL;
             p_result->img.len   = 0;
+            p_result->img.p_ref = NULL;
             cJSON *json_img = cJSON_GetObjectItem(json_data, "img");
             if ( json_img != NULL && cJSON_IsString(json_img)) {
-                uint8_t *p_img = (uint8_t *)tf_malloc( strlen(json_img->valuestring) );
+                uint8_t *p_img = (uint8_t *)tf_malloc( strlen(json_img->valuestring) + 1 );
                 if( p_img ) {
-                    memcpy(p_img, json_img->valuestring, strlen(json_img->valuestring));
+                    memcpy(p_img, json_img->valuestring, strlen(json_img->valuestring) + 1); // shared as is, keep the '\0'.
                     p_result->img.p_buf = p_img;
                     p_result->img.len   = strlen(json_img->valuestring);
                     p_result->img.time  = p_data->img_large.time;
@@ -393,6 +397,7 @@ static void img_analyzer_task(void *p_arg)
             while (xQueueReceive(p_module_ins->queue_handle, &data,0) == pdPASS ) {
                 tf_data_free((void *)&data); //clear queue
             }
+            tf_owner_set(TF_OWNER_NONE);
             xEventGroupSetBits(p_module_ins->event_group, EVENT_TASK_DELETED);
             vTaskDelete(NULL);
         }
@@ -407,8 +412,21 @@ static void img_analyzer_task(void *p_arg)
 
         if(xQueueReceive(p_module_ins->queue_handle, &data, ( TickType_t ) 10 ) == pdPASS ) {
             ESP_LOGI(TAG, "Start analyse image");
+            tf_owner_set(p_module_ins->input_evt_id);
             memset( &result, 0, sizeof(result) );
             ret = __https_upload_image(p_module_ins, &data, &result);
+            for (int i = 1; ret == UPLOAD_ERR_NO_RESPONSE && i <= TF_MODULE_IMG_ANALYZER_RETRY_NUM; i++) {
+                uint32_t wait_ms = tf_outbox_backoff_ms(TF_MODULE_IMG_ANALYZER_RETRY_MIN_MS, TF_MODULE_IMG_ANALYZER_RETRY_MAX_MS, i);
+                ESP_LOGW(TAG, "No response, retry %d in %d ms", i, (int)wait_ms);
+                // stop or delete ends the retries, the bits are left for the loop above
+                bits = xEventGroupWaitBits(p_module_ins->event_group, \
+                        EVENT_NEED_DELETE | EVENT_STOP , pdFALSE, pdFALSE, pdMS_TO_TICKS(wait_ms));
+                if (( bits & (EVENT_NEED_DELETE | EVENT_STOP) ) != 0) {
+                    break;
+                }
+                memset( &result, 0, sizeof(result) );
+                ret = __https_upload_image(p_module_ins, &data, &result);
+            }
             if( ret == 0) {
                 // output
                 ESP_LOGI(TAG, "img_analyzer result: %d", result.status);
@@ -421,11 +439,11 @@ static void img_analyzer_task(void *p_arg)
                     __data_lock(p_module_ins); 
                     for (int i = 0; i < p_module_ins->output_evt_num; i++) {
                         if( result.img.p_buf) {
-                            tf_data_image_copy(&output_data.img_small, &result.img); //use cloud image
+                            tf_data_image_share(&output_data.img_small, &result.img); //use cloud image
                         } else {
-                            tf_data_image_copy(&output_data.img_small, &data.img_small);
+                            tf_data_image_share(&output_data.img_small, &data.img_small);
                         }
-                        tf_data_image_copy(&output_data.img_large, &data.img_large);
+                        tf_data_image_share(&output_data.img_large, &data.img_large);
                         tf_data_inference_copy(&output_data.inference, &data.inference);
                         tf_data_buf_copy(&output_data.audio, &result.audio);
                         tf_data_buf_copy(&output_data.text, &text);
@@ -583,10 +601,9 @@ static int __msgs_sub_set(void *p_module, int evt_id)
 static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int num)
 {
     tf_module_img_analyzer_t *p_module_ins = (tf_module_img_analyzer_t *)p_module;
-    __data_lock(p_module_ins);
-    if (output_index == 0 && num > 0)
-    {
-        p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
+}; = (int *)tf_malloc(sizeof(int) * num);
         if (p_module_ins->p_output_evt_id )
         {
             memcpy(p_module_ins->p_output_evt_id, p_evt_id, sizeof(int) * num);
@@ -715,6 +732,12 @@ err:
     return NULL;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE),
+    .output_port_num = 1,
+    .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) },
+};
+
 esp_err_t tf_module_img_analyzer_register(void)
 {
 
@@ -727,8 +750,12 @@ esp_err_t tf_module_img_analyzer_register(void)
     }
 #endif
 
-    return tf_module_register(TF_MODULE_IMG_ANALYZER_NAME,
-                              TF_MODULE_IMG_ANALYZER_DESC,
-                              TF_MODULE_IMG_ANALYZER_VERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_IMG_ANALYZER_NAME,
+                                       TF_MODULE_IMG_ANALYZER_DESC,
+                                       TF_MODULE_IMG_ANALYZER_VERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_IMG_ANALYZER_NAME, &__g_module_io);
 }
\ No newline at end of file
@@ -31,6 +31,11 @@ extern "C"
 #define TF_MODULE_IMG_ANALYZER_TASK_PRIO       3
 #define TF_MODULE_IMG_ANALYZER_QUEUE_SIZE      3
 
+// retries when the server did not answer, a late result is of little use so they are few
+#define TF_MODULE_IMG_ANALYZER_RETRY_NUM       2
+#define TF_MODULE_IMG_ANALYZER_RETRY_MIN_MS    2000
+#define TF_MODULE_IMG_ANALYZER_RETRY_MAX_MS    8000
+
 #define TF_MODULE_IMG_ANALYZER_TYPE_RECOGNIZE    0  // Analyze pictures
 #define TF_MODULE_IMG_ANALYZER_TYPE_MONITORING   1  // Monitor behavior
 
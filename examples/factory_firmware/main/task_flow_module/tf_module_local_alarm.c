@@ -21,10 +21,11 @@ static tf_module_t *g_handle = NULL;
 
 static void __data_lock( tf_module_local_alarm_t *p_module)
 {
+    xSemaphoreTake(p_module->sem_handle, portMAX_DELAY);
 }
 static void __data_unlock( tf_module_local_alarm_t *p_module)
 {
-
+    xSemaphoreGive(p_module->sem_handle);
 }
 static void __parmas_default(struct tf_module_local_alarm_params *p_params)
 {
@@ -61,7 +62,12 @@ static int __params_parse(struct tf_module_local_alarm_params *p_params, cJSON *
 }
 static void __alarm_off( tf_module_local_alarm_t *p_module_ins )
 {
-    struct tf_module_local_alarm_params *p_params = &p_module_ins->params;
+    struct tf_module_local_alarm_params params;
+    struct tf_module_local_alarm_params *p_params = &params;
+
+    __data_lock(p_module_ins);
+    params = p_module_ins->params;
+    __data_unlock(p_module_ins);
     //TODO 
     // RGB OFF
     // SOUND OFF
@@ -105,8 +111,14 @@ static void __event_handler(void *handler_args, esp_event_base_t base, int32_t i
 {
     esp_err_t ret = ESP_OK;
     tf_module_local_alarm_t *p_module_ins = (tf_module_local_alarm_t *)handler_args;
-    struct tf_module_local_alarm_params *p_params = &p_module_ins->params;
-   
+    struct tf_module_local_alarm_params params;
+    struct tf_module_local_alarm_params *p_params = &params;
+
+    // cfg_update may change them while the flow runs
+    __data_lock(p_module_ins);
+    params = p_module_ins->params;
+    __data_unlock(p_module_ins);
+
     uint32_t type = ((uint32_t *)p_event_data)[0];
     if( type !=  TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) {
         ESP_LOGW(TAG, "unsupport type %d", type);
@@ -128,9 +140,7 @@ static void __event_handler(void *handler_args, esp_event_base_t base, int32_t i
     info.is_show_img = p_params->img;
     info.is_show_text = p_params->text;
     if( info.is_show_img ) {
-        info.img.p_buf = p_data->img_small.p_buf;
-        info.img.time = p_data->img_small.time;
-        info.img.len = p_data->img_small.len;
+        info.img = p_data->img_small; // hand our reference over to the view
         img_small_used = true;
     }
     if( info.is_show_text ) {
@@ -224,6 +234,19 @@ static int __cfg(void *p_module, cJSON *p_json)
     __data_unlock(p_module_ins);
     return 0;
 }
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    tf_module_local_alarm_t *p_module_ins = (tf_module_local_alarm_t *)p_module;
+    struct tf_module_local_alarm_params params;
+
+    __parmas_default(&params);
+    __params_parse(&params, p_json);
+
+    __data_lock(p_module_ins);
+    p_module_ins->params = params;
+    __data_unlock(p_module_ins);
+    return 0;
+}
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_local_alarm_t *p_module_ins = (tf_module_local_alarm_t *)p_module;
@@ -268,7 +291,8 @@ const static struct tf_module_ops  __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 const static struct tf_module_mgmt __g_module_mgmt = {
@@ -297,6 +321,12 @@ tf_module_t * tf_module_local_alarm_init(tf_module_local_alarm_t *p_module_ins)
 
     p_module_ins->input_evt_id = 0;
 
+    p_module_ins->sem_handle = xSemaphoreCreateMutex();
+    if (p_module_ins->sem_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create semaphore");
+        return NULL;
+    }
+
 #if TF_MODULE_LOCAL_ALARM_TIMER_ENABLE
     const esp_timer_create_args_t timer_args = {
             .callback = &__timer_callback,
@@ -321,6 +351,11 @@ tf_module_t * tf_module_local_alarm_init(tf_module_local_alarm_t *p_module_ins)
     return &p_module_ins->module_base;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT),
+    .output_port_num = 0,
+};
+
 esp_err_t tf_module_local_alarm_register(void)
 {
     g_handle = __module_instance(); // Must be instantiated
@@ -328,8 +363,12 @@ esp_err_t tf_module_local_alarm_register(void)
     {
         return ESP_FAIL;
     }
-    return tf_module_register(TF_MODULE_LOCAL_ALARM_NAME,
-                              TF_MODULE_LOCAL_ALARM_DESC,
-                              TF_MODULE_LOCAL_ALARM_RVERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_LOCAL_ALARM_NAME,
+                                       TF_MODULE_LOCAL_ALARM_DESC,
+                                       TF_MODULE_LOCAL_ALARM_RVERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_LOCAL_ALARM_NAME, &__g_module_io);
 }
\ No newline at end of file
@@ -92,7 +92,7 @@ static void __event_handler(void *handler_args, esp_event_base_t base, int32_t i
         if( ret != ESP_OK ) {
             ESP_LOGE(TAG, "Faild to report sensecraft alarm");
         }
-        free(tf_info.p_tf_name);
+        tf_free((void *)tf_info.p_tf_name);
     } else {
         ESP_LOGI(TAG, "Silence: %d, diff: %f, Skip sensecraft alarm", p_params->silence_duration, diff);
     }
@@ -124,6 +124,21 @@ static int __cfg(void *p_module, cJSON *p_json)
     __data_unlock(p_module_ins);
     return 0;
 }
+// the handler reads the text under the lock, so it is swapped under it
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    tf_module_sensecraft_alarm_t *p_module_ins = (tf_module_sensecraft_alarm_t *)p_module;
+    struct tf_module_sensecraft_alarm_params params;
+
+    __parmas_default(&params);
+    __params_parse(&params, p_json);
+
+    __data_lock(p_module_ins);
+    tf_data_buf_free(&p_module_ins->params.text);
+    p_module_ins->params = params;
+    __data_unlock(p_module_ins);
+    return 0;
+}
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_sensecraft_alarm_t *p_module_ins = (tf_module_sensecraft_alarm_t *)p_module;
@@ -170,7 +185,8 @@ const static struct tf_module_ops  __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 const static struct tf_module_mgmt __g_module_mgmt = {
@@ -211,10 +227,19 @@ err:
     return NULL;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT),
+    .output_port_num = 0,
+};
+
 esp_err_t tf_module_sensecraft_alarm_register(void)
 {
-    return tf_module_register(TF_MODULE_SENSECRAFT_ALARM_NAME,
-                              TF_MODULE_SENSECRAFT_ALARM_DESC,
-                              TF_MODULE_SENSECRAFT_ALARM_RVERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_SENSECRAFT_ALARM_NAME,
+                                       TF_MODULE_SENSECRAFT_ALARM_DESC,
+                                       TF_MODULE_SENSECRAFT_ALARM_RVERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_SENSECRAFT_ALARM_NAME, &__g_module_io);
 }
\ No newline at end of file
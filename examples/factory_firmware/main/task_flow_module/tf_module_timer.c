@@ -8,6 +8,15 @@
 
 static const char *TAG = "tfm.timer";
 
+static void __data_lock( tf_module_timer_t *p_module)
+{
+    xSemaphoreTake(p_module->sem_handle, portMAX_DELAY);
+}
+static void __data_unlock( tf_module_timer_t *p_module)
+{
+    xSemaphoreGive(p_module->sem_handle);
+}
+
 static void __timer_callback(void* p_arg)
 {
     esp_err_t ret = ESP_OK;
@@ -20,6 +29,7 @@ static void __timer_callback(void* p_arg)
     buf_data.type = TF_DATA_TYPE_TIME;
     buf_data.time = now;
 
+    __data_lock(p_module_ins);
     for(int i = 0; i < p_module_ins->output_evt_num; i++) {
         ret = tf_event_post(p_module_ins->p_output_evt_id[i], &buf_data, sizeof(buf_data), pdMS_TO_TICKS(10000));
         if( ret != ESP_OK) {
@@ -28,6 +38,7 @@ static void __timer_callback(void* p_arg)
             ESP_LOGI(TAG, "Output --> %d", p_module_ins->p_output_evt_id[i]);
         }
     }
+    __data_unlock(p_module_ins);
 }
 
 /*************************************************************************
@@ -54,7 +65,11 @@ static int __stop(void *p_module)
     tf_module_timer_t *p_module_ins = (tf_module_timer_t *)p_module;
     esp_timer_stop(p_module_ins->timer_handle);
     esp_timer_delete(p_module_ins->timer_handle);
+    __data_lock(p_module_ins);
     tf_free(p_module_ins->p_output_evt_id);
+    p_module_ins->p_output_evt_id = NULL;
+    p_module_ins->output_evt_num = 0;
+    __data_unlock(p_module_ins);
     return 0;
 }
 static int __cfg(void *p_module, cJSON *p_json)
@@ -84,6 +99,16 @@ static int __msgs_sub_set(void *p_module, int evt_id)
 static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int num)
 {
     tf_module_timer_t *p_module_ins = (tf_module_timer_t *)p_module;
+    __data_lock(p_module_ins);
+    if (output_index == 0)
+    {
+        // may be set again while started, when the flow is rewired
+        if( p_module_ins->p_output_evt_id ) {
+            tf_free(p_module_ins->p_output_evt_id);
+            p_module_ins->p_output_evt_id = NULL;
+        }
+        p_module_ins->output_evt_num = 0;
+    }
     if (output_index == 0 && num > 0)
     {
         p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
@@ -100,6 +125,7 @@ static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int n
     {
         ESP_LOGW(TAG, "only support output port 0, ignore %d", output_index);
     }
+    __data_unlock(p_module_ins);
     return 0;
 }
 
@@ -117,6 +143,11 @@ static tf_module_t * __module_instance(void)
 static  void __module_destroy(tf_module_t *handle)
 {
     if( handle ) {
+        tf_module_timer_t *p_module_ins = (tf_module_timer_t *)handle->p_module;
+        if (p_module_ins->sem_handle) {
+            vSemaphoreDelete(p_module_ins->sem_handle);
+            p_module_ins->sem_handle = NULL;
+        }
         free(handle->p_module);
     }
 }
@@ -147,13 +178,28 @@ tf_module_t * tf_module_timer_init(tf_module_timer_t *p_module_ins)
     p_module_ins->module_base.p_module = p_module_ins;
     p_module_ins->module_base.ops = &__g_module_ops;
 
+    p_module_ins->sem_handle = xSemaphoreCreateMutex();
+    if (p_module_ins->sem_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create semaphore");
+        return NULL;
+    }
     return &p_module_ins->module_base;
 }
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = 0,
+    .output_port_num = 1,
+    .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_TIME) },
+};
+
 esp_err_t tf_module_timer_register(void)
 {
-    return tf_module_register(TF_MODULE_TIMER_NAME,
-                              TF_MODULE_TIMER_DESC,
-                              TF_MODULE_TIMER_VERSION,
-                              &__g_module_mgmt);
+    esp_err_t ret = tf_module_register(TF_MODULE_TIMER_NAME,
+                                       TF_MODULE_TIMER_DESC,
+                                       TF_MODULE_TIMER_VERSION,
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_TIMER_NAME, &__g_module_io);
 }
\ No newline at end of file
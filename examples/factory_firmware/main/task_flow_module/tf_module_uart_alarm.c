@@ -20,250 +20,311 @@ static const char *TAG = "tfm.uart_alarm";
 static volatile atomic_int g_ins_cnt = ATOMIC_VAR_INIT(0);
 
 
-static void __event_handler(void *handler_args, esp_event_base_t base, int32_t id, void *p_event_data)
+#define UART_ALARM_STAGE_SIZE  128
+
+static void __data_lock(tf_module_uart_alarm_t *p_module)
 {
-    tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)handler_args;
-   
-    uint32_t type = ((uint32_t *)p_event_data)[0];
-    if( type !=  TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) {
-        ESP_LOGW(TAG, "unsupported type %d", type);
-        tf_data_free(p_event_data);
+    xSemaphoreTake(p_module->sem_handle, portMAX_DELAY);
+}
+
+static void __data_unlock(tf_module_uart_alarm_t *p_module)
+{
+    xSemaphoreGive(p_module->sem_handle);
+}
+
+/*
+ * Packet writer. Every field is streamed straight from where it lives to
+ * the uart, images included. Short fields are gathered in a small stage
+ * buffer, so no copy of the whole packet is ever built.
+ */
+struct uart_alarm_writer
+{
+    size_t len;                              // bytes emitted so far
+    size_t staged;
+    uint8_t stage[UART_ALARM_STAGE_SIZE];
+};
+
+struct uart_alarm_packet
+{
+    tf_data_dualimage_with_audio_text_t *p_data;
+    const char *p_prompt;
+    char *p_prompt_json;                     // json output: prompt as a json string
+    char *p_inference_json;                  // json output: inference object, NULL: none
+};
+
+static void __writer_flush(struct uart_alarm_writer *p_writer)
+{
+    if (p_writer->staged) {
+        uart_write_bytes(UART_NUM_2, p_writer->stage, p_writer->staged);
+    }
+    p_writer->staged = 0;
+}
+
+static void __writer_put(struct uart_alarm_writer *p_writer, const void *p_buf, size_t len)
+{
+    p_writer->len += len;
+    if (len == 0) {
         return;
     }
+    if (len > sizeof(p_writer->stage) - p_writer->staged) {
+        __writer_flush(p_writer);
+        if (len >= sizeof(p_writer->stage)) {
+            uart_write_bytes(UART_NUM_2, p_buf, len);
+            return;
+        }
+    }
+    memcpy(p_writer->stage + p_writer->staged, p_buf, len);
+    p_writer->staged += len;
+}
+
+// all integers go out little-endian, as they are in memory
+static void __writer_put_u8(struct uart_alarm_writer *p_writer, uint8_t val)
+{
+    __writer_put(p_writer, &val, 1);
+}
 
-    tf_data_dualimage_with_audio_text_t *p_data = (tf_data_dualimage_with_audio_text_t*)p_event_data;
-    uint32_t total_len = 0;
-    uint8_t *buffer = NULL;
-    cJSON *json = NULL;
+static void __writer_put_u16(struct uart_alarm_writer *p_writer, uint16_t val)
+{
+    __writer_put(p_writer, &val, 2);
+}
 
-    //prompt
-    tf_info_t tf_info;
-    memset(&tf_info, 0, sizeof(tf_info_t));
-    char *prompt = NULL;
-    if (p_module_ins->text != NULL && strlen(p_module_ins->text) > 0) {
-        prompt = p_module_ins->text;
+static void __writer_put_u32(struct uart_alarm_writer *p_writer, uint32_t val)
+{
+    __writer_put(p_writer, &val, 4);
+}
+
+static void __writer_put_str(struct uart_alarm_writer *p_writer, const char *p_str)
+{
+    __writer_put(p_writer, p_str, strlen(p_str));
+}
+
+static void __binary_emit(tf_module_uart_alarm_t *p_module_ins, struct uart_alarm_packet *p_packet,
+                          struct uart_alarm_writer *p_writer)
+{
+    tf_data_dualimage_with_audio_text_t *p_data = p_packet->p_data;
+    struct tf_data_inference_info *p_inference = &p_data->inference;
+
+    __writer_put_str(p_writer, PKT_MAGIC_HEADER);
+
+    __writer_put_u32(p_writer, strlen(p_packet->p_prompt));
+    __writer_put_str(p_writer, p_packet->p_prompt);
+
+    if (p_module_ins->include_big_image) {
+        __writer_put_u32(p_writer, p_data->img_large.len);
+        __writer_put(p_writer, p_data->img_large.p_buf, p_data->img_large.len);
     } else {
-        tf_engine_info_get(&tf_info);
-        prompt = tf_info.p_tf_name;
-        if ( prompt == NULL ){
-            prompt = "";
-        }
+        __writer_put_u32(p_writer, 0);
     }
-    if (p_module_ins->output_format == 0) {
-        //binary output
-        uint32_t prompt_len = strlen(prompt);
-        buffer = psram_calloc(1, prompt_len + 4);
-        memcpy(buffer, &prompt_len, 4);
-        memcpy(buffer + 4, prompt, prompt_len);
-        total_len += prompt_len + 4;
+
+    if (p_module_ins->include_small_image) {
+        __writer_put_u32(p_writer, p_data->img_small.len);
+        __writer_put(p_writer, p_data->img_small.p_buf, p_data->img_small.len);
     } else {
-        //json output
-        json = cJSON_CreateObject();
-        cJSON_AddItemToObject(json, "prompt", cJSON_CreateString(prompt));
+        __writer_put_u32(p_writer, 0);
     }
-    
-    if( tf_info.p_tf_name ) {
-        free(tf_info.p_tf_name);
+
+    if (!p_inference->is_valid) {
+        __writer_put_u8(p_writer, 0);
+        return;
     }
 
-    //big image
-    if (p_module_ins->include_big_image) {
-        ESP_LOGI(TAG, "include_big_image: %d", (int)p_module_ins->include_big_image);
-        if (p_module_ins->output_format == 0) {
-            //binary output
-            uint32_t big_image_len = p_data->img_large.len;
-            buffer = psram_realloc(buffer, total_len + big_image_len + 4);
-            memcpy(buffer + total_len, &big_image_len, 4);
-            memcpy(buffer + total_len + 4, p_data->img_large.p_buf, big_image_len);
-            total_len += big_image_len + 4;
-        } else {
-            //json output
-            cJSON_AddItemToObject(json, "big_image", cJSON_CreateString((char *)p_data->img_large.p_buf));
+    switch (p_inference->type)
+    {
+        case INFERENCE_TYPE_BOX:
+        {
+            sscma_client_box_t *p_boxes = (sscma_client_box_t *)p_inference->p_data;
+            __writer_put_u8(p_writer, 1);
+            __writer_put_u32(p_writer, p_inference->cnt);
+            for (size_t i = 0; i < p_inference->cnt; i++)
+            {
+                __writer_put_u16(p_writer, p_boxes[i].x);
+                __writer_put_u16(p_writer, p_boxes[i].y);
+                __writer_put_u16(p_writer, p_boxes[i].w);
+                __writer_put_u16(p_writer, p_boxes[i].h);
+                __writer_put_u8(p_writer, p_boxes[i].score);
+                __writer_put_u8(p_writer, p_boxes[i].target);
+            }
+            break;
         }
-    } else if( p_module_ins->output_format == 0 ) {
-        uint32_t big_image_len = 0;
-        buffer = psram_realloc(buffer, total_len  + 4);
-        memcpy(buffer + total_len, &big_image_len, 4);
-        total_len+=4;
-    } 
-
-    //small image
-    if (p_module_ins->include_small_image) {
-        ESP_LOGI(TAG, "include_small_image: %d", (int)p_module_ins->include_small_image);
-        if (p_module_ins->output_format == 0) {
-            //binary output
-            uint32_t small_image_len = p_data->img_small.len;
-            buffer = psram_realloc(buffer, total_len + small_image_len + 4);
-            memcpy(buffer + total_len, &small_image_len, 4);
-            memcpy(buffer + total_len + 4, p_data->img_small.p_buf, small_image_len);
-            total_len += small_image_len + 4;
-        } else {
-            //json output
-            cJSON_AddItemToObject(json, "small_image", cJSON_CreateString((char *)p_data->img_small.p_buf));
+        case INFERENCE_TYPE_CLASS:
+        {
+            sscma_client_class_t *p_classes = (sscma_client_class_t *)p_inference->p_data;
+            __writer_put_u8(p_writer, 2);
+            __writer_put_u32(p_writer, p_inference->cnt);
+            for (size_t i = 0; i < p_inference->cnt; i++)
+            {
+                __writer_put_u8(p_writer, p_classes[i].score);
+                __writer_put_u8(p_writer, p_classes[i].target);
+            }
+            break;
         }
-    } else if( p_module_ins->output_format == 0 ) {
-        uint32_t small_image_len = 0;
-        buffer = psram_realloc(buffer, total_len  + 4);
-        memcpy(buffer + total_len, &small_image_len, 4);
-        total_len+=4;
-    } 
+        default:
+            ESP_LOGE(TAG, "unsupport inference type: %d", p_inference->type);
+            __writer_put_u8(p_writer, 3);
+            __writer_put_u32(p_writer, 0);
+            break;
+    }
 
-    //inference
-    if (p_data->inference.is_valid) {
+    uint32_t name_cnt = 0;
+    for (size_t i = 0; i < CONFIG_MODEL_CLASSES_MAX_NUM && p_inference->classes[i] != NULL; i++)
+    {
+        name_cnt++;
+    }
+    __writer_put_u32(p_writer, name_cnt);
+    for (size_t i = 0; i < name_cnt; i++)
+    {
+        __writer_put(p_writer, p_inference->classes[i], strlen(p_inference->classes[i]) + 1);
+    }
+}
 
-        if (p_module_ins->output_format == 0) {
+// same bytes as cJSON_PrintUnformatted of the whole object, base64 needs no escaping
+static void __json_emit(tf_module_uart_alarm_t *p_module_ins, struct uart_alarm_packet *p_packet,
+                        struct uart_alarm_writer *p_writer)
+{
+    tf_data_dualimage_with_audio_text_t *p_data = p_packet->p_data;
 
-            switch (p_data->inference.type)
-            {
-                case INFERENCE_TYPE_BOX:
-                {
-                    uint8_t inference_type = 1;
-                    uint32_t boxes_cnt =  p_data->inference.cnt ;
-                    buffer = psram_realloc(buffer, total_len + boxes_cnt*10 + 4 + 1);
-                    memcpy(buffer + total_len, &inference_type, 1);
-                    memcpy(buffer + total_len + 1 , &boxes_cnt, 4);
-                    for (size_t i = 0; i < boxes_cnt; i++)
-                    {
-                        sscma_client_box_t *p_box =  &p_data->inference.p_data[i];
-                        uint16_t x = p_box->x;
-                        uint16_t y = p_box->y;
-                        uint16_t w = p_box->w;
-                        uint16_t h = p_box->h;
-                        uint8_t score = p_box->score;
-                        uint8_t target = p_box->target;
-
-                        memcpy(buffer + total_len + 5 + i*10 + 0, &x, 2);
-                        memcpy(buffer + total_len + 5 + i*10 + 2, &y, 2);
-                        memcpy(buffer + total_len + 5 + i*10 + 4, &w, 2);
-                        memcpy(buffer + total_len + 5 + i*10 + 6, &h, 2);
-                        memcpy(buffer + total_len + 5 + i*10 + 8, &score, 1);
-                        memcpy(buffer + total_len + 5 + i*10 + 9, &target, 1);
-                    }
-                    total_len +=  boxes_cnt*10 + 4 + 1;
-                    break;
-                }
-                case INFERENCE_TYPE_CLASS:
-                {
-                    uint8_t inference_type = 2;
-                    uint32_t classes_cnt =  p_data->inference.cnt ;
-                    buffer = psram_realloc(buffer, total_len + classes_cnt*2 + 4 + 1);
-                    memcpy(buffer + total_len, &inference_type, 1);
-                    memcpy(buffer + total_len + 1 , &classes_cnt, 4);
-                    for (size_t i = 0; i < classes_cnt; i++)
-                    {
-                        sscma_client_class_t *p_class =  &p_data->inference.p_data[i];
-                        uint8_t score = p_class->score;
-                        uint8_t target = p_class->target;
-                        memcpy(buffer + total_len + 5 + i*2 + 0, &score, 1);
-                        memcpy(buffer + total_len + 5 + i*2 + 1, &target, 1);
-                    }
-                    total_len +=  classes_cnt*10 + 4 + 1;
-                    break;
-                }
-               default:
-                    uint8_t inference_type = 3;
-                    uint32_t cnt = 0;
-                    buffer = psram_realloc(buffer, total_len + 4 + 1);
-                    memcpy(buffer + total_len, &inference_type, 1);
-                    memcpy(buffer + total_len + 1 , &cnt, 4);
-                    ESP_LOGE(TAG, "unsupport inference type: %d", p_data->inference.type);
-                    break;
-            }
-            uint32_t name_cnt = 0;
-            int classes_name_len = 0; 
-            for (size_t i = 0; p_data->inference.classes[i] != NULL; i++)
-            {
-                name_cnt++;
-                classes_name_len += strlen(p_data->inference.classes[i]) + 1;
-            }
-            
-            buffer = psram_realloc(buffer, total_len + classes_name_len + 4);
-            memcpy(buffer + total_len, &name_cnt, 4);
-            
-            int index = 4; 
-            for (size_t i = 0; p_data->inference.classes[i] != NULL; i++)
-            {
-                strcpy((char *)(buffer + total_len + index), p_data->inference.classes[i]);
-                index += strlen(p_data->inference.classes[i]);
-                buffer[total_len + index] = '\0';
-                index += 1;
-            }
-        
-            total_len +=  (classes_name_len + 4);
-        } else {
+    __writer_put_str(p_writer, "{\"prompt\":");
+    __writer_put_str(p_writer, p_packet->p_prompt_json);
+
+    if (p_module_ins->include_big_image && p_data->img_large.p_buf != NULL) {
+        __writer_put_str(p_writer, ",\"big_image\":\"");
+        __writer_put(p_writer, p_data->img_large.p_buf, p_data->img_large.len);
+        __writer_put_str(p_writer, "\"");
+    }
+
+    if (p_module_ins->include_small_image && p_data->img_small.p_buf != NULL) {
+        __writer_put_str(p_writer, ",\"small_image\":\"");
+        __writer_put(p_writer, p_data->img_small.p_buf, p_data->img_small.len);
+        __writer_put_str(p_writer, "\"");
+    }
+
+    if (p_packet->p_inference_json != NULL) {
+        __writer_put_str(p_writer, ",\"inference\":");
+        __writer_put_str(p_writer, p_packet->p_inference_json);
+    }
+    __writer_put_str(p_writer, "}\r\n");
+}
+
+static char *__inference_json_print(struct tf_data_inference_info *p_inference)
+{
+    cJSON *inference = cJSON_CreateObject();
+    char *p_str = NULL;
 
-            cJSON *inference = cJSON_CreateObject();
-            cJSON_AddItemToObject(json, "inference", inference);
+    if (inference == NULL) {
+        return NULL;
+    }
 
-            switch (p_data->inference.type)
+    switch (p_inference->type)
+    {
+        case INFERENCE_TYPE_BOX:
+        {
+            cJSON *boxes = cJSON_CreateArray();
+            cJSON_AddItemToObject(inference, "boxes", boxes);
+            sscma_client_box_t *p_boxs = (sscma_client_box_t *)p_inference->p_data;
+            for (size_t i = 0; i < p_inference->cnt; i++)
             {
-                case INFERENCE_TYPE_BOX:
-                {
-                    cJSON *boxes = cJSON_CreateArray();
-                    cJSON_AddItemToObject(inference, "boxes", boxes);
-                    sscma_client_box_t *p_boxs = (sscma_client_box_t *)p_data->inference.p_data;
-                    for (size_t i = 0; i < p_data->inference.cnt; i++)
-                    {
-                        sscma_client_box_t *p_box =  &p_boxs[i];   
-                        cJSON *box = cJSON_CreateArray();
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->x));
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->y));
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->w));
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->h));
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->score));
-                        cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->target));
-                        cJSON_AddItemToArray(boxes, box);
-                    }
-                    break;
-                }
-                case INFERENCE_TYPE_CLASS:
-                {
-                    cJSON *classes = cJSON_CreateArray();
-                    cJSON_AddItemToObject(inference, "classes", classes);
-                    sscma_client_class_t *p_classes = (sscma_client_class_t *)p_data->inference.p_data;
-                    for (size_t i = 0; i < p_data->inference.cnt; i++)
-                    {
-                        sscma_client_class_t *p_class =  &p_classes[i]; 
-                        cJSON *class = cJSON_CreateArray();
-                        cJSON_AddItemToArray(class, cJSON_CreateNumber(p_class->score));
-                        cJSON_AddItemToArray(class, cJSON_CreateNumber(p_class->target));
-                        cJSON_AddItemToArray(classes, class);
-                    }
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "unsupport inference type: %d", p_data->inference.type);
-                    break;
+                sscma_client_box_t *p_box =  &p_boxs[i];
+                cJSON *box = cJSON_CreateArray();
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->x));
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->y));
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->w));
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->h));
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->score));
+                cJSON_AddItemToArray(box, cJSON_CreateNumber(p_box->target));
+                cJSON_AddItemToArray(boxes, box);
             }
+            break;
+        }
+        case INFERENCE_TYPE_CLASS:
+        {
             cJSON *classes = cJSON_CreateArray();
-            cJSON_AddItemToObject(inference, "classes_name", classes);
-            for (size_t i = 0; p_data->inference.classes[i] != NULL; i++)
+            cJSON_AddItemToObject(inference, "classes", classes);
+            sscma_client_class_t *p_classes = (sscma_client_class_t *)p_inference->p_data;
+            for (size_t i = 0; i < p_inference->cnt; i++)
             {
-                cJSON_AddItemToArray(classes, cJSON_CreateString(p_data->inference.classes[i]));
-            }            
+                sscma_client_class_t *p_class =  &p_classes[i];
+                cJSON *class = cJSON_CreateArray();
+                cJSON_AddItemToArray(class, cJSON_CreateNumber(p_class->score));
+                cJSON_AddItemToArray(class, cJSON_CreateNumber(p_class->target));
+                cJSON_AddItemToArray(classes, class);
+            }
+            break;
+        }
+        default:
+            ESP_LOGE(TAG, "unsupport inference type: %d", p_inference->type);
+            break;
+    }
+    cJSON *classes = cJSON_CreateArray();
+    cJSON_AddItemToObject(inference, "classes_name", classes);
+    for (size_t i = 0; i < CONFIG_MODEL_CLASSES_MAX_NUM && p_inference->classes[i] != NULL; i++)
+    {
+        cJSON_AddItemToArray(classes, cJSON_CreateString(p_inference->classes[i]));
+    }
+
+    p_str = cJSON_PrintUnformatted(inference);
+    cJSON_Delete(inference);
+    return p_str;
+}
+
+static void __event_handler(void *handler_args, esp_event_base_t base, int32_t id, void *p_event_data)
+{
+    tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)handler_args;
+   
+    uint32_t type = ((uint32_t *)p_event_data)[0];
+    if( type !=  TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) {
+        ESP_LOGW(TAG, "unsupported type %d", type);
+        tf_data_free(p_event_data);
+        return;
+    }
+
+    struct uart_alarm_packet packet;
+    struct uart_alarm_writer writer;
+    void (*emit)(tf_module_uart_alarm_t *, struct uart_alarm_packet *, struct uart_alarm_writer *) = __binary_emit;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.p_data = (tf_data_dualimage_with_audio_text_t*)p_event_data;
+
+    // the prompt is written from the params, cfg_update waits for the packet to be out
+    __data_lock(p_module_ins);
+
+    //prompt
+    tf_info_t tf_info;
+    memset(&tf_info, 0, sizeof(tf_info_t));
+    if (p_module_ins->text != NULL && strlen(p_module_ins->text) > 0) {
+        packet.p_prompt = p_module_ins->text;
+    } else {
+        tf_engine_info_get(&tf_info);
+        packet.p_prompt = tf_info.p_tf_name;
+        if ( packet.p_prompt == NULL ){
+            packet.p_prompt = "";
+        }
+    }
+
+    if (p_module_ins->output_format != 0) {
+        //json output, only the short fields are printed by cJSON
+        cJSON *prompt = cJSON_CreateString(packet.p_prompt);
+        packet.p_prompt_json = prompt ? cJSON_PrintUnformatted(prompt) : NULL;
+        cJSON_Delete(prompt);
+        if (packet.p_data->inference.is_valid) {
+            packet.p_inference_json = __inference_json_print(&packet.p_data->inference);
         }
-    } else if( p_module_ins->output_format == 0 ) {
-        uint8_t inference_type = 0;
-        buffer = psram_realloc(buffer, total_len  + 1);
-        memcpy(buffer + total_len, &inference_type, 1);
-        total_len+=1;
-    } 
-
-    //output the packet
-    if (p_module_ins->output_format == 0) {
-        const char *header = "SEEED";
-        uart_write_bytes(UART_NUM_2, header, strlen(header));
-        ESP_LOGD(TAG, "uart magic header sent, output_format=%d", p_module_ins->output_format);
-        uart_write_bytes(UART_NUM_2, buffer, total_len);
-        free(buffer);
+        emit = __json_emit;
+    }
+
+    if (p_module_ins->output_format == 0 || packet.p_prompt_json != NULL) {
+        memset(&writer, 0, sizeof(writer));
+        emit(p_module_ins, &packet, &writer);
+        __writer_flush(&writer);
+        ESP_LOGD(TAG, "packet sent, output_format=%d, total_len=%u", p_module_ins->output_format, (unsigned)writer.len);
     } else {
-        char *str = cJSON_PrintUnformatted(json);
-        total_len = strlen(str);
-        ESP_LOGD(TAG, "output json:\n%s\ntotal_len=%d", str, total_len);
-        uart_write_bytes(UART_NUM_2, str, total_len);
-        uart_write_bytes(UART_NUM_2, "\r\n", 2);
-        free(str);
-        cJSON_Delete(json);
+        ESP_LOGE(TAG, "no mem for json output");
+    }
+    __data_unlock(p_module_ins);
+
+    free(packet.p_prompt_json);
+    free(packet.p_inference_json);
+    if( tf_info.p_tf_name ) {
+        tf_free((void *)tf_info.p_tf_name);
     }
 
     // data is used up, consumer frees it
@@ -282,16 +343,17 @@ static int __start(void *p_module)
 static int __stop(void *p_module)
 {
     tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)p_module;
+    __data_lock(p_module_ins);
     if (p_module_ins->text != NULL) {
         tf_free(p_module_ins->text);
+        p_module_ins->text = NULL;
     }
+    __data_unlock(p_module_ins);
     return tf_event_handler_unregister(p_module_ins->input_evt_id, __event_handler);
 }
 
-static int __cfg(void *p_module, cJSON *p_json)
+static int __params_parse(tf_module_uart_alarm_t *p_module_ins, cJSON *p_json)
 {
-    tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)p_module;
-
     cJSON *output_format = cJSON_GetObjectItem(p_json, "output_format");
     if (output_format == NULL || !cJSON_IsNumber(output_format))
     {
@@ -335,6 +397,26 @@ static int __cfg(void *p_module, cJSON *p_json)
     return 0;
 }
 
+static int __cfg(void *p_module, cJSON *p_json)
+{
+    tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)p_module;
+    int ret;
+
+    __data_lock(p_module_ins);
+    if (p_module_ins->text != NULL) {
+        tf_free(p_module_ins->text);
+        p_module_ins->text = NULL;
+    }
+    ret = __params_parse(p_module_ins, p_json);
+    __data_unlock(p_module_ins);
+    return ret;
+}
+
+static int __cfg_update(void *p_module, cJSON *p_json)
+{
+    return __cfg(p_module, p_json);
+}
+
 static int __msgs_sub_set(void *p_module, int evt_id)
 {
     tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)p_module;
@@ -356,7 +438,8 @@ const static struct tf_module_ops  __g_module_ops = {
     .stop = __stop,
     .cfg = __cfg,
     .msgs_sub_set = __msgs_sub_set,
-    .msgs_pub_set = __msgs_pub_set
+    .msgs_pub_set = __msgs_pub_set,
+    .cfg_update = __cfg_update
 };
 
 /*************************************************************************
@@ -370,8 +453,14 @@ tf_module_t *tf_module_uart_alarm_instance(void)
     {
         return NULL;
     }
+    memset(p_module_ins, 0, sizeof(tf_module_uart_alarm_t));
     p_module_ins->module_base.p_module = p_module_ins;
     p_module_ins->module_base.ops = &__g_module_ops;
+    p_module_ins->sem_handle = xSemaphoreCreateMutex();
+    if (p_module_ins->sem_handle == NULL) {
+        free(p_module_ins);
+        return NULL;
+    }
 
     if (atomic_fetch_add(&g_ins_cnt, 1) == 0) {
         // the 1st time instance, we should init the hardware
@@ -393,6 +482,7 @@ tf_module_t *tf_module_uart_alarm_instance(void)
     return &p_module_ins->module_base;
 
 err:
+    vSemaphoreDelete(p_module_ins->sem_handle);
     free(p_module_ins);
     return NULL;
 }
@@ -406,6 +496,8 @@ void tf_module_uart_alarm_destroy(tf_module_t *p_module_base)
             ESP_LOGI(TAG, "uart driver is deleted.");
         }
         if (p_module_base->p_module) {
+            tf_module_uart_alarm_t *p_module_ins = (tf_module_uart_alarm_t *)p_module_base->p_module;
+            vSemaphoreDelete(p_module_ins->sem_handle);
             free(p_module_base->p_module);
         }
     }
@@ -416,13 +508,22 @@ const static struct tf_module_mgmt __g_module_management = {
     .tf_module_destroy = tf_module_uart_alarm_destroy,
 };
 
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT),
+    .output_port_num = 0,
+};
+
 esp_err_t tf_module_uart_alarm_register(void)
 {
 #if CONFIG_ENABLE_FACTORY_FW_DEBUG_LOG
     esp_log_level_set(TAG, ESP_LOG_DEBUG);
 #endif
-    return tf_module_register(TF_MODULE_UART_ALARM_NAME,
-                              TF_MODULE_UART_ALARM_DESC,
-                              TF_MODULE_UART_ALARM_VERSION,
-                              &__g_module_management);
+    esp_err_t ret = tf_module_register(TF_MODULE_UART_ALARM_NAME,
+                                       TF_MODULE_UART_ALARM_DESC,
+                                       TF_MODULE_UART_ALARM_VERSION,
+                                       &__g_module_management);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_UART_ALARM_NAME, &__g_module_io);
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+
+#include "ota_delta.h"
+#include "storage.h"
+#include "util.h"
+
+#define OTA_DELTA_MAP_MAGIC         0x4d444f41  // "AODM"
+#define OTA_DELTA_RESUME_MAGIC      0x52444f41  // "AODR"
+#define OTA_DELTA_MAP_STORAGE       "ota_model_map"
+#define OTA_DELTA_RESUME_STORAGE    "ota_model_rsm"
+
+#define OTA_DELTA_MAP_HEADER_SIZE   offsetof(ota_delta_map_t, hash)
+
+static const char *TAG = "ota_delta";
+
+static const uint8_t unknown_hash[OTA_DELTA_HASH_LEN];
+
+void ota_delta_hash(const void *data, size_t len, uint8_t out[OTA_DELTA_HASH_LEN])
+{
+    uint8_t digest[32];
+
+    mbedtls_sha256(data, len, digest, 0);
+    memcpy(out, digest, OTA_DELTA_HASH_LEN);
+
+    // all zero is reserved for "unknown"
+    if (memcmp(out, unknown_hash, OTA_DELTA_HASH_LEN) == 0) {
+        out[OTA_DELTA_HASH_LEN - 1] = 1;
+    }
+}
+
+esp_err_t ota_delta_map_reset(ota_delta_map_t *map, uint32_t image_size)
+{
+    uint32_t count = (image_size + OTA_DELTA_BLOCK_SIZE - 1) / OTA_DELTA_BLOCK_SIZE;
+
+    memset(map, 0, sizeof(ota_delta_map_t));
+    map->magic = OTA_DELTA_MAP_MAGIC;
+    map->block_size = OTA_DELTA_BLOCK_SIZE;
+    ESP_RETURN_ON_FALSE(count <= OTA_DELTA_MAX_BLOCKS, ESP_ERR_INVALID_SIZE, TAG, "image too large for block map: %" PRIu32, image_size);
+    map->image_size = image_size;
+    map->count = count;
+
+    return ESP_OK;
+}
+
+bool ota_delta_map_match(const ota_delta_map_t *map, uint32_t index, const uint8_t hash[OTA_DELTA_HASH_LEN])
+{
+    if (index >= map->count) return false;
+    if (memcmp(map->hash[index], unknown_hash, OTA_DELTA_HASH_LEN) == 0) return false;
+    return memcmp(map->hash[index], hash, OTA_DELTA_HASH_LEN) == 0;
+}
+
+void ota_delta_map_set(ota_delta_map_t *map, uint32_t index, const uint8_t hash[OTA_DELTA_HASH_LEN])
+{
+    if (index >= OTA_DELTA_MAX_BLOCKS) return;
+    memcpy(map->hash[index], hash, OTA_DELTA_HASH_LEN);
+    if (index >= map->count) {
+        map->count = index + 1;
+    }
+}
+
+void ota_delta_map_forget(ota_delta_map_t *map, uint32_t index, uint32_t count)
+{
+    if (index >= map->count) return;
+    if (count > map->count - index) {
+        count = map->count - index;
+    }
+    memset(map->hash[index], 0, count * OTA_DELTA_HASH_LEN);
+}
+
+esp_err_t ota_delta_map_load(ota_delta_map_t *map)
+{
+    size_t len = sizeof(ota_delta_map_t);
+    esp_err_t ret = storage_read(OTA_DELTA_MAP_STORAGE, map, &len);
+
+    if (ret == ESP_OK) {
+        if (len < OTA_DELTA_MAP_HEADER_SIZE || map->magic != OTA_DELTA_MAP_MAGIC || map->block_size != OTA_DELTA_BLOCK_SIZE
+            || map->count > OTA_DELTA_MAX_BLOCKS || len != OTA_DELTA_MAP_HEADER_SIZE + map->count * OTA_DELTA_HASH_LEN) {
+            ESP_LOGW(TAG, "stored block map invalid, ignored");
+            ret = ESP_ERR_INVALID_STATE;
+        }
+    }
+    if (ret != ESP_OK) {
+        ota_delta_map_reset(map, 0);
+    }
+    return ret;
+}
+
+esp_err_t ota_delta_map_save(ota_delta_map_t *map, uint32_t dirty_index, uint32_t dirty_count)
+{
+    esp_err_t ret = ESP_OK;
+    size_t len = OTA_DELTA_MAP_HEADER_SIZE + map->count * OTA_DELTA_HASH_LEN;
+    ota_delta_map_t *persist = map;
+
+    if (dirty_count > 0 && dirty_index < map->count) {
+        persist = psram_malloc(len);
+        ESP_RETURN_ON_FALSE(persist, ESP_ERR_NO_MEM, TAG, "no mem for block map");
+        memcpy(persist, map, len);
+        ota_delta_map_forget(persist, dirty_index, dirty_count);
+    }
+
+    ret = storage_write(OTA_DELTA_MAP_STORAGE, persist, len);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "save block map failed: %s", esp_err_to_name(ret));
+    }
+
+    if (persist != map) {
+        free(persist);
+    }
+    return ret;
+}
+
+esp_err_t ota_delta_map_clear(void)
+{
+    // header only, the whole map is too big for the stack
+    uint32_t header[OTA_DELTA_MAP_HEADER_SIZE / sizeof(uint32_t)] = {
+        OTA_DELTA_MAP_MAGIC, OTA_DELTA_BLOCK_SIZE, 0, 0
+    };
+
+    return storage_write(OTA_DELTA_MAP_STORAGE, header, sizeof(header));
+}
+
+esp_err_t ota_delta_resume_load(const char *url, uint32_t image_size, ota_delta_resume_t *resume)
+{
+    uint8_t url_hash[OTA_DELTA_HASH_LEN];
+    size_t len = sizeof(ota_delta_resume_t);
+
+    ESP_RETURN_ON_FALSE(url && resume, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    if (storage_read(OTA_DELTA_RESUME_STORAGE, resume, &len) != ESP_OK || len != sizeof(ota_delta_resume_t)
+        || resume->magic != OTA_DELTA_RESUME_MAGIC || resume->committed == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ota_delta_hash(url, strlen(url), url_hash);
+    if (memcmp(resume->url_hash, url_hash, OTA_DELTA_HASH_LEN) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size != 0 && resume->image_size != image_size) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (resume->committed % OTA_DELTA_BLOCK_SIZE != 0 || resume->committed >= resume->image_size) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    resume->etag[OTA_DELTA_ETAG_LEN - 1] = '\0';
+
+    return ESP_OK;
+}
+
+esp_err_t ota_delta_resume_save(const char *url, uint32_t image_size, uint32_t committed, const char *etag)
+{
+    ota_delta_resume_t resume;
+
+    ESP_RETURN_ON_FALSE(url, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+
+    memset(&resume, 0, sizeof(resume));
+    resume.magic = OTA_DELTA_RESUME_MAGIC;
+    ota_delta_hash(url, strlen(url), resume.url_hash);
+    resume.image_size = image_size;
+    resume.committed = committed;
+    if (etag) {
+        strncpy(resume.etag, etag, sizeof(resume.etag) - 1);
+    }
+
+    return storage_write(OTA_DELTA_RESUME_STORAGE, &resume, sizeof(resume));
+}
+
+esp_err_t ota_delta_resume_clear(void)
+{
+    ota_delta_resume_t resume;
+
+    // storage.h has no key erase, an empty record reads as "nothing to resume"
+    memset(&resume, 0, sizeof(resume));
+
+    return storage_write(OTA_DELTA_RESUME_STORAGE, &resume, sizeof(resume));
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Block map and resume record for himax ai model OTA.
+ *
+ * The block map keeps one truncated sha256 per 4KB flash block of the model
+ * slot, describing what is on the himax flash right now. A new image is hashed
+ * block by block while it streams in, blocks whose hash matches the map are not
+ * sent to himax again. An all-zero hash means "unknown", such a block is always
+ * written.
+ *
+ * The resume record remembers how far an interrupted transfer got, so the next
+ * attempt for the same url can continue with an http Range request.
+ *
+ * Both live in NVS (see storage.h).
+ */
+
+#define OTA_DELTA_BLOCK_SIZE        4096    // himax flash sector, blocks are erased and written as a whole
+#define OTA_DELTA_HASH_LEN          8
+#define OTA_DELTA_MAX_BLOCKS        1024    // 4MB model slot
+#define OTA_DELTA_ETAG_LEN          64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t block_size;
+    uint32_t image_size;    // size of the image the hashes were taken from
+    uint32_t count;         // number of valid entries in hash[]
+    uint8_t hash[OTA_DELTA_MAX_BLOCKS][OTA_DELTA_HASH_LEN];
+} ota_delta_map_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t url_hash[OTA_DELTA_HASH_LEN];
+    uint32_t image_size;
+    uint32_t committed;     // bytes known to be on himax flash, multiple of OTA_DELTA_BLOCK_SIZE
+    char etag[OTA_DELTA_ETAG_LEN];  // validator for If-Range, may be empty
+} ota_delta_resume_t;
+
+/**
+ * hash one block (or the string of a url), never returns the "unknown" all-zero hash
+*/
+void ota_delta_hash(const void *data, size_t len, uint8_t out[OTA_DELTA_HASH_LEN]);
+
+/**
+ * forget all blocks and size the map for an image, fails if the image doesn't fit the slot
+*/
+esp_err_t ota_delta_map_reset(ota_delta_map_t *map, uint32_t image_size);
+
+/**
+ * whether block `index` on flash already holds data with this hash
+*/
+bool ota_delta_map_match(const ota_delta_map_t *map, uint32_t index, const uint8_t hash[OTA_DELTA_HASH_LEN]);
+
+void ota_delta_map_set(ota_delta_map_t *map, uint32_t index, const uint8_t hash[OTA_DELTA_HASH_LEN]);
+
+/**
+ * mark `count` blocks from `index` as unknown
+*/
+void ota_delta_map_forget(ota_delta_map_t *map, uint32_t index, uint32_t count);
+
+/**
+ * Load/save the map. Save persists blocks [dirty_index, dirty_index + dirty_count)
+ * as unknown without touching the in-memory map: these are the blocks that may be
+ * half written when the transfer dies before the next save.
+*/
+esp_err_t ota_delta_map_load(ota_delta_map_t *map);
+esp_err_t ota_delta_map_save(ota_delta_map_t *map, uint32_t dirty_index, uint32_t dirty_count);
+
+/**
+ * forget everything about the model slot, e.g. before something else rewrites it
+*/
+esp_err_t ota_delta_map_clear(void);
+
+/**
+ * Load the resume record for `url` of `image_size` bytes.
+ * ESP_ERR_NOT_FOUND if there is none, or it belongs to another download.
+ * image_size 0 matches any size.
+*/
+esp_err_t ota_delta_resume_load(const char *url, uint32_t image_size, ota_delta_resume_t *resume);
+esp_err_t ota_delta_resume_save(const char *url, uint32_t image_size, uint32_t committed, const char *etag);
+esp_err_t ota_delta_resume_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
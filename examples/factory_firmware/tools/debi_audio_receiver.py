@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Hub-side reference for the Watcher Opus audio chunks.
+
+The Watcher publishes the mic as Opus on debi/watcher/audio/chunk (see
+main/app/debi_audio.h for the layout): each message is a header and a
+few 20 ms packets.  Audio comes in spurts: START marks the first chunk
+of one, which was encoded from a reset encoder, END its last.  seq
+counts every chunk, so a jump inside a spurt is audio lost at QoS 0 and
+is concealed by the decoder; a GAP flag means the Watcher itself lost
+mic samples, and ts_us says how many.
+
+Usage:
+    python3 debi_audio_receiver.py --host 192.168.0.182 --user debi \
+        --password ... --out /tmp/audio
+
+writes one <ts_us>.wav per spurt.  Decoding uses the system libopus
+through ctypes; parse_chunk() needs nothing, the command line also
+needs paho-mqtt.
+"""
+
+import argparse
+import ctypes
+import ctypes.util
+import os
+import struct
+import wave
+
+TOPIC = "debi/watcher/audio/chunk"
+
+MAGIC = b"DA"
+VERSION = 1
+FLAG_START = 0x01
+FLAG_END = 0x02
+FLAG_GAP = 0x04
+FLAG_VOICE = 0x08
+
+HEADER = struct.Struct("<2sBBIQHHBB")   # magic, version, flags, seq, ts_us, rate, frame_samples, frames, snr_db
+
+
+def parse_chunk(payload):
+    """A chunk as a dict with its Opus packets, or None if malformed."""
+    if len(payload) < HEADER.size:
+        return None
+    magic, version, flags, seq, ts_us, rate, frame_samples, frames, snr_db = HEADER.unpack_from(payload)
+    if magic != MAGIC or version != VERSION:
+        return None
+    packets, off = [], HEADER.size
+    for _ in range(frames):
+        if off + 2 > len(payload):
+            return None
+        (n,) = struct.unpack_from("<H", payload, off)
+        if off + 2 + n > len(payload):
+            return None
+        packets.append(bytes(payload[off + 2:off + 2 + n]))
+        off += 2 + n
+    return {"flags": flags, "seq": seq, "ts_us": ts_us, "rate": rate,
+            "frame_samples": frame_samples, "snr_db": snr_db, "packets": packets}
+
+
+class OpusDecoder:
+    """Mono libopus decoder through ctypes."""
+
+    def __init__(self, rate, lib=None):
+        self.lib = ctypes.CDLL(lib or ctypes.util.find_library("opus") or "libopus.so.0")
+        self.lib.opus_decoder_create.restype = ctypes.c_void_p
+        self.lib.opus_decoder_create.argtypes = [ctypes.c_int32, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+        self.lib.opus_decode.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int32,
+                                         ctypes.POINTER(ctypes.c_int16), ctypes.c_int, ctypes.c_int]
+        self.lib.opus_decoder_destroy.argtypes = [ctypes.c_void_p]
+        err = ctypes.c_int()
+        self.st = self.lib.opus_decoder_create(rate, 1, ctypes.byref(err))
+        if not self.st or err.value != 0:
+            raise RuntimeError("opus_decoder_create failed: %d" % err.value)
+
+    def decode(self, packet, frame_samples):
+        """PCM bytes for one packet; None conceals a lost one."""
+        pcm = (ctypes.c_int16 * frame_samples)()
+        n = self.lib.opus_decode(self.st, packet, len(packet) if packet else 0, pcm, frame_samples, 0)
+        if n < 0:
+            raise RuntimeError("opus_decode failed: %d" % n)
+        return bytes(pcm)[:n * 2]
+
+    def __del__(self):
+        if getattr(self, "st", None):
+            self.lib.opus_decoder_destroy(self.st)
+
+
+class AudioReceiver:
+    """
+    Feed every payload received on TOPIC to feed(); it returns the
+    decoded chunk as a dict, {"ts_us", "rate", "pcm", "start", "end",
+    "gap", "lost", "voice", "snr_db"}, or None.  pcm is 16-bit mono and
+    starts with concealment for "lost" chunks lost on the way.
+    """
+
+    def __init__(self, lib=None):
+        self.lib = lib
+        self.decoder = None
+        self.last_seq = None
+        self.last_frames = 0
+        self.stats = {"chunks": 0, "lost": 0, "spurts": 0, "gaps": 0, "malformed": 0}
+
+    def feed(self, payload):
+        c = parse_chunk(payload)
+        if c is None:
+            self.stats["malformed"] += 1
+            return None
+
+        lost = 0
+        if self.last_seq is not None:
+            lost = (c["seq"] - self.last_seq - 1) & 0xFFFFFFFF
+        self.last_seq = c["seq"]
+        self.stats["chunks"] += 1
+        self.stats["lost"] += lost
+
+        pcm = b""
+        if c["flags"] & FLAG_START or self.decoder is None:
+            self.decoder = OpusDecoder(c["rate"], self.lib)
+            self.stats["spurts"] += 1
+            lost = 0    # nothing to conceal into: a new spurt starts clean
+        else:
+            for _ in range(lost * self.last_frames):
+                pcm += self.decoder.decode(None, c["frame_samples"])
+        if c["flags"] & FLAG_GAP:
+            self.stats["gaps"] += 1
+        for packet in c["packets"]:
+            pcm += self.decoder.decode(packet, c["frame_samples"])
+        self.last_frames = len(c["packets"])
+
+        return {"ts_us": c["ts_us"], "rate": c["rate"], "pcm": pcm,
+                "start": bool(c["flags"] & FLAG_START), "end": bool(c["flags"] & FLAG_END),
+                "gap": bool(c["flags"] & FLAG_GAP), "voice": bool(c["flags"] & FLAG_VOICE),
+                "lost": lost, "snr_db": c["snr_db"]}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--user")
+    ap.add_argument("--password")
+    ap.add_argument("--out", help="directory to write <ts_us>.wav per spurt into")
+    ap.add_argument("--libopus", help="path to libopus if it is not on the library path")
+    args = ap.parse_args()
+
+    import paho.mqtt.client as mqtt
+
+    receiver = AudioReceiver(args.libopus)
+    spurt = {"wav": None}
+    if args.out:
+        os.makedirs(args.out, exist_ok=True)
+
+    def close_spurt():
+        if spurt["wav"]:
+            spurt["wav"].close()
+            spurt["wav"] = None
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(TOPIC, qos=0)
+
+    def on_message(client, userdata, msg):
+        chunk = receiver.feed(msg.payload)
+        if chunk is None:
+            return
+        if chunk["start"]:
+            close_spurt()
+            print("spurt at ts_us %d" % chunk["ts_us"], receiver.stats)
+            if args.out:
+                w = wave.open(os.path.join(args.out, "%d.wav" % chunk["ts_us"]), "wb")
+                w.setnchannels(1)
+                w.setsampwidth(2)
+                w.setframerate(chunk["rate"])
+                spurt["wav"] = w
+        if spurt["wav"]:
+            spurt["wav"].writeframes(chunk["pcm"])
+        if chunk["end"]:
+            close_spurt()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()
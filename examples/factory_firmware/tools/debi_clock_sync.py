@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Hub-side reference for the Watcher media clock.
+
+Camera frames (debi/watcher/camera/bin), their boxes
+(debi/watcher/detection/bin) and audio chunks carry ts_us, the Watcher's
+esp_timer time in microseconds.  To line them up with the hub's own clock
+the hub answers the Watcher's periodic ping on debi/watcher/status,
+
+    {"ping":true,"t0":<ts_us>}
+
+with a pong on debi/watcher/cmd that echoes t0 and adds its clock,
+
+    {"pong":true,"t0":<t0>,"hub_us":<hub monotonic us>}
+
+The Watcher fits offset and skew from the pongs (see
+main/app/debi_clock.h) and publishes the result on debi/watcher/clock;
+ClockMap turns any Watcher ts_us into hub time with it.
+
+Usage:
+    python3 debi_clock_sync.py --host 192.168.0.182 --user debi \
+        --password ...
+
+Needs paho-mqtt only for the command line; pong() and ClockMap have no
+dependencies.
+"""
+
+import argparse
+import json
+import time
+
+PING_TOPIC = "debi/watcher/status"
+PONG_TOPIC = "debi/watcher/cmd"
+CLOCK_TOPIC = "debi/watcher/clock"
+
+
+def hub_us():
+    """The hub clock the Watcher is mapped to: monotonic microseconds."""
+    return time.monotonic_ns() // 1000
+
+
+def pong(payload):
+    """
+    Return the pong payload (bytes) for a message on the ping topic, or
+    None if it is not a ping.  Answer as soon as possible: the Watcher
+    takes hub_us to be half way through the round trip.
+    """
+    now = hub_us()
+    try:
+        msg = json.loads(payload)
+    except ValueError:
+        return None
+    if not isinstance(msg, dict) or msg.get("ping") is not True:
+        return None
+    reply = {"pong": True, "hub_us": now}
+    if "t0" in msg:
+        reply["t0"] = msg["t0"]
+    return json.dumps(reply, separators=(",", ":")).encode()
+
+
+class ClockMap:
+    """Latest Watcher -> hub mapping from debi/watcher/clock."""
+
+    def __init__(self):
+        self.ts_us = None
+        self.offset_us = 0
+        self.skew_ppm = 0.0
+        self.err_us = None
+
+    def update(self, payload):
+        """Take a debi/watcher/clock message; False if it is malformed."""
+        try:
+            msg = json.loads(payload)
+            ts, offset = int(msg["ts"]), int(msg["offset_us"])
+            skew, err = float(msg.get("skew_ppm", 0.0)), int(msg.get("err_us", 0))
+        except (ValueError, KeyError, TypeError):
+            return False
+        self.ts_us, self.offset_us, self.skew_ppm, self.err_us = ts, offset, skew, err
+        return True
+
+    def to_hub(self, ts_us):
+        """Hub time of a Watcher ts_us, or None before the first mapping."""
+        if self.ts_us is None:
+            return None
+        return ts_us + self.offset_us + round(self.skew_ppm * (ts_us - self.ts_us) / 1e6)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--user")
+    ap.add_argument("--password")
+    args = ap.parse_args()
+
+    import paho.mqtt.client as mqtt
+
+    clock = ClockMap()
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe([(PING_TOPIC, 0), (CLOCK_TOPIC, 0)])
+
+    def on_message(client, userdata, msg):
+        if msg.topic == PING_TOPIC:
+            reply = pong(msg.payload)
+            if reply is not None:
+                client.publish(PONG_TOPIC, reply, qos=0)
+        elif msg.topic == CLOCK_TOPIC and clock.update(msg.payload):
+            print("offset %+.3f ms  skew %+.2f ppm  +-%.1f ms  now -> hub %d" % (
+                clock.offset_us / 1e3, clock.skew_ppm, clock.err_us / 1e3, clock.to_hub(clock.ts_us)))
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()
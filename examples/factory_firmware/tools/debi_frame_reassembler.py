@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""
+Hub-side reference for the Watcher binary camera frames.
+
+The Watcher publishes each JPEG as one header message followed by
+fixed-size chunks on debi/watcher/camera/bin (see main/app/debi_camera.h
+for the layout).  QoS 0 means chunks can be lost and, across a broker
+restart, arrive after a newer frame has started, so frames are collected
+by frame id, kept for a short while and dropped if they do not complete.
+
+Usage:
+    python3 debi_frame_reassembler.py --host 192.168.0.182 --user debi \
+        --password ... --out /tmp/frames
+
+Needs paho-mqtt only for the command line; FrameReassembler itself has no
+dependencies.
+"""
+
+import argparse
+import os
+import struct
+import time
+import zlib
+
+TOPIC = "debi/watcher/camera/bin"
+
+MAGIC = b"DF"
+VERSION = 1
+MSG_HEADER = 1
+MSG_CHUNK = 2
+
+PREFIX = struct.Struct("<2sBBI")                  # magic, version, type, frame_id
+HEADER = struct.Struct("<2sBBIQIHHIHHIH")         # + ts_us, time, w, h, size, chunk_size, chunk_num, crc, dropped
+CHUNK = struct.Struct("<2sBBIHH")                 # + seq, chunk_num
+
+
+class Frame:
+    def __init__(self, frame_id):
+        self.frame_id = frame_id
+        self.header = None
+        self.chunks = {}
+        self.chunk_num = None
+        self.first_seen = time.monotonic()
+
+    def complete(self):
+        return self.header is not None and len(self.chunks) == self.chunk_num
+
+
+class FrameReassembler:
+    """
+    Feed every payload received on TOPIC to feed(); it returns a dict for
+    each frame that completed with a matching crc:
+
+        {"frame_id", "ts_us", "time", "width", "height", "dropped", "jpeg"}
+    """
+
+    def __init__(self, timeout_s=2.0, max_pending=4):
+        self.timeout_s = timeout_s
+        self.max_pending = max_pending
+        self.pending = {}
+        self.stats = {"frames": 0, "bad_crc": 0, "incomplete": 0, "malformed": 0, "dropped": 0}
+
+    def feed(self, payload, now=None):
+        now = time.monotonic() if now is None else now
+        self._expire(now)
+
+        if len(payload) < PREFIX.size:
+            self.stats["malformed"] += 1
+            return None
+        magic, version, mtype, frame_id = PREFIX.unpack_from(payload)
+        if magic != MAGIC or version != VERSION:
+            self.stats["malformed"] += 1
+            return None
+
+        frame = self.pending.get(frame_id)
+        if frame is None:
+            if len(self.pending) >= self.max_pending:
+                oldest = min(self.pending.values(), key=lambda f: f.first_seen)
+                self._give_up(oldest)
+            frame = self.pending[frame_id] = Frame(frame_id)
+
+        if mtype == MSG_HEADER and len(payload) >= HEADER.size:
+            (_, _, _, _, ts_us, wall, width, height, size,
+             chunk_size, chunk_num, crc, dropped) = HEADER.unpack_from(payload)
+            frame.header = dict(ts_us=ts_us, time=wall, width=width, height=height,
+                                size=size, chunk_size=chunk_size, crc=crc, dropped=dropped)
+            frame.chunk_num = chunk_num
+        elif mtype == MSG_CHUNK and len(payload) >= CHUNK.size:
+            _, _, _, _, seq, chunk_num = CHUNK.unpack_from(payload)
+            frame.chunk_num = chunk_num
+            frame.chunks[seq] = payload[CHUNK.size:]
+        else:
+            self.stats["malformed"] += 1
+            return None
+
+        if not frame.complete():
+            return None
+        del self.pending[frame_id]
+
+        h = frame.header
+        jpeg = b"".join(frame.chunks[i] for i in range(frame.chunk_num))
+        if len(jpeg) != h["size"] or zlib.crc32(jpeg) != h["crc"]:
+            self.stats["bad_crc"] += 1
+            return None
+
+        self.stats["frames"] += 1
+        self.stats["dropped"] += h["dropped"]
+        return {"frame_id": frame_id, "ts_us": h["ts_us"], "time": h["time"],
+                "width": h["width"], "height": h["height"], "dropped": h["dropped"],
+                "jpeg": jpeg}
+
+    def _expire(self, now):
+        for frame in [f for f in self.pending.values() if now - f.first_seen > self.timeout_s]:
+            self._give_up(frame)
+
+    def _give_up(self, frame):
+        del self.pending[frame.frame_id]
+        self.stats["incomplete"] += 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--user")
+    ap.add_argument("--password")
+    ap.add_argument("--out", help="directory to write <frame_id>.jpg into")
+    args = ap.parse_args()
+
+    import paho.mqtt.client as mqtt
+
+    reassembler = FrameReassembler()
+    if args.out:
+        os.makedirs(args.out, exist_ok=True)
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(TOPIC, qos=0)
+
+    def on_message(client, userdata, msg):
+        frame = reassembler.feed(msg.payload)
+        if frame is None:
+            return
+        print("frame %(frame_id)d %(width)dx%(height)d dropped=%(dropped)d" % frame,
+              len(frame["jpeg"]), "bytes", reassembler.stats)
+        if args.out:
+            with open(os.path.join(args.out, "%d.jpg" % frame["frame_id"]), "wb") as f:
+                f.write(frame["jpeg"])
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()
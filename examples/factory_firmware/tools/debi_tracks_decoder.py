@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Hub-side reference for the Watcher detection track messages.
+
+Each message on debi/watcher/detection/bin carries every box the AI camera
+saw in one frame, with the ByteTrack id of the person or object it belongs
+to (see main/app/debi_tracks.h for the layout).  frame_id and ts_us are the
+same as in the camera frame header, so boxes can be drawn on the JPEG that
+debi_frame_reassembler.py rebuilds for that frame.
+
+Usage:
+    python3 debi_tracks_decoder.py --host 192.168.0.182 --user debi \
+        --password ...
+
+Needs paho-mqtt only for the command line; decode() has no dependencies.
+"""
+
+import argparse
+import struct
+
+TOPIC = "debi/watcher/detection/bin"
+
+MAGIC = b"DT"
+VERSION = 1
+
+HEADER = struct.Struct("<2sBBIQ")                 # magic, version, count, frame_id, ts_us
+BOX = struct.Struct("<HHHHBBH")                   # x, y, w, h, score, target, track_id
+
+
+def decode(payload):
+    """
+    Return {"frame_id", "ts_us", "boxes": [...]} for a track message, or
+    None if it is malformed.  Each box is a dict with x, y (centre), w, h,
+    score, target and track_id (0 = not tracked).
+    """
+    if len(payload) < HEADER.size:
+        return None
+    magic, version, count, frame_id, ts_us = HEADER.unpack_from(payload)
+    if magic != MAGIC or version != VERSION or len(payload) != HEADER.size + count * BOX.size:
+        return None
+
+    boxes = []
+    for i in range(count):
+        x, y, w, h, score, target, track_id = BOX.unpack_from(payload, HEADER.size + i * BOX.size)
+        boxes.append(dict(x=x, y=y, w=w, h=h, score=score, target=target, track_id=track_id))
+    return {"frame_id": frame_id, "ts_us": ts_us, "boxes": boxes}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--user")
+    ap.add_argument("--password")
+    args = ap.parse_args()
+
+    import paho.mqtt.client as mqtt
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(TOPIC, qos=0)
+
+    def on_message(client, userdata, msg):
+        frame = decode(msg.payload)
+        if frame is None:
+            print("malformed", len(msg.payload), "bytes")
+            return
+        boxes = " ".join("#%(track_id)d:%(target)d@%(x)d,%(y)d %(w)dx%(h)d s%(score)d" % b
+                         for b in frame["boxes"]) or "(empty)"
+        print("frame %d t=%.3f" % (frame["frame_id"], frame["ts_us"] / 1e6), boxes)
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()
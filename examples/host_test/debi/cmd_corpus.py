@@ -0,0 +1,371 @@
+#!/usr/bin/env python3
+"""
+Command corpus of test_debi_comms_cmd: hub commands, well-formed and
+fuzzed, with what the dispatcher of debi_comms must do with each.
+
+A reference model of the dispatcher (the command table, argument
+checks, the cmd_id LRU and the token buckets) gives the expected
+outcome of every message.  The corpus is plain text:
+
+    # comment
+    t <us>              esp_timer time of the messages that follow
+    > <message>         a message on debi/watcher/cmd
+    < E <effect>        a call the command makes, as the test's fakes print it
+    < P pong|health     a reply that is not an ack
+    < {"ack":...}       an ack, "ts" left out
+
+Usage:
+    python3 cmd_corpus.py --seed 1 --fuzz 1000 > cmd_corpus.txt
+
+Keep the table below in step with CMD_TABLE in app/debi_comms.c.
+"""
+
+import argparse
+import json
+import random
+import struct
+
+CMD_IDS = 32            # DEBI_COMMS_CMD_IDS
+DETAIL_MAX = 32         # CMD_DETAIL_MAX
+DUR_MAX = 7 * 24 * 3600
+T_INIT = 1000000        # the test starts debi_comms at this time
+
+
+def arg(name, typ, req=False, names=None, lo=0, hi=0):
+    return (name, typ, req, names, lo, hi)
+
+
+# name: (args, read only, burst, refill_ms)
+TABLE = {
+    "audio": ([arg("mode", "enum", False, ["vad", "on", "off"]), arg("duration_s", "num", lo=0, hi=DUR_MAX),
+               arg("bitrate", "num", lo=0, hi=1000000), arg("complexity", "num", lo=0, hi=10)], False, 5, 1000),
+    "get_health": ([], True, 5, 1000),
+    "mute": ([arg("value", "bool")], False, 10, 200),
+    "ping": ([], True, 10, 500),
+    "play_sound": ([arg("file", "str", True)], False, 5, 1000),
+    "reboot": ([], False, 1, 60000),
+    "report_sensors": ([], True, 5, 1000),
+    "set_mode": ([arg("mode", "enum", True, ["active", "night", "alert", "setup"])], False, 5, 500),
+    "set_volume": ([arg("value", "num", True, lo=0, hi=100)], False, 10, 200),
+    "stop_sound": ([], False, 10, 200),
+    "stream": ([arg("mode", "enum", False, ["auto", "fixed", "off"]), arg("fps", "num", lo=0, hi=1000),
+                arg("duration_s", "num", lo=0, hi=DUR_MAX)], False, 5, 1000),
+}
+MODE_VALUES = [2, 3, 4, 5]   # DEBI_MODE_ACTIVE .. DEBI_MODE_SETUP
+
+
+def f32(x):
+    return struct.unpack("f", struct.pack("f", x))[0]
+
+
+def num(v):
+    if isinstance(v, bool) or not isinstance(v, (int, float)):
+        return None
+    try:
+        return float(v)
+    except OverflowError:
+        return float("inf") if v > 0 else float("-inf")
+
+
+def cstr(s):
+    """What C sees of a string with a NUL in it"""
+    return s.split("\0")[0]
+
+
+def get_item(pairs, key):
+    """cJSON_GetObjectItem: the first key that matches, ignoring case"""
+    for k, v in pairs:
+        if k.lower() == key:
+            return (v,)
+    return None
+
+
+class Model:
+    def __init__(self):
+        self.seen = [None] * CMD_IDS      # [id, used_us, replied, ok, detail]
+        self.bucket = {n: [TABLE[n][2], T_INIT] for n in TABLE}
+
+    def take(self, name, now):
+        burst, refill_ms = TABLE[name][2:]
+        b = self.bucket[name]
+        step = refill_ms * 1000
+        add = (now - b[1]) // step
+        if add > 0:
+            b[0] = burst if add >= burst - b[0] else b[0] + add
+            b[1] += add * step
+        if b[0] == burst:
+            b[1] = now
+        if b[0] == 0:
+            return False
+        b[0] -= 1
+        return True
+
+    def run(self, line, now):
+        """The outcome of one message: a list of expectation lines"""
+        out = []
+        try:
+            root = json.loads(line, object_pairs_hook=lambda p: p,
+                              parse_constant=lambda c: (_ for _ in ()).throw(ValueError(c)))
+        except (ValueError, RecursionError):
+            return out
+        if not isinstance(root, list) or (root and not isinstance(root[0], tuple)):
+            return out   # not an object
+        pong = get_item(root, "pong")
+        if pong and pong[0] is True:
+            return out
+        idv = get_item(root, "cmd_id")
+        cid = cstr(idv[0]) if idv and isinstance(idv[0], str) else None
+
+        def ack(status, detail, dup=False):
+            a = {"ack": status, "cmd_id": cid, "detail": detail}
+            if dup:
+                a["dup"] = True
+            out.append(json.dumps(a, ensure_ascii=False))
+
+        cmdv = get_item(root, "cmd")
+        if not cmdv or not isinstance(cmdv[0], str):
+            if cid is not None:
+                ack("error", "missing cmd field")
+            return out
+        name = cstr(cmdv[0])
+        if name not in TABLE:
+            if cid is not None:
+                ack("error", "unknown command")
+            return out
+        args, read_only = TABLE[name][:2]
+        once = cid is not None and not read_only
+        if once:
+            for s in self.seen:
+                if s and s[0] == cid:
+                    s[1] = now
+                    if s[2]:
+                        ack("ok" if s[3] else "error", s[4], True)
+                    return out
+
+        # the first key of each argument, case counts
+        val = [None] * len(args)
+        for k, v in root:
+            for i, a in enumerate(args):
+                if val[i] is None and k == a[0]:
+                    val[i] = (v,)
+                    break
+        choice = [0] * len(args)
+        for i, (an, typ, req, names, lo, hi) in enumerate(args):
+            if val[i] is None:
+                if req:
+                    if cid is not None:
+                        ack("error", "missing " + an)
+                    return out
+                continue
+            v = val[i][0]
+            if typ == "num":
+                x = num(v)
+                ok = x is not None and lo <= x <= hi
+            elif typ == "bool":
+                ok = isinstance(v, bool)
+            else:
+                ok = isinstance(v, str)
+            if ok and typ == "enum":
+                if cstr(v) not in names:
+                    if cid is not None:
+                        ack("error", "unknown " + an)
+                    return out
+                choice[i] = names.index(cstr(v))
+            if not ok:
+                if cid is not None:
+                    ack("error", "bad " + an)
+                return out
+        if not self.take(name, now):
+            if cid is not None:
+                ack("error", "rate limited")
+            return out
+        slot = None
+        if once:
+            used = [s[1] if s else 0 for s in self.seen]
+            slot = used.index(min(used))
+            self.seen[slot] = [cid, now, False, False, ""]
+
+        def reply(status, detail):
+            if slot is not None:
+                self.seen[slot][2:] = [True, status == "ok", detail.encode()[:DETAIL_MAX - 1].decode(errors="ignore")]
+            if cid is not None:
+                ack(status, detail)
+
+        def g(i):
+            return val[i][0] if val[i] is not None else None
+
+        def effect(s):
+            out.append("E " + s)
+
+        if name == "audio":
+            if val[2] or val[3]:
+                effect("encoder %d %d" % (int(num(g(2))) if val[2] else 0, int(num(g(3))) if val[3] else -1))
+            if val[0]:
+                effect("audio %d %d" % (choice[0], int(num(g(1))) if val[1] else 0))
+            reply("ok", cstr(g(0)) if val[0] else "encoder set")
+        elif name == "get_health":
+            out.append("P health")
+        elif name == "mute":
+            m = g(0) if val[0] else True
+            effect("mute %d" % m)
+            reply("ok", "muted" if m else "unmuted")
+        elif name == "ping":
+            out.append("P pong")
+        elif name == "play_sound":
+            effect("play %s" % cstr(g(0)))
+            reply("ok", "playing")
+        elif name == "reboot":
+            reply("ok", "rebooting")
+            effect("reboot")
+        elif name == "report_sensors":
+            effect("report")
+            reply("ok", "reported")
+        elif name == "set_mode":
+            effect("set_mode %d" % MODE_VALUES[choice[0]])
+            reply("ok", cstr(g(0)))
+        elif name == "set_volume":
+            effect("volume %d" % int(num(g(0))))
+            reply("ok", "volume set")
+        elif name == "stop_sound":
+            effect("stop")
+            reply("ok", "stopped")
+        elif name == "stream":
+            mode = choice[0] if val[0] else 1
+            if mode == 1 and not val[1]:
+                reply("error", "missing fps")
+                return out
+            effect("stream %d %s %d" % (mode, "%g" % f32(num(g(1)) if val[1] else 0.0),
+                                        int(num(g(2))) if val[2] else 0))
+            reply("ok", cstr(g(0)) if val[0] else "fixed")
+        return out
+
+
+KEYS = ["cmd", "cmd_id", "mode", "value", "file", "fps", "duration_s", "bitrate", "complexity",
+        "CMD", "Cmd_Id", "pong", "x", "", "mode ", "valu"]
+NAMES = list(TABLE) + ["", "Audio", "stream2", "strea", "zzz", "a", "reboot\u0000x", "set_mode ", "pin"]
+STRS = ["active", "night", "alert", "setup", "auto", "fixed", "off", "vad", "on", "", "ON",
+        "a" * 200, "é☃", "\u0001", "sounds/cry.wav", "x\u0000y"]
+
+
+def well_formed():
+    """Every command and argument once, unique ids, spaced out"""
+    msgs = []
+
+    def add(d, with_id=True):
+        if with_id:
+            d["cmd_id"] = "v%d" % (len(msgs) + 1)
+        msgs.append(json.dumps(d))
+
+    for m in ["active", "night", "alert", "setup"]:
+        add({"cmd": "set_mode", "mode": m})
+        add({"cmd": "set_mode", "mode": m}, False)
+    for v in [True, False]:
+        add({"cmd": "mute", "value": v})
+    add({"cmd": "mute"})
+    for v in [0, 37, 100, 55.9]:
+        add({"cmd": "set_volume", "value": v})
+    add({"cmd": "play_sound", "file": "sounds/lullaby.mp3"})
+    for c in ["stop_sound", "report_sensors", "get_health", "ping", "reboot", "nope"]:
+        add({"cmd": c})
+        add({"cmd": c}, False)
+    for m, f, d in [("auto", None, None), ("fixed", 5, 60), ("off", None, 10), (None, 2.5, None),
+                    ("fixed", None, None), ("bogus", None, None)]:
+        x = {"cmd": "stream"}
+        if m:
+            x["mode"] = m
+        if f is not None:
+            x["fps"] = f
+        if d is not None:
+            x["duration_s"] = d
+        add(x)
+    for x in [{"mode": "on", "duration_s": 600}, {"mode": "vad"}, {"mode": "off"}, {"bitrate": 16000},
+              {"complexity": 5}, {"bitrate": 32000, "complexity": 0, "mode": "on"}, {"mode": "loud"}]:
+        add({"cmd": "audio", **x})
+    add({"cmd_id": "nocmd"}, False)
+    add({"cmd": 5})
+    return [(100000000 * (i + 1), m) for i, m in enumerate(msgs)]
+
+
+class Fuzz:
+    def __init__(self, seed):
+        self.rng = random.Random(seed)
+
+    def value(self):
+        rng, k = self.rng, self.rng.random()
+        if k < 0.25:
+            return rng.choice(STRS)
+        if k < 0.5:
+            return rng.choice([0, 1, -1, 5, 10, 11, 24000, 100, 101, 0.5, 1e9, -1e300, 1e300, 10 ** 30, 2 ** 31,
+                               604800, 604801, 99.99])
+        if k < 0.65:
+            return rng.choice([True, False, None])
+        if k < 0.75:
+            return [self.value() for _ in range(rng.randint(0, 3))]
+        if k < 0.85:
+            return {rng.choice(KEYS): self.value()}
+        return rng.uniform(-2000, 2000)
+
+    def message(self, ids):
+        rng, pairs = self.rng, []
+        if rng.random() < 0.93:
+            pairs.append(("cmd", rng.choice(NAMES) if rng.random() < 0.9 else self.value()))
+        if rng.random() < 0.8:
+            pairs.append(("cmd_id", rng.choice(ids) if rng.random() < 0.9 else self.value()))
+        name = pairs[0][1] if pairs and isinstance(pairs[0][1], str) else None
+        args = TABLE.get(name, ([],))[0]
+        for _ in range(rng.randint(0, 5)):
+            if args and rng.random() < 0.6:
+                a = rng.choice(args)
+                k = a[0]
+                if rng.random() < 0.6:
+                    v = rng.choice(a[3]) if a[1] == "enum" else \
+                        rng.uniform(a[4], a[5]) if a[1] == "num" else \
+                        rng.random() < 0.5 if a[1] == "bool" else rng.choice(STRS)
+                else:
+                    v = self.value()
+            else:
+                k, v = rng.choice(KEYS), self.value()
+            pairs.insert(rng.randint(0, len(pairs)), (k, v))
+        body = "{" + ",".join(json.dumps(k, ensure_ascii=False) + ":" + json.dumps(v, ensure_ascii=False)
+                              for k, v in pairs) + "}"
+        r = rng.random()
+        if r < 0.03:
+            body = body[:rng.randint(0, len(body))]                      # truncated
+        elif r < 0.05:
+            body = json.dumps([dict(pairs)], ensure_ascii=False)          # not an object
+        elif r < 0.06:
+            body = "  " + body + "\t"
+        return body
+
+    def run(self, n, now):
+        """n messages from 48 ids, bursts and pauses; retries and rate limits are common"""
+        ids = ["id%d" % i for i in range(48)] + ["", "x" * 300]
+        out = []
+        for _ in range(n):
+            now += self.rng.choice([0, 0, 1000, 50000, 200000, 1000000, 60000000])
+            out.append((now, self.message(ids)))
+        return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--fuzz", type=int, default=1000, help="fuzzed messages after the well-formed ones")
+    args = ap.parse_args()
+
+    msgs = well_formed()
+    msgs += Fuzz(args.seed).run(args.fuzz, msgs[-1][0])
+    model = Model()
+    print("# generated by cmd_corpus.py --seed %d --fuzz %d" % (args.seed, args.fuzz))
+    t = None
+    for now, line in msgs:
+        if now != t:
+            print("t %d" % now)
+            t = now
+        print("> " + line)
+        for e in model.run(line, now):
+            print("< " + e)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,521 @@
+/*
+ * Opus audio uplink of debi_os (app/debi_audio.c): the VAD gate, chunking and the encoder on
+ * a made-up nursery recording, with Opus built from the esp-libopus submodule as on the device.
+ *
+ * The test stands in for the audio task: it feeds the recording in stamped blocks the way the
+ * recorder hands them out, on the esp_timer clock, and decodes the chunks the MQTT client was
+ * given. The recording is a minute of room noise and breathing with two cries, a knock and a
+ * fan that comes on half way.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// no audio task, the test feeds the frames itself
+#define FAKE_TASK ((TaskHandle_t)1)
+static int s_notified;
+static TaskHandle_t fake_task_create(StackType_t *stack, StaticTask_t *tcb)
+{
+    free(stack);
+    free(tcb);
+    return FAKE_TASK;
+}
+#undef xTaskNotifyGive
+#define xTaskNotifyGive(task) ((void)(task), s_notified++)
+#define xTaskCreateStaticPinnedToCore(code, name, depth, param, prio, stack, tcb, core) fake_task_create(stack, tcb)
+
+#include "debi_audio.c"
+
+#define RATE        16000
+#define SCENE_S     60
+#define BLOCK       8000                // recorder chunk, half a second
+#define T0          5000000LL           // esp_timer time of the first sample
+#define CHUNKS_MAX  1024
+#define SPURTS_MAX  8
+
+#define KNOCK_S     18.0
+#define FAN_S       25.0
+
+typedef struct
+{
+    double from_s;
+    double to_s;
+} span_t;
+
+static const span_t CRIES[] = { { 8.0, 12.0 }, { 40.0, 41.5 } };
+
+typedef struct
+{
+    uint8_t flags;
+    uint32_t seq;
+    int64_t ts_us;
+    int frames;
+    const uint8_t *packets;
+    int len;
+} chunk_t;
+
+static int16_t *s_scene;
+static uint8_t *s_msg[CHUNKS_MAX];
+static int s_msg_len[CHUNKS_MAX];
+static int s_n_msg;
+static bool s_connected;
+static uint64_t s_rng;
+
+/*************************************************************************
+ * What debi_audio links against
+ ************************************************************************/
+bool debi_os_hub_connected(void)
+{
+    return s_connected;
+}
+
+void *debi_os_get_mqtt_handle(void)
+{
+    return (void *)1;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    TEST_ASSERT_EQUAL_STRING(DEBI_TOPIC_AUDIO_CHUNK, topic);
+    TEST_ASSERT_EQUAL_INT(0, qos);
+    TEST_ASSERT_LESS_THAN_INT(CHUNKS_MAX, s_n_msg);
+    s_msg[s_n_msg] = malloc(len);
+    memcpy(s_msg[s_n_msg], data, len);
+    s_msg_len[s_n_msg++] = len;
+    return s_n_msg;
+}
+
+int app_audio_player_status_get(void)
+{
+    return AUDIO_PLAYER_STATUS_IDLE;
+}
+
+esp_err_t app_audio_recorder_stream_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t app_audio_recorder_stream_stop(void)
+{
+    return ESP_OK;
+}
+
+uint8_t *app_audio_recorder_stream_recv_stamped(size_t *p_recv_len, TickType_t xTicksToWait,
+                                                struct app_audio_recorder_stamp *p_stamp)
+{
+    return NULL;
+}
+
+esp_err_t app_audio_recorder_stream_free(uint8_t *p_data)
+{
+    return ESP_OK;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static double urand(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return ((s_rng >> 11) + 1.0) * (1.0 / 9007199254740994.0);
+}
+
+static double gauss(void)
+{
+    return sqrt(-2.0 * log(urand())) * cos(2.0 * M_PI * urand());
+}
+
+static double dbfs(double db)
+{
+    return 32768.0 * pow(10.0, db / 20.0);
+}
+
+// a cry is 0.8 s of a wavering 450 Hz voice with harmonics, then 0.3 s to breathe in
+static int16_t *make_scene(void)
+{
+    int n = SCENE_S * RATE;
+    int16_t *x = malloc(n * sizeof(int16_t));
+    double breath = 0, phase = 0;
+
+    s_rng = 0x9E3779B97F4A7C15ull;
+
+    for (int i = 0; i < n; i++)
+    {
+        double t = (double)i / RATE;
+        double s = dbfs(-65) * gauss();
+        breath += 0.05 * (gauss() - breath);
+        s += dbfs(-58) * 4.0 * breath * pow(fabs(sin(M_PI * 0.5 * t)), 2);
+        if (t >= FAN_S)
+        {
+            s += dbfs(-45) * gauss();
+        }
+        if (t >= KNOCK_S && t < KNOCK_S + 0.04)
+        {
+            s += dbfs(-15) * gauss() * exp(-(t - KNOCK_S) * 60);
+        }
+        for (size_t c = 0; c < sizeof(CRIES) / sizeof(CRIES[0]); c++)
+        {
+            double u = fmod(t - CRIES[c].from_s, 1.1);
+            if (t < CRIES[c].from_s || t >= CRIES[c].to_s || u > 0.8)
+            {
+                continue;
+            }
+            phase += 2 * M_PI * (450 + 30 * sin(2 * M_PI * 5 * t)) / RATE;
+            double v = 0;
+            for (int h = 1; h <= 6; h++)
+            {
+                v += sin(h * phase) / h;
+            }
+            s += dbfs(-20) * sin(M_PI * u / 0.8) * v;
+        }
+        x[i] = s > 32767 ? 32767 : s < -32768 ? -32768 : (int16_t)s;
+    }
+    return x;
+}
+
+static const int16_t *scene(double from_s)
+{
+    if (!s_scene)
+    {
+        s_scene = make_scene();
+    }
+    return s_scene + (int)(from_s * RATE);
+}
+
+// samples in blocks stamped as the recorder does, the first after a gap; the clock ends each block
+static void feed(const int16_t *x, int n, int block, int64_t t0_us, bool gap)
+{
+    for (int i = 0; i < n; i += block)
+    {
+        int m = n - i < block ? n - i : block;
+        struct app_audio_recorder_stamp stamp = {
+            .ts_us = t0_us + (int64_t)i * 1000000 / RATE,
+            .sample = i,
+            .rate = RATE,
+            .gap = i == 0 && gap,
+        };
+        host_time_set(stamp.ts_us + (int64_t)m * 1000000 / RATE);
+        audio_feed(x + i, m, &stamp);
+    }
+}
+
+static chunk_t chunk(int k)
+{
+    const uint8_t *p = s_msg[k];
+    chunk_t c = {
+        .flags = p[3],
+        .seq = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24,
+        .frames = p[20],
+        .packets = p + DEBI_AUDIO_HDR_LEN,
+        .len = s_msg_len[k] - DEBI_AUDIO_HDR_LEN,
+    };
+    for (int i = 7; i >= 0; i--)
+    {
+        c.ts_us = c.ts_us << 8 | p[8 + i];
+    }
+    TEST_ASSERT_EQUAL_UINT8('D', p[0]);
+    TEST_ASSERT_EQUAL_UINT8('A', p[1]);
+    TEST_ASSERT_EQUAL_UINT8(DEBI_AUDIO_PROTO_VERSION, p[2]);
+    TEST_ASSERT_EQUAL_UINT16(RATE, p[16] | p[17] << 8);
+    TEST_ASSERT_EQUAL_UINT16(FRAME_SAMPLES, p[18] | p[19] << 8);
+    return c;
+}
+
+static double seconds(int64_t ts_us)
+{
+    return (ts_us - T0) / 1e6;
+}
+
+// Opus bytes the chunks carry, without the length prefixes
+static int opus_bytes(void)
+{
+    int bytes = 0;
+    for (int k = 0; k < s_n_msg; k++)
+    {
+        chunk_t c = chunk(k);
+        bytes += c.len - 2 * c.frames;
+    }
+    return bytes;
+}
+
+static void uplink_scene(void)
+{
+    feed(scene(0), SCENE_S * RATE, BLOCK, T0, true);
+    spurt_end();
+}
+
+static double now_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, debi_audio_init());
+
+    // a new uplink on the same encoder, lock and buffers
+    audio_state_t keep = s_audio;
+    memset(&s_audio, 0, sizeof(s_audio));
+    s_audio.enc = keep.enc;
+    s_audio.frames = keep.frames;
+    s_audio.msg = keep.msg;
+    s_audio.min_energy = keep.min_energy;
+    s_audio.snr_lin = keep.snr_lin;
+    s_audio.lock = keep.lock;
+    s_audio.released = keep.released;
+    s_audio.task = keep.task;
+    s_audio.bitrate = DEBI_AUDIO_BITRATE;
+    s_audio.complexity = DEBI_AUDIO_COMPLEXITY;
+    opus_encoder_ctl(s_audio.enc, OPUS_SET_BITRATE(s_audio.bitrate));
+    opus_encoder_ctl(s_audio.enc, OPUS_SET_COMPLEXITY(s_audio.complexity));
+    chunk_reset();
+    s_ctl = (audio_ctl_t){ .mode = DEBI_AUDIO_MODE_VAD, .bitrate = DEBI_AUDIO_BITRATE, .complexity = DEBI_AUDIO_COMPLEXITY };
+
+    s_connected = true;
+    s_notified = 0;
+    host_time_set(0);
+}
+
+void tearDown(void)
+{
+    for (int k = 0; k < s_n_msg; k++)
+    {
+        free(s_msg[k]);
+    }
+    s_n_msg = 0;
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_vad_spurts(void)
+{
+    double from[SPURTS_MAX], to[SPURTS_MAX], sent_s = 0;
+    int spurts = 0;
+
+    uplink_scene();
+    for (int k = 0; k < s_n_msg; k++)
+    {
+        chunk_t c = chunk(k);
+        TEST_ASSERT_EQUAL_UINT32(k, c.seq);
+        if (c.flags & DEBI_AUDIO_FLAG_START)
+        {
+            TEST_ASSERT_LESS_THAN_INT(SPURTS_MAX, spurts);
+            from[spurts++] = seconds(c.ts_us);
+        }
+        if (c.flags & DEBI_AUDIO_FLAG_END)
+        {
+            to[spurts - 1] = seconds(c.ts_us) + c.frames * DEBI_AUDIO_FRAME_MS / 1000.0;
+        }
+        sent_s += c.frames * DEBI_AUDIO_FRAME_MS / 1000.0;
+    }
+
+    // both cries with their pre-roll and hang, the fan until the floor has learnt it; not the knock
+    TEST_ASSERT_EQUAL_INT(3, spurts);
+    TEST_ASSERT_FLOAT_WITHIN(0.08, CRIES[0].from_s - 0.27, from[0]);
+    TEST_ASSERT_TRUE(to[0] >= CRIES[0].to_s && to[0] <= CRIES[0].to_s + 2.5);
+    TEST_ASSERT_TRUE(from[1] >= FAN_S - 0.35 && from[1] <= FAN_S);
+    TEST_ASSERT_TRUE(to[1] <= FAN_S + DEBI_AUDIO_FLOOR_S + 3.5);
+    TEST_ASSERT_TRUE(from[2] <= CRIES[1].from_s - 0.2 && to[2] >= CRIES[1].to_s);
+    TEST_ASSERT_LESS_THAN_INT(25, (int)sent_s);
+
+    debi_audio_stats_t stats;
+    debi_audio_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.spurts);
+    TEST_ASSERT_EQUAL_UINT32(s_n_msg, stats.chunks_sent);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.chunks_lost);
+}
+
+// what the hub decodes of a cry has the energy of what the mic heard, spurt by spurt
+static void test_decoded_cry(void)
+{
+    int err;
+    OpusDecoder *dec = opus_decoder_create(RATE, 1, &err);
+    TEST_ASSERT_EQUAL_INT(OPUS_OK, err);
+    int16_t pcm[FRAME_SAMPLES];
+    double worst_db = 0;
+    int compared = 0;
+
+    uplink_scene();
+    for (int k = 0; k < s_n_msg; k++)
+    {
+        chunk_t c = chunk(k);
+        if (c.flags & DEBI_AUDIO_FLAG_START)
+        {
+            opus_decoder_ctl(dec, OPUS_RESET_STATE);
+        }
+        const int16_t *x = scene(seconds(c.ts_us));
+        const uint8_t *p = c.packets;
+        double e_in = 0, e_out = 0;
+        for (int f = 0; f < c.frames; f++)
+        {
+            int len = p[0] | p[1] << 8;
+            TEST_ASSERT_EQUAL_INT(FRAME_SAMPLES, opus_decode(dec, p + 2, len, pcm, FRAME_SAMPLES, 0));
+            for (int i = 0; i < FRAME_SAMPLES; i++)
+            {
+                e_out += (double)pcm[i] * pcm[i];
+                e_in += (double)x[f * FRAME_SAMPLES + i] * x[f * FRAME_SAMPLES + i];
+            }
+            p += 2 + len;
+        }
+        TEST_ASSERT_EQUAL_PTR(c.packets + c.len, p);
+
+        double t = seconds(c.ts_us);
+        if (t > CRIES[0].from_s + 0.2 && t < CRIES[0].to_s - 0.3 && e_in > 1e3 * c.frames * FRAME_SAMPLES)
+        {
+            worst_db = fmax(worst_db, fabs(10 * log10(e_out / e_in)));
+            compared++;
+        }
+    }
+    opus_decoder_destroy(dec);
+
+    TEST_ASSERT_GREATER_THAN_INT(20, compared);
+    TEST_ASSERT_FLOAT_WITHIN(3.0, 0, worst_db);
+}
+
+// the hub asked for everything: breathing goes out too, at the bitrate asked for
+static void test_mode_on(void)
+{
+    debi_audio_set_mode(DEBI_AUDIO_MODE_ON, 0);
+    TEST_ASSERT_EQUAL_INT(1, s_notified);
+    feed(scene(50), 10 * RATE, BLOCK, T0, true);
+    spurt_end();
+
+    TEST_ASSERT_EQUAL_INT(10 * 1000 / (DEBI_AUDIO_FRAME_MS * DEBI_AUDIO_CHUNK_FRAMES), s_n_msg);
+    TEST_ASSERT_TRUE(chunk(0).flags & DEBI_AUDIO_FLAG_START);
+    TEST_ASSERT_TRUE(chunk(s_n_msg - 1).flags & DEBI_AUDIO_FLAG_END);
+    TEST_ASSERT_INT_WITHIN(DEBI_AUDIO_BITRATE * 15 / 100, DEBI_AUDIO_BITRATE, opus_bytes() * 8 / 10);
+}
+
+static void test_encoder_settings(void)
+{
+    debi_audio_set_encoder(1000, 20);
+    TEST_ASSERT_EQUAL_INT(DEBI_AUDIO_BITRATE_MIN, s_ctl.bitrate);
+    TEST_ASSERT_EQUAL_INT(10, s_ctl.complexity);
+    debi_audio_set_encoder(100000, -1);
+    TEST_ASSERT_EQUAL_INT(DEBI_AUDIO_BITRATE_MAX, s_ctl.bitrate);
+    TEST_ASSERT_EQUAL_INT(10, s_ctl.complexity);
+
+    // taken up by the next frame
+    debi_audio_set_encoder(16000, 5);
+    debi_audio_set_mode(DEBI_AUDIO_MODE_ON, 0);
+    feed(scene(50), 10 * RATE, BLOCK, T0, true);
+    spurt_end();
+
+    TEST_ASSERT_EQUAL_INT(16000, s_audio.bitrate);
+    TEST_ASSERT_EQUAL_INT(5, s_audio.complexity);
+    // VBR spends less than that on a fan, the default would spend more
+    TEST_ASSERT_LESS_OR_EQUAL_INT(16000 * 115 / 100, opus_bytes() * 8 / 10);
+    TEST_ASSERT_GREATER_THAN_INT(DEBI_AUDIO_BITRATE_MIN, opus_bytes() * 8 / 10);
+}
+
+// mic samples lost mid-spurt: the partial frame before them goes, the next chunk says GAP
+static void test_gap_mid_spurt(void)
+{
+    const int read = 512, gap_at = read * 37;   // not on a frame edge
+
+    debi_audio_set_mode(DEBI_AUDIO_MODE_ON, 0);
+    feed(scene(0), read * 36, read, T0, true);
+    feed(scene(0) + gap_at, read * 40, read, T0 + (int64_t)gap_at * 1000000 / RATE, true);
+    spurt_end();
+
+    int gaps = 0;
+    for (int k = 0; k < s_n_msg; k++)
+    {
+        chunk_t c = chunk(k);
+        if (c.flags & DEBI_AUDIO_FLAG_GAP)
+        {
+            gaps++;
+            TEST_ASSERT_EQUAL_INT64(T0 + (int64_t)gap_at * 1000000 / RATE, c.ts_us);
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(1, gaps);
+    TEST_ASSERT_EQUAL_UINT32(1, s_audio.stats.gaps);
+    TEST_ASSERT_EQUAL_UINT32(1, s_audio.stats.spurts);
+}
+
+// nothing is encoded while the hub is away, the cry still opens a spurt once it is back
+static void test_hub_away(void)
+{
+    s_connected = false;
+    feed(scene(7), 2 * RATE, BLOCK, T0, true);
+    TEST_ASSERT_EQUAL_INT(0, s_n_msg);
+    TEST_ASSERT_EQUAL_UINT32(0, s_audio.stats.frames_encoded);
+
+    s_connected = true;
+    feed(scene(9), RATE, BLOCK, T0 + 2000000, false);
+    spurt_end();
+    TEST_ASSERT_GREATER_THAN_INT(0, s_n_msg);
+    TEST_ASSERT_TRUE(chunk(0).flags & DEBI_AUDIO_FLAG_START);
+}
+
+static void test_mode_expiry(void)
+{
+    debi_audio_set_mode(DEBI_AUDIO_MODE_ON, 5);
+    host_time_set(4900000);
+    TEST_ASSERT_EQUAL(DEBI_AUDIO_MODE_ON, debi_audio_get_mode());
+    host_time_set(5000000);
+    TEST_ASSERT_EQUAL(DEBI_AUDIO_MODE_VAD, debi_audio_get_mode());
+
+    debi_audio_set_mode(DEBI_AUDIO_MODE_OFF, 0);
+    host_time_set(3600000000LL);
+    TEST_ASSERT_EQUAL(DEBI_AUDIO_MODE_OFF, debi_audio_get_mode());
+}
+
+// host cost of a frame at the bitrates and complexities the hub may ask for, for comparison
+static void test_encode_cost(void)
+{
+    const int bitrates[] = { 16000, 24000, 32000 };
+    const int complexities[] = { 0, 3, 5, 10 };
+    const int frames = SCENE_S * RATE / FRAME_SAMPLES;
+    uint8_t out[PACKET_MAX];
+
+    printf("libopus %s, %d ms frames\n", opus_get_version_string(), DEBI_AUDIO_FRAME_MS);
+    printf("%8s %10s %8s %8s\n", "bps", "complexity", "avg us", "kbps");
+    for (size_t b = 0; b < sizeof(bitrates) / sizeof(bitrates[0]); b++)
+    {
+        for (size_t c = 0; c < sizeof(complexities) / sizeof(complexities[0]); c++)
+        {
+            opus_encoder_ctl(s_audio.enc, OPUS_RESET_STATE);
+            opus_encoder_ctl(s_audio.enc, OPUS_SET_BITRATE(bitrates[b]));
+            opus_encoder_ctl(s_audio.enc, OPUS_SET_COMPLEXITY(complexities[c]));
+            long bytes = 0;
+            double start = now_us();
+            for (int f = 0; f < frames; f++)
+            {
+                int n = opus_encode(s_audio.enc, scene(0) + f * FRAME_SAMPLES, FRAME_SAMPLES, out, PACKET_MAX);
+                TEST_ASSERT_GREATER_THAN_INT(0, n);
+                bytes += n;
+            }
+            double avg_us = (now_us() - start) / frames;
+            printf("%8d %10d %8.1f %8.1f\n", bitrates[b], complexities[c], avg_us, bytes * 8.0 / SCENE_S / 1000);
+            TEST_ASSERT_LESS_THAN_INT(DEBI_AUDIO_FRAME_MS * 1000, (int)avg_us);
+        }
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_vad_spurts);
+    RUN_TEST(test_decoded_cry);
+    RUN_TEST(test_mode_on);
+    RUN_TEST(test_encoder_settings);
+    RUN_TEST(test_gap_mid_spurt);
+    RUN_TEST(test_hub_away);
+    RUN_TEST(test_mode_expiry);
+    RUN_TEST(test_encode_cost);
+    return UNITY_END();
+}
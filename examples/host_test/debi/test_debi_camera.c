@@ -0,0 +1,821 @@
+/*
+ * Binary frame transport of debi_camera: header and chunks put back together the way the hub
+ * does it, frames dropped while the pool is full, frames rejected before they take a buffer,
+ * and a hub link lost in the middle of a frame.
+ *
+ * The sender task runs as it does on the Watcher, the MQTT client under it records every
+ * publish. The test holds the client in its first publish when it needs frames to pile up
+ * behind the one being sent.
+ *
+ * The frame rate policy is replayed on the esp_timer clock: one preview every 100 ms with what
+ * the face bridge reports for it, and the hub link health the test sets.
+ */
+#include <pthread.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "debi_camera.c"
+
+#define MSGS_MAX    128
+#define FRAMES_MAX  8
+#define WAIT_MS     5000
+
+typedef struct {
+    uint8_t *data;
+    int len;
+    int qos;
+} msg_t;
+
+typedef struct {
+    uint32_t frame_id;
+    uint64_t ts_us;
+    uint32_t time;
+    uint16_t width;
+    uint16_t height;
+    uint32_t size;
+    uint16_t chunk_size;
+    uint16_t chunk_num;
+    uint32_t crc;
+    uint16_t dropped;
+    uint16_t chunks;          // chunks received, in order
+    uint8_t *data;
+} frame_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static msg_t s_msgs[MSGS_MAX];
+static int s_msgs_num;
+static int s_outbox_calls;
+static int s_broker;
+static volatile bool s_connected;
+static volatile bool s_gate_closed;     // hold the next publish until the test opens it
+static volatile bool s_gate_waiting;
+static volatile uint32_t s_cut_frame;   // the link goes down after the first chunk of this frame
+static int64_t s_ts_us = 1000000;
+static frame_t s_frames[FRAMES_MAX];
+static int s_frames_num;
+static debi_comms_health_t s_health;
+
+/*************************************************************************
+ * What the camera links against
+ ************************************************************************/
+void *debi_os_get_mqtt_handle(void)
+{
+    return &s_broker;
+}
+
+bool debi_os_hub_connected(void)
+{
+    return s_connected;
+}
+
+debi_comms_health_t debi_comms_get_health(void)
+{
+    return s_health;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | (uint32_t)get_u16(p + 2) << 16;
+}
+
+// the sender task calls this, asserts stay in the test's thread
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int id;
+
+    if (s_gate_closed)
+    {
+        s_gate_waiting = true;
+        while (s_gate_closed)
+        {
+            vTaskDelay(1);
+        }
+    }
+    if (strcmp(topic, DEBI_TOPIC_CAMERA_BIN) != 0)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    id = s_msgs_num;
+    if (s_msgs_num < MSGS_MAX)
+    {
+        s_msgs[s_msgs_num].data = malloc(len);
+        memcpy(s_msgs[s_msgs_num].data, data, len);
+        s_msgs[s_msgs_num].len = len;
+        s_msgs[s_msgs_num].qos = qos;
+        s_msgs_num++;
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    if (len >= DEBI_CAMERA_CHUNK_HDR_LEN && p[3] == DEBI_CAMERA_MSG_CHUNK && get_u32(p + 4) == s_cut_frame)
+    {
+        s_connected = false;
+    }
+    return id;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&s_lock);
+    s_outbox_calls++;
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+#define WAIT_UNTIL(cond)                                    \
+    do {                                                    \
+        int waited_ = 0;                                    \
+        while (!(cond) && waited_ < WAIT_MS) {              \
+            vTaskDelay(pdMS_TO_TICKS(10));                  \
+            waited_ += 10;                                  \
+        }                                                   \
+        TEST_ASSERT_TRUE_MESSAGE(cond, #cond);              \
+    } while (0)
+
+static uint32_t crc32(const uint8_t *p, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static debi_camera_stats_t stats(void)
+{
+    debi_camera_stats_t st;
+
+    debi_camera_get_stats(&st);
+    return st;
+}
+
+static uint32_t frames_done(void)
+{
+    debi_camera_stats_t st = stats();
+
+    return st.frames_sent + st.frames_aborted;
+}
+
+/* SOI, APP0, SOF0 with the size, then scan data up to len and EOI */
+static uint8_t *jpeg_make(size_t len, uint16_t width, uint16_t height, uint8_t seed)
+{
+    static const uint8_t app0[] = { 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    uint8_t *p = malloc(len);
+    size_t i = 0;
+
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(64, len);
+    p[i++] = 0xFF;
+    p[i++] = 0xD8;
+    memcpy(p + i, app0, sizeof(app0));
+    i += sizeof(app0);
+    const uint8_t sof[] = { 0xFF, 0xC0, 0x00, 0x11, 8, height >> 8, height & 0xff, width >> 8, width & 0xff, 3,
+                            1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    memcpy(p + i, sof, sizeof(sof));
+    i += sizeof(sof);
+    p[i++] = 0xFF;
+    p[i++] = 0xDA;
+    for (; i < len - 2; i++)
+    {
+        p[i] = (uint8_t)(i * 31 + seed);
+    }
+    p[len - 2] = 0xFF;
+    p[len - 1] = 0xD9;
+    return p;
+}
+
+/* hand a frame to the camera as the WE2 delivers it, base64, delta_us after the previous one */
+static uint32_t forward_b64(const char *b64, int64_t delta_us)
+{
+    struct tf_module_ai_camera_preview_info preview;
+    debi_camera_stamp_t stamp;
+
+    s_ts_us += delta_us;
+    debi_camera_stamp(s_ts_us, &stamp);
+    memset(&preview, 0, sizeof(preview));
+    preview.img.p_buf = (uint8_t *)b64;
+    preview.img.len = strlen(b64);
+    preview.img.time = 1760000000;
+    debi_camera_forward_frame(&preview, &stamp);
+    return stamp.frame_id;
+}
+
+static uint32_t forward(const uint8_t *jpeg, size_t len)
+{
+    size_t b64_len = 0;
+    char *b64;
+    uint32_t id;
+
+    mbedtls_base64_encode(NULL, 0, &b64_len, jpeg, len);
+    b64 = malloc(b64_len);
+    TEST_ASSERT_EQUAL(0, mbedtls_base64_encode((unsigned char *)b64, b64_len, &b64_len, jpeg, len));
+    id = forward_b64(b64, 1000000);
+    free(b64);
+    return id;
+}
+
+static frame_t *frame_find(uint32_t frame_id)
+{
+    for (int i = 0; i < s_frames_num; i++)
+    {
+        if (s_frames[i].frame_id == frame_id)
+        {
+            return &s_frames[i];
+        }
+    }
+    return NULL;
+}
+
+/* put the frames back together from what was published, as the hub does; the sender is idle */
+static void collect(void)
+{
+    for (int m = 0; m < s_msgs_num; m++)
+    {
+        const uint8_t *p = s_msgs[m].data;
+        int len = s_msgs[m].len;
+        frame_t *f;
+
+        TEST_ASSERT_EQUAL_INT(0, s_msgs[m].qos);
+        TEST_ASSERT_GREATER_OR_EQUAL_INT(DEBI_CAMERA_CHUNK_HDR_LEN, len);
+        TEST_ASSERT_EQUAL_UINT8('D', p[0]);
+        TEST_ASSERT_EQUAL_UINT8('F', p[1]);
+        TEST_ASSERT_EQUAL_UINT8(DEBI_CAMERA_PROTO_VERSION, p[2]);
+
+        if (p[3] == DEBI_CAMERA_MSG_HEADER)
+        {
+            TEST_ASSERT_EQUAL_INT(DEBI_CAMERA_HEADER_LEN, len);
+            TEST_ASSERT_NULL(frame_find(get_u32(p + 4)));
+            TEST_ASSERT_LESS_THAN_INT(FRAMES_MAX, s_frames_num);
+            f = &s_frames[s_frames_num++];
+            memset(f, 0, sizeof(*f));
+            f->frame_id = get_u32(p + 4);
+            f->ts_us = get_u32(p + 8) | (uint64_t)get_u32(p + 12) << 32;
+            f->time = get_u32(p + 16);
+            f->width = get_u16(p + 20);
+            f->height = get_u16(p + 22);
+            f->size = get_u32(p + 24);
+            f->chunk_size = get_u16(p + 28);
+            f->chunk_num = get_u16(p + 30);
+            f->crc = get_u32(p + 32);
+            f->dropped = get_u16(p + 36);
+            f->data = malloc(f->size);
+            continue;
+        }
+
+        TEST_ASSERT_EQUAL_UINT8(DEBI_CAMERA_MSG_CHUNK, p[3]);
+        f = frame_find(get_u32(p + 4));
+        TEST_ASSERT_NOT_NULL_MESSAGE(f, "chunk before its header");
+        uint16_t seq = get_u16(p + 8);
+        size_t off = (size_t)seq * f->chunk_size;
+        TEST_ASSERT_EQUAL_UINT16(f->chunks, seq);
+        TEST_ASSERT_EQUAL_UINT16(f->chunk_num, get_u16(p + 10));
+        TEST_ASSERT_LESS_THAN_UINT16(f->chunk_num, seq);
+        size_t n = f->size - off < f->chunk_size ? f->size - off : f->chunk_size;
+        TEST_ASSERT_EQUAL_INT(DEBI_CAMERA_CHUNK_HDR_LEN + n, len);
+        memcpy(f->data + off, p + DEBI_CAMERA_CHUNK_HDR_LEN, n);
+        f->chunks++;
+    }
+}
+
+static void assert_frame(const frame_t *f, uint32_t frame_id, const uint8_t *jpeg, size_t len)
+{
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_UINT32(frame_id, f->frame_id);
+    TEST_ASSERT_EQUAL_UINT32(len, f->size);
+    TEST_ASSERT_EQUAL_UINT16(DEBI_CAMERA_CHUNK_SIZE, f->chunk_size);
+    TEST_ASSERT_EQUAL_UINT16((len + DEBI_CAMERA_CHUNK_SIZE - 1) / DEBI_CAMERA_CHUNK_SIZE, f->chunk_num);
+    TEST_ASSERT_EQUAL_UINT16(f->chunk_num, f->chunks);
+    TEST_ASSERT_EQUAL_HEX32(crc32(jpeg, len), f->crc);
+    TEST_ASSERT_EQUAL_HEX32(crc32(jpeg, len), crc32(f->data, f->size));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(jpeg, f->data, len);
+    TEST_ASSERT_EQUAL_UINT32(1760000000, f->time);
+}
+
+static void msgs_clear(void)
+{
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < s_msgs_num; i++)
+    {
+        free(s_msgs[i].data);
+    }
+    s_msgs_num = 0;
+    s_outbox_calls = 0;
+    pthread_mutex_unlock(&s_lock);
+
+    for (int i = 0; i < s_frames_num; i++)
+    {
+        free(s_frames[i].data);
+    }
+    s_frames_num = 0;
+}
+
+void setUp(void)
+{
+    s_connected = true;
+    s_gate_closed = false;
+    s_gate_waiting = false;
+    s_cut_frame = 0;
+    memset(&s_health, 0, sizeof(s_health));
+    s_health.connected = true;
+    msgs_clear();
+
+    // the sender task and its pool stay from the previous test, idle
+    if (s_cam.lock)
+    {
+        xSemaphoreTake(s_cam.lock, portMAX_DELAY);
+        memset(&s_cam.stats, 0, sizeof(s_cam.stats));
+        s_cam.dropped = 0;
+        s_cam.drop_us = 0;
+        xSemaphoreGive(s_cam.lock);
+    }
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, DEBI_CAMERA_FPS_MAX, 0);
+}
+
+void tearDown(void)
+{
+    s_gate_closed = false;
+    s_connected = true;
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_frames_reassemble(void)
+{
+    // one chunk, one byte short of a chunk, exactly one, one over, a short last chunk, the largest
+    const size_t sizes[] = { 64, DEBI_CAMERA_CHUNK_SIZE - 1, DEBI_CAMERA_CHUNK_SIZE, DEBI_CAMERA_CHUNK_SIZE + 1,
+                             3 * DEBI_CAMERA_CHUNK_SIZE + 123, DEBI_CAMERA_FRAME_MAX };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        uint8_t *jpeg = jpeg_make(sizes[i], 640 + i, 480 - i, (uint8_t)i);
+        uint32_t id;
+
+        msgs_clear();
+        id = forward(jpeg, sizes[i]);
+        WAIT_UNTIL(frames_done() == i + 1);
+        collect();
+
+        TEST_ASSERT_EQUAL_INT(1, s_frames_num);
+        assert_frame(&s_frames[0], id, jpeg, sizes[i]);
+        TEST_ASSERT_EQUAL_UINT64(s_ts_us, s_frames[0].ts_us);
+        TEST_ASSERT_EQUAL_UINT16(640 + i, s_frames[0].width);
+        TEST_ASSERT_EQUAL_UINT16(480 - i, s_frames[0].height);
+        TEST_ASSERT_EQUAL_UINT16(0, s_frames[0].dropped);
+        // the sender looks at the client's outbox once per window of chunks
+        TEST_ASSERT_EQUAL_INT((s_frames[0].chunk_num + DEBI_CAMERA_WINDOW - 1) / DEBI_CAMERA_WINDOW, s_outbox_calls);
+        free(jpeg);
+    }
+
+    debi_camera_stats_t st = stats();
+    TEST_ASSERT_EQUAL_UINT32(6, st.frames_sent);
+    TEST_ASSERT_EQUAL_UINT32(0, st.frames_dropped);
+    TEST_ASSERT_EQUAL_UINT32(0, st.frames_aborted);
+}
+
+static void test_ids_skip_frames_held_back(void)
+{
+    uint8_t *jpeg = jpeg_make(200, 320, 240, 1);
+    uint32_t first, second;
+
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 1.0f, 0);
+    first = forward(jpeg, 200);
+    WAIT_UNTIL(frames_done() == 1);
+    // half a second later: stamped, not sent
+    forward_b64("AAAA", 500000);
+    second = forward(jpeg, 200);
+    WAIT_UNTIL(frames_done() == 2);
+    collect();
+
+    TEST_ASSERT_EQUAL_INT(2, s_frames_num);
+    TEST_ASSERT_EQUAL_UINT32(first, s_frames[0].frame_id);
+    TEST_ASSERT_EQUAL_UINT32(first + 2, second);
+    TEST_ASSERT_EQUAL_UINT32(second, s_frames[1].frame_id);
+    TEST_ASSERT_EQUAL_UINT16(0, s_frames[1].dropped);
+    free(jpeg);
+}
+
+static void test_pool_full_drops_oldest(void)
+{
+    uint8_t *jpeg[4];
+    uint32_t id[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        jpeg[i] = jpeg_make(DEBI_CAMERA_CHUNK_SIZE + 100 * i, 640, 480, (uint8_t)(i * 17));
+    }
+
+    // frame 0 is held in its first publish, 1 and 2 fill the pool, 3 takes the place of 1
+    s_gate_closed = true;
+    id[0] = forward(jpeg[0], DEBI_CAMERA_CHUNK_SIZE);
+    WAIT_UNTIL(s_gate_waiting);
+    for (int i = 1; i < 4; i++)
+    {
+        id[i] = forward(jpeg[i], DEBI_CAMERA_CHUNK_SIZE + 100 * i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, stats().frames_dropped);
+    TEST_ASSERT_EQUAL_INT(3, DEBI_CAMERA_POOL_NUM);
+
+    s_gate_closed = false;
+    WAIT_UNTIL(frames_done() == 3);
+    collect();
+
+    TEST_ASSERT_EQUAL_INT(3, s_frames_num);
+    assert_frame(&s_frames[0], id[0], jpeg[0], DEBI_CAMERA_CHUNK_SIZE);
+    assert_frame(&s_frames[1], id[2], jpeg[2], DEBI_CAMERA_CHUNK_SIZE + 200);
+    assert_frame(&s_frames[2], id[3], jpeg[3], DEBI_CAMERA_CHUNK_SIZE + 300);
+    TEST_ASSERT_NULL(frame_find(id[1]));
+    // the drop is reported once, in the first header after it
+    TEST_ASSERT_EQUAL_UINT16(0, s_frames[0].dropped);
+    TEST_ASSERT_EQUAL_UINT16(1, s_frames[1].dropped);
+    TEST_ASSERT_EQUAL_UINT16(0, s_frames[2].dropped);
+    TEST_ASSERT_EQUAL_UINT32(3, stats().frames_sent);
+
+    for (int i = 0; i < 4; i++)
+    {
+        free(jpeg[i]);
+    }
+}
+
+static void test_bad_frames_rejected(void)
+{
+    size_t big = DEBI_CAMERA_FRAME_MAX + 1;
+    uint8_t *jpeg = jpeg_make(big, 640, 480, 3);
+    uint32_t id;
+
+    forward_b64("!not base64!", 1000000);
+    forward_b64("", 1000000);
+    // decodes to one byte more than a pool buffer holds
+    forward(jpeg, big);
+    TEST_ASSERT_EQUAL_UINT32(2, stats().frames_rejected);
+    TEST_ASSERT_EQUAL_UINT32(0, stats().frames_dropped);
+
+    // no buffer was kept by the rejects, more good frames than the pool go through one by one
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM + 1; i++)
+    {
+        id = forward(jpeg, 1000);
+        WAIT_UNTIL(frames_done() == (uint32_t)i + 1);
+    }
+    collect();
+    TEST_ASSERT_EQUAL_INT(DEBI_CAMERA_POOL_NUM + 1, s_frames_num);
+    assert_frame(&s_frames[DEBI_CAMERA_POOL_NUM], id, jpeg, 1000);
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM; i++)
+    {
+        TEST_ASSERT_EQUAL(SLOT_FREE, s_cam.slots[i].state);
+    }
+    free(jpeg);
+}
+
+static void test_jpeg_size(void)
+{
+    uint16_t w, h;
+    uint8_t *jpeg = jpeg_make(100, 1280, 720, 0);
+    // SOI, DHT (0xC4 is not a frame), fill bytes, then a progressive SOF2
+    const uint8_t progressive[] = { 0xFF, 0xD8, 0xFF, 0xC4, 0x00, 0x04, 0, 0, 0xFF, 0xFF, 0xFF, 0xC2, 0x00, 0x11,
+                                    8, 0x01, 0xE0, 0x02, 0x80, 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    // the scan starts before any SOF
+    const uint8_t no_sof[] = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x08, 0xFF, 0xC0, 0x00, 0x11, 8, 0, 1, 0, 1 };
+
+    jpeg_get_size(jpeg, 100, &w, &h);
+    TEST_ASSERT_EQUAL_UINT16(1280, w);
+    TEST_ASSERT_EQUAL_UINT16(720, h);
+
+    jpeg_get_size(progressive, sizeof(progressive), &w, &h);
+    TEST_ASSERT_EQUAL_UINT16(640, w);
+    TEST_ASSERT_EQUAL_UINT16(480, h);
+
+    jpeg_get_size(no_sof, sizeof(no_sof), &w, &h);
+    TEST_ASSERT_EQUAL_UINT16(0, w);
+    TEST_ASSERT_EQUAL_UINT16(0, h);
+
+    // cut inside the SOF, and not a JPEG at all
+    jpeg_get_size(jpeg, 2 + 18 + 6, &w, &h);
+    TEST_ASSERT_EQUAL_UINT16(0, w);
+    jpeg_get_size((const uint8_t *)"GIF89a....", 10, &w, &h);
+    TEST_ASSERT_EQUAL_UINT16(0, w);
+    TEST_ASSERT_EQUAL_UINT16(0, h);
+    free(jpeg);
+}
+
+static void test_disconnect_aborts_frame(void)
+{
+    uint8_t *jpeg = jpeg_make(3 * DEBI_CAMERA_CHUNK_SIZE, 640, 480, 9);
+    uint32_t id[5];
+
+    // a drop first, so that the frame the link goes down in carries one
+    s_gate_closed = true;
+    id[0] = forward(jpeg, 100);
+    WAIT_UNTIL(s_gate_waiting);
+    for (int i = 1; i < 4; i++)
+    {
+        id[i] = forward(jpeg, 3 * DEBI_CAMERA_CHUNK_SIZE);
+    }
+    s_cut_frame = id[2];
+    s_gate_closed = false;
+    WAIT_UNTIL(frames_done() == 3);
+
+    debi_camera_stats_t st = stats();
+    TEST_ASSERT_EQUAL_UINT32(1, st.frames_sent);
+    TEST_ASSERT_EQUAL_UINT32(2, st.frames_aborted);
+    collect();
+    TEST_ASSERT_EQUAL_INT(2, s_frames_num);
+    TEST_ASSERT_EQUAL_UINT32(id[0], s_frames[0].frame_id);
+    TEST_ASSERT_EQUAL_UINT32(id[2], s_frames[1].frame_id);
+    TEST_ASSERT_EQUAL_UINT16(1, s_frames[1].dropped);
+    TEST_ASSERT_EQUAL_UINT16(1, s_frames[1].chunks);
+    TEST_ASSERT_NULL(frame_find(id[3]));
+
+    // no frames while the link is down, and the next header still reports the drop the hub missed
+    forward(jpeg, 100);
+    TEST_ASSERT_EQUAL_UINT32(3, frames_done());
+    s_connected = true;
+    msgs_clear();
+    id[4] = forward(jpeg, 100);
+    WAIT_UNTIL(frames_done() == 4);
+    collect();
+    TEST_ASSERT_EQUAL_INT(1, s_frames_num);
+    assert_frame(&s_frames[0], id[4], jpeg, 100);
+    TEST_ASSERT_EQUAL_UINT16(1, s_frames[0].dropped);
+    free(jpeg);
+}
+
+/*************************************************************************
+ * Frame rate replay
+ ************************************************************************/
+#define TICK_US         100000      // the WE2 sends a preview every 100 ms
+#define REPLAY_JPEG     8000        // a 640x480 preview, two chunks
+#define MOTION_HALF     ((DEBI_CAMERA_MOTION_MIN_PM + DEBI_CAMERA_MOTION_FULL_PM) / 2)
+#define FPS_HALF        ((DEBI_CAMERA_FPS_PRESENT + DEBI_CAMERA_FPS_MAX) / 2)
+
+static char *s_b64;
+static int64_t s_first_us;          // ts of the first frame the last replay() sent, 0 if none
+
+static void replay_begin(void)
+{
+    uint8_t *jpeg = jpeg_make(REPLAY_JPEG, 640, 480, 5);
+    size_t b64_len = 0;
+
+    if (!s_b64)
+    {
+        mbedtls_base64_encode(NULL, 0, &b64_len, jpeg, REPLAY_JPEG);
+        s_b64 = malloc(b64_len);
+        TEST_ASSERT_EQUAL(0, mbedtls_base64_encode((unsigned char *)s_b64, b64_len, &b64_len, jpeg, REPLAY_JPEG));
+    }
+    free(jpeg);
+
+    portENTER_CRITICAL(&s_rate_mux);
+    s_rate.person_us = 0;
+    s_rate.motion_us = 0;
+    s_rate.motion_pm = 0;
+    portEXIT_CRITICAL(&s_rate_mux);
+    s_cam.last_frame_time_us = 0;
+    host_time_set(s_ts_us);
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_AUTO, 0, 0);
+}
+
+/* the next preview, after the face bridge reported what it saw in it */
+static void tick(bool person, int motion_pm)
+{
+    s_ts_us += TICK_US;
+    host_time_set(s_ts_us);
+    debi_camera_update_activity(person, motion_pm);
+    forward_b64(s_b64, 0);
+}
+
+/* ms of one scene, the sender finishes each frame before the next preview; frames sent */
+static int replay(int ms, bool person, int motion_pm)
+{
+    int sent = 0;
+
+    s_first_us = 0;
+    for (int t = 0; t < ms; t += TICK_US / 1000)
+    {
+        uint32_t done = frames_done();
+
+        tick(person, motion_pm);
+        if (s_cam.last_frame_time_us != s_ts_us)
+        {
+            continue;
+        }
+        for (int waited = 0; frames_done() == done && waited < WAIT_MS; waited++)
+        {
+            vTaskDelay(1);
+        }
+        TEST_ASSERT_EQUAL_UINT32(done + 1, frames_done());
+        s_first_us = s_first_us ? s_first_us : s_ts_us;
+        sent++;
+    }
+    return sent;
+}
+
+static void assert_fps(float fps)
+{
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, fps, debi_camera_get_fps());
+}
+
+static void test_rate_follows_the_scene(void)
+{
+    replay_begin();
+    assert_fps(DEBI_CAMERA_FPS_MIN);
+
+    // nobody: the first preview, then one every 5 s
+    TEST_ASSERT_EQUAL_INT(4, replay(20000, false, 0));
+    // a person sits down: the next preview goes out, then one a second, detector jitter included
+    TEST_ASSERT_EQUAL_INT(10, replay(10000, true, 0));
+    assert_fps(DEBI_CAMERA_FPS_PRESENT);
+    TEST_ASSERT_EQUAL_INT(10, replay(10000, true, DEBI_CAMERA_MOTION_MIN_PM));
+    assert_fps(DEBI_CAMERA_FPS_PRESENT);
+    // moving fast: every preview, faster still changes nothing
+    TEST_ASSERT_EQUAL_INT(100, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+    TEST_ASSERT_EQUAL_INT(100, replay(10000, true, 2 * DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+    // halfway between, 5.5 fps is every other preview
+    TEST_ASSERT_EQUAL_INT(50, replay(10000, true, MOTION_HALF));
+    assert_fps(FPS_HALF);
+
+    // still again: the rate of the last motion holds for 5 s, then one a second
+    TEST_ASSERT_EQUAL_INT(25, replay(DEBI_CAMERA_HOLD_MS, true, 0));
+    assert_fps(FPS_HALF);
+    replay(100, true, 0);
+    assert_fps(DEBI_CAMERA_FPS_PRESENT);
+
+    // the person leaves: one a second for 5 s more, then nobody's rate
+    TEST_ASSERT_EQUAL_INT(5, replay(DEBI_CAMERA_HOLD_MS, false, 0));
+    assert_fps(DEBI_CAMERA_FPS_PRESENT);
+    replay(100, false, 0);
+    assert_fps(DEBI_CAMERA_FPS_MIN);
+    TEST_ASSERT_EQUAL_UINT32(0, stats().frames_dropped);
+}
+
+static void test_rate_capped_while_the_hub_lags(void)
+{
+    replay_begin();
+    TEST_ASSERT_EQUAL_INT(100, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+
+    // a slow round trip: one frame every 2 s, from the next preview on
+    s_health.rtt_ms = DEBI_CAMERA_RTT_SLOW_MS + 1;
+    TEST_ASSERT_EQUAL_INT(5, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_CONGESTED);
+    s_health.rtt_ms = DEBI_CAMERA_RTT_SLOW_MS;
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+
+    // messages waiting in debi_comms
+    s_health.queued_count = 1;
+    TEST_ASSERT_EQUAL_INT(5, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_CONGESTED);
+    s_health.queued_count = 0;
+    TEST_ASSERT_EQUAL_INT(10, replay(1000, true, DEBI_CAMERA_MOTION_FULL_PM));
+
+    // the cap never raises a rate, nobody in view stays at the minimum once the hold is over
+    TEST_ASSERT_EQUAL_INT(50, replay(DEBI_CAMERA_HOLD_MS + 100, false, 0));
+    s_health.queued_count = 1;
+    assert_fps(DEBI_CAMERA_FPS_MIN);
+    s_health.queued_count = 0;
+
+    // a frame dropped here: the sender is held in its first publish, the fourth preview finds
+    // the pool full and takes the place of a queued one
+    s_gate_closed = true;
+    uint32_t done = frames_done();
+    tick(true, DEBI_CAMERA_MOTION_FULL_PM);
+    WAIT_UNTIL(s_gate_waiting);
+    for (int i = 0; i < DEBI_CAMERA_POOL_NUM; i++)
+    {
+        tick(true, DEBI_CAMERA_MOTION_FULL_PM);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, stats().frames_dropped);
+    s_gate_closed = false;
+    WAIT_UNTIL(frames_done() == done + DEBI_CAMERA_POOL_NUM);
+
+    // capped for 5 s after the drop, then back at once
+    assert_fps(DEBI_CAMERA_FPS_CONGESTED);
+    TEST_ASSERT_EQUAL_INT(2, replay(DEBI_CAMERA_HOLD_MS, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_CONGESTED);
+    TEST_ASSERT_EQUAL_INT(1, replay(100, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+}
+
+static void test_stream_override_and_expiry(void)
+{
+    replay_begin();
+
+    // nobody in view, the hub asks for 3 fps for 10 s: a frame every 4th preview
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 3.0f, 10);
+    TEST_ASSERT_EQUAL_INT(25, replay(9900, false, 0));
+    assert_fps(3.0f);
+    TEST_ASSERT_EQUAL_INT(0, replay(100, false, 0));
+    assert_fps(DEBI_CAMERA_FPS_MIN);
+
+    // clamped to the policy's range
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 50.0f, 0);
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 0.01f, 0);
+    assert_fps(DEBI_CAMERA_FPS_MIN);
+
+    // a fixed rate is the hub's choice, a lagging link does not cap it, and it has no expiry
+    s_health.rtt_ms = 2 * DEBI_CAMERA_RTT_SLOW_MS;
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 2.0f, 0);
+    TEST_ASSERT_EQUAL_INT(20, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+    s_ts_us += 3600 * 1000000LL;
+    TEST_ASSERT_EQUAL_INT(20, replay(10000, false, 0));
+    assert_fps(2.0f);
+    s_health.rtt_ms = 0;
+
+    // off for 5 s with a person running about, then the policy again
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_OFF, 0, 5);
+    TEST_ASSERT_EQUAL_INT(0, replay(4900, true, DEBI_CAMERA_MOTION_FULL_PM));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, debi_camera_get_fps());
+    TEST_ASSERT_EQUAL_INT(1, replay(100, true, DEBI_CAMERA_MOTION_FULL_PM));
+    assert_fps(DEBI_CAMERA_FPS_MAX);
+
+    // a new command replaces the expiry of the one before
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_OFF, 0, 5);
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 5.0f, 0);
+    TEST_ASSERT_EQUAL_INT(50, replay(10000, true, DEBI_CAMERA_MOTION_FULL_PM));
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_AUTO, 0, 0);
+    TEST_ASSERT_EQUAL_INT(10, replay(1000, true, DEBI_CAMERA_MOTION_FULL_PM));
+}
+
+/* A nursery morning in 10 min, against the fixed rates the camera could send at instead */
+static void test_replay_bytes_and_latency(void)
+{
+    const struct {
+        const char *name;
+        int ms;
+        bool person;
+        int motion_pm;
+        bool trigger;           // the first preview of the scene has to go out
+    } scenes[] = {
+        { "empty room", 180000, false, 0, false },
+        { "walks in", 20000, true, 200, true },
+        { "sits, jitter", 240000, true, 20, false },
+        { "plays", 60000, true, 120, false },
+        { "gets up", 5000, true, DEBI_CAMERA_MOTION_FULL_PM, true },
+        { "walks out", 5000, true, 200, false },
+        { "empty room", 90000, false, 0, false },
+    };
+    const int scene_num = sizeof(scenes) / sizeof(scenes[0]);
+    int64_t total_ms = 0;
+    int frames = 0;
+
+    replay_begin();
+    printf("%-14s %7s %7s %12s\n", "scene", "s", "frames", "latency ms");
+    for (int i = 0; i < scene_num; i++)
+    {
+        int64_t start_us = s_ts_us + TICK_US;
+        int n = replay(scenes[i].ms, scenes[i].person, scenes[i].motion_pm);
+
+        printf("%-14s %7d %7d %12.0f\n", scenes[i].name, scenes[i].ms / 1000, n,
+               s_first_us ? (s_first_us - start_us) / 1000.0 : -1.0);
+        if (scenes[i].trigger)
+        {
+            TEST_ASSERT_EQUAL_INT64_MESSAGE(start_us, s_first_us, scenes[i].name);
+        }
+        total_ms += scenes[i].ms;
+        frames += n;
+    }
+
+    debi_camera_stats_t st = stats();
+    double hours = total_ms / 3600000.0;
+    double fixed_max = total_ms / 1000.0 * DEBI_CAMERA_FPS_MAX * REPLAY_JPEG / hours;
+    double fixed_present = total_ms / 1000.0 * DEBI_CAMERA_FPS_PRESENT * REPLAY_JPEG / hours;
+
+    TEST_ASSERT_EQUAL_UINT32(frames, st.frames_sent);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)frames * REPLAY_JPEG, st.bytes_sent);
+    printf("adaptive %.1f MB/h, fixed %.0f fps %.1f MB/h, fixed %.0f fps %.1f MB/h\n", st.bytes_sent / hours / 1e6,
+           DEBI_CAMERA_FPS_MAX, fixed_max / 1e6, DEBI_CAMERA_FPS_PRESENT, fixed_present / 1e6);
+    // under a fifth of the full rate, while the first preview of a movement always goes out
+    TEST_ASSERT_LESS_THAN_UINT64((uint64_t)(fixed_max * hours) / 5, st.bytes_sent);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_reassemble);
+    RUN_TEST(test_ids_skip_frames_held_back);
+    RUN_TEST(test_pool_full_drops_oldest);
+    RUN_TEST(test_bad_frames_rejected);
+    RUN_TEST(test_jpeg_size);
+    RUN_TEST(test_disconnect_aborts_frame);
+    RUN_TEST(test_rate_follows_the_scene);
+    RUN_TEST(test_rate_capped_while_the_hub_lags);
+    RUN_TEST(test_stream_override_and_expiry);
+    RUN_TEST(test_replay_bytes_and_latency);
+    return UNITY_END();
+}
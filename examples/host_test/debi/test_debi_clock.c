@@ -0,0 +1,368 @@
+/*
+ * Media clock of debi_os (app/debi_clock.c): the capture time of mic samples fitted from the
+ * times reads return, and the hub clock mapping fitted from ping/pong exchanges.
+ *
+ * The codec is simulated the way the Watcher reads it: it captures at its own rate, DMA
+ * completes every 240 samples, and a 512 sample read returns when the DMA frame with its last
+ * sample is done plus a scheduling delay, sometimes a long one. The hub is a clock with its own
+ * offset and rate behind a link with a base delay each way, queueing and stalls.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "debi_clock.c"
+
+#define READ_SAMPLES    512
+#define DMA_SAMPLES     240
+#define DMA_CYCLE_READS 15      // reads before one ends with a DMA frame again
+#define READS_MAX       65536
+
+static void (*s_mic_cb)(const bsp_mic_read_t *read);
+static uint64_t s_rng;
+static double s_err[READS_MAX];
+static int s_n_err;
+
+/*************************************************************************
+ * What debi_clock links against
+ ************************************************************************/
+void bsp_set_mic_read_cb(void (*cb)(const bsp_mic_read_t *read))
+{
+    s_mic_cb = cb;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static double urand(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return ((s_rng >> 11) + 1.0) * (1.0 / 9007199254740994.0);
+}
+
+static double expo(double mean)
+{
+    return -mean * log(urand());
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double p99(void)
+{
+    qsort(s_err, s_n_err, sizeof(s_err[0]), cmp_double);
+    return s_err[s_n_err * 99 / 100];
+}
+
+// a boot: both mappings start over, the lock stays
+static void clock_reset(void)
+{
+    SemaphoreHandle_t lock = s_clock.lock;
+    memset(&s_clock, 0, sizeof(s_clock));
+    s_clock.lock = lock;
+}
+
+typedef struct
+{
+    double ppm;             // codec rate error
+    double minutes;
+    double lose_at_s;       // DMA overrun: lose_ms of samples gone
+    double lose_ms;
+    double reopen_at_s;     // the record device reopened, 300 ms later
+    double stall_at_s;      // the reading task held up stall_ms, no samples lost
+    double stall_ms;
+} audio_run_t;
+
+/*
+ * Back to back reads, as the AFE feed task makes them. Collects how far the fitted capture time
+ * of each read's first sample is from the truth, after the first 10 s, in s_err, and returns
+ * how many reads were off by more than 5 ms.
+ */
+static int audio_run(const audio_run_t *run)
+{
+    double rate = 16000.0 * (1 + run->ppm * 1e-6);
+    double t_start = 1.5e6 + urand() * 1e5;
+    uint64_t captured = 0;
+    uint64_t read = 0;
+    double prev_done = 0, lost_us = 0;
+    uint32_t session = 1;
+    bool lost = false, reopened = false, stalled = false;
+    int bad = 0;
+
+    s_n_err = 0;
+    for (;;)
+    {
+        uint64_t end = captured + READ_SAMPLES;
+        uint64_t dma_end = (end + DMA_SAMPLES - 1) / DMA_SAMPLES * DMA_SAMPLES;
+        double t_first = t_start + lost_us + captured / rate * 1e6;
+        if (t_first / 1e6 > run->minutes * 60)
+        {
+            break;
+        }
+        double done = t_start + lost_us + dma_end / rate * 1e6 + expo(150) + (urand() < 0.01 ? expo(20000) : 0);
+        if (!stalled && run->stall_at_s > 0 && t_first / 1e6 > run->stall_at_s)
+        {
+            stalled = true;
+            done += run->stall_ms * 1000;
+        }
+        if (done < prev_done)
+        {
+            done = prev_done + expo(30);
+        }
+
+        host_time_set((int64_t)done);
+        bsp_mic_read_t r = { READ_SAMPLES * 2, (int64_t)done, 16000, 2, session };
+        s_mic_cb(&r);
+        read += READ_SAMPLES;
+
+        double err = fabs((double)debi_clock_audio_time(read - READ_SAMPLES) - t_first);
+        if (t_first > t_start + 10e6)
+        {
+            TEST_ASSERT_LESS_THAN_INT(READS_MAX, s_n_err);
+            s_err[s_n_err++] = err;
+            bad += err > 5000;
+        }
+        prev_done = done;
+        captured = end;
+
+        if (!lost && run->lose_at_s > 0 && t_first / 1e6 > run->lose_at_s)
+        {
+            lost = true;
+            lost_us += run->lose_ms * 1000;
+            prev_done += run->lose_ms * 1000;
+        }
+        if (!reopened && run->reopen_at_s > 0 && t_first / 1e6 > run->reopen_at_s)
+        {
+            reopened = true;
+            session++;
+            lost_us += 300000;
+            prev_done += 300000;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT64(read, debi_clock_audio_samples());
+    return bad;
+}
+
+typedef struct
+{
+    double skew_ppm;
+    double up_ms;           // base delay each way
+    double down_ms;
+    double queue_ms;        // mean queueing each way
+    double step_at_min;     // the hub clock steps 5 s here
+    double minutes;
+} hub_run_t;
+
+/*
+ * A ping every minute. Returns the worst error of debi_clock_to_hub() over the
+ * minute after the last pong.
+ */
+static double hub_run(const hub_run_t *run)
+{
+    const double offset = 1.234e12;
+    double step = 0;
+    double worst = 0;
+
+    for (double t = 3e6; t < run->minutes * 60e6; t += 60e6)
+    {
+        if (run->step_at_min > 0 && t >= run->step_at_min * 60e6)
+        {
+            step = 5e6;
+        }
+        double up = run->up_ms * 1e3 + expo(run->queue_ms * 1e3) + (urand() < 0.05 ? expo(300e3) : 0);
+        double down = run->down_ms * 1e3 + expo(run->queue_ms * 1e3) + (urand() < 0.05 ? expo(300e3) : 0);
+        double hub = offset + step + (t + up) * (1 + run->skew_ppm * 1e-6);
+        int64_t rx = (int64_t)(t + up + down);
+        host_time_set(rx);
+        debi_clock_hub_sample((int64_t)t, rx, (int64_t)hub);
+
+        worst = 0;
+        for (double u = rx; u < t + 60e6; u += 5e6)
+        {
+            double truth = offset + step + u * (1 + run->skew_ppm * 1e-6);
+            double e = fabs((double)debi_clock_to_hub((int64_t)u) - truth);
+            worst = e > worst ? e : worst;
+        }
+    }
+    return worst;
+}
+
+void setUp(void)
+{
+    host_time_reset();
+    TEST_ASSERT_EQUAL(ESP_OK, debi_clock_init());
+    TEST_ASSERT_NOT_NULL(s_mic_cb);
+    clock_reset();
+    s_rng = 0x9E3779B97F4A7C15ull;
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_before_init(void)
+{
+    SemaphoreHandle_t lock = s_clock.lock;
+    s_clock.lock = NULL;
+
+    debi_clock_hub_t hub;
+    debi_clock_audio_t audio;
+    TEST_ASSERT_FALSE(debi_clock_hub_sample(0, 1000, 5000));
+    TEST_ASSERT_FALSE(debi_clock_get_hub(&hub));
+    TEST_ASSERT_EQUAL_INT64(0, debi_clock_to_hub(1000));
+    TEST_ASSERT_EQUAL_INT64(0, debi_clock_audio_time(0));
+    TEST_ASSERT_EQUAL_UINT64(0, debi_clock_audio_samples());
+    debi_clock_get_audio(&audio);
+    TEST_ASSERT_EQUAL_UINT32(0, audio.rate);
+
+    s_clock.lock = lock;
+}
+
+static void test_audio_codec_rates(void)
+{
+    const double ppms[] = { 0, 40, -120, 400 };
+
+    for (size_t i = 0; i < sizeof(ppms) / sizeof(ppms[0]); i++)
+    {
+        clock_reset();
+        audio_run(&(audio_run_t){ .ppm = ppms[i], .minutes = 30 });
+
+        debi_clock_audio_t a;
+        debi_clock_get_audio(&a);
+        TEST_ASSERT_EQUAL_UINT32(16000, a.rate);
+        TEST_ASSERT_EQUAL_UINT32(0, a.segments);
+        TEST_ASSERT_FLOAT_WITHIN(10, ppms[i], a.rate_ppm);
+        // a read returns up to a DMA frame, 15 ms, and a scheduling delay after its samples
+        TEST_ASSERT_LESS_OR_EQUAL_INT(1000, (int)p99());
+    }
+}
+
+static void test_audio_lost_samples(void)
+{
+    int bad = audio_run(&(audio_run_t){ .ppm = 40, .minutes = 10, .lose_at_s = 200, .lose_ms = 180 });
+
+    debi_clock_audio_t a;
+    debi_clock_get_audio(&a);
+    TEST_ASSERT_EQUAL_UINT32(1, a.segments);
+    TEST_ASSERT_EQUAL_UINT32(1, a.gaps);
+    // off only until the late reads give the gap away
+    TEST_ASSERT_LESS_OR_EQUAL_INT(CLOCK_AUDIO_LATE_READS * 2, bad);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(1000, (int)p99());
+}
+
+static void test_audio_stalled_reader(void)
+{
+    // the DMA buffers hold 300 ms, the reads after the stall drain them back to back
+    int bad = audio_run(&(audio_run_t){ .ppm = -120, .minutes = 5, .stall_at_s = 100, .stall_ms = 300 });
+
+    debi_clock_audio_t a;
+    debi_clock_get_audio(&a);
+    TEST_ASSERT_EQUAL_UINT32(0, a.segments);
+    TEST_ASSERT_EQUAL_UINT32(0, a.gaps);
+    TEST_ASSERT_EQUAL_INT(0, bad);
+}
+
+static void test_audio_reopened(void)
+{
+    int bad = audio_run(&(audio_run_t){ .ppm = 40, .minutes = 10, .reopen_at_s = 300 });
+
+    debi_clock_audio_t a;
+    debi_clock_get_audio(&a);
+    TEST_ASSERT_EQUAL_UINT32(1, a.segments);
+    TEST_ASSERT_EQUAL_UINT32(0, a.gaps);
+    // the first reads of the new segment, until one returns right at the end of a DMA frame
+    TEST_ASSERT_LESS_OR_EQUAL_INT(DMA_CYCLE_READS, bad);
+
+    // samples from before the new session have no time any more
+    TEST_ASSERT_EQUAL_INT64(0, debi_clock_audio_time(0));
+}
+
+static void test_hub_skew(void)
+{
+    const hub_run_t runs[] = {
+        { .skew_ppm = 35, .up_ms = 2, .down_ms = 2, .queue_ms = 5, .minutes = 60 },
+        { .skew_ppm = -80, .up_ms = 6, .down_ms = 1, .queue_ms = 20, .minutes = 60 },
+        { .skew_ppm = 10, .up_ms = 15, .down_ms = 15, .queue_ms = 80, .minutes = 60 },     // busy WiFi
+    };
+
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+    {
+        clock_reset();
+        double worst = hub_run(&runs[i]);
+
+        // off by half the difference of an asymmetric path, nothing can tell, and by what even
+        // the best pongs queued
+        double bound = (runs[i].up_ms + runs[i].down_ms) * 1000 / 2 + 3000 + runs[i].queue_ms * 400;
+        TEST_ASSERT_LESS_OR_EQUAL_INT((int)bound, (int)worst);
+
+        debi_clock_hub_t h;
+        TEST_ASSERT_TRUE(debi_clock_get_hub(&h));
+        // a pong held up past DEBI_CLOCK_SYNC_RTT_MAX_MS now and then
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(55, h.samples);
+        // fitted over 16 pongs in 15 minutes; on a busy link only the mapping is good
+        if (runs[i].queue_ms <= 20)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(5 + runs[i].queue_ms, runs[i].skew_ppm, h.skew_ppm);
+        }
+    }
+}
+
+static void test_hub_clock_steps(void)
+{
+    // the pong after the step starts over: good to its RTT / 2, and the skew it lost for a minute
+    hub_run_t run = { .skew_ppm = 35, .up_ms = 2, .down_ms = 2, .queue_ms = 5, .step_at_min = 30, .minutes = 31 };
+    double worst = hub_run(&run);
+
+    debi_clock_hub_t h;
+    TEST_ASSERT_TRUE(debi_clock_get_hub(&h));
+    TEST_ASSERT_EQUAL_FLOAT(0, h.skew_ppm);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(h.err_us + 35 * 60 + 100, (int)worst);
+
+    // and the skew comes back
+    clock_reset();
+    run.minutes = 60;
+    TEST_ASSERT_LESS_OR_EQUAL_INT(5000, (int)hub_run(&run));
+    TEST_ASSERT_TRUE(debi_clock_get_hub(&h));
+    TEST_ASSERT_FLOAT_WITHIN(10, 35, h.skew_ppm);
+}
+
+static void test_hub_slow_pong_ignored(void)
+{
+    TEST_ASSERT_TRUE(debi_clock_hub_sample(1000000, 1004000, 5000000));
+    debi_clock_hub_t before;
+    TEST_ASSERT_TRUE(debi_clock_get_hub(&before));
+    TEST_ASSERT_EQUAL_INT64(5000000 - 1002000, before.offset_us);
+    TEST_ASSERT_EQUAL_INT32(2000, before.err_us);
+
+    // answered after the limit, or before it was asked
+    TEST_ASSERT_FALSE(debi_clock_hub_sample(2000000, 2000000 + DEBI_CLOCK_SYNC_RTT_MAX_MS * 1000LL + 1, 9000000));
+    TEST_ASSERT_FALSE(debi_clock_hub_sample(3000000, 2999999, 9000000));
+
+    debi_clock_hub_t after;
+    TEST_ASSERT_TRUE(debi_clock_get_hub(&after));
+    TEST_ASSERT_EQUAL_MEMORY(&before, &after, sizeof(before));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_before_init);
+    RUN_TEST(test_audio_codec_rates);
+    RUN_TEST(test_audio_lost_samples);
+    RUN_TEST(test_audio_stalled_reader);
+    RUN_TEST(test_audio_reopened);
+    RUN_TEST(test_hub_skew);
+    RUN_TEST(test_hub_clock_steps);
+    RUN_TEST(test_hub_slow_pong_ignored);
+    return UNITY_END();
+}
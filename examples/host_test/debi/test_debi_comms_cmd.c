@@ -0,0 +1,480 @@
+/*
+ * Command dispatch of debi_comms: the command table, argument checks, at-most-once cmd_ids and
+ * the rate limits, against retries, bursts, reboots and a corpus of fuzzed hub messages.
+ *
+ * The fakes of the modules a command drives print what they were asked to do, the way the
+ * corpus writes it. cmd_corpus.txt is made by cmd_corpus.py, whose model of the dispatcher
+ * gives the outcome of each message; the suite replays it and compares message by message.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "debi_comms.c"
+
+#define TRACE_MAX   16
+#define TRACE_LEN   1024            // an ack with a 300 byte cmd_id
+#define CORPUS_LINE_MAX 65536
+#define T_INIT      1000000LL       // as cmd_corpus.py starts the buckets
+#define SEC         1000000LL
+
+static int s_broker;
+static esp_mqtt_client_handle_t s_client = (esp_mqtt_client_handle_t)&s_broker;
+static char s_trace[TRACE_MAX][TRACE_LEN];
+static int s_n_trace;
+static bool s_quiet;
+
+/*************************************************************************
+ * What debi_comms links against
+ ************************************************************************/
+static void trace(const char *fmt, ...)
+{
+    if (s_quiet)
+    {
+        return;
+    }
+    TEST_ASSERT_LESS_THAN_INT(TRACE_MAX, s_n_trace);
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(s_trace[s_n_trace++], sizeof(s_trace[0]), fmt, ap);
+    va_end(ap);
+}
+
+// acks as they are, pong and health by name; the ping on connect is not the test's
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (len == 0)
+    {
+        len = strlen(data);
+    }
+    if (len > 8 && memcmp(data, "{\"ping\":", 8) == 0)
+    {
+        return 0;
+    }
+    cJSON *root = cJSON_ParseWithLength(data, len);
+    TEST_ASSERT_NOT_NULL(root);
+    if (cJSON_GetObjectItem(root, "ack"))
+    {
+        trace("%.*s", len, data);
+    }
+    else
+    {
+        trace("P %s", cJSON_IsTrue(cJSON_GetObjectItem(root, "pong")) ? "pong" : "health");
+    }
+    cJSON_Delete(root);
+    return 0;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    return 0;
+}
+
+esp_err_t debi_spool_init(debi_spool_send_t send)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool debi_spool_put(const char *topic, const void *data, size_t len, int qos, bool retain)
+{
+    return false;
+}
+
+void debi_spool_replay(int rtt_ms) {}
+void debi_spool_pause(void) {}
+
+void debi_spool_get_stats(debi_spool_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void debi_voice_set_volume(int volume) { trace("E volume %d", volume); }
+void debi_voice_set_mute(bool mute) { trace("E mute %d", mute); }
+void debi_voice_stop(void) { trace("E stop"); }
+void debi_voice_play_file(const char *filepath) { trace("E play %s", filepath); }
+void debi_camera_set_stream(debi_camera_stream_mode_t mode, float fps, int duration_s) { trace("E stream %d %g %d", mode, fps, duration_s); }
+float debi_camera_get_fps(void) { return 0.0f; }
+void debi_os_set_mode(debi_mode_t mode) { trace("E set_mode %d", mode); }
+void debi_os_report_sensors(void) { trace("E report"); }
+void debi_audio_set_mode(debi_audio_mode_t mode, int duration_s) { trace("E audio %d %d", mode, duration_s); }
+void debi_audio_set_encoder(int bitrate, int complexity) { trace("E encoder %d %d", bitrate, complexity); }
+debi_audio_mode_t debi_audio_get_mode(void) { return DEBI_AUDIO_MODE_VAD; }
+void debi_hub_get_status(debi_hub_status_t *out) { memset(out, 0, sizeof(*out)); }
+const char *debi_hub_source_name(debi_hub_source_t src) { return "default"; }
+bool debi_clock_hub_sample(int64_t t0_us, int64_t rx_us, int64_t hub_us) { return false; }
+bool debi_clock_get_hub(debi_clock_hub_t *out) { return false; }
+void debi_clock_get_audio(debi_clock_audio_t *out) { memset(out, 0, sizeof(*out)); }
+void debi_audio_get_stats(debi_audio_stats_t *out) { memset(out, 0, sizeof(*out)); }
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+// the reboot waits for its ack to go out, not in virtual time
+static void no_delay(uint32_t ticks)
+{
+}
+
+static void boot(void)
+{
+    host_time_reset();
+    host_time_set(T_INIT);
+    memset(s_cmd_seen, 0, sizeof(s_cmd_seen));
+    debi_comms_init();
+    TEST_ASSERT_TRUE(s_comms.initialised);
+    debi_comms_on_connected(s_client);
+}
+
+static void comms_stop(void)
+{
+    debi_comms_on_disconnected();
+    debi_comms_deinit();
+}
+
+// one message at a time, the trace is what it did; a restart shows as the effect "reboot"
+static void cmd_at(int64_t us, const char *json)
+{
+    unsigned restarts = host_restarts();
+
+    s_n_trace = 0;
+    host_time_set(us);
+    debi_comms_handle_message(DEBI_TOPIC_CMD, json, strlen(json));
+    if (host_restarts() != restarts)
+    {
+        trace("E reboot");
+    }
+}
+
+static int effects(void)
+{
+    int n = 0;
+    for (int i = 0; i < s_n_trace; i++)
+    {
+        n += strncmp(s_trace[i], "E ", 2) == 0;
+    }
+    return n;
+}
+
+static bool traced(const char *what)
+{
+    for (int i = 0; i < s_n_trace; i++)
+    {
+        if (strcmp(s_trace[i], what) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the last ack: its status, detail and dup flag
+static void assert_ack(const char *status, const char *cmd_id, const char *detail, bool dup)
+{
+    TEST_ASSERT_GREATER_THAN_INT(0, s_n_trace);
+    cJSON *ack = cJSON_Parse(s_trace[s_n_trace - 1]);
+    TEST_ASSERT_NOT_NULL(ack);
+    TEST_ASSERT_EQUAL_STRING(status, cJSON_GetStringValue(cJSON_GetObjectItem(ack, "ack")));
+    TEST_ASSERT_EQUAL_STRING(cmd_id, cJSON_GetStringValue(cJSON_GetObjectItem(ack, "cmd_id")));
+    TEST_ASSERT_EQUAL_STRING(detail, cJSON_GetStringValue(cJSON_GetObjectItem(ack, "detail")));
+    TEST_ASSERT_EQUAL(dup, cJSON_IsTrue(cJSON_GetObjectItem(ack, "dup")));
+    cJSON_Delete(ack);
+}
+
+// an ack the corpus expects against the one sent: the same fields, but for ts
+static bool ack_same(const char *want, const char *got)
+{
+    static const char *const FIELDS[] = { "ack", "cmd_id", "detail", "dup" };
+    cJSON *a = cJSON_Parse(want), *b = cJSON_Parse(got);
+    bool same = a && b;
+    for (size_t i = 0; same && i < sizeof(FIELDS) / sizeof(FIELDS[0]); i++)
+    {
+        const cJSON *x = cJSON_GetObjectItem(a, FIELDS[i]), *y = cJSON_GetObjectItem(b, FIELDS[i]);
+        same = (!x && !y) || (x && y && cJSON_Compare(x, y, true));
+    }
+    cJSON_Delete(a);
+    cJSON_Delete(b);
+    return same;
+}
+
+typedef struct
+{
+    char want[TRACE_MAX][TRACE_LEN];
+    int n_want;
+    int line;
+    bool open;
+} corpus_msg_t;
+
+static int s_mismatches;
+
+static void corpus_check(corpus_msg_t *m)
+{
+    m->open = false;
+    if (s_quiet)
+    {
+        return;
+    }
+    bool same = m->n_want == s_n_trace;
+    for (int i = 0; same && i < s_n_trace; i++)
+    {
+        same = m->want[i][0] == '{' ? ack_same(m->want[i], s_trace[i]) : strcmp(m->want[i], s_trace[i]) == 0;
+    }
+    if (!same && s_mismatches++ < 5)
+    {
+        printf("cmd_corpus.txt:%d: %d expected, %d done\n", m->line, m->n_want, s_n_trace);
+        for (int i = 0; i < m->n_want; i++)
+        {
+            printf("  want %s\n", m->want[i]);
+        }
+        for (int i = 0; i < s_n_trace; i++)
+        {
+            printf("  got  %s\n", s_trace[i]);
+        }
+    }
+}
+
+/* replay the corpus, each message checked against its expectations; the number of messages */
+static int corpus_replay(void)
+{
+    static char line[CORPUS_LINE_MAX];
+    static corpus_msg_t m;
+    int64_t now = T_INIT;
+    int n = 0, at = 0;
+
+    FILE *f = fopen(HOST_TEST_CMD_CORPUS, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, HOST_TEST_CMD_CORPUS);
+    m.open = false;
+    while (fgets(line, sizeof(line), f))
+    {
+        size_t len = strlen(line);
+        at++;
+        TEST_ASSERT_TRUE_MESSAGE(len && line[len - 1] == '\n', "line too long");
+        line[--len] = '\0';
+        if (line[0] == 't')
+        {
+            now = strtoll(line + 2, NULL, 10);
+        }
+        else if (line[0] == '>')
+        {
+            if (m.open)
+            {
+                corpus_check(&m);
+            }
+            cmd_at(now, line + 2);
+            m = (corpus_msg_t){ .line = at, .open = true };
+            n++;
+        }
+        else if (line[0] == '<')
+        {
+            TEST_ASSERT_LESS_THAN_INT(TRACE_MAX, m.n_want);
+            snprintf(m.want[m.n_want++], sizeof(m.want[0]), "%s", line + 2);
+        }
+    }
+    if (m.open)
+    {
+        corpus_check(&m);
+    }
+    fclose(f);
+    return n;
+}
+
+void setUp(void)
+{
+    host_nvs_erase_all();
+    host_task_delay_hook(no_delay);
+    s_quiet = false;
+    s_mismatches = 0;
+    boot();
+    s_comms.cmd_dup_count = 0;
+    s_comms.cmd_limited_count = 0;
+}
+
+void tearDown(void)
+{
+    comms_stop();
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_table_sorted(void)
+{
+    for (size_t i = 1; i < CMD_COUNT; i++)
+    {
+        TEST_ASSERT_LESS_THAN_INT(0, strcmp(CMD_TABLE[i - 1].name, CMD_TABLE[i].name));
+    }
+    for (size_t i = 0; i < CMD_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_PTR(&CMD_TABLE[i], cmd_find(CMD_TABLE[i].name));
+    }
+    TEST_ASSERT_NULL(cmd_find(""));
+    TEST_ASSERT_NULL(cmd_find("zzz"));
+    TEST_ASSERT_NULL(cmd_find("Audio"));
+}
+
+// the hub retried an alarm: it goes off once, the retry gets the same ack marked dup
+static void test_retry_runs_once(void)
+{
+    cmd_at(1 * SEC, "{\"cmd\":\"set_mode\",\"mode\":\"alert\",\"cmd_id\":\"a1\"}");
+    TEST_ASSERT_TRUE(traced("E set_mode 4"));
+    assert_ack("ok", "a1", "alert", false);
+
+    cmd_at(2 * SEC, "{\"cmd\":\"set_mode\",\"mode\":\"alert\",\"cmd_id\":\"a1\"}");
+    TEST_ASSERT_EQUAL_INT(0, effects());
+    assert_ack("ok", "a1", "alert", true);
+    TEST_ASSERT_EQUAL_INT(1, s_comms.cmd_dup_count);
+}
+
+static void test_read_only_answered_again(void)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        cmd_at((i + 1) * SEC, "{\"cmd\":\"ping\",\"cmd_id\":\"p\"}");
+        TEST_ASSERT_EQUAL_INT(1, s_n_trace);
+        TEST_ASSERT_EQUAL_STRING("P pong", s_trace[0]);
+    }
+    TEST_ASSERT_EQUAL_INT(0, s_comms.cmd_dup_count);
+}
+
+// play_sound: 5 at once, then one a second; a refused id is not remembered, its retry runs
+static void test_rate_limit(void)
+{
+    char msg[64];
+    int ran = 0;
+
+    for (int i = 0; i < 7; i++)
+    {
+        snprintf(msg, sizeof(msg), "{\"cmd\":\"play_sound\",\"file\":\"f\",\"cmd_id\":\"s%d\"}", i);
+        cmd_at(1 * SEC, msg);
+        ran += effects();
+    }
+    TEST_ASSERT_EQUAL_INT(5, ran);
+    assert_ack("error", "s6", "rate limited", false);
+    TEST_ASSERT_EQUAL_INT(2, s_comms.cmd_limited_count);
+
+    cmd_at(2 * SEC - 1, msg);
+    assert_ack("error", "s6", "rate limited", false);
+    cmd_at(2 * SEC, msg);
+    TEST_ASSERT_TRUE(traced("E play f"));
+    assert_ack("ok", "s6", "playing", false);
+}
+
+static void test_reboot_once_a_minute(void)
+{
+    cmd_at(1 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r1\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+    cmd_at(30 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r2\"}");
+    TEST_ASSERT_EQUAL_INT(0, effects());
+    assert_ack("error", "r2", "rate limited", false);
+    cmd_at(62 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r3\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+}
+
+// the reboot's id is in NVS before it restarts: the retry after boot is a dup, not a reboot loop
+static void test_reboot_retry_after_boot(void)
+{
+    unsigned writes = host_nvs_writes();
+    cmd_at(5 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r1\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+    TEST_ASSERT_EQUAL_STRING("E reboot", s_trace[s_n_trace - 1]);
+    TEST_ASSERT_EQUAL_UINT(writes + 1, host_nvs_writes());
+
+    comms_stop();
+    boot();
+    cmd_at(T_INIT + 1 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r1\"}");
+    TEST_ASSERT_EQUAL_INT(0, effects());
+    assert_ack("ok", "r1", "rebooting", true);
+
+    // another reboot is one
+    cmd_at(T_INIT + 2 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r2\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+
+    // other commands stay in RAM
+    cmd_at(T_INIT + 3 * SEC, "{\"cmd\":\"stop_sound\",\"cmd_id\":\"x1\"}");
+    TEST_ASSERT_EQUAL_UINT(writes + 2, host_nvs_writes());
+    comms_stop();
+    boot();
+    cmd_at(T_INIT + 1 * SEC, "{\"cmd\":\"stop_sound\",\"cmd_id\":\"x1\"}");
+    TEST_ASSERT_TRUE(traced("E stop"));
+    cmd_at(T_INIT + 2 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r2\"}");
+    assert_ack("ok", "r2", "rebooting", true);
+}
+
+// a saved id that does not fit is ignored, and a failed save still reboots
+static void test_reboot_saved_id_bad(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, storage_write(DEBI_COMMS_CMD_STORAGE, "r1", 3));
+    comms_stop();
+    boot();
+    cmd_at(T_INIT + 1 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r1\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+
+    host_nvs_erase_all();
+    host_nvs_fail_writes(true);
+    cmd_at(T_INIT + 100 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r2\"}");
+    host_nvs_fail_writes(false);
+    TEST_ASSERT_TRUE(traced("E reboot"));
+    comms_stop();
+    boot();
+    cmd_at(T_INIT + 1 * SEC, "{\"cmd\":\"reboot\",\"cmd_id\":\"r2\"}");
+    TEST_ASSERT_TRUE(traced("E reboot"));
+}
+
+// the 33rd new id pushes out the least recently used one
+static void test_lru(void)
+{
+    char msg[64];
+
+    for (int i = 0; i <= DEBI_COMMS_CMD_IDS; i++)
+    {
+        snprintf(msg, sizeof(msg), "{\"cmd\":\"stop_sound\",\"cmd_id\":\"l%d\"}", i);
+        cmd_at((i + 1) * SEC, msg);
+        TEST_ASSERT_TRUE(traced("E stop"));
+    }
+    cmd_at(100 * SEC, "{\"cmd\":\"stop_sound\",\"cmd_id\":\"l1\"}");
+    assert_ack("ok", "l1", "stopped", true);
+    cmd_at(101 * SEC, "{\"cmd\":\"stop_sound\",\"cmd_id\":\"l0\"}");
+    TEST_ASSERT_TRUE(traced("E stop"));
+    assert_ack("ok", "l0", "stopped", false);
+}
+
+static void test_corpus(void)
+{
+    int n = corpus_replay();
+
+    TEST_ASSERT_GREATER_THAN_INT(1000, n);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, s_mismatches, "messages not handled as cmd_corpus.py expects");
+}
+
+// host cost of a message through parse and dispatch, for comparison
+static void test_dispatch_cost(void)
+{
+    struct timespec a, b;
+
+    s_quiet = true;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    int n = 0;
+    for (int i = 0; i < 5; i++)
+    {
+        n += corpus_replay();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    printf("%.0f ns per message over %d\n", ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / n, n);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_table_sorted);
+    RUN_TEST(test_retry_runs_once);
+    RUN_TEST(test_read_only_answered_again);
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_reboot_once_a_minute);
+    RUN_TEST(test_reboot_retry_after_boot);
+    RUN_TEST(test_reboot_saved_id_bad);
+    RUN_TEST(test_lru);
+    RUN_TEST(test_corpus);
+    RUN_TEST(test_dispatch_cost);
+    return UNITY_END();
+}
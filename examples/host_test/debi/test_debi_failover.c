@@ -0,0 +1,595 @@
+/*
+ * Local-only safety mode of debi_os (app/debi_failover.c): the fall heuristic on recorded-like
+ * box sequences, the alarm it raises and clears, and the hub watch.
+ *
+ * The scenes are made up the way the person model and ByteTrack report them at 10 Hz: a standing
+ * box that turns into a lying one, with box noise, missed frames, new track ids, and the
+ * postures that must not raise it (sitting, bending, lying down slowly). Every scene runs many
+ * times with random sizes, places and timings.
+ */
+#include <math.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "debi_failover.c"
+
+#define TRIALS      300
+#define FRAME_S     0.1
+
+static debi_mode_t s_mode;
+static int s_holds;
+static bool s_held;
+static int s_reports;
+static double s_report_t;
+static double s_now;
+static volatile bool s_hub_healthy;
+static volatile bool s_local_only_set;
+static volatile unsigned s_ticks;
+static volatile unsigned s_local_only_ticks;
+static uint64_t s_rng;
+
+/*************************************************************************
+ * What debi_failover links against
+ ************************************************************************/
+bool debi_comms_hub_healthy(void)
+{
+    return s_hub_healthy;
+}
+
+esp_err_t debi_taskflow_set_local_only(bool on)
+{
+    s_local_only_set = on;
+    s_local_only_ticks = s_ticks;
+    return ESP_OK;
+}
+
+void debi_face_bridge_hold(int state)
+{
+    TEST_ASSERT_EQUAL_INT(FACE_STATE_ALERT_FALL, state);
+    s_held = true;
+    s_holds++;
+}
+
+void debi_face_bridge_release(void)
+{
+    s_held = false;
+}
+
+debi_mode_t debi_os_get_mode(void)
+{
+    return s_mode;
+}
+
+// as debi_os does it: leaving ALERT releases the hold
+void debi_os_set_mode(debi_mode_t mode)
+{
+    if (mode == s_mode)
+    {
+        return;
+    }
+    if (s_mode == DEBI_MODE_ALERT)
+    {
+        debi_face_bridge_release();
+    }
+    s_mode = mode;
+}
+
+void debi_os_report_detection(const char *type, int score)
+{
+    TEST_ASSERT_EQUAL_STRING("fall_suspect", type);
+    if (s_reports++ == 0)
+    {
+        s_report_t = s_now;
+    }
+}
+
+/*************************************************************************
+ * Scenes
+ ************************************************************************/
+typedef enum {
+    // a fall, the alarm must go
+    WALK_FALL_STILL,
+    FALL_DROPOUTS,          // 30% of the frames missed, and a 2 s gap
+    FALL_REID,              // the tracker gives the person a new id while down
+    FALL_ALERT_GET_UP,      // up again after the alert, the alarm clears
+    FALL_CRAWL_STILL,       // crawls for 8 s, then lies still
+    // no alarm
+    FALL_GET_UP_QUICK,
+    FALL_UP_NEW_ID,
+    SLOW_LIE_DOWN,
+    SIT_THEN_LIE,
+    SIT,
+    BEND,
+    PICK_UP,
+    JITTER,                 // standing, a noisy box
+    WALK_ABOUT,             // nearer and further, the box grows and shrinks
+    SCENE_MAX,
+} scene_kind_t;
+
+#define FALL_SCENES FALL_GET_UP_QUICK
+
+static const char *SCENE_NAMES[SCENE_MAX] = {
+    "walk, fall, lie still", "fall, dropouts and a gap", "fall, new id while down", "fall, alert, get up",
+    "fall, crawl, lie still", "fall, get up after 2 s", "fall, up with a new id", "slow lie down",
+    "sit, then lie down", "sit down", "bend over", "crouch to pick up", "stand, jitter", "walk about",
+};
+
+typedef struct {
+    double x, y, w, h;
+} rect_t;
+
+typedef struct {
+    scene_kind_t kind;
+    rect_t up;              // standing box
+    rect_t down;            // lying box
+    double t_fall;
+    double dur_fall;
+    double t_up;
+    double t_end;
+    double noise;
+    double walk_v;
+    double crawl_s;
+} scene_t;
+
+static double urand(double a, double b)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return a + (b - a) * ((s_rng >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static double gauss(void)
+{
+    double u = urand(1e-9, 1), v = urand(0, 1);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static rect_t lerp(rect_t a, rect_t b, double f)
+{
+    f = f < 0 ? 0 : f > 1 ? 1 : f;
+    return (rect_t){ a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f, a.w + (b.w - a.w) * f, a.h + (b.h - a.h) * f };
+}
+
+static void scene_make(scene_t *s, scene_kind_t kind)
+{
+    double h = urand(110, 220), w = h * urand(0.32, 0.5);
+    double lying_w = h * urand(0.85, 1.05), lying_h = w * urand(0.7, 1.1);
+
+    s->kind = kind;
+    s->up = (rect_t){ urand(100, 300), urand(120, 180), w, h };
+    s->down = (rect_t){ s->up.x + urand(-0.4, 0.4) * h, s->up.y + h / 2 - lying_h / 2 + urand(-5, 5), lying_w, lying_h };
+    s->t_fall = urand(3, 8);
+    switch (kind)
+    {
+        case SLOW_LIE_DOWN:
+            s->dur_fall = urand(3, 6);
+            break;
+        case SIT:
+            s->dur_fall = urand(0.6, 1.5);
+            break;
+        case SIT_THEN_LIE:
+            s->dur_fall = urand(1.0, 2.5);
+            break;
+        default:
+            s->dur_fall = urand(0.3, 0.9);
+            break;
+    }
+    s->walk_v = kind == JITTER || kind == SIT ? 0 : urand(-25, 25);
+    s->noise = urand(0.01, 0.04);
+    s->crawl_s = 8;
+    s->t_up = s->t_fall + s->dur_fall + (kind == FALL_ALERT_GET_UP ? urand(8, 15) : urand(1.0, 2.5));
+    s->t_end = s->t_fall + 40;
+}
+
+/* the box of the person at t, false if the detector missed them */
+static bool scene_frame(const scene_t *s, double t, rect_t *out, uint16_t *id)
+{
+    double t_fell = s->t_fall + s->dur_fall;
+    rect_t up = s->up, b = s->up;
+    up.x += s->walk_v * s->t_fall;
+    rect_t down = s->down;
+    down.x = up.x + (s->down.x - s->up.x);
+    rect_t sit = { up.x, up.y + up.h * 0.2, up.w * 1.3, up.h * 0.62 };
+
+    *id = 1;
+    if (t < s->t_fall)
+    {
+        b.x += s->walk_v * t;
+    }
+    switch (s->kind)
+    {
+        case WALK_FALL_STILL:
+        case FALL_DROPOUTS:
+        case FALL_REID:
+        case FALL_ALERT_GET_UP:
+        case FALL_CRAWL_STILL:
+        case FALL_GET_UP_QUICK:
+        case FALL_UP_NEW_ID:
+        case SLOW_LIE_DOWN:
+            if (t >= s->t_fall)
+            {
+                b = lerp(up, down, (t - s->t_fall) / s->dur_fall);
+            }
+            if (s->kind == FALL_CRAWL_STILL && t >= t_fell)
+            {
+                b.x += 12 * fmin(t - t_fell, s->crawl_s);
+            }
+            if ((s->kind == FALL_ALERT_GET_UP || s->kind == FALL_GET_UP_QUICK || s->kind == FALL_UP_NEW_ID) && t >= s->t_up)
+            {
+                b = lerp(down, up, (t - s->t_up) / 1.2);
+            }
+            if (s->kind == FALL_UP_NEW_ID && t >= s->t_up - 1.0)
+            {
+                if (t < s->t_up)
+                {
+                    return false;
+                }
+                *id = 2;
+            }
+            if (s->kind == FALL_DROPOUTS && t > s->t_fall && ((t > t_fell + 1 && t < t_fell + 3) || urand(0, 1) < 0.3))
+            {
+                return false;
+            }
+            if (s->kind == FALL_REID && t > t_fell + 1.5)
+            {
+                if (t < t_fell + 3.5)
+                {
+                    return false;
+                }
+                *id = 2;
+            }
+            break;
+        case SIT_THEN_LIE:
+            if (t >= s->t_fall)
+            {
+                b = lerp(up, sit, t - s->t_fall);
+            }
+            if (t >= s->t_fall + 3)
+            {
+                b = lerp(sit, down, (t - s->t_fall - 3) / s->dur_fall);
+            }
+            break;
+        case SIT:
+            if (t >= s->t_fall)
+            {
+                b = lerp(up, sit, (t - s->t_fall) / s->dur_fall);
+            }
+            break;
+        case BEND:
+        case PICK_UP:
+        {
+            rect_t bend = s->kind == BEND ? (rect_t){ up.x, up.y + up.h * 0.15, up.w * 1.8, up.h * 0.7 }
+                                          : (rect_t){ up.x, up.y + up.h * 0.25, up.w * 1.2, up.h * 0.5 };
+            if (t >= s->t_fall && t < s->t_fall + 2.6)
+            {
+                b = lerp(up, bend, (t - s->t_fall) / 0.6);
+            }
+            if (t >= s->t_fall + 2.6)
+            {
+                b = lerp(bend, up, (t - s->t_fall - 2.6) / 0.8);
+            }
+            break;
+        }
+        case JITTER:
+            break;
+        case WALK_ABOUT:
+        {
+            double k = 0.7 + 0.5 * (1 + sin(t * 0.3)) / 2;
+            b.x = up.x + 80 * sin(t * 0.4);
+            b.w = up.w * k;
+            b.h = up.h * k;
+            b.y = up.y + 40 * (k - 0.7);
+            break;
+        }
+        default:
+            break;
+    }
+
+    double noise = s->noise;
+    out->x = b.x + gauss() * noise * b.w;
+    out->y = b.y + gauss() * noise * b.h;
+    out->w = b.w * (1 + gauss() * (s->kind == JITTER ? 0.1 : noise));
+    out->h = b.h * (1 + gauss() * (s->kind == JITTER ? 0.1 : noise));
+    out->x = fmin(fmax(out->x, 10), 630);
+    return out->w > 4 && out->h > 4;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static void observe(int n, const sscma_client_box_t *boxes, const uint16_t *ids, double t)
+{
+    struct tf_data_inference_info info = {
+        .is_valid = true,
+        .type = INFERENCE_TYPE_BOX,
+        .p_data = (void *)boxes,
+        .cnt = n,
+    };
+
+    s_now = t;
+    debi_failover_observe(&info, ids, (int64_t)(t * 1e6));
+}
+
+static void observe_one(int x, int y, int w, int h, uint16_t id, double t)
+{
+    sscma_client_box_t box = { x, y, w, h, 80, 0 };
+    observe(1, &box, &id, t);
+}
+
+/* a person falls at t and lies still, the frames up to until */
+static double fall(uint16_t id, double t, double until)
+{
+    for (; t < until; t += FRAME_S)
+    {
+        if (t < 1)
+        {
+            observe_one(200, 100, 60, 160, id, t);
+        }
+        else
+        {
+            observe_one(160, 200, 150, 60, id, t);
+        }
+    }
+    return t;
+}
+
+static double stand(uint16_t id, double t, double until)
+{
+    for (; t < until; t += FRAME_S)
+    {
+        observe_one(200, 100, 60, 160, id, t);
+    }
+    return t;
+}
+
+typedef struct {
+    int alerts;
+    int cleared;
+    double latency_med;
+    double latency_max;
+} scene_result_t;
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static scene_result_t scene_run(scene_kind_t kind)
+{
+    static double latency[TRIALS];
+    scene_result_t r = { 0 };
+
+    for (int k = 0; k < TRIALS; k++)
+    {
+        scene_t s;
+        rect_t b;
+        uint16_t id;
+
+        memset(&s_failover, 0, sizeof(s_failover));
+        s_failover.local_only = true;
+        s_mode = DEBI_MODE_ACTIVE;
+        s_held = false;
+        s_holds = 0;
+        s_reports = 0;
+        scene_make(&s, kind);
+
+        for (double t = 0; t < s.t_end; t += FRAME_S)
+        {
+            if (scene_frame(&s, t, &b, &id))
+            {
+                sscma_client_box_t box = { b.x, b.y, b.w, b.h, (uint8_t)urand(55, 95), 0 };
+                observe(1, &box, &id, t);
+            }
+            else
+            {
+                observe(0, NULL, &id, t);
+            }
+        }
+        if (s_reports)
+        {
+            latency[r.alerts++] = s_report_t - (s.t_fall + s.dur_fall + (kind == FALL_CRAWL_STILL ? s.crawl_s : 0));
+        }
+        if (s_holds && !s_held && s_mode == DEBI_MODE_ACTIVE)
+        {
+            r.cleared++;
+        }
+    }
+    if (r.alerts)
+    {
+        qsort(latency, r.alerts, sizeof(latency[0]), cmp_double);
+        r.latency_med = latency[r.alerts / 2];
+        r.latency_max = latency[r.alerts - 1];
+    }
+    return r;
+}
+
+static void tick_hook(uint32_t ticks)
+{
+    s_ticks++;
+    usleep(100);
+}
+
+void setUp(void)
+{
+    memset(&s_failover.tracks, 0, sizeof(s_failover.tracks));
+    memset(&s_failover.stats, 0, sizeof(s_failover.stats));
+    s_failover.local_only = false;
+    s_failover.alarm = false;
+    s_mode = DEBI_MODE_ACTIVE;
+    s_held = false;
+    s_holds = 0;
+    s_reports = 0;
+    s_rng = 0x46464646;
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_scenes(void)
+{
+    int missed = 0, false_alarms = 0;
+
+    for (scene_kind_t kind = 0; kind < SCENE_MAX; kind++)
+    {
+        scene_result_t r = scene_run(kind);
+
+        printf("%-26s %3d/%d alerts  latency median %4.1f s  max %4.1f s  cleared %d\n", SCENE_NAMES[kind], r.alerts,
+               TRIALS, r.latency_med, r.latency_max, r.cleared);
+        if (kind < FALL_SCENES)
+        {
+            // no more than 2% missed, and the alarm within the stillness wait and a restart of it
+            TEST_ASSERT_GREATER_OR_EQUAL_INT_MESSAGE(TRIALS * 98 / 100, r.alerts, SCENE_NAMES[kind]);
+            TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(2.0 * DEBI_FAILOVER_STILL_MS / 1000, r.latency_med, SCENE_NAMES[kind]);
+            TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(3.0 * DEBI_FAILOVER_STILL_MS / 1000, r.latency_max, SCENE_NAMES[kind]);
+            missed += TRIALS - r.alerts;
+        }
+        else
+        {
+            TEST_ASSERT_LESS_OR_EQUAL_INT_MESSAGE(TRIALS / 100, r.alerts, SCENE_NAMES[kind]);
+            false_alarms += r.alerts;
+        }
+        if (kind == FALL_ALERT_GET_UP)
+        {
+            TEST_ASSERT_EQUAL_INT_MESSAGE(r.alerts, r.cleared, SCENE_NAMES[kind]);
+        }
+    }
+    printf("missed %d of %d falls, %d false alarms in %d\n", missed, FALL_SCENES * TRIALS, false_alarms,
+           (SCENE_MAX - FALL_SCENES) * TRIALS);
+}
+
+static void test_alarm_and_recovery(void)
+{
+    s_failover.local_only = true;
+
+    double t = fall(1, 0, 1 + DEBI_FAILOVER_STILL_MS / 1000.0 - 0.5);
+    TEST_ASSERT_EQUAL_INT(0, s_reports);
+    t = fall(1, t, t + 1);
+    TEST_ASSERT_EQUAL_INT(1, s_reports);
+    TEST_ASSERT_EQUAL(DEBI_MODE_ALERT, s_mode);
+    TEST_ASSERT_TRUE(s_held);
+
+    // down for good: the alarm stays, however long
+    t = fall(1, t, t + 60);
+    TEST_ASSERT_EQUAL_INT(1, s_reports);
+    TEST_ASSERT_TRUE(s_held);
+
+    // up, but not for long enough
+    t = stand(1, t, t + DEBI_FAILOVER_RECOVER_MS / 1000.0 - 0.5);
+    t = fall(1, t, t + 1);
+    TEST_ASSERT_TRUE(s_held);
+
+    t = stand(1, t, t + DEBI_FAILOVER_RECOVER_MS / 1000.0 + 0.5);
+    TEST_ASSERT_FALSE(s_held);
+    TEST_ASSERT_EQUAL(DEBI_MODE_ACTIVE, s_mode);
+    TEST_ASSERT_EQUAL_UINT32(1, s_failover.stats.local_alarms);
+    TEST_ASSERT_EQUAL_UINT32(1, s_failover.stats.recovered);
+}
+
+static void test_hub_up_only_reports(void)
+{
+    fall(1, 0, 20);
+    TEST_ASSERT_EQUAL_INT(1, s_reports);
+    TEST_ASSERT_EQUAL(DEBI_MODE_ACTIVE, s_mode);
+    TEST_ASSERT_EQUAL_INT(0, s_holds);
+    TEST_ASSERT_EQUAL_UINT32(0, s_failover.stats.local_alarms);
+}
+
+static void test_mode_left_by_hub(void)
+{
+    s_failover.local_only = true;
+    fall(1, 0, 10);
+    TEST_ASSERT_EQUAL(DEBI_MODE_ALERT, s_mode);
+
+    // the hub is back and says night: the alarm is over, getting up leaves the mode alone
+    debi_os_set_mode(DEBI_MODE_NIGHT);
+    TEST_ASSERT_FALSE(s_held);
+    stand(1, 10, 20);
+    TEST_ASSERT_EQUAL(DEBI_MODE_NIGHT, s_mode);
+    TEST_ASSERT_FALSE(s_failover.alarm);
+}
+
+static void test_fallen_tracks_keep_their_slot(void)
+{
+    sscma_client_box_t boxes[DEBI_TRACKS_MAX_BOXES];
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+    double t;
+
+    s_failover.local_only = true;
+    fall(1, 0, 10);
+    TEST_ASSERT_EQUAL_UINT32(1, s_failover.stats.alerts);
+
+    // a crowd walks in, more than there are slots
+    for (t = 10; t < 12; t += FRAME_S)
+    {
+        for (int i = 0; i < DEBI_FAILOVER_TRACKS + 2; i++)
+        {
+            boxes[i] = (sscma_client_box_t){ 400 + 10 * i, 100, 40, 120, 80, 0 };
+            ids[i] = 10 + i;
+        }
+        observe(DEBI_FAILOVER_TRACKS + 2, boxes, ids, t);
+    }
+    bool kept = false;
+    for (int i = 0; i < DEBI_FAILOVER_TRACKS; i++)
+    {
+        kept |= s_failover.tracks[i].id == 1 && s_failover.tracks[i].phase == FALL_ALERT;
+    }
+    TEST_ASSERT_TRUE(kept);
+    TEST_ASSERT_TRUE(s_held);
+
+    // and the fallen person is still followed: getting up clears the alarm
+    stand(1, t, t + DEBI_FAILOVER_RECOVER_MS / 1000.0 + 0.5);
+    TEST_ASSERT_FALSE(s_held);
+}
+
+static void test_hub_watch(void)
+{
+    unsigned start;
+
+    host_task_delay_hook(tick_hook);
+    s_hub_healthy = true;
+    TEST_ASSERT_EQUAL(ESP_OK, debi_failover_init());
+
+    start = s_ticks;
+    s_hub_healthy = false;
+    for (int i = 0; i < 5000 && !debi_failover_local_only(); i++)
+    {
+        usleep(1000);
+    }
+    TEST_ASSERT_TRUE(debi_failover_local_only());
+    TEST_ASSERT_TRUE(s_local_only_set);
+    TEST_ASSERT_UINT_WITHIN(1, start + DEBI_FAILOVER_ENTER_S, s_local_only_ticks);
+
+    start = s_ticks;
+    s_hub_healthy = true;
+    for (int i = 0; i < 5000 && debi_failover_local_only(); i++)
+    {
+        usleep(1000);
+    }
+    TEST_ASSERT_FALSE(debi_failover_local_only());
+    TEST_ASSERT_FALSE(s_local_only_set);
+    TEST_ASSERT_UINT_WITHIN(1, start + DEBI_FAILOVER_EXIT_S, s_local_only_ticks);
+
+    debi_failover_stats_t stats;
+    debi_failover_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failovers);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scenes);
+    RUN_TEST(test_alarm_and_recovery);
+    RUN_TEST(test_hub_up_only_reports);
+    RUN_TEST(test_mode_left_by_hub);
+    RUN_TEST(test_fallen_tracks_keep_their_slot);
+    RUN_TEST(test_hub_watch);
+    return UNITY_END();
+}
@@ -0,0 +1,642 @@
+/*
+ * Hub discovery of debi_os (app/debi_hub.c): the connection rounds against a simulated network
+ * of brokers and mDNS answers.
+ *
+ * The test stands in for the debi_hub task: it calls hub_step() with the events and timeouts
+ * the task would have woken up for, in virtual time, so that a run of backoffs up to the
+ * 60 s cap takes no time. A broker answers a new client after a while, refuses it at once, or
+ * never answers; mDNS answers with hubs that carry an address or only a hostname. The saved
+ * configuration goes through the firmware's storage calls to the NVS stub.
+ */
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// no debi_hub task, the test runs hub_step() itself with what was notified
+#define FAKE_TASK ((TaskHandle_t)1)
+static uint32_t s_notified;
+static BaseType_t fake_task_create(TaskHandle_t *task)
+{
+    *task = FAKE_TASK;
+    return pdPASS;
+}
+static void fake_notify(uint32_t ev)
+{
+    s_notified |= ev;
+}
+#undef xTaskCreate
+#define xTaskCreate(code, name, stack, param, prio, handle) fake_task_create(handle)
+#undef xTaskNotify
+#define xTaskNotify(task, value, action) fake_notify(value)
+
+#include "debi_hub.c"
+
+#define SEC         1000000LL
+#define TRIED_MAX   64
+
+enum
+{
+    BROKER_SILENT = 0,
+    BROKER_OK,
+    BROKER_REFUSE,
+};
+
+typedef struct
+{
+    char uri[DEBI_HUB_URI_MAX];
+    int how;
+} broker_t;
+
+typedef struct
+{
+    uint8_t ip[4];
+    uint16_t port;
+    const char *id;
+    const char *scheme;
+} hub_t;
+
+static broker_t s_brokers[16];
+static int s_n_brokers;
+static hub_t s_hubs[DEBI_HUB_MDNS_RESULTS];
+static int s_n_hubs;
+static bool s_mdns_up;
+
+static char s_open[DEBI_HUB_URI_MAX];   // endpoint of the MQTT client debi_os has open
+static uint32_t s_pending;              // MQTT event the open client will post
+static int64_t s_pending_at;
+static char s_tried[TRIED_MAX][DEBI_HUB_URI_MAX];
+static int s_n_tried;
+static int s_stops;
+static int s_queries;
+static unsigned s_nvs_writes;
+
+static TickType_t s_wait;
+static int64_t s_wake_at;
+
+/*************************************************************************
+ * What debi_hub links against
+ ************************************************************************/
+esp_err_t mdns_init(void)
+{
+    return s_mdns_up ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t mdns_hostname_set(const char *hostname)
+{
+    TEST_ASSERT_EQUAL_STRING(HUB_HOSTNAME, hostname);
+    return ESP_OK;
+}
+
+// waits out the timeout, as a lookup does; even hubs answer with an address, odd ones with a hostname
+esp_err_t mdns_query_ptr(const char *service_type, const char *proto, uint32_t timeout, size_t max_results,
+                         mdns_result_t **results)
+{
+    TEST_ASSERT_EQUAL_STRING(DEBI_HUB_MDNS_SERVICE, service_type);
+    TEST_ASSERT_EQUAL_STRING(DEBI_HUB_MDNS_PROTO, proto);
+    s_queries++;
+    host_time_set(esp_timer_get_time() + timeout * 1000LL);
+
+    mdns_result_t **tail = results;
+    *results = NULL;
+    for (int i = 0; i < s_n_hubs && i < (int)max_results; i++)
+    {
+        mdns_result_t *r = calloc(1, sizeof(*r));
+        r->port = s_hubs[i].port;
+        r->hostname = "hub";
+        r->txt = calloc(2, sizeof(mdns_txt_item_t));
+        if (s_hubs[i].id)
+        {
+            r->txt[r->txt_count++] = (mdns_txt_item_t){ "id", s_hubs[i].id };
+        }
+        if (s_hubs[i].scheme)
+        {
+            r->txt[r->txt_count++] = (mdns_txt_item_t){ "scheme", s_hubs[i].scheme };
+        }
+        if (i % 2 == 0)
+        {
+            r->addr = calloc(1, sizeof(mdns_ip_addr_t));
+            r->addr->addr.type = ESP_IPADDR_TYPE_V4;
+            memcpy(&r->addr->addr.u_addr.ip4.addr, s_hubs[i].ip, 4);
+        }
+        *tail = r;
+        tail = &r->next;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mdns_query_a(const char *host_name, uint32_t timeout, esp_ip4_addr_t *addr)
+{
+    for (int i = 1; i < s_n_hubs; i += 2)
+    {
+        memcpy(&addr->addr, s_hubs[i].ip, 4);
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+void mdns_query_results_free(mdns_result_t *results)
+{
+    while (results)
+    {
+        mdns_result_t *next = results->next;
+        free(results->txt);
+        free(results->addr);
+        free(results);
+        results = next;
+    }
+}
+
+static int broker(const char *uri)
+{
+    for (int i = 0; i < s_n_brokers; i++)
+    {
+        if (strcmp(s_brokers[i].uri, uri) == 0)
+        {
+            return s_brokers[i].how;
+        }
+    }
+    return BROKER_SILENT;
+}
+
+// a new client connects after 150 ms or is refused after 30 ms, the old one goes quiet
+void debi_os_mqtt_restart(void)
+{
+    debi_hub_endpoint_t ep;
+    debi_hub_current(&ep);
+    strlcpy(s_open, ep.uri, sizeof(s_open));
+    TEST_ASSERT_LESS_THAN_INT(TRIED_MAX, s_n_tried);
+    strlcpy(s_tried[s_n_tried++], ep.uri, DEBI_HUB_URI_MAX);
+
+    int how = broker(ep.uri);
+    s_pending = how == BROKER_OK ? EV_CONNECTED : how == BROKER_REFUSE ? EV_DISCONNECTED : 0;
+    s_pending_at = s_pending ? esp_timer_get_time() + (how == BROKER_OK ? 150000 : 30000) : -1;
+}
+
+void debi_os_mqtt_stop(void)
+{
+    s_open[0] = '\0';
+    s_pending = 0;
+    s_pending_at = -1;
+    s_stops++;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static void set_broker(const char *uri, int how)
+{
+    for (int i = 0; i < s_n_brokers; i++)
+    {
+        if (strcmp(s_brokers[i].uri, uri) == 0)
+        {
+            s_brokers[i].how = how;
+            return;
+        }
+    }
+    TEST_ASSERT_LESS_THAN_INT(sizeof(s_brokers) / sizeof(s_brokers[0]), s_n_brokers);
+    strlcpy(s_brokers[s_n_brokers].uri, uri, DEBI_HUB_URI_MAX);
+    s_brokers[s_n_brokers++].how = how;
+}
+
+static void add_hub(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint16_t port, const char *id, const char *scheme)
+{
+    TEST_ASSERT_LESS_THAN_INT(DEBI_HUB_MDNS_RESULTS, s_n_hubs);
+    s_hubs[s_n_hubs++] = (hub_t){ { a, b, c, d }, port, id, scheme };
+}
+
+// the broker the Watcher is on goes away
+static void drop_open(void)
+{
+    s_pending = EV_DISCONNECTED;
+    s_pending_at = esp_timer_get_time();
+}
+
+// what the debi_hub task would do until t_end: wake up on a notification, an MQTT event or its timeout
+static void run_until(int64_t t_end)
+{
+    for (int guard = 0; guard < 100000; guard++)
+    {
+        int64_t now = esp_timer_get_time();
+        int64_t next = s_wait == portMAX_DELAY ? INT64_MAX : s_wake_at;
+        if (s_pending_at >= 0 && s_pending_at < next)
+        {
+            next = s_pending_at;
+        }
+        if (s_notified)
+        {
+            next = now;
+        }
+        if (next > t_end)
+        {
+            if (now < t_end)
+            {
+                host_time_set(t_end);
+            }
+            return;
+        }
+        if (next > now)
+        {
+            host_time_set(next);
+        }
+
+        uint32_t ev = s_notified;
+        s_notified = 0;
+        if (s_pending_at >= 0 && s_pending_at <= esp_timer_get_time())
+        {
+            ev |= s_pending;
+            s_pending = 0;
+            s_pending_at = -1;
+        }
+        s_wait = hub_step(ev, esp_timer_get_time());
+        s_wake_at = esp_timer_get_time() + s_wait * 1000LL;
+    }
+    TEST_FAIL_MESSAGE("hub_step() never settles");
+}
+
+static void run_for(double s)
+{
+    run_until(esp_timer_get_time() + (int64_t)(s * SEC));
+}
+
+// a reboot: the network, the brokers and NVS stay as they are
+static void reboot(void)
+{
+    if (s_hub.lock)
+    {
+        vSemaphoreDelete(s_hub.lock);
+    }
+    memset(&s_hub, 0, sizeof(s_hub));
+    s_notified = 0;
+    s_pending = 0;
+    s_pending_at = -1;
+    s_open[0] = '\0';
+    s_n_tried = 0;
+    s_stops = 0;
+    s_queries = 0;
+    s_wait = 0;
+    s_wake_at = esp_timer_get_time();
+}
+
+static void boot(void)
+{
+    reboot();
+    TEST_ASSERT_EQUAL(ESP_OK, debi_hub_init());
+    s_nvs_writes = host_nvs_writes();
+}
+
+static unsigned nvs_writes(void)
+{
+    return host_nvs_writes() - s_nvs_writes;
+}
+
+static void assert_connected(const char *uri, debi_hub_source_t source)
+{
+    debi_hub_status_t st;
+    debi_hub_get_status(&st);
+    TEST_ASSERT_TRUE(st.connected);
+    TEST_ASSERT_EQUAL_STRING(uri, st.uri);
+    TEST_ASSERT_EQUAL_STRING(debi_hub_source_name(source), debi_hub_source_name(st.source));
+    TEST_ASSERT_EQUAL_STRING(uri, s_open);
+}
+
+static void save_config(const char *uri0, const char *uri1, bool mdns)
+{
+    debi_hub_config_t cfg;
+    debi_hub_get_config(&cfg);
+    strlcpy(cfg.uris[0], uri0, DEBI_HUB_URI_MAX);
+    strlcpy(cfg.uris[1], uri1, DEBI_HUB_URI_MAX);
+    cfg.mdns = mdns;
+    TEST_ASSERT_EQUAL(ESP_OK, debi_hub_set_config(&cfg));
+}
+
+void setUp(void)
+{
+    host_time_reset();
+    host_nvs_erase_all();
+    s_n_brokers = 0;
+    s_n_hubs = 0;
+    s_mdns_up = true;
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_build_default(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    boot();
+
+    run_for(5);
+    debi_hub_status_t st;
+    debi_hub_get_status(&st);
+    TEST_ASSERT_FALSE(st.connected);
+    TEST_ASSERT_EQUAL_INT(0, s_n_tried);
+
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+    TEST_ASSERT_EQUAL_INT(1, s_n_tried);
+    TEST_ASSERT_EQUAL_INT(1, s_queries);
+    TEST_ASSERT_EQUAL_STRING(DEBI_HUB_MQTT_URI, s_hub.saved.last_good);
+    TEST_ASSERT_EQUAL_UINT(1, nvs_writes());
+
+    // quiet while connected
+    run_for(600);
+    TEST_ASSERT_EQUAL_INT(1, s_n_tried);
+    TEST_ASSERT_EQUAL_UINT(1, nvs_writes());
+}
+
+static void test_network_before_init(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    reboot();
+    debi_hub_network(true);     // app_wifi came up first, nobody to notify yet
+    TEST_ASSERT_EQUAL_UINT32(0, s_notified);
+
+    TEST_ASSERT_EQUAL(ESP_OK, debi_hub_init());
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+}
+
+static void test_mdns_finds_moved_hub(void)
+{
+    // DHCP moved the hub: the build default is dead, mDNS knows where it went
+    add_hub(192, 168, 1, 77, 1883, "home", NULL);
+    set_broker("mqtt://192.168.1.77:1883", BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected("mqtt://192.168.1.77:1883", DEBI_HUB_SRC_MDNS);
+    TEST_ASSERT_EQUAL_INT(1, s_n_tried);
+
+    // multicast filtered after a reboot: the last good endpoint first, no flash write for it
+    s_n_hubs = 0;
+    boot();
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected("mqtt://192.168.1.77:1883", DEBI_HUB_SRC_LAST);
+    TEST_ASSERT_EQUAL_UINT(0, nvs_writes());
+}
+
+static void test_mdns_hostname_and_tls(void)
+{
+    add_hub(10, 0, 0, 1, 1883, "a", NULL);       // with its address, dead
+    add_hub(10, 0, 0, 2, 8883, "b", "mqtts");    // hostname only, looked up
+    set_broker("mqtts://10.0.0.2:8883", BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(30);
+    assert_connected("mqtts://10.0.0.2:8883", DEBI_HUB_SRC_MDNS);
+    TEST_ASSERT_EQUAL_INT(2, s_n_tried);
+    TEST_ASSERT_EQUAL_STRING("mqtt://10.0.0.1:1883", s_tried[0]);
+}
+
+static void test_mdns_unavailable(void)
+{
+    s_mdns_up = false;
+    add_hub(10, 0, 0, 3, 1883, NULL, NULL);
+    set_broker("mqtt://10.0.0.3:1883", BROKER_OK);
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(5);
+    TEST_ASSERT_EQUAL_INT(0, s_queries);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+}
+
+static void test_hub_id_picks_one(void)
+{
+    add_hub(10, 0, 0, 5, 1883, "upstairs", NULL);
+    add_hub(10, 0, 0, 6, 1883, "nursery", NULL);
+    add_hub(10, 0, 0, 7, 1883, NULL, NULL);
+    set_broker("mqtt://10.0.0.5:1883", BROKER_OK);
+    set_broker("mqtt://10.0.0.6:1883", BROKER_OK);
+    set_broker("mqtt://10.0.0.7:1883", BROKER_OK);
+    boot();
+
+    debi_hub_config_t cfg;
+    debi_hub_get_config(&cfg);
+    strlcpy(cfg.hub_id, "nursery", sizeof(cfg.hub_id));
+    TEST_ASSERT_EQUAL(ESP_OK, debi_hub_set_config(&cfg));
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected("mqtt://10.0.0.6:1883", DEBI_HUB_SRC_MDNS);
+    TEST_ASSERT_EQUAL_INT(1, s_n_tried);
+}
+
+static void test_hub_down_and_back(void)
+{
+    set_broker("mqtt://10.1.1.1:1883", BROKER_OK);
+    boot();
+    save_config("mqtt://10.1.1.1:1883", "mqtt://10.1.1.2:1883", false);   // the spare is never up
+    debi_hub_network(true);
+    run_for(2);
+    assert_connected("mqtt://10.1.1.1:1883", DEBI_HUB_SRC_SAVED);
+
+    // hub gone: its broker refuses, the spare stays silent
+    set_broker("mqtt://10.1.1.1:1883", BROKER_REFUSE);
+    drop_open();
+    int64_t t0 = esp_timer_get_time();
+    uint32_t backoffs[12];
+    int n = 0;
+    uint32_t rounds = 0;
+    while (esp_timer_get_time() - t0 < 900 * SEC && n < 12)
+    {
+        run_for(0.5);
+        debi_hub_status_t st;
+        debi_hub_get_status(&st);
+        if (st.rounds_failed != rounds)
+        {
+            backoffs[n++] = st.backoff_ms;
+            rounds = st.rounds_failed;
+        }
+    }
+    // 1 s after the drop, then doubling up to the cap
+    const uint32_t want[] = { 2000, 4000, 8000, 16000, 32000, 60000, 60000, 60000 };
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(8, n);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(want, backoffs, 8);
+
+    // hub back: picked up within one backoff and a round
+    set_broker("mqtt://10.1.1.1:1883", BROKER_OK);
+    int64_t t_back = esp_timer_get_time();
+    debi_hub_status_t st = { 0 };
+    while (!st.connected && esp_timer_get_time() - t_back < 120 * SEC)
+    {
+        run_for(0.1);
+        debi_hub_get_status(&st);
+    }
+    TEST_ASSERT_TRUE(st.connected);
+    TEST_ASSERT_LESS_OR_EQUAL_INT64((DEBI_HUB_BACKOFF_MAX_MS / 1000 + 11) * SEC, esp_timer_get_time() - t_back);
+    assert_connected("mqtt://10.1.1.1:1883", DEBI_HUB_SRC_LAST);
+
+    // a blip is back after the minimum backoff, not the one of the outage
+    drop_open();
+    run_for(DEBI_HUB_BACKOFF_MIN_MS / 1000.0 + 1);
+    assert_connected("mqtt://10.1.1.1:1883", DEBI_HUB_SRC_LAST);
+}
+
+static void test_set_config(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    set_broker("mqtt://10.2.0.9:1883", BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+
+    // moves at once, the password kept when none is given
+    debi_hub_config_t cfg;
+    debi_hub_get_config(&cfg);
+    strlcpy(cfg.uris[0], "mqtt://10.2.0.9:1883", DEBI_HUB_URI_MAX);
+    strlcpy(cfg.user, "nursery", sizeof(cfg.user));
+    cfg.pass[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, debi_hub_set_config(&cfg));
+    run_for(5);
+    assert_connected("mqtt://10.2.0.9:1883", DEBI_HUB_SRC_SAVED);
+    debi_hub_endpoint_t ep;
+    debi_hub_current(&ep);
+    TEST_ASSERT_EQUAL_STRING("nursery", ep.user);
+    TEST_ASSERT_EQUAL_STRING(DEBI_HUB_MQTT_PASS, ep.pass);
+
+    // bad endpoints are refused and not saved
+    strlcpy(cfg.uris[1], "http://10.2.0.9", DEBI_HUB_URI_MAX);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, debi_hub_set_config(&cfg));
+    strlcpy(cfg.uris[1], "mqtt://a b", DEBI_HUB_URI_MAX);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, debi_hub_set_config(&cfg));
+    debi_hub_get_config(&cfg);
+    TEST_ASSERT_EQUAL_STRING("", cfg.uris[1]);
+
+    boot();
+    debi_hub_get_config(&cfg);
+    TEST_ASSERT_EQUAL_STRING("mqtt://10.2.0.9:1883", cfg.uris[0]);
+    TEST_ASSERT_EQUAL_STRING("nursery", cfg.user);
+}
+
+static void test_refused_moves_on(void)
+{
+    // a refusal moves on at once, without sitting out the connect timeout
+    set_broker("mqtt://10.3.0.1:1883", BROKER_REFUSE);
+    set_broker("mqtt://10.3.0.2:1883", BROKER_REFUSE);
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    boot();
+    save_config("mqtt://10.3.0.1:1883", "mqtt://10.3.0.2:1883", false);
+    debi_hub_network(true);
+    run_for(1);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+    TEST_ASSERT_EQUAL_INT(3, s_n_tried);
+}
+
+static void test_corrupt_nvs(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+
+    // a record of another layout
+    uint8_t old[100];
+    memset(old, 0xA5, sizeof(old));
+    TEST_ASSERT_EQUAL(ESP_OK, storage_write(DEBI_HUB_STORAGE, old, sizeof(old)));
+    boot();
+    debi_hub_config_t cfg;
+    debi_hub_get_config(&cfg);
+    TEST_ASSERT_TRUE(cfg.mdns);
+    TEST_ASSERT_EQUAL_STRING(DEBI_HUB_MQTT_USER, cfg.user);
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+
+    // the right size and version, junk strings: dropped or terminated
+    hub_saved_t junk;
+    memset(&junk, 'x', sizeof(junk));
+    junk.version = HUB_SAVED_VERSION;
+    TEST_ASSERT_EQUAL(ESP_OK, storage_write(DEBI_HUB_STORAGE, &junk, sizeof(junk)));
+    boot();
+    debi_hub_get_config(&cfg);
+    TEST_ASSERT_EQUAL_STRING("", cfg.uris[0]);
+    TEST_ASSERT_EQUAL_size_t(DEBI_HUB_CRED_MAX - 1, strlen(cfg.user));
+    TEST_ASSERT_EQUAL_size_t(DEBI_HUB_ID_MAX - 1, strlen(cfg.hub_id));
+    TEST_ASSERT_EQUAL_STRING("", s_hub.saved.last_good);
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_DEFAULT);
+    TEST_ASSERT_EQUAL_INT(1, s_n_tried);
+}
+
+static void test_network_flaps(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(5);
+
+    debi_hub_network(false);
+    run_for(0.01);
+    debi_hub_status_t st;
+    debi_hub_get_status(&st);
+    TEST_ASSERT_FALSE(st.connected);
+    TEST_ASSERT_EQUAL_STRING("", s_open);
+    TEST_ASSERT_EQUAL_INT(1, s_stops);
+    int tried = s_n_tried;
+    run_for(300);
+    TEST_ASSERT_EQUAL_INT(tried, s_n_tried);
+
+    // down and up merged in one notification: up wins
+    debi_hub_network(false);
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_LAST);
+
+    // up and down: down wins
+    debi_hub_network(true);
+    debi_hub_network(false);
+    run_for(5);
+    TEST_ASSERT_EQUAL_STRING("", s_open);
+
+    debi_hub_network(true);
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_LAST);
+}
+
+static void test_connect_and_drop_merged(void)
+{
+    set_broker(DEBI_HUB_MQTT_URI, BROKER_OK);
+    boot();
+    debi_hub_network(true);
+    run_for(0.01);
+
+    // the client connected and dropped before the task ran
+    s_pending = EV_CONNECTED | EV_DISCONNECTED;
+    run_for(0.5);
+    debi_hub_status_t st;
+    debi_hub_get_status(&st);
+    TEST_ASSERT_FALSE(st.connected);
+    TEST_ASSERT_EQUAL_INT(HUB_WAITING, s_hub.phase);
+
+    run_for(5);
+    assert_connected(DEBI_HUB_MQTT_URI, DEBI_HUB_SRC_LAST);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_build_default);
+    RUN_TEST(test_network_before_init);
+    RUN_TEST(test_mdns_finds_moved_hub);
+    RUN_TEST(test_mdns_hostname_and_tls);
+    RUN_TEST(test_mdns_unavailable);
+    RUN_TEST(test_hub_id_picks_one);
+    RUN_TEST(test_hub_down_and_back);
+    RUN_TEST(test_set_config);
+    RUN_TEST(test_refused_moves_on);
+    RUN_TEST(test_corrupt_nvs);
+    RUN_TEST(test_network_flaps);
+    RUN_TEST(test_connect_and_drop_merged);
+    return UNITY_END();
+}
@@ -0,0 +1,470 @@
+/*
+ * Hot debi_os messages from the debi_json templates against the cJSON code they replaced:
+ * the same bytes, topic, QoS and retain for random states, strings with every byte value,
+ * integers past INT_MAX and sensor centi-units, no heap use, and a message too long for its
+ * buffer dropped rather than cut.
+ *
+ * The wall clock and the free heap are the test's, time() and esp_get_free_heap_size() are
+ * redirected before debi_os.c is included.
+ */
+#include <limits.h>
+#include <time.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+
+static time_t s_now;
+static time_t fake_time(time_t *t)
+{
+    if (t)
+    {
+        *t = s_now;
+    }
+    return s_now;
+}
+#define time(t) fake_time(t)
+
+static uint32_t s_heap;
+static uint32_t fake_free_heap_size(void)
+{
+    return s_heap;
+}
+#include "esp_system.h"
+#define esp_get_free_heap_size() fake_free_heap_size()
+
+#include "debi_os.c"
+#include "cJSON.h"
+
+#define MSG_MAX 1024
+
+typedef struct {
+    char data[MSG_MAX];
+    const char *topic;
+    int qos;
+    int retain;
+    int num;
+} msg_t;
+
+static msg_t s_msg;
+static face_state_t s_face;
+static const char *s_face_names[FACE_STATE_COUNT];
+static app_sensor_data_t s_sensors[APP_SENSOR_SUPPORT_MAX];
+static uint8_t s_sensors_num;
+static long s_allocs;
+
+/*************************************************************************
+ * What debi_os links against
+ ************************************************************************/
+esp_event_loop_handle_t app_event_loop_handle;
+ESP_EVENT_DEFINE_BASE(CTRL_EVENT_BASE);
+ESP_EVENT_DEFINE_BASE(VIEW_EVENT_BASE);
+
+static void record(const char *topic, const char *data, int len, int qos, int retain)
+{
+    TEST_ASSERT_LESS_THAN_INT(MSG_MAX, len);
+    memcpy(s_msg.data, data, len);
+    s_msg.data[len] = '\0';
+    s_msg.topic = topic;
+    s_msg.qos = qos;
+    s_msg.retain = retain;
+    s_msg.num++;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (len == 0)
+    {
+        len = strlen(data);
+    }
+    // the length given is the text, without a NUL or anything after it
+    TEST_ASSERT_EQUAL_INT(strlen(data), len);
+    record(topic, data, len, qos, retain);
+    return 0;
+}
+
+int debi_comms_publish_bin(const char *topic, const void *data, size_t len, int qos, bool retain)
+{
+    TEST_ASSERT_EQUAL_size_t(strlen(data), len);
+    record(topic, data, len, qos, retain);
+    return 0;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) { return NULL; }
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg) { return ESP_OK; }
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) { return ESP_OK; }
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) { return ESP_OK; }
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) { return ESP_OK; }
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) { return 0; }
+
+const char *ui_face_state_name(face_state_t state) { return s_face_names[state]; }
+face_state_t ui_face_get_state(void) { return s_face; }
+void ui_face_set_state(face_state_t state) {}
+void debi_face_bridge_override(int state) {}
+void debi_face_bridge_release(void) {}
+debi_comms_config_t debi_comms_get_config(void) { return (debi_comms_config_t){ 0 }; }
+void debi_comms_on_connected(esp_mqtt_client_handle_t client) {}
+void debi_comms_on_disconnected(void) {}
+void debi_comms_handle_message(const char *topic, const char *data, int data_len) {}
+void debi_hub_current(debi_hub_endpoint_t *out) { memset(out, 0, sizeof(*out)); }
+void debi_hub_network(bool up) {}
+void debi_hub_on_connected(void) {}
+void debi_hub_on_disconnected(void) {}
+const char *debi_hub_source_name(debi_hub_source_t src) { return "default"; }
+
+uint8_t app_sensor_read_measurement(app_sensor_data_t *data, uint16_t length)
+{
+    memcpy(data, s_sensors, sizeof(s_sensors));
+    return s_sensors_num;
+}
+
+// counted with -Wl,--wrap where the linker has it, see CMakeLists.txt
+#ifdef HOST_TEST_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size) { s_allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { s_allocs++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *ptr, size_t size) { s_allocs++; return __real_realloc(ptr, size); }
+#endif
+
+/*************************************************************************
+ * The cJSON code the templates replaced
+ ************************************************************************/
+static void ref_publish(cJSON *root, const char *topic, int qos, int retain)
+{
+    char *json = cJSON_PrintUnformatted(root);
+
+    TEST_ASSERT_NOT_NULL(json);
+    record(topic, json, strlen(json), qos, retain);
+    free(json);
+    cJSON_Delete(root);
+}
+
+static void ref_detection(const char *type, int score)
+{
+    s_os.detection_count++;
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", type ? type : "unknown");
+    cJSON_AddNumberToObject(root, "score", score);
+    cJSON_AddNumberToObject(root, "seq", s_os.detection_count);
+    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
+    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    ref_publish(root, DEBI_TOPIC_DETECTION, 0, 0);
+}
+
+static void ref_sensors(void)
+{
+    app_sensor_data_t data[APP_SENSOR_SUPPORT_MAX];
+    uint8_t count = app_sensor_read_measurement(data, APP_SENSOR_SUPPORT_MAX);
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (data[i].type == SENSOR_SHT4x)
+        {
+            cJSON_AddNumberToObject(root, "temp_c", data[i].context.sht4x.temperature / 100.0);
+            cJSON_AddNumberToObject(root, "humidity", data[i].context.sht4x.humidity / 100.0);
+        }
+        else if (data[i].type == SENSOR_SCD4x)
+        {
+            cJSON_AddNumberToObject(root, "temp_c", data[i].context.scd4x.temperature / 100.0);
+            cJSON_AddNumberToObject(root, "humidity", data[i].context.scd4x.humidity / 100.0);
+            cJSON_AddNumberToObject(root, "co2", data[i].context.scd4x.co2);
+        }
+    }
+    ref_publish(root, DEBI_TOPIC_SENSOR, 0, 0);
+}
+
+static void ref_heartbeat(void)
+{
+    s_os.heartbeat_seq++;
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "seq", s_os.heartbeat_seq);
+    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
+    cJSON_AddStringToObject(root, "face", ui_face_state_name(ui_face_get_state()));
+    cJSON_AddNumberToObject(root, "uptime", difftime(time(NULL), s_os.boot_time));
+    cJSON_AddNumberToObject(root, "detections", s_os.detection_count);
+    cJSON_AddNumberToObject(root, "heap", (double)esp_get_free_heap_size());
+    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    ref_publish(root, DEBI_TOPIC_HEARTBEAT, 0, 0);
+}
+
+static void ref_status(void)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "status", "online");
+    cJSON_AddStringToObject(root, "mode", MODE_NAMES[s_os.mode]);
+    cJSON_AddStringToObject(root, "client_id", DEBI_HUB_MQTT_CLIENT_ID);
+    cJSON_AddStringToObject(root, "face", ui_face_state_name(ui_face_get_state()));
+    cJSON_AddNumberToObject(root, "uptime", difftime(time(NULL), s_os.boot_time));
+    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    ref_publish(root, DEBI_TOPIC_STATUS, 1, 1);
+}
+
+static void ref_offline(void)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "status", "offline");
+    cJSON_AddNumberToObject(root, "ts", (double)time(NULL));
+    ref_publish(root, DEBI_TOPIC_STATUS, 1, 1);
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static const char *s_type;
+static int s_score;
+static char s_type_buf[16];
+static uint64_t s_rng = 88172645463325252ULL;
+
+static uint64_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return s_rng;
+}
+
+static void cur_detection(void) { debi_os_report_detection(s_type, s_score); }
+static void ref_detection_(void) { ref_detection(s_type, s_score); }
+static void cur_sensors(void) { debi_os_report_sensors(); }
+static void cur_heartbeat(void) { heartbeat_cb(NULL); }
+static void cur_status(void) { publish_status(); }
+
+static void cur_offline(void)
+{
+    mqtt_disconnect();
+    s_os.mqtt_handle = (esp_mqtt_client_handle_t)&s_msg;
+    s_os.hub_connected = true;
+}
+
+/* the same message from the cJSON code and the template, and the same state after */
+static void assert_same(void (*ref)(void), void (*cur)(void))
+{
+    debi_os_state_t before = s_os;
+    msg_t want;
+
+    ref();
+    want = s_msg;
+    debi_os_state_t after = s_os;
+    s_os = before;
+    cur();
+
+    TEST_ASSERT_EQUAL_INT(want.num + 1, s_msg.num);
+    TEST_ASSERT_EQUAL_STRING(want.data, s_msg.data);
+    TEST_ASSERT_EQUAL_PTR(want.topic, s_msg.topic);
+    TEST_ASSERT_EQUAL_INT(want.qos, s_msg.qos);
+    TEST_ASSERT_EQUAL_INT(want.retain, s_msg.retain);
+    TEST_ASSERT_EQUAL_UINT32(after.detection_count, s_os.detection_count);
+    TEST_ASSERT_EQUAL_UINT32(after.heartbeat_seq, s_os.heartbeat_seq);
+}
+
+/* a state anywhere in range, one in eight far outside of it */
+static void randomise(void)
+{
+    bool big = rnd() % 8 == 0;
+
+    s_now = big ? (time_t)(rnd() % (1ULL << 40)) : 1700000000 + (time_t)(rnd() % 400000000);
+    s_os.boot_time = s_now - (time_t)(rnd() % (big ? (1ULL << 36) : 10000000));
+    s_os.mode = rnd() % DEBI_MODE_COUNT;
+    s_os.detection_count = big ? (uint32_t)rnd() : (uint32_t)(rnd() % 100000);
+    s_os.heartbeat_seq = big ? (uint32_t)rnd() : (uint32_t)(rnd() % 100000);
+    s_heap = big ? (uint32_t)rnd() : 100000 + (uint32_t)(rnd() % 8000000);
+    s_face = rnd() % FACE_STATE_COUNT;
+    s_sensors_num = rnd() % 3;
+    for (int i = 0; i < APP_SENSOR_SUPPORT_MAX; i++)
+    {
+        s_sensors[i].type = rnd() % 3 == 2 ? SENSOR_NONE : rnd() % 2;
+        s_sensors[i].context.scd4x.temperature = big ? (int32_t)rnd() : (int32_t)(rnd() % 16500) - 4000;
+        s_sensors[i].context.scd4x.humidity = big ? (uint32_t)rnd() : (uint32_t)(rnd() % 10001);
+        s_sensors[i].context.scd4x.co2 = big ? (uint32_t)rnd() : (uint32_t)(rnd() % 5000);
+    }
+
+    int n = rnd() % (sizeof(s_type_buf) - 1);
+    for (int i = 0; i < n; i++)
+    {
+        s_type_buf[i] = (char)(1 + rnd() % 255);
+    }
+    s_type_buf[n] = '\0';
+    s_type = rnd() % 7 == 0 ? NULL : rnd() % 2 ? s_type_buf : "person";
+    s_score = rnd() % 5 == 0 ? (int)rnd() : (int)(rnd() % 101);
+}
+
+static const char *json_str(const char *s)
+{
+    static char out[MSG_MAX];
+    char buf[MSG_MAX];
+    debi_json_t w;
+
+    debi_json_init(&w, buf, sizeof(buf));
+    debi_json_str(&w, s);
+    TEST_ASSERT_NOT_NULL(debi_json_finish(&w, NULL));
+    strcpy(out, buf);
+    return out;
+}
+
+static void assert_str_as_cjson(const char *s)
+{
+    cJSON *item = cJSON_CreateString(s);
+    char *want = cJSON_PrintUnformatted(item);
+
+    TEST_ASSERT_EQUAL_STRING(want, json_str(s));
+    free(want);
+    cJSON_Delete(item);
+}
+
+static void assert_num_as_cjson(int64_t v, bool centi)
+{
+    cJSON *item = cJSON_CreateNumber(centi ? v / 100.0 : (double)v);
+    char *want = cJSON_PrintUnformatted(item);
+    char buf[64];
+    debi_json_t w;
+
+    debi_json_init(&w, buf, sizeof(buf));
+    if (centi)
+    {
+        debi_json_centi(&w, v);
+    }
+    else
+    {
+        debi_json_int(&w, v);
+    }
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(want, debi_json_finish(&w, NULL), centi ? "centi" : "int");
+    free(want);
+    cJSON_Delete(item);
+}
+
+void setUp(void)
+{
+    static const char *names[] = { "idle", "presence", "happy", "alert\t\"fall\"", "setup\\x", "err\x01\x1f\x7f", "caf\xc3\xa9" };
+
+    for (int i = 0; i < FACE_STATE_COUNT; i++)
+    {
+        s_face_names[i] = names[i % (sizeof(names) / sizeof(names[0]))];
+    }
+    memset(&s_msg, 0, sizeof(s_msg));
+    s_os.hub_connected = true;
+    s_os.mqtt_handle = (esp_mqtt_client_handle_t)&s_msg;
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_messages_match_cjson(void)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        randomise();
+        assert_same(ref_detection_, cur_detection);
+        assert_same(ref_sensors, cur_sensors);
+        assert_same(ref_heartbeat, cur_heartbeat);
+        assert_same(ref_status, cur_status);
+        assert_same(ref_offline, cur_offline);
+    }
+}
+
+static void test_strings_escape_as_cjson(void)
+{
+    char s[2] = { 0 };
+
+    for (int c = 1; c < 256; c++)
+    {
+        s[0] = (char)c;
+        assert_str_as_cjson(s);
+    }
+    assert_str_as_cjson("");
+    assert_str_as_cjson("a \"quoted\" \\path\\ /slash\b\f\n\r\t");
+    assert_str_as_cjson("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xff\xfe");
+    // NULL is written as an empty string
+    TEST_ASSERT_EQUAL_STRING("\"\"", json_str(NULL));
+}
+
+static void test_numbers_print_as_cjson(void)
+{
+    const int64_t ints[] = { 0, 1, -1, 9, 10, -10, INT_MAX, (int64_t)INT_MAX + 1, INT_MIN, (int64_t)INT_MIN - 1,
+                             UINT32_MAX, 1700000000, 1099511627775LL, 999999999999999LL, -999999999999999LL };
+
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++)
+    {
+        assert_num_as_cjson(ints[i], false);
+    }
+    // every reading a sensor gives, then the whole int32 range at random
+    for (int64_t v = -4000; v <= 16500; v++)
+    {
+        assert_num_as_cjson(v, true);
+    }
+    for (int i = 0; i < 100000; i++)
+    {
+        assert_num_as_cjson((int32_t)rnd(), true);
+        assert_num_as_cjson((uint32_t)rnd(), true);
+    }
+    assert_num_as_cjson(INT32_MIN, true);
+    assert_num_as_cjson(UINT32_MAX, true);
+}
+
+static void test_no_heap(void)
+{
+#ifndef HOST_TEST_WRAP_MALLOC
+    TEST_IGNORE_MESSAGE("the linker cannot wrap malloc");
+#else
+    randomise();
+    s_sensors_num = 2;
+    s_sensors[0].type = SENSOR_SHT4x;
+    s_sensors[1].type = SENSOR_SCD4x;
+
+    long allocs = s_allocs;
+    cur_detection();
+    cur_sensors();
+    cur_heartbeat();
+    cur_status();
+    TEST_ASSERT_EQUAL_INT(4, s_msg.num);
+    TEST_ASSERT_EQUAL(0, s_allocs - allocs);
+
+    // the code they replaced allocated for every node, key and string
+    ref_heartbeat();
+    TEST_ASSERT_GREATER_THAN(10, s_allocs - allocs);
+#endif
+}
+
+static void test_too_long_is_dropped(void)
+{
+    char type[DEBI_OS_MSG_MAX_LEN + 1];
+    char buf[8];
+    debi_json_t w;
+
+    memset(type, 'x', sizeof(type) - 1);
+    type[sizeof(type) - 1] = '\0';
+    debi_os_report_detection(type, 1);
+    TEST_ASSERT_EQUAL_INT(0, s_msg.num);
+
+    // one that just fits goes
+    type[DEBI_OS_MSG_MAX_LEN - 100] = '\0';
+    debi_os_report_detection(type, 1);
+    TEST_ASSERT_EQUAL_INT(1, s_msg.num);
+
+    // the writer stops at the end of the buffer, room for the NUL included
+    debi_json_init(&w, buf, sizeof(buf));
+    DEBI_JSON_LIT(&w, "1234567");
+    TEST_ASSERT_EQUAL_STRING("1234567", debi_json_finish(&w, NULL));
+    debi_json_init(&w, buf, sizeof(buf));
+    DEBI_JSON_LIT(&w, "12345678");
+    TEST_ASSERT_NULL(debi_json_finish(&w, NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_messages_match_cjson);
+    RUN_TEST(test_strings_escape_as_cjson);
+    RUN_TEST(test_numbers_print_as_cjson);
+    RUN_TEST(test_no_heap);
+    RUN_TEST(test_too_long_is_dropped);
+    return UNITY_END();
+}
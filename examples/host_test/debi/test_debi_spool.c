@@ -0,0 +1,688 @@
+/*
+ * On-flash spool of debi_comms (app/debi_spool.c) against a file system that loses power.
+ *
+ * The file calls of debi_spool.c go through a fault injector that cuts the power after a given
+ * number of bytes and file operations, leaving the torn write as a prefix, a prefix and erased
+ * flash, or a prefix and junk. The test then boots the spool again from what is on disk and
+ * checks that every record synced and not sent yet comes back, in order, with nothing invented.
+ *
+ * Most tests drive the writer and the replay directly, without the spool task. The last one
+ * runs the task with publishers racing a replay. The log goes to the sd card, as on a Watcher
+ * with a card in.
+ */
+#include <pthread.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// the direct tests have no spool task, a wakeup for it is a write_batch() they make themselves
+#define FAKE_TASK ((TaskHandle_t)1)
+static void fake_notify(TaskHandle_t task)
+{
+    if (task != FAKE_TASK)
+    {
+        xTaskGenericNotify(task, 0, eIncrement);
+    }
+}
+#undef xTaskNotifyGive
+#define xTaskNotifyGive(task) fake_notify(task)
+
+#include <stdio.h>
+#include <unistd.h>
+static FILE *fi_fopen(const char *path, const char *mode);
+static size_t fi_fwrite(const void *buf, size_t size, size_t n, FILE *fp);
+static int fi_fsync(int fd);
+static int fi_remove(const char *path);
+static int fi_fclose(FILE *fp);
+#define fopen  fi_fopen
+#define fwrite fi_fwrite
+#define fsync  fi_fsync
+#define remove fi_remove
+#define fclose fi_fclose
+#include "debi_spool.c"
+#undef fopen
+#undef fwrite
+#undef fsync
+#undef remove
+#undef fclose
+
+#define SPOOL_DIR   DRV_BASE_PATH_SD
+#define NREC        4000
+#define OPEN_MAX    16
+
+typedef enum {
+    TORN_PREFIX,        // the write stops, nothing after it
+    TORN_ERASED,        // the rest of the write is erased flash
+    TORN_JUNK,          // the rest of the write is random
+    TORN_MAX,
+} torn_t;
+
+static jmp_buf s_crash;
+static long s_budget = -1;      // bytes and file operations before the power goes, -1 never
+static torn_t s_torn;
+static bool s_disk_full;        // writes come up short, and the power stays
+static FILE *s_open[OPEN_MAX];
+static uint32_t s_rng = 1;
+
+static const char *TOPICS[] = { "debi/watcher/replay/sensor", "debi/watcher/replay/detection" };
+static int s_put;               // records put
+static int s_synced;            // records put before the last flush
+static int s_sent_max = -1;
+static int s_got[NREC * 2];
+static int s_got_num;
+static bool s_refuse;
+
+/*************************************************************************
+ * File system fault injector
+ ************************************************************************/
+static uint32_t rnd(void)
+{
+    s_rng = s_rng * 1103515245u + 12345u;
+    return s_rng >> 8;
+}
+
+static void power_loss(void)
+{
+    longjmp(s_crash, 1);
+}
+
+static bool take(long n)
+{
+    if (s_budget < 0)
+    {
+        return true;
+    }
+    if (s_budget >= n)
+    {
+        s_budget -= n;
+        return true;
+    }
+    return false;
+}
+
+static FILE *fi_fopen(const char *path, const char *mode)
+{
+    if (mode[0] != 'r' && !take(1))
+    {
+        power_loss();
+    }
+    FILE *fp = fopen(path, mode);
+    for (int i = 0; fp && i < OPEN_MAX; i++)
+    {
+        if (!s_open[i])
+        {
+            s_open[i] = fp;
+            break;
+        }
+    }
+    return fp;
+}
+
+static int fi_fclose(FILE *fp)
+{
+    for (int i = 0; i < OPEN_MAX; i++)
+    {
+        if (s_open[i] == fp)
+        {
+            s_open[i] = NULL;
+        }
+    }
+    return fclose(fp);
+}
+
+static size_t fi_fwrite(const void *buf, size_t size, size_t n, FILE *fp)
+{
+    size_t total = size * n;
+
+    if (s_disk_full)
+    {
+        fwrite(buf, 1, total / 2, fp);
+        fflush(fp);
+        return 0;
+    }
+    if (take(total))
+    {
+        return fwrite(buf, size, n, fp);
+    }
+
+    size_t done = s_budget;
+    s_budget = 0;
+    fwrite(buf, 1, done, fp);
+    for (size_t i = done; s_torn != TORN_PREFIX && i < total; i++)
+    {
+        uint8_t c = s_torn == TORN_ERASED ? 0xff : rnd();
+        fwrite(&c, 1, 1, fp);
+    }
+    fflush(fp);
+    power_loss();
+    return 0;
+}
+
+/* what is written is what survives, the injector decides, so a real sync would only be slow */
+static int fi_fsync(int fd)
+{
+    if (!take(1))
+    {
+        power_loss();
+    }
+    return 0;
+}
+
+static int fi_remove(const char *path)
+{
+    if (!take(1))
+    {
+        power_loss();
+    }
+    return remove(path);
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static const char *payload(int id, size_t *len)
+{
+    static char buf[2048];
+    size_t n = 24 + (id * 131) % 600;
+    int head = snprintf(buf, sizeof(buf), "{\"id\":%d,\"p\":\"", id);
+
+    for (size_t i = head; i < n - 2; i++)
+    {
+        buf[i] = 'a' + (id + i) % 26;
+    }
+    buf[n - 2] = '"';
+    buf[n - 1] = '}';
+    *len = n;
+    return buf;
+}
+
+/* the replay sink, anything but a record that was put whole is an error */
+static int send_cb(const char *topic, const void *data, size_t len, int qos, bool retain)
+{
+    if (s_refuse)
+    {
+        return -1;
+    }
+
+    int id = atoi((const char *)data + 6);
+    size_t want_len;
+    const char *want = payload(id, &want_len);
+
+    TEST_ASSERT_TRUE_MESSAGE(id >= 0 && id < s_put, "record never put");
+    TEST_ASSERT_EQUAL_size_t(want_len, len);
+    TEST_ASSERT_EQUAL_MEMORY(want, data, len);
+    TEST_ASSERT_EQUAL_STRING(TOPICS[id % 2], topic);
+    TEST_ASSERT_EQUAL_INT(id % 2, qos);
+    TEST_ASSERT_EQUAL(id % 3 == 0, retain);
+
+    s_got[s_got_num++] = id;
+    if (id > s_sent_max)
+    {
+        s_sent_max = id;
+    }
+    return 0;
+}
+
+/* debi_spool_put() and the task's wakeup for a full batch */
+static bool put(int id)
+{
+    size_t len;
+    const char *p = payload(id, &len);
+    bool wake = s_spool.batch_len[!s_spool.fill] == 0 &&
+                s_spool.batch_len[s_spool.fill] + SPOOL_HDR_LEN + strlen(TOPICS[id % 2]) + len > DEBI_SPOOL_BATCH_BYTES;
+    bool ok = debi_spool_put(TOPICS[id % 2], p, len, id % 2, id % 3 == 0);
+
+    s_put = id + 1;
+    if (ok && wake)
+    {
+        write_batch();
+    }
+    return ok;
+}
+
+/* the task's flush timeout, everything put so far is synced after it */
+static void flush(void)
+{
+    write_batch();
+    swap_batch();
+    write_batch();
+    s_synced = s_put;
+}
+
+static bool replay_all(int rounds)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        if (replay_some())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* a reboot: RAM is gone, the files stay */
+static void reboot(void)
+{
+    uint8_t *batch0 = s_spool.batch[0];
+    uint8_t *batch1 = s_spool.batch[1];
+    uint8_t *rec = s_spool.rec;
+    SemaphoreHandle_t lock = s_spool.lock;
+
+    for (int i = 0; i < OPEN_MAX; i++)
+    {
+        if (s_open[i])
+        {
+            fclose(s_open[i]);
+            s_open[i] = NULL;
+        }
+    }
+    memset(&s_spool, 0, sizeof(s_spool));
+    s_spool.batch[0] = batch0;
+    s_spool.batch[1] = batch1;
+    s_spool.rec = rec;
+    s_spool.lock = lock;
+    s_spool.task = FAKE_TASK;
+    s_spool.send = send_cb;
+    strcpy(s_spool.dir, SPOOL_DIR);
+}
+
+static int spool_files(void)
+{
+    DIR *dir = opendir(SPOOL_DIR);
+    struct dirent *entry;
+    int num = 0;
+
+    TEST_ASSERT_NOT_NULL(dir);
+    while ((entry = readdir(dir)) != NULL)
+    {
+        num += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return num;
+}
+
+/* an outage, a partial replay, a second outage, then a full replay */
+static int workload(void)
+{
+    int id = 0;
+
+    for (; id < 40; id++)
+    {
+        put(id);
+        if (id % 7 == 6)
+        {
+            flush();
+        }
+    }
+    flush();
+    for (int i = 0; i < 3; i++)
+    {
+        replay_some();
+    }
+    for (; id < 70; id++)
+    {
+        put(id);
+        if (id % 5 == 4)
+        {
+            flush();
+        }
+    }
+    flush();
+    replay_all(1000);
+    return id;
+}
+
+/* boot after a power loss at case, mode torn */
+static void assert_recovers(long at)
+{
+    char msg[64];
+    int sent_before = s_sent_max;
+
+    snprintf(msg, sizeof(msg), "power lost at %ld, torn %d", at, s_torn);
+    reboot();
+    s_budget = -1;
+    s_got_num = 0;
+    spool_load();
+
+    uint32_t pending = s_spool.stats.pending;
+    TEST_ASSERT_TRUE_MESSAGE(replay_all(100000), msg);
+    for (int i = 1; i < s_got_num; i++)
+    {
+        TEST_ASSERT_GREATER_THAN_INT_MESSAGE(s_got[i - 1], s_got[i], msg);
+    }
+    // everything synced and not sent before the power went is back
+    for (int id = sent_before + 1, i = 0; id < s_synced; id++)
+    {
+        while (i < s_got_num && s_got[i] < id)
+        {
+            i++;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(i < s_got_num && s_got[i] == id, msg);
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(s_got_num, pending, msg);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, s_spool.stats.pending, msg);
+
+    // and the log goes on after it
+    int base = s_put;
+    s_got_num = 0;
+    for (int id = base; id < base + 20; id++)
+    {
+        put(id);
+    }
+    flush();
+    TEST_ASSERT_TRUE_MESSAGE(replay_all(100000), msg);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(20, s_got_num, msg);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(base, s_got[0], msg);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(base + 19, s_got[19], msg);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, spool_files(), msg);
+}
+
+void setUp(void)
+{
+    DIR *dir = opendir(SPOOL_DIR);
+    struct dirent *entry;
+    char path[300];
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", SPOOL_DIR, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+
+    reboot();
+    s_budget = -1;
+    s_disk_full = false;
+    s_refuse = false;
+    s_put = 0;
+    s_synced = 0;
+    s_sent_max = -1;
+    s_got_num = 0;
+}
+
+void tearDown(void)
+{
+    s_budget = -1;
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_all_come_back_once(void)
+{
+    int num = workload();
+
+    TEST_ASSERT_EQUAL_INT(num, s_got_num);
+    for (int i = 0; i < s_got_num; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(i, s_got[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(num, s_spool.stats.replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, s_spool.stats.pending);
+    TEST_ASSERT_EQUAL_INT(0, spool_files());
+}
+
+static void test_power_loss_anywhere(void)
+{
+    for (s_torn = TORN_PREFIX; s_torn < TORN_MAX; s_torn++)
+    {
+        // a prime stride lands the cut on every part of the records over the run, headers
+        // included
+        for (volatile long at = s_torn;; at += s_torn == TORN_PREFIX ? 5 : 17)
+        {
+            setUp();
+            s_budget = at;
+            if (setjmp(s_crash) == 0)
+            {
+                workload();
+                break;
+            }
+            assert_recovers(at);
+        }
+    }
+}
+
+static void test_disk_full(void)
+{
+    for (int id = 0; id < 10; id++)
+    {
+        put(id);
+    }
+    flush();
+    s_disk_full = true;
+    for (int id = 10; id < 20; id++)
+    {
+        put(id);
+    }
+    flush();
+    s_disk_full = false;
+    for (int id = 20; id < 30; id++)
+    {
+        put(id);
+    }
+    flush();
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1, s_spool.stats.write_errors);
+    TEST_ASSERT_EQUAL_UINT32(10, s_spool.stats.dropped);
+
+    // the torn segment is closed and the records after it come back, so do the whole ones the
+    // short write got out ahead of the tear
+    TEST_ASSERT_TRUE(replay_all(1000));
+    for (int i = 0, id = 0; id < 30; id++)
+    {
+        if (i < s_got_num && s_got[i] == id)
+        {
+            i++;
+        }
+        else
+        {
+            TEST_ASSERT_TRUE_MESSAGE(id >= 10 && id < 20, "record lost");
+        }
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(20, s_got_num);
+}
+
+static void test_refused_record_is_sent_again(void)
+{
+    for (int id = 0; id < 30; id++)
+    {
+        put(id);
+    }
+    flush();
+
+    replay_some();
+    int first = s_got_num;
+    TEST_ASSERT_GREATER_THAN_INT(0, first);
+    TEST_ASSERT_LESS_THAN_INT(30, first);
+    s_refuse = true;
+    replay_some();
+    replay_some();
+    s_refuse = false;
+    TEST_ASSERT_EQUAL_INT(first, s_got_num);
+
+    TEST_ASSERT_TRUE(replay_all(1000));
+    TEST_ASSERT_EQUAL_INT(30, s_got_num);
+    for (int i = 0; i < s_got_num; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(i, s_got[i]);
+    }
+}
+
+static void test_reboot_appends_to_last_segment(void)
+{
+    for (int id = 0; id < 3; id++)
+    {
+        put(id);
+    }
+    flush();
+    uint32_t seg = s_spool.seg_write;
+    size_t len = s_spool.seg_len;
+
+    reboot();
+    spool_load();
+    TEST_ASSERT_EQUAL_UINT32(seg, s_spool.seg_write);
+    TEST_ASSERT_EQUAL_size_t(len, s_spool.seg_len);
+    TEST_ASSERT_EQUAL_UINT32(3, s_spool.stats.pending);
+
+    for (int id = 3; id < 6; id++)
+    {
+        put(id);
+    }
+    flush();
+    TEST_ASSERT_EQUAL_UINT32(seg, s_spool.seg_write);
+    TEST_ASSERT_TRUE(replay_all(1000));
+    TEST_ASSERT_EQUAL_INT(6, s_got_num);
+}
+
+static void test_cap_drops_oldest_segments(void)
+{
+    const int num = 3000;
+
+    for (int id = 0; id < num; id++)
+    {
+        put(id);
+        if (id % 3 == 2)
+        {
+            flush();
+        }
+    }
+    flush();
+    debi_spool_stats_t stats = s_spool.stats;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(DEBI_SPOOL_SEGMENTS, stats.segments);
+    TEST_ASSERT_EQUAL_UINT32(num, stats.dropped + stats.pending);
+
+    TEST_ASSERT_TRUE(replay_all(100000));
+    TEST_ASSERT_EQUAL_UINT32(stats.pending, s_got_num);
+    TEST_ASSERT_EQUAL_INT(num - 1, s_got[s_got_num - 1]);
+    for (int i = 1; i < s_got_num; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(s_got[i - 1] + 1, s_got[i]);
+    }
+}
+
+/*************************************************************************
+ * The spool task, last: it cannot be stopped
+ ************************************************************************/
+#define PUTTERS     4
+#define PUTS        2000
+
+static pthread_mutex_t s_task_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_task_last[PUTTERS];
+static int s_task_got;
+static int s_task_bad;
+static int s_task_accepted[PUTTERS];
+
+static int task_send_cb(const char *topic, const void *data, size_t len, int qos, bool retain)
+{
+    int putter, i;
+
+    pthread_mutex_lock(&s_task_lock);
+    if (sscanf((const char *)data, "%d:%d", &putter, &i) != 2 || putter < 0 || putter >= PUTTERS ||
+        i <= s_task_last[putter])
+    {
+        s_task_bad++;
+    }
+    else
+    {
+        s_task_last[putter] = i;
+        s_task_got++;
+    }
+    pthread_mutex_unlock(&s_task_lock);
+    return 0;
+}
+
+static void *putter_thread(void *arg)
+{
+    long putter = (long)arg;
+    char buf[200];
+
+    for (int i = 0; i < PUTS; i++)
+    {
+        int n = snprintf(buf, sizeof(buf), "%ld:%d:%*s", putter, i, (i * 7) % 150, "x");
+        if (debi_spool_put(TOPICS[0], buf, n, 0, false))
+        {
+            s_task_accepted[putter]++;
+        }
+        if (i % 50 == 0)
+        {
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+static void test_task_with_publishers(void)
+{
+    pthread_t threads[PUTTERS];
+    debi_spool_stats_t stats;
+    int accepted = 0;
+
+    memset(&s_spool, 0, sizeof(s_spool));
+    for (int i = 0; i < PUTTERS; i++)
+    {
+        s_task_last[i] = -1;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, debi_spool_init(task_send_cb));
+    TEST_ASSERT_EQUAL_STRING(DRV_BASE_PATH_SD, s_spool.dir);
+
+    for (long i = 0; i < PUTTERS; i++)
+    {
+        pthread_create(&threads[i], NULL, putter_thread, (void *)i);
+    }
+    // replay while the publishers still write, pause, then replay the rest
+    usleep(300 * 1000);
+    debi_spool_replay(20);
+    usleep(200 * 1000);
+    debi_spool_pause();
+    for (int i = 0; i < PUTTERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        accepted += s_task_accepted[i];
+    }
+    debi_spool_replay(-1);
+    debi_spool_replay(10);
+    for (int i = 0; i < 3000; i++)
+    {
+        usleep(10 * 1000);
+        debi_spool_get_stats(&stats);
+        if (stats.pending == 0)
+        {
+            break;
+        }
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, stats.pending);
+    TEST_ASSERT_EQUAL_INT(0, s_task_bad);
+    TEST_ASSERT_EQUAL_INT(accepted, s_task_got + (int)stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(accepted, stats.spooled);
+}
+
+int main(void)
+{
+    uint8_t *mem = malloc(3 * DEBI_SPOOL_BATCH_BYTES + 1);
+
+    mkdir(SPOOL_DIR, 0755);
+    s_spool.batch[0] = mem;
+    s_spool.batch[1] = mem + DEBI_SPOOL_BATCH_BYTES;
+    s_spool.rec = mem + 2 * DEBI_SPOOL_BATCH_BYTES;
+    s_spool.lock = xSemaphoreCreateMutex();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_all_come_back_once);
+    RUN_TEST(test_power_loss_anywhere);
+    RUN_TEST(test_disk_full);
+    RUN_TEST(test_refused_record_is_sent_again);
+    RUN_TEST(test_reboot_appends_to_last_segment);
+    RUN_TEST(test_cap_drops_oldest_segments);
+    RUN_TEST(test_task_with_publishers);
+    return UNITY_END();
+}
@@ -0,0 +1,244 @@
+/*
+ * WE2 models of debi_taskflow (app/debi_taskflow.c) with the multi-model scheduler of
+ * debi_models, as the firmware builds it by default: boot hands the WE2 to the scheduler, and
+ * the failover's switch to local only leaves the person model alone on it, then brings gesture
+ * and pet back.
+ *
+ * The sscma client under the scheduler is a fake that answers every invoke at once with empty
+ * results, and counts the inferences of whichever model is loaded. The scheduler paces its
+ * rounds on the esp_timer clock, which the test moves on with the time it waits.
+ */
+#include <pthread.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "sscma_client_commands.h"
+#include "debi_taskflow.c"
+
+#define MODEL_IDS   4
+#define WAIT_MS     10000
+
+static struct sscma_client_t s_client;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_loaded = -1;
+static int s_switches[MODEL_IDS];       // set_model calls per model id
+static int s_inferences[MODEL_IDS];     // per model id
+static volatile int s_task_flow_stops;
+
+/*************************************************************************
+ * What debi_taskflow and debi_models link against
+ ************************************************************************/
+ESP_EVENT_DEFINE_BASE(VIEW_EVENT_BASE);
+esp_event_loop_handle_t app_event_loop_handle;
+
+esp_err_t tf_engine_status_get(int *p_status)
+{
+    *p_status = TF_STATUS_IDLE;
+    return ESP_OK;
+}
+
+void debi_face_bridge_feed_inference(const struct tf_data_inference_info *info) {}
+void debi_tracks_report(const struct tf_data_inference_info *info, const debi_camera_stamp_t *stamp, uint16_t *ids) {}
+void debi_failover_observe(const struct tf_data_inference_info *info, const uint16_t *ids, int64_t ts_us) {}
+
+void debi_camera_stamp(int64_t ts_us, debi_camera_stamp_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->ts_us = ts_us;
+}
+
+struct sscma_client_t *bsp_sscma_client_init(void)
+{
+    return &s_client;
+}
+
+esp_err_t sscma_client_init(sscma_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_break(sscma_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_register_callback(sscma_client_handle_t client, const sscma_client_callback_t *callback, void *user_ctx)
+{
+    client->on_connect = callback->on_connect;
+    client->on_event = callback->on_event;
+    client->user_ctx = user_ctx;
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_get_callback(sscma_client_handle_t client, sscma_client_callback_t *callback, void **user_ctx)
+{
+    memset(callback, 0, sizeof(*callback));
+    callback->on_connect = client->on_connect;
+    callback->on_event = client->on_event;
+    *user_ctx = client->user_ctx;
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_get_model(sscma_client_handle_t client, sscma_client_model_t **model, bool cached)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_model(sscma_client_handle_t client, int model)
+{
+    TEST_ASSERT_TRUE(model >= 0 && model < MODEL_IDS);
+    pthread_mutex_lock(&s_lock);
+    s_loaded = model;
+    s_switches[model]++;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// every inference answered right away, on the caller as if the monitor task had it
+esp_err_t sscma_client_invoke(sscma_client_handle_t client, int times, bool fliter, bool show)
+{
+    sscma_client_reply_t reply = { .payload = cJSON_CreateObject() };
+
+    cJSON_AddStringToObject(reply.payload, "name", CMD_AT_INVOKE);
+    for (int i = 0; i < times; i++)
+    {
+        pthread_mutex_lock(&s_lock);
+        s_inferences[s_loaded]++;
+        pthread_mutex_unlock(&s_lock);
+        client->on_event(client, &reply, client->user_ctx);
+    }
+    cJSON_Delete(reply.payload);
+    return ESP_OK;
+}
+
+esp_err_t sscma_utils_copy_boxes_from_reply(const sscma_client_reply_t *reply, sscma_client_box_t *boxes, int max_boxes, int *num_boxes)
+{
+    *num_boxes = 0;
+    return ESP_OK;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+// the boot waits for the engine, not here
+static void no_delay(uint32_t ticks)
+{
+}
+
+static void on_task_flow_stop(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    s_task_flow_stops++;
+}
+
+static void counts_clear(void)
+{
+    pthread_mutex_lock(&s_lock);
+    memset(s_switches, 0, sizeof(s_switches));
+    memset(s_inferences, 0, sizeof(s_inferences));
+    pthread_mutex_unlock(&s_lock);
+}
+
+static int inferences(int model)
+{
+    pthread_mutex_lock(&s_lock);
+    int n = s_inferences[model];
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+static int switches(int model)
+{
+    pthread_mutex_lock(&s_lock);
+    int n = s_switches[model];
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+#define WAIT_UNTIL(cond)                                \
+    do                                                  \
+    {                                                   \
+        int waited_ = 0;                                \
+        while (!(cond))                                 \
+        {                                               \
+            TEST_ASSERT_LESS_THAN_INT(WAIT_MS, waited_); \
+            usleep(1000);                               \
+            host_time_advance(1000);                    \
+            waited_++;                                  \
+        }                                               \
+    } while (0)
+
+// a round of every model: each loaded on the WE2 and run
+static void assert_all_models_run(void)
+{
+    WAIT_UNTIL(switches(1) > 0 && switches(3) > 0 && switches(2) > 0 &&
+               inferences(1) > 0 && inferences(3) > 0 && inferences(2) > 0);
+}
+
+void setUp(void)
+{
+    host_task_delay_hook(no_delay);
+}
+
+void tearDown(void)
+{
+    host_task_delay_hook(NULL);
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_no_switch_before_boot(void)
+{
+    // a task flow may still hold the WE2, the failover leaves it
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, debi_taskflow_set_local_only(true));
+    TEST_ASSERT_FALSE(debi_models_is_running());
+    TEST_ASSERT_EQUAL_INT(0, switches(1));
+}
+
+static void test_failover_switches_models(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, debi_taskflow_init());
+    // a task flow restored at boot is stopped before the scheduler takes the WE2
+    WAIT_UNTIL(debi_models_is_running());
+    WAIT_UNTIL(s_task_flow_stops == 1);
+    assert_all_models_run();
+
+    // the hub is away: the person model alone, at the local rate
+    TEST_ASSERT_EQUAL(ESP_OK, debi_taskflow_set_local_only(true));
+    counts_clear();
+    WAIT_UNTIL(inferences(1) >= 2 * (int)DEBI_TASKFLOW_LOCAL_PERSON_HZ);
+    TEST_ASSERT_EQUAL_INT(0, inferences(3));
+    TEST_ASSERT_EQUAL_INT(0, inferences(2));
+    TEST_ASSERT_EQUAL_INT(0, switches(3));
+    TEST_ASSERT_EQUAL_INT(0, switches(2));
+    TEST_ASSERT_EQUAL_INT(1, s_loaded);
+
+    // back: gesture and pet run again
+    TEST_ASSERT_EQUAL(ESP_OK, debi_taskflow_set_local_only(false));
+    counts_clear();
+    assert_all_models_run();
+
+    debi_models_stop();
+}
+
+int main(void)
+{
+    const esp_event_loop_args_t loop_args = {
+        .queue_size = 8,
+        .task_name = "app_loop",
+        .task_stack_size = 4096,
+        .task_priority = 5,
+        .task_core_id = tskNO_AFFINITY,
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&loop_args, &app_event_loop_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_handler_register_with(app_event_loop_handle, VIEW_EVENT_BASE,
+                                                              VIEW_EVENT_TASK_FLOW_STOP, on_task_flow_stop, NULL));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_no_switch_before_boot);
+    RUN_TEST(test_failover_switches_models);
+    return UNITY_END();
+}
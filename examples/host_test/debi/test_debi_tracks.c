@@ -0,0 +1,545 @@
+/*
+ * Track messages of debi_tracks: the bytes the hub decodes, ByteTrack ids across frames, the one
+ * empty message of a scene that empties, the hub away, and the frame id and time the camera gives
+ * the JPEG of the same frame.
+ *
+ * ByteTrack is the component's own C++ sources. Its ids come from one counter for the whole
+ * process, so the tests look at ids being kept and being different, not at their values.
+ */
+#include <pthread.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "mbedtls/base64.h"
+#include "debi_tracks.c"
+
+#define MSGS_MAX    256
+#define WAIT_MS     5000
+
+typedef struct {
+    uint8_t data[TRACKS_MSG_MAX];
+    size_t len;
+    int qos;
+    bool retain;
+} msg_t;
+
+typedef struct {
+    uint32_t frame_id;
+    uint64_t ts_us;
+} cam_header_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static msg_t s_msgs[MSGS_MAX];
+static int s_msgs_num;
+static cam_header_t s_cam_headers[MSGS_MAX];
+static int s_cam_headers_num;
+static bool s_hub;
+static int s_publish_fail;          // publishes of track messages left to fail
+static int s_broker;
+
+/*************************************************************************
+ * What the tracks and the camera link against
+ ************************************************************************/
+bool debi_os_hub_connected(void)
+{
+    return s_hub;
+}
+
+int debi_comms_publish_bin(const char *topic, const void *data, size_t len, int qos, bool retain)
+{
+    TEST_ASSERT_EQUAL_STRING(DEBI_TOPIC_TRACKS, topic);
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(TRACKS_MSG_MAX, len);
+    if (s_publish_fail > 0)
+    {
+        s_publish_fail--;
+        return -1;
+    }
+    TEST_ASSERT_LESS_THAN_INT(MSGS_MAX, s_msgs_num);
+    memcpy(s_msgs[s_msgs_num].data, data, len);
+    s_msgs[s_msgs_num].len = len;
+    s_msgs[s_msgs_num].qos = qos;
+    s_msgs[s_msgs_num].retain = retain;
+    s_msgs_num++;
+    return 0;
+}
+
+void *debi_os_get_mqtt_handle(void)
+{
+    return &s_broker;
+}
+
+debi_comms_health_t debi_comms_get_health(void)
+{
+    debi_comms_health_t health = { .connected = true };
+    return health;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | (uint32_t)get_u16(p + 2) << 16;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+// the camera's sender task, only the frame headers are kept
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    if (len == DEBI_CAMERA_HEADER_LEN && p[3] == DEBI_CAMERA_MSG_HEADER)
+    {
+        pthread_mutex_lock(&s_lock);
+        if (s_cam_headers_num < MSGS_MAX)
+        {
+            s_cam_headers[s_cam_headers_num].frame_id = get_u32(p + 4);
+            s_cam_headers[s_cam_headers_num].ts_us = get_u64(p + 8);
+            s_cam_headers_num++;
+        }
+        pthread_mutex_unlock(&s_lock);
+    }
+    return 0;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    return 0;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+typedef struct {
+    uint32_t frame_id;
+    uint64_t ts_us;
+    int count;
+    sscma_client_box_t boxes[DEBI_TRACKS_MAX_BOXES];
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+} tracks_msg_t;
+
+/* a message as tools/debi_tracks_decoder.py reads it */
+static tracks_msg_t decode(const msg_t *m)
+{
+    const uint8_t *p = m->data;
+    tracks_msg_t t = { 0 };
+
+    TEST_ASSERT_EQUAL_INT(0, m->qos);
+    TEST_ASSERT_FALSE(m->retain);
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(DEBI_TRACKS_HEADER_LEN, m->len);
+    TEST_ASSERT_EQUAL_UINT8('D', p[0]);
+    TEST_ASSERT_EQUAL_UINT8('T', p[1]);
+    TEST_ASSERT_EQUAL_UINT8(DEBI_TRACKS_PROTO_VERSION, p[2]);
+    t.count = p[3];
+    t.frame_id = get_u32(p + 4);
+    t.ts_us = get_u64(p + 8);
+    TEST_ASSERT_EQUAL_size_t(DEBI_TRACKS_HEADER_LEN + t.count * DEBI_TRACKS_BOX_LEN, m->len);
+
+    p += DEBI_TRACKS_HEADER_LEN;
+    for (int i = 0; i < t.count; i++, p += DEBI_TRACKS_BOX_LEN)
+    {
+        t.boxes[i].x = get_u16(p);
+        t.boxes[i].y = get_u16(p + 2);
+        t.boxes[i].w = get_u16(p + 4);
+        t.boxes[i].h = get_u16(p + 6);
+        t.boxes[i].score = p[8];
+        t.boxes[i].target = p[9];
+        t.ids[i] = get_u16(p + 10);
+    }
+    return t;
+}
+
+/* one inference of n boxes, the track ids the caller gets back in ids */
+static debi_camera_stamp_t report(const sscma_client_box_t *boxes, int n, uint16_t *ids)
+{
+    struct tf_data_inference_info info = {
+        .is_valid = true,
+        .type = INFERENCE_TYPE_BOX,
+        .p_data = (void *)boxes,
+        .cnt = n,
+    };
+    debi_camera_stamp_t stamp;
+    uint16_t unused[DEBI_TRACKS_MAX_BOXES];
+
+    debi_camera_stamp(0, &stamp);
+    debi_tracks_report(&info, &stamp, ids ? ids : unused);
+    return stamp;
+}
+
+static sscma_client_box_t box(int x, int y, int w, int h)
+{
+    sscma_client_box_t b = { .x = x, .y = y, .w = w, .h = h, .score = 90, .target = 0 };
+    return b;
+}
+
+static void msgs_clear(void)
+{
+    s_msgs_num = 0;
+    pthread_mutex_lock(&s_lock);
+    s_cam_headers_num = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void setUp(void)
+{
+    // a new tracker, as after a boot
+    if (s_tracks.tracker)
+    {
+        bt_tracker_destroy(s_tracks.tracker);
+    }
+    memset(&s_tracks, 0, sizeof(s_tracks));
+    s_tracks.last_empty = true;
+    s_hub = true;
+    s_publish_fail = 0;
+    msgs_clear();
+    host_time_advance(1000000);
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_wire_layout(void)
+{
+    // fields with both bytes set, a score and class at their ends
+    sscma_client_box_t boxes[2] = {
+        { .x = 0x0123, .y = 0x0145, .w = 0x00a0, .h = 0x00f0, .score = 100, .target = 0 },
+        { .x = 0x0030, .y = 0x0040, .w = 0x0020, .h = 0x0010, .score = 61, .target = 255 },
+    };
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+    debi_camera_stamp_t stamp;
+    struct tf_data_inference_info info = {
+        .is_valid = true,
+        .type = INFERENCE_TYPE_BOX,
+        .p_data = boxes,
+        .cnt = 2,
+    };
+
+    stamp.frame_id = 0x89abcdef;
+    stamp.ts_us = 0x0011223344556677LL;
+    debi_tracks_report(&info, &stamp, ids);
+
+    // the tracker's first frame confirms its tracks at once
+    TEST_ASSERT_NOT_EQUAL(0, ids[0]);
+    TEST_ASSERT_NOT_EQUAL(0, ids[1]);
+    TEST_ASSERT_NOT_EQUAL(ids[0], ids[1]);
+    for (int i = 2; i < DEBI_TRACKS_MAX_BOXES; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, ids[i]);
+    }
+
+    const uint8_t want[DEBI_TRACKS_HEADER_LEN + 2 * DEBI_TRACKS_BOX_LEN] = {
+        'D', 'T', 1, 2,
+        0xef, 0xcd, 0xab, 0x89,
+        0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00,
+        0x23, 0x01, 0x45, 0x01, 0xa0, 0x00, 0xf0, 0x00, 100, 0, ids[0] & 0xff, ids[0] >> 8,
+        0x30, 0x00, 0x40, 0x00, 0x20, 0x00, 0x10, 0x00, 61, 255, ids[1] & 0xff, ids[1] >> 8,
+    };
+    TEST_ASSERT_EQUAL_INT(1, s_msgs_num);
+    TEST_ASSERT_EQUAL_size_t(sizeof(want), s_msgs[0].len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(want, s_msgs[0].data, sizeof(want));
+
+    tracks_msg_t t = decode(&s_msgs[0]);
+    TEST_ASSERT_EQUAL_INT(2, t.count);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(boxes, t.boxes, sizeof(boxes));
+}
+
+static void test_boxes_past_the_limit_left_out(void)
+{
+    sscma_client_box_t boxes[DEBI_TRACKS_MAX_BOXES + 4];
+
+    for (int i = 0; i < DEBI_TRACKS_MAX_BOXES + 4; i++)
+    {
+        boxes[i] = box(20 + 30 * (i % 8), 20 + 60 * (i / 8), 20, 40);
+    }
+    report(boxes, DEBI_TRACKS_MAX_BOXES + 4, NULL);
+
+    TEST_ASSERT_EQUAL_INT(1, s_msgs_num);
+    tracks_msg_t t = decode(&s_msgs[0]);
+    TEST_ASSERT_EQUAL_INT(DEBI_TRACKS_MAX_BOXES, t.count);
+    TEST_ASSERT_EQUAL_size_t(TRACKS_MSG_MAX, s_msgs[0].len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(boxes, t.boxes, DEBI_TRACKS_MAX_BOXES * sizeof(boxes[0]));
+}
+
+static void test_ids_kept_across_frames(void)
+{
+    sscma_client_box_t boxes[2];
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+    uint16_t walker = 0, sitter = 0;
+
+    // one person walks across the frame past another sitting still, the order of the boxes swaps halfway
+    for (int f = 0; f < 60; f++)
+    {
+        int w = f < 30 ? 0 : 1;
+
+        boxes[w] = box(40 + 4 * f, 200, 60, 160);
+        boxes[1 - w] = box(300, 220, 80, 120);
+        report(boxes, 2, ids);
+        if (f == 0)
+        {
+            walker = ids[0];
+            sitter = ids[1];
+        }
+        TEST_ASSERT_NOT_EQUAL(0, walker);
+        TEST_ASSERT_NOT_EQUAL(walker, sitter);
+        TEST_ASSERT_EQUAL_UINT16(walker, ids[w]);
+        TEST_ASSERT_EQUAL_UINT16(sitter, ids[1 - w]);
+
+        // the hub gets the same ids
+        tracks_msg_t t = decode(&s_msgs[s_msgs_num - 1]);
+        TEST_ASSERT_EQUAL_UINT16(walker, t.ids[w]);
+        TEST_ASSERT_EQUAL_UINT16(sitter, t.ids[1 - w]);
+    }
+
+    // the sitter missed by the detector for a few frames keeps the id, the walker goes on walking
+    int f = 60;
+    for (int i = 0; i < DEBI_TRACKS_LOST_FRAMES / 2; i++, f++)
+    {
+        boxes[0] = box(40 + 4 * f, 200, 60, 160);
+        report(boxes, 1, ids);
+        TEST_ASSERT_EQUAL_UINT16(walker, ids[0]);
+    }
+    boxes[0] = box(40 + 4 * f++, 200, 60, 160);
+    boxes[1] = box(300, 220, 80, 120);
+    report(boxes, 2, ids);
+    TEST_ASSERT_EQUAL_UINT16(walker, ids[0]);
+    TEST_ASSERT_EQUAL_UINT16(sitter, ids[1]);
+
+    // gone longer than the tracker keeps a lost track: a new id, once ByteTrack has seen it twice
+    for (int i = 0; i < DEBI_TRACKS_LOST_FRAMES + 5; i++, f++)
+    {
+        boxes[0] = box(40 + 4 * f, 200, 60, 160);
+        report(boxes, 1, ids);
+    }
+    boxes[0] = box(40 + 4 * f++, 200, 60, 160);
+    report(boxes, 2, ids);
+    TEST_ASSERT_EQUAL_UINT16(0, ids[1]);
+    TEST_ASSERT_EQUAL_UINT16(0, decode(&s_msgs[s_msgs_num - 1]).ids[1]);
+    boxes[0] = box(40 + 4 * f++, 200, 60, 160);
+    report(boxes, 2, ids);
+    TEST_ASSERT_NOT_EQUAL(0, ids[1]);
+    TEST_ASSERT_NOT_EQUAL(sitter, ids[1]);
+    TEST_ASSERT_NOT_EQUAL(walker, ids[1]);
+    TEST_ASSERT_EQUAL_UINT16(walker, ids[0]);
+
+    debi_tracks_stats_t st;
+    debi_tracks_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT32(st.frames, st.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, st.untracked_boxes);
+}
+
+static void test_one_empty_message_when_the_scene_empties(void)
+{
+    sscma_client_box_t b = box(100, 100, 40, 80);
+    struct tf_data_inference_info classes = { .is_valid = true, .type = INFERENCE_TYPE_CLASS, .p_data = &b, .cnt = 1 };
+    struct tf_data_inference_info invalid = { .is_valid = false, .type = INFERENCE_TYPE_BOX, .p_data = &b, .cnt = 1 };
+    debi_camera_stamp_t stamp, last;
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+
+    // an empty scene from the start says nothing
+    for (int f = 0; f < 5; f++)
+    {
+        report(NULL, 0, NULL);
+    }
+    TEST_ASSERT_EQUAL_INT(0, s_msgs_num);
+
+    for (int f = 0; f < 3; f++)
+    {
+        report(&b, 1, NULL);
+    }
+    last = report(NULL, 0, NULL);
+    for (int f = 0; f < 10; f++)
+    {
+        report(NULL, 0, NULL);
+    }
+    TEST_ASSERT_EQUAL_INT(4, s_msgs_num);
+    tracks_msg_t t = decode(&s_msgs[3]);
+    TEST_ASSERT_EQUAL_INT(0, t.count);
+    TEST_ASSERT_EQUAL_UINT32(last.frame_id, t.frame_id);
+    TEST_ASSERT_EQUAL_UINT64(last.ts_us, t.ts_us);
+
+    // a person again, gone again: one more empty message
+    report(&b, 1, NULL);
+    report(NULL, 0, NULL);
+    report(NULL, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(6, s_msgs_num);
+    TEST_ASSERT_EQUAL_INT(0, decode(&s_msgs[5]).count);
+
+    // other inferences are not frames of the tracker, their ids are all 0
+    memset(ids, 0xff, sizeof(ids));
+    debi_camera_stamp(0, &stamp);
+    debi_tracks_report(&classes, &stamp, ids);
+    debi_tracks_report(&invalid, &stamp, NULL);
+    debi_tracks_report(NULL, &stamp, NULL);
+    for (int i = 0; i < DEBI_TRACKS_MAX_BOXES; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT16(0, ids[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(6, s_msgs_num);
+
+    // an empty message that did not get out is sent with the next empty frame
+    report(&b, 1, NULL);
+    s_publish_fail = 1;
+    report(NULL, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(7, s_msgs_num);
+    last = report(NULL, 0, NULL);
+    report(NULL, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(8, s_msgs_num);
+    TEST_ASSERT_EQUAL_UINT32(last.frame_id, decode(&s_msgs[7]).frame_id);
+}
+
+static void test_nothing_sent_while_the_hub_is_away(void)
+{
+    sscma_client_box_t b = box(200, 150, 60, 120);
+    uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+    uint16_t id;
+    debi_camera_stamp_t stamp;
+    debi_tracks_stats_t st;
+
+    report(&b, 1, ids);
+    id = ids[0];
+    TEST_ASSERT_EQUAL_INT(1, s_msgs_num);
+
+    // tracking goes on without the hub, the id is the same when it is back
+    s_hub = false;
+    for (int f = 0; f < 20; f++)
+    {
+        b.x += 2;
+        report(&b, 1, ids);
+        TEST_ASSERT_EQUAL_UINT16(id, ids[0]);
+    }
+    TEST_ASSERT_EQUAL_INT(1, s_msgs_num);
+    s_hub = true;
+    stamp = report(&b, 1, ids);
+    TEST_ASSERT_EQUAL_INT(2, s_msgs_num);
+    TEST_ASSERT_EQUAL_UINT16(id, decode(&s_msgs[1]).ids[0]);
+    TEST_ASSERT_EQUAL_UINT32(stamp.frame_id, decode(&s_msgs[1]).frame_id);
+
+    // the scene empties while the hub is away: the hub gets its empty message once it is back
+    s_hub = false;
+    for (int f = 0; f < 5; f++)
+    {
+        report(NULL, 0, NULL);
+    }
+    TEST_ASSERT_EQUAL_INT(2, s_msgs_num);
+    s_hub = true;
+    stamp = report(NULL, 0, NULL);
+    report(NULL, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(3, s_msgs_num);
+    TEST_ASSERT_EQUAL_INT(0, decode(&s_msgs[2]).count);
+    TEST_ASSERT_EQUAL_UINT32(stamp.frame_id, decode(&s_msgs[2]).frame_id);
+
+    // a person seen and gone while the hub was away: the hub had nothing open, nothing to close
+    s_hub = false;
+    report(&b, 1, NULL);
+    report(NULL, 0, NULL);
+    s_hub = true;
+    report(NULL, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(3, s_msgs_num);
+
+    debi_tracks_get_stats(&st);
+    TEST_ASSERT_EQUAL_UINT32(3, st.sent);
+    TEST_ASSERT_EQUAL_UINT32(32, st.frames);
+}
+
+static void test_stamp_matches_the_camera_frame(void)
+{
+    sscma_client_box_t b = box(160, 120, 50, 100);
+    struct tf_module_ai_camera_preview_info preview;
+    uint8_t jpeg[] = { 0xFF, 0xD8, 0xFF, 0xD9 };
+    char b64[16];
+    size_t b64_len = 0;
+    int64_t ts_us = esp_timer_get_time();
+
+    TEST_ASSERT_EQUAL(0, mbedtls_base64_encode((unsigned char *)b64, sizeof(b64), &b64_len, jpeg, sizeof(jpeg)));
+    memset(&preview, 0, sizeof(preview));
+    preview.img.p_buf = (uint8_t *)b64;
+    preview.img.len = b64_len;
+    preview.inference.is_valid = true;
+    preview.inference.type = INFERENCE_TYPE_BOX;
+    preview.inference.p_data = &b;
+    preview.inference.cnt = 1;
+
+    // previews the way debi_face_bridge handles them, every 100 ms with the camera at 2 fps; the
+    // sender finishes each frame the camera takes, every 5th, before the next preview
+    debi_camera_set_stream(DEBI_CAMERA_STREAM_FIXED, 2.0f, 0);
+    for (int f = 0; f < 20; f++)
+    {
+        debi_camera_stamp_t stamp;
+        uint16_t ids[DEBI_TRACKS_MAX_BOXES];
+        debi_camera_stats_t st = { 0 };
+
+        ts_us += 100000;
+        preview.ts_us = ts_us;
+        debi_camera_stamp(preview.ts_us, &stamp);
+        debi_tracks_report(&preview.inference, &stamp, ids);
+        debi_camera_forward_frame(&preview, &stamp);
+        for (int waited = 0; f % 5 == 0 && waited < WAIT_MS; waited++)
+        {
+            debi_camera_get_stats(&st);
+            if (st.frames_sent == (uint32_t)f / 5 + 1)
+            {
+                break;
+            }
+            vTaskDelay(1);
+        }
+    }
+
+    // a track message for every preview, ids one apart and times 100 ms apart
+    TEST_ASSERT_EQUAL_INT(20, s_msgs_num);
+    for (int i = 1; i < 20; i++)
+    {
+        tracks_msg_t a = decode(&s_msgs[i - 1]), t = decode(&s_msgs[i]);
+        TEST_ASSERT_EQUAL_UINT32(a.frame_id + 1, t.frame_id);
+        TEST_ASSERT_EQUAL_UINT64(a.ts_us + 100000, t.ts_us);
+    }
+
+    // every JPEG the camera sent has the id and time of the track message of its frame
+    pthread_mutex_lock(&s_lock);
+    TEST_ASSERT_EQUAL_INT(4, s_cam_headers_num);
+    for (int h = 0; h < s_cam_headers_num; h++)
+    {
+        int found = 0;
+
+        for (int i = 0; i < s_msgs_num; i++)
+        {
+            tracks_msg_t t = decode(&s_msgs[i]);
+            if (t.frame_id == s_cam_headers[h].frame_id)
+            {
+                TEST_ASSERT_EQUAL_UINT64(t.ts_us, s_cam_headers[h].ts_us);
+                found++;
+            }
+        }
+        TEST_ASSERT_EQUAL_INT(1, found);
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    // no time from the WE2: both take now
+    debi_camera_stamp_t stamp;
+    report(&b, 1, NULL);
+    debi_camera_stamp(0, &stamp);
+    TEST_ASSERT_EQUAL_UINT64(esp_timer_get_time(), decode(&s_msgs[s_msgs_num - 1]).ts_us);
+    TEST_ASSERT_EQUAL_UINT32(stamp.frame_id - 1, decode(&s_msgs[s_msgs_num - 1]).frame_id);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wire_layout);
+    RUN_TEST(test_boxes_past_the_limit_left_out);
+    RUN_TEST(test_ids_kept_across_frames);
+    RUN_TEST(test_one_empty_message_when_the_scene_empties);
+    RUN_TEST(test_nothing_sent_while_the_hub_is_away);
+    RUN_TEST(test_stamp_matches_the_camera_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,386 @@
+/*
+ * Block map and resume record of the AI model OTA (util/ota_delta.c) on the NVS stub.
+ *
+ * Besides the API, a small writer replays what app_ota.c does with the map against a fake model
+ * slot: hash every block, skip the ones the map vouches for, commit the map every few blocks. It
+ * shows why a saved map must not vouch for the blocks written after the commit.
+ */
+#include "unity.h"
+
+#include "host_test.h"
+#include "ota_delta.c"
+
+#define URL "http://example.com/model.tflite"
+
+#define SLOT_BLOCKS     64
+#define COMMIT_BLOCKS   8   // app_ota.c commits every 256KB, the window past a commit is as large
+#define DIRTY_BLOCKS    (COMMIT_BLOCKS + 2)
+
+static ota_delta_map_t s_map;
+static ota_delta_map_t s_loaded;
+static uint8_t s_slot[SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE];   // himax flash
+static uint8_t s_image[SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE];
+static uint8_t s_other[SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE];
+static int s_blocks_written;
+
+static void fill(uint8_t *image, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        image[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static void hash_block(const uint8_t *image, uint32_t index, uint8_t hash[OTA_DELTA_HASH_LEN])
+{
+    ota_delta_hash(image + index * OTA_DELTA_BLOCK_SIZE, OTA_DELTA_BLOCK_SIZE, hash);
+}
+
+static void store_raw(const void *data, size_t len)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, storage_write(OTA_DELTA_MAP_STORAGE, (void *)data, len));
+}
+
+/*
+ * Flash `image` into the slot the way the sscma writer does with the delta on: load the map,
+ * skip blocks it vouches for, commit every COMMIT_BLOCKS. With dirty false the commits save the
+ * whole map. The power goes at block `die_at` (-1 for never) when half of it is written.
+ */
+static bool flash_image(const uint8_t *image, uint32_t blocks, int die_at, bool dirty)
+{
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+    uint32_t last_commit = 0;
+
+    if (ota_delta_map_load(&s_map) != ESP_OK)
+    {
+        ota_delta_map_reset(&s_map, blocks * OTA_DELTA_BLOCK_SIZE);
+    }
+    ota_delta_map_save(&s_map, 0, dirty ? DIRTY_BLOCKS : 0);
+
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        hash_block(image, i, hash);
+        if (ota_delta_map_match(&s_map, i, hash))
+        {
+            continue;
+        }
+        if ((int)i == die_at)
+        {
+            // sector erased, half of it programmed
+            memset(s_slot + i * OTA_DELTA_BLOCK_SIZE, 0xFF, OTA_DELTA_BLOCK_SIZE);
+            memcpy(s_slot + i * OTA_DELTA_BLOCK_SIZE, image + i * OTA_DELTA_BLOCK_SIZE, OTA_DELTA_BLOCK_SIZE / 2);
+            return false;
+        }
+        memcpy(s_slot + i * OTA_DELTA_BLOCK_SIZE, image + i * OTA_DELTA_BLOCK_SIZE, OTA_DELTA_BLOCK_SIZE);
+        s_blocks_written++;
+        ota_delta_map_set(&s_map, i, hash);
+        if (i + 1 - last_commit >= COMMIT_BLOCKS)
+        {
+            last_commit = i + 1;
+            ota_delta_map_save(&s_map, last_commit, dirty ? DIRTY_BLOCKS : 0);
+        }
+    }
+    s_map.image_size = blocks * OTA_DELTA_BLOCK_SIZE;
+    ota_delta_map_save(&s_map, 0, 0);
+    return true;
+}
+
+void setUp(void)
+{
+    host_nvs_erase_all();
+    memset(&s_map, 0, sizeof(s_map));
+    memset(&s_loaded, 0, sizeof(s_loaded));
+    memset(s_slot, 0xFF, sizeof(s_slot));
+    fill(s_image, sizeof(s_image), 1);
+    fill(s_other, sizeof(s_other), 2);
+    s_blocks_written = 0;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_hash_is_never_unknown(void)
+{
+    uint8_t a[OTA_DELTA_HASH_LEN];
+    uint8_t b[OTA_DELTA_HASH_LEN];
+
+    // sha256("abc") starts ba7816bf
+    ota_delta_hash("abc", 3, a);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY("\xba\x78\x16\xbf\x8f\x01\xcf\xea", a, OTA_DELTA_HASH_LEN);
+
+    for (uint32_t i = 0; i < SLOT_BLOCKS; i++)
+    {
+        hash_block(s_image, i, a);
+        TEST_ASSERT_FALSE(memcmp(a, unknown_hash, OTA_DELTA_HASH_LEN) == 0);
+        hash_block(s_other, i, b);
+        TEST_ASSERT_FALSE(memcmp(a, b, OTA_DELTA_HASH_LEN) == 0);
+    }
+}
+
+static void test_map_reset_sizes_the_map(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_reset(&s_map, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, s_map.count);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_reset(&s_map, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, s_map.count);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_reset(&s_map, OTA_DELTA_BLOCK_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(1, s_map.count);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_reset(&s_map, OTA_DELTA_BLOCK_SIZE + 1));
+    TEST_ASSERT_EQUAL_UINT32(2, s_map.count);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_reset(&s_map, OTA_DELTA_MAX_BLOCKS * OTA_DELTA_BLOCK_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(OTA_DELTA_MAX_BLOCKS, s_map.count);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, ota_delta_map_reset(&s_map, OTA_DELTA_MAX_BLOCKS * OTA_DELTA_BLOCK_SIZE + 1));
+    TEST_ASSERT_EQUAL_UINT32(0, s_map.count);
+}
+
+static void test_map_match_set_forget(void)
+{
+    uint8_t a[OTA_DELTA_HASH_LEN];
+    uint8_t b[OTA_DELTA_HASH_LEN];
+
+    hash_block(s_image, 0, a);
+    hash_block(s_other, 0, b);
+    ota_delta_map_reset(&s_map, 4 * OTA_DELTA_BLOCK_SIZE);
+
+    // a fresh map vouches for nothing
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, 0, a));
+    ota_delta_map_set(&s_map, 0, a);
+    TEST_ASSERT_TRUE(ota_delta_map_match(&s_map, 0, a));
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, 0, b));
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, 1, a));
+
+    // a longer image grows the map, the slot bounds it
+    ota_delta_map_set(&s_map, 9, b);
+    TEST_ASSERT_EQUAL_UINT32(10, s_map.count);
+    TEST_ASSERT_TRUE(ota_delta_map_match(&s_map, 9, b));
+    ota_delta_map_set(&s_map, OTA_DELTA_MAX_BLOCKS, b);
+    TEST_ASSERT_EQUAL_UINT32(10, s_map.count);
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, OTA_DELTA_MAX_BLOCKS, b));
+
+    // forget stops at the end of the map
+    ota_delta_map_set(&s_map, 8, a);
+    ota_delta_map_forget(&s_map, 8, 100);
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, 8, a));
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_map, 9, b));
+    TEST_ASSERT_TRUE(ota_delta_map_match(&s_map, 0, a));
+    TEST_ASSERT_EQUAL_UINT32(10, s_map.count);
+}
+
+static void test_map_save_load_round_trip(void)
+{
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+
+    ota_delta_map_reset(&s_map, SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE);
+    for (uint32_t i = 0; i < SLOT_BLOCKS; i++)
+    {
+        hash_block(s_image, i, hash);
+        ota_delta_map_set(&s_map, i, hash);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_save(&s_map, 0, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(SLOT_BLOCKS, s_loaded.count);
+    TEST_ASSERT_EQUAL_UINT32(SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE, s_loaded.image_size);
+    TEST_ASSERT_EQUAL_MEMORY(s_map.hash, s_loaded.hash, SLOT_BLOCKS * OTA_DELTA_HASH_LEN);
+}
+
+static void test_map_save_leaves_dirty_window_unknown(void)
+{
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+
+    ota_delta_map_reset(&s_map, SLOT_BLOCKS * OTA_DELTA_BLOCK_SIZE);
+    for (uint32_t i = 0; i < SLOT_BLOCKS; i++)
+    {
+        hash_block(s_image, i, hash);
+        ota_delta_map_set(&s_map, i, hash);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_save(&s_map, 10, 5));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    for (uint32_t i = 0; i < SLOT_BLOCKS; i++)
+    {
+        hash_block(s_image, i, hash);
+        // the map in memory keeps vouching, only the saved copy forgets
+        TEST_ASSERT_TRUE(ota_delta_map_match(&s_map, i, hash));
+        TEST_ASSERT_EQUAL_MESSAGE(i < 10 || i >= 15, ota_delta_map_match(&s_loaded, i, hash), "block");
+    }
+
+    // a window past the end of the map is cut, not written past it
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_save(&s_map, SLOT_BLOCKS - 2, 100));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(SLOT_BLOCKS, s_loaded.count);
+    hash_block(s_image, SLOT_BLOCKS - 3, hash);
+    TEST_ASSERT_TRUE(ota_delta_map_match(&s_loaded, SLOT_BLOCKS - 3, hash));
+    hash_block(s_image, SLOT_BLOCKS - 1, hash);
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_loaded, SLOT_BLOCKS - 1, hash));
+}
+
+static void test_map_load_rejects_invalid(void)
+{
+    ota_delta_map_t *map = &s_map;
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+
+    // nothing stored
+    memset(&s_loaded, 0xAA, sizeof(s_loaded));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(0, s_loaded.count);
+
+    ota_delta_map_reset(map, 4 * OTA_DELTA_BLOCK_SIZE);
+    hash_block(s_image, 0, hash);
+    ota_delta_map_set(map, 0, hash);
+
+    // cut short
+    store_raw(map, OTA_DELTA_MAP_HEADER_SIZE + 3 * OTA_DELTA_HASH_LEN);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_loaded, 0, hash));
+
+    // another layout
+    map->magic ^= 1;
+    store_raw(map, OTA_DELTA_MAP_HEADER_SIZE + 4 * OTA_DELTA_HASH_LEN);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_map_load(&s_loaded));
+    map->magic ^= 1;
+    map->block_size = 2 * OTA_DELTA_BLOCK_SIZE;
+    store_raw(map, OTA_DELTA_MAP_HEADER_SIZE + 4 * OTA_DELTA_HASH_LEN);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_map_load(&s_loaded));
+
+    // header only
+    store_raw(map, 8);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(0, s_loaded.count);
+}
+
+static void test_map_clear_forgets_the_slot(void)
+{
+    uint8_t hash[OTA_DELTA_HASH_LEN];
+
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_clear());
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(0, s_loaded.count);
+    hash_block(s_image, 0, hash);
+    TEST_ASSERT_FALSE(ota_delta_map_match(&s_loaded, 0, hash));
+}
+
+static void test_map_save_fails_with_nvs(void)
+{
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+    ota_delta_map_reset(&s_map, 0);
+    host_nvs_fail_writes(true);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, ota_delta_map_save(&s_map, 0, 0));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, ota_delta_map_save(&s_map, 0, 4));
+    host_nvs_fail_writes(false);
+
+    // the map of the last good save is still there
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_map_load(&s_loaded));
+    TEST_ASSERT_EQUAL_UINT32(SLOT_BLOCKS, s_loaded.count);
+}
+
+static void test_unchanged_blocks_are_not_flashed(void)
+{
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+    TEST_ASSERT_EQUAL_INT(SLOT_BLOCKS, s_blocks_written);
+    TEST_ASSERT_EQUAL_MEMORY(s_image, s_slot, sizeof(s_image));
+
+    // the same image again writes nothing, one changed block writes one
+    s_blocks_written = 0;
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+    TEST_ASSERT_EQUAL_INT(0, s_blocks_written);
+    s_image[17 * OTA_DELTA_BLOCK_SIZE + 100] ^= 0x55;
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+    TEST_ASSERT_EQUAL_INT(1, s_blocks_written);
+    TEST_ASSERT_EQUAL_MEMORY(s_image, s_slot, sizeof(s_image));
+}
+
+static void test_torn_block_is_rewritten(void)
+{
+    // every point of death, after commits and in between, then back to the image on flash before
+    for (int die_at = 0; die_at < SLOT_BLOCKS; die_at += 3)
+    {
+        setUp();
+        TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+        TEST_ASSERT_FALSE(flash_image(s_other, SLOT_BLOCKS, die_at, true));
+        TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, true));
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(s_image, s_slot, sizeof(s_image), "rollback");
+
+        // or on to the new one
+        TEST_ASSERT_FALSE(flash_image(s_other, SLOT_BLOCKS, die_at, true));
+        TEST_ASSERT_TRUE(flash_image(s_other, SLOT_BLOCKS, -1, true));
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(s_other, s_slot, sizeof(s_other), "retry");
+    }
+}
+
+static void test_torn_block_survives_without_dirty_window(void)
+{
+    // the case the window is for: a map saved whole still vouches for the old block under the tear
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, false));
+    TEST_ASSERT_FALSE(flash_image(s_other, SLOT_BLOCKS, COMMIT_BLOCKS + 3, false));
+    TEST_ASSERT_TRUE(flash_image(s_image, SLOT_BLOCKS, -1, false));
+    TEST_ASSERT_FALSE(memcmp(s_image, s_slot, sizeof(s_image)) == 0);
+}
+
+static void test_resume_record(void)
+{
+    ota_delta_resume_t resume;
+    const uint32_t size = 40 * OTA_DELTA_BLOCK_SIZE + 100;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size, &resume));
+
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_save(URL, size, 8 * OTA_DELTA_BLOCK_SIZE, "\"v2\""));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_load(URL, size, &resume));
+    TEST_ASSERT_EQUAL_UINT32(size, resume.image_size);
+    TEST_ASSERT_EQUAL_UINT32(8 * OTA_DELTA_BLOCK_SIZE, resume.committed);
+    TEST_ASSERT_EQUAL_STRING("\"v2\"", resume.etag);
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_load(URL, 0, &resume));
+
+    // another download
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL "?v=3", size, &resume));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size + 1, &resume));
+
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_clear());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size, &resume));
+}
+
+static void test_resume_record_rejects_invalid(void)
+{
+    ota_delta_resume_t resume;
+    const uint32_t size = 40 * OTA_DELTA_BLOCK_SIZE;
+    char etag[2 * OTA_DELTA_ETAG_LEN];
+
+    // nothing done, off a block boundary, nothing left to do
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_save(URL, size, 0, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size, &resume));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_save(URL, size, OTA_DELTA_BLOCK_SIZE + 1, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size, &resume));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_save(URL, size, size, NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, ota_delta_resume_load(URL, size, &resume));
+
+    // an ETag too long for the record is cut
+    memset(etag, 'e', sizeof(etag) - 1);
+    etag[sizeof(etag) - 1] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_save(URL, size, OTA_DELTA_BLOCK_SIZE, etag));
+    TEST_ASSERT_EQUAL(ESP_OK, ota_delta_resume_load(URL, size, &resume));
+    TEST_ASSERT_EQUAL_size_t(OTA_DELTA_ETAG_LEN - 1, strlen(resume.etag));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, ota_delta_resume_load(NULL, size, &resume));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, ota_delta_resume_save(NULL, size, 0, NULL));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hash_is_never_unknown);
+    RUN_TEST(test_map_reset_sizes_the_map);
+    RUN_TEST(test_map_match_set_forget);
+    RUN_TEST(test_map_save_load_round_trip);
+    RUN_TEST(test_map_save_leaves_dirty_window_unknown);
+    RUN_TEST(test_map_load_rejects_invalid);
+    RUN_TEST(test_map_clear_forgets_the_slot);
+    RUN_TEST(test_map_save_fails_with_nvs);
+    RUN_TEST(test_unchanged_blocks_are_not_flashed);
+    RUN_TEST(test_torn_block_is_rewritten);
+    RUN_TEST(test_torn_block_survives_without_dirty_window);
+    RUN_TEST(test_resume_record);
+    RUN_TEST(test_resume_record_rejects_invalid);
+    return UNITY_END();
+}
@@ -0,0 +1,288 @@
+/*
+ * Reply framer of sscma_client: "\r{...}\n" frames cut at any chunk size, with truncated,
+ * duplicated, corrupted, oversized and zero padded input.
+ *
+ * The test builds the client by hand and calls the step of the process task, so that frames
+ * land in the reply queue of the client and nothing runs behind the test's back.
+ */
+#include "unity.h"
+
+#include "sscma_client_ops.c"
+
+#define FRAMES_MAX 16
+
+#define EVENT(n) "\r{\"type\": 1, \"name\": \"INVOKE\", \"code\": 0, \"data\": {\"n\": " #n "}}\n"
+
+typedef struct {
+    sscma_client_io_t base;
+    const char *data;
+    size_t len;
+    size_t pos;
+    size_t chunk;
+} fake_io_t;
+
+static fake_io_t s_io;
+static struct sscma_client_t s_client;
+static int s_frames[FRAMES_MAX];
+static int s_frames_num;
+
+static esp_err_t fake_read(sscma_client_io_t *io, void *data, size_t size)
+{
+    fake_io_t *fake = (fake_io_t *)io;
+
+    TEST_ASSERT_LESS_OR_EQUAL(fake->len - fake->pos, size);
+    memcpy(data, fake->data + fake->pos, size);
+    fake->pos += size;
+    return ESP_OK;
+}
+
+static esp_err_t fake_available(sscma_client_io_t *io, size_t *ret_avail)
+{
+    fake_io_t *fake = (fake_io_t *)io;
+    size_t left = fake->len - fake->pos;
+
+    *ret_avail = left < fake->chunk ? left : fake->chunk;
+    return ESP_OK;
+}
+
+static void on_event(sscma_client_handle_t client, const sscma_client_reply_t *reply, void *user_ctx)
+{
+}
+
+static void client_init(size_t rx_size, size_t rx_max)
+{
+    memset(&s_client, 0, sizeof(s_client));
+    s_client.io = &s_io.base;
+    s_client.rx_buffer.data = malloc(rx_size);
+    s_client.rx_buffer.len = rx_size;
+    s_client.framer.state = SSCMA_CLIENT_FRAME_HUNT;
+    s_client.framer.max_len = rx_max > rx_size ? rx_max : rx_size;
+    s_client.request_list = malloc(sizeof(List_t));
+    vListInitialise(s_client.request_list);
+    s_client.reply_queue = xQueueCreate(FRAMES_MAX, sizeof(sscma_client_reply_t));
+    // events are only queued for a client with an event callback
+    s_client.on_event = on_event;
+}
+
+static void client_deinit(void)
+{
+    sscma_client_reply_t reply;
+
+    while (xQueueReceive(s_client.reply_queue, &reply, 0) == pdTRUE)
+    {
+        sscma_client_reply_clear(&reply);
+    }
+    vQueueDelete(s_client.reply_queue);
+    free(s_client.request_list);
+    free(s_client.rx_buffer.data);
+}
+
+/* run the framer over the bytes in reads of at most chunk bytes, collect the "n" of every frame */
+static void feed(const char *data, size_t len, size_t chunk)
+{
+    sscma_client_reply_t reply;
+
+    s_io.base.read = fake_read;
+    s_io.base.available = fake_available;
+    s_io.data = data;
+    s_io.len = len;
+    s_io.pos = 0;
+    s_io.chunk = chunk;
+    while (s_io.pos < s_io.len)
+    {
+        sscma_client_rx_poll(&s_client);
+    }
+
+    s_frames_num = 0;
+    while (xQueueReceive(s_client.reply_queue, &reply, 0) == pdTRUE)
+    {
+        cJSON *data = cJSON_GetObjectItem(reply.payload, "data");
+        cJSON *n = cJSON_GetObjectItem(data, "n");
+        TEST_ASSERT_NOT_NULL(n);
+        TEST_ASSERT_LESS_THAN(FRAMES_MAX, s_frames_num);
+        s_frames[s_frames_num++] = n->valueint;
+        sscma_client_reply_clear(&reply);
+    }
+}
+
+static void feed_str(const char *data, size_t chunk)
+{
+    feed(data, strlen(data), chunk);
+}
+
+static void assert_frames(const int *expected, int num)
+{
+    TEST_ASSERT_EQUAL_INT(num, s_frames_num);
+    if (num > 0)
+    {
+        TEST_ASSERT_EQUAL_INT_ARRAY(expected, s_frames, num);
+    }
+}
+
+void setUp(void)
+{
+    memset(&s_io, 0, sizeof(s_io));
+    client_init(64, 512);
+}
+
+void tearDown(void)
+{
+    client_deinit();
+}
+
+static void test_frames_at_any_chunk_size(void)
+{
+    const int expected[] = { 1, 2, 3 };
+
+    for (size_t chunk = 1; chunk <= 80; chunk++)
+    {
+        feed_str(EVENT(1) EVENT(2) EVENT(3), chunk);
+        assert_frames(expected, 3);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, s_client.framer.resyncs);
+    TEST_ASSERT_EQUAL(SSCMA_CLIENT_FRAME_HUNT, s_client.framer.state);
+    TEST_ASSERT_EQUAL_size_t(0, s_client.rx_buffer.pos);
+}
+
+static void test_noise_between_frames_is_skipped(void)
+{
+    const int expected[] = { 1, 2 };
+
+    for (size_t chunk = 1; chunk <= 8; chunk++)
+    {
+        // a log line, a lone '\r' and a stray suffix outside any frame
+        feed_str("boot ok\n\r\r}\n" EVENT(1) "\rxx" EVENT(2) "}\n", chunk);
+        assert_frames(expected, 2);
+    }
+}
+
+static void test_truncated_frame_is_dropped(void)
+{
+    const int expected[] = { 2, 3 };
+
+    for (size_t chunk = 1; chunk <= 8; chunk++)
+    {
+        uint32_t resyncs = s_client.framer.resyncs;
+        // frame 1 lost its tail, the next boundary starts frame 2
+        feed_str("\r{\"type\": 1, \"name\": \"INVOKE\", \"data\": {\"n\": 1" EVENT(2) EVENT(3), chunk);
+        assert_frames(expected, 2);
+        TEST_ASSERT_EQUAL_UINT32(resyncs + 1, s_client.framer.resyncs);
+    }
+}
+
+static void test_truncated_frame_completes_later(void)
+{
+    const int expected[] = { 7 };
+    const char *frame = EVENT(7);
+    size_t len = strlen(frame);
+
+    // a frame cut between two reads is held until its suffix arrives
+    for (size_t cut = 1; cut < len; cut++)
+    {
+        feed(frame, cut, 4);
+        assert_frames(NULL, 0);
+        feed(frame + cut, len - cut, 4);
+        assert_frames(expected, 1);
+    }
+}
+
+static void test_duplicated_frame_is_delivered_twice(void)
+{
+    const int expected[] = { 4, 4, 5 };
+
+    // the framer does not dedupe, a repeated frame must not damage its neighbours
+    for (size_t chunk = 1; chunk <= 8; chunk++)
+    {
+        feed_str(EVENT(4) EVENT(4) EVENT(5), chunk);
+        assert_frames(expected, 3);
+    }
+}
+
+static void test_corrupted_frame_is_dropped(void)
+{
+    const int expected[] = { 6 };
+    uint32_t frames = s_client.framer.frames;
+
+    // framed but not JSON: the dispatcher drops it, the framer goes on with the next one
+    feed_str("\r{\"type\": 1, \"name\": \"INV\x01KE\", \"data\": {\"n\": 9 ]}\n" EVENT(6), 3);
+    assert_frames(expected, 1);
+    TEST_ASSERT_EQUAL_UINT32(frames + 2, s_client.framer.frames);
+
+    // a flipped byte in the body of frame 9
+    feed_str("\r{\"type\": 1, \"name\": \"INVOKE\", \"data\": {\"n\": 9x}}\n" EVENT(6), 3);
+    assert_frames(expected, 1);
+}
+
+static void test_oversized_frame_is_dropped(void)
+{
+    const int expected[] = { 8 };
+    char frame[2048];
+    int len;
+
+    len = snprintf(frame, sizeof(frame), "\r{\"type\": 1, \"name\": \"INVOKE\", \"data\": {\"n\": 1, \"pad\": \"%0900d\"}}\n" EVENT(8), 0);
+    TEST_ASSERT_LESS_THAN((int)sizeof(frame), len);
+
+    for (size_t chunk = 1; chunk <= 200; chunk += 37)
+    {
+        uint32_t overflows = s_client.framer.overflows;
+        feed(frame, len, chunk);
+        assert_frames(expected, 1);
+        TEST_ASSERT_EQUAL_UINT32(overflows + 1, s_client.framer.overflows);
+        // the buffer grew to the cap and no further
+        TEST_ASSERT_EQUAL_size_t(512, s_client.rx_buffer.len);
+    }
+}
+
+static void test_zero_padding_is_stripped(void)
+{
+    const int expected[] = { 1, 2 };
+    char data[256];
+    size_t len = 0;
+    const char *a = EVENT(1);
+    const char *b = EVENT(2);
+
+    // the spi transport pads every read with zeros, also inside a frame
+    memcpy(data + len, a, 20);
+    len += 20;
+    memset(data + len, 0, 13);
+    len += 13;
+    memcpy(data + len, a + 20, strlen(a) - 20);
+    len += strlen(a) - 20;
+    memset(data + len, 0, 7);
+    len += 7;
+    memcpy(data + len, b, strlen(b));
+    len += strlen(b);
+
+    for (size_t chunk = 1; chunk <= 16; chunk++)
+    {
+        feed(data, len, chunk);
+        assert_frames(expected, 2);
+    }
+}
+
+static void test_frame_stats(void)
+{
+    sscma_client_frame_stats_t stats;
+
+    feed_str(EVENT(1) "\r{\"n\"" EVENT(2), 5);
+    TEST_ASSERT_EQUAL(ESP_OK, sscma_client_get_frame_stats(&s_client, &stats));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.frames);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.resyncs);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.overflows);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_at_any_chunk_size);
+    RUN_TEST(test_noise_between_frames_is_skipped);
+    RUN_TEST(test_truncated_frame_is_dropped);
+    RUN_TEST(test_truncated_frame_completes_later);
+    RUN_TEST(test_duplicated_frame_is_delivered_twice);
+    RUN_TEST(test_corrupted_frame_is_dropped);
+    RUN_TEST(test_oversized_frame_is_dropped);
+    RUN_TEST(test_zero_padding_is_stripped);
+    RUN_TEST(test_frame_stats);
+    return UNITY_END();
+}
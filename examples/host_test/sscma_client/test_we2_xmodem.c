@@ -0,0 +1,480 @@
+/*
+ * XMODEM sender of the WE2 uart flasher against a simulated receiver: clean transfers, block
+ * ids wrapping under a resend, NACKs and lost blocks in the middle of the window, lost and late
+ * ACKs and the duplicate ACK that makes up for a lost one, a receiver that cancels, one that ends
+ * the transfer with EOF and one that never answers. Throughput over a PTY is in test_we2_xmodem_pty.c.
+ *
+ * Built once with the default window of 1 and once with a window of 4 and 1K blocks, see
+ * CMakeLists.txt. The receiver behaves as xmodem_write() expects of it for windows above 1: it
+ * NACKs a corrupted block, silently drops the blocks that follow until the corrupted one
+ * comes again, and ACKs a duplicate of the last block it took.
+ */
+#include "unity.h"
+
+#include "host_test.h"
+#include "sscma_client_flasher_we2_uart.c"
+
+#define IMAGE_MAX (320 * 1024)
+#define LATE_ACK_MS 5 /* a late ACK comes this long after the sender gave up waiting */
+
+typedef struct {
+    sscma_client_io_t base;
+    uint8_t rx[64];          /* bytes the receiver sent, not read yet */
+    size_t rx_head;
+    size_t rx_len;
+    uint8_t image[IMAGE_MAX]; /* data taken by the receiver */
+    size_t image_len;
+    uint8_t expect_id;
+    bool dropping;           /* after a NACK, until the NACKed block comes again */
+    int packets;             /* blocks received, retransmissions included */
+    int corrupt_from;        /* corrupt the packets in [corrupt_from, corrupt_to) */
+    int corrupt_to;
+    int lose_ack;            /* swallow the ACK of this packet */
+    int late_ack;            /* hold the ACK of this packet, and all after it, past the ACK timeout */
+    int64_t hold_until;
+    int lose_packet;         /* this packet never reaches the receiver */
+    int cancel_at;           /* answer this packet with CAN */
+    int eof_at;              /* answer this packet with EOF, the receiver ends the transfer */
+    bool mute;               /* never answer */
+    int out_of_sequence;     /* blocks a standard receiver would have cancelled on */
+    int duplicates;
+    int nacks;
+    int eots;
+    int cans;
+} fake_receiver_t;
+
+static fake_receiver_t s_rx;
+static sscma_client_flasher_we2_uart_t s_flasher;
+static uint8_t s_data[IMAGE_MAX];
+
+static uint16_t crc16(const uint8_t *data, size_t size)
+{
+    uint16_t crc = 0;
+
+    while (size--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void rx_push(uint8_t c)
+{
+    TEST_ASSERT_LESS_THAN(sizeof(s_rx.rx), s_rx.rx_len);
+    s_rx.rx[(s_rx.rx_head + s_rx.rx_len++) % sizeof(s_rx.rx)] = c;
+}
+
+static void receive_packet(const uint8_t *packet, size_t size)
+{
+    int n = s_rx.packets++;
+    size_t block = packet[0] == XSTX ? XMODEM_1K_BLOCK_SIZE : XMODEM_BLOCK_SIZE;
+    uint8_t id = packet[1];
+    bool corrupt = n >= s_rx.corrupt_from && n < s_rx.corrupt_to;
+
+    TEST_ASSERT_TRUE(packet[0] == XSOH || packet[0] == XSTX);
+    TEST_ASSERT_EQUAL_size_t(3 + block + 2, size);
+    TEST_ASSERT_EQUAL_HEX8(0xFF - id, packet[2]);
+    if (!corrupt)
+    {
+        TEST_ASSERT_EQUAL_HEX16(crc16(&packet[3], block), (uint16_t)(packet[3 + block] << 8 | packet[4 + block]));
+    }
+
+    if (s_rx.mute)
+    {
+        return;
+    }
+    if (n == s_rx.lose_packet)
+    {
+        // what follows is out of sequence until the lost block comes again
+        s_rx.dropping = true;
+        return;
+    }
+    if (n == s_rx.cancel_at)
+    {
+        rx_push(XCAN);
+        return;
+    }
+    if (n == s_rx.eof_at)
+    {
+        rx_push(XEOF);
+        return;
+    }
+    if (corrupt)
+    {
+        s_rx.nacks++;
+        s_rx.dropping = true;
+        rx_push(XNACK);
+        return;
+    }
+    if (id == s_rx.expect_id)
+    {
+        TEST_ASSERT_LESS_OR_EQUAL(IMAGE_MAX, s_rx.image_len + block);
+        memcpy(s_rx.image + s_rx.image_len, &packet[3], block);
+        s_rx.image_len += block;
+        s_rx.expect_id++;
+        s_rx.dropping = false;
+    }
+    else if (id == (uint8_t)(s_rx.expect_id - 1))
+    {
+        s_rx.duplicates++;
+    }
+    else
+    {
+        if (!s_rx.dropping)
+        {
+            s_rx.out_of_sequence++;
+        }
+        return;
+    }
+    if (n == s_rx.late_ack)
+    {
+        s_rx.hold_until = esp_timer_get_time() + (TRANSFER_ACK_TIMEOUT + LATE_ACK_MS) * 1000LL;
+    }
+    if (n != s_rx.lose_ack)
+    {
+        rx_push(XACK);
+    }
+}
+
+static esp_err_t fake_write(sscma_client_io_t *io, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+
+    if (size == 1)
+    {
+        if (bytes[0] == XEOT)
+        {
+            s_rx.eots++;
+            if (!s_rx.mute)
+            {
+                rx_push(XACK);
+            }
+        }
+        else if (bytes[0] == XCAN)
+        {
+            s_rx.cans++;
+        }
+        return ESP_OK;
+    }
+    receive_packet(bytes, size);
+    return ESP_OK;
+}
+
+static esp_err_t fake_read(sscma_client_io_t *io, void *data, size_t size)
+{
+    uint8_t *bytes = data;
+
+    TEST_ASSERT_LESS_OR_EQUAL(s_rx.rx_len, size);
+    for (size_t i = 0; i < size; i++)
+    {
+        bytes[i] = s_rx.rx[s_rx.rx_head];
+        s_rx.rx_head = (s_rx.rx_head + 1) % sizeof(s_rx.rx);
+        s_rx.rx_len--;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t fake_available(sscma_client_io_t *io, size_t *ret_avail)
+{
+    *ret_avail = esp_timer_get_time() < s_rx.hold_until ? 0 : s_rx.rx_len;
+    return ESP_OK;
+}
+
+/* polling loops of the sender sleep in vTaskDelay, let that pass in virtual time */
+static void delay_hook(uint32_t ticks)
+{
+    host_time_advance((int64_t)ticks * 1000);
+}
+
+void setUp(void)
+{
+    memset(&s_rx, 0, sizeof(s_rx));
+    s_rx.base.write = fake_write;
+    s_rx.base.read = fake_read;
+    s_rx.base.available = fake_available;
+    s_rx.expect_id = 1;
+    s_rx.corrupt_from = -1;
+    s_rx.corrupt_to = -1;
+    s_rx.lose_ack = -1;
+    s_rx.late_ack = -1;
+    s_rx.lose_packet = -1;
+    s_rx.cancel_at = -1;
+    s_rx.eof_at = -1;
+
+    memset(&s_flasher, 0, sizeof(s_flasher));
+    s_flasher.io = &s_rx.base;
+
+    for (size_t i = 0; i < sizeof(s_data); i++)
+    {
+        s_data[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+
+    host_time_reset();
+    host_task_delay_hook(delay_hook);
+}
+
+void tearDown(void)
+{
+    host_task_delay_hook(NULL);
+}
+
+/* the bootloader asks for CRC mode with 'C' */
+static void start(void)
+{
+    rx_push(XC);
+    TEST_ASSERT_EQUAL(ESP_OK, xmodem_start(&s_flasher));
+}
+
+/* send the image in writes of the given size, as the flasher's caller does */
+static esp_err_t transfer(size_t len, size_t write_size)
+{
+    for (size_t off = 0; off < len; off += write_size)
+    {
+        size_t n = len - off < write_size ? len - off : write_size;
+        esp_err_t ret = xmodem_write(&s_flasher, s_data + off, n);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    return xmodem_finish(&s_flasher);
+}
+
+static void assert_image(size_t len)
+{
+    TEST_ASSERT_EQUAL_size_t(len, s_rx.image_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(s_data, s_rx.image, len);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.out_of_sequence);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.eots);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.cans);
+}
+
+static void test_clean_transfer(void)
+{
+    const size_t len = 37 * XMODEM_BLOCK_SIZE + 3 * XMODEM_1K_BLOCK_SIZE;
+
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, 4096));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.nacks);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.duplicates);
+}
+
+static void test_block_ids_wrap(void)
+{
+    // more than 255 blocks, the id wraps from 255 to 0
+    const size_t len = 300 * XMODEM_BLOCK_SIZE;
+
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, 1024 + XMODEM_BLOCK_SIZE));
+    assert_image(len);
+}
+
+static void test_corrupted_block_is_resent(void)
+{
+    const size_t len = 20 * XMODEM_1K_BLOCK_SIZE;
+
+    s_rx.corrupt_from = 3;
+    s_rx.corrupt_to = 4;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, 4096));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.nacks);
+}
+
+static void test_corrupted_burst_is_resent(void)
+{
+    const size_t len = 20 * XMODEM_1K_BLOCK_SIZE;
+
+    // three packets in a row, whether resends of the bad block or blocks in flight behind it
+    s_rx.corrupt_from = 5;
+    s_rx.corrupt_to = 8;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, 4096));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(3, s_rx.nacks);
+}
+
+static void test_lost_ack_is_resent_as_duplicate(void)
+{
+    const size_t len = 20 * XMODEM_1K_BLOCK_SIZE;
+
+    s_rx.lose_ack = 6;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, 4096));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.duplicates);
+}
+
+static void test_lost_ack_then_nack(void)
+{
+    // one ACK short in the middle of the window, the receiver's ACK of the duplicate makes up
+    // for it; a NACK after that finds the sender in step with the receiver
+    const size_t len = 24 * XMODEM_1K_BLOCK_SIZE;
+
+    s_rx.lose_ack = 6;
+    s_rx.corrupt_from = 14;
+    s_rx.corrupt_to = 15;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.nacks);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.duplicates);
+}
+
+static void test_window_wraps_across_resend(void)
+{
+    // block 254 is NACKed with the window reaching over the id wrap, the go-back resends 254, 255, 0, ...
+    const int blocks = 300;
+    const size_t len = blocks * xmodem_block_size(XMODEM_1K_BLOCK_SIZE);
+
+    s_rx.corrupt_from = 253;
+    s_rx.corrupt_to = 254;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.nacks);
+    // the NACKed block and the ones in flight behind it, nothing more
+    TEST_ASSERT_EQUAL_INT(blocks + XMODEM_WINDOW, s_rx.packets);
+}
+
+static void test_nack_mid_window(void)
+{
+    // a block corrupted with the window full: it and the blocks sent behind it go again, at once
+    const size_t len = 16 * XMODEM_1K_BLOCK_SIZE;
+    const int blocks = len / xmodem_block_size(XMODEM_1K_BLOCK_SIZE);
+
+    s_rx.corrupt_from = 5;
+    s_rx.corrupt_to = 6;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.nacks);
+    TEST_ASSERT_EQUAL_INT(blocks + XMODEM_WINDOW, s_rx.packets);
+    TEST_ASSERT_LESS_THAN_INT64(TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+}
+
+static void test_timeout_mid_window(void)
+{
+    // a block lost on the line: no answer to it or to those behind it, resent after the ACK timeout
+    const size_t len = 16 * XMODEM_1K_BLOCK_SIZE;
+    const int blocks = len / xmodem_block_size(XMODEM_1K_BLOCK_SIZE);
+
+    s_rx.lose_packet = 5;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.nacks);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.duplicates);
+    TEST_ASSERT_EQUAL_INT(blocks + XMODEM_WINDOW, s_rx.packets);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+    TEST_ASSERT_LESS_THAN_INT64(2 * TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+}
+
+static void test_timeouts_apart_are_resent(void)
+{
+    // a lost block now and then is not a dead receiver: each is resent, with ACKs in between
+    const size_t len = 64 * XMODEM_1K_BLOCK_SIZE;
+
+    s_rx.lose_packet = 5;
+    s_rx.lose_ack = 30;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(2 * TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+}
+
+static void test_late_acks_retire_blocks(void)
+{
+    // the ACKs of the window turn up just after the sender gave up waiting: they retire the
+    // blocks instead of being thrown away, no block the receiver took is sent again. A NACK
+    // further on shows whether the sender kept in step.
+    const size_t len = 16 * XMODEM_1K_BLOCK_SIZE;
+    const int blocks = len / xmodem_block_size(XMODEM_1K_BLOCK_SIZE);
+
+    s_rx.late_ack = 4;
+    s_rx.corrupt_from = 12;
+    s_rx.corrupt_to = 13;
+    start();
+    TEST_ASSERT_EQUAL(ESP_OK, transfer(len, len));
+    assert_image(len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.nacks);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.duplicates);
+    TEST_ASSERT_EQUAL_INT(blocks + XMODEM_WINDOW, s_rx.packets);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+}
+
+static void test_receiver_cancels(void)
+{
+    s_rx.cancel_at = 4;
+    start();
+    TEST_ASSERT_EQUAL(ESP_FAIL, transfer(16 * XMODEM_1K_BLOCK_SIZE, 4096));
+    TEST_ASSERT_EQUAL_INT(0, s_rx.eots);
+}
+
+static void test_receiver_ends_with_eof(void)
+{
+    // EOF in place of an ACK: the receiver is done, the sender answers with EOT and the write
+    // fails, the rest of it never went
+    s_rx.eof_at = 4;
+    start();
+    TEST_ASSERT_EQUAL(ESP_FAIL, xmodem_write(&s_flasher, s_data, 16 * XMODEM_1K_BLOCK_SIZE));
+    TEST_ASSERT_EQUAL_size_t(4 * xmodem_block_size(XMODEM_1K_BLOCK_SIZE), s_rx.image_len);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.eots);
+    TEST_ASSERT_EQUAL_INT(0, s_rx.cans);
+    TEST_ASSERT_LESS_THAN_INT64(TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time());
+}
+
+static void test_gives_up_after_retries(void)
+{
+    s_rx.corrupt_from = 2;
+    s_rx.corrupt_to = INT_MAX;
+    start();
+    TEST_ASSERT_EQUAL(ESP_FAIL, transfer(16 * XMODEM_1K_BLOCK_SIZE, 4096));
+    // with a window, the blocks in flight behind the bad one are NACKed as well
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(WRITE_BLOCK_MAX_RETRIES + 1, s_rx.nacks);
+    TEST_ASSERT_EQUAL_size_t(2 * xmodem_block_size(XMODEM_1K_BLOCK_SIZE), s_rx.image_len);
+    // the sender cancels the transfer on its way out
+    TEST_ASSERT_EQUAL_INT(1, s_rx.cans);
+}
+
+static void test_mute_receiver_times_out(void)
+{
+    int64_t begin;
+
+    start();
+    s_rx.mute = true;
+    begin = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, xmodem_write(&s_flasher, s_data, 4096));
+    // the blocks are resent once, then the write ends: two ACK timeouts, not one per retry
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(WRITE_BLOCK_MAX_TIMEOUTS * TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time() - begin);
+    TEST_ASSERT_LESS_THAN_INT64((WRITE_BLOCK_MAX_TIMEOUTS + 1) * TRANSFER_ACK_TIMEOUT * 1000LL, esp_timer_get_time() - begin);
+    TEST_ASSERT_EQUAL_INT(WRITE_BLOCK_MAX_TIMEOUTS * XMODEM_WINDOW, s_rx.packets);
+    TEST_ASSERT_EQUAL_INT(1, s_rx.cans);
+}
+
+int main(void)
+{
+    printf("xmodem window %d, 1K blocks %s\n", XMODEM_WINDOW, xmodem_block_size(XMODEM_1K_BLOCK_SIZE) == XMODEM_1K_BLOCK_SIZE ? "on" : "off");
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_transfer);
+    RUN_TEST(test_block_ids_wrap);
+    RUN_TEST(test_corrupted_block_is_resent);
+    RUN_TEST(test_corrupted_burst_is_resent);
+    RUN_TEST(test_lost_ack_is_resent_as_duplicate);
+    RUN_TEST(test_lost_ack_then_nack);
+    RUN_TEST(test_window_wraps_across_resend);
+    RUN_TEST(test_nack_mid_window);
+    RUN_TEST(test_timeout_mid_window);
+    RUN_TEST(test_timeouts_apart_are_resent);
+    RUN_TEST(test_late_acks_retire_blocks);
+    RUN_TEST(test_receiver_cancels);
+    RUN_TEST(test_receiver_ends_with_eof);
+    RUN_TEST(test_gives_up_after_retries);
+    RUN_TEST(test_mute_receiver_times_out);
+    return UNITY_END();
+}
@@ -0,0 +1,311 @@
+/*
+ * XMODEM sender of the WE2 uart flasher over a PTY, stop-and-wait against a window of 4.
+ *
+ * The sender runs as on the device, polling the tty for responses with a 1 ms delay. A receiver
+ * thread on the other end stands in for the bootloader: it lets each packet arrive only once a
+ * 921600 baud line could have carried it, spends PROGRAM_US on the block, then ACKs it. The same
+ * image goes through with 1K blocks and a window of 1, then 4; the window has to win by the
+ * time per block it hides behind the line.
+ */
+#define _GNU_SOURCE /* posix_openpt() and the rest of the PTY calls */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+
+static int s_window = 1;
+#define CONFIG_SSCMA_FLASHER_XMODEM_WINDOW s_window
+#define CONFIG_SSCMA_FLASHER_XMODEM_1K     1
+#include "sscma_client_flasher_we2_uart.c"
+
+#define IMAGE_LEN   (64 * 1024)
+#define WRITE_SIZE  (8 * 1024)       /* what app_ota hands the flasher at once */
+#define BAUD        921600
+#define PROGRAM_US  4000             /* the receiver's own time per block: flash write, turnaround */
+#define WRITES_MAX  1024
+
+typedef struct {
+    sscma_client_io_t base;
+    int fd;
+    pthread_mutex_t lock;
+    int64_t written_us[WRITES_MAX]; /* when the sender wrote each packet, the line starts on it then */
+    int writes;
+} pty_io_t;
+
+typedef struct {
+    int fd;
+    pty_io_t *p_io;
+    uint8_t image[IMAGE_LEN];
+    size_t image_len;
+    uint8_t expect_id;
+    int packets;
+    int bad;
+} pty_receiver_t;
+
+static pty_io_t s_io;
+static pty_receiver_t s_rx;
+static sscma_client_flasher_we2_uart_t s_flasher;
+static uint8_t s_data[IMAGE_LEN];
+static int64_t s_t0;
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - s_t0;
+}
+
+static void sleep_until(int64_t us)
+{
+    int64_t left = us - now_us();
+
+    if (left > 0)
+    {
+        usleep((useconds_t)left);
+    }
+}
+
+static uint16_t crc16(const uint8_t *data, size_t size)
+{
+    uint16_t crc = 0;
+
+    while (size--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static esp_err_t pty_write(sscma_client_io_t *io, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+
+    pthread_mutex_lock(&s_io.lock);
+    TEST_ASSERT_LESS_THAN_INT(WRITES_MAX, s_io.writes);
+    s_io.written_us[s_io.writes++] = now_us();
+    pthread_mutex_unlock(&s_io.lock);
+    while (size)
+    {
+        ssize_t n = write(s_io.fd, bytes, size);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        bytes += n;
+        size -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t pty_read(sscma_client_io_t *io, void *data, size_t size)
+{
+    uint8_t *bytes = data;
+
+    while (size)
+    {
+        ssize_t n = read(s_io.fd, bytes, size);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        bytes += n;
+        size -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t pty_available(sscma_client_io_t *io, size_t *ret_avail)
+{
+    int n = 0;
+
+    TEST_ASSERT_EQUAL_INT(0, ioctl(s_io.fd, FIONREAD, &n));
+    *ret_avail = n;
+    return ESP_OK;
+}
+
+/* the sender's polling delays are real, its timeouts on the clock of the test */
+static void delay_hook(uint32_t ticks)
+{
+    usleep(ticks * 1000);
+    host_time_set(now_us());
+}
+
+static void rx_read(uint8_t *p_buf, size_t size)
+{
+    while (size)
+    {
+        ssize_t n = read(s_rx.fd, p_buf, size);
+        if (n <= 0)
+        {
+            return;
+        }
+        p_buf += n;
+        size -= n;
+    }
+}
+
+/* the receiver runs on its own thread, it counts what goes wrong for the test to assert */
+static void rx_send(uint8_t c)
+{
+    if (write(s_rx.fd, &c, 1) != 1)
+    {
+        s_rx.bad++;
+    }
+}
+
+static void *receiver(void *p_arg)
+{
+    static uint8_t packet[XMODEM_PACKET_SIZE];
+    int64_t line_free = 0;
+
+    rx_send(XC);
+    while (1)
+    {
+        rx_read(packet, 1);
+        if (packet[0] == XEOT)
+        {
+            rx_send(XACK);
+            return NULL;
+        }
+        if (packet[0] != XSTX && packet[0] != XSOH)
+        {
+            s_rx.bad++;
+            continue;
+        }
+        size_t block = packet[0] == XSTX ? XMODEM_1K_BLOCK_SIZE : XMODEM_BLOCK_SIZE;
+        size_t size = 3 + block + 2;
+        rx_read(&packet[1], size - 1);
+
+        // on the line from when it was written, or when the line was done with the one before
+        pthread_mutex_lock(&s_io.lock);
+        int64_t written = s_io.written_us[s_rx.packets];
+        pthread_mutex_unlock(&s_io.lock);
+        line_free = (written > line_free ? written : line_free) + (int64_t)size * 10 * 1000000 / BAUD;
+        sleep_until(line_free);
+        s_rx.packets++;
+
+        uint16_t crc = (uint16_t)(packet[3 + block] << 8 | packet[4 + block]);
+        if (packet[1] != s_rx.expect_id || packet[2] != (uint8_t)(0xFF - packet[1]) || crc != crc16(&packet[3], block) ||
+            s_rx.image_len + block > IMAGE_LEN)
+        {
+            s_rx.bad++;
+            rx_send(XCAN);
+            return NULL;
+        }
+        memcpy(s_rx.image + s_rx.image_len, &packet[3], block);
+        s_rx.image_len += block;
+        s_rx.expect_id++;
+        usleep(PROGRAM_US);
+        rx_send(XACK);
+    }
+}
+
+/* one transfer of the image over a fresh PTY pair, bytes per second */
+static uint32_t pty_transfer(int window)
+{
+    struct termios tio;
+    pthread_t thread;
+    int64_t begin, elapsed;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if (master < 0)
+    {
+        TEST_IGNORE_MESSAGE("no PTY on this host");
+    }
+    TEST_ASSERT_EQUAL_INT(0, grantpt(master));
+    TEST_ASSERT_EQUAL_INT(0, unlockpt(master));
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(0, slave);
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    s_window = window;
+    memset(&s_io.written_us, 0, sizeof(s_io.written_us));
+    s_io.writes = 0;
+    s_io.fd = master;
+    memset(&s_rx, 0, sizeof(s_rx));
+    s_rx.fd = slave;
+    s_rx.expect_id = 1;
+    memset(&s_flasher, 0, sizeof(s_flasher));
+    s_flasher.io = &s_io.base;
+
+    pthread_create(&thread, NULL, receiver, NULL);
+    TEST_ASSERT_EQUAL(ESP_OK, xmodem_start(&s_flasher));
+    begin = now_us();
+    for (size_t off = 0; off < IMAGE_LEN; off += WRITE_SIZE)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, xmodem_write(&s_flasher, s_data + off, WRITE_SIZE));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, xmodem_finish(&s_flasher));
+    elapsed = now_us() - begin;
+    pthread_join(thread, NULL);
+    close(slave);
+    close(master);
+
+    TEST_ASSERT_EQUAL_INT(0, s_rx.bad);
+    TEST_ASSERT_EQUAL_INT(IMAGE_LEN / XMODEM_1K_BLOCK_SIZE, s_rx.packets);
+    TEST_ASSERT_EQUAL_size_t(IMAGE_LEN, s_rx.image_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(s_data, s_rx.image, IMAGE_LEN);
+    return (uint32_t)(IMAGE_LEN * 1000000LL / elapsed);
+}
+
+void setUp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    s_t0 = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    host_time_reset();
+    host_task_delay_hook(delay_hook);
+
+    s_io.base.write = pty_write;
+    s_io.base.read = pty_read;
+    s_io.base.available = pty_available;
+    pthread_mutex_init(&s_io.lock, NULL);
+    for (size_t i = 0; i < sizeof(s_data); i++)
+    {
+        s_data[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+}
+
+void tearDown(void)
+{
+    host_task_delay_hook(NULL);
+    pthread_mutex_destroy(&s_io.lock);
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_window_against_stop_and_wait(void)
+{
+    // per block the line takes 11.2 ms and the receiver 4 ms on top: stop-and-wait pays both,
+    // the window only the line
+    const int64_t line_us = (int64_t)(3 + XMODEM_1K_BLOCK_SIZE + 2) * 10 * 1000000 / BAUD;
+    uint32_t saw = pty_transfer(1);
+    uint32_t window = pty_transfer(4);
+    uint32_t line = (uint32_t)(XMODEM_1K_BLOCK_SIZE * 1000000LL / line_us);
+    uint32_t line_and_program = (uint32_t)(XMODEM_1K_BLOCK_SIZE * 1000000LL / (line_us + PROGRAM_US));
+
+    printf("stop-and-wait %u B/s, window of 4 %u B/s, line %u B/s\n", (unsigned)saw, (unsigned)window, (unsigned)line);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(line_and_program, saw);
+    TEST_ASSERT_GREATER_THAN_UINT32(saw * 125 / 100, window);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(line, window);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_window_against_stop_and_wait);
+    return UNITY_END();
+}
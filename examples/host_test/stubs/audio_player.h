@@ -0,0 +1,4 @@
+/*
+ * audio_player.h for the host tests, the esp-audio-player component: nothing of it is called
+ */
+#pragma once
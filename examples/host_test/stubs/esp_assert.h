@@ -0,0 +1,8 @@
+/*
+ * esp_assert.h for the host tests
+ */
+#pragma once
+
+#include <assert.h>
+
+#define ESP_STATIC_ASSERT _Static_assert
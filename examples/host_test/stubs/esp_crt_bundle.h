@@ -0,0 +1,16 @@
+/*
+ * esp_crt_bundle.h for the host tests, the client stub speaks plain http only
+ */
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_crt_bundle_attach(void *conf);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,270 @@
+/*
+ * esp_event loops for the host tests
+ *
+ * A loop with a task_name runs its handlers on a task of its own, as on the chip. Without one the
+ * test runs them with esp_event_loop_run(), on its own thread. The data of a post is copied, a
+ * handler matches on base and id, ESP_EVENT_ANY_ID and ESP_EVENT_ANY_BASE act as wildcards.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+typedef struct handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t fn;
+    void *arg;
+    struct handler *next;
+} handler_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} event_t;
+
+typedef struct {
+    QueueHandle_t queue;
+    pthread_mutex_t lock;
+    handler_t *handlers;
+    TaskHandle_t task;
+} loop_t;
+
+static bool matches(const handler_t *h, esp_event_base_t base, int32_t id)
+{
+    // bases are compared by pointer, as ESP-IDF does
+    return (h->base == ESP_EVENT_ANY_BASE || h->base == base) && (h->id == ESP_EVENT_ANY_ID || h->id == id);
+}
+
+static void dispatch(loop_t *loop, event_t *event)
+{
+    handler_t *h;
+    handler_t *run = NULL;
+    handler_t **tail = &run;
+
+    // handlers may (un)register from inside a handler, call a copy of the matching ones
+    pthread_mutex_lock(&loop->lock);
+    for (h = loop->handlers; h != NULL; h = h->next)
+    {
+        if (matches(h, event->base, event->id))
+        {
+            *tail = malloc(sizeof(handler_t));
+            **tail = *h;
+            (*tail)->next = NULL;
+            tail = &(*tail)->next;
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    while (run != NULL)
+    {
+        h = run;
+        run = h->next;
+        h->fn(h->arg, event->base, event->id, event->data);
+        free(h);
+    }
+    free(event->data);
+}
+
+static void loop_task(void *arg)
+{
+    loop_t *loop = arg;
+    event_t event;
+
+    while (1)
+    {
+        if (xQueueReceive(loop->queue, &event, portMAX_DELAY) == pdTRUE)
+        {
+            dispatch(loop, &event);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create(const esp_event_loop_args_t *event_loop_args, esp_event_loop_handle_t *event_loop)
+{
+    loop_t *loop;
+
+    if (event_loop_args == NULL || event_loop == NULL || event_loop_args->queue_size <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    loop = calloc(1, sizeof(loop_t));
+    if (loop == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    loop->queue = xQueueCreate(event_loop_args->queue_size, sizeof(event_t));
+    pthread_mutex_init(&loop->lock, NULL);
+    if (event_loop_args->task_name != NULL &&
+        xTaskCreatePinnedToCore(loop_task, event_loop_args->task_name, event_loop_args->task_stack_size, loop,
+                                event_loop_args->task_priority, &loop->task, event_loop_args->task_core_id) != pdPASS)
+    {
+        vQueueDelete(loop->queue);
+        free(loop);
+        return ESP_FAIL;
+    }
+    *event_loop = loop;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop)
+{
+    loop_t *loop = event_loop;
+    event_t event;
+
+    if (loop->task != NULL)
+    {
+        vTaskDelete(loop->task);
+    }
+    while (xQueueReceive(loop->queue, &event, 0) == pdTRUE)
+    {
+        free(event.data);
+    }
+    while (loop->handlers != NULL)
+    {
+        handler_t *h = loop->handlers;
+        loop->handlers = h->next;
+        free(h);
+    }
+    // the task may still be blocked on the queue until its next checkpoint, leave that to the OS
+    if (loop->task == NULL)
+    {
+        vQueueDelete(loop->queue);
+        free(loop);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run)
+{
+    loop_t *loop = event_loop;
+    TickType_t end = xTaskGetTickCount() + ticks_to_run;
+    event_t event;
+
+    if (loop == NULL || loop->task != NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (1)
+    {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (int32_t)(end - now) > 0 ? end - now : 0;
+        if (xQueueReceive(loop->queue, &event, wait) != pdTRUE)
+        {
+            break;
+        }
+        dispatch(loop, &event);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                                   esp_event_handler_t event_handler, void *event_handler_arg,
+                                                   esp_event_handler_instance_t *instance)
+{
+    loop_t *loop = event_loop;
+    handler_t *h;
+    handler_t **tail;
+
+    if (loop == NULL || event_handler == NULL || (event_base == ESP_EVENT_ANY_BASE && event_id != ESP_EVENT_ANY_ID))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    h = calloc(1, sizeof(handler_t));
+    if (h == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    h->base = event_base;
+    h->id = event_id;
+    h->fn = event_handler;
+    h->arg = event_handler_arg;
+    // handlers run in the order they were registered
+    pthread_mutex_lock(&loop->lock);
+    for (tail = &loop->handlers; *tail != NULL; tail = &(*tail)->next)
+    {
+    }
+    *tail = h;
+    pthread_mutex_unlock(&loop->lock);
+    if (instance)
+    {
+        *instance = h;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                          esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return esp_event_handler_instance_register_with(event_loop, event_base, event_id, event_handler, event_handler_arg, NULL);
+}
+
+static esp_err_t unregister(loop_t *loop, esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler,
+                            esp_event_handler_instance_t instance)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    if (loop == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&loop->lock);
+    for (handler_t **h = &loop->handlers; *h != NULL; h = &(*h)->next)
+    {
+        handler_t *gone = *h;
+        if (gone->base == event_base && gone->id == event_id &&
+            (instance ? gone == instance : gone->fn == event_handler))
+        {
+            *h = gone->next;
+            free(gone);
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&loop->lock);
+    return ret;
+}
+
+esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                            esp_event_handler_t event_handler)
+{
+    return unregister(event_loop, event_base, event_id, event_handler, NULL);
+}
+
+esp_err_t esp_event_handler_instance_unregister_with(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                                     esp_event_handler_instance_t instance)
+{
+    return unregister(event_loop, event_base, event_id, NULL, instance);
+}
+
+esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                            const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    loop_t *loop = event_loop;
+    event_t event = { .base = event_base, .id = event_id };
+
+    if (loop == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (event_data && event_data_size)
+    {
+        event.data = malloc(event_data_size);
+        if (event.data == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (xQueueSend(loop->queue, &event, ticks_to_wait) != pdTRUE)
+    {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
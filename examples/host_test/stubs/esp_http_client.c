@@ -0,0 +1,315 @@
+/*
+ * esp_http_client over host sockets, with the faults of host_socket_fault_push(), see
+ * esp_http_client.h
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "host_test.h"
+
+#define HEADERS_MAX     2048
+#define FAULTS_MAX      32
+
+static const char *TAG = "host.http";
+
+struct esp_http_client
+{
+    char url[256];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    char headers[HEADERS_MAX];
+    size_t headers_len;
+    int fd;
+    host_socket_fault_t fault;
+    int status;
+    int64_t content_length;
+    bool chunked;
+    char rx[HEADERS_MAX];     // what came after the response headers
+    size_t rx_len;
+    size_t rx_pos;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_socket_fault_t s_faults[FAULTS_MAX];
+static int s_faults_num;
+static unsigned s_connections;
+
+void host_socket_fault_push(host_socket_fault_t fault)
+{
+    pthread_mutex_lock(&s_lock);
+    if (s_faults_num < FAULTS_MAX)
+    {
+        s_faults[s_faults_num++] = fault;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_socket_fault_clear(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_faults_num = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+unsigned host_socket_connections(void)
+{
+    pthread_mutex_lock(&s_lock);
+    unsigned connections = s_connections;
+    pthread_mutex_unlock(&s_lock);
+    return connections;
+}
+
+static host_socket_fault_t fault_pop(void)
+{
+    host_socket_fault_t fault = HOST_SOCKET_OK;
+
+    pthread_mutex_lock(&s_lock);
+    s_connections++;
+    if (s_faults_num > 0)
+    {
+        fault = s_faults[0];
+        memmove(&s_faults[0], &s_faults[1], (s_faults_num - 1) * sizeof(s_faults[0]));
+        s_faults_num--;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return fault;
+}
+
+esp_err_t esp_crt_bundle_attach(void *conf)
+{
+    return ESP_OK;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+
+    if (client == NULL)
+    {
+        return NULL;
+    }
+    snprintf(client->url, sizeof(client->url), "%s", config->url ? config->url : "");
+    client->method = config->method;
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : 5000;
+    client->fd = -1;
+    client->content_length = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    int len = snprintf(client->headers + client->headers_len, sizeof(client->headers) - client->headers_len, "%s: %s\r\n", key,
+                       value ? value : "");
+
+    if (len < 0 || (size_t)len >= sizeof(client->headers) - client->headers_len)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    client->headers_len += len;
+    return ESP_OK;
+}
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    static const char *methods[] = { "GET", "POST", "PUT", "PATCH", "DELETE", "HEAD" };
+    char host[64];
+    int port = 80;
+    char path[192] = "/";
+    char request[HEADERS_MAX + 512];
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    struct timeval tv = { .tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000 };
+    int len;
+
+    if (sscanf(client->url, "http://%63[^:/]:%d%191s", host, &port, path) < 1)
+    {
+        ESP_LOGE(TAG, "only http://host:port/path, not %s", client->url);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (inet_pton(AF_INET, strcmp(host, "localhost") == 0 ? "127.0.0.1" : host, &addr.sin_addr) != 1)
+    {
+        ESP_LOGE(TAG, "no name lookup, %s", host);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    addr.sin_port = htons(port);
+
+    client->fault = fault_pop();
+    if (client->fault == HOST_SOCKET_REFUSE)
+    {
+        ESP_LOGW(TAG, "fault: connection refused");
+        return ESP_FAIL;
+    }
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        ESP_LOGE(TAG, "connect to %s:%d failed", host, port);
+        close(client->fd);
+        client->fd = -1;
+        return ESP_FAIL;
+    }
+
+    len = snprintf(request, sizeof(request), "%s %s HTTP/1.1\r\nHost: %s:%d\r\n%sContent-Length: %d\r\nConnection: close\r\n\r\n",
+                   methods[client->method], path, host, port, client->headers, write_len);
+    if (!send_all(client->fd, request, len))
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len)
+{
+    if (client->fd < 0)
+    {
+        return -1;
+    }
+    if (client->fault == HOST_SOCKET_RESET)
+    {
+        // half the body made it out, then the connection is gone
+        struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+        send_all(client->fd, buffer, len / 2);
+        setsockopt(client->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(client->fd);
+        client->fd = -1;
+        ESP_LOGW(TAG, "fault: connection reset");
+        return -1;
+    }
+    return send_all(client->fd, buffer, len) ? len : -1;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char *end = NULL;
+    char *line = NULL;
+
+    if (client->fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    while ((end = memmem(client->rx, client->rx_len, "\r\n\r\n", 4)) == NULL)
+    {
+        ssize_t n;
+        if (client->rx_len == sizeof(client->rx) - 1)
+        {
+            return ESP_FAIL;
+        }
+        n = recv(client->fd, client->rx + client->rx_len, sizeof(client->rx) - 1 - client->rx_len, 0);
+        if (n <= 0)
+        {
+            return ESP_FAIL;
+        }
+        client->rx_len += n;
+    }
+    *end = '\0';
+    if (sscanf(client->rx, "HTTP/1.%*d %d", &client->status) != 1)
+    {
+        return ESP_FAIL;
+    }
+    client->content_length = 0;
+    for (line = strstr(client->rx, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n"))
+    {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0)
+        {
+            client->content_length = strtoll(line + 17, NULL, 10);
+        }
+        else if (strncasecmp(line + 2, "Transfer-Encoding: chunked", 26) == 0)
+        {
+            client->chunked = true;
+        }
+    }
+    // keep what came after the headers for read_response
+    client->rx_pos = end + 4 - client->rx;
+    return client->content_length;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client)
+{
+    return client->chunked;
+}
+
+esp_err_t esp_http_client_get_chunk_length(esp_http_client_handle_t client, int *len)
+{
+    *len = 0;
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int esp_http_client_read_response(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int got = 0;
+
+    if (client->fault == HOST_SOCKET_CUT)
+    {
+        ESP_LOGW(TAG, "fault: response cut");
+        len /= 2;
+    }
+    while (got < len && client->rx_pos < client->rx_len)
+    {
+        buffer[got++] = client->rx[client->rx_pos++];
+    }
+    while (got < len && client->fd >= 0)
+    {
+        ssize_t n = recv(client->fd, buffer + got, len - got, 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        got += n;
+    }
+    return got;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,37 @@
+/*
+ * esp_https_ota.h for the host tests, the types the firmware's OTA header names and nothing
+ * else, no OTA runs on the host.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    const esp_http_client_config_t *http_config;
+} esp_https_ota_config_t;
+
+typedef void *esp_https_ota_handle_t;
+
+/* from esp_app_format.h and esp_partition.h, which the header brings along */
+typedef struct
+{
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+typedef struct
+{
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+ * esp_log.h for the host tests
+ *
+ * Errors and warnings go to stdout so that ctest shows them next to a failing assertion,
+ * info and debug only when the test runs with HOST_TEST_VERBOSE set.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+static inline int host_log_verbose(void)
+{
+    return getenv("HOST_TEST_VERBOSE") != NULL;
+}
+
+#define ESP_LOGE(tag, format, ...) printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (host_log_verbose()) { printf("I %s: " format "\n", tag, ##__VA_ARGS__); } } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (host_log_verbose()) { printf("D %s: " format "\n", tag, ##__VA_ARGS__); } } while (0)
+#define ESP_LOGV(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+
+#define ESP_EARLY_LOGE ESP_LOGE
+#define ESP_EARLY_LOGW ESP_LOGW
+#define ESP_EARLY_LOGI ESP_LOGI
+
+#define ESP_LOG_BUFFER_HEX(tag, buffer, len) ((void)(tag), (void)(buffer), (void)(len))
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, len, level) ((void)(tag), (void)(buffer), (void)(len), (void)(level))
+
+#define esp_log_level_set(tag, level) ((void)(tag), (void)(level))
+
+/* the pieces of a line logged in parts, shown like info and debug */
+static inline void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+
+    (void)level;
+    (void)tag;
+    if (host_log_verbose())
+    {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
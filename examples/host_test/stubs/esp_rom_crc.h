@@ -0,0 +1,17 @@
+/*
+ * esp_rom_crc.h for the host tests, the little endian CRC32 of the ROM
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* same as zlib's crc32(), chained by passing the previous result as crc */
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+ * esp_random, esp_restart and the ROM crc for the host tests
+ */
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "host_test.h"
+
+static volatile unsigned s_restarts;
+
+uint32_t esp_random(void)
+{
+    // random() gives 31 bits
+    return (uint32_t)random() ^ ((uint32_t)random() << 16);
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        p[i] = (uint8_t)esp_random();
+    }
+}
+
+// a table, the suites that frame records run the crc over megabytes unoptimised
+static uint32_t s_crc_table[256];
+static pthread_once_t s_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_table_init(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t crc = n;
+        for (int i = 0; i < 8; i++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+        s_crc_table[n] = crc;
+    }
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    pthread_once(&s_crc_once, crc_table_init);
+    crc = ~crc;
+    while (len--)
+    {
+        crc = s_crc_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void esp_restart(void)
+{
+    // the test plays the reboot, the caller carries on
+    s_restarts++;
+}
+
+unsigned host_restarts(void)
+{
+    return s_restarts;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 256 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return 128 * 1024;
+}
@@ -0,0 +1,19 @@
+/*
+ * esp_system.h for the host tests, esp_restart() only counts, see host_restarts()
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,188 @@
+/*
+ * esp_timer on a manual clock, see host_test.h
+ */
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "host_test.h"
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    bool active;
+    uint64_t period;
+    int64_t due;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_timer *s_timers;
+static int64_t s_now;
+
+int64_t esp_timer_get_time(void)
+{
+    pthread_mutex_lock(&s_lock);
+    int64_t now = s_now;
+    pthread_mutex_unlock(&s_lock);
+    return now;
+}
+
+void host_time_set(int64_t us)
+{
+    pthread_mutex_lock(&s_lock);
+    s_now = us;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static struct esp_timer *next_due(int64_t until)
+{
+    struct esp_timer *due = NULL;
+
+    for (struct esp_timer *t = s_timers; t != NULL; t = t->next)
+    {
+        if (t->active && t->due <= until && (due == NULL || t->due < due->due))
+        {
+            due = t;
+        }
+    }
+    return due;
+}
+
+void host_time_advance(int64_t us)
+{
+    pthread_mutex_lock(&s_lock);
+    int64_t until = s_now + us;
+    struct esp_timer *t;
+
+    while ((t = next_due(until)) != NULL)
+    {
+        s_now = t->due;
+        if (t->period)
+        {
+            t->due += t->period;
+        }
+        else
+        {
+            t->active = false;
+        }
+        // the callback may start, stop or delete timers
+        pthread_mutex_unlock(&s_lock);
+        t->callback(t->arg);
+        pthread_mutex_lock(&s_lock);
+    }
+    s_now = until;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_time_reset(void)
+{
+    pthread_mutex_lock(&s_lock);
+    while (s_timers)
+    {
+        struct esp_timer *t = s_timers;
+        s_timers = t->next;
+        free(t);
+    }
+    s_now = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    t->callback = create_args->callback;
+    t->arg = create_args->arg;
+
+    pthread_mutex_lock(&s_lock);
+    t->next = s_timers;
+    s_timers = t;
+    pthread_mutex_unlock(&s_lock);
+
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->period = period;
+    timer->due = s_now + (int64_t)timeout_us;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    bool was_active = timer->active;
+    timer->active = false;
+    pthread_mutex_unlock(&s_lock);
+    return was_active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **pp = &s_timers; *pp != NULL; pp = &(*pp)->next)
+    {
+        if (*pp == timer)
+        {
+            *pp = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    bool active = timer != NULL && timer->active;
+    pthread_mutex_unlock(&s_lock);
+    return active;
+}
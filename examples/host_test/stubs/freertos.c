@@ -0,0 +1,1019 @@
+/*
+ * FreeRTOS on pthreads for the host tests
+ *
+ * Blocking calls wait on condition variables of the monotonic clock, one tick is 1 ms. There
+ * is no scheduler: priorities and core affinity are ignored, every task runs at once.
+ */
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
+#include "host_test.h"
+
+/* ---- time ---- */
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+/* wait for the condition once, false when the deadline has passed */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *until)
+{
+    if (ticks == 0)
+    {
+        return false;
+    }
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/* ---- critical sections ---- */
+
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(void)
+{
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+/* ---- tasks ---- */
+
+struct host_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    TaskFunction_t code;
+    void *param;
+    UBaseType_t priority;
+    uint32_t notify;
+    bool notified;
+    bool suspended;
+    bool deleted;
+    char name[16];
+};
+
+static __thread struct host_task *s_current;
+
+static struct host_task *task_new(const char *name, UBaseType_t priority)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->cond);
+    task->priority = priority;
+    strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+    return task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // the thread of main() and any thread the test makes get a handle on first use
+    if (s_current == NULL)
+    {
+        s_current = task_new("main", 1);
+        s_current->thread = pthread_self();
+    }
+    return s_current;
+}
+
+/* a task deleted or suspended by another one stops here, at its next blocking call */
+static void task_checkpoint(void)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&self->lock);
+    while (self->suspended && !self->deleted)
+    {
+        pthread_cond_wait(&self->cond, &self->lock);
+    }
+    bool deleted = self->deleted;
+    pthread_mutex_unlock(&self->lock);
+    if (deleted)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+static void *task_entry(void *arg)
+{
+    s_current = arg;
+    s_current->code(s_current->param);
+    // a FreeRTOS task must not return
+    abort();
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, const uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                                   TaskHandle_t *pxCreatedTask, const BaseType_t xCoreID)
+{
+    (void)usStackDepth;
+    (void)xCoreID;
+    struct host_task *task = task_new(pcName, uxPriority);
+
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->code = pxTaskCode;
+    task->param = pvParameters;
+    if (pxCreatedTask)
+    {
+        *pxCreatedTask = task;
+    }
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, const uint32_t ulStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                                           StackType_t *const puxStackBuffer, StaticTask_t *const pxTaskBuffer, const BaseType_t xCoreID)
+{
+    (void)puxStackBuffer;
+    (void)pxTaskBuffer;
+    TaskHandle_t task = NULL;
+
+    xTaskCreatePinnedToCore(pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, &task, xCoreID);
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+
+    if (xTaskToDelete == NULL || xTaskToDelete == self)
+    {
+        pthread_exit(NULL);
+    }
+    pthread_mutex_lock(&xTaskToDelete->lock);
+    xTaskToDelete->deleted = true;
+    pthread_cond_broadcast(&xTaskToDelete->cond);
+    pthread_mutex_unlock(&xTaskToDelete->lock);
+}
+
+static void (*s_delay_hook)(uint32_t ticks);
+
+void host_task_delay_hook(void (*hook)(uint32_t ticks))
+{
+    s_delay_hook = hook;
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    task_checkpoint();
+    if (s_delay_hook)
+    {
+        s_delay_hook(xTicksToDelay);
+    }
+    else if (xTicksToDelay > 0)
+    {
+        usleep((useconds_t)xTicksToDelay * 1000);
+    }
+    task_checkpoint();
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *const pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    int32_t left = (int32_t)(wake - xTaskGetTickCount());
+
+    *pxPreviousWakeTime = wake;
+    if (left > 0)
+    {
+        vTaskDelay((TickType_t)left);
+        return pdTRUE;
+    }
+    task_checkpoint();
+    return pdFALSE;
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend)
+{
+    struct host_task *task = xTaskToSuspend ? xTaskToSuspend : xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&task->lock);
+    task->suspended = true;
+    pthread_mutex_unlock(&task->lock);
+    if (task == xTaskGetCurrentTaskHandle())
+    {
+        task_checkpoint();
+    }
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume)
+{
+    if (xTaskToResume == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&xTaskToResume->lock);
+    xTaskToResume->suspended = false;
+    pthread_cond_broadcast(&xTaskToResume->cond);
+    pthread_mutex_unlock(&xTaskToResume->lock);
+}
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    struct host_task *task = xTaskToQuery ? xTaskToQuery : xTaskGetCurrentTaskHandle();
+
+    return task->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+{
+    struct host_task *task = xTask ? xTask : xTaskGetCurrentTaskHandle();
+
+    return task->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    (void)xTask;
+    return 1024;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction)
+{
+    BaseType_t ret = pdPASS;
+
+    pthread_mutex_lock(&xTaskToNotify->lock);
+    switch (eAction)
+    {
+        case eSetBits:
+            xTaskToNotify->notify |= ulValue;
+            break;
+        case eIncrement:
+            xTaskToNotify->notify++;
+            break;
+        case eSetValueWithOverwrite:
+            xTaskToNotify->notify = ulValue;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (xTaskToNotify->notified)
+            {
+                ret = pdFAIL;
+            }
+            else
+            {
+                xTaskToNotify->notify = ulValue;
+            }
+            break;
+        default:
+            break;
+    }
+    xTaskToNotify->notified = true;
+    pthread_cond_broadcast(&xTaskToNotify->cond);
+    pthread_mutex_unlock(&xTaskToNotify->lock);
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+    struct timespec until = deadline(xTicksToWait);
+    uint32_t value;
+
+    task_checkpoint();
+    pthread_mutex_lock(&self->lock);
+    while (self->notify == 0 && !self->deleted)
+    {
+        if (!cond_wait(&self->cond, &self->lock, xTicksToWait, &until))
+        {
+            break;
+        }
+    }
+    value = self->notify;
+    if (value)
+    {
+        self->notify = xClearCountOnExit ? 0 : value - 1;
+    }
+    self->notified = false;
+    pthread_mutex_unlock(&self->lock);
+    task_checkpoint();
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait)
+{
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+    struct timespec until = deadline(xTicksToWait);
+    BaseType_t ret;
+
+    task_checkpoint();
+    pthread_mutex_lock(&self->lock);
+    if (!self->notified)
+    {
+        self->notify &= ~ulBitsToClearOnEntry;
+    }
+    while (!self->notified && !self->deleted)
+    {
+        if (!cond_wait(&self->cond, &self->lock, xTicksToWait, &until))
+        {
+            break;
+        }
+    }
+    if (pulNotificationValue)
+    {
+        *pulNotificationValue = self->notify;
+    }
+    ret = self->notified ? pdTRUE : pdFALSE;
+    if (self->notified)
+    {
+        self->notify &= ~ulBitsToClearOnExit;
+    }
+    self->notified = false;
+    pthread_mutex_unlock(&self->lock);
+    task_checkpoint();
+    return ret;
+}
+
+/* ---- queues ---- */
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->items = calloc(uxQueueLength ? uxQueueLength : 1, uxItemSize ? uxItemSize : 1);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->cond);
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t uxQueueLength, UBaseType_t uxItemSize, uint8_t *pucQueueStorage, StaticQueue_t *pxQueueBuffer)
+{
+    (void)pucQueueStorage;
+    (void)pxQueueBuffer;
+    return xQueueCreate(uxQueueLength, uxItemSize);
+}
+
+static BaseType_t queue_send(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait, bool front, bool overwrite)
+{
+    struct timespec until = deadline(xTicksToWait);
+    UBaseType_t slot;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length && !overwrite)
+    {
+        if (!cond_wait(&xQueue->cond, &xQueue->lock, xTicksToWait, &until) && xQueue->count == xQueue->length)
+        {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    if (overwrite && xQueue->count == xQueue->length)
+    {
+        slot = (xQueue->head + xQueue->count - 1) % xQueue->length;
+    }
+    else if (front)
+    {
+        xQueue->head = (xQueue->head + xQueue->length - 1) % xQueue->length;
+        slot = xQueue->head;
+        xQueue->count++;
+    }
+    else
+    {
+        slot = (xQueue->head + xQueue->count) % xQueue->length;
+        xQueue->count++;
+    }
+    if (xQueue->item_size)
+    {
+        memcpy(xQueue->items + slot * xQueue->item_size, pvItemToQueue, xQueue->item_size);
+    }
+    pthread_cond_broadcast(&xQueue->cond);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, false, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, true, false);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void *pvItemToQueue)
+{
+    return queue_send(xQueue, pvItemToQueue, 0, false, true);
+}
+
+static BaseType_t queue_receive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait, bool peek)
+{
+    struct timespec until = deadline(xTicksToWait);
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0)
+    {
+        if (!cond_wait(&xQueue->cond, &xQueue->lock, xTicksToWait, &until) && xQueue->count == 0)
+        {
+            pthread_mutex_unlock(&xQueue->lock);
+            return pdFALSE;
+        }
+    }
+    if (xQueue->item_size)
+    {
+        memcpy(pvBuffer, xQueue->items + xQueue->head * xQueue->item_size, xQueue->item_size);
+    }
+    if (!peek)
+    {
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+        xQueue->count--;
+        pthread_cond_broadcast(&xQueue->cond);
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, true);
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    xQueue->head = 0;
+    xQueue->count = 0;
+    pthread_cond_broadcast(&xQueue->cond);
+    pthread_mutex_unlock(&xQueue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&xQueue->lock);
+    UBaseType_t spaces = xQueue->length - xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return spaces;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    if (xQueue == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->cond);
+    free(xQueue->items);
+    free(xQueue);
+}
+
+/* ---- semaphores ---- */
+
+struct host_sem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max;
+    bool recursive;
+    TaskHandle_t owner;
+    UBaseType_t depth;
+};
+
+static SemaphoreHandle_t sem_new(UBaseType_t max, UBaseType_t count, bool recursive)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+
+    if (sem == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    cond_init(&sem->cond);
+    sem->max = max;
+    sem->count = count;
+    sem->recursive = recursive;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_new(1, 1, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return sem_new(1, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_new(1, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    return sem_new(uxMaxCount, uxInitialCount, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *pxMutexBuffer)
+{
+    (void)pxMutexBuffer;
+    return xSemaphoreCreateMutex();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
+{
+    (void)pxSemaphoreBuffer;
+    return xSemaphoreCreateBinary();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    struct timespec until = deadline(xBlockTime);
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    pthread_mutex_lock(&xSemaphore->lock);
+    if (xSemaphore->recursive && xSemaphore->depth > 0 && xSemaphore->owner == self)
+    {
+        xSemaphore->depth++;
+        pthread_mutex_unlock(&xSemaphore->lock);
+        return pdTRUE;
+    }
+    while (xSemaphore->count == 0)
+    {
+        if (!cond_wait(&xSemaphore->cond, &xSemaphore->lock, xBlockTime, &until) && xSemaphore->count == 0)
+        {
+            pthread_mutex_unlock(&xSemaphore->lock);
+            return pdFALSE;
+        }
+    }
+    xSemaphore->count--;
+    xSemaphore->owner = self;
+    xSemaphore->depth = 1;
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    if (xSemaphore->recursive && xSemaphore->depth > 1)
+    {
+        xSemaphore->depth--;
+        pthread_mutex_unlock(&xSemaphore->lock);
+        return pdTRUE;
+    }
+    if (xSemaphore->count >= xSemaphore->max)
+    {
+        pthread_mutex_unlock(&xSemaphore->lock);
+        return pdFALSE;
+    }
+    xSemaphore->count++;
+    xSemaphore->depth = 0;
+    xSemaphore->owner = NULL;
+    pthread_cond_broadcast(&xSemaphore->cond);
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xBlockTime)
+{
+    return xSemaphoreTake(xMutex, xBlockTime);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex)
+{
+    return xSemaphoreGive(xMutex);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_lock(&xSemaphore->lock);
+    UBaseType_t count = xSemaphore->count;
+    pthread_mutex_unlock(&xSemaphore->lock);
+    return count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    if (xSemaphore == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&xSemaphore->lock);
+    pthread_cond_destroy(&xSemaphore->cond);
+    free(xSemaphore);
+}
+
+/* ---- event groups ---- */
+
+struct host_event_group
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct host_event_group *group = calloc(1, sizeof(*group));
+
+    if (group == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    cond_init(&group->cond);
+    return group;
+}
+
+static bool bits_met(EventBits_t bits, EventBits_t wait_for, BaseType_t all)
+{
+    return all ? (bits & wait_for) == wait_for : (bits & wait_for) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor, const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits,
+                                TickType_t xTicksToWait)
+{
+    struct timespec until = deadline(xTicksToWait);
+    EventBits_t bits;
+
+    pthread_mutex_lock(&xEventGroup->lock);
+    while (!bits_met(xEventGroup->bits, uxBitsToWaitFor, xWaitForAllBits))
+    {
+        if (!cond_wait(&xEventGroup->cond, &xEventGroup->lock, xTicksToWait, &until))
+        {
+            break;
+        }
+    }
+    bits = xEventGroup->bits;
+    if (xClearOnExit && bits_met(bits, uxBitsToWaitFor, xWaitForAllBits))
+    {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    xEventGroup->bits |= uxBitsToSet;
+    EventBits_t bits = xEventGroup->bits;
+    pthread_cond_broadcast(&xEventGroup->cond);
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    pthread_mutex_lock(&xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    pthread_mutex_unlock(&xEventGroup->lock);
+    return bits;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    if (xEventGroup == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&xEventGroup->lock);
+    pthread_cond_destroy(&xEventGroup->cond);
+    free(xEventGroup);
+}
+
+/* ---- software timers, one service thread like the timer task ---- */
+
+struct host_timer
+{
+    TickType_t period;
+    UBaseType_t reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    bool deleted;
+    TickType_t due;
+    struct host_timer *next;
+};
+
+static pthread_mutex_t s_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timer_cond;
+static struct host_timer *s_timer_list;
+static bool s_timer_started;
+
+static void *timer_service(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&s_timer_lock);
+    while (true)
+    {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = 100;
+        struct host_timer **pp = &s_timer_list;
+
+        while (*pp != NULL)
+        {
+            struct host_timer *timer = *pp;
+            if (timer->deleted)
+            {
+                *pp = timer->next;
+                free(timer);
+                continue;
+            }
+            if (timer->active && (int32_t)(now - timer->due) >= 0)
+            {
+                if (timer->reload)
+                {
+                    timer->due += timer->period;
+                }
+                else
+                {
+                    timer->active = false;
+                }
+                pthread_mutex_unlock(&s_timer_lock);
+                timer->callback(timer);
+                pthread_mutex_lock(&s_timer_lock);
+                now = xTaskGetTickCount();
+            }
+            if (timer->active && (int32_t)(timer->due - now) < (int32_t)wait)
+            {
+                wait = (int32_t)(timer->due - now) > 0 ? timer->due - now : 0;
+            }
+            pp = &timer->next;
+        }
+        struct timespec until = deadline(wait);
+        pthread_cond_timedwait(&s_timer_cond, &s_timer_lock, &until);
+    }
+    return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char *pcTimerName, const TickType_t xTimerPeriodInTicks, const UBaseType_t uxAutoReload, void *pvTimerID,
+                           TimerCallbackFunction_t pxCallbackFunction)
+{
+    (void)pcTimerName;
+    struct host_timer *timer = calloc(1, sizeof(*timer));
+
+    if (timer == NULL)
+    {
+        return NULL;
+    }
+    timer->period = xTimerPeriodInTicks;
+    timer->reload = uxAutoReload;
+    timer->id = pvTimerID;
+    timer->callback = pxCallbackFunction;
+
+    pthread_mutex_lock(&s_timer_lock);
+    if (!s_timer_started)
+    {
+        pthread_t thread;
+        cond_init(&s_timer_cond);
+        pthread_create(&thread, NULL, timer_service, NULL);
+        pthread_detach(thread);
+        s_timer_started = true;
+    }
+    timer->next = s_timer_list;
+    s_timer_list = timer;
+    pthread_mutex_unlock(&s_timer_lock);
+    return timer;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    pthread_mutex_lock(&s_timer_lock);
+    xTimer->period = xNewPeriod;
+    xTimer->due = xTaskGetTickCount() + xNewPeriod;
+    xTimer->active = true;
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerChangePeriod(xTimer, xTimer->period, xTicksToWait);
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return xTimerStart(xTimer, xTicksToWait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    pthread_mutex_lock(&s_timer_lock);
+    xTimer->active = false;
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    (void)xTicksToWait;
+    pthread_mutex_lock(&s_timer_lock);
+    xTimer->active = false;
+    xTimer->deleted = true;
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    BaseType_t active = xTimer->active ? pdTRUE : pdFALSE;
+    pthread_mutex_unlock(&s_timer_lock);
+    return active;
+}
+
+void vTimerSetReloadMode(TimerHandle_t xTimer, const UBaseType_t uxAutoReload)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    xTimer->reload = uxAutoReload;
+    pthread_mutex_unlock(&s_timer_lock);
+}
+
+void *pvTimerGetTimerID(const TimerHandle_t xTimer)
+{
+    return xTimer->id;
+}
+
+/* ---- lists, as the kernel's list.c ---- */
+
+void vListInitialise(List_t *const pxList)
+{
+    pxList->pxIndex = (ListItem_t *)&(pxList->xListEnd);
+    pxList->xListEnd.xItemValue = portMAX_DELAY;
+    pxList->xListEnd.pxNext = (ListItem_t *)&(pxList->xListEnd);
+    pxList->xListEnd.pxPrevious = (ListItem_t *)&(pxList->xListEnd);
+    pxList->uxNumberOfItems = 0;
+}
+
+void vListInitialiseItem(ListItem_t *const pxItem)
+{
+    pxItem->pxContainer = NULL;
+}
+
+void vListInsertEnd(List_t *const pxList, ListItem_t *const pxNewListItem)
+{
+    ListItem_t *const pxIndex = pxList->pxIndex;
+
+    pxNewListItem->pxNext = pxIndex;
+    pxNewListItem->pxPrevious = pxIndex->pxPrevious;
+    pxIndex->pxPrevious->pxNext = pxNewListItem;
+    pxIndex->pxPrevious = pxNewListItem;
+    pxNewListItem->pxContainer = pxList;
+    pxList->uxNumberOfItems++;
+}
+
+void vListInsert(List_t *const pxList, ListItem_t *const pxNewListItem)
+{
+    ListItem_t *pxIterator;
+    const TickType_t xValueOfInsertion = pxNewListItem->xItemValue;
+
+    if (xValueOfInsertion == portMAX_DELAY)
+    {
+        pxIterator = pxList->xListEnd.pxPrevious;
+    }
+    else
+    {
+        for (pxIterator = (ListItem_t *)&(pxList->xListEnd); pxIterator->pxNext->xItemValue <= xValueOfInsertion; pxIterator = pxIterator->pxNext)
+        {
+        }
+    }
+    pxNewListItem->pxNext = pxIterator->pxNext;
+    pxNewListItem->pxNext->pxPrevious = pxNewListItem;
+    pxNewListItem->pxPrevious = pxIterator;
+    pxIterator->pxNext = pxNewListItem;
+    pxNewListItem->pxContainer = pxList;
+    pxList->uxNumberOfItems++;
+}
+
+UBaseType_t uxListRemove(ListItem_t *const pxItemToRemove)
+{
+    List_t *const pxList = pxItemToRemove->pxContainer;
+
+    pxItemToRemove->pxNext->pxPrevious = pxItemToRemove->pxPrevious;
+    pxItemToRemove->pxPrevious->pxNext = pxItemToRemove->pxNext;
+    if (pxList->pxIndex == pxItemToRemove)
+    {
+        pxList->pxIndex = pxItemToRemove->pxPrevious;
+    }
+    pxItemToRemove->pxContainer = NULL;
+    pxList->uxNumberOfItems--;
+    return pxList->uxNumberOfItems;
+}
@@ -0,0 +1,76 @@
+/*
+ * FreeRTOS for the host tests
+ *
+ * Tasks are pthreads and ticks are milliseconds of the monotonic clock, see freertos.c. Only
+ * the API the firmware uses is there, with the semantics of the ESP-IDF port.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE          ((BaseType_t)0)
+#define pdTRUE           ((BaseType_t)1)
+#define pdFAIL           pdFALSE
+#define pdPASS           pdTRUE
+
+#define portMAX_DELAY    ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(ticks) ((TickType_t)(((TickType_t)(ticks) * (TickType_t)1000U) / (TickType_t)configTICK_RATE_HZ))
+
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY   ((BaseType_t)0x7FFFFFFF)
+#define tskIDLE_PRIORITY ((UBaseType_t)0U)
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+/* the host has no interrupts, critical sections take one global lock */
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+#define portENTER_CRITICAL(mux)     ((void)(mux), vPortEnterCritical())
+#define portEXIT_CRITICAL(mux)      ((void)(mux), vPortExitCritical())
+#define taskENTER_CRITICAL(mux)     portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux)      portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(x)       ((void)(x))
+
+BaseType_t xPortGetCoreID(void);
+
+typedef struct {
+    uint8_t opaque[1];
+} StaticTask_t;
+
+typedef struct {
+    uint8_t opaque[1];
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+
+#include "freertos/list.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+/* what the ESP-IDF FreeRTOS.h brings along through its port and idf_additions.h */
+#include <assert.h>
+#include "esp_bit_defs.h"
+#include "esp_heap_caps.h"
+#include "freertos/event_groups.h"
@@ -0,0 +1,69 @@
+/*
+ * FreeRTOS lists for the host tests, same layout and walk order as the kernel's list.h
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct xLIST;
+
+struct xLIST_ITEM
+{
+    TickType_t xItemValue;
+    struct xLIST_ITEM *pxNext;
+    struct xLIST_ITEM *pxPrevious;
+    void *pvOwner;
+    struct xLIST *pxContainer;
+};
+typedef struct xLIST_ITEM ListItem_t;
+
+struct xMINI_LIST_ITEM
+{
+    TickType_t xItemValue;
+    struct xLIST_ITEM *pxNext;
+    struct xLIST_ITEM *pxPrevious;
+};
+typedef struct xMINI_LIST_ITEM MiniListItem_t;
+
+typedef struct xLIST
+{
+    volatile UBaseType_t uxNumberOfItems;
+    ListItem_t *pxIndex;
+    MiniListItem_t xListEnd;
+} List_t;
+
+#define listSET_LIST_ITEM_OWNER(pxListItem, pxOwner) ((pxListItem)->pvOwner = (void *)(pxOwner))
+#define listGET_LIST_ITEM_OWNER(pxListItem)          ((pxListItem)->pvOwner)
+#define listSET_LIST_ITEM_VALUE(pxListItem, xValue)  ((pxListItem)->xItemValue = (xValue))
+#define listGET_LIST_ITEM_VALUE(pxListItem)          ((pxListItem)->xItemValue)
+#define listCURRENT_LIST_LENGTH(pxList)              ((pxList)->uxNumberOfItems)
+#define listLIST_IS_EMPTY(pxList)                    (((pxList)->uxNumberOfItems == (UBaseType_t)0) ? pdTRUE : pdFALSE)
+#define listIS_CONTAINED_WITHIN(pxList, pxListItem)  (((pxListItem)->pxContainer == (pxList)) ? (pdTRUE) : (pdFALSE))
+#define listLIST_ITEM_CONTAINER(pxListItem)          ((pxListItem)->pxContainer)
+#define listGET_HEAD_ENTRY(pxList)                   (((pxList)->xListEnd).pxNext)
+#define listGET_NEXT(pxListItem)                     ((pxListItem)->pxNext)
+#define listGET_END_MARKER(pxList)                   ((ListItem_t const *)(&((pxList)->xListEnd)))
+
+#define listGET_OWNER_OF_NEXT_ENTRY(pxTCB, pxList)                                       \
+    do {                                                                                 \
+        List_t *const pxConstList = (pxList);                                            \
+        (pxConstList)->pxIndex = (pxConstList)->pxIndex->pxNext;                         \
+        if ((void *)(pxConstList)->pxIndex == (void *)&((pxConstList)->xListEnd)) {      \
+            (pxConstList)->pxIndex = (pxConstList)->pxIndex->pxNext;                     \
+        }                                                                                \
+        (pxTCB) = (pxConstList)->pxIndex->pvOwner;                                       \
+    } while (0)
+
+void vListInitialise(List_t *const pxList);
+void vListInitialiseItem(ListItem_t *const pxItem);
+void vListInsertEnd(List_t *const pxList, ListItem_t *const pxNewListItem);
+void vListInsert(List_t *const pxList, ListItem_t *const pxNewListItem);
+UBaseType_t uxListRemove(ListItem_t *const pxItemToRemove);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,20 @@
+/*
+ * FreeRTOS ring buffers for the host tests, the types only: no source under test makes one
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_ringbuf *RingbufHandle_t;
+
+typedef struct {
+    uint8_t opaque[1];
+} StaticRingbuffer_t;
+
+#ifdef __cplusplus
+}
+#endif
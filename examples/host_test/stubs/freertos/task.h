@@ -0,0 +1,54 @@
+/*
+ * FreeRTOS tasks for the host tests
+ */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, const uint32_t usStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                                   TaskHandle_t *pxCreatedTask, const BaseType_t xCoreID);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, const uint32_t ulStackDepth, void *pvParameters, UBaseType_t uxPriority,
+                                           StackType_t *const puxStackBuffer, StaticTask_t *const pxTaskBuffer, const BaseType_t xCoreID);
+#define xTaskCreate(code, name, stack, param, prio, handle) xTaskCreatePinnedToCore(code, name, stack, param, prio, handle, tskNO_AFFINITY)
+#define xTaskCreateStatic(code, name, stack, param, prio, sbuf, tbuf) xTaskCreateStaticPinnedToCore(code, name, stack, param, prio, sbuf, tbuf, tskNO_AFFINITY)
+
+/**
+ * Only a task deleting itself (NULL or its own handle) is supported, deleting another task
+ * marks it and it exits at its next blocking call.
+ */
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+void vTaskDelay(const TickType_t xTicksToDelay);
+BaseType_t xTaskDelayUntil(TickType_t *const pxPreviousWakeTime, const TickType_t xTimeIncrement);
+#define vTaskDelayUntil(prev, inc) ((void)xTaskDelayUntil(prev, inc))
+void vTaskSuspend(TaskHandle_t xTaskToSuspend);
+void vTaskResume(TaskHandle_t xTaskToResume);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetName(TaskHandle_t xTaskToQuery);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
+
+BaseType_t xTaskGenericNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction);
+#define xTaskNotifyGive(task) xTaskGenericNotify(task, 0, eIncrement)
+#define xTaskNotify(task, value, action) xTaskGenericNotify(task, value, action)
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t *pulNotificationValue, TickType_t xTicksToWait);
+
+#ifdef __cplusplus
+}
+#endif
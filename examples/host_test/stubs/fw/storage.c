@@ -0,0 +1,50 @@
+/*
+ * util/storage.h of the firmware for the host tests
+ *
+ * The firmware funnels NVS access through its app event loop, here the calls go to the NVS
+ * stub directly, from whichever thread makes them.
+ */
+#include <string.h>
+
+#include "nvs_flash.h"
+#include "storage.h"
+
+#define STORAGE_NAMESPACE "UserCfg"
+
+int storage_init(void)
+{
+    return nvs_flash_init();
+}
+
+esp_err_t storage_write(char *p_key, void *p_data, size_t len)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_blob(handle, p_key, p_data, len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_read(char *p_key, void *p_data, size_t *p_len)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_get_blob(handle, p_key, p_data, p_len);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t storage_erase()
+{
+    return nvs_flash_erase();
+}
@@ -0,0 +1,29 @@
+/*
+ * The allocators of util/util.h of the firmware for the host tests, PSRAM is the libc heap
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+void *psram_malloc(size_t sz)
+{
+    return malloc(sz);
+}
+
+void *psram_calloc(size_t n, size_t sz)
+{
+    return calloc(n, sz);
+}
+
+void *psram_realloc(void *ptr, size_t new_sz)
+{
+    return realloc(ptr, new_sz);
+}
+
+char *strdup_psram(const char *s)
+{
+    return strdup(s);
+}
@@ -0,0 +1,81 @@
+/*
+ * Controls of the host test stubs
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set the esp_timer clock, without firing timers
+ */
+void host_time_set(int64_t us);
+
+/**
+ * @brief Move the esp_timer clock forward and fire every timer that falls due, in order
+ */
+void host_time_advance(int64_t us);
+
+/**
+ * @brief Forget every esp_timer and reset the clock to 0
+ */
+void host_time_reset(void);
+
+/**
+ * @brief Call hook instead of sleeping in vTaskDelay, NULL to sleep again
+ *
+ * A test of a polling loop hooks host_time_advance() here, so that the loop's timeouts pass
+ * in virtual time.
+ */
+void host_task_delay_hook(void (*hook)(uint32_t ticks));
+
+/**
+ * @brief Forget every NVS namespace and key, and let writes succeed again
+ */
+void host_nvs_erase_all(void);
+
+/**
+ * @brief Fail every NVS write with ESP_ERR_NVS_NOT_ENOUGH_SPACE, as a full partition does
+ */
+void host_nvs_fail_writes(bool fail);
+
+/**
+ * @brief Number of NVS writes and erases that went through since host_nvs_erase_all()
+ */
+unsigned host_nvs_writes(void);
+
+/**
+ * @brief Number of esp_restart() calls, the stub returns to the caller
+ */
+unsigned host_restarts(void);
+
+typedef enum {
+    HOST_SOCKET_OK = 0,
+    HOST_SOCKET_REFUSE,     // connect fails
+    HOST_SOCKET_RESET,      // the connection drops while the request body is written
+    HOST_SOCKET_CUT,        // the response body stops halfway
+} host_socket_fault_t;
+
+/**
+ * @brief Queue a fault for the socket of the next esp_http_client connection, one per connection
+ */
+void host_socket_fault_push(host_socket_fault_t fault);
+
+/**
+ * @brief Drop the faults not taken yet
+ */
+void host_socket_fault_clear(void);
+
+/**
+ * @brief Number of connections esp_http_client opened or tried to, faulted ones included
+ */
+unsigned host_socket_connections(void);
+
+#ifdef __cplusplus
+}
+#endif
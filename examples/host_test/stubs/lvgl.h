@@ -0,0 +1,9 @@
+/*
+ * lvgl.h for the host tests, the types the firmware's headers name
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct _lv_obj_t lv_obj_t;
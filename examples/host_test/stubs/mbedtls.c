@@ -0,0 +1,195 @@
+/*
+ * The parts of mbedTLS the firmware uses, for the host tests: base64 and one-shot SHA-256
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/base64.h"
+#include "mbedtls/sha256.h"
+
+static const char s_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t need = 4 * ((slen + 2) / 3) + 1;
+    size_t i;
+    unsigned char *p = dst;
+
+    if (slen == 0)
+    {
+        *olen = 0;
+        return 0;
+    }
+    if (dst == NULL || dlen < need)
+    {
+        *olen = need;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    for (i = 0; i + 2 < slen; i += 3)
+    {
+        uint32_t v = (uint32_t)src[i] << 16 | (uint32_t)src[i + 1] << 8 | src[i + 2];
+        *p++ = s_alphabet[(v >> 18) & 0x3F];
+        *p++ = s_alphabet[(v >> 12) & 0x3F];
+        *p++ = s_alphabet[(v >> 6) & 0x3F];
+        *p++ = s_alphabet[v & 0x3F];
+    }
+    if (i < slen)
+    {
+        uint32_t v = (uint32_t)src[i] << 16 | (i + 1 < slen ? (uint32_t)src[i + 1] << 8 : 0);
+        *p++ = s_alphabet[(v >> 18) & 0x3F];
+        *p++ = s_alphabet[(v >> 12) & 0x3F];
+        *p++ = i + 1 < slen ? s_alphabet[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+    *p = 0;
+    *olen = p - dst;
+    return 0;
+}
+
+static int decode_char(unsigned char c)
+{
+    const char *p = c ? strchr(s_alphabet, c) : NULL;
+
+    return p ? (int)(p - s_alphabet) : -1;
+}
+
+int mbedtls_base64_decode(unsigned char *dst, size_t dlen, size_t *olen, const unsigned char *src, size_t slen)
+{
+    size_t n = 0;
+    size_t pad = 0;
+    size_t need;
+    uint32_t v = 0;
+    size_t bits = 0;
+    size_t out = 0;
+
+    // count the payload first, mbedTLS reports the size needed without writing
+    for (size_t i = 0; i < slen; i++)
+    {
+        if (src[i] == '\r' || src[i] == '\n' || src[i] == ' ')
+        {
+            continue;
+        }
+        if (src[i] == '=')
+        {
+            pad++;
+            continue;
+        }
+        if (pad || decode_char(src[i]) < 0)
+        {
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+        n++;
+    }
+    if (pad > 2 || (n + pad) % 4 != 0)
+    {
+        return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    }
+    need = n * 6 / 8;
+    if (dst == NULL || dlen < need)
+    {
+        *olen = need;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    for (size_t i = 0; i < slen; i++)
+    {
+        int d = decode_char(src[i]);
+        if (d < 0)
+        {
+            continue;
+        }
+        v = v << 6 | (uint32_t)d;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            dst[out++] = (unsigned char)(v >> bits);
+        }
+    }
+    *olen = out;
+    return 0;
+}
+
+static const uint32_t s_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void sha256_block(uint32_t state[8], const unsigned char block[64])
+{
+    uint32_t w[64];
+    uint32_t v[8];
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, state, sizeof(v));
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t s1 = ROR32(v[4], 6) ^ ROR32(v[4], 11) ^ ROR32(v[4], 25);
+        uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+        uint32_t t1 = v[7] + s1 + ch + s_sha256_k[i] + w[i];
+        uint32_t s0 = ROR32(v[0], 2) ^ ROR32(v[0], 13) ^ ROR32(v[0], 22);
+        uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+        memmove(&v[1], &v[0], 7 * sizeof(uint32_t));
+        v[4] += t1;
+        v[0] = t1 + s0 + maj;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        state[i] += v[i];
+    }
+}
+
+int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char output[32], int is224)
+{
+    uint32_t state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    unsigned char tail[128] = { 0 };
+    size_t full = ilen / 64 * 64;
+    size_t rest = ilen - full;
+    size_t tail_len = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)ilen * 8;
+
+    if (is224)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < full; i += 64)
+    {
+        sha256_block(state, input + i);
+    }
+    memcpy(tail, input + full, rest);
+    tail[rest] = 0x80;
+    for (int i = 0; i < 8; i++)
+    {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (size_t i = 0; i < tail_len; i += 64)
+    {
+        sha256_block(state, tail + i);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        output[4 * i] = (unsigned char)(state[i] >> 24);
+        output[4 * i + 1] = (unsigned char)(state[i] >> 16);
+        output[4 * i + 2] = (unsigned char)(state[i] >> 8);
+        output[4 * i + 3] = (unsigned char)state[i];
+    }
+    return 0;
+}
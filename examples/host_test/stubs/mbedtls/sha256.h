@@ -0,0 +1,17 @@
+/*
+ * mbedtls/sha256.h for the host tests, same contract as mbedTLS, see mbedtls.c
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* is224 must be 0, the host tests only do SHA-256 */
+int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char output[32], int is224);
+
+#ifdef __cplusplus
+}
+#endif
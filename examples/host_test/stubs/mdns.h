@@ -0,0 +1,80 @@
+/*
+ * mdns.h for the host tests, the query API of the ESP-IDF mdns component and the lwIP address
+ * types it returns, laid out as ESP-IDF has them. A test defines the calls its sources make,
+ * there is no network behind them.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_IPADDR_TYPE_V4 0
+#define ESP_IPADDR_TYPE_V6 6
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    uint32_t addr[4];
+    uint8_t zone;
+} esp_ip6_addr_t;
+
+typedef struct {
+    union {
+        esp_ip6_addr_t ip6;
+        esp_ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+
+#define esp_ip4_addr1_16(ipaddr) ((uint16_t)(((const uint8_t *)(&(ipaddr)->addr))[0]))
+#define esp_ip4_addr2_16(ipaddr) ((uint16_t)(((const uint8_t *)(&(ipaddr)->addr))[1]))
+#define esp_ip4_addr3_16(ipaddr) ((uint16_t)(((const uint8_t *)(&(ipaddr)->addr))[2]))
+#define esp_ip4_addr4_16(ipaddr) ((uint16_t)(((const uint8_t *)(&(ipaddr)->addr))[3]))
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) esp_ip4_addr1_16(ipaddr), esp_ip4_addr2_16(ipaddr), \
+                       esp_ip4_addr3_16(ipaddr), esp_ip4_addr4_16(ipaddr)
+
+typedef struct mdns_ip_addr_s {
+    esp_ip_addr_t addr;
+    struct mdns_ip_addr_s *next;
+} mdns_ip_addr_t;
+
+typedef struct {
+    const char *key;
+    const char *value;
+} mdns_txt_item_t;
+
+typedef struct mdns_result_s {
+    struct mdns_result_s *next;
+    void *esp_netif;
+    uint32_t ttl;
+    int ip_protocol;
+    char *instance_name;
+    char *service_type;
+    char *proto;
+    char *hostname;
+    uint16_t port;
+    mdns_txt_item_t *txt;
+    uint8_t *txt_value_len;
+    size_t txt_count;
+    mdns_ip_addr_t *addr;
+} mdns_result_t;
+
+esp_err_t mdns_init(void);
+esp_err_t mdns_hostname_set(const char *hostname);
+esp_err_t mdns_query_ptr(const char *service_type, const char *proto, uint32_t timeout, size_t max_results,
+                         mdns_result_t **results);
+esp_err_t mdns_query_a(const char *host_name, uint32_t timeout, esp_ip4_addr_t *addr);
+void mdns_query_results_free(mdns_result_t *results);
+
+#ifdef __cplusplus
+}
+#endif
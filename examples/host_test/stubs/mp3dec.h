@@ -0,0 +1,6 @@
+/*
+ * mp3dec.h for the host tests, the decoder handle of the audio player's header
+ */
+#pragma once
+
+typedef void *HMP3Decoder;
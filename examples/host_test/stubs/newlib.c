@@ -0,0 +1,37 @@
+/*
+ * newlib extensions for the host tests, see newlib.h
+ */
+#include <string.h>
+
+#include "newlib.h"
+
+char *strnstr(const char *haystack, const char *needle, size_t len)
+{
+    size_t needle_len = strlen(needle);
+
+    if (needle_len == 0)
+    {
+        return (char *)haystack;
+    }
+    for (size_t i = 0; i + needle_len <= len && haystack[i] != '\0'; i++)
+    {
+        if (strncmp(haystack + i, needle, needle_len) == 0)
+        {
+            return (char *)haystack + i;
+        }
+    }
+    return NULL;
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size > 0)
+    {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
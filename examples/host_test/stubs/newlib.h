@@ -0,0 +1,21 @@
+/*
+ * newlib extensions the firmware uses and glibc lacks, included ahead of every source
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifndef __containerof
+#define __containerof(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char *strnstr(const char *haystack, const char *needle, size_t len);
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
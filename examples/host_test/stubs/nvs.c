@@ -0,0 +1,343 @@
+/*
+ * NVS as an in-memory store that outlives nothing but the process, see host_test.h
+ *
+ * Entries are typed like on the chip: reading a key with another type than it was written
+ * with is ESP_ERR_NVS_TYPE_MISMATCH. Partitions are not told apart.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_test.h"
+
+#define NAMESPACES_MAX 16
+
+typedef enum {
+    ENTRY_U8,
+    ENTRY_U32,
+    ENTRY_I32,
+    ENTRY_STR,
+    ENTRY_BLOB,
+} entry_type_t;
+
+typedef struct entry {
+    nvs_handle_t ns;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    entry_type_t type;
+    void *data;
+    size_t len;
+    struct entry *next;
+} entry_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static char s_namespaces[NAMESPACES_MAX][NVS_KEY_NAME_MAX_SIZE];
+static entry_t *s_entries;
+static bool s_fail_writes;
+static unsigned s_writes;
+
+static entry_t **find(nvs_handle_t ns, const char *key)
+{
+    entry_t **e;
+
+    for (e = &s_entries; *e != NULL; e = &(*e)->next)
+    {
+        if ((*e)->ns == ns && strcmp((*e)->key, key) == 0)
+        {
+            break;
+        }
+    }
+    return e;
+}
+
+static esp_err_t check(nvs_handle_t handle, const char *key)
+{
+    if (handle == 0 || handle > NAMESPACES_MAX || s_namespaces[handle - 1][0] == '\0')
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (key == NULL || key[0] == '\0')
+    {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t set(nvs_handle_t handle, const char *key, entry_type_t type, const void *value, size_t len)
+{
+    esp_err_t ret = check(handle, key);
+    entry_t **e;
+    void *data;
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (s_fail_writes)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    data = malloc(len ? len : 1);
+    memcpy(data, value, len);
+    e = find(handle, key);
+    if (*e == NULL)
+    {
+        *e = calloc(1, sizeof(entry_t));
+        (*e)->ns = handle;
+        strcpy((*e)->key, key);
+    }
+    free((*e)->data);
+    (*e)->type = type;
+    (*e)->data = data;
+    (*e)->len = len;
+    s_writes++;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+/* length is inout for strings and blobs, NULL for the integer types */
+static esp_err_t get(nvs_handle_t handle, const char *key, entry_type_t type, void *out, size_t *length)
+{
+    esp_err_t ret = check(handle, key);
+    entry_t *e;
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    pthread_mutex_lock(&s_lock);
+    e = *find(handle, key);
+    if (e == NULL)
+    {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (e->type != type)
+    {
+        ret = ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    else if (length == NULL)
+    {
+        memcpy(out, e->data, e->len);
+    }
+    else if (out == NULL)
+    {
+        *length = e->len;
+    }
+    else if (*length < e->len)
+    {
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out, e->data, e->len);
+        *length = e->len;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init_partition(const char *partition_label)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    host_nvs_erase_all();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    int free_slot = -1;
+
+    if (name == NULL || name[0] == '\0' || strlen(name) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < NAMESPACES_MAX; i++)
+    {
+        if (strcmp(s_namespaces[i], name) == 0)
+        {
+            *out_handle = i + 1;
+            pthread_mutex_unlock(&s_lock);
+            return ESP_OK;
+        }
+        if (free_slot < 0 && s_namespaces[i][0] == '\0')
+        {
+            free_slot = i;
+        }
+    }
+    if (open_mode == NVS_READONLY || free_slot < 0)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return open_mode == NVS_READONLY ? ESP_ERR_NVS_NOT_FOUND : ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    strcpy(s_namespaces[free_slot], name);
+    *out_handle = free_slot + 1;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char *part_name, const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    return nvs_open(name, open_mode, out_handle);
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return get(handle, key, ENTRY_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set(handle, key, ENTRY_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return get(handle, key, ENTRY_STR, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set(handle, key, ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    return get(handle, key, ENTRY_U8, out_value, NULL);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set(handle, key, ENTRY_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    return get(handle, key, ENTRY_U32, out_value, NULL);
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value)
+{
+    return set(handle, key, ENTRY_I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value)
+{
+    return get(handle, key, ENTRY_I32, out_value, NULL);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    esp_err_t ret = check(handle, key);
+    entry_t **e;
+    entry_t *gone;
+
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    pthread_mutex_lock(&s_lock);
+    e = find(handle, key);
+    gone = *e;
+    if (gone == NULL)
+    {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else
+    {
+        *e = gone->next;
+        free(gone->data);
+        free(gone);
+        s_writes++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    entry_t **e;
+
+    if (handle == 0 || handle > NAMESPACES_MAX)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    pthread_mutex_lock(&s_lock);
+    for (e = &s_entries; *e != NULL;)
+    {
+        entry_t *gone = *e;
+        if (gone->ns != handle)
+        {
+            e = &gone->next;
+            continue;
+        }
+        *e = gone->next;
+        free(gone->data);
+        free(gone);
+    }
+    s_writes++;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+void host_nvs_erase_all(void)
+{
+    pthread_mutex_lock(&s_lock);
+    while (s_entries != NULL)
+    {
+        entry_t *gone = s_entries;
+        s_entries = gone->next;
+        free(gone->data);
+        free(gone);
+    }
+    memset(s_namespaces, 0, sizeof(s_namespaces));
+    s_fail_writes = false;
+    s_writes = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_nvs_fail_writes(bool fail)
+{
+    pthread_mutex_lock(&s_lock);
+    s_fail_writes = fail;
+    pthread_mutex_unlock(&s_lock);
+}
+
+unsigned host_nvs_writes(void)
+{
+    pthread_mutex_lock(&s_lock);
+    unsigned writes = s_writes;
+    pthread_mutex_unlock(&s_lock);
+    return writes;
+}
@@ -0,0 +1,18 @@
+/*
+ * nvs_flash.h for the host tests, see nvs.c
+ */
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_init_partition(const char *partition_label);
+esp_err_t nvs_flash_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
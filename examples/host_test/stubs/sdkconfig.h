@@ -0,0 +1,8 @@
+/*
+ * sdkconfig of the host tests
+ *
+ * Only what the sources under test need, everything else takes the default of the source.
+ */
+#pragma once
+
+#define CONFIG_LOG_MAXIMUM_LEVEL 3
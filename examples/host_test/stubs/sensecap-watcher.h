@@ -0,0 +1,48 @@
+/*
+ * sensecap-watcher.h for the host tests, the mount points, the mic read hook and the i2s slot
+ * mode the audio player's header uses, the sscma client and lvgl port calls of the BSP
+ *
+ * The mount points are relative to the working directory of the test, which creates them. A
+ * test of a mic read listener defines bsp_set_mic_read_cb() and makes the reads itself, a test
+ * of the ai camera defines the sscma client and lvgl port calls.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DRV_BASE_PATH_SD    "host_sdcard"
+#define DRV_BASE_PATH_FLASH "host_spiffs"
+
+/* from the i2s driver, which the BSP header brings along */
+typedef enum {
+    I2S_SLOT_MODE_MONO = 1,
+    I2S_SLOT_MODE_STEREO = 2,
+} i2s_slot_mode_t;
+
+typedef struct
+{
+    size_t len;          /* bytes read */
+    int64_t done_us;     /* esp_timer time the read returned */
+    uint32_t rate;       /* sample rate of the record device */
+    uint8_t frame_bytes; /* bytes per sample frame */
+    uint32_t session;
+} bsp_mic_read_t;
+
+void bsp_set_mic_read_cb(void (*cb)(const bsp_mic_read_t *read));
+
+struct sscma_client_t;
+struct sscma_client_t *bsp_sscma_client_init(void);
+
+/* from esp_lvgl_port */
+bool lvgl_port_lock(uint32_t timeout_ms);
+void lvgl_port_unlock(void);
+
+#ifdef __cplusplus
+}
+#endif
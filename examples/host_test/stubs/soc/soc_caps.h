@@ -0,0 +1,4 @@
+/*
+ * soc/soc_caps.h for the host tests
+ */
+#pragma once
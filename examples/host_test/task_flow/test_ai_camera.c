@@ -0,0 +1,591 @@
+/*
+ * ai camera module: the zones of its params against the boxes of a frame. Boxes with their centre
+ * outside every zone are dropped before anything else sees them, the rest are counted per zone.
+ * Centres on either side of the rectangle and polygon edges and on them, zones that overlap,
+ * counts past 255, and a frame from the WE2 through the module's event callback, to the preview and to
+ * the listener of the preview event on the app loop's task. A start leaves the sscma callbacks to
+ * whoever holds them, the model scheduler in the middle of a swap.
+ *
+ * The module is built by hand around a fake sscma client, no task talks to the himax.
+ */
+#include <pthread.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "tf_module_ai_camera.c"
+
+// [100, 140) x [100, 140) and [140, 240) x [100, 140), and a triangle with a slanted edge
+#define ZONES_JSON  "[{\"name\": \"door\", \"zone\": [100, 100, 40, 40]}," \
+                    " {\"name\": \"hall\", \"zone\": [140, 100, 100, 40]}," \
+                    " {\"name\": \"bed\", \"zone\": [[200, 200], [300, 200], [200, 300]]}]"
+
+#define ZONE_DOOR   0
+#define ZONE_HALL   1
+#define ZONE_BED    2
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    bool kept;
+    uint8_t zones;      // bit per zone
+} centre_t;
+
+static struct sscma_client_t s_client;
+static tf_module_ai_camera_t *sp_ins;
+
+// what the WE2 reports, what the preview got
+static sscma_client_box_t *sp_we2_boxes;
+static int s_we2_box_num;
+static sscma_client_box_t s_preview_boxes[64];
+static int s_preview_box_num;
+static uint8_t s_preview_zone_num;
+static uint8_t s_preview_zone_cnt[CONFIG_MODEL_ZONES_MAX_NUM];
+static int s_previews;
+
+// what the listener of the preview event got, and on which task
+static sscma_client_box_t s_listened_boxes[64];
+static volatile int s_listened_box_num;
+static volatile int s_listened;
+static char s_listener_task[16];
+
+/*************************************************************************
+ * What the module links against
+ ************************************************************************/
+ESP_EVENT_DEFINE_BASE(VIEW_EVENT_BASE);
+esp_event_loop_handle_t app_event_loop_handle;
+
+struct sscma_client_t *bsp_sscma_client_init(void)
+{
+    return &s_client;
+}
+
+bool lvgl_port_lock(uint32_t timeout_ms)
+{
+    return true;
+}
+
+void lvgl_port_unlock(void)
+{
+}
+
+esp_err_t sscma_client_init(sscma_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_reset(sscma_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_break(sscma_client_handle_t client)
+{
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_register_callback(sscma_client_handle_t client, const sscma_client_callback_t *callback, void *user_ctx)
+{
+    client->on_connect = callback->on_connect;
+    client->on_disconnect = callback->on_disconnect;
+    client->on_response = callback->on_response;
+    client->on_event = callback->on_event;
+    client->on_log = callback->on_log;
+    client->user_ctx = user_ctx;
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_get_callback(sscma_client_handle_t client, sscma_client_callback_t *callback, void **user_ctx)
+{
+    callback->on_connect = client->on_connect;
+    callback->on_disconnect = client->on_disconnect;
+    callback->on_response = client->on_response;
+    callback->on_event = client->on_event;
+    callback->on_log = client->on_log;
+    if (user_ctx)
+    {
+        *user_ctx = client->user_ctx;
+    }
+    return ESP_OK;
+}
+
+esp_err_t sscma_client_get_info(sscma_client_handle_t client, sscma_client_info_t **info, bool cached)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_get_model(sscma_client_handle_t client, sscma_client_model_t **model, bool cached)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_request(sscma_client_handle_t client, const char *cmd, sscma_client_reply_t *reply, bool wait, TickType_t timeout)
+{
+    return ESP_FAIL;
+}
+
+void sscma_client_reply_clear(sscma_client_reply_t *reply)
+{
+}
+
+esp_err_t sscma_client_sample(sscma_client_handle_t client, int times)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_confidence_threshold(sscma_client_handle_t client, int threshold)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_iou_threshold(sscma_client_handle_t client, int threshold)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_model(sscma_client_handle_t client, int model)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_model_info(sscma_client_handle_t client, const char *model_info)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_client_set_sensor(sscma_client_handle_t client, int id, int opt_id, bool enable)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_utils_fetch_boxes_from_reply(const sscma_client_reply_t *reply, sscma_client_box_t **boxes, int *num_boxes)
+{
+    *boxes = tf_malloc(s_we2_box_num * sizeof(sscma_client_box_t) + 1);
+    memcpy(*boxes, sp_we2_boxes, s_we2_box_num * sizeof(sscma_client_box_t));
+    *num_boxes = s_we2_box_num;
+    return ESP_OK;
+}
+
+esp_err_t sscma_utils_fetch_classes_from_reply(const sscma_client_reply_t *reply, sscma_client_class_t **classes, int *num_classes)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_utils_fetch_image_from_reply(const sscma_client_reply_t *reply, char **image, int *image_size)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t sscma_utils_fetch_points_from_reply(const sscma_client_reply_t *reply, sscma_client_point_t **points, int *num_points)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t app_ota_ai_model_download(char *url, int size_bytes)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t app_ota_ai_model_download_abort()
+{
+    return ESP_OK;
+}
+
+esp_err_t app_sensecraft_mqtt_preview_upload_with_reduce_freq(char *p_img, size_t img_len)
+{
+    return ESP_OK;
+}
+
+int view_image_preview_flush(struct tf_module_ai_camera_preview_info *p_info)
+{
+    s_previews++;
+    s_preview_box_num = p_info->inference.cnt;
+    TEST_ASSERT_LESS_OR_EQUAL_INT(64, s_preview_box_num);
+    memcpy(s_preview_boxes, p_info->inference.p_data, s_preview_box_num * sizeof(sscma_client_box_t));
+    s_preview_zone_num = p_info->inference.zone_num;
+    memcpy(s_preview_zone_cnt, p_info->inference.zone_cnt, sizeof(s_preview_zone_cnt));
+    return 0;
+}
+
+int view_image_check(uint8_t *p_buf, size_t len, size_t ram_buf_len)
+{
+    return 0;
+}
+
+esp_err_t tf_event_post(int32_t event_id, const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t tf_event_handler_register(int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_event_handler_unregister(int32_t event_id, esp_event_handler_t event_handler)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_module_register(const char *p_name, const char *p_desc, const char *p_version,
+                             tf_module_mgmt_t *mgmt_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_module_io_set(const char *p_name, const tf_module_io_t *p_io)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_module_status_set(const char *p_module_name, int status)
+{
+    return ESP_OK;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+/* the module as tf_module_ai_camera_init() leaves it, without its task */
+static tf_module_ai_camera_t *module_new(const char *p_params)
+{
+    tf_module_ai_camera_t *p_ins = calloc(1, sizeof(tf_module_ai_camera_t));
+    cJSON *p_json = cJSON_Parse(p_params);
+
+    TEST_ASSERT_NOT_NULL(p_json);
+    p_ins->sem_handle = xSemaphoreCreateMutex();
+    p_ins->event_group = xEventGroupCreate();
+    p_ins->sscma_client_handle = bsp_sscma_client_init();
+    TEST_ASSERT_EQUAL(0, __cfg(p_ins, p_json));
+    p_ins->params.algorithm.category = TF_MODULE_AI_CAMERA_ALGORITHM_CAT_DET;
+    cJSON_Delete(p_json);
+    return p_ins;
+}
+
+static void module_delete(tf_module_ai_camera_t *p_ins)
+{
+    tf_data_image_free(&p_ins->preview_info_cache.img);
+    tf_data_inference_free(&p_ins->preview_info_cache.inference);
+    tf_expr_free(p_ins->params.p_expr);
+    vSemaphoreDelete(p_ins->sem_handle);
+    vEventGroupDelete(p_ins->event_group);
+    free(p_ins);
+}
+
+static sscma_client_box_t box_at(int x, int y, int i)
+{
+    sscma_client_box_t b = { .x = x, .y = y, .w = 20 + i, .h = 30, .score = 80, .target = i % 3 };
+    return b;
+}
+
+/* the boxes of the centres, filtered as a frame is */
+static void filter(struct tf_data_inference_info *p_inference, const centre_t *p_centres, int num)
+{
+    sscma_client_box_t *p_boxes = tf_malloc(num * sizeof(sscma_client_box_t) + 1);
+
+    memset(p_inference, 0, sizeof(*p_inference));
+    for (int i = 0; i < num; i++)
+    {
+        p_boxes[i] = box_at(p_centres[i].x, p_centres[i].y, i);
+    }
+    p_inference->is_valid = true;
+    p_inference->type = INFERENCE_TYPE_BOX;
+    p_inference->p_data = p_boxes;
+    p_inference->cnt = num;
+    __zones_filter(&sp_ins->params, p_inference);
+}
+
+/* the kept boxes in their order, the count of each zone */
+static void assert_filtered(const struct tf_data_inference_info *p_inference, const centre_t *p_centres, int num)
+{
+    const sscma_client_box_t *p_boxes = p_inference->p_data;
+    int cnt[CONFIG_MODEL_ZONES_MAX_NUM] = { 0 };
+    int kept = 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        char msg[48];
+        snprintf(msg, sizeof(msg), "centre %d, %d", p_centres[i].x, p_centres[i].y);
+        if (!p_centres[i].kept)
+        {
+            TEST_ASSERT_EQUAL_MESSAGE(0, p_centres[i].zones, msg);
+            continue;
+        }
+        TEST_ASSERT_LESS_THAN_MESSAGE(p_inference->cnt, kept, msg);
+        sscma_client_box_t want = box_at(p_centres[i].x, p_centres[i].y, i);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&want, &p_boxes[kept], sizeof(want), msg);
+        kept++;
+        for (int z = 0; z < CONFIG_MODEL_ZONES_MAX_NUM; z++)
+        {
+            cnt[z] += (p_centres[i].zones >> z) & 1;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(kept, p_inference->cnt);
+    TEST_ASSERT_EQUAL_UINT8(sp_ins->params.zone_num, p_inference->zone_num);
+    for (int z = 0; z < CONFIG_MODEL_ZONES_MAX_NUM; z++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(cnt[z], p_inference->zone_cnt[z]);
+    }
+}
+
+// the only listener, it owns what the event carries
+static void on_preview(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    struct tf_module_ai_camera_preview_info *p_info = data;
+
+    s_listened_box_num = p_info->inference.cnt;
+    TEST_ASSERT_LESS_OR_EQUAL_INT(64, s_listened_box_num);
+    memcpy(s_listened_boxes, p_info->inference.p_data, s_listened_box_num * sizeof(sscma_client_box_t));
+    snprintf(s_listener_task, sizeof(s_listener_task), "%s", pcTaskGetName(NULL));
+    tf_data_image_free(&p_info->img);
+    tf_data_inference_free(&p_info->inference);
+    s_listened++;
+}
+
+void setUp(void)
+{
+    memset(&s_client, 0, sizeof(s_client));
+    sp_ins = module_new("{\"modes\": 0, \"zones\": " ZONES_JSON "}");
+    s_previews = 0;
+}
+
+void tearDown(void)
+{
+    module_delete(sp_ins);
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_zones_parsed(void)
+{
+    TEST_ASSERT_EQUAL_INT(3, sp_ins->params.zone_num);
+    TEST_ASSERT_EQUAL_STRING("door", sp_ins->params.zones[ZONE_DOOR].name);
+    TEST_ASSERT_EQUAL_STRING("hall", sp_ins->params.zones[ZONE_HALL].name);
+    TEST_ASSERT_EQUAL_STRING("bed", sp_ins->params.zones[ZONE_BED].name);
+    module_delete(sp_ins);
+
+    // a bad zone is left out, zones past CONFIG_MODEL_ZONES_MAX_NUM too
+    sp_ins = module_new("{\"zones\": [{\"name\": \"a\", \"zone\": [0, 0, 0, 10]}, {\"name\": \"b\", \"zone\": [0, 0, 5, 5]},"
+                        " {\"zone\": [[0, 0], [1, 1]]}, {\"name\": \"c\", \"zone\": [1, 1, 5, 5]},"
+                        " {\"name\": \"d\", \"zone\": [2, 2, 5, 5]}, {\"name\": \"e\", \"zone\": [3, 3, 5, 5]},"
+                        " {\"name\": \"f\", \"zone\": [4, 4, 5, 5]}]}");
+    TEST_ASSERT_EQUAL_INT(CONFIG_MODEL_ZONES_MAX_NUM, sp_ins->params.zone_num);
+    TEST_ASSERT_EQUAL_STRING("b", sp_ins->params.zones[0].name);
+    TEST_ASSERT_EQUAL_STRING("e", sp_ins->params.zones[3].name);
+}
+
+static void test_rectangle_edges(void)
+{
+    // [min, max): the left and top edges are in, the right and bottom ones out
+    const centre_t centres[] = {
+        { 100, 100, true, 1 << ZONE_DOOR },
+        { 99, 120, false, 0 },
+        { 120, 99, false, 0 },
+        { 139, 139, true, 1 << ZONE_DOOR },
+        { 120, 140, false, 0 },
+        { 100, 139, true, 1 << ZONE_DOOR },
+        { 99, 139, false, 0 },
+        // door ends where hall begins, the two share no centre
+        { 139, 120, true, 1 << ZONE_DOOR },
+        { 140, 120, true, 1 << ZONE_HALL },
+        { 239, 100, true, 1 << ZONE_HALL },
+        { 240, 100, false, 0 },
+        { 0, 0, false, 0 },
+        { -5, 120, false, 0 },
+    };
+    struct tf_data_inference_info inference;
+
+    filter(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    assert_filtered(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    tf_data_inference_free(&inference);
+}
+
+static void test_polygon_edges(void)
+{
+    // the triangle (200, 200) (300, 200) (200, 300): its slanted edge runs x + y = 500
+    const centre_t centres[] = {
+        { 200, 200, true, 1 << ZONE_BED },
+        { 199, 250, false, 0 },
+        { 200, 250, true, 1 << ZONE_BED },
+        { 249, 250, true, 1 << ZONE_BED },
+        { 250, 250, false, 0 },
+        { 251, 250, false, 0 },
+        { 299, 200, true, 1 << ZONE_BED },
+        { 300, 200, false, 0 },
+        { 250, 199, false, 0 },
+        { 200, 299, true, 1 << ZONE_BED },
+        { 200, 300, false, 0 },
+        { 290, 290, false, 0 },
+    };
+    struct tf_data_inference_info inference;
+
+    filter(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    assert_filtered(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    tf_data_inference_free(&inference);
+}
+
+static void test_overlapping_zones(void)
+{
+    // a box in two zones is kept once and counted in both
+    module_delete(sp_ins);
+    sp_ins = module_new("{\"zones\": [{\"name\": \"room\", \"zone\": [0, 0, 200, 200]}, {\"name\": \"cot\", \"zone\": [50, 50, 50, 50]}]}");
+    const centre_t centres[] = {
+        { 60, 60, true, 3 },
+        { 10, 10, true, 1 },
+        { 99, 99, true, 3 },
+        { 100, 99, true, 1 },
+        { 250, 60, false, 0 },
+    };
+    struct tf_data_inference_info inference;
+
+    filter(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    assert_filtered(&inference, centres, sizeof(centres) / sizeof(centres[0]));
+    tf_data_inference_free(&inference);
+}
+
+static void test_counts_stop_at_255(void)
+{
+    centre_t centres[300];
+    struct tf_data_inference_info inference;
+
+    for (int i = 0; i < 300; i++)
+    {
+        centres[i] = (centre_t){ .x = 100 + i % 40, .y = 100 + i / 40, .kept = true, .zones = 1 << ZONE_DOOR };
+    }
+    filter(&inference, centres, 300);
+    TEST_ASSERT_EQUAL_INT(300, inference.cnt);
+    TEST_ASSERT_EQUAL_UINT8(255, inference.zone_cnt[ZONE_DOOR]);
+    TEST_ASSERT_EQUAL_UINT8(0, inference.zone_cnt[ZONE_HALL]);
+    tf_data_inference_free(&inference);
+}
+
+static void test_nothing_filtered(void)
+{
+    struct tf_data_inference_info inference;
+    const centre_t centres[] = { { 0, 0, true, 0 }, { 120, 120, true, 0 } };
+
+    // a frame in no zone at all
+    const centre_t outside[] = { { 0, 0, false, 0 }, { 400, 400, false, 0 } };
+    filter(&inference, outside, 2);
+    assert_filtered(&inference, outside, 2);
+    tf_data_inference_free(&inference);
+
+    // without zones every box stays and no count is given
+    module_delete(sp_ins);
+    sp_ins = module_new("{\"modes\": 0}");
+    filter(&inference, centres, 2);
+    TEST_ASSERT_EQUAL_INT(2, inference.cnt);
+    TEST_ASSERT_EQUAL_UINT8(0, inference.zone_num);
+    tf_data_inference_free(&inference);
+
+    // classes have no centre
+    module_delete(sp_ins);
+    sp_ins = module_new("{\"zones\": " ZONES_JSON "}");
+    memset(&inference, 0, sizeof(inference));
+    inference.type = INFERENCE_TYPE_CLASS;
+    inference.p_data = tf_malloc(2 * sizeof(sscma_client_class_t));
+    inference.cnt = 2;
+    __zones_filter(&sp_ins->params, &inference);
+    TEST_ASSERT_EQUAL_INT(2, inference.cnt);
+    TEST_ASSERT_EQUAL_UINT8(3, inference.zone_num);
+    TEST_ASSERT_EQUAL_UINT8(0, inference.zone_cnt[ZONE_DOOR]);
+    tf_data_inference_free(&inference);
+}
+
+static void test_frame_from_the_we2(void)
+{
+    // what the preview gets of an INVOKE event, boxes out of every zone already gone
+    sscma_client_box_t boxes[] = { box_at(120, 120, 0), box_at(10, 10, 1), box_at(210, 210, 2), box_at(150, 130, 3),
+                                   box_at(250, 250, 4) };
+    sscma_client_reply_t reply = { 0 };
+
+    sp_we2_boxes = boxes;
+    s_we2_box_num = 5;
+    reply.payload = cJSON_Parse("{\"type\": 1, \"name\": \"INVOKE\", \"data\": {\"resolution\": [416, 416]}}");
+    sscma_on_event(&s_client, &reply, sp_ins);
+    cJSON_Delete(reply.payload);
+
+    TEST_ASSERT_EQUAL_INT(1, s_previews);
+    TEST_ASSERT_EQUAL_INT(3, s_preview_box_num);
+    TEST_ASSERT_EQUAL_MEMORY(&boxes[0], &s_preview_boxes[0], sizeof(sscma_client_box_t));
+    TEST_ASSERT_EQUAL_MEMORY(&boxes[2], &s_preview_boxes[1], sizeof(sscma_client_box_t));
+    TEST_ASSERT_EQUAL_MEMORY(&boxes[3], &s_preview_boxes[2], sizeof(sscma_client_box_t));
+    TEST_ASSERT_EQUAL_UINT8(3, s_preview_zone_num);
+    TEST_ASSERT_EQUAL_UINT8(1, s_preview_zone_cnt[ZONE_DOOR]);
+    TEST_ASSERT_EQUAL_UINT8(1, s_preview_zone_cnt[ZONE_HALL]);
+    TEST_ASSERT_EQUAL_UINT8(1, s_preview_zone_cnt[ZONE_BED]);
+
+    // the same boxes to the listener, which runs on the app loop and not on the sscma callback
+    for (int i = 0; i < 1000 && s_listened == 0; i++)
+    {
+        usleep(1000);
+    }
+    TEST_ASSERT_EQUAL_INT(1, s_listened);
+    TEST_ASSERT_EQUAL_STRING("app_loop", s_listener_task);
+    TEST_ASSERT_EQUAL_INT(3, s_listened_box_num);
+    TEST_ASSERT_EQUAL_MEMORY(s_preview_boxes, s_listened_boxes, 3 * sizeof(sscma_client_box_t));
+}
+
+static void scheduler_on_event(sscma_client_handle_t client, const sscma_client_reply_t *reply, void *user_ctx)
+{
+}
+
+static void scheduler_on_connect(sscma_client_handle_t client, const sscma_client_reply_t *reply, void *user_ctx)
+{
+}
+
+// the module task's side of a start: EVENT_START taken, EVENT_START_DONE given
+static void *start_done(void *p_arg)
+{
+    xEventGroupWaitBits(sp_ins->event_group, EVENT_START, pdTRUE, pdTRUE, portMAX_DELAY);
+    sp_ins->start_err_code = 0;
+    xEventGroupSetBits(sp_ins->event_group, EVENT_START_DONE);
+    return NULL;
+}
+
+static void test_start_leaves_the_callbacks(void)
+{
+    // the model scheduler took the callbacks over: a flow started in the meantime doesn't take them back
+    const sscma_client_callback_t scheduler = { .on_event = scheduler_on_event, .on_connect = scheduler_on_connect };
+    sscma_client_callback_t current;
+    pthread_t thread;
+    void *p_ctx = sp_ins;
+
+    sscma_client_register_callback(&s_client, &scheduler, NULL);
+    pthread_create(&thread, NULL, start_done, NULL);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, __start(sp_ins));
+    pthread_join(thread, NULL);
+
+    sscma_client_get_callback(&s_client, &current, &p_ctx);
+    TEST_ASSERT_EQUAL_PTR(scheduler_on_event, current.on_event);
+    TEST_ASSERT_EQUAL_PTR(scheduler_on_connect, current.on_connect);
+    TEST_ASSERT_NULL(p_ctx);
+}
+
+int main(void)
+{
+    const esp_event_loop_args_t loop_args = {
+        .queue_size = 8,
+        .task_name = "app_loop",
+        .task_stack_size = 4096,
+        .task_priority = 5,
+        .task_core_id = tskNO_AFFINITY,
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&loop_args, &app_event_loop_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_handler_register_with(app_event_loop_handle, VIEW_EVENT_BASE,
+                                                              VIEW_EVENT_AI_CAMERA_PREVIEW, on_preview, NULL));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_zones_parsed);
+    RUN_TEST(test_rectangle_edges);
+    RUN_TEST(test_polygon_edges);
+    RUN_TEST(test_overlapping_zones);
+    RUN_TEST(test_counts_stop_at_255);
+    RUN_TEST(test_nothing_filtered);
+    RUN_TEST(test_frame_from_the_we2);
+    RUN_TEST(test_start_leaves_the_callbacks);
+    return UNITY_END();
+}
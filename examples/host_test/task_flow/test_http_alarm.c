@@ -0,0 +1,700 @@
+/*
+ * http alarm module and its outbox against stub http servers, in a flow run by the task flow
+ * engine: faults of the uplink, retries, dedup, a reboot with alarms left, and alarms left
+ * for a server or account the module no longer uses.
+ *
+ * The servers are threads on loopback sockets, the socket under the esp_http_client stub
+ * takes the faults the test queues. Backoff runs on the esp_timer clock, which the test
+ * moves on when it wants the next retry.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "tf_module_http_alarm.c"
+
+#define SERVERS         2
+#define REQUESTS_MAX    32
+#define REPLIES_MAX     8
+#define BODY_MAX        4096
+#define WAIT_MS         5000
+
+typedef struct {
+    char path[128];
+    char auth[160];
+    char request_id[40];
+    char img[64];
+    int status;               // what the server answered
+    int files;                // in the outbox directory while the request was on the wire
+} request_t;
+
+typedef struct {
+    int fd;
+    int port;
+    pthread_t thread;
+    bool down;                // answer 503 to everything
+    const char *replies[REPLIES_MAX];   // scripted answers, then 200
+    int replies_num;
+    request_t requests[REQUESTS_MAX];
+    int requests_num;
+    int partial;              // connections that ended before the body did
+} server_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static server_t s_servers[SERVERS];
+static local_service_cfg_type1_t s_local_cfg;
+static char s_local_url[64];
+static char s_local_token[64];
+static QueueHandle_t s_status;
+static tf_module_http_alarm_t *s_instances[4];
+static int s_instances_num;
+
+#define REPLY(status, body) "HTTP/1.1 " status "\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n" body
+
+/*************************************************************************
+ * What the module links against
+ ************************************************************************/
+static struct app_sensecraft s_sensecraft = { .deviceinfo = { .eui = "2CF7F1C0000000AA" } };
+struct app_sensecraft *gp_sensecraft = &s_sensecraft;
+
+char *__token_gen(void)
+{
+    return "MkNGN0YxQzAwMDAwMDBBQTprZXk=";
+}
+
+const char *factory_info_eui_get(void)
+{
+    return s_sensecraft.deviceinfo.eui;
+}
+
+uint8_t app_sensor_read_measurement(app_sensor_data_t *data, uint16_t length)
+{
+    return 0;
+}
+
+time_t util_get_timestamp_ms(void)
+{
+    return 1700000000000;
+}
+
+/* the notification proxy the user set up, the module copies and frees it */
+esp_err_t get_local_service_cfg_type1(int caller, int cfg_index, local_service_cfg_type1_t *pcfg)
+{
+    pthread_mutex_lock(&s_lock);
+    pcfg->enable = s_local_cfg.enable;
+    pcfg->url = s_local_cfg.url ? strdup(s_local_cfg.url) : NULL;
+    pcfg->token = s_local_cfg.token ? strdup(s_local_cfg.token) : NULL;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static void local_cfg_set(int server, const char *p_token)
+{
+    pthread_mutex_lock(&s_lock);
+    snprintf(s_local_url, sizeof(s_local_url), "http://127.0.0.1:%d", s_servers[server].port);
+    snprintf(s_local_token, sizeof(s_local_token), "%s", p_token);
+    s_local_cfg.enable = true;
+    s_local_cfg.url = s_local_url;
+    s_local_cfg.token = s_local_token;
+    pthread_mutex_unlock(&s_lock);
+}
+
+/*************************************************************************
+ * Stub servers
+ ************************************************************************/
+static int outbox_files(void);
+
+static void json_string_get(const char *p_body, const char *p_key, char *p_out, size_t size)
+{
+    cJSON *json = cJSON_Parse(p_body);
+    cJSON *item = cJSON_GetObjectItem(json, p_key);
+    cJSON *events = cJSON_GetObjectItem(json, "events");
+
+    if (item == NULL && events != NULL)
+    {
+        item = cJSON_GetObjectItem(events, p_key);
+    }
+    snprintf(p_out, size, "%s", cJSON_IsString(item) ? item->valuestring : "");
+    cJSON_Delete(json);
+}
+
+static void server_handle(server_t *p_server, int fd)
+{
+    char buf[BODY_MAX + 2048];
+    size_t len = 0;
+    char *p_end = NULL;
+    char *p_line = NULL;
+    long content_length = 0;
+    request_t request = { 0 };
+    char reply[512];
+    const char *p_reply = NULL;
+    int reply_len;
+
+    while ((p_end = memmem(buf, len, "\r\n\r\n", 4)) == NULL || len < (size_t)(p_end + 4 - buf) + content_length)
+    {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0)
+        {
+            pthread_mutex_lock(&s_lock);
+            p_server->partial++;
+            pthread_mutex_unlock(&s_lock);
+            return;
+        }
+        len += n;
+        buf[len] = '\0';
+        p_line = strcasestr(buf, "\r\nContent-Length:");
+        if (p_line != NULL)
+        {
+            content_length = strtol(p_line + 17, NULL, 10);
+        }
+    }
+    *p_end = '\0';
+    sscanf(buf, "POST %127s", request.path);
+    p_line = strcasestr(buf, "\r\nAuthorization: ");
+    if (p_line != NULL)
+    {
+        sscanf(p_line + 17, "%159[^\r]", request.auth);
+    }
+    json_string_get(p_end + 4, "requestId", request.request_id, sizeof(request.request_id));
+    json_string_get(p_end + 4, "img", request.img, sizeof(request.img));
+    request.files = outbox_files();
+
+    pthread_mutex_lock(&s_lock);
+    if (p_server->down)
+    {
+        p_reply = REPLY("503 Service Unavailable", "{\"code\": 503}");
+    }
+    else if (p_server->replies_num > 0)
+    {
+        p_reply = p_server->replies[0];
+        memmove(&p_server->replies[0], &p_server->replies[1], (p_server->replies_num - 1) * sizeof(p_server->replies[0]));
+        p_server->replies_num--;
+    }
+    else
+    {
+        p_reply = REPLY("200 OK", "{\"code\": 200, \"data\": {}}");
+    }
+    sscanf(p_reply, "HTTP/1.1 %d", &request.status);
+    if (p_server->requests_num < REQUESTS_MAX)
+    {
+        p_server->requests[p_server->requests_num++] = request;
+    }
+    pthread_mutex_unlock(&s_lock);
+
+    // the body of a reply is what follows the blank line
+    reply_len = snprintf(reply, sizeof(reply), p_reply, (int)strlen(strstr(p_reply, "\r\n\r\n") + 4));
+    send(fd, reply, reply_len, MSG_NOSIGNAL);
+}
+
+static void *server_task(void *p_arg)
+{
+    server_t *p_server = p_arg;
+    int fd;
+
+    while ((fd = accept(p_server->fd, NULL, NULL)) >= 0)
+    {
+        server_handle(p_server, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void server_start(server_t *p_server)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+
+    p_server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, p_server->fd);
+    TEST_ASSERT_EQUAL(0, bind(p_server->fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(p_server->fd, 8));
+    TEST_ASSERT_EQUAL(0, getsockname(p_server->fd, (struct sockaddr *)&addr, &addr_len));
+    p_server->port = ntohs(addr.sin_port);
+    TEST_ASSERT_EQUAL(0, pthread_create(&p_server->thread, NULL, server_task, p_server));
+}
+
+static void server_reset(server_t *p_server)
+{
+    pthread_mutex_lock(&s_lock);
+    p_server->down = false;
+    p_server->replies_num = 0;
+    p_server->requests_num = 0;
+    p_server->partial = 0;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void server_down(int server, bool down)
+{
+    pthread_mutex_lock(&s_lock);
+    s_servers[server].down = down;
+    pthread_mutex_unlock(&s_lock);
+}
+
+static void server_reply_push(int server, const char *p_reply)
+{
+    pthread_mutex_lock(&s_lock);
+    s_servers[server].replies[s_servers[server].replies_num++] = p_reply;
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* requests the server took in full, and of those the ones it answered 200 */
+static int server_requests(int server)
+{
+    pthread_mutex_lock(&s_lock);
+    int num = s_servers[server].requests_num;
+    pthread_mutex_unlock(&s_lock);
+    return num;
+}
+
+static int server_delivered(int server)
+{
+    int num = 0;
+
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < s_servers[server].requests_num; i++)
+    {
+        num += s_servers[server].requests[i].status == 200;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return num;
+}
+
+static request_t server_request(int server, int i)
+{
+    pthread_mutex_lock(&s_lock);
+    request_t request = s_servers[server].requests[i];
+    pthread_mutex_unlock(&s_lock);
+    return request;
+}
+
+/*************************************************************************
+ * Flow and module
+ ************************************************************************/
+static tf_module_t *instance(void)
+{
+    tf_module_t *p_handle = __module_instance();
+
+    if (p_handle != NULL)
+    {
+        pthread_mutex_lock(&s_lock);
+        s_instances[s_instances_num++] = p_handle->p_module;
+        pthread_mutex_unlock(&s_lock);
+    }
+    return p_handle;
+}
+
+static void destroy(tf_module_t *p_handle)
+{
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < s_instances_num; i++)
+    {
+        if (s_instances[i] == p_handle->p_module)
+        {
+            s_instances[i] = s_instances[--s_instances_num];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    __module_destroy(p_handle);
+}
+
+static struct tf_module_mgmt s_mgmt = {
+    .tf_module_instance = instance,
+    .tf_module_destroy = destroy,
+};
+
+static void status_cb(void *p_arg, intmax_t tid, int status, const char *p_err_module)
+{
+    if (status != TF_STATUS_STARTING)
+    {
+        xQueueSend(s_status, &status, portMAX_DELAY);
+    }
+}
+
+static void status_expect(int expected)
+{
+    int status;
+
+    TEST_ASSERT_EQUAL_MESSAGE(pdTRUE, xQueueReceive(s_status, &status, pdMS_TO_TICKS(WAIT_MS)), "no status from the engine");
+    TEST_ASSERT_EQUAL_INT(expected, status);
+}
+
+/* wait until cond holds, the esp_timer clock jumps past any backoff if retry is set */
+#define WAIT_UNTIL(cond, retry)                                                     \
+    do {                                                                            \
+        int waited_ = 0;                                                            \
+        while (!(cond) && waited_ < WAIT_MS) {                                      \
+            if (retry) {                                                            \
+                host_time_advance((int64_t)TF_MODULE_HTTP_ALARM_RETRY_MAX_MS * 1000); \
+            }                                                                       \
+            vTaskDelay(pdMS_TO_TICKS(10));                                          \
+            waited_ += 10;                                                          \
+        }                                                                           \
+        TEST_ASSERT_TRUE_MESSAGE(cond, #cond);                                      \
+    } while (0)
+
+/* long enough for the module's task to go round its loop several times */
+static void settle(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(200));
+}
+
+#define ALARM(id) "{\"id\": " #id ", \"type\": \"http alarm\", \"index\": " #id ", \"params\": " \
+                  "{\"silence_duration\": 0, \"time_en\": false, \"sensor_en\": false, \"text\": \"fire\"}, \"wires\": []}"
+
+static void flow_start(const char *p_modules)
+{
+    char flow[1024];
+    int len = snprintf(flow, sizeof(flow), "{\"tlid\": 1, \"ctd\": 1, \"tn\": \"alarm\", \"type\": 0, \"task_flow\": [%s]}", p_modules);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_flow_set(flow, len));
+    status_expect(TF_STATUS_RUNNING);
+}
+
+/* a reboot as far as the module sees it, its instance goes and the files stay */
+static void flow_stop(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_stop());
+    status_expect(TF_STATUS_STOP);
+    WAIT_UNTIL(s_instances_num == 0, false);
+}
+
+static tf_module_http_alarm_t *module_get(int id)
+{
+    tf_module_http_alarm_t *p_module = NULL;
+
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < s_instances_num; i++)
+    {
+        if (s_instances[i]->input_evt_id == id)
+        {
+            p_module = s_instances[i];
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    TEST_ASSERT_NOT_NULL(p_module);
+    return p_module;
+}
+
+/* what the ai camera posts, img is the base64 of the small image */
+static void alarm_post(int id, const char *p_img)
+{
+    tf_data_dualimage_with_audio_text_t data = { .type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT };
+
+    data.img_small.len = strlen(p_img);
+    data.img_small.p_buf = tf_malloc(data.img_small.len + 1);
+    memcpy(data.img_small.p_buf, p_img, data.img_small.len + 1);
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(id, &data, sizeof(data), portMAX_DELAY));
+}
+
+static int outbox_num(int id)
+{
+    return tf_outbox_num_get(module_get(id)->p_outbox);
+}
+
+static int outbox_files(void)
+{
+    DIR *p_dir = opendir(DRV_BASE_PATH_FLASH);
+    struct dirent *p_entry;
+    int num = 0;
+
+    TEST_ASSERT_NOT_NULL(p_dir);
+    while ((p_entry = readdir(p_dir)) != NULL)
+    {
+        num += p_entry->d_name[0] != '.';
+    }
+    closedir(p_dir);
+    return num;
+}
+
+void setUp(void)
+{
+    DIR *p_dir = opendir(DRV_BASE_PATH_FLASH);
+    struct dirent *p_entry;
+    char path[300];
+
+    while ((p_entry = readdir(p_dir)) != NULL)
+    {
+        if (p_entry->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", DRV_BASE_PATH_FLASH, p_entry->d_name);
+            remove(path);
+        }
+    }
+    closedir(p_dir);
+
+    for (int i = 0; i < SERVERS; i++)
+    {
+        server_reset(&s_servers[i]);
+    }
+    local_cfg_set(0, "Bearer a");
+    host_socket_fault_clear();
+    host_time_reset();
+    xQueueReset(s_status);
+}
+
+void tearDown(void)
+{
+    int status = TF_STATUS_IDLE;
+
+    tf_engine_status_get(&status);
+    if (status == TF_STATUS_RUNNING)
+    {
+        flow_stop();
+    }
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_alarm_is_posted(void)
+{
+    request_t request;
+
+    flow_start(ALARM(1));
+    alarm_post(1, "aW1n");
+    WAIT_UNTIL(server_delivered(0) == 1, false);
+    WAIT_UNTIL(outbox_num(1) == 0, false);
+
+    request = server_request(0, 0);
+    TEST_ASSERT_EQUAL_STRING(CONFIG_TF_MODULE_HTTP_ALARM_SERV_REQ_PATH, request.path);
+    TEST_ASSERT_EQUAL_STRING("Bearer a", request.auth);
+    TEST_ASSERT_EQUAL_STRING("aW1n", request.img);
+    TEST_ASSERT_EQUAL_INT(36, strlen(request.request_id));
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+static void test_sent_alarm_skips_the_flash(void)
+{
+    flow_start(ALARM(1));
+    alarm_post(1, "aW1n");
+    WAIT_UNTIL(server_delivered(0) == 1, false);
+    TEST_ASSERT_EQUAL_INT(0, server_request(0, 0).files);
+    TEST_ASSERT_EQUAL_INT(0, outbox_num(1));
+
+    // the same picture again is the alarm already sent, a new one goes out
+    alarm_post(1, "aW1n");
+    alarm_post(1, "bmV3");
+    WAIT_UNTIL(server_delivered(0) == 2, false);
+    settle();
+    TEST_ASSERT_EQUAL_INT(2, server_requests(0));
+    TEST_ASSERT_EQUAL_STRING("bmV3", server_request(0, 1).img);
+    TEST_ASSERT_EQUAL_INT(0, server_request(0, 1).files);
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+static void test_uplink_faults_are_retried(void)
+{
+    unsigned connections = host_socket_connections();
+
+    // no connection, a reset in the body, a cut reply, then two bad answers
+    host_socket_fault_push(HOST_SOCKET_REFUSE);
+    host_socket_fault_push(HOST_SOCKET_RESET);
+    host_socket_fault_push(HOST_SOCKET_CUT);
+    server_reply_push(0, REPLY("503 Service Unavailable", "{\"code\": 503}"));
+    server_reply_push(0, REPLY("429 Too Many Requests", "{\"code\": 429}"));
+    server_reply_push(0, REPLY("502 Bad Gateway", "<html>bad gateway</html>"));
+    server_reply_push(0, REPLY("200 OK", "{\"code\": 200}"));
+
+    flow_start(ALARM(1));
+    alarm_post(1, "aW1n");
+
+    // the first try is made from memory and fails, the alarm is kept and the next try waits for the backoff
+    WAIT_UNTIL(host_socket_connections() == connections + 1, false);
+    settle();
+    TEST_ASSERT_EQUAL_UINT(connections + 1, host_socket_connections());
+    TEST_ASSERT_EQUAL_INT(1, outbox_num(1));
+    TEST_ASSERT_EQUAL_INT(1, outbox_files());
+
+    WAIT_UNTIL(server_delivered(0) == 1, true);
+    WAIT_UNTIL(outbox_num(1) == 0, false);
+    TEST_ASSERT_EQUAL_UINT(connections + 6, host_socket_connections());
+    TEST_ASSERT_EQUAL_INT(1, s_servers[0].partial);
+    // the 503 that was cut, 429, the gateway page and the 200, all of one alarm
+    TEST_ASSERT_EQUAL_INT(4, server_requests(0));
+    for (int i = 1; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(server_request(0, 0).request_id, server_request(0, i).request_id);
+    }
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+static void test_rejected_alarm_is_dropped(void)
+{
+    server_reply_push(0, REPLY("400 Bad Request", "{\"code\": 400}"));
+    flow_start(ALARM(1));
+    alarm_post(1, "aW1n");
+    WAIT_UNTIL(server_requests(0) == 1 && outbox_num(1) == 0, false);
+
+    // not tried again, however long it waits
+    host_time_advance((int64_t)TF_MODULE_HTTP_ALARM_RETRY_MAX_MS * 1000);
+    settle();
+    TEST_ASSERT_EQUAL_INT(1, server_requests(0));
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+static void test_same_image_is_one_alarm(void)
+{
+    server_down(0, true);
+    flow_start(ALARM(1));
+    alarm_post(1, "c2FtZQ==");
+    alarm_post(1, "c2FtZQ==");
+    alarm_post(1, "b3RoZXI=");
+    WAIT_UNTIL(outbox_num(1) == 2, false);
+    settle();
+    TEST_ASSERT_EQUAL_INT(2, outbox_num(1));
+
+    server_down(0, false);
+    WAIT_UNTIL(server_delivered(0) == 2, true);
+    WAIT_UNTIL(outbox_num(1) == 0, false);
+    TEST_ASSERT_EQUAL_STRING("b3RoZXI=", server_request(0, server_requests(0) - 1).img);
+}
+
+static void test_unsent_alarms_survive_reboot(void)
+{
+    char request_id[40];
+
+    server_down(0, true);
+    flow_start(ALARM(1));
+    alarm_post(1, "Zmlyc3Q=");
+    alarm_post(1, "c2Vjb25k");
+    WAIT_UNTIL(outbox_num(1) == 2 && server_requests(0) >= 1, false);
+    snprintf(request_id, sizeof(request_id), "%s", server_request(0, 0).request_id);
+    flow_stop();
+    TEST_ASSERT_EQUAL_INT(2, outbox_files());
+
+    server_down(0, false);
+    flow_start(ALARM(1));
+    WAIT_UNTIL(server_delivered(0) == 2, true);
+    WAIT_UNTIL(outbox_num(1) == 0, false);
+    // oldest first, and the same alarm the server saw before the reboot
+    TEST_ASSERT_EQUAL_STRING("Zmlyc3Q=", server_request(0, server_requests(0) - 2).img);
+    TEST_ASSERT_EQUAL_STRING(request_id, server_request(0, server_requests(0) - 2).request_id);
+    TEST_ASSERT_EQUAL_STRING("c2Vjb25k", server_request(0, server_requests(0) - 1).img);
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+static void test_alarms_for_old_server_are_dropped(void)
+{
+    server_down(0, true);
+    flow_start(ALARM(1));
+    alarm_post(1, "Zmlyc3Q=");
+    alarm_post(1, "c2Vjb25k");
+    WAIT_UNTIL(outbox_num(1) == 2, false);
+    flow_stop();
+
+    // the user points the proxy at another server, the old one comes back
+    local_cfg_set(1, "Bearer a");
+    server_down(0, false);
+    flow_start(ALARM(1));
+    WAIT_UNTIL(outbox_num(1) == 0, true);
+    settle();
+    TEST_ASSERT_EQUAL_INT(0, server_requests(1));
+    TEST_ASSERT_EQUAL_INT(0, server_delivered(0));
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+
+    // new alarms go to the new server
+    alarm_post(1, "dGhpcmQ=");
+    WAIT_UNTIL(server_delivered(1) == 1, false);
+    TEST_ASSERT_EQUAL_STRING("dGhpcmQ=", server_request(1, 0).img);
+    TEST_ASSERT_EQUAL_INT(0, server_delivered(0));
+}
+
+static void test_alarms_for_old_token_are_dropped(void)
+{
+    server_down(0, true);
+    flow_start(ALARM(1));
+    alarm_post(1, "Zmlyc3Q=");
+    WAIT_UNTIL(outbox_num(1) == 1, false);
+    flow_stop();
+
+    // same server, another account
+    local_cfg_set(0, "Bearer b");
+    server_down(0, false);
+    flow_start(ALARM(1));
+    WAIT_UNTIL(outbox_num(1) == 0, true);
+    settle();
+    TEST_ASSERT_EQUAL_INT(0, server_delivered(0));
+
+    alarm_post(1, "c2Vjb25k");
+    WAIT_UNTIL(server_delivered(0) == 1, false);
+    TEST_ASSERT_EQUAL_STRING("Bearer b", server_request(0, server_requests(0) - 1).auth);
+}
+
+static void test_send_checks_destination(void)
+{
+    tf_module_http_alarm_t *p_module;
+    const char *p_body = "{}";
+
+    flow_start(ALARM(1));
+    p_module = module_get(1);
+    // an alarm the outbox read just before a new config came in
+    TEST_ASSERT_EQUAL_INT(TF_OUTBOX_SEND_DROP, __alarm_send(p_module, p_module->dest + 1, (const uint8_t *)p_body, strlen(p_body)));
+    TEST_ASSERT_EQUAL_INT(0, server_requests(0));
+    TEST_ASSERT_EQUAL_INT(TF_OUTBOX_SEND_OK, __alarm_send(p_module, p_module->dest, (const uint8_t *)p_body, strlen(p_body)));
+    TEST_ASSERT_EQUAL_INT(1, server_delivered(0));
+}
+
+static void test_second_module_has_no_outbox(void)
+{
+    int owner;
+    int other;
+
+    // whichever the engine instances first takes the outbox
+    flow_start(ALARM(1) "," ALARM(2));
+    owner = module_get(1)->p_outbox != NULL ? 1 : 2;
+    other = 3 - owner;
+    TEST_ASSERT_NOT_NULL(module_get(owner)->p_outbox);
+    TEST_ASSERT_NULL(module_get(other)->p_outbox);
+
+    // the other one sends once and does not touch the files of the owner
+    server_down(0, true);
+    alarm_post(owner, "b25l");
+    WAIT_UNTIL(outbox_num(owner) == 1 && server_requests(0) >= 1, false);
+    alarm_post(other, "dHdv");
+    WAIT_UNTIL(server_requests(0) == 2, false);
+    settle();
+    TEST_ASSERT_EQUAL_INT(2, server_requests(0));
+    TEST_ASSERT_EQUAL_INT(1, outbox_files());
+
+    server_down(0, false);
+    WAIT_UNTIL(server_delivered(0) == 1, true);
+    WAIT_UNTIL(outbox_num(owner) == 0, false);
+    TEST_ASSERT_EQUAL_STRING("b25l", server_request(0, server_requests(0) - 1).img);
+    TEST_ASSERT_EQUAL_INT(0, outbox_files());
+}
+
+int main(void)
+{
+    mkdir(DRV_BASE_PATH_FLASH, 0755);
+    for (int i = 0; i < SERVERS; i++)
+    {
+        server_start(&s_servers[i]);
+    }
+    s_status = xQueueCreate(8, sizeof(int));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_init());
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_status_cb_register(status_cb, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register(TF_MODULE_HTTP_ALARM_NAME, TF_MODULE_HTTP_ALARM_DESC, TF_MODULE_HTTP_ALARM_RVERSION, &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set(TF_MODULE_HTTP_ALARM_NAME, &__g_module_io));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_alarm_is_posted);
+    RUN_TEST(test_sent_alarm_skips_the_flash);
+    RUN_TEST(test_uplink_faults_are_retried);
+    RUN_TEST(test_rejected_alarm_is_dropped);
+    RUN_TEST(test_same_image_is_one_alarm);
+    RUN_TEST(test_unsent_alarms_survive_reboot);
+    RUN_TEST(test_alarms_for_old_server_are_dropped);
+    RUN_TEST(test_alarms_for_old_token_are_dropped);
+    RUN_TEST(test_send_checks_destination);
+    RUN_TEST(test_second_module_has_no_outbox);
+    return UNITY_END();
+}
@@ -0,0 +1,266 @@
+/*
+ * Shared images of the task flow data (tf_data_image_share / tf_data_image_wrap): a frame handed
+ * to several consumers without a copy, the buffer released once, by whichever owner lets go of it
+ * last, and not before. Owners freeing from one task and from many at once, images inside the
+ * event data of the flow, and an image that was never shared.
+ *
+ * The memory accounting is on, every test ends with nothing held.
+ */
+#include <pthread.h>
+
+#include "unity.h"
+
+#include "tf_module_util.h"
+#include "tf_module_data_type.h"
+#include "tf_util.h"
+
+#define FRAME_LEN       4096
+#define CONSUMERS       6
+#define RACE_ROUNDS     2000
+
+typedef struct {
+    int releases;
+    uint8_t *p_released;
+    void *p_ctx;
+} release_log_t;
+
+static release_log_t s_log;
+
+static void release(uint8_t *p_buf, void *p_ctx)
+{
+    __atomic_add_fetch(&s_log.releases, 1, __ATOMIC_ACQ_REL);
+    s_log.p_released = p_buf;
+    s_log.p_ctx = p_ctx;
+    // a late reader would see this
+    memset(p_buf, 0xee, FRAME_LEN);
+    tf_free(p_buf);
+}
+
+static uint8_t *frame_new(uint8_t seed)
+{
+    uint8_t *p_buf = tf_malloc(FRAME_LEN + 1);
+
+    for (int i = 0; i < FRAME_LEN; i++)
+    {
+        p_buf[i] = (uint8_t)(seed + i);
+    }
+    p_buf[FRAME_LEN] = 0;
+    return p_buf;
+}
+
+static void assert_frame(const struct tf_data_image *p_img, uint8_t seed)
+{
+    TEST_ASSERT_NOT_NULL(p_img->p_buf);
+    TEST_ASSERT_EQUAL_UINT32(FRAME_LEN, p_img->len);
+    for (int i = 0; i < FRAME_LEN; i++)
+    {
+        if (p_img->p_buf[i] != (uint8_t)(seed + i))
+        {
+            TEST_FAIL_MESSAGE("frame changed under an owner");
+        }
+    }
+}
+
+static size_t held_bytes(void)
+{
+    tf_mem_stats_t stats = { 0 };
+
+    tf_mem_stats_get(TF_OWNER_NONE, &stats);
+    return stats.cur_bytes;
+}
+
+void setUp(void)
+{
+    memset(&s_log, 0, sizeof(s_log));
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL_size_t(0, held_bytes());
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_released_by_the_last_owner(void)
+{
+    struct tf_data_image src;
+    struct tf_data_image dst[CONSUMERS];
+    uint8_t *p_buf = frame_new(1);
+    int ctx;
+
+    TEST_ASSERT_EQUAL_INT(0, tf_data_image_wrap(&src, p_buf, FRAME_LEN, 1234, release, &ctx));
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        tf_data_image_share(&dst[i], &src);
+        TEST_ASSERT_EQUAL_PTR(p_buf, dst[i].p_buf);
+        TEST_ASSERT_EQUAL(1234, dst[i].time);
+    }
+    TEST_ASSERT_EQUAL_UINT32(CONSUMERS + 1, src.p_ref->refcnt);
+
+    // the producer lets go first, then the consumers out of order
+    tf_data_image_free(&src);
+    TEST_ASSERT_NULL(src.p_buf);
+    TEST_ASSERT_NULL(src.p_ref);
+    const int order[CONSUMERS] = { 3, 0, 5, 1, 4, 2 };
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(0, s_log.releases);
+        for (int j = i; j < CONSUMERS; j++)
+        {
+            assert_frame(&dst[order[j]], 1);
+        }
+        tf_data_image_free(&dst[order[i]]);
+    }
+    TEST_ASSERT_EQUAL_INT(1, s_log.releases);
+    TEST_ASSERT_EQUAL_PTR(p_buf, s_log.p_released);
+    TEST_ASSERT_EQUAL_PTR(&ctx, s_log.p_ctx);
+}
+
+static void test_producer_released_last(void)
+{
+    struct tf_data_image src;
+    struct tf_data_image dst;
+
+    TEST_ASSERT_EQUAL_INT(0, tf_data_image_wrap(&src, frame_new(2), FRAME_LEN, 0, release, NULL));
+    tf_data_image_share(&dst, &src);
+    tf_data_image_free(&dst);
+    TEST_ASSERT_EQUAL_INT(0, s_log.releases);
+    assert_frame(&src, 2);
+    tf_data_image_free(&src);
+    TEST_ASSERT_EQUAL_INT(1, s_log.releases);
+
+    // one owner only
+    TEST_ASSERT_EQUAL_INT(0, tf_data_image_wrap(&src, frame_new(3), FRAME_LEN, 0, release, NULL));
+    tf_data_image_free(&src);
+    TEST_ASSERT_EQUAL_INT(2, s_log.releases);
+}
+
+static void test_plain_image_shared(void)
+{
+    // a buffer of tf_malloc is handed over to a refcount on its first share, tf_free releases it
+    struct tf_data_image src = { .p_buf = frame_new(4), .len = FRAME_LEN, .time = 99 };
+    struct tf_data_image a, b;
+    uint8_t *p_buf = src.p_buf;
+
+    tf_data_image_share(&a, &src);
+    TEST_ASSERT_NOT_NULL(src.p_ref);
+    tf_data_image_share(&b, &a);
+    TEST_ASSERT_EQUAL_PTR(p_buf, b.p_buf);
+    TEST_ASSERT_EQUAL_PTR(src.p_ref, b.p_ref);
+    TEST_ASSERT_EQUAL_UINT32(3, src.p_ref->refcnt);
+
+    tf_data_image_free(&src);
+    tf_data_image_free(&b);
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(FRAME_LEN, held_bytes());
+    assert_frame(&a, 4);
+    tf_data_image_free(&a);
+    TEST_ASSERT_EQUAL_INT(0, s_log.releases);
+
+    // an empty image shares nothing
+    struct tf_data_image empty = { .p_buf = NULL, .len = 0, .time = 5 };
+    tf_data_image_share(&a, &empty);
+    TEST_ASSERT_NULL(a.p_buf);
+    TEST_ASSERT_NULL(a.p_ref);
+    TEST_ASSERT_NULL(empty.p_ref);
+    TEST_ASSERT_EQUAL(5, a.time);
+    tf_data_image_free(&a);
+    tf_data_image_free(&empty);
+
+    // a copy owns its buffer
+    src = (struct tf_data_image){ .p_buf = frame_new(6), .len = FRAME_LEN };
+    tf_data_image_copy(&a, &src);
+    tf_data_image_free(&src);
+    assert_frame(&a, 6);
+    TEST_ASSERT_EQUAL_UINT8(0, a.p_buf[FRAME_LEN]);
+    tf_data_image_free(&a);
+}
+
+static void test_event_data_of_the_flow(void)
+{
+    // what the ai camera posts to each output, and the consumers freeing the whole event
+    struct tf_data_image small;
+    tf_data_dualimage_with_inference_t events[3];
+
+    TEST_ASSERT_EQUAL_INT(0, tf_data_image_wrap(&small, frame_new(7), FRAME_LEN, 0, release, NULL));
+    for (int i = 0; i < 3; i++)
+    {
+        memset(&events[i], 0, sizeof(events[i]));
+        events[i].type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE;
+        tf_data_image_share(&events[i].img_small, &small);
+    }
+    tf_data_image_free(&small);
+
+    // a module passing the event on shares it again
+    tf_data_dualimage_with_audio_text_t alarm = { .type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT };
+    tf_data_image_share(&alarm.img_small, &events[1].img_small);
+
+    tf_data_free(&events[0]);
+    tf_data_free(&events[1]);
+    tf_data_free(&events[2]);
+    TEST_ASSERT_EQUAL_INT(0, s_log.releases);
+    assert_frame(&alarm.img_small, 7);
+    tf_data_free(&alarm);
+    TEST_ASSERT_EQUAL_INT(1, s_log.releases);
+}
+
+typedef struct {
+    struct tf_data_image img;
+    uint8_t seed;
+    pthread_barrier_t *p_go;
+} consumer_t;
+
+static void *consumer(void *p_arg)
+{
+    consumer_t *p_consumer = p_arg;
+
+    pthread_barrier_wait(p_consumer->p_go);
+    assert_frame(&p_consumer->img, p_consumer->seed);
+    tf_data_image_free(&p_consumer->img);
+    return NULL;
+}
+
+static void test_owners_racing(void)
+{
+    // consumers on their own tasks let go at once: one release, after the last of them read
+    pthread_barrier_t go;
+    pthread_t threads[CONSUMERS];
+    consumer_t consumers[CONSUMERS];
+
+    pthread_barrier_init(&go, NULL, CONSUMERS + 1);
+    for (int round = 0; round < RACE_ROUNDS; round++)
+    {
+        struct tf_data_image src;
+        uint8_t seed = (uint8_t)round;
+
+        TEST_ASSERT_EQUAL_INT(0, tf_data_image_wrap(&src, frame_new(seed), FRAME_LEN, 0, release, NULL));
+        for (int i = 0; i < CONSUMERS; i++)
+        {
+            tf_data_image_share(&consumers[i].img, &src);
+            consumers[i].seed = seed;
+            consumers[i].p_go = &go;
+            pthread_create(&threads[i], NULL, consumer, &consumers[i]);
+        }
+        pthread_barrier_wait(&go);
+        tf_data_image_free(&src);
+        for (int i = 0; i < CONSUMERS; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        TEST_ASSERT_EQUAL_INT(round + 1, s_log.releases);
+    }
+    pthread_barrier_destroy(&go);
+}
+
+int main(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, tf_mem_acct_init());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_released_by_the_last_owner);
+    RUN_TEST(test_producer_released_last);
+    RUN_TEST(test_plain_image_shared);
+    RUN_TEST(test_event_data_of_the_flow);
+    RUN_TEST(test_owners_racing);
+    return UNITY_END();
+}
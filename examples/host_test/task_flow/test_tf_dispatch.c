@@ -0,0 +1,436 @@
+/*
+ * Task flow event dispatcher: the order events reach their handlers and whether a busy event id
+ * can starve the others. Events of one mailbox in the order they were posted, mailboxes of one
+ * worker taken in turn, a handler flooding its own mailbox, the full mailbox policies, the wait
+ * and run stats on the manual clock; then the worker tasks themselves, a slow uplink sink beside
+ * the frame path.
+ *
+ * Most tests build the dispatcher without its tasks and run the worker one event at a time,
+ * tearDown closing what they opened.
+ */
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "host_test.h"
+#include "tf_dispatch.c"
+
+#define EVT_A           1
+#define EVT_B           2
+#define EVT_C           3
+#define EVT_UPLINK      4
+#define LOG_MAX         4096
+#define FLOOD_RUNS      1000
+#define FRAME_EVENTS    200
+#define UPLINK_SLOW_MS  20
+
+ESP_EVENT_DEFINE_BASE(TF_EVENT_BASE);
+
+typedef struct {
+    int32_t event_id;
+    int seq;
+} entry_t;
+
+static entry_t s_log[LOG_MAX];
+static int s_log_num;
+static int s_dropped[8];
+static int s_flood_reposts;
+static bool s_tasks_started;
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static void handler(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    TEST_ASSERT_EQUAL_PTR(TF_EVENT_BASE, base);
+    TEST_ASSERT_EQUAL_PTR((void *)(intptr_t)event_id, handler_arg);
+    pthread_mutex_lock(&s_log_lock);
+    if (s_log_num < LOG_MAX)
+    {
+        s_log[s_log_num].event_id = event_id;
+        s_log[s_log_num].seq = *(int *)event_data;
+        s_log_num++;
+    }
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+// a busy event id: every event of it posts the next one
+static void flood_handler(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    int next = *(int *)event_data + 1;
+
+    handler(handler_arg, base, event_id, event_data);
+    if (s_flood_reposts-- > 0)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_post(event_id, &next, sizeof(next), 0));
+    }
+}
+
+static void drop_cb(void *p_event_data)
+{
+    s_dropped[*(int *)p_event_data % 8]++;
+}
+
+static void open_box(int32_t event_id, int worker, int depth, tf_dispatch_policy_t policy, esp_event_handler_t h)
+{
+    tf_dispatch_cfg_t cfg = { .worker = worker, .depth = depth, .policy = policy, .drop_cb = drop_cb };
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_open(event_id, &cfg, h, (void *)(intptr_t)event_id));
+}
+
+static esp_err_t post(int32_t event_id, int seq)
+{
+    return tf_dispatch_post(event_id, &seq, sizeof(seq), 0);
+}
+
+static int run(int worker, int max)
+{
+    struct tf_dispatch_item item;
+    int n = 0;
+
+    while (n < max && __worker_run_once(gp_dispatcher, worker, &item))
+    {
+        n++;
+    }
+    return n;
+}
+
+static void assert_log(const entry_t *p_want, int num)
+{
+    TEST_ASSERT_EQUAL_INT(num, s_log_num);
+    for (int i = 0; i < num; i++)
+    {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "entry %d", i);
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(p_want[i].event_id, s_log[i].event_id, msg);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(p_want[i].seq, s_log[i].seq, msg);
+    }
+}
+
+static tf_dispatch_stats_t stats_of(int32_t event_id)
+{
+    tf_dispatch_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_stats_get(event_id, &stats));
+    return stats;
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the dispatcher as tf_dispatch_init() leaves it, the test's own task standing in for the workers */
+static void dispatcher_new(void)
+{
+    tf_dispatcher_t *p_dispatcher = calloc(1, sizeof(tf_dispatcher_t));
+
+    p_dispatcher->sem_handle = xSemaphoreCreateMutex();
+    for (int i = 0; i < TF_DISPATCH_WORKER_NUM; i++)
+    {
+        p_dispatcher->workers[i].run_lock = xSemaphoreCreateRecursiveMutex();
+        p_dispatcher->workers[i].task_handle = xTaskGetCurrentTaskHandle();
+    }
+    gp_dispatcher = p_dispatcher;
+}
+
+static void dispatcher_delete(void)
+{
+    for (int i = 0; i < TF_DISPATCH_MAILBOX_MAX; i++)
+    {
+        struct tf_mailbox *p_mailbox = &gp_dispatcher->mailboxes[i];
+        if (p_mailbox->used)
+        {
+            TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_close(p_mailbox->event_id, p_mailbox->handler));
+        }
+    }
+    for (int i = 0; i < TF_DISPATCH_WORKER_NUM; i++)
+    {
+        vSemaphoreDelete(gp_dispatcher->workers[i].run_lock);
+    }
+    vSemaphoreDelete(gp_dispatcher->sem_handle);
+    free(gp_dispatcher);
+    gp_dispatcher = NULL;
+}
+
+void setUp(void)
+{
+    s_log_num = 0;
+    s_flood_reposts = 0;
+    memset(s_dropped, 0, sizeof(s_dropped));
+    host_time_reset();
+    if (!s_tasks_started)
+    {
+        dispatcher_new();
+    }
+}
+
+void tearDown(void)
+{
+    // the worker tasks keep the dispatcher of tf_dispatch_init()
+    s_flood_reposts = 0;
+    if (!s_tasks_started)
+    {
+        dispatcher_delete();
+    }
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_one_mailbox_in_post_order(void)
+{
+    entry_t want[8];
+
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 8, TF_DISPATCH_POLICY_BLOCK, handler);
+    for (int i = 0; i < 8; i++)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, post(EVT_A, i));
+        want[i] = (entry_t){ EVT_A, i };
+    }
+    TEST_ASSERT_EQUAL_INT(8, run(TF_DISPATCH_WORKER_FRAME, 100));
+    assert_log(want, 8);
+    TEST_ASSERT_EQUAL_UINT32(8, stats_of(EVT_A).handled);
+    TEST_ASSERT_EQUAL_UINT32(8, stats_of(EVT_A).high_water);
+}
+
+static void test_mailboxes_taken_in_turn(void)
+{
+    // A has a backlog, B and C a little each: they don't wait behind A
+    const entry_t want[] = {
+        { EVT_A, 0 }, { EVT_B, 100 }, { EVT_C, 200 },
+        { EVT_A, 1 }, { EVT_B, 101 }, { EVT_C, 201 },
+        { EVT_A, 2 }, { EVT_A, 3 }, { EVT_A, 4 }, { EVT_A, 5 },
+    };
+
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 8, TF_DISPATCH_POLICY_BLOCK, handler);
+    open_box(EVT_B, TF_DISPATCH_WORKER_FRAME, 8, TF_DISPATCH_POLICY_BLOCK, handler);
+    open_box(EVT_C, TF_DISPATCH_WORKER_FRAME, 8, TF_DISPATCH_POLICY_BLOCK, handler);
+    for (int i = 0; i < 6; i++)
+    {
+        post(EVT_A, i);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        post(EVT_B, 100 + i);
+        post(EVT_C, 200 + i);
+    }
+    TEST_ASSERT_EQUAL_INT(10, run(TF_DISPATCH_WORKER_FRAME, 100));
+    assert_log(want, 10);
+
+    // the turn goes on from where it stopped, not from the first mailbox
+    post(EVT_A, 10);
+    post(EVT_B, 110);
+    post(EVT_C, 210);
+    s_log_num = 0;
+    TEST_ASSERT_EQUAL_INT(1, run(TF_DISPATCH_WORKER_FRAME, 1));
+    TEST_ASSERT_EQUAL_INT32(EVT_B, s_log[0].event_id);
+    run(TF_DISPATCH_WORKER_FRAME, 100);
+}
+
+static void test_busy_event_id_starves_nobody(void)
+{
+    // A reposts itself on every event and never runs dry, B and C still get theirs in
+    int seq = 0;
+
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 4, TF_DISPATCH_POLICY_BLOCK, flood_handler);
+    open_box(EVT_B, TF_DISPATCH_WORKER_FRAME, 4, TF_DISPATCH_POLICY_BLOCK, handler);
+    open_box(EVT_C, TF_DISPATCH_WORKER_FRAME, 4, TF_DISPATCH_POLICY_BLOCK, handler);
+    s_flood_reposts = FLOOD_RUNS * 2;
+    post(EVT_A, 0);
+
+    int last_b = -1;
+    int gap_max = 0;
+    for (int i = 0; i < FLOOD_RUNS; i++)
+    {
+        if (i % 10 == 0)
+        {
+            post(EVT_B, seq);
+            post(EVT_C, seq);
+            seq++;
+        }
+        TEST_ASSERT_EQUAL_INT(1, run(TF_DISPATCH_WORKER_FRAME, 1));
+        if (s_log[s_log_num - 1].event_id == EVT_B)
+        {
+            if (last_b >= 0 && s_log_num - 1 - last_b > gap_max)
+            {
+                gap_max = s_log_num - 1 - last_b;
+            }
+            last_b = s_log_num - 1;
+        }
+    }
+
+    // every B and C posted was handled, none waited behind more than a turn of the others
+    int b = 0, c = 0;
+    for (int i = 0; i < s_log_num; i++)
+    {
+        b += s_log[i].event_id == EVT_B;
+        c += s_log[i].event_id == EVT_C;
+    }
+    TEST_ASSERT_EQUAL_INT(seq, b);
+    TEST_ASSERT_EQUAL_INT(seq, c);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(10, gap_max);
+    TEST_ASSERT_EQUAL_UINT32(0, stats_of(EVT_B).dropped);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, stats_of(EVT_B).high_water);
+    s_flood_reposts = 0;
+    run(TF_DISPATCH_WORKER_FRAME, 100);
+}
+
+static void test_workers_apart(void)
+{
+    // a worker only runs the mailboxes of its own
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 4, TF_DISPATCH_POLICY_BLOCK, handler);
+    open_box(EVT_UPLINK, TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_BLOCK, handler);
+    post(EVT_UPLINK, 1);
+    post(EVT_A, 2);
+    post(EVT_UPLINK, 3);
+
+    TEST_ASSERT_EQUAL_INT(1, run(TF_DISPATCH_WORKER_FRAME, 100));
+    TEST_ASSERT_EQUAL_INT(0, run(TF_DISPATCH_WORKER_ALARM, 100));
+    TEST_ASSERT_EQUAL_INT(2, run(TF_DISPATCH_WORKER_UPLINK, 100));
+    const entry_t want[] = { { EVT_A, 2 }, { EVT_UPLINK, 1 }, { EVT_UPLINK, 3 } };
+    assert_log(want, 3);
+}
+
+static void test_full_mailbox_policies(void)
+{
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 3, TF_DISPATCH_POLICY_DROP_NEWEST, handler);
+    open_box(EVT_B, TF_DISPATCH_WORKER_FRAME, 3, TF_DISPATCH_POLICY_DROP_OLDEST, handler);
+    open_box(EVT_C, TF_DISPATCH_WORKER_FRAME, 3, TF_DISPATCH_POLICY_BLOCK, handler);
+
+    for (int i = 0; i < 5; i++)
+    {
+        TEST_ASSERT_EQUAL(i < 3 ? ESP_OK : ESP_ERR_TIMEOUT, post(EVT_A, i));
+        TEST_ASSERT_EQUAL(ESP_OK, post(EVT_B, 10 + i));
+        TEST_ASSERT_EQUAL(i < 3 ? ESP_OK : ESP_ERR_TIMEOUT, post(EVT_C, 20 + i));
+    }
+
+    // A and C keep the first three; B the last three, the two oldest gone through drop_cb
+    run(TF_DISPATCH_WORKER_FRAME, 100);
+    const entry_t want[] = {
+        { EVT_A, 0 }, { EVT_B, 12 }, { EVT_C, 20 },
+        { EVT_A, 1 }, { EVT_B, 13 }, { EVT_C, 21 },
+        { EVT_A, 2 }, { EVT_B, 14 }, { EVT_C, 22 },
+    };
+    assert_log(want, 9);
+    TEST_ASSERT_EQUAL_INT(1, s_dropped[10 % 8]);
+    TEST_ASSERT_EQUAL_INT(1, s_dropped[11 % 8]);
+    TEST_ASSERT_EQUAL_UINT32(2, stats_of(EVT_A).dropped);
+    TEST_ASSERT_EQUAL_UINT32(2, stats_of(EVT_B).dropped);
+    TEST_ASSERT_EQUAL_UINT32(5, stats_of(EVT_B).posted);
+    TEST_ASSERT_EQUAL_UINT32(2, stats_of(EVT_C).dropped);
+
+    // what close finds queued goes through drop_cb, and the id takes no more events
+    post(EVT_B, 16);
+    post(EVT_B, 17);
+    memset(s_dropped, 0, sizeof(s_dropped));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_close(EVT_B, handler));
+    TEST_ASSERT_EQUAL_INT(1, s_dropped[0]);
+    TEST_ASSERT_EQUAL_INT(1, s_dropped[1]);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, post(EVT_B, 18));
+}
+
+static void test_wait_and_run_on_the_manual_clock(void)
+{
+    open_box(EVT_A, TF_DISPATCH_WORKER_FRAME, 4, TF_DISPATCH_POLICY_BLOCK, handler);
+    post(EVT_A, 0);
+    host_time_advance(3000);
+    post(EVT_A, 1);
+    host_time_advance(1000);
+    run(TF_DISPATCH_WORKER_FRAME, 100);
+
+    tf_dispatch_stats_t stats = stats_of(EVT_A);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.handled);
+    TEST_ASSERT_EQUAL_UINT32(4000, stats.wait_max_us);
+    TEST_ASSERT_EQUAL_UINT64(5000, stats.wait_total_us);
+
+    tf_dispatch_stats_reset();
+    stats = stats_of(EVT_A);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.handled);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.wait_max_us);
+}
+
+static volatile int s_uplink_running;
+static int s_uplink_overlaps;
+static int64_t s_frame_lag_max_us;
+
+static void uplink_handler(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    if (__atomic_add_fetch(&s_uplink_running, 1, __ATOMIC_ACQ_REL) > 1)
+    {
+        s_uplink_overlaps++;
+    }
+    usleep(UPLINK_SLOW_MS * 1000);
+    __atomic_sub_fetch(&s_uplink_running, 1, __ATOMIC_ACQ_REL);
+}
+
+static void frame_handler(void *handler_arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    int64_t lag = now_us() - *(int64_t *)event_data;
+
+    if (lag > s_frame_lag_max_us)
+    {
+        s_frame_lag_max_us = lag;
+    }
+    pthread_mutex_lock(&s_log_lock);
+    s_log_num++;
+    pthread_mutex_unlock(&s_log_lock);
+}
+
+static void test_slow_sink_beside_the_frame_path(void)
+{
+    // the worker tasks as on the device: an uplink sink busy for 20 ms per event doesn't
+    // hold up the frame path, and its handler never runs twice at once
+    tf_dispatch_cfg_t uplink = { .worker = TF_DISPATCH_WORKER_UPLINK, .depth = 4, .policy = TF_DISPATCH_POLICY_DROP_NEWEST };
+    tf_dispatch_cfg_t frame = TF_DISPATCH_CFG_DEFAULT();
+    int64_t stamp;
+
+    dispatcher_delete();
+    s_tasks_started = true;
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_init());
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_open(EVT_UPLINK, &uplink, uplink_handler, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_open(EVT_A, &frame, frame_handler, NULL));
+
+    for (int i = 0; i < FRAME_EVENTS; i++)
+    {
+        stamp = now_us();
+        TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_post(EVT_A, &stamp, sizeof(stamp), portMAX_DELAY));
+        tf_dispatch_post(EVT_UPLINK, &stamp, sizeof(stamp), 0);
+        usleep(1000);
+    }
+    for (int i = 0; i < 1000 && s_log_num < FRAME_EVENTS; i++)
+    {
+        usleep(1000);
+    }
+
+    tf_dispatch_stats_t up = stats_of(EVT_UPLINK);
+    printf("frame events %d, lag max %lld us; uplink handled %u, dropped %u\n", s_log_num,
+           (long long)s_frame_lag_max_us, (unsigned)up.handled, (unsigned)up.dropped);
+    TEST_ASSERT_EQUAL_INT(FRAME_EVENTS, s_log_num);
+    TEST_ASSERT_LESS_THAN_INT64(UPLINK_SLOW_MS * 1000, s_frame_lag_max_us);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, up.dropped);
+    TEST_ASSERT_EQUAL_INT(0, s_uplink_overlaps);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_close(EVT_UPLINK, uplink_handler));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_dispatch_close(EVT_A, frame_handler));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_one_mailbox_in_post_order);
+    RUN_TEST(test_mailboxes_taken_in_turn);
+    RUN_TEST(test_busy_event_id_starves_nobody);
+    RUN_TEST(test_workers_apart);
+    RUN_TEST(test_full_mailbox_policies);
+    RUN_TEST(test_wait_and_run_on_the_manual_clock);
+    // starts the worker tasks, last
+    RUN_TEST(test_slow_sink_beside_the_frame_path);
+    return UNITY_END();
+}
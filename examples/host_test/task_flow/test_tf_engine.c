@@ -0,0 +1,954 @@
+/*
+ * Task flow engine (tf.c) with fake module types: the registry, the order modules are started
+ * and stopped in, the wiring handed to them, and how bad flows are reported.
+ *
+ * The engine runs its own task and the dispatcher's workers, as on the device. The test waits
+ * for the status callback of the engine, and for events to arrive at the sinks.
+ *
+ * A handler registered outside msgs_sub_set is dispatched as its type says, and a second handler
+ * for an id is refused.
+ *
+ * A flow set while another runs is updated in place: "tuner" modules take new params through
+ * cfg_update, the other types are rebuilt for new params; new wires alone are handed over with
+ * msgs_pub_set. The fakes check that a started module is
+ * only ever wired to started ones. The blind time case models a camera whose start loads a
+ * model and whose stop waits, and prints the longest gap between frames at the sink.
+ */
+#include "unity.h"
+
+#include "tf.h"
+#include "tf_util.h"
+
+#define TYPE_IMG    TF_DATA_TYPE_MASK(1)
+#define TYPE_TEXT   TF_DATA_TYPE_MASK(2)
+
+#define LOG_MAX         64
+#define EXTRA_TYPES     40
+#define WAIT            pdMS_TO_TICKS(5000)
+
+// the blind time case, a model load and the stop delay of a camera, at 50 fps
+#define SLOW_START_MS   400
+#define SLOW_STOP_MS    200
+#define FRAME_MS        20
+#define SINK_ID         3
+
+typedef struct {
+    int id;
+    int serial;         // which instance: a rebuilt module may get the address of the one before
+    int pub[TF_MODULE_OUTPUT_PORT_MAX][8];
+    int pub_num[TF_MODULE_OUTPUT_PORT_MAX];
+    int received;
+    bool started;
+    int gain;
+    int cfg_updates;
+    bool start_fail;
+    int start_ms;
+    int stop_ms;
+    char task[16];      // the task its last event was handled on
+} fake_module_t;
+
+static SemaphoreHandle_t s_lock;
+static QueueHandle_t s_status;
+static char s_err_module[32];
+static int s_started[LOG_MAX];
+static int s_started_num;
+static int s_stopped[LOG_MAX];
+static int s_stopped_num;
+static int s_instances;
+static int s_serial;
+static fake_module_t *s_modules[LOG_MAX];
+static int s_modules_num;
+static char s_extra_names[EXTRA_TYPES][16];
+static int s_wired_to_stopped;
+static TickType_t s_sink_rx_last;     // of whichever module is id SINK_ID, across rebuilds
+static TickType_t s_sink_gap_max;
+static int s_sink_rx;
+
+static void handler(void *handler_args, esp_event_base_t base, int32_t id, void *event_data)
+{
+    fake_module_t *p_module = handler_args;
+    int value = *(int *)event_data;
+
+    TickType_t now = xTaskGetTickCount();
+    bool forward = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    p_module->received++;
+    snprintf(p_module->task, sizeof(p_module->task), "%s", pcTaskGetName(NULL));
+    if (p_module->id == SINK_ID)
+    {
+        if (s_sink_rx_last != 0 && now - s_sink_rx_last > s_sink_gap_max)
+        {
+            s_sink_gap_max = now - s_sink_rx_last;
+        }
+        s_sink_rx_last = now;
+        s_sink_rx++;
+    }
+    // a camera only sends frames once its model is up
+    forward = p_module->started;
+    xSemaphoreGive(s_lock);
+    if (!forward)
+    {
+        return;
+    }
+    // a filter passes what it gets on through every port
+    for (int m = 0; m < TF_MODULE_OUTPUT_PORT_MAX; m++)
+    {
+        for (int n = 0; n < p_module->pub_num[m]; n++)
+        {
+            tf_event_post(p_module->pub[m][n], &value, sizeof(value), portMAX_DELAY);
+        }
+    }
+}
+
+static bool started(int id)
+{
+    for (int i = 0; i < s_modules_num; i++)
+    {
+        if (s_modules[i]->id == id)
+        {
+            return s_modules[i]->started;
+        }
+    }
+    return false;
+}
+
+static int fake_start(void *p)
+{
+    fake_module_t *p_module = p;
+
+    if (p_module->start_fail)
+    {
+        return ESP_FAIL;
+    }
+    vTaskDelay(pdMS_TO_TICKS(p_module->start_ms));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_started[s_started_num++] = p_module->id;
+    p_module->started = true;
+    for (int m = 0; m < TF_MODULE_OUTPUT_PORT_MAX; m++)
+    {
+        for (int n = 0; n < p_module->pub_num[m]; n++)
+        {
+            s_wired_to_stopped += !started(p_module->pub[m][n]);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+static int fake_stop(void *p)
+{
+    fake_module_t *p_module = p;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    p_module->started = false;
+    xSemaphoreGive(s_lock);
+    vTaskDelay(pdMS_TO_TICKS(p_module->stop_ms));
+    tf_event_handler_unregister(p_module->id, handler);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stopped[s_stopped_num++] = p_module->id;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+static int param_int(cJSON *p_json, const char *p_key)
+{
+    cJSON *p_item = cJSON_GetObjectItem(p_json, p_key);
+
+    return cJSON_IsNumber(p_item) ? p_item->valueint : 0;
+}
+
+static int fake_cfg(void *p, cJSON *p_json)
+{
+    fake_module_t *p_module = p;
+
+    p_module->gain = param_int(p_json, "gain");
+    p_module->start_fail = cJSON_IsTrue(cJSON_GetObjectItem(p_json, "start_fail"));
+    p_module->start_ms = param_int(p_json, "start_ms");
+    p_module->stop_ms = param_int(p_json, "stop_ms");
+    return ESP_OK;
+}
+
+// a tuner takes any new gain while it runs, unless told to fail
+static int fake_cfg_update(void *p, cJSON *p_json)
+{
+    fake_module_t *p_module = p;
+
+    if (cJSON_IsTrue(cJSON_GetObjectItem(p_json, "update_fail")))
+    {
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    p_module->gain = param_int(p_json, "gain");
+    p_module->cfg_updates++;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+static int fake_msgs_sub_set(void *p, int evt_id)
+{
+    fake_module_t *p_module = p;
+
+    p_module->id = evt_id;
+    return tf_event_handler_register(evt_id, handler, p_module);
+}
+
+static int fake_msgs_pub_set(void *p, int output_index, int *p_evt_id, int num)
+{
+    fake_module_t *p_module = p;
+
+    TEST_ASSERT_LESS_THAN(TF_MODULE_OUTPUT_PORT_MAX, output_index);
+    TEST_ASSERT_LESS_OR_EQUAL(8, num);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (num > 0)
+    {
+        memcpy(p_module->pub[output_index], p_evt_id, sizeof(int) * num);
+    }
+    p_module->pub_num[output_index] = num;
+    // a rewire of a running module comes after its new targets are up
+    for (int n = 0; n < num && p_module->started; n++)
+    {
+        s_wired_to_stopped += !started(p_evt_id[n]);
+    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+// an uplink only takes its events once it is started, not in msgs_sub_set
+static int late_start(void *p)
+{
+    fake_module_t *p_module = p;
+    int ret = fake_start(p);
+
+    return ret != ESP_OK ? ret : tf_event_handler_register(p_module->id, handler, p_module);
+}
+
+static int late_msgs_sub_set(void *p, int evt_id)
+{
+    fake_module_t *p_module = p;
+
+    p_module->id = evt_id;
+    return ESP_OK;
+}
+
+static const struct tf_module_ops s_ops = {
+    .start = fake_start,
+    .stop = fake_stop,
+    .cfg = fake_cfg,
+    .msgs_sub_set = fake_msgs_sub_set,
+    .msgs_pub_set = fake_msgs_pub_set,
+};
+
+static const struct tf_module_ops s_tuner_ops = {
+    .start = fake_start,
+    .stop = fake_stop,
+    .cfg = fake_cfg,
+    .msgs_sub_set = fake_msgs_sub_set,
+    .msgs_pub_set = fake_msgs_pub_set,
+    .cfg_update = fake_cfg_update,
+};
+
+static const struct tf_module_ops s_late_ops = {
+    .start = late_start,
+    .stop = fake_stop,
+    .cfg = fake_cfg,
+    .msgs_sub_set = late_msgs_sub_set,
+    .msgs_pub_set = fake_msgs_pub_set,
+};
+
+static tf_module_t *fake_instance_with(const struct tf_module_ops *p_ops)
+{
+    tf_module_t *p_handle = calloc(1, sizeof(tf_module_t));
+    fake_module_t *p_module = calloc(1, sizeof(fake_module_t));
+
+    p_handle->ops = p_ops;
+    p_handle->p_module = p_module;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_instances++;
+    p_module->serial = ++s_serial;
+    s_modules[s_modules_num++] = p_module;
+    xSemaphoreGive(s_lock);
+    return p_handle;
+}
+
+static tf_module_t *fake_instance(void)
+{
+    return fake_instance_with(&s_ops);
+}
+
+static tf_module_t *tuner_instance(void)
+{
+    return fake_instance_with(&s_tuner_ops);
+}
+
+static tf_module_t *late_instance(void)
+{
+    return fake_instance_with(&s_late_ops);
+}
+
+static void fake_destroy(tf_module_t *p_handle)
+{
+    fake_module_t *p_module = p_handle->p_module;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_instances--;
+    for (int i = 0; i < s_modules_num; i++)
+    {
+        if (s_modules[i] == p_module)
+        {
+            s_modules[i] = s_modules[--s_modules_num];
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    free(p_module);
+    free(p_handle);
+}
+
+static tf_module_mgmt_t s_mgmt = {
+    .tf_module_instance = fake_instance,
+    .tf_module_destroy = fake_destroy,
+};
+
+static tf_module_mgmt_t s_tuner_mgmt = {
+    .tf_module_instance = tuner_instance,
+    .tf_module_destroy = fake_destroy,
+};
+
+static tf_module_mgmt_t s_late_mgmt = {
+    .tf_module_instance = late_instance,
+    .tf_module_destroy = fake_destroy,
+};
+
+static void status_cb(void *p_arg, intmax_t tid, int status, const char *p_err_module)
+{
+    // the name lives in the flow, which is freed right after a failed start
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    snprintf(s_err_module, sizeof(s_err_module), "%s", p_err_module ? p_err_module : "");
+    xSemaphoreGive(s_lock);
+    xQueueSend(s_status, &status, portMAX_DELAY);
+}
+
+/* the status the engine settles on after STARTING */
+static int status_wait(void)
+{
+    int status;
+
+    do
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(pdTRUE, xQueueReceive(s_status, &status, WAIT), "no status from the engine");
+    } while (status == TF_STATUS_STARTING);
+    return status;
+}
+
+static int flow_run(const char *p_modules)
+{
+    char flow[2048];
+    int len = snprintf(flow, sizeof(flow), "{\"tlid\": 7, \"ctd\": 7, \"tn\": \"test\", \"type\": 0, \"task_flow\": [%s]}", p_modules);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_flow_set(flow, len));
+    return status_wait();
+}
+
+static int module_received(int id)
+{
+    int received = -1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_modules_num; i++)
+    {
+        if (s_modules[i]->id == id)
+        {
+            received = s_modules[i]->received;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return received;
+}
+
+static fake_module_t *module_get(int id)
+{
+    for (int i = 0; i < s_modules_num; i++)
+    {
+        if (s_modules[i]->id == id)
+        {
+            return s_modules[i];
+        }
+    }
+    TEST_FAIL_MESSAGE("module not instanced");
+    return NULL;
+}
+
+static void received_wait(int id, int count)
+{
+    for (int i = 0; i < 500 && module_received(id) < count; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_INT(count, module_received(id));
+}
+
+static int position(const int *p_log, int num, int id)
+{
+    for (int i = 0; i < num; i++)
+    {
+        if (p_log[i] == id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void engine_init(void)
+{
+    static const tf_module_io_t camera = { .input_types = 0, .output_port_num = 1, .output_types = { TYPE_IMG } };
+    static const tf_module_io_t filter = { .input_types = TYPE_IMG, .output_port_num = 2, .output_types = { TYPE_IMG, TYPE_TEXT } };
+    static const tf_module_io_t screen = { .input_types = TYPE_IMG | TYPE_TEXT, .output_port_num = 0 };
+    static const tf_module_io_t uart = { .input_types = TYPE_TEXT, .output_port_num = 0 };
+    static const tf_dispatch_cfg_t uplink = { .worker = TF_DISPATCH_WORKER_UPLINK, .depth = 4, .policy = TF_DISPATCH_POLICY_BLOCK };
+
+    s_lock = xSemaphoreCreateMutex();
+    s_status = xQueueCreate(16, sizeof(int));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_init());
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_status_cb_register(status_cb, NULL));
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("camera", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("filter", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("screen", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("uart", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("plain", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("tuner", "", "1.0.0", &s_tuner_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("filter", &filter));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("screen", &screen));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("uart", &uart));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_register("uplink", "", "1.0.0", &s_late_mgmt));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("camera", &camera));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("tuner", &filter));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set("uplink", &screen));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_dispatch_set("uplink", &uplink));
+}
+
+void setUp(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_started_num = 0;
+    s_stopped_num = 0;
+    s_err_module[0] = '\0';
+    s_wired_to_stopped = 0;
+    xSemaphoreGive(s_lock);
+    xQueueReset(s_status);
+}
+
+void tearDown(void)
+{
+    int status = TF_STATUS_IDLE;
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_status_get(&status));
+    if (status == TF_STATUS_RUNNING)
+    {
+        tf_engine_stop();
+        TEST_ASSERT_EQUAL_INT(TF_STATUS_STOP, status_wait());
+    }
+    // STOP is reported before the modules are, they are gone before the next test
+    for (int i = 0; i < 500 && s_instances > 0; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static void test_registry_has_no_fixed_size(void)
+{
+    static const tf_module_io_t io = { .input_types = TF_DATA_TYPE_MASK_ANY };
+    static const tf_dispatch_cfg_t cfg = TF_DISPATCH_CFG_DEFAULT();
+
+    // more types than the firmware has, each still found by name
+    for (int i = 0; i < EXTRA_TYPES; i++)
+    {
+        snprintf(s_extra_names[i], sizeof(s_extra_names[i]), "extra %d", i);
+        TEST_ASSERT_EQUAL(ESP_OK, tf_module_register(s_extra_names[i], "", "1.0.0", &s_mgmt));
+    }
+    for (int i = 0; i < EXTRA_TYPES; i++)
+    {
+        TEST_ASSERT_EQUAL(ESP_OK, tf_module_io_set(s_extra_names[i], &io));
+        TEST_ASSERT_EQUAL(ESP_OK, tf_module_dispatch_set(s_extra_names[i], &cfg));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, tf_module_register("camera", "", "1.0.0", &s_mgmt));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, tf_module_io_set("nope", &io));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, tf_module_dispatch_set("nope", &cfg));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, tf_module_register(NULL, "", "1.0.0", &s_mgmt));
+}
+
+static void test_flow_starts_sinks_first_and_stops_sources_first(void)
+{
+    int value = 1;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3], [3, 4]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []},"
+        "{\"id\": 4, \"type\": \"uart\", \"index\": 3, \"params\": {}, \"wires\": []}"));
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_INT(4, s_started_num);
+    TEST_ASSERT_LESS_THAN_INT(position(s_started, 4, 2), position(s_started, 4, 3));
+    TEST_ASSERT_LESS_THAN_INT(position(s_started, 4, 2), position(s_started, 4, 4));
+    TEST_ASSERT_LESS_THAN_INT(position(s_started, 4, 1), position(s_started, 4, 2));
+    xSemaphoreGive(s_lock);
+
+    // the wires of each port went to the port
+    TEST_ASSERT_EQUAL_INT(1, module_get(2)->pub_num[0]);
+    TEST_ASSERT_EQUAL_INT(3, module_get(2)->pub[0][0]);
+    TEST_ASSERT_EQUAL_INT(2, module_get(2)->pub_num[1]);
+    TEST_ASSERT_EQUAL_INT(4, module_get(2)->pub[1][1]);
+    TEST_ASSERT_EQUAL_INT(2, module_get(1)->pub[0][0]);
+
+    // an event at the camera comes out at the screen twice and the uart once
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(1, &value, sizeof(value), portMAX_DELAY));
+    received_wait(3, 2);
+    received_wait(4, 1);
+
+    tf_engine_stop();
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_STOP, status_wait());
+    // stopped in reverse, so nothing posts into a stopped module
+    for (int i = 0; i < 100 && s_instances > 0; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_INT(4, s_stopped_num);
+    TEST_ASSERT_LESS_THAN_INT(position(s_stopped, 4, 2), position(s_stopped, 4, 1));
+    TEST_ASSERT_LESS_THAN_INT(position(s_stopped, 4, 3), position(s_stopped, 4, 2));
+    TEST_ASSERT_EQUAL_INT(0, s_instances);
+    xSemaphoreGive(s_lock);
+}
+
+static void assert_rejected(int expected_status, const char *p_module, const char *p_flow)
+{
+    TEST_ASSERT_EQUAL_INT(expected_status, flow_run(p_flow));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_STRING(p_module, s_err_module);
+    // rejected before any module was instanced
+    TEST_ASSERT_EQUAL_INT(0, s_instances);
+    TEST_ASSERT_EQUAL_INT(0, s_started_num);
+    xSemaphoreGive(s_lock);
+}
+
+static void test_bad_flows_are_reported(void)
+{
+    assert_rejected(TF_STATUS_ERR_MODULE_NOT_FOUND, "zoom",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"zoom\", \"index\": 1, \"params\": {}, \"wires\": []}");
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "screen",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 1, \"type\": \"screen\", \"index\": 1, \"params\": {}, \"wires\": []}");
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "camera",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[1]]}");
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "filter",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3, 3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}");
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "camera",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"uart\", \"index\": 1, \"params\": {}, \"wires\": []}");
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "plain",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"plain\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"plain\", \"index\": 2, \"params\": {}, \"wires\": [[2]]}");
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_ERR_JSON_PARSE, flow_run("{\"id\": 1}"));
+}
+
+static void test_good_flow_runs_after_bad_one(void)
+{
+    assert_rejected(TF_STATUS_ERR_MODULES_WIRES, "camera",
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"uart\", \"index\": 1, \"params\": {}, \"wires\": []}");
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"screen\", \"index\": 1, \"params\": {}, \"wires\": []}"));
+    TEST_ASSERT_EQUAL_INT(2, s_started_num);
+}
+
+static void test_handler_registered_late_gets_its_type_dispatch(void)
+{
+    int value = 1;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"uplink\", \"index\": 1, \"params\": {}, \"wires\": []}"));
+
+    // registered in start, not msgs_sub_set, the uplink still runs on the worker of its type
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(1, &value, sizeof(value), portMAX_DELAY));
+    received_wait(2, 1);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_STRING("tf_uplink", module_get(2)->task);
+    TEST_ASSERT_EQUAL_STRING("tf_frame", module_get(1)->task);
+    xSemaphoreGive(s_lock);
+
+    // one handler per id, a second one is turned away and the first still gets the events
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, tf_event_handler_register(2, handler, module_get(1)));
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(2, &value, sizeof(value), portMAX_DELAY));
+    received_wait(2, 2);
+    TEST_ASSERT_EQUAL_INT(1, module_received(1));
+}
+
+static int occurrences(const int *p_log, int num, int id)
+{
+    int n = 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        n += p_log[i] == id;
+    }
+    return n;
+}
+
+static void instances_wait(int num)
+{
+    for (int i = 0; i < 500 && s_instances != num; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL_INT(num, s_instances);
+}
+
+static void assert_log(const int *p_log, const int *p_num, int id, int expected)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int n = occurrences(p_log, *p_num, id);
+    xSemaphoreGive(s_lock);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected, n, "starts or stops of a module");
+}
+
+#define assert_started(id, n)   assert_log(s_started, &s_started_num, id, n)
+#define assert_stopped(id, n)   assert_log(s_stopped, &s_stopped_num, id, n)
+
+static void test_update_keeps_modules_and_updates_params(void)
+{
+    int value = 1;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2, 5]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {\"gain\": 1}, \"wires\": [[3]]},"
+        "{\"id\": 5, \"type\": \"filter\", \"index\": 2, \"params\": {\"gain\": 1}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 3, \"params\": {}, \"wires\": []}"));
+    int camera = module_get(1)->serial;
+    int tuner = module_get(2)->serial;
+    int filter = module_get(5)->serial;
+    int screen = module_get(3)->serial;
+
+    // new params for both, only the tuner can take them while it runs
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2, 5]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {\"gain\": 2}, \"wires\": [[3]]},"
+        "{\"id\": 5, \"type\": \"filter\", \"index\": 2, \"params\": {\"gain\": 2}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 3, \"params\": {}, \"wires\": []}"));
+
+    TEST_ASSERT_EQUAL_INT(camera, module_get(1)->serial);
+    TEST_ASSERT_EQUAL_INT(screen, module_get(3)->serial);
+    TEST_ASSERT_EQUAL_INT(tuner, module_get(2)->serial);
+    TEST_ASSERT_EQUAL_INT(1, module_get(2)->cfg_updates);
+    TEST_ASSERT_EQUAL_INT(2, module_get(2)->gain);
+    TEST_ASSERT_NOT_EQUAL(filter, module_get(5)->serial);
+    TEST_ASSERT_EQUAL_INT(2, module_get(5)->gain);
+    assert_started(1, 1);
+    assert_started(2, 1);
+    assert_started(3, 1);
+    assert_started(5, 2);
+    assert_stopped(1, 0);
+    assert_stopped(2, 0);
+    assert_stopped(3, 0);
+    assert_stopped(5, 1);
+    instances_wait(4);
+
+    // the rebuilt filter is subscribed again, the screen hears from both
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(1, &value, sizeof(value), portMAX_DELAY));
+    received_wait(3, 2);
+}
+
+static void test_update_rewires_once_targets_run(void)
+{
+    int value = 1;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    int tuner = module_get(2)->serial;
+
+    // same params, the text port now goes to a new uart
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3], [4]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []},"
+        "{\"id\": 4, \"type\": \"uart\", \"index\": 3, \"params\": {}, \"wires\": []}"));
+
+    TEST_ASSERT_EQUAL_INT(tuner, module_get(2)->serial);
+    TEST_ASSERT_EQUAL_INT(0, module_get(2)->cfg_updates);
+    TEST_ASSERT_EQUAL_INT(1, module_get(2)->pub_num[1]);
+    TEST_ASSERT_EQUAL_INT(4, module_get(2)->pub[1][0]);
+    assert_started(2, 1);
+    assert_started(4, 1);
+    TEST_ASSERT_EQUAL_INT(0, s_wired_to_stopped);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(1, &value, sizeof(value), portMAX_DELAY));
+    received_wait(3, 1);
+    received_wait(4, 1);
+
+    // and back, the port is cleared
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    TEST_ASSERT_EQUAL_INT(tuner, module_get(2)->serial);
+    TEST_ASSERT_EQUAL_INT(0, module_get(2)->pub_num[1]);
+    assert_stopped(4, 1);
+    instances_wait(3);
+}
+
+static void test_update_drops_removed_modules(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3], [4]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []},"
+        "{\"id\": 4, \"type\": \"uart\", \"index\": 3, \"params\": {}, \"wires\": []}"));
+
+    int filter = module_get(2)->serial;
+
+    // the filter only loses a wire, it is rewired without cfg_update; the uart goes
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+
+    instances_wait(3);
+    assert_stopped(1, 0);
+    assert_stopped(2, 0);
+    assert_stopped(3, 0);
+    assert_stopped(4, 1);
+    assert_started(2, 1);
+    TEST_ASSERT_EQUAL_INT(filter, module_get(2)->serial);
+    TEST_ASSERT_EQUAL_INT(1, module_get(2)->pub_num[0]);
+    TEST_ASSERT_EQUAL_INT(0, module_get(2)->pub_num[1]);
+
+    // a new param still needs cfg_update, the filter has none and is rebuilt
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {\"gain\": 2}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    instances_wait(3);
+    assert_stopped(2, 1);
+    assert_started(2, 2);
+    TEST_ASSERT_NOT_EQUAL(filter, module_get(2)->serial);
+}
+
+static void test_update_rebuilds_a_new_type_under_an_old_id(void)
+{
+    int value = 1;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    int filter = module_get(2)->serial;
+    int screen = module_get(3)->serial;
+
+    // same id, params and wires, but a tuner now
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"tuner\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+
+    instances_wait(3);
+    TEST_ASSERT_EQUAL_INT(filter, module_get(2)->serial);
+    TEST_ASSERT_NOT_EQUAL(screen, module_get(3)->serial);
+    TEST_ASSERT_EQUAL_INT(0, module_get(3)->cfg_updates);
+    assert_stopped(3, 1);
+    assert_started(3, 2);
+    assert_stopped(2, 0);
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_event_post(1, &value, sizeof(value), portMAX_DELAY));
+    received_wait(3, 1);
+}
+
+static void test_update_rebuilds_when_cfg_update_fails(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {\"gain\": 1}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    int tuner = module_get(2)->serial;
+
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {\"gain\": 3, \"update_fail\": true}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+
+    instances_wait(3);
+    TEST_ASSERT_NOT_EQUAL(tuner, module_get(2)->serial);
+    TEST_ASSERT_EQUAL_INT(3, module_get(2)->gain);
+    TEST_ASSERT_EQUAL_INT(0, module_get(2)->cfg_updates);
+    assert_stopped(2, 1);
+    assert_started(2, 2);
+    assert_stopped(1, 0);
+    assert_stopped(3, 0);
+}
+
+static void test_update_of_a_bad_flow_falls_back_to_a_restart(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+
+    // __update gives up with ESP_ERR_NOT_SUPPORTED, the old flow is stopped and __run reports
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_ERR_MODULE_NOT_FOUND, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"zoom\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_STRING("zoom", s_err_module);
+    xSemaphoreGive(s_lock);
+    instances_wait(0);
+    assert_stopped(1, 1);
+    assert_stopped(2, 1);
+    assert_stopped(3, 1);
+
+    // a wiring error the same way
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"screen\", \"index\": 1, \"params\": {}, \"wires\": []}"));
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_ERR_MODULES_WIRES, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"uart\", \"index\": 1, \"params\": {}, \"wires\": []}"));
+    instances_wait(0);
+
+    // and the engine takes the next flow from scratch
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"screen\", \"index\": 1, \"params\": {}, \"wires\": []}"));
+    instances_wait(2);
+}
+
+static void test_update_that_fails_to_build_stops_the_flow(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"));
+
+    // the kept modules are carried over, then a new one fails to start
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_ERR_MODULES_START, flow_run(
+        "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2]]},"
+        "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {}, \"wires\": [[3], [4]]},"
+        "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []},"
+        "{\"id\": 4, \"type\": \"uart\", \"index\": 3, \"params\": {\"start_fail\": true}, \"wires\": []}"));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_STRING("uart", s_err_module);
+    xSemaphoreGive(s_lock);
+
+    // nothing left running or instanced, every kept module stopped once
+    instances_wait(0);
+    assert_stopped(1, 1);
+    assert_stopped(2, 1);
+    assert_stopped(3, 1);
+    assert_started(4, 0);
+    TEST_ASSERT_EQUAL_INT(0, s_wired_to_stopped);
+}
+
+static volatile bool s_feed;
+
+static void feeder_task(void *p_arg)
+{
+    int value = 1;
+
+    while (s_feed)
+    {
+        tf_event_post(1, &value, sizeof(value), 0);
+        vTaskDelay(pdMS_TO_TICKS(FRAME_MS));
+    }
+    vTaskDelete(NULL);
+}
+
+static TickType_t sink_gap_across(void (*change)(void))
+{
+    TickType_t gap = 0;
+
+    vTaskDelay(pdMS_TO_TICKS(FRAME_MS * 5));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_sink_gap_max = 0;
+    xSemaphoreGive(s_lock);
+
+    change();
+    // until frames reach the sink again
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int rx = s_sink_rx;
+    xSemaphoreGive(s_lock);
+    for (int i = 0; i < 500 && s_sink_rx < rx + 5; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    gap = s_sink_gap_max;
+    xSemaphoreGive(s_lock);
+    return gap;
+}
+
+#define SLOW_FLOW(gain) \
+    "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {\"start_ms\": 400, \"stop_ms\": 200}, \"wires\": [[2]]}," \
+    "{\"id\": 2, \"type\": \"tuner\", \"index\": 1, \"params\": {\"gain\": " #gain "}, \"wires\": [[3]]}," \
+    "{\"id\": 3, \"type\": \"screen\", \"index\": 2, \"params\": {}, \"wires\": []}"
+
+static void restart_change(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, tf_engine_restart());
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, status_wait());
+}
+
+static void update_change(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(SLOW_FLOW(2)));
+}
+
+static void test_update_blind_time(void)
+{
+    TEST_ASSERT_EQUAL_INT(TF_STATUS_RUNNING, flow_run(SLOW_FLOW(1)));
+    s_feed = true;
+    xTaskCreate(feeder_task, "feeder", 4096, NULL, 5, NULL);
+
+    TickType_t restart_gap = sink_gap_across(restart_change);
+    TickType_t update_gap = sink_gap_across(update_change);
+    s_feed = false;
+
+    printf("longest gap between frames at the sink, %d ms per frame, %d ms camera start, %d ms stop\n",
+           FRAME_MS, SLOW_START_MS, SLOW_STOP_MS);
+    printf("    full restart   %4u ms\n", (unsigned)pdTICKS_TO_MS(restart_gap));
+    printf("    in place       %4u ms\n", (unsigned)pdTICKS_TO_MS(update_gap));
+
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT(pdMS_TO_TICKS(SLOW_START_MS + SLOW_STOP_MS), restart_gap);
+    TEST_ASSERT_LESS_THAN_UINT(pdMS_TO_TICKS(SLOW_START_MS / 2), update_gap);
+    vTaskDelay(pdMS_TO_TICKS(FRAME_MS * 2));
+}
+
+int main(void)
+{
+    engine_init();
+    UNITY_BEGIN();
+    RUN_TEST(test_registry_has_no_fixed_size);
+    RUN_TEST(test_flow_starts_sinks_first_and_stops_sources_first);
+    RUN_TEST(test_bad_flows_are_reported);
+    RUN_TEST(test_good_flow_runs_after_bad_one);
+    RUN_TEST(test_handler_registered_late_gets_its_type_dispatch);
+    RUN_TEST(test_update_keeps_modules_and_updates_params);
+    RUN_TEST(test_update_rewires_once_targets_run);
+    RUN_TEST(test_update_drops_removed_modules);
+    RUN_TEST(test_update_rebuilds_a_new_type_under_an_old_id);
+    RUN_TEST(test_update_rebuilds_when_cfg_update_fails);
+    RUN_TEST(test_update_of_a_bad_flow_falls_back_to_a_restart);
+    RUN_TEST(test_update_that_fails_to_build_stops_the_flow);
+    RUN_TEST(test_update_blind_time);
+    return UNITY_END();
+}
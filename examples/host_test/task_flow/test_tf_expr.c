@@ -0,0 +1,497 @@
+/*
+ * Trigger expressions of the ai camera (tf_module_expr.c): what the compiler refuses, how
+ * and / or / not nest, class names bound to a model, the score, area and count filters of a
+ * term, dwell, and which points a rectangle or polygon zone holds.
+ *
+ * Frames are made-up boxes, time is the now_us the test passes to tf_expr_eval().
+ */
+#include <string.h>
+
+#include "unity.h"
+
+#include "sscma_client_types.h"
+#include "tf_module_expr.h"
+
+#define SCORE_DEFAULT   50
+#define BOX_MAX         16
+#define SEC             1000000LL
+
+enum { PERSON = 0, DOG, CAT };
+
+static char *s_classes[] = { "person", "dog", "cat", NULL };
+
+static sscma_client_box_t s_boxes[BOX_MAX];
+static struct tf_data_inference_info s_frame;
+
+static esp_err_t compile(const char *p_str, tf_expr_t **pp_expr)
+{
+    static const struct tf_expr_zone_def defs[] = {
+        { .name = "door", .zone = { .type = TF_EXPR_ZONE_RECT, .min_x = 0, .min_y = 0, .max_x = 100, .max_y = 100 } },
+    };
+    cJSON *p_json = cJSON_Parse(p_str);
+    esp_err_t ret = ESP_OK;
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(p_json, p_str);
+    ret = tf_expr_compile(p_json, SCORE_DEFAULT, defs, 1, pp_expr);
+    cJSON_Delete(p_json);
+    if (ret == ESP_OK)
+    {
+        tf_expr_bind(*pp_expr, s_classes);
+    }
+    return ret;
+}
+
+static tf_expr_t *compiled(const char *p_str)
+{
+    tf_expr_t *p_expr = NULL;
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, compile(p_str, &p_expr), p_str);
+    return p_expr;
+}
+
+static void frame_clear(void)
+{
+    memset(&s_frame, 0, sizeof(s_frame));
+    s_frame.is_valid = true;
+    s_frame.type = INFERENCE_TYPE_BOX;
+    s_frame.p_data = s_boxes;
+}
+
+static void box_add(int target, int score, int x, int y, int w, int h)
+{
+    TEST_ASSERT_LESS_THAN(BOX_MAX, s_frame.cnt);
+    s_boxes[s_frame.cnt++] = (sscma_client_box_t){ .x = x, .y = y, .w = w, .h = h, .score = score, .target = target };
+}
+
+static bool eval(tf_expr_t *p_expr, int64_t now_us)
+{
+    return tf_expr_eval(p_expr, &s_frame, now_us);
+}
+
+static void assert_rejected(const char *p_str)
+{
+    tf_expr_t *p_expr = (tf_expr_t *)1;
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, compile(p_str, &p_expr), p_str);
+    TEST_ASSERT_NULL(p_expr);
+}
+
+/* count nots around a term */
+static void nested_not(char *p_buf, size_t size, int depth)
+{
+    int len = 0;
+
+    for (int i = 0; i < depth; i++)
+    {
+        len += snprintf(p_buf + len, size - len, "{\"not\": ");
+    }
+    len += snprintf(p_buf + len, size - len, "{\"class\": \"dog\"}");
+    for (int i = 0; i < depth; i++)
+    {
+        len += snprintf(p_buf + len, size - len, "}");
+    }
+}
+
+/* an or over num terms, each under wrap nots */
+static void wide_or(char *p_buf, size_t size, int num, bool wrap)
+{
+    int len = snprintf(p_buf, size, "{\"or\": [");
+
+    for (int i = 0; i < num; i++)
+    {
+        len += snprintf(p_buf + len, size - len, "%s%s{\"num\": %d}%s", i ? ", " : "", wrap ? "{\"not\": " : "", i, wrap ? "}" : "");
+    }
+    snprintf(p_buf + len, size - len, "]}");
+}
+
+void setUp(void)
+{
+    frame_clear();
+}
+
+void tearDown(void)
+{
+}
+
+static void test_compile_errors(void)
+{
+    char buf[1024];
+    tf_expr_t *p_expr = NULL;
+
+    // keys that are not a term's, and term keys next to a logic node
+    assert_rejected("{\"clas\": \"person\"}");
+    assert_rejected("{\"class\": \"person\", \"dwel\": 3}");
+    assert_rejected("{\"and\": [{\"class\": \"person\"}], \"class\": \"dog\"}");
+    assert_rejected("{\"not\": {\"class\": \"person\"}, \"num\": 1}");
+
+    // bad nesting
+    assert_rejected("[{\"class\": \"person\"}]");
+    assert_rejected("{\"and\": []}");
+    assert_rejected("{\"or\": {\"class\": \"person\"}}");
+    assert_rejected("{\"not\": [{\"class\": \"person\"}]}");
+    assert_rejected("{\"not\": 1}");
+    assert_rejected("{\"and\": [{\"class\": \"person\"}], \"or\": [{\"class\": \"dog\"}]}");
+    assert_rejected("{\"and\": [{\"class\": \"person\"}, 3]}");
+
+    // bad values
+    assert_rejected("{\"class\": 1}");
+    assert_rejected("{\"class\": \"a class name longer than the limit\"}");
+    assert_rejected("{\"op\": \"=~\"}");
+    assert_rejected("{\"op\": 1}");
+    assert_rejected("{\"score\": 101}");
+    assert_rejected("{\"score\": -1}");
+    assert_rejected("{\"area\": [1]}");
+    assert_rejected("{\"num\": \"1\"}");
+    assert_rejected("{\"dwell\": -1}");
+    assert_rejected("{\"zone\": \"window\"}");
+    assert_rejected("{\"zone\": [0, 0, 0, 10]}");
+    assert_rejected("{\"zone\": [[0, 0], [10, 0]]}");
+    assert_rejected("{\"zone\": [[0, 0], [10, 0], [10]]}");
+    assert_rejected("{\"zone\": [[0,0],[1,0],[2,0],[3,0],[4,1],[3,2],[2,2],[1,2],[0,1]]}");
+
+    // too deep: TF_EXPR_NEST_MAX levels above a term are the most
+    nested_not(buf, sizeof(buf), TF_EXPR_NEST_MAX - 1);
+    p_expr = compiled(buf);
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_NEST_MAX, p_expr->code_num);
+    tf_expr_free(p_expr);
+    nested_not(buf, sizeof(buf), TF_EXPR_NEST_MAX);
+    assert_rejected(buf);
+
+    // too many terms, too much code
+    wide_or(buf, sizeof(buf), TF_EXPR_TERM_MAX, false);
+    tf_expr_free(compiled(buf));
+    wide_or(buf, sizeof(buf), TF_EXPR_TERM_MAX + 1, false);
+    assert_rejected(buf);
+    wide_or(buf, sizeof(buf), TF_EXPR_CODE_MAX / 2 - 1, true);
+    tf_expr_free(compiled(buf));
+    wide_or(buf, sizeof(buf), TF_EXPR_CODE_MAX / 2, true);
+    assert_rejected(buf);
+
+    // all keys at once, and an empty term
+    tf_expr_free(compiled("{\"class\": \"dog\", \"score\": 60, \"zone\": \"door\", \"area\": [1, 0], \"op\": \">=\", \"num\": 1, \"dwell\": 0.5}"));
+    tf_expr_free(compiled("{}"));
+}
+
+static void frame_of(bool person, bool dog, bool cat)
+{
+    frame_clear();
+    if (person)
+    {
+        box_add(PERSON, 90, 10, 10, 4, 4);
+    }
+    if (dog)
+    {
+        box_add(DOG, 90, 20, 20, 4, 4);
+    }
+    if (cat)
+    {
+        box_add(CAT, 90, 30, 30, 4, 4);
+    }
+}
+
+/* what each case below must give for person a, dog b and cat c */
+static bool truth_0(bool a, bool b, bool c) { return a || (b && !c); }
+static bool truth_1(bool a, bool b, bool c) { return (a || b) && !c; }
+static bool truth_2(bool a, bool b, bool c) { return !(a && b && c); }
+static bool truth_3(bool a, bool b, bool c) { return !a && !b; }
+static bool truth_4(bool a, bool b, bool c) { return (a && b) || (b && c) || !(a || c); }
+static bool truth_5(bool a, bool b, bool c) { return c; }
+
+static void test_and_or_not_nest_as_written(void)
+{
+    static const struct {
+        const char *p_expr;
+        bool (*truth)(bool a, bool b, bool c);
+    } cases[] = {
+#define P "{\"class\": \"person\"}"
+#define D "{\"class\": \"dog\"}"
+#define C "{\"class\": \"cat\"}"
+        { "{\"or\": [" P ", {\"and\": [" D ", {\"not\": " C "}]}]}", truth_0 },
+        { "{\"and\": [{\"or\": [" P ", " D "]}, {\"not\": " C "}]}", truth_1 },
+        { "{\"not\": {\"and\": [" P ", " D ", " C "]}}", truth_2 },
+        { "{\"and\": [{\"not\": " P "}, {\"not\": " D "}]}", truth_3 },
+        { "{\"or\": [{\"and\": [" P ", " D "]}, {\"and\": [" D ", " C "]}, {\"not\": {\"or\": [" P ", " C "]}}]}", truth_4 },
+        { "{\"not\": {\"not\": " C "}}", truth_5 },
+#undef P
+#undef D
+#undef C
+    };
+
+    for (int n = 0; n < sizeof(cases) / sizeof(cases[0]); n++)
+    {
+        tf_expr_t *p_expr = compiled(cases[n].p_expr);
+
+        for (int bits = 0; bits < 8; bits++)
+        {
+            bool a = bits & 1, b = bits & 2, c = bits & 4;
+            char msg[256];
+
+            frame_of(a, b, c);
+            snprintf(msg, sizeof(msg), "%s with person %d dog %d cat %d", cases[n].p_expr, a, b, c);
+            TEST_ASSERT_EQUAL_MESSAGE(cases[n].truth(a, b, c), eval(p_expr, 0), msg);
+        }
+        tf_expr_free(p_expr);
+    }
+}
+
+static void test_classes_bind_to_the_model(void)
+{
+    static char *other_model[] = { "cat", "person", NULL };
+    static char *no_model[] = { NULL };
+    tf_expr_t *p_expr = NULL;
+    cJSON *p_json = cJSON_Parse("{\"and\": [{\"class\": \"person\"}, {\"class\": \"dog\", \"op\": \"==\", \"num\": 0}, {\"num\": 1}]}");
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_expr_compile(p_json, SCORE_DEFAULT, NULL, 0, &p_expr));
+    cJSON_Delete(p_json);
+
+    // before a model, a named class counts nothing, a term without a class everything
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_CLASS_NONE, p_expr->terms[0].class_id);
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_CLASS_ANY, p_expr->terms[2].class_id);
+    box_add(PERSON, 90, 10, 10, 4, 4);
+    box_add(CAT, 90, 20, 20, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+
+    // person 0, dog 1 in this model, the same names in every term
+    tf_expr_bind(p_expr, s_classes);
+    TEST_ASSERT_EQUAL_INT(PERSON, p_expr->terms[0].class_id);
+    TEST_ASSERT_EQUAL_INT(DOG, p_expr->terms[1].class_id);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    box_add(DOG, 90, 30, 30, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+
+    // a model with person at 1 and no dog: target 0 is a cat now, the dog never counts
+    tf_expr_bind(p_expr, other_model);
+    TEST_ASSERT_EQUAL_INT(1, p_expr->terms[0].class_id);
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_CLASS_NONE, p_expr->terms[1].class_id);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));  // box 1 is target 1
+    frame_clear();
+    box_add(0, 90, 10, 10, 4, 4);
+    box_add(0, 90, 20, 20, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+
+    tf_expr_bind(p_expr, no_model);
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_CLASS_NONE, p_expr->terms[0].class_id);
+    TEST_ASSERT_EQUAL_INT(TF_EXPR_CLASS_ANY, p_expr->terms[2].class_id);
+    tf_expr_free(p_expr);
+}
+
+static void test_score_area_and_count(void)
+{
+    static const struct {
+        const char *p_op;
+        bool at[4];  // 0, 1, 2, 3 boxes against num 2
+    } ops[] = {
+        { "<",  { true, true, false, false } },
+        { "<=", { true, true, true, false } },
+        { "==", { false, false, true, false } },
+        { "!=", { true, true, false, true } },
+        { ">=", { false, false, true, true } },
+        { ">",  { false, false, false, true } },
+    };
+    tf_expr_t *p_expr = NULL;
+    char buf[128];
+
+    for (int n = 0; n < sizeof(ops) / sizeof(ops[0]); n++)
+    {
+        snprintf(buf, sizeof(buf), "{\"class\": \"person\", \"op\": \"%s\", \"num\": 2}", ops[n].p_op);
+        p_expr = compiled(buf);
+        frame_clear();
+        for (int cnt = 0; cnt < 4; cnt++)
+        {
+            TEST_ASSERT_EQUAL_MESSAGE(ops[n].at[cnt], eval(p_expr, 0), buf);
+            box_add(PERSON, 90, 10, 10, 4, 4);
+            box_add(DOG, 90, 10, 10, 4, 4);
+        }
+        tf_expr_free(p_expr);
+    }
+
+    // the default score, and a term's own
+    frame_clear();
+    p_expr = compiled("{\"or\": [{\"class\": \"person\"}, {\"class\": \"dog\", \"score\": 80}]}");
+    TEST_ASSERT_EQUAL_INT(SCORE_DEFAULT, p_expr->terms[0].score);
+    box_add(PERSON, SCORE_DEFAULT - 1, 10, 10, 4, 4);
+    box_add(DOG, 79, 10, 10, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+    box_add(DOG, 80, 10, 10, 4, 4);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    frame_clear();
+    box_add(PERSON, SCORE_DEFAULT, 10, 10, 4, 4);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+
+    // area bounds are inclusive, max 0 has no limit
+    frame_clear();
+    p_expr = compiled("{\"area\": [100, 400], \"op\": \"==\", \"num\": 3}");
+    box_add(PERSON, 90, 10, 10, 10, 10);
+    box_add(PERSON, 90, 10, 10, 20, 20);
+    box_add(PERSON, 90, 10, 10, 5, 40);
+    box_add(PERSON, 90, 10, 10, 9, 11);
+    box_add(PERSON, 90, 10, 10, 21, 20);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+    p_expr = compiled("{\"area\": [100, 0], \"op\": \"==\", \"num\": 2}");
+    frame_clear();
+    box_add(PERSON, 90, 10, 10, 10, 10);
+    box_add(PERSON, 90, 10, 10, 480, 480);
+    box_add(PERSON, 90, 10, 10, 9, 11);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+
+    // a classification result has no boxes, zone and area terms never count it
+    static sscma_client_class_t classes[] = { { .target = PERSON, .score = 90 } };
+    p_expr = compiled("{\"or\": [{\"class\": \"person\", \"area\": [1, 0]}, {\"class\": \"person\", \"zone\": \"door\"}]}");
+    s_frame.type = INFERENCE_TYPE_CLASS;
+    s_frame.p_data = classes;
+    s_frame.cnt = 1;
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+    p_expr = compiled("{\"class\": \"person\"}");
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    s_frame.is_valid = false;
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+}
+
+static void test_dwell(void)
+{
+    tf_expr_t *p_expr = compiled("{\"and\": [{\"class\": \"person\", \"dwell\": 2}, {\"not\": {\"class\": \"dog\", \"dwell\": 0.5}}]}");
+
+    TEST_ASSERT_EQUAL_UINT32(2000, p_expr->terms[0].dwell_ms);
+    TEST_ASSERT_EQUAL_UINT32(500, p_expr->terms[1].dwell_ms);
+
+    // true once the person has been there 2 s
+    box_add(PERSON, 90, 10, 10, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 10 * SEC));
+    TEST_ASSERT_FALSE(eval(p_expr, 11 * SEC));
+    TEST_ASSERT_FALSE(eval(p_expr, 12 * SEC - 1));
+    TEST_ASSERT_TRUE(eval(p_expr, 12 * SEC));
+    TEST_ASSERT_TRUE(eval(p_expr, 20 * SEC));
+
+    // one frame without them starts it over
+    frame_clear();
+    TEST_ASSERT_FALSE(eval(p_expr, 20 * SEC + 100000));
+    box_add(PERSON, 90, 10, 10, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 21 * SEC));
+    TEST_ASSERT_FALSE(eval(p_expr, 22 * SEC + 999999));
+    TEST_ASSERT_TRUE(eval(p_expr, 23 * SEC));
+
+    // a dog for less than 0.5 s doesn't count under the not
+    box_add(DOG, 90, 20, 20, 4, 4);
+    TEST_ASSERT_TRUE(eval(p_expr, 24 * SEC));
+    TEST_ASSERT_TRUE(eval(p_expr, 24 * SEC + 499999));
+    TEST_ASSERT_FALSE(eval(p_expr, 24 * SEC + 500000));
+
+    // dwell is counted on every frame, even when another term already decides
+    frame_clear();
+    box_add(DOG, 90, 20, 20, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 25 * SEC));
+    box_add(PERSON, 90, 10, 10, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 26 * SEC));
+    frame_clear();
+    box_add(PERSON, 90, 10, 10, 4, 4);
+    TEST_ASSERT_TRUE(eval(p_expr, 28 * SEC));
+
+    // reset forgets, as after a model change
+    tf_expr_reset(p_expr);
+    TEST_ASSERT_FALSE(eval(p_expr, 29 * SEC));
+    TEST_ASSERT_TRUE(eval(p_expr, 31 * SEC));
+    tf_expr_free(p_expr);
+}
+
+static struct tf_expr_zone zone_of(const char *p_str)
+{
+    struct tf_expr_zone zone;
+    cJSON *p_json = cJSON_Parse(p_str);
+
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, tf_expr_zone_parse(p_json, &zone), p_str);
+    cJSON_Delete(p_json);
+    return zone;
+}
+
+static void assert_points(const struct tf_expr_zone *p_zone, const int (*p_points)[2], int num, bool inside)
+{
+    for (int i = 0; i < num; i++)
+    {
+        char msg[64];
+
+        snprintf(msg, sizeof(msg), "(%d, %d)", p_points[i][0], p_points[i][1]);
+        TEST_ASSERT_EQUAL_MESSAGE(inside, tf_expr_zone_contains(p_zone, p_points[i][0], p_points[i][1]), msg);
+    }
+}
+
+static void test_zone_membership(void)
+{
+    // [x, y, w, h] holds [x, x + w) and [y, y + h)
+    static const int rect_in[][2] = { { 10, 20 }, { 39, 20 }, { 10, 59 }, { 39, 59 }, { 25, 40 } };
+    static const int rect_out[][2] = { { 9, 20 }, { 40, 20 }, { 10, 19 }, { 10, 60 }, { 40, 60 }, { 0, 0 } };
+    struct tf_expr_zone rect = zone_of("[10, 20, 30, 40]");
+
+    TEST_ASSERT_EQUAL(TF_EXPR_ZONE_RECT, rect.type);
+    assert_points(&rect, rect_in, 5, true);
+    assert_points(&rect, rect_out, 6, false);
+
+    // the polygon of the same corners holds the same points
+    struct tf_expr_zone square = zone_of("[[10, 20], [40, 20], [40, 60], [10, 60]]");
+    TEST_ASSERT_EQUAL(TF_EXPR_ZONE_POLYGON, square.type);
+    for (int x = 0; x < 50; x++)
+    {
+        for (int y = 10; y < 70; y++)
+        {
+            TEST_ASSERT_EQUAL(tf_expr_zone_contains(&rect, x, y), tf_expr_zone_contains(&square, x, y));
+        }
+    }
+
+    // a triangle: the left and top edges and the corner between them are in, the rest out
+    static const int tri_in[][2] = { { 0, 0 }, { 0, 10 }, { 0, 19 }, { 10, 0 }, { 19, 0 }, { 9, 10 }, { 5, 5 } };
+    static const int tri_out[][2] = { { 20, 0 }, { 0, 20 }, { 10, 10 }, { 15, 5 }, { -1, 0 }, { 0, -1 }, { 20, 20 } };
+    struct tf_expr_zone tri = zone_of("[[0, 0], [20, 0], [0, 20]]");
+    assert_points(&tri, tri_in, 7, true);
+    assert_points(&tri, tri_out, 7, false);
+
+    // the two halves of a square share the diagonal, each of its points is in exactly one
+    struct tf_expr_zone upper = zone_of("[[0, 0], [20, 0], [0, 20]]");
+    struct tf_expr_zone lower = zone_of("[[20, 0], [20, 20], [0, 20]]");
+    struct tf_expr_zone whole = zone_of("[0, 0, 20, 20]");
+    for (int x = -2; x < 23; x++)
+    {
+        for (int y = -2; y < 23; y++)
+        {
+            bool a = tf_expr_zone_contains(&upper, x, y);
+            bool b = tf_expr_zone_contains(&lower, x, y);
+            char msg[64];
+
+            snprintf(msg, sizeof(msg), "(%d, %d)", x, y);
+            TEST_ASSERT_FALSE_MESSAGE(a && b, msg);
+            TEST_ASSERT_EQUAL_MESSAGE(tf_expr_zone_contains(&whole, x, y), a || b, msg);
+        }
+    }
+
+    // a U: the notch is out, its walls belong to the side the zone is on
+    static const int u_in[][2] = { { 5, 20 }, { 25, 20 }, { 15, 5 }, { 15, 0 }, { 20, 20 }, { 0, 29 }, { 15, 9 } };
+    static const int u_out[][2] = { { 15, 20 }, { 15, 10 }, { 10, 20 }, { 30, 20 }, { 5, 30 }, { 15, 29 } };
+    struct tf_expr_zone u = zone_of("[[0, 0], [30, 0], [30, 30], [20, 30], [20, 10], [10, 10], [10, 30], [0, 30]]");
+    assert_points(&u, u_in, 7, true);
+    assert_points(&u, u_out, 6, false);
+
+    // through a term, the box centre counts; a named zone from zone_defs the same
+    tf_expr_t *p_expr = compiled("{\"and\": [{\"zone\": [[0, 0], [20, 0], [0, 20]], \"op\": \"==\", \"num\": 2}, {\"zone\": \"door\", \"num\": 2}]}");
+    box_add(PERSON, 90, 0, 0, 40, 40);
+    box_add(DOG, 90, 9, 10, 4, 4);
+    box_add(CAT, 90, 10, 10, 4, 4);
+    TEST_ASSERT_TRUE(eval(p_expr, 0));
+    box_add(CAT, 90, 1, 1, 4, 4);
+    TEST_ASSERT_FALSE(eval(p_expr, 0));
+    tf_expr_free(p_expr);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_compile_errors);
+    RUN_TEST(test_and_or_not_nest_as_written);
+    RUN_TEST(test_classes_bind_to_the_model);
+    RUN_TEST(test_score_area_and_count);
+    RUN_TEST(test_dwell);
+    RUN_TEST(test_zone_membership);
+    return UNITY_END();
+}
@@ -0,0 +1,340 @@
+/*
+ * Memory accounting of the task flow (tf_malloc / tf_free): blocks charged to the owner their
+ * task is bound to and credited back to it whoever frees them, peaks and their reset, owners past
+ * TF_OWNER_MAX, and a block table of CONFIG_TF_MEM_TRACK_NUM entries running full.
+ *
+ * Built with a table of TRACK_NUM blocks, every test starts with an empty one.
+ */
+#include <pthread.h>
+
+#include "unity.h"
+
+#include "tf_util.c"
+
+#define TRACK_NUM       CONFIG_TF_MEM_TRACK_NUM
+#define WORKERS         4
+#define WORKER_ROUNDS   2000
+#define CHURN_ROUNDS    20000
+
+static tf_mem_stats_t stats_of(int owner)
+{
+    tf_mem_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_OK, tf_mem_stats_get(owner, &stats));
+    return stats;
+}
+
+static void assert_stats(int owner, uint32_t alloc_num, size_t cur, size_t peak)
+{
+    tf_mem_stats_t stats = stats_of(owner);
+
+    TEST_ASSERT_EQUAL_UINT32(alloc_num, stats.alloc_num);
+    TEST_ASSERT_EQUAL_size_t(cur, stats.cur_bytes);
+    TEST_ASSERT_EQUAL_size_t(peak, stats.peak_bytes);
+}
+
+static void assert_unknown(int owner)
+{
+    tf_mem_stats_t stats;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, tf_mem_stats_get(owner, &stats));
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, tf_mem_acct_init());
+}
+
+void tearDown(void)
+{
+    tf_owner_set(TF_OWNER_NONE);
+    vSemaphoreDelete(gp_acct->sem_handle);
+    free(gp_acct->p_blocks);
+    free(gp_acct);
+    gp_acct = NULL;
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_table_size(void)
+{
+    // at most half full: the next power of two at or above twice the blocks tracked
+    uint32_t size = gp_acct->block_mask + 1;
+
+    TEST_ASSERT_EQUAL_UINT32(0, size & (size - 1));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TRACK_NUM * 2, size);
+    TEST_ASSERT_LESS_THAN_UINT32(TRACK_NUM * 4, size);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, tf_mem_acct_init());
+}
+
+static void test_owner_attribution(void)
+{
+    void *p_a, *p_b, *p_c;
+    char *p_name;
+
+    TEST_ASSERT_EQUAL_INT(TF_OWNER_NONE, tf_owner_set(3));
+    p_a = tf_malloc(100);
+    p_name = tf_strdup("camera");
+    TEST_ASSERT_EQUAL_INT(3, tf_owner_set(5));
+    p_b = tf_malloc(50);
+    TEST_ASSERT_EQUAL_INT(5, tf_owner_set(TF_OWNER_NONE));
+    p_c = tf_malloc(10);
+
+    assert_stats(3, 2, 107, 107);
+    assert_stats(5, 1, 50, 50);
+    assert_stats(TF_OWNER_NONE, 1, 10, 10);
+    assert_unknown(4);
+
+    // credited back to the owner that allocated it, whoever frees it
+    tf_owner_set(5);
+    tf_free(p_a);
+    tf_free(p_name);
+    tf_owner_set(TF_OWNER_NONE);
+    tf_free(p_b);
+    assert_stats(3, 2, 0, 107);
+    assert_stats(5, 1, 0, 50);
+    assert_stats(TF_OWNER_NONE, 1, 10, 10);
+
+    tf_free(p_c);
+    tf_free(NULL);
+    assert_stats(TF_OWNER_NONE, 1, 0, 10);
+    TEST_ASSERT_EQUAL_UINT32(0, gp_acct->block_num);
+}
+
+static void test_freed_with_free(void)
+{
+    // a block released with free() is dropped once the heap hands its address out again
+    void *p_a, *p_b;
+
+    tf_owner_set(3);
+    p_a = tf_malloc(64);
+    free(p_a);
+    tf_owner_set(5);
+    p_b = tf_malloc(64);
+    if (p_b == p_a)
+    {
+        assert_stats(3, 1, 0, 64);
+        TEST_ASSERT_EQUAL_UINT32(1, gp_acct->block_num);
+    }
+    assert_stats(5, 1, 64, 64);
+    tf_free(p_b);
+}
+
+typedef struct {
+    int owner;
+    size_t size;
+} worker_t;
+
+static void *worker(void *p_arg)
+{
+    worker_t *p_worker = p_arg;
+    void *p_held[8] = { 0 };
+
+    tf_owner_set(p_worker->owner);
+    for (int i = 0; i < WORKER_ROUNDS; i++)
+    {
+        tf_free(p_held[i % 8]);
+        p_held[i % 8] = tf_malloc(p_worker->size);
+    }
+    // keep the last four
+    for (int i = 0; i < 4; i++)
+    {
+        tf_free(p_held[i]);
+    }
+    return NULL;
+}
+
+static void test_tasks_bound_to_owners(void)
+{
+    pthread_t threads[WORKERS];
+    worker_t workers[WORKERS];
+    void *p_main;
+
+    tf_owner_set(1);
+    p_main = tf_malloc(1000);
+    for (int i = 0; i < WORKERS; i++)
+    {
+        workers[i].owner = 10 + i;
+        workers[i].size = 16 * (i + 1);
+        pthread_create(&threads[i], NULL, worker, &workers[i]);
+    }
+    for (int i = 0; i < WORKERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    // every task charged its own owner, the binding of the main task untouched
+    for (int i = 0; i < WORKERS; i++)
+    {
+        assert_stats(workers[i].owner, WORKER_ROUNDS, 4 * workers[i].size, 8 * workers[i].size);
+    }
+    assert_stats(1, 1, 1000, 1000);
+    TEST_ASSERT_EQUAL_INT(1, tf_owner_set(TF_OWNER_NONE));
+    tf_free(p_main);
+}
+
+static void test_peak_and_reset(void)
+{
+    void *p_a, *p_b, *p_c;
+
+    tf_owner_set(7);
+    p_a = tf_malloc(100);
+    p_b = tf_malloc(200);
+    tf_free(p_b);
+    p_b = tf_malloc(50);
+    assert_stats(7, 3, 150, 300);
+
+    // the peak starts again from what is held, the count from 0
+    tf_mem_stats_reset();
+    assert_stats(7, 0, 150, 150);
+    p_c = tf_malloc(20);
+    assert_stats(7, 1, 170, 170);
+    tf_free(p_a);
+    assert_stats(7, 1, 70, 170);
+
+    // owners holding nothing are forgotten, TF_OWNER_NONE stays
+    tf_owner_set(8);
+    tf_free(tf_malloc(10));
+    assert_stats(8, 1, 0, 10);
+    tf_mem_stats_reset();
+    assert_unknown(8);
+    assert_stats(7, 0, 70, 70);
+    assert_stats(TF_OWNER_NONE, 0, 0, 0);
+
+    tf_free(p_b);
+    tf_free(p_c);
+    tf_mem_stats_reset();
+    assert_unknown(7);
+}
+
+static void test_owners_past_the_limit(void)
+{
+    void *p_blocks[TF_OWNER_MAX + 2];
+
+    for (int i = 0; i < TF_OWNER_MAX + 2; i++)
+    {
+        tf_owner_set(100 + i);
+        p_blocks[i] = tf_malloc(8);
+    }
+    for (int i = 0; i < TF_OWNER_MAX; i++)
+    {
+        assert_stats(100 + i, 1, 8, 8);
+    }
+    // the owners that didn't fit count as TF_OWNER_NONE
+    assert_unknown(100 + TF_OWNER_MAX);
+    assert_unknown(100 + TF_OWNER_MAX + 1);
+    assert_stats(TF_OWNER_NONE, 2, 16, 16);
+
+    // a slot freed by a reset is taken by the next owner
+    tf_free(p_blocks[0]);
+    tf_mem_stats_reset();
+    assert_unknown(100);
+    tf_owner_set(200);
+    p_blocks[0] = tf_malloc(4);
+    assert_stats(200, 1, 4, 4);
+
+    for (int i = 0; i < TF_OWNER_MAX + 2; i++)
+    {
+        tf_free(p_blocks[i]);
+    }
+}
+
+static void test_table_full(void)
+{
+    void *p_tracked[TRACK_NUM];
+    void *p_over[3];
+    void *p_more;
+
+    tf_owner_set(2);
+    for (int i = 0; i < TRACK_NUM; i++)
+    {
+        p_tracked[i] = tf_malloc(10);
+    }
+    // past the limit the blocks are handed out, not counted
+    for (int i = 0; i < 3; i++)
+    {
+        p_over[i] = tf_malloc(1000);
+        TEST_ASSERT_NOT_NULL(p_over[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TRACK_NUM, gp_acct->block_num);
+    TEST_ASSERT_EQUAL_UINT32(3, gp_acct->untracked);
+    assert_stats(2, TRACK_NUM, TRACK_NUM * 10, TRACK_NUM * 10);
+
+    // freeing one the table doesn't know changes nothing
+    tf_free(p_over[0]);
+    assert_stats(2, TRACK_NUM, TRACK_NUM * 10, TRACK_NUM * 10);
+
+    // a free entry is used again
+    tf_free(p_tracked[0]);
+    p_more = tf_malloc(30);
+    assert_stats(2, TRACK_NUM + 1, TRACK_NUM * 10 + 20, TRACK_NUM * 10 + 20);
+
+    tf_free(p_more);
+    tf_free(p_over[1]);
+    tf_free(p_over[2]);
+    for (int i = 1; i < TRACK_NUM; i++)
+    {
+        tf_free(p_tracked[i]);
+    }
+    assert_stats(2, TRACK_NUM + 1, 0, TRACK_NUM * 10 + 20);
+    TEST_ASSERT_EQUAL_UINT32(0, gp_acct->block_num);
+}
+
+static void test_table_churn(void)
+{
+    // random frees in the middle of probe runs, the table against a plain list of what is held
+    void *p_held[TRACK_NUM] = { 0 };
+    size_t sizes[TRACK_NUM] = { 0 };
+    size_t cur = 0;
+    uint32_t held = 0;
+
+    srandom(39);
+    tf_owner_set(4);
+    for (int round = 0; round < CHURN_ROUNDS; round++)
+    {
+        int i = random() % TRACK_NUM;
+        if (p_held[i])
+        {
+            tf_free(p_held[i]);
+            cur -= sizes[i];
+            held--;
+            p_held[i] = NULL;
+        }
+        else
+        {
+            sizes[i] = 1 + random() % 256;
+            p_held[i] = tf_malloc(sizes[i]);
+            cur += sizes[i];
+            held++;
+        }
+        TEST_ASSERT_EQUAL_size_t(cur, stats_of(4).cur_bytes);
+        TEST_ASSERT_EQUAL_UINT32(held, gp_acct->block_num);
+    }
+    for (int i = 0; i < TRACK_NUM; i++)
+    {
+        if (p_held[i])
+        {
+            uint32_t j = __block_probe(gp_acct, p_held[i]);
+            TEST_ASSERT_EQUAL_PTR(p_held[i], gp_acct->p_blocks[j].ptr);
+            TEST_ASSERT_EQUAL_UINT32(sizes[i], gp_acct->p_blocks[j].size);
+            tf_free(p_held[i]);
+        }
+    }
+    TEST_ASSERT_EQUAL_size_t(0, stats_of(4).cur_bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, gp_acct->untracked);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_table_size);
+    RUN_TEST(test_owner_attribution);
+    RUN_TEST(test_freed_with_free);
+    RUN_TEST(test_tasks_bound_to_owners);
+    RUN_TEST(test_peak_and_reset);
+    RUN_TEST(test_owners_past_the_limit);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_table_churn);
+    return UNITY_END();
+}
@@ -0,0 +1,356 @@
+/*
+ * Flow compile of the task flow engine (tf_parse_flow_compile): duplicate ids, missing targets,
+ * self and double wires, data type checks, cycles, and the start order of the compiled array with
+ * "index" breaking ties inside a level.
+ *
+ * Flows are parsed from JSON as the engine does, the module types' data types are filled in by
+ * hand from the table below instead of the registry.
+ */
+#include "unity.h"
+
+#include "tf_parse.h"
+#include "tf_util.h"
+
+#define TYPE_IMG    TF_DATA_TYPE_MASK(1)
+#define TYPE_TEXT   TF_DATA_TYPE_MASK(2)
+
+#define FLOW_LEN_MAX    (64 * 1024)
+#define RANDOM_MODULES  200
+
+typedef struct {
+    const char *p_name;
+    tf_module_io_t io;
+} module_type_t;
+
+// "plain" declares nothing, every wire to and from it passes the type check
+static const module_type_t s_types[] = {
+    { "camera", { .input_types = 0, .output_port_num = 1, .output_types = { TYPE_IMG } } },
+    { "filter", { .input_types = TYPE_IMG, .output_port_num = 2, .output_types = { TYPE_IMG, TYPE_TEXT } } },
+    { "screen", { .input_types = TYPE_IMG | TYPE_TEXT, .output_port_num = 0 } },
+    { "uart", { .input_types = TYPE_TEXT, .output_port_num = 0 } },
+};
+
+static char s_flow[FLOW_LEN_MAX];
+static int s_flow_len;
+static cJSON *s_root;
+static tf_module_item_t *s_head;
+static int s_num;
+static const char *s_err_module;
+
+static void flow_begin(void)
+{
+    s_flow_len = snprintf(s_flow, sizeof(s_flow), "{\"tlid\": 1, \"ctd\": 1, \"tn\": \"test\", \"type\": 0, \"task_flow\": [");
+}
+
+/* add a module, wires is the JSON of its wires array, e.g. "[[2, 3], [4]]" */
+static void flow_module(int id, const char *p_type, const char *p_wires)
+{
+    s_flow_len += snprintf(s_flow + s_flow_len, sizeof(s_flow) - s_flow_len,
+                           "%s{\"id\": %d, \"type\": \"%s\", \"index\": 0, \"params\": {}, \"wires\": %s}",
+                           s_flow[s_flow_len - 1] == '[' ? "" : ", ", id, p_type, p_wires);
+    TEST_ASSERT_LESS_THAN(sizeof(s_flow), s_flow_len);
+}
+
+static void flow_end(void)
+{
+    s_flow_len += snprintf(s_flow + s_flow_len, sizeof(s_flow) - s_flow_len, "]}");
+    TEST_ASSERT_LESS_THAN(sizeof(s_flow), s_flow_len);
+}
+
+/* parse and compile the flow built so far, as __run() does after looking up the module types */
+static int compile(void)
+{
+    tf_info_t info;
+
+    flow_end();
+    s_num = tf_parse_json_with_length(s_flow, s_flow_len, &s_root, &s_head, &info);
+    TEST_ASSERT_GREATER_THAN_MESSAGE(0, s_num, s_flow);
+    for (int i = 0; i < s_num; i++)
+    {
+        for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++)
+        {
+            if (strcmp(s_head[i].p_name, s_types[t].p_name) == 0)
+            {
+                s_head[i].p_io = &s_types[t].io;
+            }
+        }
+    }
+    return tf_parse_flow_compile(s_head, s_num, &s_err_module);
+}
+
+static tf_module_item_t *module_find(int id)
+{
+    for (int i = 0; i < s_num; i++)
+    {
+        if (s_head[i].id == id)
+        {
+            return &s_head[i];
+        }
+    }
+    TEST_FAIL_MESSAGE("module missing after compile");
+    return NULL;
+}
+
+/* every module comes after the modules it feeds, and every wire points at its target */
+static void assert_compiled(void)
+{
+    for (int i = 0; i < s_num; i++)
+    {
+        for (int m = 0; m < s_head[i].output_port_num; m++)
+        {
+            struct tf_module_wires *p_wires = &s_head[i].p_wires[m];
+            for (int n = 0; n < p_wires->num; n++)
+            {
+                int dst = p_wires->p_dst_index[n];
+                TEST_ASSERT_TRUE(dst >= 0 && dst < s_num);
+                TEST_ASSERT_EQUAL_INT(p_wires->p_evt_id[n], s_head[dst].id);
+                TEST_ASSERT_LESS_THAN_INT(i, dst);
+            }
+        }
+    }
+}
+
+void setUp(void)
+{
+    s_root = NULL;
+    s_head = NULL;
+    s_num = 0;
+    s_err_module = NULL;
+    flow_begin();
+}
+
+void tearDown(void)
+{
+    tf_parse_free(s_root, s_head, s_num);
+}
+
+static void test_flow_compiles_sinks_first(void)
+{
+    // listed sources first, as the cloud sends them
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[3], [3, 4]]");
+    flow_module(3, "screen", "[]");
+    flow_module(4, "uart", "[]");
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    TEST_ASSERT_NULL(s_err_module);
+    assert_compiled();
+    TEST_ASSERT_EQUAL_INT(1, s_head[s_num - 1].id);
+    TEST_ASSERT_EQUAL_INT(2, s_head[s_num - 2].id);
+
+    // the same target on two ports is fine, one per port
+    TEST_ASSERT_EQUAL_INT(1, module_find(2)->p_wires[0].num);
+    TEST_ASSERT_EQUAL_INT(2, module_find(2)->p_wires[1].num);
+}
+
+static void test_order_ignores_json_order_and_index(void)
+{
+    // a diamond listed backwards, with "index" saying the opposite of the wires: the wires win
+    s_flow_len = snprintf(s_flow, sizeof(s_flow), "{\"tlid\": 1, \"ctd\": 1, \"tn\": \"test\", \"type\": 0, \"task_flow\": ["
+                          "{\"id\": 40, \"type\": \"screen\", \"index\": 0, \"params\": {}, \"wires\": []},"
+                          "{\"id\": 30, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[40]]},"
+                          "{\"id\": 20, \"type\": \"filter\", \"index\": 2, \"params\": {}, \"wires\": [[40]]},"
+                          "{\"id\": 10, \"type\": \"camera\", \"index\": 3, \"params\": {}, \"wires\": [[20, 30]]}");
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    assert_compiled();
+    TEST_ASSERT_EQUAL_INT(40, s_head[0].id);
+    TEST_ASSERT_EQUAL_INT(10, s_head[3].id);
+}
+
+static void test_index_orders_a_level(void)
+{
+    // three sinks and two filters, each pair at one depth: inside a level the higher index starts
+    // first, as the old sort on "index" had it, whatever the JSON order
+    s_flow_len = snprintf(s_flow, sizeof(s_flow), "{\"tlid\": 1, \"ctd\": 1, \"tn\": \"test\", \"type\": 0, \"task_flow\": ["
+                          "{\"id\": 1, \"type\": \"camera\", \"index\": 0, \"params\": {}, \"wires\": [[2, 3]]},"
+                          "{\"id\": 2, \"type\": \"filter\", \"index\": 1, \"params\": {}, \"wires\": [[4], [5]]},"
+                          "{\"id\": 3, \"type\": \"filter\", \"index\": 2, \"params\": {}, \"wires\": [[6]]},"
+                          "{\"id\": 4, \"type\": \"screen\", \"index\": 5, \"params\": {}, \"wires\": []},"
+                          "{\"id\": 5, \"type\": \"uart\", \"index\": 3, \"params\": {}, \"wires\": []},"
+                          "{\"id\": 6, \"type\": \"screen\", \"index\": 4, \"params\": {}, \"wires\": []}");
+    const int want[] = { 4, 6, 5, 3, 2, 1 };
+
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    assert_compiled();
+    for (int i = 0; i < s_num; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(want[i], s_head[i].id);
+    }
+}
+
+static void test_random_dags_compile(void)
+{
+    int rank[RANDOM_MODULES];
+    char wires[256];
+
+    srand(32);
+    for (int round = 0; round < 20; round++)
+    {
+        setUp();
+        // ids in random order, wires only go from a lower to a higher rank
+        for (int i = 0; i < RANDOM_MODULES; i++)
+        {
+            rank[i] = i;
+        }
+        for (int i = RANDOM_MODULES - 1; i > 0; i--)
+        {
+            int j = rand() % (i + 1);
+            int t = rank[i];
+            rank[i] = rank[j];
+            rank[j] = t;
+        }
+        for (int i = 0; i < RANDOM_MODULES; i++)
+        {
+            int len = snprintf(wires, sizeof(wires), "[");
+            int fanout = i + 1 < RANDOM_MODULES ? rand() % 4 : 0;
+            for (int k = 0; k < fanout; k++)
+            {
+                int to = i + 1 + rand() % (RANDOM_MODULES - i - 1);
+                len += snprintf(wires + len, sizeof(wires) - len, "%s%d", k ? "], [" : "[", 1000 + rank[to]);
+            }
+            snprintf(wires + len, sizeof(wires) - len, "%s]", fanout ? "]" : "");
+            flow_module(1000 + rank[i], "plain", wires);
+        }
+        TEST_ASSERT_EQUAL(ESP_OK, compile());
+        assert_compiled();
+        tearDown();
+    }
+    setUp();
+}
+
+static void test_duplicate_id_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "screen", "[]");
+    flow_module(2, "uart", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("uart", s_err_module);
+}
+
+static void test_missing_target_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2, 7]]");
+    flow_module(2, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, compile());
+    TEST_ASSERT_EQUAL_STRING("camera", s_err_module);
+}
+
+static void test_self_wire_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "plain", "[[3, 2]]");
+    flow_module(3, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, compile());
+    TEST_ASSERT_EQUAL_STRING("plain", s_err_module);
+}
+
+static void test_double_wire_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[3], [4, 3, 4]]");
+    flow_module(3, "screen", "[]");
+    flow_module(4, "uart", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("filter", s_err_module);
+}
+
+static void test_type_mismatch_is_rejected(void)
+{
+    // the camera publishes images, the uart takes text only
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "uart", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("camera", s_err_module);
+}
+
+static void test_port_types_are_checked_per_port(void)
+{
+    // port 1 of the filter publishes text, a uart may hang there but not on port 0
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[4], [3]]");
+    flow_module(3, "uart", "[]");
+    flow_module(4, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    assert_compiled();
+
+    tearDown();
+    setUp();
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[3], [4]]");
+    flow_module(3, "uart", "[]");
+    flow_module(4, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("filter", s_err_module);
+}
+
+static void test_wire_into_source_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[1]]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("filter", s_err_module);
+}
+
+static void test_extra_port_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2], [3]]");
+    flow_module(2, "screen", "[]");
+    flow_module(3, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, compile());
+    TEST_ASSERT_EQUAL_STRING("camera", s_err_module);
+}
+
+static void test_undeclared_types_pass(void)
+{
+    // "plain" declares nothing, its wires are only checked for targets
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "plain", "[[3], [4]]");
+    flow_module(3, "uart", "[]");
+    flow_module(4, "plain", "[]");
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    assert_compiled();
+}
+
+static void test_cycle_is_rejected(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "plain", "[[3]]");
+    flow_module(3, "filter", "[[4]]");
+    flow_module(4, "plain", "[[2]]");
+    flow_module(5, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, compile());
+    // one of the modules on the cycle is named
+    TEST_ASSERT_NOT_NULL(s_err_module);
+    TEST_ASSERT_TRUE(strcmp(s_err_module, "plain") == 0 || strcmp(s_err_module, "filter") == 0);
+}
+
+static void test_compile_again_after_update(void)
+{
+    flow_module(1, "camera", "[[2]]");
+    flow_module(2, "filter", "[[3]]");
+    flow_module(3, "screen", "[]");
+    TEST_ASSERT_EQUAL(ESP_OK, compile());
+    // compiling the compiled array again keeps it valid, as a restart of the flow does
+    TEST_ASSERT_EQUAL(ESP_OK, tf_parse_flow_compile(s_head, s_num, &s_err_module));
+    assert_compiled();
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_flow_compiles_sinks_first);
+    RUN_TEST(test_order_ignores_json_order_and_index);
+    RUN_TEST(test_index_orders_a_level);
+    RUN_TEST(test_random_dags_compile);
+    RUN_TEST(test_duplicate_id_is_rejected);
+    RUN_TEST(test_missing_target_is_rejected);
+    RUN_TEST(test_self_wire_is_rejected);
+    RUN_TEST(test_double_wire_is_rejected);
+    RUN_TEST(test_type_mismatch_is_rejected);
+    RUN_TEST(test_port_types_are_checked_per_port);
+    RUN_TEST(test_wire_into_source_is_rejected);
+    RUN_TEST(test_extra_port_is_rejected);
+    RUN_TEST(test_undeclared_types_pass);
+    RUN_TEST(test_cycle_is_rejected);
+    RUN_TEST(test_compile_again_after_update);
+    return UNITY_END();
+}
@@ -0,0 +1,668 @@
+/*
+ * uart alarm module: the packets it streams to the uart, binary and JSON, against golden frames
+ * and against a decoder of the format in tf_module_uart_alarm.h. Every inference type, images
+ * in and out, and fields far larger than the 128 byte stage buffer of the writer. New params
+ * through cfg_update show in the next packet.
+ *
+ * The module's event handler is called directly with the data its parent would post; the uart
+ * under it records every write.
+ */
+#include "unity.h"
+
+#include "host_test.h"
+#include "tf_module_uart_alarm.c"
+
+#define WRITES_MAX      256
+#define BIG_LEN         20000
+#define SMALL_LEN       3000
+
+typedef struct {
+    const void *p_src;
+    size_t len;
+} write_t;
+
+static uint8_t *s_out;
+static size_t s_out_len;
+static size_t s_out_size;
+static write_t s_writes[WRITES_MAX];
+static int s_writes_num;
+static const char *s_flow_name = "flow name";
+
+static const char B64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*************************************************************************
+ * What the module links against
+ ************************************************************************/
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size)
+{
+    TEST_ASSERT_EQUAL(UART_NUM_2, uart_num);
+    TEST_ASSERT_GREATER_THAN_size_t(0, size);
+    if (s_out_len + size > s_out_size)
+    {
+        s_out_size = (s_out_len + size) * 2;
+        s_out = realloc(s_out, s_out_size);
+    }
+    memcpy(s_out + s_out_len, src, size);
+    s_out_len += size;
+    TEST_ASSERT_LESS_THAN_INT(WRITES_MAX, s_writes_num);
+    s_writes[s_writes_num].p_src = src;
+    s_writes[s_writes_num].len = size;
+    s_writes_num++;
+    return size;
+}
+
+esp_err_t tf_engine_info_get(tf_info_t *p_info)
+{
+    memset(p_info, 0, sizeof(*p_info));
+    p_info->p_tf_name = s_flow_name ? tf_strdup(s_flow_name) : NULL;
+    return ESP_OK;
+}
+
+esp_err_t tf_event_handler_register(int32_t event_id, esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_event_handler_unregister(int32_t event_id, esp_event_handler_t event_handler)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_module_register(const char *p_name, const char *p_desc, const char *p_version,
+                             tf_module_mgmt_t *mgmt_handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t tf_module_io_set(const char *p_name, const tf_module_io_t *p_io)
+{
+    return ESP_OK;
+}
+
+/*************************************************************************
+ * Helpers
+ ************************************************************************/
+static tf_module_uart_alarm_t *module_new(const char *p_params)
+{
+    tf_module_t *p_module = tf_module_uart_alarm_instance();
+    cJSON *p_json = cJSON_Parse(p_params);
+
+    TEST_ASSERT_NOT_NULL(p_module);
+    TEST_ASSERT_NOT_NULL(p_json);
+    TEST_ASSERT_EQUAL(0, p_module->ops->cfg(p_module->p_module, p_json));
+    cJSON_Delete(p_json);
+    return (tf_module_uart_alarm_t *)p_module->p_module;
+}
+
+static void module_delete(tf_module_uart_alarm_t *p_ins)
+{
+    p_ins->module_base.ops->stop(p_ins);
+    tf_module_uart_alarm_destroy(&p_ins->module_base);
+}
+
+static uint8_t image_byte(int seed, size_t i)
+{
+    return B64[(i * 7 + seed) % 64];
+}
+
+static void image_fill(struct tf_data_image *p_img, int seed, size_t len)
+{
+    p_img->p_buf = tf_malloc(len);
+    p_img->len = len;
+    for (size_t i = 0; i < len; i++)
+    {
+        p_img->p_buf[i] = image_byte(seed, i);
+    }
+}
+
+static sscma_client_box_t box_at(int i)
+{
+    sscma_client_box_t b = { .x = 100 + i, .y = 0x0200 + i, .w = 30 + i, .h = 0x0140 + i, .score = 50 + i, .target = i % 3 };
+    return b;
+}
+
+static sscma_client_class_t class_at(int i)
+{
+    sscma_client_class_t c = { .target = i % 5, .score = 90 - i };
+    return c;
+}
+
+static void name_at(char *p_buf, size_t size, int i)
+{
+    snprintf(p_buf, size, "class %d", i);
+}
+
+/* an alarm as the parent posts it, images of big_len and small_len bytes (0: none), cnt results */
+static tf_data_dualimage_with_audio_text_t *data_new(size_t big_len, size_t small_len, int type, int cnt, int names)
+{
+    tf_data_dualimage_with_audio_text_t *p_data = calloc(1, sizeof(*p_data));
+
+    p_data->type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT;
+    if (big_len)
+    {
+        image_fill(&p_data->img_large, 1, big_len);
+    }
+    if (small_len)
+    {
+        image_fill(&p_data->img_small, 2, small_len);
+    }
+    if (type < 0)
+    {
+        return p_data;
+    }
+
+    p_data->inference.is_valid = true;
+    p_data->inference.type = type;
+    p_data->inference.cnt = cnt;
+    if (type == INFERENCE_TYPE_BOX)
+    {
+        sscma_client_box_t *p_boxes = tf_malloc(cnt * sizeof(*p_boxes) + 1);
+        for (int i = 0; i < cnt; i++)
+        {
+            p_boxes[i] = box_at(i);
+        }
+        p_data->inference.p_data = p_boxes;
+    }
+    else if (type == INFERENCE_TYPE_CLASS)
+    {
+        sscma_client_class_t *p_classes = tf_malloc(cnt * sizeof(*p_classes) + 1);
+        for (int i = 0; i < cnt; i++)
+        {
+            p_classes[i] = class_at(i);
+        }
+        p_data->inference.p_data = p_classes;
+    }
+    for (int i = 0; i < names; i++)
+    {
+        char name[32];
+        name_at(name, sizeof(name), i);
+        p_data->inference.classes[i] = tf_strdup(name);
+    }
+    return p_data;
+}
+
+/* the handler frees the data, the caller keeps what it needs beforehand */
+static void alarm(tf_module_uart_alarm_t *p_ins, tf_data_dualimage_with_audio_text_t *p_data)
+{
+    s_out_len = 0;
+    s_writes_num = 0;
+    __event_handler(p_ins, NULL, 0, p_data);
+    free(p_data);
+}
+
+static void assert_out(const void *p_want, size_t len)
+{
+    TEST_ASSERT_EQUAL_size_t(len, s_out_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(p_want, s_out, len);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+typedef struct {
+    const char *p_prompt;
+    size_t big_len;           // as it is in the packet
+    size_t small_len;
+    int type;                 // -1: no inference
+    int cnt;
+    int names;
+} want_t;
+
+/* walk a binary packet as a reader of tf_module_uart_alarm.h does */
+static void binary_check(const want_t *p_want)
+{
+    const uint8_t *p = s_out;
+    const uint8_t *p_end = s_out + s_out_len;
+    size_t len;
+
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(5 + 4 + 4 + 4 + 1, s_out_len);
+    TEST_ASSERT_EQUAL_MEMORY(PKT_MAGIC_HEADER, p, 5);
+    p += 5;
+    len = get_u32(p);
+    p += 4;
+    TEST_ASSERT_EQUAL_size_t(strlen(p_want->p_prompt), len);
+    TEST_ASSERT_EQUAL_STRING_LEN(p_want->p_prompt, (const char *)p, len);
+    p += len;
+
+    len = get_u32(p);
+    p += 4;
+    TEST_ASSERT_EQUAL_size_t(p_want->big_len, len);
+    for (size_t i = 0; i < len; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(image_byte(1, i), p[i]);
+    }
+    p += len;
+    len = get_u32(p);
+    p += 4;
+    TEST_ASSERT_EQUAL_size_t(p_want->small_len, len);
+    for (size_t i = 0; i < len; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(image_byte(2, i), p[i]);
+    }
+    p += len;
+
+    uint8_t type = *p++;
+    if (p_want->type < 0)
+    {
+        TEST_ASSERT_EQUAL_UINT8(0, type);
+        TEST_ASSERT_EQUAL_PTR(p_end, p);
+        return;
+    }
+
+    uint32_t cnt = get_u32(p);
+    p += 4;
+    if (p_want->type == INFERENCE_TYPE_BOX)
+    {
+        TEST_ASSERT_EQUAL_UINT8(1, type);
+        TEST_ASSERT_EQUAL_UINT32(p_want->cnt, cnt);
+        for (uint32_t i = 0; i < cnt; i++, p += 10)
+        {
+            sscma_client_box_t b = box_at(i);
+            TEST_ASSERT_EQUAL_UINT16(b.x, p[0] | p[1] << 8);
+            TEST_ASSERT_EQUAL_UINT16(b.y, p[2] | p[3] << 8);
+            TEST_ASSERT_EQUAL_UINT16(b.w, p[4] | p[5] << 8);
+            TEST_ASSERT_EQUAL_UINT16(b.h, p[6] | p[7] << 8);
+            TEST_ASSERT_EQUAL_UINT8(b.score, p[8]);
+            TEST_ASSERT_EQUAL_UINT8(b.target, p[9]);
+        }
+    }
+    else if (p_want->type == INFERENCE_TYPE_CLASS)
+    {
+        TEST_ASSERT_EQUAL_UINT8(2, type);
+        TEST_ASSERT_EQUAL_UINT32(p_want->cnt, cnt);
+        for (uint32_t i = 0; i < cnt; i++, p += 2)
+        {
+            sscma_client_class_t c = class_at(i);
+            TEST_ASSERT_EQUAL_UINT8(c.score, p[0]);
+            TEST_ASSERT_EQUAL_UINT8(c.target, p[1]);
+        }
+    }
+    else
+    {
+        TEST_ASSERT_EQUAL_UINT8(3, type);
+        TEST_ASSERT_EQUAL_UINT32(0, cnt);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(p_want->names, get_u32(p));
+    p += 4;
+    for (int i = 0; i < p_want->names; i++)
+    {
+        char name[32];
+        name_at(name, sizeof(name), i);
+        TEST_ASSERT_EQUAL_STRING(name, (const char *)p);
+        p += strlen(name) + 1;
+    }
+    TEST_ASSERT_EQUAL_PTR(p_end, p);
+}
+
+static char *image_string(int seed, size_t len)
+{
+    char *p_str = malloc(len + 1);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        p_str[i] = image_byte(seed, i);
+    }
+    p_str[len] = '\0';
+    return p_str;
+}
+
+/* the whole object printed by cJSON, as the module did before it streamed the images */
+static void json_check(const want_t *p_want)
+{
+    cJSON *json = cJSON_CreateObject();
+    char *p_big = image_string(1, p_want->big_len);
+    char *p_small = image_string(2, p_want->small_len);
+
+    cJSON_AddItemToObject(json, "prompt", cJSON_CreateString(p_want->p_prompt));
+    if (p_want->big_len)
+    {
+        cJSON_AddItemToObject(json, "big_image", cJSON_CreateString(p_big));
+    }
+    if (p_want->small_len)
+    {
+        cJSON_AddItemToObject(json, "small_image", cJSON_CreateString(p_small));
+    }
+    if (p_want->type >= 0)
+    {
+        cJSON *inference = cJSON_AddObjectToObject(json, "inference");
+        if (p_want->type == INFERENCE_TYPE_BOX)
+        {
+            cJSON *boxes = cJSON_AddArrayToObject(inference, "boxes");
+            for (int i = 0; i < p_want->cnt; i++)
+            {
+                sscma_client_box_t b = box_at(i);
+                int v[6] = { b.x, b.y, b.w, b.h, b.score, b.target };
+                cJSON_AddItemToArray(boxes, cJSON_CreateIntArray(v, 6));
+            }
+        }
+        else if (p_want->type == INFERENCE_TYPE_CLASS)
+        {
+            cJSON *classes = cJSON_AddArrayToObject(inference, "classes");
+            for (int i = 0; i < p_want->cnt; i++)
+            {
+                sscma_client_class_t c = class_at(i);
+                int v[2] = { c.score, c.target };
+                cJSON_AddItemToArray(classes, cJSON_CreateIntArray(v, 2));
+            }
+        }
+        cJSON *names = cJSON_AddArrayToObject(inference, "classes_name");
+        for (int i = 0; i < p_want->names; i++)
+        {
+            char name[32];
+            name_at(name, sizeof(name), i);
+            cJSON_AddItemToArray(names, cJSON_CreateString(name));
+        }
+    }
+
+    char *p_str = cJSON_PrintUnformatted(json);
+    size_t len = strlen(p_str);
+    TEST_ASSERT_EQUAL_size_t(len + 2, s_out_len);
+    TEST_ASSERT_EQUAL_MEMORY(p_str, s_out, len);
+    TEST_ASSERT_EQUAL_MEMORY("\r\n", s_out + len, 2);
+
+    free(p_str);
+    free(p_big);
+    free(p_small);
+    cJSON_Delete(json);
+}
+
+/*
+ * short fields go out through the stage buffer, long ones in one write from where they are:
+ * each of p_direct exactly once, and at most printed more from buffers the module prints into
+ */
+static void writes_check(const void *const *p_direct, int direct_num, int printed)
+{
+    int direct = 0;
+    int others = 0;
+
+    for (int i = 0; i < s_writes_num; i++)
+    {
+        bool is_direct = false;
+        for (int d = 0; d < direct_num; d++)
+        {
+            is_direct |= s_writes[i].p_src == p_direct[d];
+        }
+        if (is_direct)
+        {
+            direct++;
+            TEST_ASSERT_GREATER_OR_EQUAL_size_t(UART_ALARM_STAGE_SIZE, s_writes[i].len);
+        }
+        else if (s_writes[i].len > UART_ALARM_STAGE_SIZE)
+        {
+            others++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(direct_num, direct);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(printed, others);
+}
+
+void setUp(void)
+{
+    s_flow_name = "flow name";
+    s_out_len = 0;
+    s_writes_num = 0;
+}
+
+void tearDown(void)
+{
+}
+
+/*************************************************************************
+ * Tests
+ ************************************************************************/
+static void test_binary_golden(void)
+{
+    tf_module_uart_alarm_t *p_ins = module_new("{\"output_format\":0,\"text\":\"cat\"}");
+    tf_data_dualimage_with_audio_text_t *p_data;
+
+    // no inference, no images
+    const uint8_t none[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    alarm(p_ins, data_new(4, 4, -1, 0, 0));
+    assert_out(none, sizeof(none));
+
+    // one box, two class names
+    const uint8_t box[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0,
+                            1, 1, 0, 0, 0, 0x02, 0x01, 0x04, 0x03, 0x06, 0x05, 0x08, 0x07, 0x55, 0x02,
+                            2, 0, 0, 0, 'c', 'a', 't', 0, 'd', 'o', 'g', 0 };
+    p_data = data_new(0, 0, INFERENCE_TYPE_BOX, 1, 0);
+    ((sscma_client_box_t *)p_data->inference.p_data)[0] =
+        (sscma_client_box_t){ .x = 0x0102, .y = 0x0304, .w = 0x0506, .h = 0x0708, .score = 0x55, .target = 2 };
+    p_data->inference.classes[0] = tf_strdup("cat");
+    p_data->inference.classes[1] = tf_strdup("dog");
+    alarm(p_ins, p_data);
+    assert_out(box, sizeof(box));
+
+    // three classes, two bytes each as the header documents; the names follow right after them
+    const uint8_t classes[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0,
+                                2, 3, 0, 0, 0, 90, 0, 89, 1, 88, 2,
+                                3, 0, 0, 0, 'c', 'l', 'a', 's', 's', ' ', '0', 0, 'c', 'l', 'a', 's', 's', ' ', '1', 0,
+                                'c', 'l', 'a', 's', 's', ' ', '2', 0 };
+    alarm(p_ins, data_new(0, 0, INFERENCE_TYPE_CLASS, 3, 3));
+    assert_out(classes, sizeof(classes));
+
+    // a type the format has no layout for: type 3, no results, the names
+    const uint8_t unknown[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0,
+                                3, 0, 0, 0, 0, 1, 0, 0, 0, 'c', 'l', 'a', 's', 's', ' ', '0', 0 };
+    alarm(p_ins, data_new(0, 0, INFERENCE_TYPE_POINT, 2, 1));
+    assert_out(unknown, sizeof(unknown));
+
+    // an empty box list
+    const uint8_t empty[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 0, 0, 0, 0, 0, 0, 0, 0,
+                              1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    alarm(p_ins, data_new(0, 0, INFERENCE_TYPE_BOX, 0, 0));
+    assert_out(empty, sizeof(empty));
+    module_delete(p_ins);
+
+    // both images, their lengths in front of them
+    p_ins = module_new("{\"output_format\":0,\"text\":\"cat\",\"include_big_image\":true,\"include_small_image\":1}");
+    const uint8_t images[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'c', 'a', 't', 4, 0, 0, 0, 'B', 'I', 'P', 'W',
+                               3, 0, 0, 0, 'C', 'J', 'Q', 0 };
+    alarm(p_ins, data_new(4, 3, -1, 0, 0));
+    assert_out(images, sizeof(images));
+    module_delete(p_ins);
+}
+
+static void test_cfg_update_while_started(void)
+{
+    tf_module_uart_alarm_t *p_ins = module_new("{\"output_format\":0,\"text\":\"cat\"}");
+    cJSON *p_json = cJSON_Parse("{\"output_format\":0,\"text\":\"dog\",\"include_small_image\":true}");
+
+    // the next packet has the new prompt and the small image, no restart in between
+    TEST_ASSERT_NOT_NULL(p_json);
+    TEST_ASSERT_EQUAL(ESP_OK, tf_module_cfg_update(&p_ins->module_base, p_json));
+    cJSON_Delete(p_json);
+    const uint8_t dog[] = { 'S', 'E', 'E', 'E', 'D', 3, 0, 0, 0, 'd', 'o', 'g', 0, 0, 0, 0,
+                            3, 0, 0, 0, 'C', 'J', 'Q', 0 };
+    alarm(p_ins, data_new(4, 3, -1, 0, 0));
+    assert_out(dog, sizeof(dog));
+    module_delete(p_ins);
+}
+
+static void test_json_golden(void)
+{
+    tf_module_uart_alarm_t *p_ins = module_new("{\"output_format\":1,\"text\":\"cat\"}");
+    tf_data_dualimage_with_audio_text_t *p_data;
+
+    alarm(p_ins, data_new(4, 4, -1, 0, 0));
+    assert_out("{\"prompt\":\"cat\"}\r\n", 18);
+
+    p_data = data_new(0, 0, INFERENCE_TYPE_BOX, 1, 0);
+    ((sscma_client_box_t *)p_data->inference.p_data)[0] =
+        (sscma_client_box_t){ .x = 0x0102, .y = 0x0304, .w = 0x0506, .h = 0x0708, .score = 0x55, .target = 2 };
+    p_data->inference.classes[0] = tf_strdup("cat");
+    p_data->inference.classes[1] = tf_strdup("dog");
+    alarm(p_ins, p_data);
+    const char *box = "{\"prompt\":\"cat\",\"inference\":{\"boxes\":[[258,772,1286,1800,85,2]],"
+                      "\"classes_name\":[\"cat\",\"dog\"]}}\r\n";
+    assert_out(box, strlen(box));
+
+    alarm(p_ins, data_new(0, 0, INFERENCE_TYPE_CLASS, 2, 1));
+    const char *classes = "{\"prompt\":\"cat\",\"inference\":{\"classes\":[[90,0],[89,1]],\"classes_name\":[\"class 0\"]}}\r\n";
+    assert_out(classes, strlen(classes));
+
+    alarm(p_ins, data_new(0, 0, INFERENCE_TYPE_POINT, 2, 0));
+    const char *unknown = "{\"prompt\":\"cat\",\"inference\":{\"classes_name\":[]}}\r\n";
+    assert_out(unknown, strlen(unknown));
+    module_delete(p_ins);
+
+    // images as they are, an image asked for but missing is left out; the prompt is escaped
+    p_ins = module_new("{\"output_format\":1,\"text\":\"say \\\"hi\\\"\\n\",\"include_big_image\":true,\"include_small_image\":true}");
+    alarm(p_ins, data_new(4, 3, -1, 0, 0));
+    const char *images = "{\"prompt\":\"say \\\"hi\\\"\\n\",\"big_image\":\"BIPW\",\"small_image\":\"CJQ\"}\r\n";
+    assert_out(images, strlen(images));
+    alarm(p_ins, data_new(0, 3, -1, 0, 0));
+    const char *small = "{\"prompt\":\"say \\\"hi\\\"\\n\",\"small_image\":\"CJQ\"}\r\n";
+    assert_out(small, strlen(small));
+    module_delete(p_ins);
+}
+
+static void test_prompt_from_the_flow(void)
+{
+    // no text: the name of the flow, or nothing when the flow has none
+    tf_module_uart_alarm_t *p_bin = module_new("{\"output_format\":0,\"text\":\"\"}");
+    tf_module_uart_alarm_t *p_json = module_new("{\"output_format\":1}");
+    want_t want = { .p_prompt = "flow name", .type = -1 };
+
+    alarm(p_bin, data_new(0, 0, -1, 0, 0));
+    binary_check(&want);
+    alarm(p_json, data_new(0, 0, -1, 0, 0));
+    json_check(&want);
+
+    s_flow_name = NULL;
+    want.p_prompt = "";
+    alarm(p_bin, data_new(0, 0, -1, 0, 0));
+    binary_check(&want);
+    alarm(p_json, data_new(0, 0, -1, 0, 0));
+    json_check(&want);
+    module_delete(p_bin);
+    module_delete(p_json);
+}
+
+static void test_every_type_both_formats(void)
+{
+    const int types[] = { -1, INFERENCE_TYPE_BOX, INFERENCE_TYPE_CLASS, INFERENCE_TYPE_KEYPOINT };
+    const char *params[] = {
+        "{\"output_format\":%d,\"text\":\"t\"}",
+        "{\"output_format\":%d,\"text\":\"t\",\"include_small_image\":true}",
+        "{\"output_format\":%d,\"text\":\"t\",\"include_big_image\":true,\"include_small_image\":true}",
+    };
+
+    for (int format = 0; format < 2; format++)
+    {
+        for (size_t p = 0; p < sizeof(params) / sizeof(params[0]); p++)
+        {
+            char json[160];
+            snprintf(json, sizeof(json), params[p], format);
+            tf_module_uart_alarm_t *p_ins = module_new(json);
+
+            for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+            {
+                for (int cnt = 0; cnt <= 3; cnt++)
+                {
+                    want_t want = {
+                        .p_prompt = "t",
+                        .big_len = p_ins->include_big_image ? 40 : 0,
+                        .small_len = p_ins->include_small_image ? 30 : 0,
+                        .type = types[t],
+                        .cnt = types[t] == INFERENCE_TYPE_KEYPOINT ? 0 : cnt,
+                        .names = cnt,
+                    };
+                    alarm(p_ins, data_new(40, 30, types[t], cnt, cnt));
+                    if (format == 0)
+                    {
+                        binary_check(&want);
+                    }
+                    else
+                    {
+                        json_check(&want);
+                    }
+                    // nothing here is past the stage size
+                    writes_check(NULL, 0, 0);
+                }
+            }
+            module_delete(p_ins);
+        }
+    }
+}
+
+static void test_fields_past_the_stage_buffer(void)
+{
+    char prompt[301];
+    const int types[] = { INFERENCE_TYPE_BOX, INFERENCE_TYPE_CLASS };
+
+    memset(prompt, 'p', 300);
+    prompt[300] = '\0';
+    for (int format = 0; format < 2; format++)
+    {
+        char json[512];
+        snprintf(json, sizeof(json), "{\"output_format\":%d,\"text\":\"%s\",\"include_big_image\":true,\"include_small_image\":true}",
+                 format, prompt);
+        tf_module_uart_alarm_t *p_ins = module_new(json);
+
+        for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+        {
+            // 40 boxes are 400 bytes, all class names near 200
+            tf_data_dualimage_with_audio_text_t *p_data =
+                data_new(BIG_LEN, SMALL_LEN, types[t], 40, CONFIG_MODEL_CLASSES_MAX_NUM);
+            const void *direct[3] = { p_data->img_large.p_buf, p_data->img_small.p_buf, p_ins->text };
+            want_t want = {
+                .p_prompt = prompt,
+                .big_len = BIG_LEN,
+                .small_len = SMALL_LEN,
+                .type = types[t],
+                .cnt = 40,
+                .names = CONFIG_MODEL_CLASSES_MAX_NUM,
+            };
+
+            alarm(p_ins, p_data);
+            if (format == 0)
+            {
+                binary_check(&want);
+                writes_check(direct, 3, 0);
+            }
+            else
+            {
+                // cJSON prints the prompt and the inference into buffers of their own
+                json_check(&want);
+                writes_check(direct, 2, 2);
+            }
+        }
+        module_delete(p_ins);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_binary_golden);
+    RUN_TEST(test_cfg_update_while_started);
+    RUN_TEST(test_json_golden);
+    RUN_TEST(test_prompt_from_the_flow);
+    RUN_TEST(test_every_type_both_formats);
+    RUN_TEST(test_fields_past_the_stage_buffer);
+    return UNITY_END();
+}
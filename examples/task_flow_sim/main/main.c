@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <malloc.h>
+#include "sim.h"
+#include "tf.h"
+#include "tf_util.h"
+#include "tf_module_util.h"
+#include "tf_module_alarm_trigger.h"
+#include "tf_module_timer.h"
+#include "tf_module_debug.h"
+#include "tf_module_local_alarm.h"
+#include "event_loops.h"
+#include "data_defs.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*
+ * Task flow simulator: runs a flow with the engine, the dispatcher and the
+ * pure-logic modules of the factory firmware, fed by a replayed camera and
+ * drained by latency sinks, then reports per-hop queueing, end to end
+ * latency and memory.
+ */
+
+static const char *TAG = "sim";
+
+#define SIM_HEAP_SAMPLE_MS  10
+
+// glibc serves large blocks such as big images with mmap, outside the arena
+static size_t __heap_used(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+typedef struct sim_args {
+    const char *p_flow;
+    sim_camera_cfg_t camera;
+    int duration_s;
+    int sink_delay_ms;
+} sim_args_t;
+
+// same as __g_module_dispatch_cfgs of app_taskflow.c, keep in sync
+static const struct {
+    const char *p_name;
+    tf_dispatch_cfg_t cfg;
+} __g_module_dispatch_cfgs[] = {
+    { TF_MODULE_AI_CAMERA_NAME,         { TF_DISPATCH_WORKER_FRAME,  4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_ALARM_TRIGGER_NAME,     { TF_DISPATCH_WORKER_FRAME,  4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { TF_MODULE_LOCAL_ALARM_NAME,       { TF_DISPATCH_WORKER_ALARM,  2, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { SIM_MODULE_IMG_ANALYZER_NAME,     { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { SIM_MODULE_SENSECRAFT_ALARM_NAME, { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { SIM_MODULE_UART_ALARM_NAME,       { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+    { SIM_MODULE_HTTP_ALARM_NAME,       { TF_DISPATCH_WORKER_UPLINK, 4, TF_DISPATCH_POLICY_DROP_OLDEST, tf_data_free } },
+};
+
+static int __g_argc;
+static char **__g_argv;
+static SemaphoreHandle_t __g_screen_lock;
+static sim_latency_t __g_screen_latency;
+static volatile int __g_engine_status = TF_STATUS_IDLE;
+
+// app_main gets no arguments on the linux target, glibc hands them to constructors
+static void __attribute__((constructor)) __args_save(int argc, char **argv, char **envp)
+{
+    __g_argc = argc;
+    __g_argv = argv;
+}
+
+static void __usage(const char *p_prog)
+{
+    printf("usage: %s [options] flow.json\n"
+           "  -i FILE   replay inference records, one sscma reply data object per line\n"
+           "  -f FPS    camera frame rate (default 5)\n"
+           "  -t SEC    run time (default 10)\n"
+           "  -d MS     time every uplink sink spends on a frame (default 0)\n"
+           "  -s BYTES  small image size (default 16384)\n"
+           "  -l BYTES  large image size (default 0, none)\n", p_prog);
+}
+
+static int __args_parse(int argc, char **argv, sim_args_t *p_args)
+{
+    int opt;
+
+    memset(p_args, 0, sizeof(sim_args_t));
+    p_args->camera.fps = 5;
+    p_args->camera.img_small_size = 16 * 1024;
+    p_args->duration_s = 10;
+
+    while( (opt = getopt(argc, argv, "i:f:t:d:s:l:h")) != -1 ) {
+        switch (opt)
+        {
+            case 'i': p_args->camera.p_replay = optarg; break;
+            case 'f': p_args->camera.fps = atof(optarg); break;
+            case 't': p_args->duration_s = atoi(optarg); break;
+            case 'd': p_args->sink_delay_ms = atoi(optarg); break;
+            case 's': p_args->camera.img_small_size = atoi(optarg); break;
+            case 'l': p_args->camera.img_large_size = atoi(optarg); break;
+            default:
+                return -1;
+        }
+    }
+    if( optind != argc - 1 || p_args->camera.fps <= 0 || p_args->duration_s <= 0 ) {
+        return -1;
+    }
+    p_args->p_flow = argv[optind];
+    return 0;
+}
+
+static char *__file_read(const char *p_path, size_t *p_len)
+{
+    FILE *fp = fopen(p_path, "rb");
+    char *p_buf = NULL;
+    long len = 0;
+
+    if( fp == NULL ) {
+        return NULL;
+    }
+    if( fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0 ) {
+        p_buf = malloc(len + 1);
+        if( p_buf != NULL && fread(p_buf, 1, len, fp) == (size_t)len ) {
+            p_buf[len] = '\0';
+            *p_len = len;
+        } else {
+            free(p_buf);
+            p_buf = NULL;
+        }
+    }
+    fclose(fp);
+    return p_buf;
+}
+
+// the screen of the firmware: takes over the image and text of local alarm
+static void __view_event_handler(void *handler_args, esp_event_base_t base, int32_t id, void *p_event_data)
+{
+    struct tf_module_local_alarm_info *p_info = (struct tf_module_local_alarm_info *)p_event_data;
+
+    xSemaphoreTake(__g_screen_lock, portMAX_DELAY);
+    sim_latency_add(&__g_screen_latency, &p_info->img);
+    xSemaphoreGive(__g_screen_lock);
+
+    tf_data_image_free(&p_info->img);
+    tf_data_buf_free(&p_info->text);
+}
+
+static void __engine_status_cb(void *p_arg, intmax_t tid, int status, const char *p_err_module)
+{
+    __g_engine_status = status;
+    if( status >= TF_STATUS_ERR_GENERAL ) {
+        ESP_LOGE(TAG, "flow %jd: status %d, module %s", tid, status, p_err_module ? p_err_module : "-");
+    }
+}
+
+static void __report_hops(const char *p_flow)
+{
+    cJSON *p_json = cJSON_Parse(p_flow);
+    cJSON *p_modules = p_json ? cJSON_GetObjectItem(p_json, "task_flow") : NULL;
+    tf_dispatch_stats_t stats;
+
+    printf("per hop (mailbox of each module):\n");
+    for( int i = 0; i < cJSON_GetArraySize(p_modules); i++ ) {
+        cJSON *p_item = cJSON_GetArrayItem(p_modules, i);
+        cJSON *p_id = cJSON_GetObjectItem(p_item, "id");
+        cJSON *p_type = cJSON_GetObjectItem(p_item, "type");
+        if( !cJSON_IsNumber(p_id) || !cJSON_IsString(p_type) ) {
+            continue;
+        }
+        if( tf_dispatch_stats_get(p_id->valueint, &stats) != ESP_OK ) {
+            continue;  // no input, a source
+        }
+        printf("  %-16s #%-4d posted %6" PRIu32 "  dropped %5" PRIu32 "  high water %2" PRIu32
+               "  wait mean %8.2f  max %8.2f ms\n",
+               p_type->valuestring, p_id->valueint, stats.posted, stats.dropped, stats.high_water,
+               stats.handled ? stats.wait_total_us / 1000.0 / stats.handled : 0.0,
+               stats.wait_max_us / 1000.0);
+    }
+    cJSON_Delete(p_json);
+}
+
+static void __report_profile(void)
+{
+    tf_module_profile_t profiles[TF_DISPATCH_MAILBOX_MAX];
+    int64_t window_us = 0;
+    int num = 0;
+
+    tf_engine_profile_get(profiles, TF_DISPATCH_MAILBOX_MAX, &num, &window_us);
+    printf("per module (task flow profile over %.1f s):\n", window_us / 1000000.0);
+    for( int i = 0; i < num; i++ ) {
+        tf_module_profile_t *p = &profiles[i];
+        printf("  %-16s #%-4d events %6" PRIu32 "  run mean %8.2f  max %8.2f ms  cpu %5.1f%%"
+               "  mem %7zu  peak %7zu bytes\n",
+               p->name, p->id, p->events,
+               p->events ? p->run_total_us / 1000.0 / p->events : 0.0, p->run_max_us / 1000.0,
+               window_us > 0 ? p->run_total_us * 100.0 / window_us : 0.0,
+               p->mem_cur_bytes, p->mem_peak_bytes);
+    }
+}
+
+void app_main(void)
+{
+    sim_args_t args;
+    sim_camera_stats_t camera;
+    size_t flow_len = 0;
+    char *p_flow = NULL;
+    size_t heap_base = 0, heap_max = 0;
+
+    if( __args_parse(__g_argc, __g_argv, &args) != 0 ) {
+        __usage(__g_argv[0]);
+        exit(2);
+    }
+    p_flow = __file_read(args.p_flow, &flow_len);
+    if( p_flow == NULL ) {
+        printf("can't read %s\n", args.p_flow);
+        exit(2);
+    }
+
+    esp_event_loop_args_t loop_args = {
+        .queue_size = 16,
+        .task_name = "app_eventloop",
+        .task_priority = 6,
+        .task_stack_size = 1024 * 5,
+        .task_core_id = tskNO_AFFINITY
+    };
+    ESP_ERROR_CHECK(esp_event_loop_create(&loop_args, &app_event_loop_handle));
+    __g_screen_lock = xSemaphoreCreateMutex();
+    ESP_ERROR_CHECK(esp_event_handler_register_with(app_event_loop_handle, VIEW_EVENT_BASE, VIEW_EVENT_ALARM_ON,
+                                                    __view_event_handler, NULL));
+
+    ESP_ERROR_CHECK(tf_engine_init());
+    ESP_ERROR_CHECK(tf_module_timer_register());
+    ESP_ERROR_CHECK(tf_module_debug_register());
+    ESP_ERROR_CHECK(tf_module_alarm_trigger_register());
+    ESP_ERROR_CHECK(tf_module_local_alarm_register());
+    ESP_ERROR_CHECK(tf_module_sim_camera_register(&args.camera));
+    ESP_ERROR_CHECK(tf_module_sim_sink_register(args.sink_delay_ms));
+    for (int i = 0; i < sizeof(__g_module_dispatch_cfgs) / sizeof(__g_module_dispatch_cfgs[0]); i++) {
+        ESP_ERROR_CHECK(tf_module_dispatch_set(__g_module_dispatch_cfgs[i].p_name, &__g_module_dispatch_cfgs[i].cfg));
+    }
+    ESP_ERROR_CHECK(tf_engine_status_cb_register(__engine_status_cb, NULL));
+
+    heap_base = __heap_used();
+    ESP_ERROR_CHECK(tf_engine_flow_set(p_flow, flow_len));
+
+    int64_t end_us = esp_timer_get_time() + (int64_t)args.duration_s * 1000000;
+    while( esp_timer_get_time() < end_us ) {
+        size_t used = __heap_used();
+        if( used > heap_max ) {
+            heap_max = used;
+        }
+        if( __g_engine_status >= TF_STATUS_ERR_GENERAL ) {
+            exit(1);
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_HEAP_SAMPLE_MS));
+    }
+
+    sim_camera_stats_get(&camera);
+    printf("\n%s: %.1f fps, %d s, sink delay %d ms\n", args.p_flow, args.camera.fps, args.duration_s, args.sink_delay_ms);
+    printf("camera: %" PRIu32 " inferences, %" PRIu32 " frames posted, %" PRIu32 " not posted\n",
+           camera.inferences, camera.posted, camera.post_failed);
+    __report_hops(p_flow);
+    __report_profile();
+    printf("end to end (camera to handler):\n");
+    sim_sink_report();
+    xSemaphoreTake(__g_screen_lock, portMAX_DELAY);
+    sim_latency_print("screen", &__g_screen_latency);
+    xSemaphoreGive(__g_screen_lock);
+    printf("memory: heap peak %zu bytes over the flow, frames live max %" PRIu32 " (%" PRIu32 " bytes)\n",
+           heap_max > heap_base ? heap_max - heap_base : 0, camera.frames_live_max, camera.bytes_live_max);
+
+    free(p_flow);
+    tf_engine_stop();
+    vTaskDelay(pdMS_TO_TICKS(500));
+    sim_camera_stats_get(&camera);
+    printf("after stop: %" PRIu32 " frames live, heap %+zd bytes\n",
+           camera.frames_live, (ssize_t)(__heap_used() - heap_base));
+    fflush(stdout);
+    exit(camera.frames_live ? 1 : 0);
+}
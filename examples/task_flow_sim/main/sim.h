@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "tf_module_data_type.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Every image the simulated camera emits carries a sim_frame_t as the
+ * p_ctx of its shared buffer, so any sink down the flow can tell how long
+ * ago the frame left the camera, however many hops it was shared across.
+ */
+typedef struct sim_frame {
+    uint32_t seq;
+    int64_t  t_us;      // esp_timer_get_time() when the camera posted it
+    uint32_t len;       // bytes of the image buffer
+} sim_frame_t;
+
+// names of the firmware modules replaced by tf_module_sim_sink_register()
+#define SIM_MODULE_IMG_ANALYZER_NAME     "image analyzer"
+#define SIM_MODULE_SENSECRAFT_ALARM_NAME "sensecraft alarm"
+#define SIM_MODULE_UART_ALARM_NAME       "uart alarm"
+#define SIM_MODULE_HTTP_ALARM_NAME       "http alarm"
+
+typedef struct sim_camera_cfg {
+    const char *p_replay;        // jsonl of recorded inference, NULL: one box per frame
+    float    fps;
+    uint32_t img_small_size;     // base64 bytes of the small image
+    uint32_t img_large_size;     // 0: no large image
+} sim_camera_cfg_t;
+
+typedef struct sim_camera_stats {
+    uint32_t inferences;         // replayed inference records
+    uint32_t posted;             // frames that passed the silence window
+    uint32_t post_failed;
+    uint32_t frames_live;        // frames whose buffer is still shared by some module
+    uint32_t frames_live_max;
+    uint32_t bytes_live;
+    uint32_t bytes_live_max;
+} sim_camera_stats_t;
+
+#define SIM_LATENCY_SAMPLES_MAX   8192
+
+typedef struct sim_latency {
+    uint32_t num;
+    uint32_t lost;               // samples beyond SIM_LATENCY_SAMPLES_MAX
+    int64_t  max_us;
+    uint32_t *p_samples;         // us
+} sim_latency_t;
+
+/**
+ * Synthetic "ai camera": replays p_cfg->p_replay at p_cfg->fps, each line an
+ * sscma reply data object such as {"boxes":[[x,y,w,h,score,target],...]}.
+ * A record with at least one target is a trigger, subject to the module's
+ * silent_period.silence_duration.
+ */
+esp_err_t tf_module_sim_camera_register(const sim_camera_cfg_t *p_cfg);
+
+void sim_camera_stats_get(sim_camera_stats_t *p_stats);
+
+/**
+ * Latency sinks registered under the names of the uplink modules, which need
+ * a network or uart. Each handler sleeps delay_ms to model a slow sink, the
+ * image analyzer then passes the frame on like the cloud answered at once.
+ */
+esp_err_t tf_module_sim_sink_register(int delay_ms);
+
+/**
+ * Print the frame latency seen by every sink instance.
+ */
+void sim_sink_report(void);
+
+/**
+ * Frame record of an image, NULL if it does not come from the sim camera.
+ */
+const sim_frame_t *sim_frame_get(const struct tf_data_image *p_img);
+
+void sim_latency_add(sim_latency_t *p_lat, const struct tf_data_image *p_img);
+
+void sim_latency_print(const char *p_name, sim_latency_t *p_lat);
+
+void sim_latency_free(sim_latency_t *p_lat);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "tf.h"
+#include "tf_util.h"
+#include "tf_module_util.h"
+#include "tf_module_ai_camera.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "sim.camera";
+
+#define SIM_CAMERA_TASK_STACK_SIZE  1024 * 8
+#define SIM_CAMERA_TASK_PRIO        13   // TF_MODULE_AI_CAMERA_TASK_PRIO
+#define SIM_CAMERA_LINE_MAX         4096
+
+typedef struct tf_module_sim_camera
+{
+    tf_module_t module_base;
+    int id;
+    int *p_output_evt_id;
+    int output_evt_num;
+    SemaphoreHandle_t sem_lock;  // the targets, a flow update may rewire a running camera
+    int silence_duration;        // seconds, silent_period.silence_duration
+    int64_t last_output_us;
+    FILE *p_replay;
+    TaskHandle_t task_handle;
+    SemaphoreHandle_t sem_exit;
+    volatile bool run;
+} tf_module_sim_camera_t;
+
+static sim_camera_cfg_t __g_cfg;
+static sim_camera_stats_t __g_stats;
+static SemaphoreHandle_t __g_stats_lock;
+static uint32_t __g_seq;
+
+/*************************************************************************
+ * Frames
+ ************************************************************************/
+
+static void __frame_release(uint8_t *p_buf, void *p_ctx)
+{
+    sim_frame_t *p_frame = (sim_frame_t *)p_ctx;
+    uint32_t len = p_frame->len;
+
+    xSemaphoreTake(__g_stats_lock, portMAX_DELAY);
+    __g_stats.frames_live--;
+    __g_stats.bytes_live -= len;
+    xSemaphoreGive(__g_stats_lock);
+
+    tf_free(p_buf);
+    tf_free(p_frame);
+}
+
+static int __frame_image(struct tf_data_image *p_img, uint32_t len, sim_frame_t *p_frame)
+{
+    uint8_t *p_buf = tf_malloc(len + 1);
+    if( p_buf == NULL ) {
+        return -1;
+    }
+    memset(p_buf, 'A', len);  // valid base64 of zeros, for sinks that decode it
+    p_buf[len] = '\0';
+    p_frame->len = len;
+
+    if( tf_data_image_wrap(p_img, p_buf, len, time(NULL), __frame_release, p_frame) != 0 ) {
+        tf_free(p_buf);
+        return -1;
+    }
+
+    xSemaphoreTake(__g_stats_lock, portMAX_DELAY);
+    __g_stats.frames_live++;
+    __g_stats.bytes_live += len;
+    if( __g_stats.frames_live > __g_stats.frames_live_max ) {
+        __g_stats.frames_live_max = __g_stats.frames_live;
+    }
+    if( __g_stats.bytes_live > __g_stats.bytes_live_max ) {
+        __g_stats.bytes_live_max = __g_stats.bytes_live;
+    }
+    xSemaphoreGive(__g_stats_lock);
+    return 0;
+}
+
+const sim_frame_t *sim_frame_get(const struct tf_data_image *p_img)
+{
+    if( p_img->p_ref == NULL || p_img->p_ref->release != __frame_release ) {
+        return NULL;
+    }
+    return (const sim_frame_t *)p_img->p_ref->p_ctx;
+}
+
+/*************************************************************************
+ * Replay
+ ************************************************************************/
+
+// one line of the replay file, either the sscma reply or only its data object
+static void __inference_parse(const char *p_line, struct tf_data_inference_info *p_inference)
+{
+    memset(p_inference, 0, sizeof(struct tf_data_inference_info));
+
+    cJSON *p_json = cJSON_Parse(p_line);
+    if( p_json == NULL ) {
+        ESP_LOGW(TAG, "skip invalid record: %.32s", p_line);
+        return;
+    }
+    cJSON *p_data = cJSON_GetObjectItem(p_json, "data");
+    if( p_data == NULL ) {
+        p_data = p_json;
+    }
+
+    cJSON *p_boxes = cJSON_GetObjectItem(p_data, "boxes");
+    cJSON *p_classes = cJSON_GetObjectItem(p_data, "classes");
+    int num = 0;
+
+    if( cJSON_IsArray(p_boxes) && (num = cJSON_GetArraySize(p_boxes)) > 0 ) {
+        sscma_client_box_t *p_box = tf_malloc(sizeof(sscma_client_box_t) * num);
+        if( p_box != NULL ) {
+            for( int i = 0; i < num; i++ ) {
+                cJSON *p_item = cJSON_GetArrayItem(p_boxes, i);
+                p_box[i].x = cJSON_GetArrayItem(p_item, 0)->valueint;
+                p_box[i].y = cJSON_GetArrayItem(p_item, 1)->valueint;
+                p_box[i].w = cJSON_GetArrayItem(p_item, 2)->valueint;
+                p_box[i].h = cJSON_GetArrayItem(p_item, 3)->valueint;
+                p_box[i].score = cJSON_GetArrayItem(p_item, 4)->valueint;
+                p_box[i].target = cJSON_GetArrayItem(p_item, 5)->valueint;
+            }
+            p_inference->type = INFERENCE_TYPE_BOX;
+            p_inference->p_data = p_box;
+            p_inference->cnt = num;
+        }
+    } else if( cJSON_IsArray(p_classes) && (num = cJSON_GetArraySize(p_classes)) > 0 ) {
+        sscma_client_class_t *p_class = tf_malloc(sizeof(sscma_client_class_t) * num);
+        if( p_class != NULL ) {
+            for( int i = 0; i < num; i++ ) {
+                cJSON *p_item = cJSON_GetArrayItem(p_classes, i);
+                p_class[i].score = cJSON_GetArrayItem(p_item, 0)->valueint;
+                p_class[i].target = cJSON_GetArrayItem(p_item, 1)->valueint;
+            }
+            p_inference->type = INFERENCE_TYPE_CLASS;
+            p_inference->p_data = p_class;
+            p_inference->cnt = num;
+        }
+    }
+    p_inference->is_valid = true;
+    cJSON_Delete(p_json);
+}
+
+static void __inference_next(tf_module_sim_camera_t *p_module_ins, char *p_line,
+                             struct tf_data_inference_info *p_inference)
+{
+    if( p_module_ins->p_replay == NULL ) {
+        static const sscma_client_box_t box = { .x = 208, .y = 208, .w = 64, .h = 128, .score = 90, .target = 0 };
+        memset(p_inference, 0, sizeof(struct tf_data_inference_info));
+        p_inference->p_data = tf_malloc(sizeof(box));
+        if( p_inference->p_data != NULL ) {
+            memcpy(p_inference->p_data, &box, sizeof(box));
+            p_inference->type = INFERENCE_TYPE_BOX;
+            p_inference->cnt = 1;
+            p_inference->is_valid = true;
+        }
+        return;
+    }
+
+    if( fgets(p_line, SIM_CAMERA_LINE_MAX, p_module_ins->p_replay) == NULL ) {
+        rewind(p_module_ins->p_replay);  // loop the recording
+        if( fgets(p_line, SIM_CAMERA_LINE_MAX, p_module_ins->p_replay) == NULL ) {
+            p_line[0] = '\0';
+        }
+    }
+    __inference_parse(p_line, p_inference);
+}
+
+static void __output(tf_module_sim_camera_t *p_module_ins, struct tf_data_inference_info *p_inference)
+{
+    tf_data_dualimage_with_inference_t output_data;
+    struct tf_data_image img_small = {0};
+    struct tf_data_image img_large = {0};
+    sim_frame_t *p_frame = tf_malloc(sizeof(sim_frame_t));
+
+    if( p_frame == NULL ) {
+        return;
+    }
+    p_frame->seq = __g_seq++;
+    p_frame->t_us = esp_timer_get_time();
+    if( __frame_image(&img_small, __g_cfg.img_small_size, p_frame) != 0 ) {
+        tf_free(p_frame);
+        return;
+    }
+    if( __g_cfg.img_large_size ) {
+        sim_frame_t *p_frame_large = tf_malloc(sizeof(sim_frame_t));
+        if( p_frame_large != NULL ) {
+            *p_frame_large = *p_frame;
+            if( __frame_image(&img_large, __g_cfg.img_large_size, p_frame_large) != 0 ) {
+                tf_free(p_frame_large);
+            }
+        }
+    }
+
+    p_module_ins->last_output_us = p_frame->t_us;
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    for( int i = 0; i < p_module_ins->output_evt_num; i++ ) {
+        memset(&output_data, 0, sizeof(output_data));
+        output_data.type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE;
+        tf_data_image_share(&output_data.img_small, &img_small);
+        if( img_large.p_buf != NULL ) {
+            tf_data_image_share(&output_data.img_large, &img_large);
+        }
+        tf_data_inference_copy(&output_data.inference, p_inference);
+
+        // same timeout as the ai camera, a full mailbox costs the frame, not the camera
+        esp_err_t ret = tf_event_post(p_module_ins->p_output_evt_id[i], &output_data, sizeof(output_data), pdMS_TO_TICKS(1));
+        xSemaphoreTake(__g_stats_lock, portMAX_DELAY);
+        if( ret != ESP_OK ) {
+            __g_stats.post_failed++;
+        } else {
+            __g_stats.posted++;
+        }
+        xSemaphoreGive(__g_stats_lock);
+        if( ret != ESP_OK ) {
+            ESP_LOGD(TAG, "Failed to post event %d", p_module_ins->p_output_evt_id[i]);
+            tf_data_free(&output_data);
+        }
+    }
+    xSemaphoreGive(p_module_ins->sem_lock);
+    tf_data_image_free(&img_small);
+    tf_data_image_free(&img_large);
+}
+
+static void __camera_task(void *p_arg)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_arg;
+    struct tf_data_inference_info inference;
+    char *p_line = tf_malloc(SIM_CAMERA_LINE_MAX);
+    TickType_t period = pdMS_TO_TICKS(1000.0f / __g_cfg.fps);
+    TickType_t last_wake = xTaskGetTickCount();
+
+    if( period == 0 ) {
+        period = 1;
+    }
+    // frames count against the camera in the task flow profile
+    tf_owner_set(p_module_ins->id);
+    while( p_module_ins->run && p_line != NULL ) {
+        vTaskDelayUntil(&last_wake, period);
+
+        __inference_next(p_module_ins, p_line, &inference);
+        xSemaphoreTake(__g_stats_lock, portMAX_DELAY);
+        __g_stats.inferences++;
+        xSemaphoreGive(__g_stats_lock);
+
+        int64_t now = esp_timer_get_time();
+        bool silent = p_module_ins->last_output_us != 0 &&
+                      (now - p_module_ins->last_output_us) < (int64_t)p_module_ins->silence_duration * 1000000;
+        if( inference.cnt > 0 && !silent ) {
+            __output(p_module_ins, &inference);
+        }
+        tf_data_inference_free(&inference);
+    }
+    tf_free(p_line);
+    tf_owner_set(TF_OWNER_NONE);
+    xSemaphoreGive(p_module_ins->sem_exit);
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ * Interface implementation
+ ************************************************************************/
+
+static int __start(void *p_module)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_module;
+
+    if( __g_cfg.p_replay != NULL ) {
+        p_module_ins->p_replay = fopen(__g_cfg.p_replay, "r");
+        ESP_RETURN_ON_FALSE(p_module_ins->p_replay, ESP_ERR_NOT_FOUND, TAG, "can't open %s", __g_cfg.p_replay);
+    }
+    p_module_ins->sem_exit = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(p_module_ins->sem_exit, ESP_ERR_NO_MEM, TAG, "no mem");
+
+    p_module_ins->run = true;
+    if( xTaskCreate(__camera_task, "sim_camera", SIM_CAMERA_TASK_STACK_SIZE, p_module_ins,
+                    SIM_CAMERA_TASK_PRIO, &p_module_ins->task_handle) != pdPASS ) {
+        p_module_ins->run = false;
+        return ESP_FAIL;
+    }
+    return 0;
+}
+static int __stop(void *p_module)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_module;
+
+    if( p_module_ins->task_handle ) {
+        p_module_ins->run = false;
+        xSemaphoreTake(p_module_ins->sem_exit, portMAX_DELAY);
+        p_module_ins->task_handle = NULL;
+    }
+    if( p_module_ins->sem_exit ) {
+        vSemaphoreDelete(p_module_ins->sem_exit);
+        p_module_ins->sem_exit = NULL;
+    }
+    if( p_module_ins->p_replay ) {
+        fclose(p_module_ins->p_replay);
+        p_module_ins->p_replay = NULL;
+    }
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    tf_free(p_module_ins->p_output_evt_id);
+    p_module_ins->p_output_evt_id = NULL;
+    p_module_ins->output_evt_num = 0;
+    xSemaphoreGive(p_module_ins->sem_lock);
+    return 0;
+}
+static int __cfg(void *p_module, cJSON *p_json)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_module;
+    cJSON *p_silent = cJSON_GetObjectItem(p_json, "silent_period");
+    cJSON *p_duration = p_silent ? cJSON_GetObjectItem(p_silent, "silence_duration") : NULL;
+
+    p_module_ins->silence_duration = 0;
+    if( p_duration != NULL && cJSON_IsNumber(p_duration) ) {
+        p_module_ins->silence_duration = p_duration->valueint;
+    }
+    return 0;
+}
+static int __msgs_sub_set(void *p_module, int evt_id)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_module;
+
+    // the shutter input of the ai camera is not simulated, frames follow the fps
+    p_module_ins->id = evt_id;
+    return 0;
+}
+static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int num)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)p_module;
+    if( output_index != 0 ) {
+        return 0;
+    }
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    tf_free(p_module_ins->p_output_evt_id);
+    p_module_ins->p_output_evt_id = NULL;
+    p_module_ins->output_evt_num = 0;
+    if( num > 0 ) {
+        p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
+        if( p_module_ins->p_output_evt_id ) {
+            memcpy(p_module_ins->p_output_evt_id, p_evt_id, sizeof(int) * num);
+            p_module_ins->output_evt_num = num;
+        }
+    }
+    xSemaphoreGive(p_module_ins->sem_lock);
+    return 0;
+}
+
+const static struct tf_module_ops  __g_module_ops = {
+    .start = __start,
+    .stop = __stop,
+    .cfg = __cfg,
+    .msgs_sub_set = __msgs_sub_set,
+    .msgs_pub_set = __msgs_pub_set
+};
+
+static tf_module_t * __module_instance(void)
+{
+    tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *) tf_malloc(sizeof(tf_module_sim_camera_t));
+    if (p_module_ins == NULL)
+    {
+        return NULL;
+    }
+    memset(p_module_ins, 0, sizeof(tf_module_sim_camera_t));
+    p_module_ins->sem_lock = xSemaphoreCreateMutex();
+    if (p_module_ins->sem_lock == NULL)
+    {
+        tf_free(p_module_ins);
+        return NULL;
+    }
+    p_module_ins->module_base.p_module = p_module_ins;
+    p_module_ins->module_base.ops = &__g_module_ops;
+    return &p_module_ins->module_base;
+}
+
+static  void __module_destroy(tf_module_t *handle)
+{
+    if( handle ) {
+        tf_module_sim_camera_t *p_module_ins = (tf_module_sim_camera_t *)handle->p_module;
+        vSemaphoreDelete(p_module_ins->sem_lock);
+        free(handle->p_module);
+    }
+}
+
+const static  struct tf_module_mgmt __g_module_mgmt = {
+    .tf_module_instance = __module_instance,
+    .tf_module_destroy = __module_destroy,
+};
+
+static const tf_module_io_t __g_module_io = {
+    .input_types = TF_DATA_TYPE_MASK_ANY,
+    .output_port_num = 1,
+    .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE) },
+};
+
+/*************************************************************************
+ * API
+ ************************************************************************/
+
+esp_err_t tf_module_sim_camera_register(const sim_camera_cfg_t *p_cfg)
+{
+    ESP_RETURN_ON_FALSE(p_cfg && p_cfg->fps > 0, ESP_ERR_INVALID_ARG, TAG, "invalid cfg");
+
+    __g_cfg = *p_cfg;
+    __g_stats_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(__g_stats_lock, ESP_ERR_NO_MEM, TAG, "no mem");
+
+    esp_err_t ret = tf_module_register(TF_MODULE_AI_CAMERA_NAME,
+                                       "simulated ai camera",
+                                       "1.0.0",
+                                       &__g_module_mgmt);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return tf_module_io_set(TF_MODULE_AI_CAMERA_NAME, &__g_module_io);
+}
+
+void sim_camera_stats_get(sim_camera_stats_t *p_stats)
+{
+    xSemaphoreTake(__g_stats_lock, portMAX_DELAY);
+    *p_stats = __g_stats;
+    xSemaphoreGive(__g_stats_lock);
+}
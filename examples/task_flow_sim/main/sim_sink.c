@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/queue.h>
+#include "sim.h"
+#include "tf.h"
+#include "tf_util.h"
+#include "tf_module_util.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "sim.sink";
+
+typedef struct tf_module_sim_sink
+{
+    tf_module_t module_base;
+    const char *p_name;
+    int input_evt_id;
+    int *p_output_evt_id;
+    int output_evt_num;
+    SemaphoreHandle_t sem_lock;  // the targets, a flow update may rewire a running module
+    sim_latency_t latency;
+    SLIST_ENTRY(tf_module_sim_sink) next;
+} tf_module_sim_sink_t;
+
+static SLIST_HEAD(, tf_module_sim_sink) __g_sinks = SLIST_HEAD_INITIALIZER(__g_sinks);
+static SemaphoreHandle_t __g_sinks_lock;
+static int __g_delay_ms;
+
+/*************************************************************************
+ * Latency
+ ************************************************************************/
+
+void sim_latency_add(sim_latency_t *p_lat, const struct tf_data_image *p_img)
+{
+    const sim_frame_t *p_frame = sim_frame_get(p_img);
+    if( p_frame == NULL ) {
+        return;
+    }
+    int64_t us = esp_timer_get_time() - p_frame->t_us;
+
+    if( p_lat->p_samples == NULL ) {
+        p_lat->p_samples = malloc(sizeof(uint32_t) * SIM_LATENCY_SAMPLES_MAX);
+    }
+    if( p_lat->p_samples != NULL && p_lat->num < SIM_LATENCY_SAMPLES_MAX ) {
+        p_lat->p_samples[p_lat->num++] = (uint32_t)us;
+    } else {
+        p_lat->lost++;
+    }
+    if( us > p_lat->max_us ) {
+        p_lat->max_us = us;
+    }
+}
+
+static int __cmp_u32(const void *p_a, const void *p_b)
+{
+    uint32_t a = *(const uint32_t *)p_a;
+    uint32_t b = *(const uint32_t *)p_b;
+    return a < b ? -1 : a > b;
+}
+
+void sim_latency_print(const char *p_name, sim_latency_t *p_lat)
+{
+    if( p_lat->num == 0 ) {
+        printf("  %-24s no frames\n", p_name);
+        return;
+    }
+    qsort(p_lat->p_samples, p_lat->num, sizeof(uint32_t), __cmp_u32);
+    printf("  %-24s %6" PRIu32 " frames  p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms\n",
+           p_name, p_lat->num + p_lat->lost,
+           p_lat->p_samples[p_lat->num * 50 / 100] / 1000.0,
+           p_lat->p_samples[p_lat->num * 90 / 100] / 1000.0,
+           p_lat->p_samples[p_lat->num * 99 / 100] / 1000.0,
+           p_lat->max_us / 1000.0);
+}
+
+void sim_latency_free(sim_latency_t *p_lat)
+{
+    free(p_lat->p_samples);
+    memset(p_lat, 0, sizeof(sim_latency_t));
+}
+
+/*************************************************************************
+ * Sink
+ ************************************************************************/
+
+static void __forward(tf_module_sim_sink_t *p_module_ins, tf_data_dualimage_with_inference_t *p_data)
+{
+    tf_data_dualimage_with_audio_text_t output_data;
+
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    for( int i = 0; i < p_module_ins->output_evt_num; i++ ) {
+        memset(&output_data, 0, sizeof(output_data));
+        output_data.type = TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT;
+        tf_data_image_share(&output_data.img_small, &p_data->img_small);
+        if( p_data->img_large.p_buf != NULL ) {
+            tf_data_image_share(&output_data.img_large, &p_data->img_large);
+        }
+        tf_data_inference_copy(&output_data.inference, &p_data->inference);
+
+        esp_err_t ret = tf_event_post(p_module_ins->p_output_evt_id[i], &output_data, sizeof(output_data), pdMS_TO_TICKS(10000));
+        if( ret != ESP_OK ) {
+            ESP_LOGE(TAG, "Failed to post event %d", p_module_ins->p_output_evt_id[i]);
+            tf_data_free(&output_data);
+        }
+    }
+    xSemaphoreGive(p_module_ins->sem_lock);
+}
+
+static void __event_handler(void *handler_args, esp_event_base_t base, int32_t id, void *p_event_data)
+{
+    tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *)handler_args;
+    uint32_t type = ((uint32_t *)p_event_data)[0];
+    struct tf_data_image *p_img = NULL;
+
+    if( type == TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE ) {
+        p_img = &((tf_data_dualimage_with_inference_t *)p_event_data)->img_small;
+    } else if( type == TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT ) {
+        p_img = &((tf_data_dualimage_with_audio_text_t *)p_event_data)->img_small;
+    }
+    if( p_img != NULL ) {
+        xSemaphoreTake(__g_sinks_lock, portMAX_DELAY);
+        sim_latency_add(&p_module_ins->latency, p_img);
+        xSemaphoreGive(__g_sinks_lock);
+    }
+
+    if( __g_delay_ms > 0 ) {
+        vTaskDelay(pdMS_TO_TICKS(__g_delay_ms));
+    }
+    if( type == TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE ) {
+        __forward(p_module_ins, (tf_data_dualimage_with_inference_t *)p_event_data);
+    }
+    tf_data_free(p_event_data);
+}
+
+/*************************************************************************
+ * Interface implementation
+ ************************************************************************/
+
+static int __start(void *p_module)
+{
+    return 0;
+}
+static int __stop(void *p_module)
+{
+    tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *)p_module;
+    tf_event_handler_unregister(p_module_ins->input_evt_id, __event_handler);
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    tf_free(p_module_ins->p_output_evt_id);
+    p_module_ins->p_output_evt_id = NULL;
+    p_module_ins->output_evt_num = 0;
+    xSemaphoreGive(p_module_ins->sem_lock);
+    return 0;
+}
+static int __cfg(void *p_module, cJSON *p_json)
+{
+    return 0;
+}
+static int __msgs_sub_set(void *p_module, int evt_id)
+{
+    tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *)p_module;
+    p_module_ins->input_evt_id = evt_id;
+    return tf_event_handler_register(evt_id, __event_handler, p_module_ins);
+}
+static int __msgs_pub_set(void *p_module, int output_index, int *p_evt_id, int num)
+{
+    tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *)p_module;
+    if( output_index != 0 ) {
+        return 0;
+    }
+    xSemaphoreTake(p_module_ins->sem_lock, portMAX_DELAY);
+    tf_free(p_module_ins->p_output_evt_id);
+    p_module_ins->p_output_evt_id = NULL;
+    p_module_ins->output_evt_num = 0;
+    if( num > 0 ) {
+        p_module_ins->p_output_evt_id = (int *)tf_malloc(sizeof(int) * num);
+        if( p_module_ins->p_output_evt_id ) {
+            memcpy(p_module_ins->p_output_evt_id, p_evt_id, sizeof(int) * num);
+            p_module_ins->output_evt_num = num;
+        }
+    }
+    xSemaphoreGive(p_module_ins->sem_lock);
+    return 0;
+}
+
+const static struct tf_module_ops  __g_module_ops = {
+    .start = __start,
+    .stop = __stop,
+    .cfg = __cfg,
+    .msgs_sub_set = __msgs_sub_set,
+    .msgs_pub_set = __msgs_pub_set
+};
+
+static tf_module_t * __module_instance(const char *p_name)
+{
+    tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *) tf_malloc(sizeof(tf_module_sim_sink_t));
+    if (p_module_ins == NULL)
+    {
+        return NULL;
+    }
+    memset(p_module_ins, 0, sizeof(tf_module_sim_sink_t));
+    p_module_ins->sem_lock = xSemaphoreCreateMutex();
+    if (p_module_ins->sem_lock == NULL)
+    {
+        tf_free(p_module_ins);
+        return NULL;
+    }
+    p_module_ins->p_name = p_name;
+    p_module_ins->module_base.p_module = p_module_ins;
+    p_module_ins->module_base.ops = &__g_module_ops;
+
+    xSemaphoreTake(__g_sinks_lock, portMAX_DELAY);
+    SLIST_INSERT_HEAD(&__g_sinks, p_module_ins, next);
+    xSemaphoreGive(__g_sinks_lock);
+    return &p_module_ins->module_base;
+}
+
+static  void __module_destroy(tf_module_t *handle)
+{
+    if( handle ) {
+        tf_module_sim_sink_t *p_module_ins = (tf_module_sim_sink_t *)handle->p_module;
+        xSemaphoreTake(__g_sinks_lock, portMAX_DELAY);
+        SLIST_REMOVE(&__g_sinks, p_module_ins, tf_module_sim_sink, next);
+        xSemaphoreGive(__g_sinks_lock);
+        sim_latency_free(&p_module_ins->latency);
+        vSemaphoreDelete(p_module_ins->sem_lock);
+        free(p_module_ins);
+    }
+}
+
+static tf_module_t * __img_analyzer_instance(void)
+{
+    return __module_instance(SIM_MODULE_IMG_ANALYZER_NAME);
+}
+static tf_module_t * __sensecraft_alarm_instance(void)
+{
+    return __module_instance(SIM_MODULE_SENSECRAFT_ALARM_NAME);
+}
+static tf_module_t * __uart_alarm_instance(void)
+{
+    return __module_instance(SIM_MODULE_UART_ALARM_NAME);
+}
+static tf_module_t * __http_alarm_instance(void)
+{
+    return __module_instance(SIM_MODULE_HTTP_ALARM_NAME);
+}
+
+// same names and io as the firmware modules, so recorded flows load unchanged
+static const struct {
+    const char *p_name;
+    struct tf_module_mgmt mgmt;
+    tf_module_io_t io;
+} __g_sinks_def[] = {
+    { SIM_MODULE_IMG_ANALYZER_NAME,
+      { __img_analyzer_instance, __module_destroy },
+      { .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE),
+        .output_port_num = 1,
+        .output_types = { TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) } } },
+    { SIM_MODULE_SENSECRAFT_ALARM_NAME,
+      { __sensecraft_alarm_instance, __module_destroy },
+      { .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) } },
+    { SIM_MODULE_UART_ALARM_NAME,
+      { __uart_alarm_instance, __module_destroy },
+      { .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) } },
+    { SIM_MODULE_HTTP_ALARM_NAME,
+      { __http_alarm_instance, __module_destroy },
+      { .input_types = TF_DATA_TYPE_MASK(TF_DATA_TYPE_DUALIMAGE_WITH_INFERENCE_AUDIO_TEXT) } },
+};
+
+/*************************************************************************
+ * API
+ ************************************************************************/
+
+esp_err_t tf_module_sim_sink_register(int delay_ms)
+{
+    esp_err_t ret = ESP_OK;
+
+    __g_delay_ms = delay_ms;
+    __g_sinks_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(__g_sinks_lock, ESP_ERR_NO_MEM, TAG, "no mem");
+
+    for( int i = 0; i < sizeof(__g_sinks_def) / sizeof(__g_sinks_def[0]); i++ ) {
+        ret = tf_module_register(__g_sinks_def[i].p_name, "simulated sink", "1.0.0", &__g_sinks_def[i].mgmt);
+        ESP_RETURN_ON_ERROR(ret, TAG, "register %s", __g_sinks_def[i].p_name);
+        ret = tf_module_io_set(__g_sinks_def[i].p_name, &__g_sinks_def[i].io);
+        ESP_RETURN_ON_ERROR(ret, TAG, "io %s", __g_sinks_def[i].p_name);
+    }
+    return ESP_OK;
+}
+
+void sim_sink_report(void)
+{
+    tf_module_sim_sink_t *p_module_ins;
+    char name[48];
+
+    xSemaphoreTake(__g_sinks_lock, portMAX_DELAY);
+    SLIST_FOREACH(p_module_ins, &__g_sinks, next) {
+        snprintf(name, sizeof(name), "%s #%d", p_module_ins->p_name, p_module_ins->input_evt_id);
+        sim_latency_print(name, &p_module_ins->latency);
+    }
+    xSemaphoreGive(__g_sinks_lock);
+}
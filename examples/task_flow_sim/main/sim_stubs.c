@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "event_loops.h"
+#include "app_rgb.h"
+#include "app_audio_player.h"
+
+/*
+ * Firmware services the simulated modules call into: the app event loop,
+ * rgb and audio as no-ops, and esp_timer on FreeRTOS software timers.
+ */
+
+static const char *TAG = "sim.stubs";
+
+ESP_EVENT_DEFINE_BASE(VIEW_EVENT_BASE);
+
+esp_event_loop_handle_t app_event_loop_handle;
+
+void app_rgb_set(int caller, rgb_service_t service)
+{
+    ESP_LOGD(TAG, "rgb %d", service);
+}
+
+int app_audio_player_status_get(void)
+{
+    return AUDIO_PLAYER_STATUS_IDLE;
+}
+
+esp_err_t app_audio_player_file(void *p_filepath)
+{
+    ESP_LOGD(TAG, "play %s", (char *)p_filepath);
+    return ESP_OK;
+}
+
+esp_err_t app_audio_player_mem(uint8_t *p_buf, size_t len, bool is_need_free)
+{
+    if( is_need_free ) {
+        free(p_buf);
+    }
+    return ESP_OK;
+}
+
+/*************************************************************************
+ * esp_timer
+ ************************************************************************/
+
+struct esp_timer
+{
+    TimerHandle_t timer;
+    esp_timer_cb_t callback;
+    void *arg;
+};
+
+static void __timer_cb(TimerHandle_t timer)
+{
+    struct esp_timer *p_timer = (struct esp_timer *)pvTimerGetTimerID(timer);
+    p_timer->callback(p_timer->arg);
+}
+
+static TickType_t __us_to_ticks(uint64_t us)
+{
+    TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+    return ticks ? ticks : 1;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    ESP_RETURN_ON_FALSE(create_args && create_args->callback && out_handle, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+
+    struct esp_timer *p_timer = calloc(1, sizeof(struct esp_timer));
+    ESP_RETURN_ON_FALSE(p_timer, ESP_ERR_NO_MEM, TAG, "no mem");
+    p_timer->callback = create_args->callback;
+    p_timer->arg = create_args->arg;
+    p_timer->timer = xTimerCreate(create_args->name ? create_args->name : "esp_timer",
+                                  1, pdFALSE, p_timer, __timer_cb);
+    if( p_timer->timer == NULL ) {
+        free(p_timer);
+        return ESP_ERR_NO_MEM;
+    }
+    *out_handle = p_timer;
+    return ESP_OK;
+}
+
+static esp_err_t __timer_start(esp_timer_handle_t timer, uint64_t us, bool periodic)
+{
+    ESP_RETURN_ON_FALSE(timer, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+    vTimerSetReloadMode(timer->timer, periodic ? pdTRUE : pdFALSE);
+    if( xTimerChangePeriod(timer->timer, __us_to_ticks(us), portMAX_DELAY) != pdPASS ) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return __timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return __timer_start(timer, period, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    ESP_RETURN_ON_FALSE(timer, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+    if( !xTimerIsTimerActive(timer->timer) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTimerStop(timer->timer, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    ESP_RETURN_ON_FALSE(timer, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+    xTimerDelete(timer->timer, portMAX_DELAY);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && xTimerIsTimerActive(timer->timer);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}